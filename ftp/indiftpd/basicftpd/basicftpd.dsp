@@ -91,6 +91,10 @@ SOURCE=.\basicmain.cpp
 # End Source File
 # Begin Source File
 
+SOURCE=..\core\AsciiXlate.cpp
+# End Source File
+# Begin Source File
+
 SOURCE=..\core\BlowfishCrypt.cpp
 # End Source File
 # Begin Source File
@@ -103,6 +107,10 @@ SOURCE=..\core\Crypto.cpp
 # End Source File
 # Begin Source File
 
+SOURCE=..\core\DirCache.cpp
+# End Source File
+# Begin Source File
+
 SOURCE=..\core\Dll.cpp
 # End Source File
 # Begin Source File
@@ -123,6 +131,10 @@ SOURCE=..\core\Log.cpp
 # End Source File
 # Begin Source File
 
+SOURCE=..\core\LogQueue.cpp
+# End Source File
+# Begin Source File
+
 SOURCE=..\core\Service.cpp
 # End Source File
 # Begin Source File
@@ -155,14 +167,26 @@ SOURCE=..\core\Thr.cpp
 # End Source File
 # Begin Source File
 
+SOURCE=..\core\ThrPool.cpp
+# End Source File
+# Begin Source File
+
 SOURCE=..\core\Timer.cpp
 # End Source File
+# Begin Source File
+
+SOURCE=..\core\TokenBucket.cpp
+# End Source File
 # End Group
 # Begin Group "Header Files"
 
 # PROP Default_Filter "h;hpp;hxx;hm;inl"
 # Begin Source File
 
+SOURCE=..\core\AsciiXlate.h
+# End Source File
+# Begin Source File
+
 SOURCE=..\core\BlowfishCrypt.h
 # End Source File
 # Begin Source File
@@ -175,6 +199,10 @@ SOURCE=..\core\Crypto.h
 # End Source File
 # Begin Source File
 
+SOURCE=..\core\DirCache.h
+# End Source File
+# Begin Source File
+
 SOURCE=..\core\Dll.h
 # End Source File
 # Begin Source File
@@ -195,6 +223,10 @@ SOURCE=..\core\Log.h
 # End Source File
 # Begin Source File
 
+SOURCE=..\core\LogQueue.h
+# End Source File
+# Begin Source File
+
 SOURCE=..\core\Service.h
 # End Source File
 # Begin Source File
@@ -227,8 +259,16 @@ SOURCE=..\core\Thr.h
 # End Source File
 # Begin Source File
 
+SOURCE=..\core\ThrPool.h
+# End Source File
+# Begin Source File
+
 SOURCE=..\core\Timer.h
 # End Source File
+# Begin Source File
+
+SOURCE=..\core\TokenBucket.h
+# End Source File
 # End Group
 # Begin Group "Resource Files"
 
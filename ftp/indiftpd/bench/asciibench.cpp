@@ -0,0 +1,243 @@
+// Copyright (C) 2026 The indiftpd contributors
+//
+// This program is free software; you can redistribute it and/or
+// modify it under the terms of the GNU General Public License
+// as published by the Free Software Foundation; either version 2
+// of the License, or (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program; if not, write to the Free Software
+// Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.
+//
+//
+// asciibench.cpp: benchmark for the ASCII mode (TYPE A) translation.
+//
+// Compares CAsciiXlate with the BtoA()/AtoU() routines it replaced in
+// CFtpsXfer (they are copied below).  The data is translated in
+// FTPSXFER_MAXPACKETSIZE blocks, the same as in a transfer, and the
+// output of both versions is checked to be the same.
+//
+// Usage: asciibench [MB of text] [passes]
+//
+//////////////////////////////////////////////////////////////////////
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "../core/AsciiXlate.h"
+#include "../core/Timer.h"
+#include "../core/FtpsXfer.h"
+
+//////////////////////////////////////////////////////////////////////
+// Previous translation routines (from CFtpsXfer)
+//////////////////////////////////////////////////////////////////////
+
+static char *_oldbtoa(char lastchar, char *inbuf, int inbufsize, int *outbufsize) {
+    char *outbuf = NULL;
+    int i, nlcount = 0, noutbuf = 0;
+
+    if (outbufsize != NULL)
+        *outbufsize = 0;    //initialize the out buffer size
+
+    if (inbuf == NULL || inbufsize == 0)
+        return(NULL);
+
+    if (*inbuf == '\n' && lastchar != '\r')
+        nlcount++;
+    for (i = 1; i < inbufsize; i++) {
+        if (*(inbuf+i) == '\n' && *(inbuf+i-1) != '\r')
+            nlcount++;
+    }
+
+    if ((outbuf = (char *)malloc(inbufsize+nlcount)) == NULL)
+        return(NULL);
+
+        //copy data to the new buffer
+    if (*inbuf == '\n' && lastchar != '\r') {
+        memcpy(outbuf,"\r\n",2);
+        noutbuf+= 2;
+    } else {
+        *outbuf = *inbuf;
+        noutbuf++;
+    }
+    for (i = 1; i < inbufsize; i++) {
+        if (*(inbuf+i) == '\n' && *(inbuf+i-1) != '\r') {
+            memcpy(outbuf+noutbuf,"\r\n",2);
+            noutbuf += 2;
+        } else {
+            *(outbuf + noutbuf) = *(inbuf + i);
+            noutbuf++;
+        }
+    }
+
+    if (outbufsize != NULL)
+        *outbufsize = noutbuf;
+    
+    return(outbuf);
+}
+
+static char *_oldatou(char *inbuf, int inbufsize, int *outbufsize) {
+    char *outbuf = NULL;
+    int i, noutbuf = 0;
+
+    if (outbufsize != NULL)
+        *outbufsize = 0;    //initialize the out buffer size
+
+    if (inbuf == NULL || inbufsize == 0)
+        return(NULL);
+
+    if ((outbuf = (char *)malloc(inbufsize)) == NULL)
+        return(NULL);
+
+        //copy data to the new buffer
+    for (i = 0; i < inbufsize; i++) {
+        if (*(inbuf+i) == '\r') {
+            if (i < (inbufsize-1)) {
+                if (*(inbuf+i+1) != '\n') {
+                    *(outbuf + noutbuf) = *(inbuf+i);   //keep only '\r' w/o following '\n'
+                    noutbuf++;
+                }
+            }
+        } else {
+            *(outbuf + noutbuf) = *(inbuf+i);
+            noutbuf++;
+        }
+    }
+
+    if (outbufsize != NULL)
+        *outbufsize = noutbuf;
+
+    return(outbuf);
+}
+
+//////////////////////////////////////////////////////////////////////
+// Benchmark
+//////////////////////////////////////////////////////////////////////
+
+    //Fills "buf" with lines of text (line lengths of 1 to 120 chars)
+static void _maketext(char *buf, int bufsize)
+{
+    int i, linelen = 0;
+
+    srand(1);
+    for (i = 0; i < bufsize; i++) {
+        if (linelen == 0) {
+            linelen = 1 + rand() % 120;
+            buf[i] = '\n';
+        } else {
+            buf[i] = 'a' + rand() % 26;
+            linelen--;
+        }
+    }
+}
+
+    //Translates "inbuf" block by block w/ the old (flagnew = 0) or new
+    //(flagnew != 0) routines.  If "outbuf" is not NULL the output is
+    //stored in it.  Returns the size of the output.
+static long _translate(int flagnew, int flagtolf, char *inbuf, long inbufsize, char *outbuf)
+{
+    CAsciiXlate asciixlate;
+    char lastchar = ' ', *tmppacket;
+    int packetlen, tmppacketlen;
+    long i, noutbuf = 0;
+
+    for (i = 0; i < inbufsize; i += packetlen) {
+        packetlen = (inbufsize - i < FTPSXFER_MAXPACKETSIZE) ? (int)(inbufsize - i) : FTPSXFER_MAXPACKETSIZE;
+        if (flagnew == 0) {
+            if (flagtolf == 0) {
+                tmppacket = _oldbtoa(lastchar,inbuf+i,packetlen,&tmppacketlen);
+                lastchar = tmppacket[tmppacketlen-1];
+            } else {
+                tmppacket = _oldatou(inbuf+i,packetlen,&tmppacketlen);
+            }
+        } else {
+            if (flagtolf == 0)
+                tmppacket = asciixlate.ToCRLF(inbuf+i,packetlen,&tmppacketlen);
+            else
+                tmppacket = asciixlate.ToLF(inbuf+i,packetlen,&tmppacketlen);
+        }
+        if (outbuf != NULL)
+            memcpy(outbuf+noutbuf,tmppacket,tmppacketlen);
+        noutbuf += tmppacketlen;
+        if (flagnew == 0)
+            free(tmppacket);
+    }
+
+    return(noutbuf);
+}
+
+    //Runs "npasses" translations and returns the speed in MB/s
+static double _run(int flagnew, int flagtolf, char *inbuf, long inbufsize, int npasses)
+{
+    CTimer timer;
+    unsigned long ltime1, ltime2;
+    double sec;
+    int i;
+
+    ltime1 = timer.Get();
+    for (i = 0; i < npasses; i++)
+        _translate(flagnew,flagtolf,inbuf,inbufsize,NULL);
+    ltime2 = timer.Get();
+
+    sec = timer.DiffSec(ltime1,ltime2);
+    return((sec > 0) ? ((double)inbufsize * npasses / (1024.0 * 1024.0)) / sec : 0);
+}
+
+int main(int argc, char **argv)
+{
+    char *lfbuf, *crlfbuf, *oldbuf, *newbuf;
+    long lfsize, crlfsize, oldsize, newsize;
+    double oldspeed, newspeed;
+    int npasses;
+
+    lfsize = ((argc > 1) ? atol(argv[1]) : 64) * 1024 * 1024;
+    npasses = (argc > 2) ? atoi(argv[2]) : 5;
+    if (lfsize <= 0 || npasses <= 0) {
+        printf("Usage: %s [MB of text] [passes]\n",argv[0]);
+        return(1);
+    }
+
+    lfbuf = (char *)malloc(lfsize);
+    crlfbuf = (char *)malloc(2*lfsize);
+    oldbuf = (char *)malloc(2*lfsize);
+    newbuf = (char *)malloc(2*lfsize);
+    if (lfbuf == NULL || crlfbuf == NULL || oldbuf == NULL || newbuf == NULL) {
+        printf("ERROR: out of memory.\n");
+        return(1);
+    }
+
+    _maketext(lfbuf,lfsize);
+    crlfsize = _translate(1,0,lfbuf,lfsize,crlfbuf);
+
+    printf("ASCII translation of %ld MB in %d byte blocks (%s)\n",lfsize/(1024*1024),FTPSXFER_MAXPACKETSIZE,
+           (ASCIIXLATE_VECSIZE == 32) ? "AVX2" : ((ASCIIXLATE_VECSIZE == 16) ? "SSE2" : "no SIMD"));
+
+        //check that both versions give the same output
+    oldsize = _translate(0,0,lfbuf,lfsize,oldbuf);
+    newsize = _translate(1,0,lfbuf,lfsize,newbuf);
+    if (oldsize != newsize || memcmp(oldbuf,newbuf,newsize) != 0) {
+        printf("ERROR: \\n -> \\r\\n output differs.\n");
+        return(1);
+    }
+    oldsize = _translate(0,1,crlfbuf,crlfsize,oldbuf);
+    newsize = _translate(1,1,crlfbuf,crlfsize,newbuf);
+    if (oldsize != newsize || memcmp(oldbuf,newbuf,newsize) != 0) {
+        printf("ERROR: \\r\\n -> \\n output differs.\n");
+        return(1);
+    }
+
+    oldspeed = _run(0,0,lfbuf,lfsize,npasses);
+    newspeed = _run(1,0,lfbuf,lfsize,npasses);
+    printf("\\n -> \\r\\n (RETR): old %8.1f MB/s  new %8.1f MB/s  (x%.1f)\n",oldspeed,newspeed,(oldspeed > 0) ? newspeed/oldspeed : 0);
+    oldspeed = _run(0,1,crlfbuf,crlfsize,npasses);
+    newspeed = _run(1,1,crlfbuf,crlfsize,npasses);
+    printf("\\r\\n -> \\n (STOR): old %8.1f MB/s  new %8.1f MB/s  (x%.1f)\n",oldspeed,newspeed,(oldspeed > 0) ? newspeed/oldspeed : 0);
+
+    free(lfbuf); free(crlfbuf); free(oldbuf); free(newbuf);
+    return(0);
+}
@@ -0,0 +1,838 @@
+// Copyright (C) 2026 The indiftpd contributors
+//
+// This program is free software; you can redistribute it and/or
+// modify it under the terms of the GNU General Public License
+// as published by the Free Software Foundation; either version 2
+// of the License, or (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program; if not, write to the Free Software
+// Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.
+//
+//
+// ftpbench.cpp: load generator for the FTP servers (IndiFTPD and
+//               BasicFTPD).
+//
+// Starts the server given on the command line in a directory of test
+// files (or uses a server that is already running) and runs each mix
+// of commands with many clients on the loopback interface.  Each client
+// logs in, runs a number of commands from the mix (PASV data
+// connections), logs out and starts a new session.  The clients use the
+// same socket classes as the server (CSock and CSSLSock).
+//
+// Mixes: l = LIST of a directory with _NSMALLFILES files
+//        s = small files (3 RETR and 1 STOR of _SMALLSIZE bytes)
+//        b = big files (RETR and STOR of _BIGSIZE bytes)
+// The uploaded files are deleted (DELE) after each STOR.  Overwriting
+// the same files instead is much slower on some file systems (Ex. ext4
+// writes a truncated file to the disk when it is closed).
+//        x = mixed (LIST, small files and 1 big RETR in 9 commands)
+//
+// For each mix the sessions/sec, transfers/sec, throughput, median and
+// 99th percentile latency of the commands (time to the first reply),
+// the errors and the CPU and memory (RSS) used by the server are shown.
+// The server's CPU and memory are read from /proc (Linux only).
+//
+// Usage: ftpbench [options] [server [server options]]
+//
+// Example: ftpbench -c32 -n10 ../indiftpd/indiftpd -p2121 -Rrwx -e -L0
+//          ftpbench -mls ../basicftpd/basicftpd 2121
+//
+//////////////////////////////////////////////////////////////////////
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#ifdef WIN32
+  #include <direct.h>   //for _mkdir()
+#else
+  #include <unistd.h>
+  #include <signal.h>
+  #include <sys/types.h>
+  #include <sys/stat.h>
+  #include <sys/wait.h>
+#endif
+
+#include "../core/Sock.h"
+#include "../core/SSLSock.h"
+#include "../core/Thr.h"
+#include "../core/Timer.h"
+#include "../core/TokenBucket.h"
+
+#define _DEFPORT        "2121"          //default port of the server
+#define _DEFDIR         "ftpbench.root" //default directory of the test files (the server's CWD)
+#define _NSMALLFILES    200             //number of small files (listed by the "l" mix)
+#define _SMALLSIZE      4096            //size of the small files
+#define _BIGSIZE        8388608         //size of the big file (8MB)
+#define _BUFSIZE        65536           //size of the data connection reads
+#define _MAXLINE        1024            //max length of a reply line
+#define _MAXCLIENTS     1024            //max number of clients
+#define _MAXMIXOPS      16              //max number of commands in a mix
+#define _TIMEOUT        10              //max sec to wait for a reply or data
+#define _STOPWAIT       60              //max sec to wait for the clients to finish their last command
+
+    //commands run by the clients
+#define _OPLIST     0
+#define _OPGETSMALL 1
+#define _OPPUTSMALL 2
+#define _OPGETBIG   3
+#define _OPPUTBIG   4
+
+typedef struct {
+    char letter;            //letter of the mix (-m option)
+    const char *name;
+    int nops;               //number of commands in "ops"
+    int ops[_MAXMIXOPS];    //commands run in turn by each client
+} _Mix_t;
+
+static const _Mix_t _mixes[] = {
+    {'l',"list",1,{_OPLIST}},
+    {'s',"small",4,{_OPGETSMALL,_OPGETSMALL,_OPPUTSMALL,_OPGETSMALL}},
+    {'b',"big",2,{_OPGETBIG,_OPPUTBIG}},
+    {'x',"mixed",9,{_OPLIST,_OPGETSMALL,_OPGETSMALL,_OPPUTSMALL,_OPLIST,_OPGETSMALL,_OPGETSMALL,_OPPUTSMALL,_OPGETBIG}},
+    {'\0',NULL,0,{0}}
+};
+
+typedef struct {
+    int id;                     //client number
+    unsigned long nextop;       //next command of the mix (continues across sessions)
+    long nsessions;             //number of sessions completed
+    long nxfers;                //number of transfers completed
+    long nerrors;               //number of failed sessions
+    long ndataconns;            //number of SSL data connections
+    long nresumed;              //number of SSL data connections that resumed the session
+    double nbytes;              //bytes transferred
+    unsigned long *latency;     //latency (usec) of the commands
+    long nlatency;
+    long maxlatency;
+    char *buf;                  //data connection buffer
+} _Client_t;
+
+    //control connection of a session
+typedef struct {
+    SOCKET sd;
+    sslsock_t *pssl;            //NULL = clear text
+} _Ctrl_t;
+
+static CThr _thr;
+static thrSync_t _mutexthreads;
+static int _nthreads;
+static volatile int _flagstop;
+
+    //options
+static const char *_port = _DEFPORT;
+static const char *_user = "anonymous";
+static const char *_pass = "ftpbench@";
+static int _nclients = 16;
+static int _nsec = 5;
+static int _opspersession = 20;
+static int _flagssl;
+static int _flagascii;
+static const _Mix_t *_mix;
+
+    //contents of the files: text lines ending in "\n" (binary and
+    //downloads) and "\r\n" (ASCII uploads)
+static char *_filedata;
+static char *_filedatacrlf;
+static long _filedatacrlfsize;
+
+//////////////////////////////////////////////////////////////////////
+// Test files
+//////////////////////////////////////////////////////////////////////
+
+    //Fills "buf" with lines of text ending in "eol"
+static long _filltext(char *buf, long size, const char *eol)
+{
+    static const char chars[] = "abcdefghijklmnopqrstuvwxyzABCDEFGHIJKLMNOPQRSTUVWXYZ0123456789";
+    long i, linelen = 0, eollen = strlen(eol);
+
+    for (i = 0; i < size; i++) {
+        if (linelen == 60 && i + eollen <= size) {
+            memcpy(buf+i,eol,eollen);
+            i += eollen - 1;
+            linelen = 0;
+        } else {
+            buf[i] = chars[(i * 7) % (sizeof(chars) - 1)];
+            linelen++;
+        }
+    }
+    return(size);
+}
+
+    //Writes "size" bytes of "data" to "path"
+static int _writefile(const char *path, const char *data, long size)
+{
+    FILE *fp;
+    int retval;
+
+    if ((fp = fopen(path,"wb")) == NULL)
+        return(0);
+    retval = (fwrite(data,1,size,fp) == (size_t)size);
+    if (fclose(fp) != 0)
+        retval = 0;
+    return(retval);
+}
+
+    //Creates the test files in "dir" (small/, big.txt and up/)
+static int _makefiles(const char *dir)
+{
+    char path[1024];
+    int i;
+
+    #ifdef WIN32
+      _mkdir(dir);
+    #else
+      mkdir(dir,0755);
+    #endif
+    sprintf(path,"%.900s/small",dir);
+    #ifdef WIN32
+      _mkdir(path);
+    #else
+      mkdir(path,0755);
+    #endif
+    sprintf(path,"%.900s/up",dir);
+    #ifdef WIN32
+      _mkdir(path);
+    #else
+      mkdir(path,0755);
+    #endif
+
+    for (i = 0; i < _NSMALLFILES; i++) {
+        sprintf(path,"%.900s/small/f%03d.txt",dir,i);
+        if (_writefile(path,_filedata,_SMALLSIZE) == 0)
+            return(0);
+    }
+    sprintf(path,"%.900s/big.txt",dir);
+    return(_writefile(path,_filedata,_BIGSIZE));
+}
+
+//////////////////////////////////////////////////////////////////////
+// Server
+//////////////////////////////////////////////////////////////////////
+
+    //Returns 1 if a connection can be made to the server
+static int _checkserver()
+{
+    CSock sock;
+    SOCKET sd;
+
+    if ((sd = sock.OpenClient("127.0.0.1",_port,2)) == SOCK_INVALID)
+        return(0);
+    sock.Close(sd);
+    return(1);
+}
+
+#ifndef WIN32
+
+    //Starts the server "args" in "dir".  Returns the PID of the server
+    //(0 on failure).
+static long _startserver(char **args, const char *dir)
+{
+    CTimer timer;
+    char cwd[1024], *path = NULL;
+    pid_t pid;
+    int i, status;
+
+        //the server runs in "dir"
+    if (strchr(args[0],'/') != NULL && args[0][0] != '/' && getcwd(cwd,sizeof(cwd)) != NULL) {
+        if ((path = (char *)malloc(strlen(cwd)+strlen(args[0])+2)) == NULL)
+            return(0);
+        sprintf(path,"%s/%s",cwd,args[0]);
+        args[0] = path;
+    }
+
+    if ((pid = fork()) < 0) {
+        if (path != NULL) free(path);
+        return(0);
+    }
+    if (pid == 0) {
+        if (chdir(dir) != 0 || freopen("server.out","w",stdout) == NULL || freopen("server.out","a",stderr) == NULL)
+            _exit(127);
+        execvp(args[0],args);
+        _exit(127);
+    }
+    if (path != NULL) free(path);
+
+        //wait for the server to listen
+    for (i = 0; i < 100; i++) {
+        if (waitpid(pid,&status,WNOHANG) == pid)
+            return(0);  //the server exited
+        if (_checkserver() != 0)
+            return((long)pid);
+        timer.Sleep(100);
+    }
+    kill(pid,SIGKILL);
+    waitpid(pid,&status,0);
+    return(0);
+}
+
+    //Stops the server started by _startserver()
+static void _stopserver(long pid)
+{
+    CTimer timer;
+    int i, status;
+
+    kill((pid_t)pid,SIGTERM);
+    for (i = 0; i < 50; i++) {
+        if (waitpid((pid_t)pid,&status,WNOHANG) == (pid_t)pid)
+            return;
+        timer.Sleep(100);
+    }
+    kill((pid_t)pid,SIGKILL);
+    waitpid((pid_t)pid,&status,0);
+}
+
+#endif //WIN32
+
+    //Gets the CPU time (sec) and the current and peak RSS (MB) of the
+    //server.  Returns 0 if they are not available.
+static int _serverstats(long pid, double *cpusec, double *rssmb, double *peakmb)
+{
+#ifdef LINUX
+    char path[64], line[1024], *ptr;
+    unsigned long utime, stime;
+    long kb;
+    FILE *fp;
+    int i, n;
+
+    *cpusec = *rssmb = *peakmb = 0;
+    if (pid <= 0)
+        return(0);
+
+        //utime and stime are the 14th and 15th fields of /proc/<pid>/stat
+    sprintf(path,"/proc/%ld/stat",pid);
+    if ((fp = fopen(path,"r")) == NULL)
+        return(0);
+    n = fread(line,1,sizeof(line)-1,fp);
+    fclose(fp);
+    line[(n > 0) ? n : 0] = '\0';
+    if ((ptr = strrchr(line,')')) == NULL)
+        return(0);
+    for (i = 0; i < 12 && ptr != NULL; i++)
+        ptr = strchr(ptr+1,' ');
+    if (ptr == NULL || sscanf(ptr,"%lu %lu",&utime,&stime) != 2)
+        return(0);
+    *cpusec = (double)(utime + stime) / sysconf(_SC_CLK_TCK);
+
+    sprintf(path,"/proc/%ld/status",pid);
+    if ((fp = fopen(path,"r")) == NULL)
+        return(0);
+    while (fgets(line,sizeof(line),fp) != NULL) {
+        if (sscanf(line,"VmRSS: %ld",&kb) == 1)
+            *rssmb = kb / 1024.0;
+        else if (sscanf(line,"VmHWM: %ld",&kb) == 1)
+            *peakmb = kb / 1024.0;
+    }
+    fclose(fp);
+    return(1);
+#else
+    return(0);
+#endif
+}
+
+//////////////////////////////////////////////////////////////////////
+// Clients
+//////////////////////////////////////////////////////////////////////
+
+    //Adds the latency of a command
+static void _addlatency(_Client_t *pclient, tokenbucketTime_t timestart)
+{
+    unsigned long *latency;
+    long maxlatency;
+
+    if (pclient->nlatency == pclient->maxlatency) {
+        maxlatency = (pclient->maxlatency > 0) ? 2 * pclient->maxlatency : 4096;
+        if ((latency = (unsigned long *)realloc(pclient->latency,maxlatency*sizeof(unsigned long))) == NULL)
+            return;
+        pclient->latency = latency;
+        pclient->maxlatency = maxlatency;
+    }
+    pclient->latency[pclient->nlatency++] = (unsigned long)(CTokenBucket::GetTimeUSec() - timestart);
+}
+
+    //Waits up to _TIMEOUT sec for data on a connection.  Returns 0 on
+    //timeout (Ex. the server dropped a connection from a full listen
+    //queue after the client saw it as established).
+static int _waitdata(SOCKET sd, sslsock_t *pssl)
+{
+    CSock sock;
+
+    #ifdef ENABLE_SSL
+      if (pssl != NULL && SSL_pending(pssl->ssl) > 0)
+          return(1);
+    #endif
+    return((sock.CheckStatus(sd,_TIMEOUT) > 0) ? 1 : 0);
+}
+
+    //Receives a reply.  The last line of the reply is copied to "reply"
+    //(if not NULL).  Returns the reply code (0 on failure).
+static int _recvreply(_Ctrl_t *pctrl, char *reply, int maxreply)
+{
+    CSock sock;
+    CSSLSock sslsock;
+    char line[_MAXLINE];
+    int n;
+
+    for (;;) {
+        if (_waitdata(pctrl->sd,pctrl->pssl) == 0)
+            return(0);
+        if (pctrl->pssl != NULL)
+            n = sslsock.SSLRecvLn(pctrl->pssl,line,sizeof(line));
+        else
+            n = sock.RecvLn(pctrl->sd,line,sizeof(line));
+        if (n <= 0)
+            return(0);
+            //the last line starts with the code followed by a space
+        if (strlen(line) >= 4 && line[0] >= '1' && line[0] <= '5' && line[3] == ' ')
+            break;
+    }
+    if (reply != NULL) {
+        reply[0] = '\0';
+        strncat(reply,line,maxreply-1);
+    }
+    return(atoi(line));
+}
+
+    //Sends a command and receives the reply (the time to the reply is
+    //the command's latency).  Returns the reply code (0 on failure).
+static int _command(_Client_t *pclient, _Ctrl_t *pctrl, const char *command, char *reply = NULL, int maxreply = 0)
+{
+    CSock sock;
+    CSSLSock sslsock;
+    tokenbucketTime_t timestart;
+    char line[_MAXLINE];
+    int n, code;
+
+    n = sprintf(line,"%.*s\r\n",_MAXLINE-3,command);
+    timestart = CTokenBucket::GetTimeUSec();
+    if (pctrl->pssl != NULL) {
+        if (sslsock.SSLSendN(pctrl->pssl,line,n) != n)
+            return(0);
+    } else if (sock.SendN(pctrl->sd,line,n) != n) {
+        return(0);
+    }
+    if ((code = _recvreply(pctrl,reply,maxreply)) > 0)
+        _addlatency(pclient,timestart);
+    return(code);
+}
+
+    //Runs a command that uses a data connection.  Returns 1 on success.
+static int _xfer(_Client_t *pclient, _Ctrl_t *pctrl, int op)
+{
+    CSock sock;
+    CSSLSock sslsock;
+    sslsock_t *pdatassl = NULL;
+    SOCKET datasd;
+    char command[128], reply[256], host[32], port[16], *ptr;
+    const char *data = _filedata;
+    long size = 0, nsent, nbytes = 0;
+    int h1, h2, h3, h4, p1, p2, n, errcode, retval = 1;
+
+    switch (op) {
+        case _OPLIST:
+            strcpy(command,"LIST small");
+            break;
+        case _OPGETSMALL:
+            sprintf(command,"RETR small/f%03lu.txt",(pclient->nextop * 7 + pclient->id) % _NSMALLFILES);
+            break;
+        case _OPPUTSMALL:
+            sprintf(command,"STOR up/c%d_%lu.txt",pclient->id,pclient->nextop);
+            size = _SMALLSIZE;
+            break;
+        case _OPGETBIG:
+            strcpy(command,"RETR big.txt");
+            break;
+        case _OPPUTBIG:
+            sprintf(command,"STOR up/c%d_%lu.txt",pclient->id,pclient->nextop);
+            size = _BIGSIZE;
+            break;
+        default:
+            return(0);
+    }
+    if (size > 0 && _flagascii != 0) {
+        data = _filedatacrlf;   //the server removes the '\r'
+        size = (size == _BIGSIZE) ? _filedatacrlfsize : _SMALLSIZE;
+    }
+
+        //open a passive data connection
+    if (_command(pclient,pctrl,"PASV",reply,sizeof(reply)) != 227)
+        return(0);
+    if ((ptr = strchr(reply,'(')) == NULL ||
+        sscanf(ptr+1,"%d,%d,%d,%d,%d,%d",&h1,&h2,&h3,&h4,&p1,&p2) != 6)
+        return(0);
+    sprintf(host,"%d.%d.%d.%d",h1,h2,h3,h4);
+    sprintf(port,"%d",p1 * 256 + p2);
+    if ((datasd = sock.OpenClient(host,port,10)) == SOCK_INVALID)
+        return(0);
+
+    if (_command(pclient,pctrl,command) / 100 != 1) {
+        sock.Close(datasd);
+        return(0);
+    }
+    if (pctrl->pssl != NULL) {
+            //resume the session of the control connection
+        if ((pdatassl = sslsock.SSLClientNeg(datasd,&errcode,3,pctrl->pssl)) == NULL) {
+            sock.Close(datasd);
+            _recvreply(pctrl,NULL,0);
+            return(0);
+        }
+        pclient->ndataconns++;
+        if (sslsock.IsSessionReused(pdatassl) != 0)
+            pclient->nresumed++;
+    }
+
+    if (size > 0) {
+        for (nbytes = 0; nbytes < size; nbytes += nsent) {
+            n = (size - nbytes > _BUFSIZE) ? _BUFSIZE : (int)(size - nbytes);
+            nsent = (pdatassl != NULL) ? sslsock.SSLSendN(pdatassl,data+nbytes,n) : sock.SendN(datasd,data+nbytes,n);
+            if (nsent != n) {
+                retval = 0;
+                break;
+            }
+        }
+    } else {
+        for (;;) {
+            if (_waitdata(datasd,pdatassl) == 0) {
+                retval = 0;
+                break;
+            }
+            n = (pdatassl != NULL) ? sslsock.SSLRecvN(pdatassl,pclient->buf,_BUFSIZE) : sock.RecvN(datasd,pclient->buf,_BUFSIZE);
+            if (n < 0)
+                retval = 0;
+            if (n <= 0)
+                break;
+            nbytes += n;
+            if (n < _BUFSIZE)
+                break;  //end of the data
+        }
+    }
+
+    if (pdatassl != NULL) {
+        sslsock.SSLClose(pdatassl);
+        sslsock.FreeSSLInfo(pdatassl);
+    }
+    sock.Close(datasd);
+
+    if (_recvreply(pctrl,NULL,0) / 100 != 2 || retval == 0)
+        return(0);
+    if (size > 0) {
+        command[0] = 'D'; command[1] = 'E'; command[2] = 'L'; command[3] = 'E';
+        if (_command(pclient,pctrl,command) != 250)
+            return(0);
+    }
+    pclient->nxfers++;
+    pclient->nbytes += nbytes;
+    return(1);
+}
+
+    //Runs one session (login, _opspersession commands and logout).
+    //Returns 1 on success.
+static int _session(_Client_t *pclient)
+{
+    CSock sock;
+    CSSLSock sslsock;
+    _Ctrl_t ctrl;
+    tokenbucketTime_t timestart;
+    char command[128];
+    int i, code, errcode, retval = 0;
+
+        //the greeting is the latency of the connection
+    timestart = CTokenBucket::GetTimeUSec();
+    if ((ctrl.sd = sock.OpenClient("127.0.0.1",_port,10)) == SOCK_INVALID)
+        return(0);
+    ctrl.pssl = NULL;
+    if (_recvreply(&ctrl,NULL,0) != 220)
+        goto done;
+    _addlatency(pclient,timestart);
+
+    if (_flagssl != 0) {
+        if (_command(pclient,&ctrl,"AUTH SSL") != 234)
+            goto done;
+        if ((ctrl.pssl = sslsock.SSLClientNeg(ctrl.sd,&errcode,3)) == NULL)
+            goto done;
+        if (_command(pclient,&ctrl,"PBSZ 0") != 200 || _command(pclient,&ctrl,"PROT P") != 200)
+            goto done;
+    }
+
+    sprintf(command,"USER %.100s",_user);
+    code = _command(pclient,&ctrl,command);
+    if (code == 331) {
+        sprintf(command,"PASS %.100s",_pass);
+        code = _command(pclient,&ctrl,command);
+    }
+    if (code != 230)
+        goto done;
+    if (_command(pclient,&ctrl,(_flagascii != 0) ? "TYPE A" : "TYPE I") != 200)
+        goto done;
+
+    for (i = 0; i < _opspersession && _flagstop == 0; i++) {
+        if (_xfer(pclient,&ctrl,_mix->ops[pclient->nextop % _mix->nops]) == 0)
+            goto done;
+        pclient->nextop++;
+    }
+
+    if (_command(pclient,&ctrl,"QUIT") == 221)
+        retval = 1;
+
+  done:
+    if (ctrl.pssl != NULL) {
+        sslsock.SSLClose(ctrl.pssl);
+        sslsock.FreeSSLInfo(ctrl.pssl);
+    }
+    sock.Close(ctrl.sd);
+    return(retval);
+}
+
+    //Runs sessions until _flagstop is set
+#ifdef WIN32
+  static void _clientthread(void *vpclient)
+#else
+  static void *_clientthread(void *vpclient)
+#endif
+{
+    _Client_t *pclient = (_Client_t *)vpclient;
+
+    while (_flagstop == 0) {
+        if (_session(pclient) != 0) {
+            pclient->nsessions++;
+        } else {
+            pclient->nerrors++;
+            pclient->nextop++;  //skip the failed command
+        }
+    }
+
+    _thr.P(&_mutexthreads);
+    _nthreads--;
+    _thr.V(&_mutexthreads);
+
+    #ifndef WIN32
+      return(NULL);
+    #endif
+}
+
+//////////////////////////////////////////////////////////////////////
+// Benchmark
+//////////////////////////////////////////////////////////////////////
+
+static int _cmplatency(const void *p1, const void *p2)
+{
+    unsigned long l1 = *(const unsigned long *)p1, l2 = *(const unsigned long *)p2;
+
+    return((l1 < l2) ? -1 : (l1 > l2) ? 1 : 0);
+}
+
+    //Runs the mix with all the clients for _nsec and prints the results
+static void _run(_Client_t *clients, long serverpid)
+{
+    CTimer timer;
+    tokenbucketTime_t timestart;
+    double sec, cpustart, cpuend, rss, peak, nbytes = 0;
+    long nsessions = 0, nxfers = 0, nerrors = 0, ndataconns = 0, nresumed = 0, nlatency = 0;
+    unsigned long *latency;
+    int i, flagstats, nwait;
+
+    for (i = 0; i < _nclients; i++) {
+        clients[i].nextop = 0;
+        clients[i].nsessions = clients[i].nxfers = clients[i].nerrors = 0;
+        clients[i].ndataconns = clients[i].nresumed = 0;
+        clients[i].nbytes = 0;
+        clients[i].nlatency = 0;
+    }
+
+    _flagstop = 0;
+    _nthreads = 0;
+    flagstats = _serverstats(serverpid,&cpustart,&rss,&peak);
+    timestart = CTokenBucket::GetTimeUSec();
+    for (i = 0; i < _nclients; i++) {
+        _thr.P(&_mutexthreads);
+        _nthreads++;
+        _thr.V(&_mutexthreads);
+        if (_thr.Create(_clientthread,(void *)&clients[i]) == 0) {
+            _thr.P(&_mutexthreads);
+            _nthreads--;
+            _thr.V(&_mutexthreads);
+        }
+    }
+    timer.Sleep(_nsec * 1000);
+    _flagstop = 1;
+        //the clients finish the command they are running
+    for (nwait = 0; _nthreads > 0 && nwait < _STOPWAIT * 100; nwait++)
+        timer.Sleep(10);
+    sec = (double)(CTokenBucket::GetTimeUSec() - timestart) / 1000000.0;
+    if (flagstats != 0)
+        flagstats = _serverstats(serverpid,&cpuend,&rss,&peak);
+
+    for (i = 0; i < _nclients; i++) {
+        nsessions += clients[i].nsessions;
+        nxfers += clients[i].nxfers;
+        nerrors += clients[i].nerrors;
+        ndataconns += clients[i].ndataconns;
+        nresumed += clients[i].nresumed;
+        nbytes += clients[i].nbytes;
+        nlatency += clients[i].nlatency;
+    }
+    if ((latency = (unsigned long *)malloc((nlatency+1)*sizeof(unsigned long))) == NULL)
+        return;
+    for (i = 0, nlatency = 0; i < _nclients; i++) {
+        memcpy(latency+nlatency,clients[i].latency,clients[i].nlatency*sizeof(unsigned long));
+        nlatency += clients[i].nlatency;
+    }
+    qsort(latency,nlatency,sizeof(unsigned long),_cmplatency);
+    if (nlatency == 0)
+        latency[0] = 0;
+
+    printf("%-6s %9.1f %9.1f %8.1f %7.2f %7.2f %6ld",_mix->name,nsessions/sec,nxfers/sec,nbytes/sec/1048576,
+           latency[nlatency/2]/1000.0,latency[(nlatency > 0) ? (nlatency*99)/100 : 0]/1000.0,nerrors);
+    if (flagstats != 0)
+        printf(" %6.0f%% %7.1f %7.1f",100*(cpuend-cpustart)/sec,rss,peak);
+    else
+        printf(" %7s %7s %7s","-","-","-");
+    if (_flagssl != 0)
+        printf(" %6.0f%%",(ndataconns > 0) ? 100.0*nresumed/ndataconns : 0.0);
+    printf("\n");
+    if (_nthreads > 0)
+        printf("WARNING: %d clients did not finish in %d sec\n",_nthreads,_STOPWAIT);
+    fflush(stdout);
+
+    free(latency);
+}
+
+static void _usage(const char *progname)
+{
+    printf("Usage: %s [options] [server [server options]]\n",progname);
+    printf("-p<port>      port of the server (default = %s)\n",_DEFPORT);
+    printf("-c<clients>   number of clients (default = 16, max = %d)\n",_MAXCLIENTS);
+    printf("-n<sec>       seconds each mix is run (default = 5)\n");
+    printf("-o<commands>  data commands in each session (default = 20)\n");
+    printf("-m<mixes>     mixes to run (default = lsbx)\n");
+    printf("              l = LIST, s = small files, b = big files, x = mixed\n");
+    printf("-a            ASCII mode (TYPE A)\n");
+    printf("-e            explicit SSL (AUTH SSL, PROT P)\n");
+    printf("-U<user>      user name (default = anonymous)\n");
+    printf("-P<password>  password (default = ftpbench@)\n");
+    printf("-d<dir>       directory of the test files (default = %s)\n",_DEFDIR);
+    printf("The server is started in <dir> (it must allow LIST, RETR, STOR and DELE in\n");
+    printf("its CWD).  If no server is given, a server already running on the\n");
+    printf("port with its home directory in <dir> is used.\n");
+    printf("Example: %s -c32 -e ../indiftpd/indiftpd -p2121 -Rrwx -e -L0\n",progname);
+}
+
+int main(int argc, char **argv)
+{
+    CSock sock;
+    CSSLSock sslsock;
+    _Client_t *clients;
+    const char *dir = _DEFDIR, *mixes = "lsbx";
+    long serverpid = 0;
+    double cpu, rss, peak;
+    int i, j;
+
+    for (i = 1; i < argc && argv[i][0] == '-'; i++) {
+        switch (argv[i][1]) {
+            case 'p': _port = argv[i] + 2; break;
+            case 'c': _nclients = atoi(argv[i] + 2); break;
+            case 'n': _nsec = atoi(argv[i] + 2); break;
+            case 'o': _opspersession = atoi(argv[i] + 2); break;
+            case 'm': mixes = argv[i] + 2; break;
+            case 'a': _flagascii = 1; break;
+            case 'e': _flagssl = 1; break;
+            case 'U': _user = argv[i] + 2; break;
+            case 'P': _pass = argv[i] + 2; break;
+            case 'd': dir = argv[i] + 2; break;
+            default: _nclients = 0; break;
+        }
+    }
+    if (_nclients <= 0 || _nclients > _MAXCLIENTS || _nsec <= 0 || _opspersession <= 0 || atoi(_port) <= 0) {
+        _usage(argv[0]);
+        return(1);
+    }
+    #ifndef ENABLE_SSL
+      if (_flagssl != 0) {
+          printf("ERROR: %s was built without SSL\n",argv[0]);
+          return(1);
+      }
+    #endif
+
+    #ifndef WIN32
+      signal(SIGPIPE,SIG_IGN);
+    #endif
+    sock.Initialize();
+    sslsock.Initialize();
+    _thr.InitializeCritSec(&_mutexthreads);
+
+        //create the test files
+    _filedata = (char *)malloc(_BIGSIZE);
+    _filedatacrlfsize = _BIGSIZE + _BIGSIZE / 60;
+    _filedatacrlf = (char *)malloc(_filedatacrlfsize);
+    clients = (_Client_t *)calloc(_nclients,sizeof(_Client_t));
+    if (_filedata == NULL || _filedatacrlf == NULL || clients == NULL) {
+        printf("ERROR: unable to allocate memory\n");
+        return(1);
+    }
+    _filltext(_filedata,_BIGSIZE,"\n");
+    _filedatacrlfsize = _filltext(_filedatacrlf,_filedatacrlfsize,"\r\n");
+    if (_makefiles(dir) == 0) {
+        printf("ERROR: unable to create the test files in %s\n",dir);
+        return(1);
+    }
+
+    if (i < argc) {
+        #ifdef WIN32
+          printf("ERROR: starting the server is not supported on Windows\n");
+          return(1);
+        #else
+          if ((serverpid = _startserver(argv+i,dir)) == 0) {
+              printf("ERROR: unable to start %s on port %s (see %s/server.out)\n",argv[i],_port,dir);
+              return(1);
+          }
+          printf("Started %s (PID %ld) in %s\n",argv[i],serverpid,dir);
+        #endif
+    } else if (_checkserver() == 0) {
+        printf("ERROR: no server is running on port %s\n",_port);
+        return(1);
+    }
+
+    for (i = 0; i < _nclients; i++) {
+        clients[i].id = i;
+        clients[i].buf = (char *)malloc(_BUFSIZE);
+    }
+
+    printf("%d clients, %d data commands per session, %d sec per mix, %s, %s\n",_nclients,_opspersession,_nsec,
+           (_flagascii != 0) ? "ASCII" : "binary",(_flagssl != 0) ? "SSL" : "clear text");
+    printf("mix       sess/s   xfers/s     MB/s  p50 ms  p99 ms errors srv cpu rss MB peak MB%s\n",
+           (_flagssl != 0) ? " resumed" : "");
+    for (i = 0; mixes[i] != '\0'; i++) {
+        for (j = 0; _mixes[j].letter != '\0' && _mixes[j].letter != mixes[i]; j++);
+        if (_mixes[j].letter == '\0') {
+            printf("Unknown mix '%c'\n",mixes[i]);
+            continue;
+        }
+        _mix = &_mixes[j];
+        _run(clients,serverpid);
+    }
+
+    #ifndef WIN32
+      if (serverpid != 0) {
+          if (_serverstats(serverpid,&cpu,&rss,&peak) != 0)
+              printf("Server used %.2f sec of CPU in total (peak RSS %.1f MB)\n",cpu,peak);
+          _stopserver(serverpid);
+      }
+    #endif
+
+    for (i = 0; i < _nclients; i++) {
+        if (clients[i].latency != NULL) free(clients[i].latency);
+        if (clients[i].buf != NULL) free(clients[i].buf);
+    }
+    free(clients);
+    free(_filedata);
+    free(_filedatacrlf);
+    _thr.DestroyCritSec(&_mutexthreads);
+    sslsock.Uninitialize();
+    sock.Uninitialize();
+    return(0);
+}
@@ -0,0 +1,291 @@
+// Copyright (C) 2026 The indiftpd contributors
+//
+// This program is free software; you can redistribute it and/or
+// modify it under the terms of the GNU General Public License
+// as published by the Free Software Foundation; either version 2
+// of the License, or (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program; if not, write to the Free Software
+// Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.
+//
+//
+// ratebench.cpp: benchmark for the transfer speed limits.
+//
+// Runs threads that "send" FTPSXFER_MAXPACKETSIZE packets (nothing is
+// sent, so only the speed limit holds them back) and measures how close
+// the total rate is to the limit (accuracy), how evenly the rate is
+// shared by the transfers (fairness) and how evenly each transfer's
+// bytes are spread over time (smoothness).
+//
+// The site limit is compared with the transfer cycles CFtpsXfer used
+// before CTokenBucket (copied below).  The site -> user -> transfer
+// limits are then checked with users that have different numbers of
+// transfers.
+//
+// Usage: ratebench [site KB/s] [transfers] [seconds]
+//
+//////////////////////////////////////////////////////////////////////
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "../core/TokenBucket.h"
+#include "../core/Thr.h"
+#include "../core/Timer.h"
+#include "../core/FtpsXfer.h"
+
+#define _WINDOWMSEC 100     //length of the time windows the bytes are counted in
+#define _MAXWINDOWS 600     //max number of windows (60 sec)
+#define _MAXXFERS   64      //max number of transfers
+#define _MAXUSERS   8       //max number of users (site -> user -> transfer test)
+
+typedef struct {
+    int flagnew;                //0 = old transfer cycles, 1 = CTokenBucket
+    CTokenBucket bucket;        //transfer's bucket (flagnew = 1)
+    long nbytes;                //bytes sent by the transfer
+    long windows[_MAXWINDOWS];  //bytes sent in each time window
+} _Xfer_t;
+
+static CThr _thr;
+static thrSync_t _mutexthreads;
+static int _nthreads;
+static volatile int _flagstop;
+static tokenbucketTime_t _timestart;
+static int _nwindows;
+
+    //site limit used by the old transfer cycles
+static long _sitemaxspeed;
+static long _sitebytes;
+static unsigned long _sitetimer;
+static thrSync_t _mutexsite;
+
+//////////////////////////////////////////////////////////////////////
+// Previous site limit (from CFtpsXfer::GetXferQuota() and
+// CFtpsXfer::EndXferQuota())
+//////////////////////////////////////////////////////////////////////
+
+static void _oldendquota(_Xfer_t *pxfer, long nquota, long nxfered)
+{
+    CTimer timer;
+    long sitemaxbytesperinterval;
+    unsigned long xferupdtmsec, timediff;
+
+    sitemaxbytesperinterval = (long)((double)_sitemaxspeed * FTPSXFER_XFERRATEUPDTRATE);
+    xferupdtmsec = (unsigned)(FTPSXFER_XFERRATEUPDTRATE * 1000); //convert to msec
+
+    _sitebytes -= (nquota - nxfered);
+    if (_sitebytes >= sitemaxbytesperinterval) {
+        _thr.P(&_mutexsite);
+            //another transfer may have started a new cycle while we waited
+        if (_sitebytes >= sitemaxbytesperinterval) {
+            timediff = timer.Diff(_sitetimer,timer.Get());
+            if (xferupdtmsec > timediff)
+                timer.Sleep(xferupdtmsec - timediff);
+            _sitetimer = timer.Get();
+            _sitebytes = 0;
+        }
+        _thr.V(&_mutexsite);
+    }
+}
+
+static long _oldgetquota(_Xfer_t *pxfer, long nbytes)
+{
+    long sitemaxbytesperinterval, siteavail;
+
+    sitemaxbytesperinterval = (long)((double)_sitemaxspeed * FTPSXFER_XFERRATEUPDTRATE);
+
+    while (1) {
+        siteavail = sitemaxbytesperinterval - _sitebytes;
+        if (siteavail > 0)
+            break;
+        _oldendquota(pxfer,0,0);    //wait for the next cycle
+    }
+
+    nbytes = (nbytes <= siteavail) ? nbytes : siteavail;
+    _sitebytes += nbytes;
+
+    return(nbytes);
+}
+
+//////////////////////////////////////////////////////////////////////
+// Benchmark
+//////////////////////////////////////////////////////////////////////
+
+    //Sends packets until _flagstop is set
+#ifdef WIN32
+  static void _xferthread(void *vpxfer)
+#else
+  static void *_xferthread(void *vpxfer)
+#endif
+{
+    _Xfer_t *pxfer = (_Xfer_t *)vpxfer;
+    CTimer timer;
+    unsigned long waitmsec;
+    long nquota;
+    int window;
+
+    while (_flagstop == 0) {
+        if (pxfer->flagnew == 0) {
+            nquota = _oldgetquota(pxfer,FTPSXFER_MAXPACKETSIZE);
+            _oldendquota(pxfer,nquota,nquota);
+        } else {
+            nquota = pxfer->bucket.Take(FTPSXFER_MAXPACKETSIZE,&waitmsec);
+            if (waitmsec > 0)
+                timer.Sleep(waitmsec);
+        }
+            //count the bytes in the window they are "sent" in
+        window = (int)((CTokenBucket::GetTimeUSec() - _timestart) / (_WINDOWMSEC * 1000));
+        if (window >= _nwindows)
+            break;
+        pxfer->windows[window] += nquota;
+        pxfer->nbytes += nquota;
+    }
+
+    _thr.P(&_mutexthreads);
+    _nthreads--;
+    _thr.V(&_mutexthreads);
+
+    #ifndef WIN32
+      return(NULL);
+    #endif
+}
+
+    //Runs the transfers in "xfers" for "nsec" seconds
+static void _run(_Xfer_t *xfers, int nxfers, int nsec)
+{
+    CTimer timer;
+    int i;
+
+    _flagstop = 0;
+    _nthreads = nxfers;
+    _nwindows = nsec * 1000 / _WINDOWMSEC;
+    _sitebytes = 0;
+    _sitetimer = timer.Get();
+    _timestart = CTokenBucket::GetTimeUSec();
+    for (i = 0; i < nxfers; i++)
+        _thr.Create(_xferthread,(void *)&xfers[i]);
+    timer.Sleep(nsec * 1000);
+    _flagstop = 1;
+    while (_nthreads > 0) timer.Sleep(10);
+}
+
+    //Prints the accuracy, fairness and smoothness of a run
+static void _report(const char *name, _Xfer_t *xfers, int nxfers, int nsec, long limit)
+{
+    double total = 0, rate, minrate = 0, maxrate = 0, sum = 0, sumsq = 0;
+    double peak = 0, mean;
+    long nidle = 0;
+    int i, j;
+
+    for (i = 0; i < nxfers; i++) {
+        rate = (double)xfers[i].nbytes / nsec;
+        total += rate;
+        sum += rate;
+        sumsq += rate * rate;
+        if (i == 0 || rate < minrate) minrate = rate;
+        if (i == 0 || rate > maxrate) maxrate = rate;
+            //skip the first second (the buckets start full)
+        mean = (double)xfers[i].nbytes / _nwindows;
+        for (j = 1000 / _WINDOWMSEC; j < _nwindows; j++) {
+            if (xfers[i].windows[j] == 0)
+                nidle++;
+            if (mean > 0 && xfers[i].windows[j] / mean > peak)
+                peak = xfers[i].windows[j] / mean;
+        }
+    }
+
+    printf("%s: total %7.1f KB/s (%5.1f%% of the limit)  per transfer %6.1f - %6.1f KB/s  fairness %.3f\n",
+           name,total/1024,100*total/limit,minrate/1024,maxrate/1024,(sumsq > 0) ? (sum*sum)/(nxfers*sumsq) : 0);
+    printf("%*s  idle %4.1f%% of the %d msec windows  peak window %.1fx the mean\n",(int)strlen(name),"",
+           100.0*nidle/(nxfers*(_nwindows-1000/_WINDOWMSEC)),_WINDOWMSEC,peak);
+}
+
+int main(int argc, char **argv)
+{
+    CTokenBucket sitebucket, userbuckets[_MAXUSERS];
+    _Xfer_t *xfers;
+    long siterate, userrate, xferrate;
+    double rate;
+    int i, j, nxfers, nsec, nusers, nuserxfers, user[_MAXXFERS];
+
+    siterate = ((argc > 1) ? atol(argv[1]) : 1024) * 1024;
+    nxfers = (argc > 2) ? atoi(argv[2]) : 8;
+    nsec = (argc > 3) ? atoi(argv[3]) : 5;
+    if (siterate <= 0 || nxfers <= 0 || nxfers > _MAXXFERS || nsec <= 1 || nsec * 1000 / _WINDOWMSEC > _MAXWINDOWS) {
+        printf("Usage: %s [site KB/s] [transfers (max %d)] [seconds (2 - %d)]\n",argv[0],_MAXXFERS,_MAXWINDOWS*_WINDOWMSEC/1000);
+        return(1);
+    }
+
+    xfers = new _Xfer_t[_MAXXFERS];
+    _thr.InitializeCritSec(&_mutexthreads);
+    _thr.InitializeCritSec(&_mutexsite);
+
+    printf("Site limit of %ld KB/s shared by %d transfers (%d sec)\n",siterate/1024,nxfers,nsec);
+
+        //site limit with the old transfer cycles
+    _sitemaxspeed = siterate;
+    for (i = 0; i < nxfers; i++) {
+        memset(xfers[i].windows,0,sizeof(xfers[i].windows));
+        xfers[i].flagnew = 0;
+        xfers[i].nbytes = 0;
+    }
+    _run(xfers,nxfers,nsec);
+    _report("old",xfers,nxfers,nsec,siterate);
+
+        //site limit with CTokenBucket
+    sitebucket.SetRate(siterate);
+    for (i = 0; i < nxfers; i++) {
+        memset(xfers[i].windows,0,sizeof(xfers[i].windows));
+        xfers[i].flagnew = 1;
+        xfers[i].nbytes = 0;
+        xfers[i].bucket.SetParent(&sitebucket);
+    }
+    _run(xfers,nxfers,nsec);
+    _report("new",xfers,nxfers,nsec,siterate);
+
+        //site -> user -> transfer: user i has i+1 transfers
+    nusers = 0; nxfers = 0;
+    while (nusers < _MAXUSERS && nxfers + nusers + 1 <= _MAXXFERS && nxfers < 10) {
+        nuserxfers = nusers + 1;
+        for (j = 0; j < nuserxfers; j++)
+            user[nxfers++] = nusers;
+        nusers++;
+    }
+    userrate = siterate / 3;
+    xferrate = userrate / 2;
+    printf("\nSite limit %ld KB/s, user limit %ld KB/s, transfer limit %ld KB/s\n",siterate/1024,userrate/1024,xferrate/1024);
+    sitebucket.SetRate(0);
+    sitebucket.SetRate(siterate);   //start over full
+    for (i = 0; i < nusers; i++) {
+        userbuckets[i].SetParent(&sitebucket);
+        userbuckets[i].SetRate(userrate);
+    }
+    for (i = 0; i < nxfers; i++) {
+        memset(xfers[i].windows,0,sizeof(xfers[i].windows));
+        xfers[i].flagnew = 1;
+        xfers[i].nbytes = 0;
+        xfers[i].bucket.SetParent(&userbuckets[user[i]]);
+        xfers[i].bucket.SetRate(xferrate);
+    }
+    _run(xfers,nxfers,nsec);
+    _report("new",xfers,nxfers,nsec,siterate);
+    for (i = 0; i < nusers; i++) {
+        rate = 0;
+        for (j = 0; j < nxfers; j++) {
+            if (user[j] == i)
+                rate += (double)xfers[j].nbytes / nsec;
+        }
+        printf("    user %d (%d transfer%s): %7.1f KB/s\n",i,i+1,(i == 0) ? " " : "s",rate/1024);
+    }
+
+    _thr.DestroyCritSec(&_mutexthreads);
+    _thr.DestroyCritSec(&_mutexsite);
+    delete [] xfers;
+    return(0);
+}
@@ -0,0 +1,276 @@
+// Copyright (C) 2026 The indiftpd contributors
+//
+// This program is free software; you can redistribute it and/or
+// modify it under the terms of the GNU General Public License
+// as published by the Free Software Foundation; either version 2
+// of the License, or (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program; if not, write to the Free Software
+// Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.
+//
+//
+// userbench.cpp: benchmark for the user lookups done on every FTP
+//                command (Ex. CIndiSiteInfo::CheckPermissions()).
+//
+// Compares CHashTable with the mutex protected CDll list it replaced
+// in CIndiSiteInfo (the list search is copied below).  Each thread looks up random users and checks
+// their permissions, the same as a client sending commands.
+//
+// Usage: userbench [users] [threads] [seconds]
+//
+//////////////////////////////////////////////////////////////////////
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <ctype.h>
+
+#include "../core/HashTable.h"
+#include "../core/Thr.h"
+#include "../core/Timer.h"
+
+    //same size as the user properties in CIndiSiteInfo
+typedef struct {
+    char username[64];
+    char passwordraw[64];
+    char usernumber[16];
+    char groupnumber[16];
+    char dateadded[64];
+    char homedir[265];
+    char permissions[16];
+} _UserProp_t;
+
+typedef struct {
+    int flagnew;            //0 = CDll list, 1 = CHashTable
+    unsigned long seed;     //used to pick the users
+    unsigned long nlookups; //number of lookups done by the thread
+    unsigned long nfound;   //number of users found (all of them)
+} _ThreadInfo_t;
+
+    //node of the old user list
+typedef struct _UserNode_t {
+    struct _UserNode_t *next;
+    char *name;
+    void *genptr;
+} _UserNode_t;
+
+static _UserNode_t _userlist;   //header of the old user list (circular)
+static thrSync_t _mutexusers;
+static CHashTable _users(sizeof(_UserProp_t));
+static int _nusers;
+
+static CThr _thr;
+static thrSync_t _mutexthreads;
+static int _nthreads;
+static volatile int _flagstop;
+
+//////////////////////////////////////////////////////////////////////
+// Previous lookup (from CDll::Search() and
+// CIndiSiteInfo::CheckPermissions())
+//////////////////////////////////////////////////////////////////////
+
+static _UserNode_t *_oldsearch(_UserNode_t *list, const char *name)
+{
+    _UserNode_t *node = list->next;
+
+    while (node != list) {
+        if (node->name != NULL && toupper(*(node->name)) == toupper(*name)) {
+            #ifdef WIN32
+              if (strcmpi(node->name,name) == 0)    //case insensitive
+            #else
+              if (strcasecmp(node->name,name) == 0) //case insensitive
+            #endif
+                return(node);
+        }
+        node = node->next;
+    }
+
+    return(NULL);
+}
+
+static int _oldcheckpermissions(char *username, char *flags)
+{
+    _UserProp_t *puserprop;
+    _UserNode_t *node;
+    char *ptr;
+    int retval = 0;
+
+    _thr.P(&_mutexusers);
+    if ((node = _oldsearch(&_userlist,username)) != NULL) {
+        puserprop = (_UserProp_t *)(node->genptr);
+        for (ptr = flags; *ptr != '\0'; ptr++) {
+            if (strchr(puserprop->permissions,*ptr) != NULL) {
+                retval = 1;
+                break;
+            }
+        }
+    }
+    _thr.V(&_mutexusers);
+
+    return(retval);
+}
+
+static int _newcheckpermissions(char *username, char *flags)
+{
+    _UserProp_t userprop;
+    char *ptr;
+
+    if (_users.Lookup(username,&userprop) == 0)
+        return(0);
+
+    for (ptr = flags; *ptr != '\0'; ptr++) {
+        if (strchr(userprop.permissions,*ptr) != NULL)
+            return(1);
+    }
+
+    return(0);
+}
+
+//////////////////////////////////////////////////////////////////////
+// Benchmark
+//////////////////////////////////////////////////////////////////////
+
+    //Looks up random users until _flagstop is set
+#ifdef WIN32
+  static void _lookupthread(void *vpinfo)
+#else
+  static void *_lookupthread(void *vpinfo)
+#endif
+{
+    _ThreadInfo_t *pinfo = (_ThreadInfo_t *)vpinfo;
+    char username[64];
+
+    while (_flagstop == 0) {
+        pinfo->seed = pinfo->seed * 1103515245 + 12345;
+            //the names are looked up case insensitive (the same as the server)
+        sprintf(username,"User%lu",(pinfo->seed >> 8) % _nusers);
+        if (pinfo->flagnew == 0)
+            pinfo->nfound += _oldcheckpermissions(username,(char *)"r");
+        else
+            pinfo->nfound += _newcheckpermissions(username,(char *)"r");
+        pinfo->nlookups++;
+    }
+
+    _thr.P(&_mutexthreads);
+    _nthreads--;
+    _thr.V(&_mutexthreads);
+
+    #ifndef WIN32
+      return(NULL);
+    #endif
+}
+
+    //Runs "nthreads" lookup threads for "nsec" seconds and returns
+    //the number of lookups per second
+static double _run(int flagnew, int nthreads, int nsec)
+{
+    _ThreadInfo_t *info;
+    CTimer timer;
+    unsigned long ltime1, ltime2, nlookups = 0, nfound = 0;
+    int i;
+
+    if ((info = (_ThreadInfo_t *)calloc(nthreads,sizeof(_ThreadInfo_t))) == NULL)
+        return(0);
+
+    _flagstop = 0;
+    _nthreads = nthreads;
+    ltime1 = timer.Get();
+    for (i = 0; i < nthreads; i++) {
+        info[i].flagnew = flagnew;
+        info[i].seed = i + 1;
+        _thr.Create(_lookupthread,(void *)&info[i]);
+    }
+    timer.Sleep(nsec * 1000);
+    _flagstop = 1;
+    while (_nthreads > 0) timer.Sleep(10);
+    ltime2 = timer.Get();
+
+    for (i = 0; i < nthreads; i++) {
+        nlookups += info[i].nlookups;
+        nfound += info[i].nfound;
+    }
+    free(info);
+
+    if (nfound != nlookups) {
+        printf("ERROR: %lu of %lu users were not found.\n",nlookups-nfound,nlookups);
+        return(0);
+    }
+
+    return(nlookups / timer.DiffSec(ltime1,ltime2));
+}
+
+int main(int argc, char **argv)
+{
+    _UserProp_t *users;
+    _UserNode_t *node, *last;
+    CTimer timer;
+    unsigned long ltime1, ltime2;
+    double oldspeed, newspeed;
+    int i, nthreads, nsec;
+
+    _nusers = (argc > 1) ? atoi(argv[1]) : 100000;
+    nthreads = (argc > 2) ? atoi(argv[2]) : 8;
+    nsec = (argc > 3) ? atoi(argv[3]) : 2;
+    if (_nusers <= 0 || nthreads <= 0 || nsec <= 0) {
+        printf("Usage: %s [users] [threads] [seconds]\n",argv[0]);
+        return(1);
+    }
+
+    if ((users = (_UserProp_t *)calloc(_nusers,sizeof(_UserProp_t))) == NULL) {
+        printf("ERROR: out of memory.\n");
+        return(1);
+    }
+    for (i = 0; i < _nusers; i++) {
+        sprintf(users[i].username,"user%d",i);
+        sprintf(users[i].homedir,"/home/user%d/",i);
+        strcpy(users[i].permissions,"rlcp");
+    }
+
+    _thr.InitializeCritSec(&_mutexusers);
+    _thr.InitializeCritSec(&_mutexthreads);
+
+        //build the old list (without the duplicate check done by the
+        //old AddUser(), which makes loading the users O(users^2))
+    last = &_userlist;
+    for (i = 0; i < _nusers; i++) {
+        if ((node = (_UserNode_t *)malloc(sizeof(_UserNode_t))) == NULL)
+            break;
+        node->name = users[i].username;
+        node->genptr = (void *)&users[i];
+        last->next = node;
+        last = node;
+    }
+    last->next = &_userlist;
+
+    ltime1 = timer.Get();
+    _users.Add(users,_nusers);
+    ltime2 = timer.Get();
+    printf("%d users loaded into CHashTable in %.1f ms\n",_users.GetNumRecords(),timer.DiffSec(ltime1,ltime2)*1000);
+
+    oldspeed = _run(0,nthreads,nsec);
+    newspeed = _run(1,nthreads,nsec);
+    printf("lookups with %d threads: old %12.0f /s  new %12.0f /s  (x%.0f)\n",nthreads,oldspeed,newspeed,(oldspeed > 0) ? newspeed/oldspeed : 0);
+
+        //replace all the users (Ex. on SIGHUP)
+    ltime1 = timer.Get();
+    for (i = 0; i < 5; i++) {
+        _users.Clear();
+        _users.Add(users,_nusers);
+    }
+    ltime2 = timer.Get();
+    printf("reload of %d users: %.1f ms\n",_nusers,timer.DiffSec(ltime1,ltime2)*1000/5);
+
+    for (node = _userlist.next; node != &_userlist; node = last) {
+        last = node->next;
+        free(node);
+    }
+    _thr.DestroyCritSec(&_mutexusers);
+    _thr.DestroyCritSec(&_mutexthreads);
+    free(users);
+    return(0);
+}
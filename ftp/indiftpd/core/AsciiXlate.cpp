@@ -0,0 +1,350 @@
+// Copyright (C) 2026 The indiftpd contributors
+//
+// This program is free software; you can redistribute it and/or
+// modify it under the terms of the GNU General Public License
+// as published by the Free Software Foundation; either version 2
+// of the License, or (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program; if not, write to the Free Software
+// Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.
+//
+//
+// AsciiXlate.cpp: implementation of the CAsciiXlate class.
+//
+// This class is used to translate the line endings of ASCII mode
+// (TYPE A) transfers between the local format (\n) and the network
+// format (\r\n).  The data is translated one block at a time into a
+// buffer that is reused for every block, and line endings are found
+// 16 (SSE2) or 32 (AVX2) bytes at a time when the compiler supports it.
+//
+//////////////////////////////////////////////////////////////////////
+#include <stdlib.h>
+#include <string.h>
+
+#include "AsciiXlate.h"
+
+#if ASCIIXLATE_VECSIZE == 32
+  #include <immintrin.h>
+#elif ASCIIXLATE_VECSIZE == 16
+  #include <emmintrin.h>
+#endif
+#if ASCIIXLATE_VECSIZE != 0 && defined(_MSC_VER)
+  #include <intrin.h>       //for _BitScanForward()
+#endif
+
+//////////////////////////////////////////////////////////////////////
+// Block scanning functions
+//////////////////////////////////////////////////////////////////////
+
+#if ASCIIXLATE_VECSIZE != 0
+
+    //Returns a bit mask of the bytes in the block "ptr" that are equal to "c"
+    //(bit 0 = ptr[0]).
+static inline unsigned int _vecmatch(const char *ptr, char c)
+{
+    #if ASCIIXLATE_VECSIZE == 32
+      __m256i v = _mm256_loadu_si256((const __m256i *)ptr);
+      return((unsigned int)_mm256_movemask_epi8(_mm256_cmpeq_epi8(v,_mm256_set1_epi8(c))));
+    #else
+      __m128i v = _mm_loadu_si128((const __m128i *)ptr);
+      return((unsigned int)_mm_movemask_epi8(_mm_cmpeq_epi8(v,_mm_set1_epi8(c))));
+    #endif
+}
+
+    //Copies a whole block from "src" to "dst"
+static inline void _veccopy(char *dst, const char *src)
+{
+    #if ASCIIXLATE_VECSIZE == 32
+      _mm256_storeu_si256((__m256i *)dst,_mm256_loadu_si256((const __m256i *)src));
+    #else
+      _mm_storeu_si128((__m128i *)dst,_mm_loadu_si128((const __m128i *)src));
+    #endif
+}
+
+    //Returns the position of the lowest bit set in "mask" (mask != 0)
+static inline int _firstbit(unsigned int mask)
+{
+    #ifdef _MSC_VER
+      unsigned long pos;
+      _BitScanForward(&pos,mask);
+      return((int)pos);
+    #else
+      return(__builtin_ctz(mask));
+    #endif
+}
+
+#endif //ASCIIXLATE_VECSIZE != 0
+
+//////////////////////////////////////////////////////////////////////
+// Construction/Destruction
+//////////////////////////////////////////////////////////////////////
+
+CAsciiXlate::CAsciiXlate()
+{
+
+    m_buf = NULL;
+    m_bufsize = 0;
+    Reset();
+}
+
+CAsciiXlate::~CAsciiXlate()
+{
+
+    if (m_buf != NULL)
+        free(m_buf);
+}
+
+//////////////////////////////////////////////////////////////////////
+// Public Methods
+//////////////////////////////////////////////////////////////////////
+
+//////////////////////////////////////////////////////////////////////
+// Resets the translation state so a new stream of data can be
+// translated (the output buffer is kept).
+//
+void CAsciiXlate::Reset()
+{
+
+    m_lastchar = ' ';
+    m_flagcr = 0;
+}
+
+//////////////////////////////////////////////////////////////////////
+// Translates a block of data from the local format to the network
+// format (all "\n" are converted to "\r\n").  A "\n" that is already
+// preceded by a "\r" is left as is, including when the "\r" was the
+// last character of the previous block.
+//
+// [in] inbuf       : Block of data to translate.
+// [in] inbufsize   : Number of bytes in "inbuf".
+// [out] outbufsize : Number of bytes in the returned buffer.
+//
+// Return : On success the translated data is returned.  On failure
+//          (out of memory) NULL is returned.
+//
+// NOTE: The returned buffer belongs to the class and is overwritten
+//       by the next call -- do not free() it.
+//
+char *CAsciiXlate::ToCRLF(const char *inbuf, int inbufsize, int *outbufsize)
+{
+    const char *nlptr;
+    char *outbuf, *outptr, prev;
+    int i = 0, nlpos;
+    #if ASCIIXLATE_VECSIZE != 0
+      unsigned int mask;
+      int pos, last;
+    #endif
+
+    if (outbufsize != NULL)
+        *outbufsize = 0;    //initialize the out buffer size
+
+    if (inbuf == NULL || inbufsize < 0)
+        return(NULL);
+
+        //worst case every character is a "\n"
+    if ((outbuf = GetBuffer(2 * inbufsize)) == NULL)
+        return(NULL);
+    outptr = outbuf;
+    prev = m_lastchar;
+
+    #if ASCIIXLATE_VECSIZE != 0
+        //Whole blocks are copied with one load/store.  A block containing
+        //"\n" is copied run by run -- each copy writes a full block and the
+        //next run overwrites the extra bytes.  Stop one block before the end
+        //so the last run of a block can always be read as a whole block.
+      while (i + 2 * ASCIIXLATE_VECSIZE <= inbufsize) {
+          if ((mask = _vecmatch(inbuf+i,'\n')) == 0) {
+              _veccopy(outptr,inbuf+i);
+              outptr += ASCIIXLATE_VECSIZE;
+              i += ASCIIXLATE_VECSIZE;
+              continue;
+          }
+          last = 0;
+          do {
+              pos = _firstbit(mask);
+              _veccopy(outptr,inbuf+i+last);
+              outptr += pos - last;
+              if (((i + pos) == 0 ? prev : inbuf[i+pos-1]) != '\r')
+                  *outptr++ = '\r';
+              *outptr++ = '\n';
+              last = pos + 1;
+              mask &= mask - 1;
+          } while (mask != 0);
+          _veccopy(outptr,inbuf+i+last);
+          outptr += ASCIIXLATE_VECSIZE - last;
+          i += ASCIIXLATE_VECSIZE;
+      }
+    #endif
+
+        //translate the rest one line at a time
+    while (i < inbufsize) {
+        if ((nlptr = (const char *)memchr(inbuf+i,'\n',inbufsize-i)) == NULL) {
+            memcpy(outptr,inbuf+i,inbufsize-i);
+            outptr += inbufsize - i;
+            break;
+        }
+        nlpos = (int)(nlptr - inbuf);
+        memcpy(outptr,inbuf+i,nlpos-i);
+        outptr += nlpos - i;
+        if ((nlpos == 0 ? prev : inbuf[nlpos-1]) != '\r')
+            *outptr++ = '\r';
+        *outptr++ = '\n';
+        i = nlpos + 1;
+    }
+
+    if (inbufsize > 0)
+        m_lastchar = inbuf[inbufsize-1];
+    if (outbufsize != NULL)
+        *outbufsize = (int)(outptr - outbuf);
+
+    return(outbuf);
+}
+
+//////////////////////////////////////////////////////////////////////
+// Translates a block of data from the network format to the local
+// format (all "\r\n" are converted to "\n").  A "\r" at the end of
+// the block is held back until the next block (or FlushLF()) shows
+// whether it starts a "\r\n".
+//
+// [in] inbuf       : Block of data to translate.
+// [in] inbufsize   : Number of bytes in "inbuf".
+// [out] outbufsize : Number of bytes in the returned buffer.
+//
+// Return : On success the translated data is returned.  On failure
+//          (out of memory) NULL is returned.
+//
+// NOTE: The returned buffer belongs to the class and is overwritten
+//       by the next call -- do not free() it.
+//
+char *CAsciiXlate::ToLF(const char *inbuf, int inbufsize, int *outbufsize)
+{
+    const char *crptr;
+    char *outbuf, *outptr;
+    int i = 0, crpos;
+    #if ASCIIXLATE_VECSIZE != 0
+      unsigned int mask;
+      int pos, last;
+    #endif
+
+    if (outbufsize != NULL)
+        *outbufsize = 0;    //initialize the out buffer size
+
+    if (inbuf == NULL || inbufsize < 0)
+        return(NULL);
+
+        //the output is never longer than the input (+ a held back "\r")
+    if ((outbuf = GetBuffer(inbufsize + 1)) == NULL)
+        return(NULL);
+    outptr = outbuf;
+
+    if (m_flagcr != 0 && inbufsize > 0) {
+        if (inbuf[0] != '\n')
+            *outptr++ = '\r';   //keep a '\r' w/o a following '\n'
+        m_flagcr = 0;
+    }
+
+    #if ASCIIXLATE_VECSIZE != 0
+        //same block copy as ToCRLF() (a "\r" found in a block is never the
+        //last byte of "inbuf", so the next byte can always be checked)
+      while (i + 2 * ASCIIXLATE_VECSIZE <= inbufsize) {
+          if ((mask = _vecmatch(inbuf+i,'\r')) == 0) {
+              _veccopy(outptr,inbuf+i);
+              outptr += ASCIIXLATE_VECSIZE;
+              i += ASCIIXLATE_VECSIZE;
+              continue;
+          }
+          last = 0;
+          do {
+              pos = _firstbit(mask);
+              _veccopy(outptr,inbuf+i+last);
+              outptr += pos - last;
+              if (inbuf[i+pos+1] != '\n')
+                  *outptr++ = '\r';
+              last = pos + 1;
+              mask &= mask - 1;
+          } while (mask != 0);
+          _veccopy(outptr,inbuf+i+last);
+          outptr += ASCIIXLATE_VECSIZE - last;
+          i += ASCIIXLATE_VECSIZE;
+      }
+    #endif
+
+        //translate the rest one line at a time
+    while (i < inbufsize) {
+        if ((crptr = (const char *)memchr(inbuf+i,'\r',inbufsize-i)) == NULL) {
+            memcpy(outptr,inbuf+i,inbufsize-i);
+            outptr += inbufsize - i;
+            break;
+        }
+        crpos = (int)(crptr - inbuf);
+        memcpy(outptr,inbuf+i,crpos-i);
+        outptr += crpos - i;
+        if (crpos == (inbufsize - 1))
+            m_flagcr = 1;   //decide w/ the next block
+        else if (inbuf[crpos+1] != '\n')
+            *outptr++ = '\r';  //keep a '\r' w/o a following '\n'
+        i = crpos + 1;
+    }
+
+    if (outbufsize != NULL)
+        *outbufsize = (int)(outptr - outbuf);
+
+    return(outbuf);
+}
+
+//////////////////////////////////////////////////////////////////////
+// Ends a stream of data translated with ToLF().
+//
+// [out] outbufsize : Number of bytes in the returned buffer.
+//
+// Return : The "\r" that was held back at the end of the last block
+//          (*outbufsize = 1), or an empty buffer (*outbufsize = 0).
+//          NULL is returned if out of memory.
+//
+char *CAsciiXlate::FlushLF(int *outbufsize)
+{
+    char *outbuf;
+
+    if (outbufsize != NULL)
+        *outbufsize = 0;
+
+    if ((outbuf = GetBuffer(1)) == NULL)
+        return(NULL);
+
+    if (m_flagcr != 0) {
+        *outbuf = '\r';
+        if (outbufsize != NULL)
+            *outbufsize = 1;
+        m_flagcr = 0;
+    }
+
+    return(outbuf);
+}
+
+//////////////////////////////////////////////////////////////////////
+// Private Methods
+//////////////////////////////////////////////////////////////////////
+
+    //Makes sure the output buffer can hold "size" bytes (plus room for
+    //the block copies that write past the end of the data).
+    //Returns the output buffer or NULL if out of memory.
+char *CAsciiXlate::GetBuffer(int size)
+{
+    char *newbuf;
+
+    size += ASCIIXLATE_VECSIZE;
+    if (size > m_bufsize) {
+        if ((newbuf = (char *)realloc(m_buf,size)) == NULL)
+            return(NULL);
+        m_buf = newbuf;
+        m_bufsize = size;
+    }
+
+    return(m_buf);
+}
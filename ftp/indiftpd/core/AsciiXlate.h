@@ -0,0 +1,55 @@
+// Copyright (C) 2026 The indiftpd contributors
+//
+// This program is free software; you can redistribute it and/or
+// modify it under the terms of the GNU General Public License
+// as published by the Free Software Foundation; either version 2
+// of the License, or (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program; if not, write to the Free Software
+// Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.
+//
+//
+// AsciiXlate.h: interface for the CAsciiXlate class.
+//
+//////////////////////////////////////////////////////////////////////
+#ifndef ASCIIXLATE_H
+#define ASCIIXLATE_H
+
+    //Size of the blocks that are scanned for line endings at once
+#if defined(__AVX2__)
+  #define ASCIIXLATE_VECSIZE 32     //AVX2
+#elif defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+  #define ASCIIXLATE_VECSIZE 16     //SSE2
+#else
+  #define ASCIIXLATE_VECSIZE 0      //no SIMD (byte by byte)
+#endif
+
+
+class CAsciiXlate
+{
+public:
+    CAsciiXlate();
+    virtual ~CAsciiXlate();
+
+    void Reset();
+    char *ToCRLF(const char *inbuf, int inbufsize, int *outbufsize);
+    char *ToLF(const char *inbuf, int inbufsize, int *outbufsize);
+    char *FlushLF(int *outbufsize);
+
+private:
+    char *GetBuffer(int size);
+
+private:
+    char *m_buf;        //output buffer (reused for every block of data)
+    int m_bufsize;      //size of "m_buf"
+    char m_lastchar;    //last character of the previous input block (ToCRLF)
+    int m_flagcr;       //1 if the previous input block ended with '\r' (ToLF)
+};
+
+#endif //ASCIIXLATE_H
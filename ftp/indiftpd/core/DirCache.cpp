@@ -0,0 +1,589 @@
+// Copyright (C) 2026 The indiftpd contributors
+//
+// This program is free software; you can redistribute it and/or
+// modify it under the terms of the GNU General Public License
+// as published by the Free Software Foundation; either version 2
+// of the License, or (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program; if not, write to the Free Software
+// Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.
+//
+//
+// DirCache.cpp: implementation of the CDirCache class.
+//
+// A directory is read once with large getdents64() calls (Linux) and
+// its sorted names are kept until the directory's mod time changes.
+// The stats of the files are read relative to the open directory with
+// fstatat() so the kernel does not walk the full path for each file.
+// The names are only cached once the directory has not been changed
+// for DIRCACHE_MINAGE seconds, so a change made in the same tick of the
+// file system clock as the read can not be missed.
+//
+//////////////////////////////////////////////////////////////////////
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <fcntl.h>
+#include <sys/types.h>
+
+#ifdef WIN32
+  #include <io.h>
+#else
+  #include <unistd.h>
+  #include <dirent.h>
+#endif
+
+#ifdef LINUX
+  #include <sys/syscall.h>  //for SYS_getdents64
+#endif
+
+#include "DirCache.h"
+
+#ifndef O_DIRECTORY
+  #define O_DIRECTORY 0
+#endif
+
+#define DIRCACHE_READSIZE 65536     //size of the buffer the directory entries are read into
+#define DIRCACHE_NAMEBUFSIZE 16384  //initial size of the buffer used to store the names
+
+#ifdef LINUX
+    //directory entry returned by getdents64()
+  typedef struct {
+      unsigned long long d_ino;
+      long long d_off;
+      unsigned short d_reclen;
+      unsigned char d_type;
+      char d_name[1];
+  } _dircacheDirent64_t;
+#endif
+
+    //Adds "name" to the end of the name buffer (names are NULL terminated)
+    //Returns 0 if out of memory.
+static int _addname(char **pnamebuf, long *pnamebufsize, long *pnamebuflen, const char *name)
+{
+    char *tmpbuf;
+    long len;
+
+        //do not list the "." and ".." entries
+    if (name[0] == '.' && (name[1] == '\0' || (name[1] == '.' && name[2] == '\0')))
+        return(1);
+
+    len = strlen(name) + 1;
+    if (*pnamebuflen + len > *pnamebufsize) {
+        if ((tmpbuf = (char *)realloc(*pnamebuf,(*pnamebufsize)*2 + len)) == NULL)
+            return(0);
+        *pnamebuf = tmpbuf;
+        *pnamebufsize = (*pnamebufsize)*2 + len;
+    }
+    memcpy(*pnamebuf + *pnamebuflen,name,len);
+    *pnamebuflen += len;
+
+    return(1);
+}
+
+    //Compares two names for qsort()
+static int _cmpnames(const void *name1, const void *name2)
+{
+
+    return(strcmp(*(char **)name1,*(char **)name2));
+}
+
+//////////////////////////////////////////////////////////////////////
+// Construction/Destruction
+//////////////////////////////////////////////////////////////////////
+
+//////////////////////////////////////////////////////////////////////
+// Constructor for the CDirCache class.
+//
+// [in] maxdirs  : Max number of directories in the cache.
+// [in] maxbytes : Max memory used by the cached names.
+//
+CDirCache::CDirCache(int maxdirs /*=DIRCACHE_MAXDIRS*/, long maxbytes /*=DIRCACHE_MAXBYTES*/)
+{
+
+    m_maxdirs = maxdirs;
+    m_maxbytes = maxbytes;
+
+    m_dirs = NULL;
+    m_ndirs = 0;
+    m_nbytes = 0;
+    memset(m_owners,0,sizeof(m_owners));
+
+    m_thr.InitializeCritSec(&m_mutexdirs);
+    m_thr.InitializeCritSec(&m_mutexowners);
+}
+
+CDirCache::~CDirCache()
+{
+
+    Clear();
+
+    m_thr.DestroyCritSec(&m_mutexdirs);
+    m_thr.DestroyCritSec(&m_mutexowners);
+}
+
+//////////////////////////////////////////////////////////////////////
+// Public Methods
+//////////////////////////////////////////////////////////////////////
+
+//////////////////////////////////////////////////////////////////////
+// Gets the sorted names in a directory.  The cached names are used if
+// the directory was not changed since they were read.
+//
+// [in] dirpath : Path of the directory.
+//
+// Return : On success the listing of the directory is returned.  On
+//          failure (Ex. not a directory) NULL is returned.
+//
+// NOTE: The listing must be closed with CloseDir().
+//
+dircacheList_t *CDirCache::OpenDir(const char *dirpath)
+{
+    dircacheList_t *plist;
+    dircacheDir_t *pdir;
+    long devnum, inodnum, timemod, timemodnsec = 0;
+    int dirfd = -1;
+
+    if (dirpath == NULL || *dirpath == '\0')
+        return(NULL);
+
+        //get the identity and mod time of the directory
+    #ifdef WIN32
+      CFSUtils fsutils;
+      fsutilsFileInfo_t finfo;
+      char *tmppath;
+
+      if ((tmppath = (char *)malloc(strlen(dirpath)+1)) == NULL)
+          return(NULL);
+      strcpy(tmppath,dirpath);
+      if (fsutils.GetFileStats(tmppath,&finfo) == 0 || S_ISDIR(finfo.mode) == 0) {
+          free(tmppath);
+          return(NULL);
+      }
+      free(tmppath);
+      devnum = finfo.devnum;
+      inodnum = finfo.inodnum;
+      timemod = finfo.timemod;
+    #else
+      struct stat st;
+
+      if ((dirfd = open(dirpath,O_RDONLY|O_DIRECTORY)) < 0)
+          return(NULL);
+      if (fstat(dirfd,&st) != 0 || S_ISDIR(st.st_mode) == 0) {
+          close(dirfd);
+          return(NULL);
+      }
+      devnum = st.st_dev;
+      inodnum = st.st_ino;
+      timemod = st.st_mtime;
+      #ifdef LINUX
+        timemodnsec = st.st_mtim.tv_nsec;
+      #endif
+    #endif
+
+    if ((plist = (dircacheList_t *)malloc(sizeof(dircacheList_t))) == NULL) {
+        #ifndef WIN32
+          close(dirfd);
+        #endif
+        return(NULL);
+    }
+
+        //check if the names are cached
+    m_thr.P(&m_mutexdirs);
+    for (pdir = m_dirs; pdir != NULL; pdir = pdir->next) {
+        if (strcmp(pdir->dirpath,dirpath) == 0)
+            break;
+    }
+    if (pdir != NULL) {
+        if (pdir->devnum == devnum && pdir->inodnum == inodnum && pdir->timemod == timemod && pdir->timemodnsec == timemodnsec) {
+            pdir->nrefs++;
+            if (pdir != m_dirs) {   //move the directory to the front of the cache
+                RemoveDir(pdir);
+                AddDir(pdir);
+            }
+        } else {
+            RemoveDir(pdir);    //the directory was changed
+            pdir = NULL;
+        }
+    }
+    m_thr.V(&m_mutexdirs);
+
+        //read the directory (the cache is not locked while reading)
+    if (pdir == NULL) {
+        if ((pdir = ReadDir(dirpath,dirfd)) == NULL) {
+            #ifndef WIN32
+              close(dirfd);
+            #endif
+            free(plist);
+            return(NULL);
+        }
+        pdir->devnum = devnum;
+        pdir->inodnum = inodnum;
+        pdir->timemod = timemod;
+        pdir->timemodnsec = timemodnsec;
+        pdir->nrefs = 1;
+        if (time(NULL) - timemod >= DIRCACHE_MINAGE) {
+            m_thr.P(&m_mutexdirs);
+            AddDir(pdir);
+            m_thr.V(&m_mutexdirs);
+        }
+    }
+
+    plist->nfiles = pdir->nfiles;
+    plist->names = pdir->names;
+    plist->pdir = pdir;
+    plist->dirfd = dirfd;
+
+    return(plist);
+}
+
+//////////////////////////////////////////////////////////////////////
+// Gets information about a file in a directory listing.
+//
+// [in] plist    : Listing returned by OpenDir().
+// [in] index    : Index of the file's name in the listing.
+// [out] infoptr : Structure containing the file information.
+//
+// Return : On success 1 is returned.  0 is returned if the file no
+//          longer exists.
+//
+int CDirCache::GetFileStats(dircacheList_t *plist, int index, fsutilsFileInfo_t *infoptr)
+{
+
+    if (plist == NULL || index < 0 || index >= plist->nfiles || infoptr == NULL)
+        return(0);
+
+    #if !defined(WIN32) && defined(AT_FDCWD)
+      struct stat filestatus;
+
+      if (fstatat(plist->dirfd,plist->names[index],&filestatus,0) != 0)
+          return(0);
+
+      memset(infoptr,0,sizeof(fsutilsFileInfo_t));
+      infoptr->timeaccess = filestatus.st_atime;
+      infoptr->timecreate = filestatus.st_ctime;
+      infoptr->timemod = filestatus.st_mtime;
+      infoptr->size = filestatus.st_size;
+      infoptr->groupid = filestatus.st_gid;
+      infoptr->userid = filestatus.st_uid;
+      infoptr->mode = filestatus.st_mode;
+      infoptr->devnum = filestatus.st_dev;
+      infoptr->inodnum = filestatus.st_ino;
+      infoptr->nlinks = filestatus.st_nlink;
+
+      return(1);
+    #else
+        //no fstatat(): stat the full path
+      CFSUtils fsutils;
+      char *filepath;
+      int retval;
+
+      if ((filepath = (char *)malloc(strlen(plist->pdir->dirpath)+strlen(plist->names[index])+2)) == NULL)
+          return(0);
+      strcpy(filepath,plist->pdir->dirpath);
+      fsutils.CheckSlashEnd(filepath,strlen(plist->pdir->dirpath)+2);
+      strcat(filepath,plist->names[index]);
+      retval = fsutils.GetFileStats(filepath,infoptr);
+      free(filepath);
+
+      return(retval);
+    #endif
+}
+
+//////////////////////////////////////////////////////////////////////
+// Closes a listing returned by OpenDir().
+//
+// [in] plist : Listing to close.
+//
+// Return : VOID
+//
+void CDirCache::CloseDir(dircacheList_t *plist)
+{
+    dircacheDir_t *pdir;
+
+    if (plist == NULL)
+        return;
+
+    #ifndef WIN32
+      if (plist->dirfd >= 0)
+          close(plist->dirfd);
+    #endif
+
+    pdir = plist->pdir;
+    m_thr.P(&m_mutexdirs);
+    pdir->nrefs--;
+    if (pdir->nrefs > 0 || pdir->flagcached != 0)
+        pdir = NULL;    //the names are still used
+    m_thr.V(&m_mutexdirs);
+
+    if (pdir != NULL)
+        FreeDir(pdir);
+    free(plist);
+}
+
+//////////////////////////////////////////////////////////////////////
+// Removes all the directories from the cache.
+//
+// Return : VOID
+//
+void CDirCache::Clear()
+{
+
+    m_thr.P(&m_mutexdirs);
+    while (m_dirs != NULL)
+        RemoveDir(m_dirs);
+    m_thr.V(&m_mutexdirs);
+}
+
+//////////////////////////////////////////////////////////////////////
+// Gets the user name based on the user ID (see CFSUtils::GetUsrName()).
+//
+// [in] uid         : The user ID.
+// [out] username   : Name of the user corresponding to uid.
+// [in] maxusername : Max size of the "username" string.
+//
+// Return : On success 1 is returned.  On failure 0 is returned.
+//
+int CDirCache::GetUsrName(long uid, char *username, int maxusername)
+{
+
+    return(GetOwnerName(uid,0,username,maxusername));
+}
+
+//////////////////////////////////////////////////////////////////////
+// Gets the group name based on the group ID (see CFSUtils::GetGrpName()).
+//
+// [in] gid        : The group ID.
+// [out] grpname   : Name of the group corresponding to gid.
+// [in] maxgrpname : Max size of the "grpname" string.
+//
+// Return : On success 1 is returned.  On failure 0 is returned.
+//
+int CDirCache::GetGrpName(long gid, char *grpname, int maxgrpname)
+{
+
+    return(GetOwnerName(gid,1,grpname,maxgrpname));
+}
+
+//////////////////////////////////////////////////////////////////////
+// Private Methods
+//////////////////////////////////////////////////////////////////////
+
+//////////////////////////////////////////////////////////////////////
+// Reads and sorts the names in a directory.
+//
+// [in] dirpath : Path of the directory.
+// [in] dirfd   : Open directory (UNIX only).
+//
+// Return : On success the names are returned (not in the cache).  On
+//          failure NULL is returned.
+//
+dircacheDir_t *CDirCache::ReadDir(const char *dirpath, int dirfd)
+{
+    dircacheDir_t *pdir;
+    char *namebuf, *ptr;
+    long namebufsize = DIRCACHE_NAMEBUFSIZE, namebuflen = 0;
+    int i, nfiles = 0, retval = 1;
+
+    if ((namebuf = (char *)malloc(namebufsize)) == NULL)
+        return(NULL);
+
+        //read the names into "namebuf"
+    #if defined(LINUX)
+      _dircacheDirent64_t *pent;
+      char *readbuf;
+      long nread, offset;
+
+      if ((readbuf = (char *)malloc(DIRCACHE_READSIZE)) == NULL) {
+          free(namebuf);
+          return(NULL);
+      }
+      while (retval != 0 && (nread = syscall(SYS_getdents64,dirfd,readbuf,DIRCACHE_READSIZE)) > 0) {
+          for (offset = 0; offset < nread; offset += pent->d_reclen) {
+              pent = (_dircacheDirent64_t *)(readbuf + offset);
+              if ((retval = _addname(&namebuf,&namebufsize,&namebuflen,pent->d_name)) == 0)
+                  break;
+          }
+      }
+      if (nread < 0)
+          retval = 0;
+      free(readbuf);
+    #elif defined(WIN32)
+      struct _finddata_t fileinfo;
+      char *pattern;
+      long hdir;
+
+      if ((pattern = (char *)malloc(strlen(dirpath)+3)) == NULL) {
+          free(namebuf);
+          return(NULL);
+      }
+      strcpy(pattern,dirpath);
+      if (*pattern != '\0' && pattern[strlen(pattern)-1] != '\\' && pattern[strlen(pattern)-1] != '/')
+          strcat(pattern,"\\");
+      strcat(pattern,"*");
+      if ((hdir = _findfirst(pattern,&fileinfo)) != -1L) {
+          do {
+              if ((retval = _addname(&namebuf,&namebufsize,&namebuflen,fileinfo.name)) == 0)
+                  break;
+          } while (_findnext(hdir,&fileinfo) == 0);
+          _findclose(hdir);
+      }
+      free(pattern);
+    #else
+      struct dirent *pent;
+      DIR *pd;
+
+      if ((pd = opendir(dirpath)) == NULL) {
+          free(namebuf);
+          return(NULL);
+      }
+      while ((pent = readdir(pd)) != NULL) {
+          if ((retval = _addname(&namebuf,&namebufsize,&namebuflen,pent->d_name)) == 0)
+              break;
+      }
+      closedir(pd);
+    #endif
+
+    if (retval == 0) {
+        free(namebuf);
+        return(NULL);
+    }
+
+        //the names are stored after the array of name pointers
+    for (ptr = namebuf; ptr < namebuf + namebuflen; ptr += strlen(ptr) + 1)
+        nfiles++;
+    if ((pdir = (dircacheDir_t *)malloc(sizeof(dircacheDir_t) + sizeof(char *)*nfiles + namebuflen + strlen(dirpath) + 1)) == NULL) {
+        free(namebuf);
+        return(NULL);
+    }
+    memset(pdir,0,sizeof(dircacheDir_t));
+    pdir->names = (char **)((char *)pdir + sizeof(dircacheDir_t));
+    ptr = (char *)(pdir->names + nfiles);
+    memcpy(ptr,namebuf,namebuflen);
+    for (i = 0; i < nfiles; i++) {
+        pdir->names[i] = ptr;
+        ptr += strlen(ptr) + 1;
+    }
+    pdir->dirpath = ptr;
+    strcpy(pdir->dirpath,dirpath);
+    pdir->nfiles = nfiles;
+    pdir->size = sizeof(dircacheDir_t) + sizeof(char *)*nfiles + namebuflen + strlen(dirpath) + 1;
+    free(namebuf);
+
+    qsort(pdir->names,nfiles,sizeof(char *),_cmpnames);
+
+    return(pdir);
+}
+
+    //Frees the names of a directory
+void CDirCache::FreeDir(dircacheDir_t *pdir)
+{
+
+    free(pdir);
+}
+
+    //Adds a directory to the front of the cache and removes the least
+    //recently used directories if the cache is full.
+    //NOTE: m_mutexdirs must be locked.
+void CDirCache::AddDir(dircacheDir_t *pdir)
+{
+    dircacheDir_t *plast, *tmpdir;
+
+    if (pdir->size > m_maxbytes || m_maxdirs <= 0)
+        return;     //too large to cache
+
+        //another listing may have added the same directory
+    for (tmpdir = m_dirs; tmpdir != NULL; tmpdir = tmpdir->next) {
+        if (strcmp(tmpdir->dirpath,pdir->dirpath) == 0) {
+            RemoveDir(tmpdir);
+            break;
+        }
+    }
+
+    pdir->next = m_dirs;
+    m_dirs = pdir;
+    pdir->flagcached = 1;
+    m_ndirs++;
+    m_nbytes += pdir->size;
+
+    while (m_ndirs > m_maxdirs || m_nbytes > m_maxbytes) {
+        for (plast = m_dirs; plast->next != NULL; plast = plast->next);
+        RemoveDir(plast);
+    }
+}
+
+    //Removes a directory from the cache.  The names are freed if they are
+    //not used by a listing.
+    //NOTE: m_mutexdirs must be locked.
+void CDirCache::RemoveDir(dircacheDir_t *pdir)
+{
+    dircacheDir_t *tmpdir, *prev = NULL;
+
+    for (tmpdir = m_dirs; tmpdir != NULL; tmpdir = tmpdir->next) {
+        if (tmpdir == pdir) {
+            if (prev == NULL)
+                m_dirs = pdir->next;
+            else
+                prev->next = pdir->next;
+            m_ndirs--;
+            m_nbytes -= pdir->size;
+            break;
+        }
+        prev = tmpdir;
+    }
+
+    pdir->next = NULL;
+    pdir->flagcached = 0;
+    if (pdir->nrefs <= 0)
+        FreeDir(pdir);
+}
+
+    //Gets a user (flaggroup = 0) or group (flaggroup = 1) name from the
+    //cache.  Names that are not cached (or expired) are looked up w/
+    //CFSUtils (the cache is not locked during the lookup).
+int CDirCache::GetOwnerName(long id, int flaggroup, char *name, int maxname)
+{
+    CFSUtils fsutils;
+    dircacheOwner_t *powner;
+    char tmpname[DIRCACHE_MAXOWNER];
+    long now;
+
+    if (name == NULL || maxname <= 0)
+        return(0);
+
+    now = (long)time(NULL);
+    powner = &m_owners[(((unsigned long)id * 2654435761UL) + flaggroup) & (DIRCACHE_NAMESLOTS-1)];
+
+    m_thr.P(&m_mutexowners);
+    if (powner->timeset != 0 && powner->id == id && powner->flaggroup == flaggroup && now - powner->timeset < DIRCACHE_NAMETTL) {
+        strncpy(name,powner->name,maxname-1);
+        name[maxname-1] = '\0';
+        m_thr.V(&m_mutexowners);
+        return(1);
+    }
+    m_thr.V(&m_mutexowners);
+
+    if (flaggroup == 0)
+        fsutils.GetUsrName(id,tmpname,sizeof(tmpname));
+    else
+        fsutils.GetGrpName(id,tmpname,sizeof(tmpname));
+
+    m_thr.P(&m_mutexowners);
+    powner->id = id;
+    powner->flaggroup = flaggroup;
+    powner->timeset = now;
+    strcpy(powner->name,tmpname);
+    m_thr.V(&m_mutexowners);
+
+    strncpy(name,tmpname,maxname-1);
+    name[maxname-1] = '\0';
+
+    return(1);
+}
@@ -0,0 +1,111 @@
+// Copyright (C) 2026 The indiftpd contributors
+//
+// This program is free software; you can redistribute it and/or
+// modify it under the terms of the GNU General Public License
+// as published by the Free Software Foundation; either version 2
+// of the License, or (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program; if not, write to the Free Software
+// Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.
+//
+//
+// DirCache.h: interface for the CDirCache class.
+//
+//////////////////////////////////////////////////////////////////////
+#ifndef DIRCACHE_H
+#define DIRCACHE_H
+
+#include "Thr.h"
+#include "FSUtils.h"
+
+#define DIRCACHE_MAXDIRS   64           //max number of directories in the cache
+#define DIRCACHE_MAXBYTES  33554432     //max memory used by the cached names (32MB)
+#define DIRCACHE_MINAGE    2            //min age (sec) of a directory's mod time before its names are cached
+#define DIRCACHE_NAMESLOTS 256          //number of cached user/group names (power of 2)
+#define DIRCACHE_NAMETTL   300          //time (sec) a user/group name is cached
+#define DIRCACHE_MAXOWNER  32           //max length of a cached user/group name
+
+    //names in a directory (shared by the listings of the directory)
+typedef struct _dircacheDir_t {
+    struct _dircacheDir_t *next;    //next directory in the cache (most recently used first)
+    char *dirpath;      //path of the directory
+    long devnum;        //device and inode of the directory
+    long inodnum;
+    long timemod;       //mod time of the directory when it was read
+    long timemodnsec;   //nanoseconds of the mod time (0 if not supported)
+    long size;          //bytes used by the names
+    int nfiles;         //number of names
+    char **names;       //names sorted w/ strcmp() ("." and ".." are not included)
+    int nrefs;          //number of listings using the names
+    int flagcached;     //0 = not (or no longer) in the cache
+} dircacheDir_t;
+
+    //a listing of a directory (returned by CDirCache::OpenDir())
+typedef struct {
+    int nfiles;         //number of names
+    char **names;       //sorted names
+    dircacheDir_t *pdir;
+    int dirfd;          //open directory used to get the file stats (-1 = none)
+} dircacheList_t;
+
+    //cached user or group name
+typedef struct {
+    long id;            //user or group ID
+    int flaggroup;      //0 = user name, 1 = group name
+    long timeset;       //time the name was looked up (0 = empty slot)
+    char name[DIRCACHE_MAXOWNER];
+} dircacheOwner_t;
+
+
+///////////////////////////////////////////////////////////////////////////////
+// Caches the sorted names in the recently listed directories (checked
+// against the mod time of the directory) and the user/group names shown
+// in the listings.  The file stats are not cached since a file can change
+// without changing the mod time of its directory.
+///////////////////////////////////////////////////////////////////////////////
+
+class CDirCache
+{
+public:
+    CDirCache(int maxdirs = DIRCACHE_MAXDIRS, long maxbytes = DIRCACHE_MAXBYTES);
+    virtual ~CDirCache();
+
+        //directory functions
+    dircacheList_t *OpenDir(const char *dirpath);
+    int GetFileStats(dircacheList_t *plist, int index, fsutilsFileInfo_t *infoptr);
+    void CloseDir(dircacheList_t *plist);
+    void Clear();
+
+        //user/group name functions
+    int GetUsrName(long uid, char *username, int maxusername);
+    int GetGrpName(long gid, char *grpname, int maxgrpname);
+
+private:
+    dircacheDir_t *ReadDir(const char *dirpath, int dirfd);
+    void FreeDir(dircacheDir_t *pdir);
+    void AddDir(dircacheDir_t *pdir);
+    void RemoveDir(dircacheDir_t *pdir);
+    int GetOwnerName(long id, int flaggroup, char *name, int maxname);
+
+private:
+    CThr m_thr;         //thread functions
+
+    int m_maxdirs;      //max number of directories in the cache
+    long m_maxbytes;    //max memory used by the cached names
+
+    dircacheDir_t *m_dirs;  //cached directories (most recently used first)
+    int m_ndirs;            //number of cached directories
+    long m_nbytes;          //memory used by the cached names
+    thrSync_t m_mutexdirs;  //protects the cached directories
+
+    dircacheOwner_t m_owners[DIRCACHE_NAMESLOTS];   //user/group names (by ID)
+    thrSync_t m_mutexowners;    //protects m_owners
+};
+
+#endif //DIRCACHE_H
@@ -27,6 +27,7 @@
 #include <stdlib.h>
 #include <time.h>
 #include <sys/types.h>
+#include <errno.h>
 
 #ifdef WIN32
   #include <io.h>
@@ -35,8 +36,8 @@
 #else
   #include <glob.h>
   #include <unistd.h>
-  #include <grp.h>  //for getgrgid
-  #include <pwd.h>  //for getpwuid
+  #include <grp.h>  //for getgrgid_r
+  #include <pwd.h>  //for getpwuid_r
   #include <utime.h>
 #endif
 
@@ -57,6 +58,14 @@
   #include <sys/vfs.h>
 #endif
 
+    //Needed for CopySingleFile()
+#ifdef LINUX
+  #include <fcntl.h>
+  #include <sys/ioctl.h>
+  #include <sys/syscall.h>
+  #include <linux/fs.h>     //for FICLONE
+#endif
+
 #include "StrUtils.h"
 #include "FSUtils.h"
 
@@ -355,9 +364,10 @@ int CFSUtils::GetUsrName(long uid, char *username, int maxusername)
         return(0);
 
     #ifndef WIN32
-      struct passwd *pw;
-          
-      if ((pw = getpwuid(uid)) != NULL) {
+      struct passwd pwbuf, *pw = NULL;
+      char buffer[FSUTILS_MAXPWBUF];
+
+      if (getpwuid_r(uid,&pwbuf,buffer,sizeof(buffer),&pw) == 0 && pw != NULL) {
           strncpy(username,pw->pw_name,maxusername-1);
           username[maxusername-1] = '\0';
           return(1);
@@ -387,9 +397,10 @@ int CFSUtils::GetGrpName(long gid, char *grpname, int maxgrpname)
         return(0);
 
     #ifndef WIN32
-      struct group *grp;
+      struct group grpbuf, *grp = NULL;
+      char buffer[FSUTILS_MAXPWBUF];
 
-      if ((grp = getgrgid(gid)) != NULL) {
+      if (getgrgid_r(gid,&grpbuf,buffer,sizeof(buffer),&grp) == 0 && grp != NULL) {
           strncpy(grpname,grp->gr_name,maxgrpname-1);
           grpname[maxgrpname-1] = '\0';
           return(1);
@@ -1038,8 +1049,10 @@ int CFSUtils::Rename(const char *oldname, const char *newname)
 //
 // [in] input  : file or directory to copy
 // [in] output : destination file/directory
+// [out] plist : if not NULL, the files are added to this list instead
+//               of being copied (the output directories are created).
 //
-// Return : returns the number of files copied.
+// Return : returns the number of files copied (or added to "plist").
 //
 // NOTE: If "input" is a file and "output" is a directory, a file
 //       with the name "input" will be created in the "output"
@@ -1052,7 +1065,7 @@ int CFSUtils::Rename(const char *oldname, const char *newname)
 //       If both "input" and "output" are files, "input" will be
 //       copied to "output".  Wildcards can be used when specifying
 //       "input".
-int CFSUtils::CopyFiles(char *input, char *output)
+int CFSUtils::CopyFiles(char *input, char *output, fsutilsCopyList_t *plist /*=NULL*/)
 {
     CStrUtils strutils;
     char *buffer, *tmpout, *tmpin, *outputbuff, *inputbuff, *indirptr = NULL, *infileptr = NULL;
@@ -1097,7 +1110,7 @@ int CFSUtils::CopyFiles(char *input, char *output)
         if (type == 0) {
             free(inputbuff);
                 //output is a new filename
-            return(CopySingleFile(input,output));
+            return(CopyOrAddFile(input,output,plist));
         } else {
             if (type == 1) {  //the output path is a directory
                 if ((buffer = (char *)malloc(strlen(output)+strlen(infileptr)+2)) != NULL) {
@@ -1105,7 +1118,7 @@ int CFSUtils::CopyFiles(char *input, char *output)
                     CheckSlash(buffer);
                     CheckSlashEnd(buffer,strlen(output)+strlen(infileptr)+2);
                     strcat(buffer,infileptr);   //build the full output file path
-                    ncopied = CopySingleFile(inputbuff,buffer);   //copy the file
+                    ncopied = CopyOrAddFile(inputbuff,buffer,plist);   //copy the file
                     free(buffer);
                     free(inputbuff);
                     return(ncopied);
@@ -1115,7 +1128,7 @@ int CFSUtils::CopyFiles(char *input, char *output)
                 }
             } else {
                 free(inputbuff);
-                return(CopySingleFile(input,output));   //overwrite an existing file
+                return(CopyOrAddFile(input,output,plist));   //overwrite an existing file
             }
         }
     }
@@ -1163,7 +1176,7 @@ int CFSUtils::CopyFiles(char *input, char *output)
                         strncat(tmpin,buffer,FSUTILS_MAXPATH-strlen(tmpin)-1);
                         tmpin[FSUTILS_MAXPATH-1] = '\0';
                         strutils.SNPrintf(tmpout,FSUTILS_MAXPATH,"%s%s",outputbuff,buffer);
-                        ncopied += CopySingleFile(tmpin,tmpout);
+                        ncopied += CopyOrAddFile(tmpin,tmpout,plist);
                     }
                 }
             } while (DirGetNextFile(handle,buffer,FSUTILS_MAXPATH) != 0);
@@ -1182,9 +1195,9 @@ int CFSUtils::CopyFiles(char *input, char *output)
                     if (type != 0) {
                         strutils.SNPrintf(tmpout,FSUTILS_MAXPATH,"%s%s",outputbuff,buffer);
                         if (type == 2)
-                            ncopied += CopySingleFile(tmpin,tmpout);    //tmpin is a file
+                            ncopied += CopyOrAddFile(tmpin,tmpout,plist);    //tmpin is a file
                         else
-                            ncopied += CopyFiles(tmpin,tmpout);         //tmpin is a dir (recurse)
+                            ncopied += CopyFiles(tmpin,tmpout,plist);        //tmpin is a dir (recurse)
                     }
                 }
             } while (DirGetNextFile(handle,buffer,FSUTILS_MAXPATH) != 0);
@@ -1206,18 +1219,29 @@ int CFSUtils::CopyFiles(char *input, char *output)
 //
 // [in] inputfilename  : file to be copied
 // [in] outputfilename : destination file
+// [out] pnbytes       : if not NULL, the number of bytes copied is
+//                       added to *pnbytes while the file is copied.
 //
 // Return : On success 1 is returned.  On failure 0 is returned.
 //
-int CFSUtils::CopySingleFile(char *inputfilename, char *outputfilename)
+// NOTE: On Linux the file is first cloned (FICLONE -- the new file
+//       shares the blocks of the input on Btrfs/XFS), then copied in
+//       the kernel (copy_file_range()), and only then copied through
+//       a buffer.
+//
+int CFSUtils::CopySingleFile(char *inputfilename, char *outputfilename, long *pnbytes /*=NULL*/)
 {
     FILE *fdr, *fdw;
     char *buffer;
-    int nbytes = 0, transferbuffersize = 512;
+    int nbytes = 0, retval = 1;
 
     if (ValidatePath(inputfilename) != 2)
         return(0);  //input is not a file
 
+    #ifdef LINUX
+      return(CopyFileFd(inputfilename,outputfilename,pnbytes));
+    #endif
+
     if ((fdr = fopen(inputfilename,"rb")) == NULL)
         return(0);
     if ((fdw = fopen(outputfilename,"wb")) == NULL) {
@@ -1226,21 +1250,53 @@ int CFSUtils::CopySingleFile(char *inputfilename, char *outputfilename)
     }
     //printf("Copy %s -> %s\n",inputfilename,outputfilename);
 
-    if ((buffer = (char *)malloc(transferbuffersize)) == NULL) {
+    if ((buffer = (char *)malloc(FSUTILS_COPYBUFSIZE)) == NULL) {
         fclose(fdw);
         fclose(fdr);
         return(0);
     }
 
-    while ((nbytes = fread(buffer,1,transferbuffersize,fdr)) > 0)
-        fwrite(buffer,1,nbytes,fdw);
+    while ((nbytes = fread(buffer,1,FSUTILS_COPYBUFSIZE,fdr)) > 0) {
+        if (fwrite(buffer,1,nbytes,fdw) != (unsigned)nbytes) {
+            retval = 0; //unable to write the file (Ex. disk full)
+            break;
+        }
+        if (pnbytes != NULL)
+            *pnbytes += nbytes;
+    }
+    if (ferror(fdr))
+        retval = 0;
 
     free(buffer);
 
-    fclose(fdw);
+    if (fclose(fdw) != 0)
+        retval = 0;
     fclose(fdr);
 
-    return(1);
+    return(retval);
+}
+
+//////////////////////////////////////////////////////////////////////
+// Frees the files in a list built by CopyFiles()
+//
+// [in] plist : list of files to copy
+//
+// Return : VOID
+//
+void CFSUtils::FreeCopyList(fsutilsCopyList_t *plist)
+{
+    int i;
+
+    if (plist == NULL)
+        return;
+
+    for (i = 0; i < plist->nfiles; i++) {
+        free(plist->files[i].inputfilename);
+        free(plist->files[i].outputfilename);
+    }
+    if (plist->files != NULL)
+        free(plist->files);
+    memset(plist,0,sizeof(fsutilsCopyList_t));
 }
 
 //////////////////////////////////////////////////////////////////////
@@ -1251,7 +1307,8 @@ int CFSUtils::CopySingleFile(char *inputfilename, char *outputfilename)
 //
 // Return : returns the number of files moved.
 //
-// NOTE: Wildcards can be used when specifying "input".
+// NOTE: Wildcards can be used when specifying "input".  Files on another
+//       file system are copied and deleted (see MoveSingleFile()).
 //
 int CFSUtils::MoveFiles(char *input, char *output)
 {
@@ -1292,7 +1349,7 @@ int CFSUtils::MoveFiles(char *input, char *output)
         if (type == 0) {
             free(inputbuff);
             //printf("Move %s -> %s\n",input,output);
-            if (rename(input,output) == 0) {  //output is a new file name (file -> file)
+            if (MoveSingleFile(input,output) != 0) {  //output is a new file name (file -> file)
                 return(1);
             } else {
                 return(0);
@@ -1306,7 +1363,7 @@ int CFSUtils::MoveFiles(char *input, char *output)
                     strcat(buffer,infileptr);   //build the full output file path
                     remove(buffer);             //delete the previous file (if necessary)
                     //printf("Move %s -> %s\n",inputbuff,buffer);
-                    nmoved = (rename(inputbuff,buffer) == 0) ? 1 : 0;   //move the file
+                    nmoved = MoveSingleFile(inputbuff,buffer);  //move the file
                     free(buffer);
                     free(inputbuff);
                     return(nmoved);
@@ -1318,7 +1375,7 @@ int CFSUtils::MoveFiles(char *input, char *output)
                 free(inputbuff);
                 remove(output);                 //delete the previous file
                 //printf("Move %s -> %s\n",input,output);
-                if (rename(input,output) == 0) {  //overwrite an existing file (file -> file)
+                if (MoveSingleFile(input,output) != 0) {  //overwrite an existing file (file -> file)
                     return(1);
                 } else {
                     return(0);
@@ -1372,7 +1429,7 @@ int CFSUtils::MoveFiles(char *input, char *output)
                         strutils.SNPrintf(tmpout,FSUTILS_MAXPATH,"%s%s",outputbuff,buffer);
                         remove(tmpout);             //delete the previous file (if necessary)
                         //printf("Move %s -> %s\n",tmpin,tmpout);
-                        nmoved += (rename(tmpin,tmpout) == 0) ? 1 : 0;
+                        nmoved += MoveSingleFile(tmpin,tmpout);
                     }
                 }
             } while (DirGetNextFile(handle,buffer,FSUTILS_MAXPATH) != 0);
@@ -1389,6 +1446,38 @@ int CFSUtils::MoveFiles(char *input, char *output)
     return(nmoved);
 }
 
+//////////////////////////////////////////////////////////////////////
+// Moves a single file.  If the file can not be renamed because the
+// destination is on another file system, the file is copied (see
+// CopySingleFile()) and then deleted.
+//
+// [in] inputfilename  : file to be moved
+// [in] outputfilename : destination file
+// [out] pnbytes       : if not NULL, the number of bytes copied is
+//                       added to *pnbytes while the file is copied.
+//
+// Return : On success 1 is returned.  On failure 0 is returned.
+//
+int CFSUtils::MoveSingleFile(char *inputfilename, char *outputfilename, long *pnbytes /*=NULL*/)
+{
+
+    if (inputfilename == NULL || outputfilename == NULL)
+        return(0);
+
+    if (rename(inputfilename,outputfilename) == 0)
+        return(1);
+
+    if (errno != EXDEV)
+        return(0);  //not a move to another file system
+
+    if (CopySingleFile(inputfilename,outputfilename,pnbytes) == 0) {
+        remove(outputfilename); //remove the partial copy
+        return(0);
+    }
+
+    return((remove(inputfilename) == 0) ? 1 : 0);
+}
+
 //////////////////////////////////////////////////////////////////////
 // Deletes the file(s)/directory specified.
 //
@@ -1716,3 +1805,111 @@ int CFSUtils::VerifyOutputDir(char *path, int maxpath)
 
     return(1);
 }
+
+    //copies a file, or adds it to "plist" if "plist" is not NULL
+    //(used by CopyFiles())
+int CFSUtils::CopyOrAddFile(char *inputfilename, char *outputfilename, fsutilsCopyList_t *plist)
+{
+    fsutilsCopyFile_t *files;
+    fsutilsFileInfo_t finfo;
+    int maxfiles;
+
+    if (plist == NULL)
+        return(CopySingleFile(inputfilename,outputfilename));
+
+    if (GetFileStats(inputfilename,&finfo) == 0)
+        return(0);
+
+    if (plist->nfiles == plist->maxfiles) {
+        maxfiles = (plist->maxfiles > 0) ? plist->maxfiles * 2 : 64;
+        if ((files = (fsutilsCopyFile_t *)realloc(plist->files,maxfiles*sizeof(fsutilsCopyFile_t))) == NULL)
+            return(0);
+        plist->files = files;
+        plist->maxfiles = maxfiles;
+    }
+
+    files = &plist->files[plist->nfiles];
+    files->inputfilename = strdup(inputfilename);
+    files->outputfilename = strdup(outputfilename);
+    if (files->inputfilename == NULL || files->outputfilename == NULL) {
+        if (files->inputfilename != NULL) free(files->inputfilename);
+        if (files->outputfilename != NULL) free(files->outputfilename);
+        return(0);
+    }
+    files->size = finfo.size;
+    plist->nbytes += finfo.size;
+    plist->nfiles++;
+
+    return(1);
+}
+
+#ifdef LINUX
+    //copies a file using the file descriptors (see CopySingleFile())
+int CFSUtils::CopyFileFd(char *inputfilename, char *outputfilename, long *pnbytes)
+{
+    struct stat st;
+    char *buffer;
+    long nbytes;
+    int fdr, fdw, retval = 1;
+
+    if ((fdr = open(inputfilename,O_RDONLY)) < 0)
+        return(0);
+    if (fstat(fdr,&st) != 0 || (fdw = open(outputfilename,O_WRONLY|O_CREAT|O_TRUNC,0666)) < 0) {
+        close(fdr);
+        return(0);
+    }
+
+    #ifdef FICLONE
+        //share the blocks of the input file (no data is copied)
+      if (ioctl(fdw,FICLONE,fdr) == 0) {
+          if (pnbytes != NULL)
+              *pnbytes += st.st_size;
+          close(fdw);
+          close(fdr);
+          return(1);
+      }
+    #endif
+
+    #ifdef SYS_copy_file_range
+        //copy in the kernel -- a failure (Ex. EXDEV on older kernels or
+        //EINVAL for some file systems) continues below from the same offset
+      while ((nbytes = syscall(SYS_copy_file_range,fdr,NULL,fdw,NULL,FSUTILS_COPYCHUNKSIZE,0)) > 0) {
+          if (pnbytes != NULL)
+              *pnbytes += nbytes;
+      }
+      if (nbytes == 0) {
+          retval = (close(fdw) == 0) ? 1 : 0;
+          close(fdr);
+          return(retval);
+      }
+    #endif
+
+        //copy through a buffer
+    if ((buffer = (char *)malloc(FSUTILS_COPYBUFSIZE)) == NULL) {
+        close(fdw);
+        close(fdr);
+        return(0);
+    }
+    while ((nbytes = read(fdr,buffer,FSUTILS_COPYBUFSIZE)) != 0) {
+        if (nbytes < 0) {
+            if (errno == EINTR)
+                continue;
+            retval = 0; //unable to read the file
+            break;
+        }
+        if (write(fdw,buffer,nbytes) != nbytes) {
+            retval = 0; //unable to write the file (Ex. disk full)
+            break;
+        }
+        if (pnbytes != NULL)
+            *pnbytes += nbytes;
+    }
+    free(buffer);
+
+    if (close(fdw) != 0)
+        retval = 0;
+    close(fdr);
+
+    return(retval);
+}
+#endif
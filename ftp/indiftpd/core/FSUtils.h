@@ -25,6 +25,9 @@
 #include <sys/stat.h>
 
 #define FSUTILS_MAXPATH 256     //max length of a file/dir path
+#define FSUTILS_MAXPWBUF 4096   //size of the buffer used to look up user/group names
+#define FSUTILS_COPYBUFSIZE 65536   //size of the buffer used to copy a file (read/write)
+#define FSUTILS_COPYCHUNKSIZE 8388608   //max bytes copied by each copy_file_range() (8MB)
 
 #ifdef WIN32
   #define FSUTILS_SLASH '\\'    //Windows slash
@@ -32,6 +35,14 @@
   #define FSUTILS_SLASH '/'     //UNIX slash
 #endif
 
+    //test the type in fsutilsFileInfo_t.mode (Windows does not define these)
+#ifndef S_ISDIR
+  #define S_ISDIR(mode) (((mode) & S_IFMT) == S_IFDIR)
+#endif
+#ifndef S_ISREG
+  #define S_ISREG(mode) (((mode) & S_IFMT) == S_IFREG)
+#endif
+
 typedef struct {
     long groupid;
     long timeaccess;
@@ -50,6 +61,19 @@ typedef struct {
     double bytesfree;
 } fsutilsDiskInfo_t;
 
+typedef struct {
+    char *inputfilename;    //file to copy
+    char *outputfilename;   //destination file
+    long size;              //size of the file (bytes)
+} fsutilsCopyFile_t;
+
+typedef struct {
+    fsutilsCopyFile_t *files;   //files to copy
+    int nfiles;                 //number of files in the list
+    int maxfiles;               //number of files allocated
+    long nbytes;                //total size of the files (bytes)
+} fsutilsCopyList_t;    //list of files to copy (initialize to all 0's)
+
 class CFSUtils  
 {
 public:
@@ -91,9 +115,11 @@ public:
     int Rename(const char *oldname, const char *newname);
 
         //advanced file functions
-    int CopyFiles(char *input, char *output);
-    int CopySingleFile(char *inputfilename, char *outputfilename);
+    int CopyFiles(char *input, char *output, fsutilsCopyList_t *plist = NULL);
+    int CopySingleFile(char *inputfilename, char *outputfilename, long *pnbytes = NULL);
+    void FreeCopyList(fsutilsCopyList_t *plist);
     int MoveFiles(char *input, char *output);
+    int MoveSingleFile(char *inputfilename, char *outputfilename, long *pnbytes = NULL);
     int DeleteFiles(char *input, int flagkeepdirs = 0);
 
         //disk drive information functions
@@ -105,6 +131,10 @@ private:
     char *GetFileNamePtr(char *path);
     void CreateRelativePath(char *path, int maxpath);
     int VerifyOutputDir(char *path, int maxpath);
+    int CopyOrAddFile(char *inputfilename, char *outputfilename, fsutilsCopyList_t *plist);
+    #ifdef LINUX
+      int CopyFileFd(char *inputfilename, char *outputfilename, long *pnbytes);
+    #endif
 };
 
 #endif //FSUTILS_H
@@ -208,6 +208,10 @@ int CFtps::ExecFTP(int argc, char **argv)
                 retval = DoMDTM(argc,argv);
             } else if (strutils.CaseCmp(argv[0],"MKD") == 0) {
                 retval = DoMKD(argc,argv);
+            } else if (strutils.CaseCmp(argv[0],"MLSD") == 0) {
+                retval = DoMLSD(argc,argv);
+            } else if (strutils.CaseCmp(argv[0],"MLST") == 0) {
+                retval = DoMLST(argc,argv);
             } else if (strutils.CaseCmp(argv[0],"MODE") == 0) {
                 retval = DoMODE(argc,argv);
             } else {
@@ -417,7 +421,8 @@ int CFtps::DoAUTH(int argc, char **argv)
         }
         EventHandler(argc,argv,"Security data exchange complete.","234",1,1,0);
         m_psiteinfo->GetPrivKeyPW(privpw,sizeof(privpw));
-        if ((sslinfo = m_sslsock.SSLServerNeg(m_sd,privkeybuf,privkeysize,privpw,certbuf,certsize,&errcode)) != NULL) {
+        if ((sslinfo = m_sslsock.SSLServerNeg(m_sd,privkeybuf,privkeysize,privpw,certbuf,certsize,&errcode,
+                                              m_psiteinfo->m_sslcachesize,m_psiteinfo->m_sslcachettl)) != NULL) {
             memcpy(&m_sslinfo,sslinfo,sizeof(sslsock_t));
             m_sslsock.FreeSSLInfo(sslinfo);
             m_ftpscmd.SetSSLInfo(&m_sslinfo);   //set the SSL info
@@ -574,6 +579,7 @@ int CFtps::DoFEAT(int argc, char **argv)
 
     m_ftpscmd.ResponseSend("Extensions supported","211",1);
     m_ftpscmd.ResponseSend("  AUTH SSL","211",1);
+    m_ftpscmd.ResponseSend("  MLST type*;size*;modify*;perm*;unix.mode*;","211",1);
     m_ftpscmd.ResponseSend("  PBSZ","211",1);
     m_ftpscmd.ResponseSend("  PROT","211",1);
     EventHandler(argc,argv,"FEAT command successful.","211",1,1,0);
@@ -588,12 +594,13 @@ int CFtps::DoHELP(int argc, char **argv)
     m_ftpscmd.ResponseSend("  ABOR   *ACCT   *ALLO    APPE ","214",1);
     m_ftpscmd.ResponseSend("  CDUP    CWD     DELE    FEAT ","214",1);
     m_ftpscmd.ResponseSend("  HELP    LIST    MDTM    MKD  ","214",1);
-    m_ftpscmd.ResponseSend("  MODE    NLST    NOOP   *OPTS ","214",1);
-    m_ftpscmd.ResponseSend("  PASS    PASV    PORT    PWD  ","214",1);
-    m_ftpscmd.ResponseSend("  QUIT   *REIN    REST    RETR ","214",1);
-    m_ftpscmd.ResponseSend("  RMD     RNFR    RNTO    SITE ","214",1);
-    m_ftpscmd.ResponseSend("  SIZE   *SMNT    STAT    STOR ","214",1);
-    m_ftpscmd.ResponseSend("  STOU    SYST    TYPE    USER ","214",1);
+    m_ftpscmd.ResponseSend("  MLSD    MLST    MODE    NLST ","214",1);
+    m_ftpscmd.ResponseSend("  NOOP   *OPTS    PASS    PASV ","214",1);
+    m_ftpscmd.ResponseSend("  PORT    PWD     QUIT   *REIN ","214",1);
+    m_ftpscmd.ResponseSend("  REST    RETR    RMD     RNFR ","214",1);
+    m_ftpscmd.ResponseSend("  RNTO    SITE    SIZE   *SMNT ","214",1);
+    m_ftpscmd.ResponseSend("  STAT    STOR    STOU    SYST ","214",1);
+    m_ftpscmd.ResponseSend("  TYPE    USER ","214",1);
     EventHandler(argc,argv,"HELP command successful.","214",1,1,0);
 
     return(1);
@@ -602,11 +609,14 @@ int CFtps::DoHELP(int argc, char **argv)
 int CFtps::DoLIST(int argc, char **argv)
 {
     CFSUtils fsutils;
+    CStrUtils strutils;
     CCmdLine cmdline(0);
-    CThr thr;
     ftpsXferInfo_t *xferinfo;
     char *tmppath, permissions[4];
-    int i, optionlen;
+    int i, optionlen, flagmlsd, retval;
+
+        //DoMLSD() also uses this function
+    flagmlsd = (strutils.CaseCmp(argv[0],"MLSD") == 0) ? 1 : 0;
 
         //allocate the transfer information structure
         //this structure is properly free() by ftpsXferThread()
@@ -615,9 +625,9 @@ int CFtps::DoLIST(int argc, char **argv)
         return(0);
     }
 
-        //extract the options
+        //extract the options (MLSD does not have options)
     optionlen = 0;
-    for (i = 1; i < argc; i++) {
+    for (i = 1; i < argc && flagmlsd == 0; i++) {
         if (*argv[i] == '-') {  //if the argument is an option
             optionlen += strlen(argv[i]+1);
             if (optionlen < (int)sizeof(xferinfo->options))
@@ -626,7 +636,7 @@ int CFtps::DoLIST(int argc, char **argv)
     }
 
         //allocate memory for the path
-    if ((xferinfo->path = cmdline.CombineArgs(argc,argv,'-')) == NULL) {
+    if ((xferinfo->path = cmdline.CombineArgs(argc,argv,(flagmlsd == 0) ? '-' : 0)) == NULL) {
         EventHandler(argc,argv,"ERROR: out of memory.","451",1,1,1);
         free(xferinfo);
         return(0);
@@ -637,7 +647,7 @@ int CFtps::DoLIST(int argc, char **argv)
         strcpy(permissions,"vx");   //permissions needed for recursive listing
     else
         strcpy(permissions,"lvx");   //permissions needed for non-recursive listing
-    if (CheckPermissions("LIST",xferinfo->path,permissions,1) == 0) {
+    if (CheckPermissions(argv[0],xferinfo->path,permissions,1) == 0) {
         cmdline.FreeCombineArgs(xferinfo->path); free(xferinfo);
         return(0);
     }
@@ -675,7 +685,7 @@ int CFtps::DoLIST(int argc, char **argv)
     strcpy(xferinfo->userroot,m_userroot);  //set the user's root directory
 
         //set the remaining values of the transfer info
-    xferinfo->command = 'L';    //indicate the command is a LIST
+    xferinfo->command = (flagmlsd == 0) ? 'L' : 'M';   //indicate the command is a LIST (or MLSD)
     xferinfo->flagpasv = m_flagpasv;
     xferinfo->pasvsd = m_pasvsd;
     strcpy(xferinfo->portaddr,m_portaddr);
@@ -689,10 +699,13 @@ int CFtps::DoLIST(int argc, char **argv)
     m_flagabor = 0;     //reset the abort flag
     m_numlistthreads++; //increment the number of listing threads
 
-        //create the thread to transfer the directory listing
-    if (thr.Create(ftpsXferThread,(void *)xferinfo) == 0) {
-            //if unable to create the new thread, clean up.
-        EventHandler(argc,argv,"ERROR: unable to create a new transfer thread.","530",1,1,1);
+        //run the thread to transfer the directory listing
+    if ((retval = StartXferThread((void *)xferinfo)) <= 0) {
+            //if unable to run the transfer, clean up.
+        if (retval < 0)
+            EventHandler(argc,argv,"Too many transfers in progress, try again later.","425",1,1,0);
+        else
+            EventHandler(argc,argv,"ERROR: unable to create a new transfer thread.","530",1,1,1);
         cmdline.FreeCombineArgs(xferinfo->path); free(xferinfo->cwd);
         free(xferinfo->userroot); free(xferinfo);
         m_numlistthreads--;
@@ -800,6 +813,102 @@ int CFtps::DoMKD(int argc, char **argv)
     return(retval);
 }
 
+int CFtps::DoMLSD(int argc, char **argv)
+{
+    CFSUtils fsutils;
+    CCmdLine cmdline(0);
+    char *dirname, *tmppath;
+    int type;
+
+    if ((dirname = cmdline.CombineArgs(argc,argv)) == NULL) {
+        EventHandler(argc,argv,"ERROR: out of memory.","451",1,1,1);
+        return(0);
+    }
+
+    if ((tmppath = fsutils.BuildPath(m_userroot,m_cwd,dirname)) == NULL) {
+        EventHandler(argc,argv,"ERROR: unable to set directory path.","550",1,1,0);
+        cmdline.FreeCombineArgs(dirname);
+        return(0);
+    }
+    type = fsutils.ValidatePath(tmppath);
+    fsutils.FreePath(tmppath);
+
+        //MLSD only lists directories (w/o wildcards)
+    if (type == 2 || strchr(dirname,'*') != NULL) {
+        fsutils.CheckSlashUNIX(dirname);    //display the path w/UNIX slashes
+        WriteToLineBuffer("%s: Not a directory.",dirname);
+        EventHandler(argc,argv,m_linebuffer,"501",1,1,0);
+        cmdline.FreeCombineArgs(dirname);
+        return(0);
+    }
+    cmdline.FreeCombineArgs(dirname);
+
+        //send the listing the same way as LIST
+    return(DoLIST(argc,argv));
+}
+
+int CFtps::DoMLST(int argc, char **argv)
+{
+    CFSUtils fsutils;
+    CCmdLine cmdline(0);
+    fsutilsFileInfo_t fileinfo;
+    char *filename, *path, *dispname, fileperm[SITEINFO_MAXMLSXPERM], dirperm[SITEINFO_MAXMLSXPERM];
+    int retval = 0;
+
+    if ((filename = cmdline.CombineArgs(argc,argv)) == NULL) {
+        EventHandler(argc,argv,"ERROR: out of memory.","451",1,1,1);
+        return(0);
+    }
+
+        //check the user's permissions for the path
+    if (CheckPermissions("MLST",filename,"lx",1) == 0) {
+        cmdline.FreeCombineArgs(filename);
+        return(0);
+    }
+
+    if ((path = fsutils.BuildPath(m_userroot,m_cwd,filename)) == NULL) {
+        EventHandler(argc,argv,"ERROR: unable to set directory path.","550",1,1,0);
+        cmdline.FreeCombineArgs(filename);
+        return(0);
+    }
+
+        //display the path that was entered (or the CWD)
+    if ((dispname = (char *)malloc(strlen(filename)+strlen(m_cwd)+2)) == NULL) {
+        EventHandler(argc,argv,"ERROR: out of memory.","451",1,1,1);
+        fsutils.FreePath(path); cmdline.FreeCombineArgs(filename);
+        return(0);
+    }
+    if (*filename != '\0')
+        strcpy(dispname,filename);
+    else
+        sprintf(dispname,"/%s",m_cwd);
+    fsutils.CheckSlashUNIX(dispname);   //display the path w/UNIX slashes
+
+    if (fsutils.GetFileStats(path,&fileinfo) != 0) {
+            //the "perm" facts are based on the permissions of the directory
+        if (S_ISDIR(fileinfo.mode) == 0)
+            fsutils.GetDirPath(path,strlen(path)+1,path);
+        m_psiteinfo->GetMLSxPerm(m_login,path,fileperm,dirperm);
+        WriteToLineBuffer("Listing %s",dispname);
+        m_ftpscmd.ResponseSend(m_linebuffer,"250",1);
+            //the facts are sent on a line that starts with a space
+        *m_linebuffer = ' ';
+        m_psiteinfo->BuildMLSxLine(m_linebuffer+1,sizeof(m_linebuffer)-1,dispname,&fileinfo,S_ISDIR(fileinfo.mode) ? dirperm : fileperm);
+        m_ftpscmd.ResponseSend(m_linebuffer,"",3);
+        EventHandler(argc,argv,"End","250",1,1,0);
+        retval = 1;
+    } else {
+        WriteToLineBuffer("%s: No such file or directory.",dispname);
+        EventHandler(argc,argv,m_linebuffer,"550",1,1,0);
+    }
+
+    free(dispname);
+    fsutils.FreePath(path);
+    cmdline.FreeCombineArgs(filename);
+
+    return(retval);
+}
+
 int CFtps::DoMODE(int argc, char **argv)
 {
     int retval = 0;
@@ -1145,10 +1254,9 @@ int CFtps::DoRETR(int argc, char **argv)
 {
     CFSUtils fsutils;
     CCmdLine cmdline(0);
-    CThr thr;
     ftpsXferInfo_t *xferinfo;
     char *tmppath;
-    int i;
+    int i, retval;
 
     if (argc < 2) {
         EventHandler(argc,argv,"'RETR': Invalid number of parameters.","500",1,1,0);
@@ -1227,10 +1335,13 @@ int CFtps::DoRETR(int argc, char **argv)
     m_numdatathreads++; //increment the number of data transfer threads
     m_restoffset = 0;   //reset the transfer reset offset
 
-        //create the thread to transfer the file
-    if (thr.Create(ftpsXferThread,(void *)xferinfo) == 0) {
-            //if unable to create the new thread, clean up.
-        EventHandler(argc,argv,"ERROR: unable to create a new transfer thread.","530",1,1,1);
+        //run the thread to transfer the file
+    if ((retval = StartXferThread((void *)xferinfo)) <= 0) {
+            //if unable to run the transfer, clean up.
+        if (retval < 0)
+            EventHandler(argc,argv,"Too many transfers in progress, try again later.","425",1,1,0);
+        else
+            EventHandler(argc,argv,"ERROR: unable to create a new transfer thread.","530",1,1,1);
         cmdline.FreeCombineArgs(xferinfo->path); free(xferinfo->cwd);
         free(xferinfo->userroot); free(xferinfo);
         m_numdatathreads--;
@@ -1566,10 +1677,9 @@ int CFtps::DoSTOR(int argc, char **argv, int mode /*=0*/)
 {
     CFSUtils fsutils;
     CCmdLine cmdline(0);
-    CThr thr;
     ftpsXferInfo_t *xferinfo;
     char *buffer, *tmppath;
-    int i;
+    int i, retval;
 
     if (argc < 2) {
         EventHandler(argc,argv,"'STOR': Invalid number of parameters.","500",1,1,0);
@@ -1655,10 +1765,13 @@ int CFtps::DoSTOR(int argc, char **argv, int mode /*=0*/)
     m_numdatathreads++; //increment the number of data transfer threads
     m_restoffset = 0;   //reset the transfer reset offset
 
-        //create the thread to transfer the file
-    if (thr.Create(ftpsXferThread,(void *)xferinfo) == 0) {
-            //if unable to create the new thread, clean up.
-        EventHandler(argc,argv,"ERROR: unable to create a new transfer thread.","530",1,1,1);
+        //run the thread to transfer the file
+    if ((retval = StartXferThread((void *)xferinfo)) <= 0) {
+            //if unable to run the transfer, clean up.
+        if (retval < 0)
+            EventHandler(argc,argv,"Too many transfers in progress, try again later.","425",1,1,0);
+        else
+            EventHandler(argc,argv,"ERROR: unable to create a new transfer thread.","530",1,1,1);
         cmdline.FreeCombineArgs(xferinfo->path); free(xferinfo->cwd);
         free(xferinfo->userroot); free(xferinfo);
         m_numdatathreads--;
@@ -2138,3 +2251,19 @@ int CFtps::CheckPermissions(char *cmd, char *arg, char *pflags, int flagdir /*=0
 
     return(retval);
 }
+
+    //Runs a transfer ("xferinfo" is a ftpsXferInfo_t) in one of the site's
+    //transfer threads.  If the site does not run transfer threads, a new
+    //thread is created for the transfer.
+    //Returns 1 on success, 0 if a new thread can't be created and -1 if too
+    //many transfers are waiting for a transfer thread.
+int CFtps::StartXferThread(void *xferinfo)
+{
+    CThr thr;
+    int retval;
+
+    if ((retval = m_psiteinfo->AddXfer(ftpsXferJob,xferinfo)) != 0)
+        return(retval);
+
+    return((thr.Create(ftpsXferThread,xferinfo) != 0) ? 1 : 0);
+}
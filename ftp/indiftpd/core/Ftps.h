@@ -70,6 +70,8 @@ public:
     virtual int DoLIST(int argc, char **argv);
     virtual int DoMDTM(int argc, char **argv);
     virtual int DoMKD(int argc, char **argv);
+    virtual int DoMLSD(int argc, char **argv);
+    virtual int DoMLST(int argc, char **argv);
     virtual int DoMODE(int argc, char **argv);
     virtual int DoNLST(int argc, char **argv);
     virtual int DoNOOP(int argc, char **argv);
@@ -140,6 +142,7 @@ public:
 protected:
     void DefaultResp(int argc, char **argv);
     int CheckPermissions(char *cmd, char *arg, char *pflags, int flagdir = 0);
+    int StartXferThread(void *xferinfo);
 
 protected:
     CSiteInfo *m_psiteinfo;     //pointer to the class containing the site information
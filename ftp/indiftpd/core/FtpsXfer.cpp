@@ -29,6 +29,7 @@
   #include <io.h>       //for open(), read(), write(), close()
 #else
   #include <unistd.h>   //for open(), read(), write(), close()
+  #include <fnmatch.h>  //for fnmatch()
 #endif
 
 #include "FtpsXfer.h"
@@ -36,6 +37,8 @@
 #include "StrUtils.h"
 #include "FSUtils.h"
 #include "SiteInfo.h"
+#include "AsciiXlate.h"
+#include "DirCache.h"
 
 //////////////////////////////////////////////////////////////////////
 //////////////////////////////////////////////////////////////////////
@@ -44,7 +47,7 @@
 //////////////////////////////////////////////////////////////////////
 
 //////////////////////////////////////////////////////////////////////
-// Function used to start the new transfer thread
+// Functions used to run the transfers
 //////////////////////////////////////////////////////////////////////
 
     //NOTE: This function does not check the validity of the buffers
@@ -55,6 +58,23 @@
 #else
   void *ftpsXferThread(void *vp)    //UNIX must return "void *" to run as a new thread
 #endif
+{
+    void *vpxfer = NULL;
+
+        //run the transfer w/ a CFtpsXfer that is only used once
+    ftpsXferJob(vp,&vpxfer);
+    ftpsXferJobExit(vpxfer);
+
+    #ifndef WIN32
+      return(NULL);
+    #endif
+}
+
+    //Runs the transfer in "vp" (ftpsXferInfo_t) in a transfer thread.
+    //"*vppxfer" is the CFtpsXfer kept by the thread for its transfers
+    //(it is created if it is NULL).  The buffers in the CFtpsXfer are
+    //reused by the next transfer of the thread.
+void ftpsXferJob(void *vp, void **vppxfer)
 {
     ftpsXferInfo_t *xferinfo;
     CFtpsXfer *pxfer;
@@ -62,20 +82,21 @@
     
     args[0] = cmd; args[1] = arg;
 
-    if (vp == NULL)
-        #ifdef WIN32
-          return;
-        #else
-          return(NULL);
-        #endif
+    if (vp == NULL || vppxfer == NULL)
+        return;
 
     xferinfo = (ftpsXferInfo_t *)vp;
 
-    if ((pxfer = new CFtpsXfer()) != NULL) {
+    if (*vppxfer == NULL)
+        *vppxfer = (void *)new CFtpsXfer();
+
+    if ((pxfer = (CFtpsXfer *)(*vppxfer)) != NULL) {
+
+        pxfer->Reset();     //clear the state left by the previous transfer
 
         switch (xferinfo->command) {
         
-            case 'L': {
+            case 'L': case 'M': {
                 pxfer->SendList(xferinfo);
             } break;
 
@@ -93,7 +114,6 @@
 
         } // end switch
 
-        delete pxfer;
     } else {
         xferinfo->pftps->EventHandler(2,args,"ERROR: out of memory.","451",1,1,1);
     }
@@ -102,10 +122,14 @@
     free(xferinfo->cwd);
     free(xferinfo->userroot);
     free(vp);
+}
 
-    #ifndef WIN32
-      return(NULL);
-    #endif
+    //Frees the CFtpsXfer kept by a transfer thread (when the thread exits)
+void ftpsXferJobExit(void *vpxfer)
+{
+
+    if (vpxfer != NULL)
+        delete (CFtpsXfer *)vpxfer;
 }
 
 //////////////////////////////////////////////////////////////////////
@@ -115,30 +139,48 @@
 CFtpsXfer::CFtpsXfer()
 {
 
-        //initialize the connection parameters
-    m_datasd = SOCK_INVALID;
-    memset(&m_sslinfo,0,sizeof(sslsock_t));
+        //the buffers are allocated when they are first needed
+    m_packet = NULL;
+    m_listbuf = NULL;
+    m_pipefd[0] = m_pipefd[1] = -1;
 
-        //initialize the transfer speed parameters
-    m_maxulspeed = 0;
-    m_maxdlspeed = 0;
-    m_bytesxfered = 0;
-    m_xfertimer = 0;
-
-        //initialize the transfer rate parameters
-    m_timexferrateupdt = 0;
-    m_bytessincerateupdt = 0;
+    Reset();
 }
 
 CFtpsXfer::~CFtpsXfer()
 {
 
+    if (m_packet != NULL)
+        free(m_packet);
+    if (m_listbuf != NULL)
+        free(m_listbuf);
+    ClosePipe();
 }
 
 //////////////////////////////////////////////////////////////////////
 // Public Methods
 //////////////////////////////////////////////////////////////////////
 
+    //Prepares the class for a new transfer (the buffers are kept)
+void CFtpsXfer::Reset()
+{
+
+        //initialize the connection parameters
+    m_datasd = SOCK_INVALID;
+    memset(&m_sslinfo,0,sizeof(sslsock_t));
+
+        //initialize the transfer speed parameters
+    m_puserbucket = NULL;
+    m_xferbucket.SetParent(NULL);
+    m_xferbucket.SetRate(0);    //the next limit starts w/ a full bucket
+
+        //initialize the transfer rate parameters
+    m_timexferrateupdt = 0;
+    m_bytessincerateupdt = 0;
+
+    m_asciixlate.Reset();
+}
+
     //Sends the directory listing using the control connection
     //This is used by STAT
 int CFtpsXfer::SendListCtrl(ftpsXferInfo_t *xferinfo)
@@ -164,9 +206,10 @@ int CFtpsXfer::SendList(ftpsXferInfo_t *xferinfo)
     char *buffer;
     unsigned long ltime1, ltime2;
     long nbytes = 0;    //number of bytes sent in the dir listing
-    char *args[2], cmd[] = "LIST";
+    char *args[2], cmd[] = "LIST", cmdmlsd[] = "MLSD";
 
-    args[0] = cmd; args[1] = xferinfo->path;
+    args[0] = (xferinfo->command == 'M') ? cmdmlsd : cmd;
+    args[1] = xferinfo->path;
 
         //create the data connection
     if (xferinfo->flagpasv != 0) {
@@ -359,13 +402,15 @@ int CFtpsXfer::RecvFile(ftpsXferInfo_t *xferinfo)
         }
     }
     
-        //set the max upload speed for the user
-    m_maxulspeed = xferinfo->psiteinfo->GetMaxULSpeed(xferinfo->pftps->GetLogin());
+        //set the max upload speed for the transfer
+    StartXferLimit(xferinfo,1);
 
     ltime1 = timer.Get();   //time how long it takes to receive the data
     nbytes = RecvFileData(xferinfo,fdw);
     ltime2 = timer.Get();   //stop timing
 
+    EndXferLimit(xferinfo);
+
         //close the data connection and file descriptor
     if (xferinfo->flagencdata != 0) m_sslsock.SSLClose(&m_sslinfo);
     m_sock.Close(m_datasd);
@@ -518,13 +563,15 @@ int CFtpsXfer::SendFile(ftpsXferInfo_t *xferinfo)
         }
     }
 
-        //set the max download speed for the user
-    m_maxdlspeed = xferinfo->psiteinfo->GetMaxDLSpeed(xferinfo->pftps->GetLogin());
+        //set the max download speed for the transfer
+    StartXferLimit(xferinfo,0);
 
     ltime1 = timer.Get();   //time how long it takes to send the data
     nbytes = SendFileData(xferinfo,fdr);
     ltime2 = timer.Get();   //stop timing
 
+    EndXferLimit(xferinfo);
+
         //close the data connection and file descriptor
     if (xferinfo->flagencdata != 0) m_sslsock.SSLClose(&m_sslinfo);
     m_sock.Close(m_datasd);
@@ -572,29 +619,23 @@ int CFtpsXfer::SendFile(ftpsXferInfo_t *xferinfo)
 void CFtpsXfer::SendListData(ftpsXferInfo_t *xferinfo, long *nbytes)
 {
     CFSUtils fsutils;
+    CStrUtils strutils;
+    CDirCache *pdircache;
+    dircacheList_t *plist;
+    fsutilsFileInfo_t fileinfo, *finfo;
     ftpsXferInfo_t *tmpxferinfo;
-    char *linebuf, *fullpath, *packet, *listline, thisyear[8], *tmpbuf, *ptr;
-    int listlinelen, packetlen = 0, len;
-    long handle;
-
-    if ((linebuf = (char *)malloc(FTPSXFER_MAXDIRENTRY)) == NULL)
-        return;
+    char *fullpath, *dirpath, *pattern, *packet, *types, thisyear[8], *tmpbuf;
+    char fileperm[SITEINFO_MAXMLSXPERM], dirperm[SITEINFO_MAXMLSXPERM];
+    int packetlen = 0, flagdir, i;
 
         //allocate memory/build the full directory/file path
-    if ((fullpath = fsutils.BuildPath(xferinfo->userroot,xferinfo->cwd,xferinfo->path)) == NULL) {
-        free(linebuf);
+    if ((fullpath = fsutils.BuildPath(xferinfo->userroot,xferinfo->cwd,xferinfo->path)) == NULL)
         return;
-    }
 
-        //allocate mem for the buffer used to store data that is sent
-    if ((packet = (char *)malloc(FTPSXFER_MAXPACKETSIZE)) == NULL) {
-        fsutils.FreePath(fullpath); free(linebuf);
-        return;
-    }
-        //allocate mem for a line in the listing
-    listlinelen = FTPSXFER_MAXDIRENTRY;
-    if ((listline = (char *)malloc(listlinelen)) == NULL) {
-        free(packet); fsutils.FreePath(fullpath); free(linebuf);
+        //get the buffer the listing lines are built in
+        //(-R: it is free again when the sub-directories are listed)
+    if ((packet = GetBuffer(&m_listbuf,FTPSXFER_LISTBUFSIZE)) == NULL) {
+        fsutils.FreePath(fullpath);
         return;
     }
 
@@ -603,17 +644,10 @@ void CFtpsXfer::SendListData(ftpsXferInfo_t *xferinfo, long *nbytes)
     xferinfo->psiteinfo->GetTimeString(thisyear,sizeof(thisyear),"%Y",time(NULL));
 
         //check if the fullpath is a file.
-    BuildListLine(fullpath,"",listline,listlinelen,xferinfo,2,thisyear);
-    if (*listline != '\0') {
-        if ((ptr = strchr(listline,'\r')) != NULL) {
-            *ptr = '\0';
-            len = strlen(listline);
-            strncat(listline,xferinfo->path,listlinelen-len-3);
-            listline[listlinelen-3] = '\0';
-            strcat(listline,"\r\n");    //end the line
-            *nbytes += AddToSendBuffer(packet,FTPSXFER_MAXPACKETSIZE,&packetlen,listline,strlen(listline),xferinfo->flagencdata,1);
-        }
-        free(listline); free(packet); fsutils.FreePath(fullpath); free(linebuf);
+    if (strchr(fullpath,'*') == NULL && fsutils.GetFileStats(fullpath,&fileinfo) != 0 && S_ISDIR(fileinfo.mode) == 0) {
+        packetlen = BuildListLine(xferinfo->path,&fileinfo,packet,FTPSXFER_MAXDIRENTRY,xferinfo,thisyear,"");
+        *nbytes += AddToSendBuffer(packet,FTPSXFER_LISTBUFSIZE,&packetlen,"",0,xferinfo->flagencdata,1);
+        fsutils.FreePath(fullpath);
         return; //send the listing for the file and return
     }
 
@@ -626,7 +660,7 @@ void CFtpsXfer::SendListData(ftpsXferInfo_t *xferinfo, long *nbytes)
             if ((tmpbuf = (char *)malloc(strlen(xferinfo->path)+4)) != NULL) {
                 sprintf(tmpbuf,"%s:\r\n",xferinfo->path);
                 fsutils.CheckSlashUNIX(tmpbuf);
-                *nbytes += AddToSendBuffer(packet,FTPSXFER_MAXPACKETSIZE,&packetlen,tmpbuf,strlen(tmpbuf),xferinfo->flagencdata);
+                *nbytes += AddToSendBuffer(packet,FTPSXFER_LISTBUFSIZE,&packetlen,tmpbuf,strlen(tmpbuf),xferinfo->flagencdata);
                 free(tmpbuf);
             }
         } else {
@@ -634,83 +668,120 @@ void CFtpsXfer::SendListData(ftpsXferInfo_t *xferinfo, long *nbytes)
             if ((tmpbuf = (char *)malloc(strlen(xferinfo->path)+23)) != NULL) {
                 sprintf(tmpbuf,"%s: Permission denied.\r\n",xferinfo->path);
                 fsutils.CheckSlashUNIX(tmpbuf);
-                *nbytes += AddToSendBuffer(packet,FTPSXFER_MAXPACKETSIZE,&packetlen,tmpbuf,strlen(tmpbuf),xferinfo->flagencdata,1);
+                *nbytes += AddToSendBuffer(packet,FTPSXFER_LISTBUFSIZE,&packetlen,tmpbuf,strlen(tmpbuf),xferinfo->flagencdata,1);
                 free(tmpbuf);
             }
-            free(listline); free(packet); fsutils.FreePath(fullpath); free(linebuf);
+            fsutils.FreePath(fullpath);
             return; //send the permission denied message and return
         }
     }
 
-        //List all the directories
-    if ((handle = fsutils.DirGetFirstFile(fullpath,linebuf,FTPSXFER_MAXDIRENTRY)) <= 0) {
-        free(listline); free(packet); fsutils.FreePath(fullpath); free(linebuf);
-        return;
-    }
-    do {
-        if (xferinfo->pftps->GetFlagAbor() != 0) {   //check for ABOR
-            fsutils.DirClose(handle); free(listline); free(packet); fsutils.FreePath(fullpath); free(linebuf);
+        //split a wildcard path into the directory and the pattern
+        //(Ex. /ftp/dir/*.txt -> /ftp/dir/ and *.txt)
+    dirpath = fullpath;
+    pattern = NULL;
+    if (strchr(fullpath,'*') != NULL) {
+        if ((dirpath = (char *)malloc(strlen(fullpath)+1)) == NULL) {
+            fsutils.FreePath(fullpath);
             return;
         }
-        BuildListLine(fullpath,linebuf,listline,listlinelen,xferinfo,1,thisyear);
-        *nbytes += AddToSendBuffer(packet,FTPSXFER_MAXPACKETSIZE,&packetlen,listline,strlen(listline),xferinfo->flagencdata);
-    } while (fsutils.DirGetNextFile(handle,linebuf,FTPSXFER_MAXDIRENTRY) > 0);
-    fsutils.DirClose(handle);
-
-        //List all the files
-    if ((handle = fsutils.DirGetFirstFile(fullpath,linebuf,FTPSXFER_MAXDIRENTRY)) <= 0) {
-        free(listline); free(packet); fsutils.FreePath(fullpath); free(linebuf);
+        fsutils.GetDirPath(dirpath,strlen(fullpath)+1,fullpath);
+        pattern = fullpath + strlen(dirpath);
+    }
+
+        //get the (cached) names in the directory
+    pdircache = xferinfo->psiteinfo->GetDirCache();
+    if ((plist = pdircache->OpenDir(dirpath)) == NULL) {
+        *nbytes += AddToSendBuffer(packet,FTPSXFER_LISTBUFSIZE,&packetlen,"",0,xferinfo->flagencdata,1);
+        if (dirpath != fullpath) free(dirpath);
+        fsutils.FreePath(fullpath);
         return;
     }
-    do {
-        if (xferinfo->pftps->GetFlagAbor() != 0) {   //check for ABOR
-            fsutils.DirClose(handle); free(listline); free(packet); fsutils.FreePath(fullpath); free(linebuf);
-            return;
+    finfo = (fsutilsFileInfo_t *)malloc(sizeof(fsutilsFileInfo_t)*plist->nfiles + 1);
+    types = (char *)malloc(plist->nfiles + 1);
+    if (finfo == NULL || types == NULL) {
+        if (finfo != NULL) free(finfo);
+        if (types != NULL) free(types);
+        pdircache->CloseDir(plist);
+        if (dirpath != fullpath) free(dirpath);
+        fsutils.FreePath(fullpath);
+        return;
+    }
+
+        //get the stats of the files that are listed
+        //types[i] = 1 for a directory, 2 for a file, 0 if not listed
+    for (i = 0; i < plist->nfiles; i++) {
+        types[i] = 0;
+        if (pattern != NULL) {
+            #ifdef WIN32
+              if (strutils.MatchWildcard(pattern,plist->names[i]) == 0)
+            #else
+              if (fnmatch(pattern,plist->names[i],FNM_PERIOD) != 0)
+            #endif
+                continue;
+        } else if (*(plist->names[i]) == '.') {
+            continue;   //hidden files are only listed when they match a pattern
         }
-        BuildListLine(fullpath,linebuf,listline,listlinelen,xferinfo,2,thisyear);
-        *nbytes += AddToSendBuffer(packet,FTPSXFER_MAXPACKETSIZE,&packetlen,listline,strlen(listline),xferinfo->flagencdata);
-    } while (fsutils.DirGetNextFile(handle,linebuf,FTPSXFER_MAXDIRENTRY) > 0);
-    fsutils.DirClose(handle);
+        if (pdircache->GetFileStats(plist,i,&finfo[i]) != 0)
+            types[i] = S_ISDIR(finfo[i].mode) ? 1 : 2;
+    }
+
+        //get the "perm" facts for MLSD
+    *fileperm = *dirperm = '\0';
+    if (xferinfo->command == 'M')
+        xferinfo->psiteinfo->GetMLSxPerm(xferinfo->pftps->GetLogin(),dirpath,fileperm,dirperm);
+
+        //List all the directories and then all the files
+        //(the lines are built directly in the send buffer)
+    for (flagdir = 1; flagdir <= 2; flagdir++) {
+        for (i = 0; i < plist->nfiles; i++) {
+            if (types[i] != flagdir)
+                continue;
+            if (xferinfo->pftps->GetFlagAbor() != 0) {   //check for ABOR
+                free(types); free(finfo); pdircache->CloseDir(plist);
+                if (dirpath != fullpath) free(dirpath);
+                fsutils.FreePath(fullpath);
+                return;
+            }
+            if (FTPSXFER_LISTBUFSIZE - packetlen < FTPSXFER_MAXDIRENTRY)
+                *nbytes += AddToSendBuffer(packet,FTPSXFER_LISTBUFSIZE,&packetlen,"",0,xferinfo->flagencdata,1);
+            packetlen += BuildListLine(plist->names[i],&finfo[i],packet+packetlen,FTPSXFER_MAXDIRENTRY,xferinfo,thisyear,(flagdir == 1) ? dirperm : fileperm);
+        }
+    }
 
         //if the recursive option (-R) was selected do a second pass
         //to go through the sub-directories.
     if (strchr(xferinfo->options,'R') != NULL) {
             //force any remaining data in the buffer to be sent (and add a \r\n)
-        *nbytes += AddToSendBuffer(packet,FTPSXFER_MAXPACKETSIZE,&packetlen,"\r\n",2,xferinfo->flagencdata,1);
-        free(packet);
-            //List all the directories
-        if ((handle = fsutils.DirGetFirstFile(fullpath,linebuf,FTPSXFER_MAXDIRENTRY)) <= 0) {
-            free(listline); fsutils.FreePath(fullpath); free(linebuf);
-            return;
-        }
-        do {
-            BuildListLine(fullpath,linebuf,listline,listlinelen,xferinfo,1,thisyear);
-            if (*listline != '\0') {
-                if ((tmpxferinfo = (ftpsXferInfo_t *)malloc(sizeof(ftpsXferInfo_t))) != NULL) {
-                    memcpy(tmpxferinfo,xferinfo,sizeof(ftpsXferInfo_t));
-                    if ((tmpxferinfo->path = (char *)malloc(strlen(xferinfo->path)+strlen(linebuf)+2)) != NULL) {
-                        strcpy(tmpxferinfo->path,xferinfo->path);
-                        if (*(tmpxferinfo->path) != '\0')
-                            fsutils.CheckSlashEnd(tmpxferinfo->path,strlen(xferinfo->path)+strlen(linebuf)+2);
-                        strcat(tmpxferinfo->path,linebuf);
-                        fsutils.CheckSlashUNIX(tmpxferinfo->path);
-                        SendListData(tmpxferinfo,nbytes);   //Recurse
-                        free(tmpxferinfo->path);
-                    }
-                    free(tmpxferinfo);
+        *nbytes += AddToSendBuffer(packet,FTPSXFER_LISTBUFSIZE,&packetlen,"\r\n",2,xferinfo->flagencdata,1);
+        for (i = 0; i < plist->nfiles; i++) {
+            if (types[i] != 1)
+                continue;
+            if ((tmpxferinfo = (ftpsXferInfo_t *)malloc(sizeof(ftpsXferInfo_t))) != NULL) {
+                memcpy(tmpxferinfo,xferinfo,sizeof(ftpsXferInfo_t));
+                if ((tmpxferinfo->path = (char *)malloc(strlen(xferinfo->path)+strlen(plist->names[i])+2)) != NULL) {
+                    strcpy(tmpxferinfo->path,xferinfo->path);
+                    if (*(tmpxferinfo->path) != '\0')
+                        fsutils.CheckSlashEnd(tmpxferinfo->path,strlen(xferinfo->path)+strlen(plist->names[i])+2);
+                    strcat(tmpxferinfo->path,plist->names[i]);
+                    fsutils.CheckSlashUNIX(tmpxferinfo->path);
+                    SendListData(tmpxferinfo,nbytes);   //Recurse
+                    free(tmpxferinfo->path);
                 }
+                free(tmpxferinfo);
             }
-        } while (fsutils.DirGetNextFile(handle,linebuf,FTPSXFER_MAXDIRENTRY) > 0);
-        fsutils.DirClose(handle);
+        }
     } else {
             //force any remaining data in the buffer to be sent
-        *nbytes += AddToSendBuffer(packet,FTPSXFER_MAXPACKETSIZE,&packetlen,"",0,xferinfo->flagencdata,1);
-        free(packet);
+        *nbytes += AddToSendBuffer(packet,FTPSXFER_LISTBUFSIZE,&packetlen,"",0,xferinfo->flagencdata,1);
     }
 
-    free(listline);
+    free(types);
+    free(finfo);
+    pdircache->CloseDir(plist);
+    if (dirpath != fullpath)
+        free(dirpath);
     fsutils.FreePath(fullpath);
-    free(linebuf);
 }
 
 long CFtpsXfer::RecvFileData(ftpsXferInfo_t *xferinfo, int fdw)
@@ -719,74 +790,65 @@ long CFtpsXfer::RecvFileData(ftpsXferInfo_t *xferinfo, int fdw)
     long nbytes = 0;
     int packetlen = 0, tmppacketlen = 0;
     CTimer timer;
-    #ifdef WIN32
-      char lastchar = ' ';
-    #endif
 
         //move the file pointer to the proper restart position
         //(used if command is APPE or REST was specified)
     if (xferinfo->restoffset > 0)
         lseek(fdw,xferinfo->restoffset,0);
 
-        //allocate mem for the buffer used to store data that is received
-    if ((packet = (char *)malloc(FTPSXFER_MAXPACKETSIZE)) == NULL) {
-        return(0);
-    }
-
         //initialize the transfer rate parameters
     xferinfo->psiteinfo->SetCurrentXferRate(xferinfo->pftps->GetUserID(),0);
     m_bytessincerateupdt = 0;
     m_timexferrateupdt = timer.Get();
-    m_bytesxfered = 0;
-    m_xfertimer = timer.Get();
+
+        //binary data on an unencrypted connection is moved
+        //straight from the socket into the file
+    if (xferinfo->type != 'A' && xferinfo->flagencdata == 0) {
+        if ((nbytes = RecvFileZCopy(xferinfo,fdw)) >= 0)
+            return(nbytes);
+        nbytes = 0;
+    }
+
+        //get the buffer used to store data that is received
+    if ((packet = GetBuffer(&m_packet,FTPSXFER_MAXPACKETSIZE)) == NULL)
+        return(0);
 
     do {
-        if (xferinfo->pftps->GetFlagAbor() != 0) {
-            free(packet);
+        if (xferinfo->pftps->GetFlagAbor() != 0)
             return(0);
-        }
-        if (m_sock.CheckStatus(m_datasd,10*FTPS_STDSOCKTIMEOUT,0) <= 0) {
-            free(packet);
+        if (m_sock.CheckStatus(m_datasd,10*FTPS_STDSOCKTIMEOUT,0) <= 0)
             return(0);  //if the data stops being sent
-        }
-        if ((packetlen = RecvData(xferinfo,packet,FTPSXFER_MAXPACKETSIZE)) < 0) {
-            free(packet);
+        if ((packetlen = RecvData(xferinfo,packet,FTPSXFER_MAXPACKETSIZE)) < 0)
             return(0);  //if there was an error receiving the data
-        }
         if (xferinfo->type == 'A') {  //Recv in ASCI mode
             #ifdef WIN32
                   //For WINDOWS OS an ASCII file will always contain \r\n (NOT \n)
-              if ((tmppacket = BtoA(lastchar,packet,packetlen,&tmppacketlen)) != NULL) {
-                  lastchar = tmppacket[tmppacketlen-1];
-                  write(fdw,tmppacket,tmppacketlen);
-                  free(tmppacket);
-              } else {
-                  free(packet);
-                  return(0);    //out of memory
-              }
-            #else                   //Recv in BINARY mode
+              tmppacket = m_asciixlate.ToCRLF(packet,packetlen,&tmppacketlen);
+            #else
                   //For UNIX OS an ASCII file will always contain \n (NOT \r\n)
-              if ((tmppacket = AtoU(packet,packetlen,&tmppacketlen)) != NULL) {
-                  write(fdw,tmppacket,tmppacketlen);
-                  free(tmppacket);
-              } else {
-                  free(packet);
-                  return(0);    //out of memory
-              }
+              tmppacket = m_asciixlate.ToLF(packet,packetlen,&tmppacketlen);
             #endif
-        } else {
+            if (tmppacket == NULL)
+                return(0);    //out of memory
+            write(fdw,tmppacket,tmppacketlen);
+        } else {                      //Recv in BINARY mode
             write(fdw,packet,packetlen);
         }
         nbytes += packetlen;
     } while(packetlen == FTPSXFER_MAXPACKETSIZE);
 
-    free(packet);
+    #ifndef WIN32
+        //write a '\r' that ended the file (it was held back by ToLF())
+      if (xferinfo->type == 'A' && (tmppacket = m_asciixlate.FlushLF(&tmppacketlen)) != NULL)
+          write(fdw,tmppacket,tmppacketlen);
+    #endif
+
     return(nbytes);
 }
 
 long CFtpsXfer::SendFileData(ftpsXferInfo_t *xferinfo, int fdr)
 {
-    char lastchar = ' ', *packet, *tmppacket;
+    char *packet, *tmppacket;
     long nsent, nbytes = 0;
     int packetlen = 0, tmppacketlen = 0;
     CTimer timer;
@@ -795,40 +857,39 @@ long CFtpsXfer::SendFileData(ftpsXferInfo_t *xferinfo, int fdr)
     if (xferinfo->restoffset > 0)
         lseek(fdr,xferinfo->restoffset,0);
 
-        //allocate mem for the buffer used to store data that is sent
-    if ((packet = (char *)malloc(FTPSXFER_MAXPACKETSIZE)) == NULL) {
-        return(0);
-    }
-
         //initialize the transfer rate parameters
     xferinfo->psiteinfo->SetCurrentXferRate(xferinfo->pftps->GetUserID(),0);
     m_bytessincerateupdt = 0;
     m_timexferrateupdt = timer.Get();
-    m_bytesxfered = 0;
-    m_xfertimer = timer.Get();
+
+        //binary data on an unencrypted connection is sent
+        //straight from the file cache
+    if (xferinfo->type != 'A' && xferinfo->flagencdata == 0) {
+        if ((nbytes = SendFileZCopy(xferinfo,fdr)) >= 0)
+            return(nbytes);
+        nbytes = 0;
+    }
+
+        //get the buffer used to store data that is sent
+    if ((packet = GetBuffer(&m_packet,FTPSXFER_MAXPACKETSIZE)) == NULL)
+        return(0);
 
     do {
-        if (xferinfo->pftps->GetFlagAbor() != 0) {
-            free(packet);
+        if (xferinfo->pftps->GetFlagAbor() != 0)
             return(0);
-        }
         packetlen = read(fdr,packet,FTPSXFER_MAXPACKETSIZE);
         if (xferinfo->type == 'A') {
-            if ((tmppacket = BtoA(lastchar,packet,packetlen,&tmppacketlen)) != NULL) {
-                lastchar = tmppacket[tmppacketlen-1];
+            if (packetlen > 0) {
+                if ((tmppacket = m_asciixlate.ToCRLF(packet,packetlen,&tmppacketlen)) == NULL)
+                    return(0);    //out of memory
                 if ((nsent = SendData(xferinfo,tmppacket,tmppacketlen)) < 0) {
-                    free(tmppacket); free(packet);
                     return(0);
                 } else {
                     nbytes += nsent;
                 }
-                free(tmppacket);
-            } else {
-                lastchar = ' ';
             }
         } else {
             if ((nsent = SendData(xferinfo,packet,packetlen)) < 0) {
-                free(packet);
                 return(0);
             } else {
                 nbytes += nsent;
@@ -836,7 +897,91 @@ long CFtpsXfer::SendFileData(ftpsXferInfo_t *xferinfo, int fdr)
         }
     } while(packetlen == FTPSXFER_MAXPACKETSIZE);
 
-    free(packet);
+    return(nbytes);
+}
+
+    //Receives a file w/o copying the data through a user space buffer
+    //(the data is spliced from the socket into the file).
+    //Returns the number of bytes received.  -1 is returned if zero-copy
+    //receives can not be used for "fdw" (nothing has been read yet).
+long CFtpsXfer::RecvFileZCopy(ftpsXferInfo_t *xferinfo, int fdw)
+{
+#ifdef LINUX
+    long nrecv, nquota, nbytes = 0, chunksize = FTPSXFER_MINZCOPYSIZE;
+
+        //splice() can not write to a file opened for appending
+    if ((fcntl(fdw,F_GETFL) & O_APPEND) != 0)
+        return(-1);
+
+        //the pipe is kept for the next transfers
+    if (m_pipefd[0] < 0) {
+        if (pipe(m_pipefd) < 0) {
+            m_pipefd[0] = m_pipefd[1] = -1;
+            return(-1);
+        }
+        #ifdef F_SETPIPE_SZ
+            //let a full chunk fit in the pipe (the default is 64KB)
+          fcntl(m_pipefd[1],F_SETPIPE_SZ,FTPSXFER_MAXZCOPYSIZE);
+        #endif
+    }
+
+    do {
+        if (xferinfo->pftps->GetFlagAbor() != 0) {
+            nbytes = 0;
+            break;
+        }
+        if (m_sock.CheckStatus(m_datasd,10*FTPS_STDSOCKTIMEOUT,0) <= 0) {
+            nbytes = 0;
+            break;  //if the data stops being sent
+        }
+        nquota = GetXferQuota(xferinfo,chunksize);
+        if ((nrecv = m_sock.RecvFile(m_datasd,fdw,m_pipefd,nquota)) < 0) {
+            EndXferQuota(nquota,0);
+            ClosePipe();    //data may be left in the pipe
+            nbytes = 0;
+            break;  //if there was an error receiving the data
+        }
+        EndXferQuota(nquota,nrecv);
+        UpdateXferRate(xferinfo,nrecv);
+        nbytes += nrecv;
+            //use larger chunks as long as the client keeps them full
+        if (nrecv == chunksize && chunksize < FTPSXFER_MAXZCOPYSIZE)
+            chunksize *= 2;
+    } while (nrecv > 0);
+
+    return(nbytes);
+#else
+    return(-1);
+#endif
+}
+
+    //Sends a file w/o copying the data through a user space buffer
+    //(the data is sent with sendfile() from "restoffset" onward).
+    //Returns the number of bytes sent.  -1 is returned if zero-copy
+    //sends can not be used for "fdr" (nothing has been sent yet).
+long CFtpsXfer::SendFileZCopy(ftpsXferInfo_t *xferinfo, int fdr)
+{
+    long nsent, nquota, offset, nbytes = 0, chunksize = FTPSXFER_MINZCOPYSIZE;
+
+    offset = (xferinfo->restoffset > 0) ? xferinfo->restoffset : 0;
+
+    do {
+        if (xferinfo->pftps->GetFlagAbor() != 0)
+            return(0);
+        nquota = GetXferQuota(xferinfo,chunksize);
+        if ((nsent = m_sock.SendFile(m_datasd,fdr,offset,nquota)) < 0) {
+            EndXferQuota(nquota,0);
+            return((nbytes == 0) ? -1 : 0);
+        }
+        EndXferQuota(nquota,nsent);
+        UpdateXferRate(xferinfo,nsent);
+        offset += nsent;
+        nbytes += nsent;
+            //use larger chunks as long as the file has more data
+        if (nsent == chunksize && chunksize < FTPSXFER_MAXZCOPYSIZE)
+            chunksize *= 2;
+    } while (nsent == nquota);
+
     return(nbytes);
 }
 
@@ -887,150 +1032,25 @@ int CFtpsXfer::AddToSendBuffer(char *sendbuf, int maxsendbuf, int *sendbufoffset
 }
 
     //Loads "listline" with a directory listing line that should be returned.
-    //"options" are the directory listing options that were specified.
-    //"flagdir" is used for selecting only directories (=1), files (=2), or
-    //both (=3).
-char *CFtpsXfer::BuildListLine(char *fullpath, char *filename, char *listline, int maxlinesize, ftpsXferInfo_t *xferinfo, int flagdir, char *thisyear)
+    //"finfo" contains the stats of the file named "filename".
+    //"perm" is the "perm" fact of the file (only used for MLSD).
+    //Returns the length of the line.
+int CFtpsXfer::BuildListLine(char *filename, fsutilsFileInfo_t *finfo, char *listline, int maxlinesize, ftpsXferInfo_t *xferinfo, char *thisyear, char *perm)
 {
-    CFSUtils fsutils;
-    fsutilsFileInfo_t finfo;
-    char *filepath;
-
-    *listline = '\0';   //initialize listline to an empty string
-
-        //do not display the "." and ".." entries
-    if (strcmp(filename,".") == 0 || strcmp(filename,"..") == 0)
-        return(listline);
-
-    if ((filepath = (char *)malloc(strlen(fullpath)+strlen(filename)+2)) == NULL)
-        return(listline);
-
-    if (strchr(fullpath,'*') != NULL)   //check if wildcard
-        fsutils.GetDirPath(filepath,strlen(fullpath)+1,fullpath); //get only the directory name
-    else
-        strcpy(filepath,fullpath);
-    fsutils.CheckSlashEnd(filepath,strlen(fullpath)+strlen(filename)+2);
-    strcat(filepath,filename);
-    fsutils.CheckSlash(filepath);
-
-    if (fsutils.GetFileStats(filepath,&finfo) == 0) {
-        free(filepath);
-        return(listline);
-    }
+    int len;
 
-    if (finfo.mode & S_IFDIR) {
-        if ((flagdir & 1) == 0) {
-            free(filepath);
-            return(listline);   //only file lines should be returned
-        }
-    } else {
-        if ((flagdir & 2) == 0) {
-            free(filepath);
-            return(listline);   //only directory lines should be returned
-        }
-    }
-
-    if (strchr(xferinfo->options,'N') != NULL) {  //do NLST (names only)
+    if (xferinfo->command == 'M') {    //do MLSD (facts and name)
+        xferinfo->psiteinfo->BuildMLSxLine(listline,maxlinesize-2,filename,finfo,perm);
+    } else if (strchr(xferinfo->options,'N') != NULL) {  //do NLST (names only)
         strncpy(listline,filename,maxlinesize-3);
+        listline[maxlinesize-3] = '\0'; //make sure the string is terminated
     } else {    //do long list
-        xferinfo->psiteinfo->BuildFullListLine(listline,maxlinesize-3,filepath,thisyear);
-    }
-    listline[maxlinesize-3] = '\0'; //make sure the string is terminated
-    strcat(listline,"\r\n");        //end the line
-
-    free(filepath);
-
-    return(listline);
-}
-
-    //Converts the contents of inbuf from a BINARY mode to an
-    //ASCII mode (all "\n" are converted to "\r\n").
-    //"lastchar" is the last character in the previous buffer
-    //-- this is needed to detect a "\r\n" across buffers
-    //A buffer containing the ASCII version is returned.
-    //The size of the returned buffer is loaded into "outbufsize"
-    //NOTE: The returned buffer must be free()
-char *CFtpsXfer::BtoA(char lastchar, char *inbuf, int inbufsize, int *outbufsize) {
-    char *outbuf = NULL;
-    int i, nlcount = 0, noutbuf = 0;
-
-    if (outbufsize != NULL)
-        *outbufsize = 0;    //initialize the out buffer size
-
-    if (inbuf == NULL || inbufsize == 0)
-        return(NULL);
-
-    if (*inbuf == '\n' && lastchar != '\r')
-        nlcount++;
-    for (i = 1; i < inbufsize; i++) {
-        if (*(inbuf+i) == '\n' && *(inbuf+i-1) != '\r')
-            nlcount++;
-    }
-
-    if ((outbuf = (char *)malloc(inbufsize+nlcount)) == NULL)
-        return(NULL);
-
-        //copy data to the new buffer
-    if (*inbuf == '\n' && lastchar != '\r') {
-        memcpy(outbuf,"\r\n",2);
-        noutbuf+= 2;
-    } else {
-        *outbuf = *inbuf;
-        noutbuf++;
-    }
-    for (i = 1; i < inbufsize; i++) {
-        if (*(inbuf+i) == '\n' && *(inbuf+i-1) != '\r') {
-            memcpy(outbuf+noutbuf,"\r\n",2);
-            noutbuf += 2;
-        } else {
-            *(outbuf + noutbuf) = *(inbuf + i);
-            noutbuf++;
-        }
-    }
-
-    if (outbufsize != NULL)
-        *outbufsize = noutbuf;
-    
-    return(outbuf);
-}
-
-    //Converts the contents of inbuf from a FTP ASCII mode (\r\n) to a
-    //Unix ASCII mode (\n) (all "\r\n" are converted to "\n").
-    //A buffer containing the Unix ASCII version is returned.
-    //The size of the returned buffer is loaded into "outbufsize"
-    //NOTE: The returned buffer must be free()
-char *CFtpsXfer::AtoU(char *inbuf, int inbufsize, int *outbufsize) {
-    char *outbuf = NULL;
-    int i, noutbuf = 0;
-
-    if (outbufsize != NULL)
-        *outbufsize = 0;    //initialize the out buffer size
-
-    if (inbuf == NULL || inbufsize == 0)
-        return(NULL);
-
-    if ((outbuf = (char *)malloc(inbufsize)) == NULL)
-        return(NULL);
-
-        //copy data to the new buffer
-    for (i = 0; i < inbufsize; i++) {
-        if (*(inbuf+i) == '\r') {
-            if (i < (inbufsize-1)) {
-                if (*(inbuf+i+1) != '\n') {
-                    *(outbuf + noutbuf) = *(inbuf+i);   //keep only '\r' w/o following '\n'
-                    noutbuf++;
-                }
-            }
-        } else {
-            *(outbuf + noutbuf) = *(inbuf+i);
-            noutbuf++;
-        }
+        xferinfo->psiteinfo->BuildFullListLine(listline,maxlinesize-2,filename,finfo,thisyear);
     }
+    len = strlen(listline);
+    strcpy(listline+len,"\r\n");   //end the line
 
-    if (outbufsize != NULL)
-        *outbufsize = noutbuf;
-
-    return(outbuf);
+    return(len+2);
 }
 
     //updates the current transfer rate
@@ -1050,207 +1070,94 @@ void CFtpsXfer::UpdateXferRate(ftpsXferInfo_t *xferinfo, long bytessent)
     }
 }
 
-int CFtpsXfer::SendData(ftpsXferInfo_t *xferinfo, char *buffer, int bufsize)
+    //Sets the speed limits for a transfer (flagupload = 0 for downloads).
+    //The transfer's bytes are also counted against the user's and the
+    //site's limits.  Call EndXferLimit() when the transfer is done.
+void CFtpsXfer::StartXferLimit(ftpsXferInfo_t *xferinfo, int flagupload)
 {
-    CTimer timer;
-    CThr thr;
-    int nbytessent = 0, nbytestosend, offset = 0, packetlen = 0;
-    int usermaxbytesperinterval, sitemaxbytesperinterval, useravail, siteavail;
-    unsigned long xferupdtmsec, timediff;
 
-        //Max number of bytes that can be sent within "FTPSXFER_XFERRATEUPDTRATE" sec.
-        //Max bytes for the current user.
-    usermaxbytesperinterval = (int)((double)m_maxdlspeed * FTPSXFER_XFERRATEUPDTRATE);
-        //Max bytes for the whole site (all users combined).
-    sitemaxbytesperinterval = (int)((double)xferinfo->psiteinfo->m_maxdlspeed * FTPSXFER_XFERRATEUPDTRATE);
+    m_puserbucket = xferinfo->psiteinfo->GetUserBucket(xferinfo->pftps->GetLogin(),flagupload);
+    m_xferbucket.SetParent(m_puserbucket);
+    m_xferbucket.SetRate((flagupload != 0) ? xferinfo->psiteinfo->m_maxxferulspeed : xferinfo->psiteinfo->m_maxxferdlspeed);
+}
 
-    xferupdtmsec = (unsigned)(FTPSXFER_XFERRATEUPDTRATE * 1000); //convert to msec
+void CFtpsXfer::EndXferLimit(ftpsXferInfo_t *xferinfo)
+{
 
-    if (usermaxbytesperinterval == 0 && sitemaxbytesperinterval == 0) {
-        if (xferinfo->flagencdata == 0)
-            nbytessent = m_sock.SendN(m_datasd,buffer,bufsize);
-        else
-            nbytessent = m_sslsock.SSLSendN(&m_sslinfo,buffer,bufsize);
-        UpdateXferRate(xferinfo,nbytessent);
-        return(nbytessent); //no limits
-    }
+    m_xferbucket.SetParent(NULL);
+    xferinfo->psiteinfo->ReleaseUserBucket(m_puserbucket);
+    m_puserbucket = NULL;
+}
 
-    usermaxbytesperinterval = (usermaxbytesperinterval == 0) ? 0x7FFFFFFF : usermaxbytesperinterval;
-    sitemaxbytesperinterval = (sitemaxbytesperinterval == 0) ? 0x7FFFFFFF : sitemaxbytesperinterval;
+    //Returns how many of "nbytes" bytes may be transfered now w/o going
+    //over the transfer's, the user's or the site's max speed.  If the
+    //bytes were taken ahead of their time, this waits until they may be
+    //sent.  Call EndXferQuota() after the transfer.
+long CFtpsXfer::GetXferQuota(ftpsXferInfo_t *xferinfo, long nbytes)
+{
+    CTimer timer;
+    unsigned long waitmsec;
 
-    while (offset < bufsize) {
+    if (m_xferbucket.IsLimited() == 0)
+        return(nbytes); //no limits
 
-        useravail = usermaxbytesperinterval - m_bytesxfered;
-        siteavail = sitemaxbytesperinterval - xferinfo->psiteinfo->m_bytessent;
-        useravail = (useravail <= 0) ? 0 : useravail;
-        siteavail = (siteavail <= 0) ? 0 : siteavail;
-
-        if (useravail <= siteavail) {
-                //user limitation
-            nbytestosend = ((bufsize - offset) <= useravail) ? (bufsize - offset) : useravail;
-            m_bytesxfered += nbytestosend;
-            useravail = usermaxbytesperinterval - m_bytesxfered;
-            if (useravail <= 0) {
-                if (xferinfo->flagencdata == 0)
-                    packetlen = m_sock.SendN(m_datasd,buffer+offset,nbytestosend);
-                else
-                    packetlen = m_sslsock.SSLSendN(&m_sslinfo,buffer+offset,nbytestosend);
-                if (packetlen < 0)
-                    return(packetlen);
-                timediff = timer.Diff(m_xfertimer,timer.Get());
-                if (xferupdtmsec > timediff)
-                    timer.Sleep(xferupdtmsec - timediff);
-                m_xfertimer = timer.Get();
-                m_bytesxfered = 0;
-            } else {
-                if (xferinfo->flagencdata == 0)
-                    packetlen = m_sock.SendN(m_datasd,buffer+offset,nbytestosend);
-                else
-                    packetlen = m_sslsock.SSLSendN(&m_sslinfo,buffer+offset,nbytestosend);
-                if (packetlen < 0)
-                    return(packetlen);
-            }
-            packetlen = (packetlen <= 0) ? 0 : packetlen;
-            nbytessent += packetlen;
-            offset += packetlen;
-            UpdateXferRate(xferinfo,packetlen);
-        } else {
-                //site limitation
-                //NOTE: maybe send out data in smaller pieces in case of slow connection
-            nbytestosend = ((bufsize - offset) <= siteavail) ? (bufsize - offset) : siteavail;
-            xferinfo->psiteinfo->m_bytessent += nbytestosend;
-            siteavail = sitemaxbytesperinterval - xferinfo->psiteinfo->m_bytessent;
-            if (siteavail <= 0) {
-                thr.P(&(xferinfo->psiteinfo->m_mutexsend));
-                if (xferinfo->flagencdata == 0)
-                    packetlen = m_sock.SendN(m_datasd,buffer+offset,nbytestosend);
-                else
-                    packetlen = m_sslsock.SSLSendN(&m_sslinfo,buffer+offset,nbytestosend);
-                if (packetlen < 0)
-                    return(packetlen);
-                timediff = timer.Diff(xferinfo->psiteinfo->m_sendtimer,timer.Get());
-                if (xferupdtmsec > timediff)
-                    timer.Sleep(xferupdtmsec - timediff);
-                xferinfo->psiteinfo->m_sendtimer = timer.Get();
-                xferinfo->psiteinfo->m_bytessent = 0;
-                thr.V(&(xferinfo->psiteinfo->m_mutexsend));
-            } else {
-                if (xferinfo->flagencdata == 0)
-                    packetlen = m_sock.SendN(m_datasd,buffer+offset,nbytestosend);
-                else
-                    packetlen = m_sslsock.SSLSendN(&m_sslinfo,buffer+offset,nbytestosend);
-                if (packetlen < 0)
-                    return(packetlen);
-            }
-            packetlen = (packetlen <= 0) ? 0 : packetlen;
-            nbytessent += packetlen;
-            offset += packetlen;
-            UpdateXferRate(xferinfo,packetlen);
-        }
-
-    }
+    nbytes = m_xferbucket.Take(nbytes,&waitmsec);
+    if (waitmsec > 0)
+        timer.Sleep(waitmsec);
 
-    return(nbytessent);
+    return(nbytes);
 }
 
-int CFtpsXfer::RecvData(ftpsXferInfo_t *xferinfo, char *buffer, int bufsize)
+    //Gives back the unused part of a quota from GetXferQuota() ("nquota"
+    //bytes were allowed, "nxfered" were transfered).
+void CFtpsXfer::EndXferQuota(long nquota, long nxfered)
 {
-    CTimer timer;
-    CThr thr;
-    int nbytesrecv = 0, nbytestorecv = 0, offset = 0, packetlen = 0;
-    int usermaxbytesperinterval, sitemaxbytesperinterval, useravail, siteavail;
-    unsigned long xferupdtmsec, timediff;
 
-        //Max number of bytes that can be sent within "FTPSXFER_XFERRATEUPDTRATE" sec.
-        //Max bytes for the current user.
-    usermaxbytesperinterval = (int)((double)m_maxulspeed * FTPSXFER_XFERRATEUPDTRATE);
-        //Max bytes for the whole site (all users combined).
-    sitemaxbytesperinterval = (int)((double)xferinfo->psiteinfo->m_maxulspeed * FTPSXFER_XFERRATEUPDTRATE);
+    if (nquota > nxfered)
+        m_xferbucket.Return(nquota - ((nxfered > 0) ? nxfered : 0));
+}
 
-    xferupdtmsec = (unsigned)(FTPSXFER_XFERRATEUPDTRATE * 1000); //convert to msec
+int CFtpsXfer::SendData(ftpsXferInfo_t *xferinfo, char *buffer, int bufsize)
+{
+    int nbytessent = 0, offset = 0, packetlen, nquota;
 
-    if (usermaxbytesperinterval == 0 && sitemaxbytesperinterval == 0) {
+    while (offset < bufsize) {
+        nquota = (int)GetXferQuota(xferinfo,bufsize - offset);
         if (xferinfo->flagencdata == 0)
-            nbytesrecv = m_sock.RecvN(m_datasd,buffer,bufsize);
+            packetlen = m_sock.SendN(m_datasd,buffer+offset,nquota);
         else
-            nbytesrecv = m_sslsock.SSLRecvN(&m_sslinfo,buffer,bufsize);
-        UpdateXferRate(xferinfo,nbytesrecv);
-        return(nbytesrecv);  //no limits
+            packetlen = m_sslsock.SSLSendN(&m_sslinfo,buffer+offset,nquota);
+        EndXferQuota(nquota,packetlen);
+        if (packetlen < 0)
+            return(packetlen);
+        nbytessent += packetlen;
+        offset += packetlen;
+        UpdateXferRate(xferinfo,packetlen);
+        if (packetlen < nquota)
+            break;  //the connection was closed
     }
 
-    usermaxbytesperinterval = (usermaxbytesperinterval == 0) ? 0x7FFFFFFF : usermaxbytesperinterval;
-    sitemaxbytesperinterval = (sitemaxbytesperinterval == 0) ? 0x7FFFFFFF : sitemaxbytesperinterval;
-
-    while (offset < bufsize && packetlen == nbytestorecv) {
-
-        useravail = usermaxbytesperinterval - m_bytesxfered;
-        siteavail = sitemaxbytesperinterval - xferinfo->psiteinfo->m_bytesrecv;
-        useravail = (useravail <= 0) ? 0 : useravail;
-        siteavail = (siteavail <= 0) ? 0 : siteavail;
-
-        if (useravail <= siteavail) {
-                //user limitation
-            nbytestorecv = ((bufsize - offset) <= useravail) ? (bufsize - offset) : useravail;
-            m_bytesxfered += nbytestorecv;
-            useravail = usermaxbytesperinterval - m_bytesxfered;
-            if (useravail <= 0) {
-                if (xferinfo->flagencdata == 0)
-                    packetlen = m_sock.RecvN(m_datasd,buffer+offset,nbytestorecv);
-                else
-                    packetlen = m_sslsock.SSLRecvN(&m_sslinfo,buffer+offset,nbytestorecv);
-                if (packetlen < 0)
-                    return(packetlen);
-                timediff = timer.Diff(m_xfertimer,timer.Get());
-                if (xferupdtmsec > timediff)
-                    timer.Sleep(xferupdtmsec - timediff);
-                m_xfertimer = timer.Get();
-                m_bytesxfered = 0;
-            } else {
-                if (xferinfo->flagencdata == 0)
-                    packetlen = m_sock.RecvN(m_datasd,buffer+offset,nbytestorecv);
-                else
-                    packetlen = m_sslsock.SSLRecvN(&m_sslinfo,buffer+offset,nbytestorecv);
-                if (packetlen < 0)
-                    return(packetlen);
-            }
-            packetlen = (packetlen <= 0) ? 0 : packetlen;
-            nbytesrecv += packetlen;
-            offset += packetlen;
-            UpdateXferRate(xferinfo,packetlen);
-        } else {
-                //site limitation
-                //NOTE: maybe receive in smaller pieces in case of slow connection
-            nbytestorecv = ((bufsize - offset) <= siteavail) ? (bufsize - offset) : siteavail;
-            xferinfo->psiteinfo->m_bytesrecv += nbytestorecv;
-            siteavail = sitemaxbytesperinterval - xferinfo->psiteinfo->m_bytesrecv;
-            if (siteavail <= 0) {
-                thr.P(&(xferinfo->psiteinfo->m_mutexrecv));
-                if (xferinfo->flagencdata == 0)
-                    packetlen = m_sock.RecvN(m_datasd,buffer+offset,nbytestorecv);
-                else
-                    packetlen = m_sslsock.SSLRecvN(&m_sslinfo,buffer+offset,nbytestorecv);
-                if (packetlen < 0)
-                    return(packetlen);
-                timediff = timer.Diff(xferinfo->psiteinfo->m_recvtimer,timer.Get());
-                if (xferupdtmsec > timediff)
-                    timer.Sleep(xferupdtmsec - timediff);
-                xferinfo->psiteinfo->m_recvtimer = timer.Get();
-                xferinfo->psiteinfo->m_bytesrecv = 0;
-                thr.V(&(xferinfo->psiteinfo->m_mutexrecv));
-            } else {
-                if (xferinfo->flagencdata == 0)
-                    packetlen = m_sock.RecvN(m_datasd,buffer+offset,nbytestorecv);
-                else
-                    packetlen = m_sslsock.SSLRecvN(&m_sslinfo,buffer+offset,nbytestorecv);
-                if (packetlen < 0)
-                    return(packetlen);
-            }
-            packetlen = (packetlen <= 0) ? 0 : packetlen;
-            nbytesrecv += packetlen;
-            offset += packetlen;
-            UpdateXferRate(xferinfo,packetlen);
-        }
+    return(nbytessent);
+}
 
+int CFtpsXfer::RecvData(ftpsXferInfo_t *xferinfo, char *buffer, int bufsize)
+{
+    int nbytesrecv = 0, offset = 0, packetlen, nquota;
+
+    while (offset < bufsize) {
+        nquota = (int)GetXferQuota(xferinfo,bufsize - offset);
+        if (xferinfo->flagencdata == 0)
+            packetlen = m_sock.RecvN(m_datasd,buffer+offset,nquota);
+        else
+            packetlen = m_sslsock.SSLRecvN(&m_sslinfo,buffer+offset,nquota);
+        EndXferQuota(nquota,packetlen);
+        if (packetlen < 0)
+            return(packetlen);
+        nbytesrecv += packetlen;
+        offset += packetlen;
+        UpdateXferRate(xferinfo,packetlen);
+        if (packetlen < nquota)
+            break;  //the end of the data was reached
     }
 
     return(nbytesrecv);
@@ -1300,6 +1207,29 @@ int CFtpsXfer::CheckFXP(ftpsXferInfo_t *xferinfo, int flagupload)
     return(retval);
 }
 
+    //Returns the buffer in "*pbuf" (allocated w/ "size" bytes the first
+    //time).  The buffer is kept for the next transfers and freed in the
+    //destructor.  Returns NULL if out of memory.
+char *CFtpsXfer::GetBuffer(char **pbuf, int size)
+{
+
+    if (*pbuf == NULL)
+        *pbuf = (char *)malloc(size);
+
+    return(*pbuf);
+}
+
+    //Closes the pipe used for the zero-copy receives
+void CFtpsXfer::ClosePipe()
+{
+
+    #ifdef LINUX
+      if (m_pipefd[0] >= 0) close(m_pipefd[0]);
+      if (m_pipefd[1] >= 0) close(m_pipefd[1]);
+    #endif
+    m_pipefd[0] = m_pipefd[1] = -1;
+}
+
     //negotiates the SSL connection
     //returns !0 on success and 0 on failure
 int CFtpsXfer::NegSSLConnection(ftpsXferInfo_t *xferinfo)
@@ -1310,6 +1240,13 @@ int CFtpsXfer::NegSSLConnection(ftpsXferInfo_t *xferinfo)
     if (xferinfo->flagpasv != 0) {
             //negotiate a server SSL connection (use the SSL context from the control connection)
         sslinfo = m_sslsock.SSLServerNeg(m_datasd,xferinfo->pftps->GetSSLInfo(),&sslerrcode);
+            //the client must resume the control connection's session
+        if (sslinfo != NULL && xferinfo->psiteinfo->m_flagsslreuse != 0 && m_sslsock.IsSessionReused(sslinfo) == 0) {
+            xferinfo->psiteinfo->WriteToProgLog("XFER","SSL data connection of %s did not resume the control connection's session.",xferinfo->pftps->GetLogin());
+            m_sslsock.SSLClose(sslinfo);
+            m_sslsock.FreeSSLInfo(sslinfo);
+            sslinfo = NULL;
+        }
     } else {
             //negotiate a client SSL connection
         m_sock.SetTimeout(m_datasd,FTPS_STDSOCKTIMEOUT*1000);
@@ -24,9 +24,15 @@
 
 #include "Ftps.h"
 #include "SSLSock.h"
+#include "TokenBucket.h"
+#include "FSUtils.h"
+#include "AsciiXlate.h"
 
 #define FTPSXFER_MAXDIRENTRY   256  //max length of a line in a dir listing
 #define FTPSXFER_MAXPACKETSIZE 4096 //max size of a sending packet (4KB)
+#define FTPSXFER_LISTBUFSIZE   65536    //size of the buffer a dir listing is sent from (64KB)
+#define FTPSXFER_MINZCOPYSIZE  65536    //initial size of a zero-copy transfer chunk (64KB)
+#define FTPSXFER_MAXZCOPYSIZE  1048576  //max size of a zero-copy transfer chunk (1MB)
 
 #define FTPSXFER_XFERRATEUPDTRATE .5   //transfer rate update rate (in seconds)
 
@@ -43,9 +49,13 @@ class CSiteInfo;    //dummy declaration (needed to avoid compiler errors)
 #else
   void *ftpsXferThread(void *vp);   //UNIX must return "void *" to run as a new thread
 #endif
+    //functions used to run the transfer in one of the site's transfer threads
+    //(see CSiteInfo::AddXfer()).  The thread keeps its CFtpsXfer in "*vppxfer".
+void ftpsXferJob(void *vp, void **vppxfer);
+void ftpsXferJobExit(void *vpxfer);
 
 typedef struct {
-    char command;       //L = dir list, R = receive data, S = send data
+    char command;       //L = dir list, M = MLSD dir list, R = receive data, S = send data
     int mode;           //0 = STOR, 1 = STOU, 2 = APPE (only applies to FTP STOR command)
     char options[16];   //command options (Ex. ls -la -> options = "la")
     char *path;         //file or dir path for the transfer command (Must free())
@@ -69,6 +79,8 @@ public:
     CFtpsXfer();
     virtual ~CFtpsXfer();
 
+    void Reset();
+
     int SendListCtrl(ftpsXferInfo_t *xferinfo);
     int SendList(ftpsXferInfo_t *xferinfo);
     int RecvFile(ftpsXferInfo_t *xferinfo);
@@ -78,16 +90,22 @@ private:
     void SendListData(ftpsXferInfo_t *xferinfo, long *nbytes);
     long RecvFileData(ftpsXferInfo_t *xferinfo, int fdw);
     long SendFileData(ftpsXferInfo_t *xferinfo, int fdr);
+    long RecvFileZCopy(ftpsXferInfo_t *xferinfo, int fdw);
+    long SendFileZCopy(ftpsXferInfo_t *xferinfo, int fdr);
     int AddToSendBuffer(char *sendbuf, int maxsendbuf, int *sendbufoffset, char *data, int datasize, int flagencdata, int flagforcesend = 0);
-    char *BuildListLine(char *fullpath, char *filename, char *listline, int maxlinesize, ftpsXferInfo_t *xferinfo, int flagdir, char *thisyear);
-    char *BtoA(char lastchar, char *inbuf, int inbufsize, int *outbufsize);
-    char *AtoU(char *inbuf, int inbufsize, int *outbufsize);
+    int BuildListLine(char *filename, fsutilsFileInfo_t *finfo, char *listline, int maxlinesize, ftpsXferInfo_t *xferinfo, char *thisyear, char *perm);
     void UpdateXferRate(ftpsXferInfo_t *xferinfo, long bytessent);
+    void StartXferLimit(ftpsXferInfo_t *xferinfo, int flagupload);
+    void EndXferLimit(ftpsXferInfo_t *xferinfo);
+    long GetXferQuota(ftpsXferInfo_t *xferinfo, long nbytes);
+    void EndXferQuota(long nquota, long nxfered);
     int SendData(ftpsXferInfo_t *xferinfo, char *buffer, int bufsize);
     int RecvData(ftpsXferInfo_t *xferinfo, char *buffer, int bufsize);
     int GetUniqueExtNum(char *filepath);
     int CheckFXP(ftpsXferInfo_t *xferinfo, int flagupload);
     int NegSSLConnection(ftpsXferInfo_t *xferinfo);
+    char *GetBuffer(char **pbuf, int size);
+    void ClosePipe();
 
 private:
     CSock m_sock;       //create the sockets class
@@ -96,13 +114,17 @@ private:
     SOCKET m_datasd;    //socket desc for the data connection
     sslsock_t m_sslinfo;    //SSL connection information
 
-    long m_maxulspeed;  //max upload speed (bytes/sec)
-    long m_maxdlspeed;  //max download speed (bytes/sec)
-    long m_bytesxfered; //num bytes xfered in the current sending cycle
-    unsigned long m_xfertimer;   //used for transfer rate timing
+    CTokenBucket m_xferbucket;      //limits the transfer speed (its parents limit the user and the site)
+    CTokenBucket *m_puserbucket;    //user's bucket from CSiteInfo::GetUserBucket()
 
     unsigned long m_timexferrateupdt;   //last time the transfer rate was updated
     double m_bytessincerateupdt;        //num bytes xfered since the last xfer rate update
+
+        //Buffers kept for the next transfer (a transfer thread reuses its CFtpsXfer)
+    char *m_packet;     //file data buffer (FTPSXFER_MAXPACKETSIZE)
+    char *m_listbuf;    //dir listing buffer (FTPSXFER_LISTBUFSIZE)
+    CAsciiXlate m_asciixlate;   //ASCII mode line ending translation
+    int m_pipefd[2];    //pipe for the zero-copy receives (-1 = not open)
 };
 
 #endif //FTPSXFER_H
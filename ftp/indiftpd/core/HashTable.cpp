@@ -0,0 +1,326 @@
+// Copyright (C) 2026 The indiftpd contributors
+//
+// This program is free software; you can redistribute it and/or
+// modify it under the terms of the GNU General Public License
+// as published by the Free Software Foundation; either version 2
+// of the License, or (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program; if not, write to the Free Software
+// Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.
+//
+//
+// HashTable.cpp: implementation of the CHashTable class.
+//
+// The table is read far more often than it is changed (Ex. the user
+// list is checked for every FTP command and only changes when the
+// users are reloaded).  A change copies the current table into a new
+// one, publishes the new table with a single pointer store and frees
+// the old table once no reader can still be using it.
+//
+//////////////////////////////////////////////////////////////////////
+#include <stdlib.h>
+#include <string.h>
+#include <ctype.h>
+
+#include "HashTable.h"
+#include "Timer.h"
+
+    //atomic operations used for the reader counts
+#ifdef WIN32
+  #define HASHTABLE_INC(ptr) InterlockedIncrement((volatile LONG *)(ptr))
+  #define HASHTABLE_DEC(ptr) InterlockedDecrement((volatile LONG *)(ptr))
+  #define HASHTABLE_BARRIER() MemoryBarrier()
+#else
+  #define HASHTABLE_INC(ptr) __sync_fetch_and_add((ptr),1)
+  #define HASHTABLE_DEC(ptr) __sync_fetch_and_sub((ptr),1)
+  #define HASHTABLE_BARRIER() __sync_synchronize()
+#endif
+
+    //pointer to the record stored in an entry
+#define HASHTABLE_RECORD(entry) ((char *)(entry) + sizeof(hashtableEntry_t))
+
+//////////////////////////////////////////////////////////////////////
+// Construction/Destruction
+//////////////////////////////////////////////////////////////////////
+
+//////////////////////////////////////////////////////////////////////
+// Constructor for the CHashTable class.
+//
+// [in] recordsize : Size of a record.
+// [in] nameoffset : Offset of the name (NULL terminated string) used
+//                   to look up a record.
+//
+CHashTable::CHashTable(int recordsize, int nameoffset /*=0*/)
+{
+
+    m_recordsize = recordsize;
+    m_nameoffset = nameoffset;
+        //keep the entries aligned for the records
+    m_entrysize = (sizeof(hashtableEntry_t) + recordsize + 7) & ~7;
+
+    m_table = NULL;
+    m_epoch = 0;
+    m_nreaders[0] = m_nreaders[1] = 0;
+
+    m_thr.InitializeCritSec(&m_mutexwrite);
+}
+
+CHashTable::~CHashTable()
+{
+
+    if (m_table != NULL)
+        free(m_table);
+
+    m_thr.DestroyCritSec(&m_mutexwrite);
+}
+
+//////////////////////////////////////////////////////////////////////
+// Public Methods
+//////////////////////////////////////////////////////////////////////
+
+//////////////////////////////////////////////////////////////////////
+// Adds records to the table.  A record is not added if a record with
+// the same name (case insensitive) is already in the table.
+//
+// [in] records  : Array of records to add.
+// [in] nrecords : Number of records in "records".
+//
+// Return : The number of records added.
+//
+// NOTE: Adding the records in one call is much faster than adding
+//       them one at a time (the table is copied on every call).
+//
+int CHashTable::Add(const void *records, int nrecords)
+{
+    hashtableTable_t *pold, *pnew;
+    hashtableEntry_t *pentry;
+    const char *precord;
+    unsigned i, nbuckets, nentries, hash;
+    int nadded = 0;
+
+    if (records == NULL || nrecords <= 0)
+        return(0);
+
+    m_thr.P(&m_mutexwrite);
+
+    pold = m_table;
+    nentries = ((pold != NULL) ? pold->nentries : 0) + nrecords;
+        //use at least 2 buckets per entry (keeps the lists short)
+    for (nbuckets = 16; nbuckets < 2 * nentries; nbuckets *= 2);
+
+        //allocate the new table, its buckets, and its entries at once
+    if ((pnew = (hashtableTable_t *)malloc(sizeof(hashtableTable_t) + nbuckets * sizeof(hashtableEntry_t *) + nentries * m_entrysize)) == NULL) {
+        m_thr.V(&m_mutexwrite);
+        return(0);
+    }
+    pnew->nbuckets = nbuckets;
+    pnew->nentries = 0;
+    pnew->buckets = (hashtableEntry_t **)(pnew + 1);
+    pnew->entries = (char *)(pnew->buckets + nbuckets);
+    memset(pnew->buckets,0,nbuckets * sizeof(hashtableEntry_t *));
+
+        //copy the entries of the current table
+    if (pold != NULL) {
+        memcpy(pnew->entries,pold->entries,pold->nentries * m_entrysize);
+        for (i = 0; i < pold->nentries; i++) {
+            pentry = (hashtableEntry_t *)(pnew->entries + i * m_entrysize);
+            pentry->next = pnew->buckets[pentry->hash & (nbuckets-1)];
+            pnew->buckets[pentry->hash & (nbuckets-1)] = pentry;
+        }
+        pnew->nentries = pold->nentries;
+    }
+
+        //add the new records
+    for (i = 0; i < (unsigned)nrecords; i++) {
+        precord = (const char *)records + i * m_recordsize;
+        hash = Hash(precord + m_nameoffset);
+        if (Find(pnew,precord + m_nameoffset,hash) != NULL)
+            continue;   //already in the table
+        pentry = (hashtableEntry_t *)(pnew->entries + pnew->nentries * m_entrysize);
+        memcpy(HASHTABLE_RECORD(pentry),precord,m_recordsize);
+        pentry->hash = hash;
+        pentry->next = pnew->buckets[hash & (nbuckets-1)];
+        pnew->buckets[hash & (nbuckets-1)] = pentry;
+        pnew->nentries++;
+        nadded++;
+    }
+
+    if (nadded > 0)
+        Publish(pnew);
+    else
+        free(pnew);
+
+    m_thr.V(&m_mutexwrite);
+
+    return(nadded);
+}
+
+//////////////////////////////////////////////////////////////////////
+// Removes all the records from the table.
+//
+// Return : VOID
+//
+void CHashTable::Clear()
+{
+
+    m_thr.P(&m_mutexwrite);
+    Publish(NULL);
+    m_thr.V(&m_mutexwrite);
+}
+
+//////////////////////////////////////////////////////////////////////
+// Looks up a record by name (case insensitive).
+//
+// [in]  name   : Name of the record.
+// [out] record : Stores a copy of the record (may be NULL).
+//
+// Return : 1 if the record was found and 0 otherwise.
+//
+int CHashTable::Lookup(const char *name, void *record /*=NULL*/)
+{
+    hashtableTable_t *ptable;
+    hashtableEntry_t *pentry;
+    unsigned long epoch;
+    unsigned hash;
+    int retval = 0;
+
+    if (name == NULL)
+        return(0);
+
+    hash = Hash(name);
+
+    epoch = ReadLock();
+    if ((ptable = m_table) != NULL) {
+        if ((pentry = Find(ptable,name,hash)) != NULL) {
+            if (record != NULL)
+                memcpy(record,HASHTABLE_RECORD(pentry),m_recordsize);
+            retval = 1;
+        }
+    }
+    ReadUnlock(epoch);
+
+    return(retval);
+}
+
+//////////////////////////////////////////////////////////////////////
+// Get the number of records in the table.
+//
+int CHashTable::GetNumRecords()
+{
+    hashtableTable_t *ptable;
+    unsigned long epoch;
+    int nrecords = 0;
+
+    epoch = ReadLock();
+    if ((ptable = m_table) != NULL)
+        nrecords = ptable->nentries;
+    ReadUnlock(epoch);
+
+    return(nrecords);
+}
+
+//////////////////////////////////////////////////////////////////////
+// Private Methods
+//////////////////////////////////////////////////////////////////////
+
+//////////////////////////////////////////////////////////////////////
+// Case insensitive FNV-1a hash of "name".
+//
+unsigned CHashTable::Hash(const char *name)
+{
+    unsigned hash = 2166136261U;
+
+    for (; *name != '\0'; name++) {
+        hash ^= (unsigned char)tolower((unsigned char)*name);
+        hash *= 16777619U;
+    }
+
+    return(hash);
+}
+
+//////////////////////////////////////////////////////////////////////
+// Finds the entry named "name" (with the hash value "hash") in the
+// table "ptable".  Returns NULL if the entry is not found.
+//
+hashtableEntry_t *CHashTable::Find(hashtableTable_t *ptable, const char *name, unsigned hash)
+{
+    hashtableEntry_t *pentry;
+
+    for (pentry = ptable->buckets[hash & (ptable->nbuckets-1)]; pentry != NULL; pentry = pentry->next) {
+        if (pentry->hash != hash)
+            continue;
+        #ifdef WIN32
+          if (strcmpi(HASHTABLE_RECORD(pentry) + m_nameoffset,name) == 0)
+        #else
+          if (strcasecmp(HASHTABLE_RECORD(pentry) + m_nameoffset,name) == 0)
+        #endif
+            return(pentry);
+    }
+
+    return(NULL);
+}
+
+//////////////////////////////////////////////////////////////////////
+// Replaces the current table with "ptable" and frees the old table
+// once the readers that may be using it are done.
+//
+// NOTE: Must be called in m_mutexwrite.
+//
+void CHashTable::Publish(hashtableTable_t *ptable)
+{
+    hashtableTable_t *pold = m_table;
+    unsigned long epoch;
+    CTimer timer;
+
+    m_table = ptable;
+    HASHTABLE_BARRIER();
+
+        //new readers use the next epoch (and see the new table)
+    epoch = m_epoch;
+    m_epoch = epoch + 1;
+    HASHTABLE_BARRIER();
+
+        //wait for the readers of the old epoch
+    while (m_nreaders[epoch & 1] != 0) timer.Sleep(1);
+
+    if (pold != NULL)
+        free(pold);
+}
+
+//////////////////////////////////////////////////////////////////////
+// Registers a reader for the current epoch.  The table read after
+// this call is not freed until ReadUnlock() is called.
+//
+// Return : The epoch to pass to ReadUnlock().
+//
+unsigned long CHashTable::ReadLock()
+{
+    unsigned long epoch;
+
+    while (1) {
+        epoch = m_epoch;
+        HASHTABLE_INC(&m_nreaders[epoch & 1]);
+        HASHTABLE_BARRIER();
+        if (m_epoch == epoch)
+            break;
+            //a change moved to the next epoch (try again)
+        HASHTABLE_DEC(&m_nreaders[epoch & 1]);
+    }
+
+    return(epoch);
+}
+
+//////////////////////////////////////////////////////////////////////
+// Unregisters a reader (see ReadLock()).
+//
+void CHashTable::ReadUnlock(unsigned long epoch)
+{
+
+    HASHTABLE_DEC(&m_nreaders[epoch & 1]);
+}
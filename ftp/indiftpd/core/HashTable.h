@@ -0,0 +1,83 @@
+// Copyright (C) 2026 The indiftpd contributors
+//
+// This program is free software; you can redistribute it and/or
+// modify it under the terms of the GNU General Public License
+// as published by the Free Software Foundation; either version 2
+// of the License, or (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program; if not, write to the Free Software
+// Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.
+//
+//
+// HashTable.h: interface for the CHashTable class.
+//
+//////////////////////////////////////////////////////////////////////
+#ifndef HASHTABLE_H
+#define HASHTABLE_H
+
+#include "Thr.h"
+
+    //entry in the hash table (the record is stored right after it)
+typedef struct _hashtableEntry_t {
+    struct _hashtableEntry_t *next; //next entry in the same bucket
+    unsigned hash;                  //hash value of the entry's name
+} hashtableEntry_t;
+
+    //version of the table (never changed once it is published)
+typedef struct {
+    unsigned nbuckets;          //number of buckets (power of 2)
+    unsigned nentries;          //number of entries in the table
+    hashtableEntry_t **buckets; //lists of entries with the same (hash & (nbuckets-1))
+    char *entries;              //entries in the order they were added
+} hashtableTable_t;
+
+
+///////////////////////////////////////////////////////////////////////////////
+// Hash table of fixed size records looked up by a name stored in the record
+// (case insensitive).  Lookups do not lock.  Changes build a new table that
+// replaces the current one.
+///////////////////////////////////////////////////////////////////////////////
+
+class CHashTable
+{
+public:
+    CHashTable(int recordsize, int nameoffset = 0);
+    virtual ~CHashTable();
+
+    int Add(const void *records, int nrecords);
+    void Clear();
+
+    int Lookup(const char *name, void *record = NULL);
+    int GetNumRecords();
+
+private:
+    unsigned Hash(const char *name);
+    hashtableEntry_t *Find(hashtableTable_t *ptable, const char *name, unsigned hash);
+    void Publish(hashtableTable_t *ptable);
+    unsigned long ReadLock();
+    void ReadUnlock(unsigned long epoch);
+
+private:
+    CThr m_thr;             //thread functions
+
+    int m_recordsize;       //size of a record
+    int m_nameoffset;       //offset of the name (string) in a record
+    int m_entrysize;        //size of an entry (with its record)
+
+    hashtableTable_t * volatile m_table;    //current table (NULL = empty)
+    thrSync_t m_mutexwrite; //serializes the changes to the table
+
+        //Readers add themselves to the count for the current epoch.  A
+        //change publishes the new table, moves to the next epoch, and
+        //frees the old table once the readers of the old epoch are done.
+    volatile unsigned long m_epoch;
+    volatile long m_nreaders[2];
+};
+
+#endif //HASHTABLE_H
@@ -0,0 +1,644 @@
+// Copyright (C) 2026 The indiftpd contributors
+//
+// This program is free software; you can redistribute it and/or
+// modify it under the terms of the GNU General Public License
+// as published by the Free Software Foundation; either version 2
+// of the License, or (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program; if not, write to the Free Software
+// Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.
+//
+//
+// LogQueue.cpp: implementation of the CLogQueue class.
+//
+// Log lines are added to a fixed ring of records without taking a
+// lock (each record has a sequence number that tells if it is free
+// or ready to be written).  Only the writer thread opens, rotates,
+// and writes the log files, so the threads that log never wait on
+// the disk.
+//
+//////////////////////////////////////////////////////////////////////
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <fcntl.h>
+
+#ifdef WIN32
+  #include <io.h>
+#else
+  #include <unistd.h>
+  #include <sys/time.h>
+  #include <sys/uio.h>
+  #include <errno.h>
+#endif
+
+#include "LogQueue.h"
+#include "Timer.h"
+
+    //atomic operations used on the ring
+#ifdef WIN32
+  #define LOGQUEUE_CAS(ptr,oldval,newval) (InterlockedCompareExchange((volatile LONG *)(ptr),(LONG)(newval),(LONG)(oldval)) == (LONG)(oldval))
+  #define LOGQUEUE_INC(ptr) InterlockedIncrement((volatile LONG *)(ptr))
+  #define LOGQUEUE_DEC(ptr) InterlockedDecrement((volatile LONG *)(ptr))
+  #define LOGQUEUE_BARRIER() MemoryBarrier()
+#else
+  #define LOGQUEUE_CAS(ptr,oldval,newval) __sync_bool_compare_and_swap((ptr),(oldval),(newval))
+  #define LOGQUEUE_INC(ptr) __sync_fetch_and_add((ptr),1)
+  #define LOGQUEUE_DEC(ptr) __sync_fetch_and_sub((ptr),1)
+  #define LOGQUEUE_BARRIER() __sync_synchronize()
+#endif
+
+//////////////////////////////////////////////////////////////////////
+// Construction/Destruction
+//////////////////////////////////////////////////////////////////////
+
+CLogQueue::CLogQueue()
+{
+    int i;
+
+    m_records = NULL;
+    m_mask = 0;
+    m_addpos = m_writepos = 0;
+    m_fullpolicy = LOGQUEUE_FULLBLOCK;
+    m_ndropped = 0;
+
+    for (i = 0; i < LOGQUEUE_MAXFILES; i++) {
+        *m_files[i].pattern = '\0';
+        *m_files[i].name = '\0';
+        m_files[i].nametime = -1;
+        m_files[i].fd = -1;
+    }
+
+    m_flagwaiting = 0;
+    m_nblocked = 0;
+    m_flagstop = 1;     //not started
+    m_flagrunning = 0;
+    m_nwriters = 0;
+
+    m_thr.InitializeCritSec(&m_mutexfiles);
+    m_thr.InitializeCritSec(&m_mutexwake);
+    #ifdef WIN32
+      m_eventwake = CreateEvent(NULL,FALSE,FALSE,NULL);
+      m_eventspace = CreateEvent(NULL,FALSE,FALSE,NULL);
+    #else
+      pthread_cond_init(&m_condwake,NULL);
+      pthread_cond_init(&m_condspace,NULL);
+    #endif
+}
+
+CLogQueue::~CLogQueue()
+{
+
+    Stop();
+
+    m_thr.DestroyCritSec(&m_mutexfiles);
+    m_thr.DestroyCritSec(&m_mutexwake);
+    #ifdef WIN32
+      if (m_eventwake != NULL)
+          CloseHandle(m_eventwake);
+      if (m_eventspace != NULL)
+          CloseHandle(m_eventspace);
+    #else
+      pthread_cond_destroy(&m_condwake);
+      pthread_cond_destroy(&m_condspace);
+    #endif
+}
+
+//////////////////////////////////////////////////////////////////////
+// Public Methods
+//////////////////////////////////////////////////////////////////////
+
+//////////////////////////////////////////////////////////////////////
+// Starts the writer thread.
+//
+// [in] nrecords   : Max number of log lines that can wait in the
+//                   queue (rounded up to a power of 2).
+// [in] fullpolicy : What Add() does when the queue is full
+//                   (LOGQUEUE_FULLBLOCK or LOGQUEUE_FULLDROP).
+//
+// Return : On success 1 is returned.  On failure 0 is returned.
+//
+int CLogQueue::Start(int nrecords /*=LOGQUEUE_DEFRECORDS*/, int fullpolicy /*=LOGQUEUE_FULLBLOCK*/)
+{
+    unsigned long i, size;
+
+    if (nrecords <= 0 || m_records != NULL)
+        return(0);
+
+    for (size = 2; size < (unsigned long)nrecords; size *= 2);
+
+    if ((m_records = (logqueueRecord_t *)malloc(size * sizeof(logqueueRecord_t))) == NULL)
+        return(0);
+    for (i = 0; i < size; i++)
+        m_records[i].seq = i;   //record "i" is free for position "i"
+    m_mask = size - 1;
+    m_addpos = m_writepos = 0;
+    m_fullpolicy = fullpolicy;
+    m_ndropped = 0;
+
+    m_flagstop = 0;
+    m_flagrunning = 1;
+    if (m_thr.Create(WriterThread,(void *)this) == 0) {
+        m_flagstop = 1;
+        m_flagrunning = 0;
+        free(m_records);
+        m_records = NULL;
+        return(0);
+    }
+
+    return(1);
+}
+
+//////////////////////////////////////////////////////////////////////
+// Stops the writer thread.  All the log lines in the queue are
+// written before the log files are closed.
+//
+// Return : VOID
+//
+void CLogQueue::Stop()
+{
+    CTimer timer;
+    int i;
+
+    if (m_records == NULL)
+        return;
+
+    m_flagstop = 1;
+    LOGQUEUE_BARRIER();
+    WakeWriter();
+
+        //wait for the writer thread to exit
+    while (m_flagrunning != 0) timer.Sleep(10);
+
+        //wait for the producers that got past IsRunning() in Add()
+        //(they either drop their line or finish filling in a record)
+    while (m_nwriters != 0) timer.Sleep(1);
+
+        //write any lines added while the writer was exiting
+    while (WriteRecords() > 0);
+
+    for (i = 0; i < LOGQUEUE_MAXFILES; i++) {
+        if (m_files[i].fd >= 0)
+            close(m_files[i].fd);
+        *m_files[i].name = '\0';
+        m_files[i].nametime = -1;
+        m_files[i].fd = -1;
+    }
+
+    free(m_records);
+    m_records = NULL;
+    m_mask = 0;
+}
+
+//////////////////////////////////////////////////////////////////////
+// Returns 1 if the writer thread is running (log lines can be
+// added) and 0 otherwise.
+//
+int CLogQueue::IsRunning()
+{
+
+    return((m_records != NULL && m_flagstop == 0) ? 1 : 0);
+}
+
+//////////////////////////////////////////////////////////////////////
+// Set the name of a log file written by the queue.
+//
+// [in] fileid   : Log file ID (0 to LOGQUEUE_MAXFILES-1).
+// [in] filename : Name of the log file.  The name may contain
+//                 strftime() specifiers that are expanded using the
+//                 time each line was logged (used to rotate the logs).
+//
+// Return : On success 1 is returned.  On failure 0 is returned.
+//
+// NOTE: "%O" (UTC offset) is written as "%z".
+//
+int CLogQueue::SetFileName(int fileid, const char *filename)
+{
+    char *ptr;
+    int len = 0;
+
+    if (fileid < 0 || fileid >= LOGQUEUE_MAXFILES || filename == NULL)
+        return(0);
+
+    if (strlen(filename) >= LOGQUEUE_MAXPATH)
+        return(0);
+
+    m_thr.P(&m_mutexfiles);
+
+    for (ptr = (char *)filename; *ptr != '\0'; ptr++) {
+        m_files[fileid].pattern[len++] = *ptr;
+        if (*ptr == '%' && *(ptr+1) != '\0') {
+            ptr++;
+            m_files[fileid].pattern[len++] = (*ptr == 'O') ? 'z' : *ptr;
+        }
+    }
+    m_files[fileid].pattern[len] = '\0';
+    m_files[fileid].nametime = -1;  //rebuild the file name on the next write
+
+    m_thr.V(&m_mutexfiles);
+
+    return(1);
+}
+
+//////////////////////////////////////////////////////////////////////
+// Adds a line to the queue.  The line is written to the log file
+// (and/or the screen) by the writer thread.
+//
+// [in] fileid : Log file ID (see SetFileName()).
+// [in] level  : Logging level to use (see Log.h).
+// [in] line   : Line to log (without the '\n').
+// [in] ltime  : Time the line was logged (0 = current time).
+//
+// Return : On success 1 is returned.  If the queue is not running
+//          or the line was dropped 0 is returned.
+//
+int CLogQueue::Add(int fileid, int level, const char *line, time_t ltime /*=0*/)
+{
+    logqueueRecord_t *precord;
+    unsigned long pos, seq;
+    long diff;
+    int len;
+
+    if (fileid < 0 || fileid >= LOGQUEUE_MAXFILES || line == NULL)
+        return(0);
+
+        //count this call before checking if the queue runs, so Stop()
+        //does not free the records while they are being used
+    LOGQUEUE_INC(&m_nwriters);
+    if (IsRunning() == 0) {
+        LOGQUEUE_DEC(&m_nwriters);
+        return(0);
+    }
+
+        //reserve a free record
+    pos = m_addpos;
+    while (1) {
+        precord = &m_records[pos & m_mask];
+        seq = precord->seq;
+        LOGQUEUE_BARRIER();
+        diff = (long)(seq - pos);
+        if (diff == 0) {
+            if (LOGQUEUE_CAS(&m_addpos,pos,pos+1))
+                break;  //got the record
+        } else if (diff < 0) {
+                //the queue is full
+            if (m_fullpolicy == LOGQUEUE_FULLDROP || m_flagstop != 0) {
+                LOGQUEUE_INC(&m_ndropped);
+                LOGQUEUE_DEC(&m_nwriters);
+                return(0);
+            }
+            WaitForSpace(pos);
+        }
+        pos = m_addpos;
+    }
+
+        //fill in the record
+    precord->fileid = fileid;
+    precord->level = level;
+    precord->time = (ltime != 0) ? ltime : time(NULL);
+    for (len = 0; line[len] != '\0' && len < LOGQUEUE_MAXLINE-1; len++)
+        precord->line[len] = line[len];
+    precord->line[len++] = '\n';
+    precord->len = len;
+
+        //mark the record as ready to write
+    LOGQUEUE_BARRIER();
+    precord->seq = pos + 1;
+    LOGQUEUE_BARRIER();
+
+        //wake up the writer for the first line or a full batch
+    if (m_flagwaiting == 1 || (m_flagwaiting == 2 && pos + 1 - m_writepos >= LOGQUEUE_MAXBATCH))
+        WakeWriter();
+
+    LOGQUEUE_DEC(&m_nwriters);
+    return(1);
+}
+
+//////////////////////////////////////////////////////////////////////
+// Get the number of log lines dropped because the queue was full.
+//
+unsigned long CLogQueue::GetNumDropped()
+{
+
+    return(m_ndropped);
+}
+
+//////////////////////////////////////////////////////////////////////
+// Private Methods
+//////////////////////////////////////////////////////////////////////
+
+//////////////////////////////////////////////////////////////////////
+// Writes a batch of ready log lines (at most LOGQUEUE_MAXBATCH).
+// Consecutive lines for the same log file are written at once.
+//
+// Return : The number of records removed from the queue.
+//
+int CLogQueue::WriteRecords()
+{
+    logqueueRecord_t *records[LOGQUEUE_MAXBATCH];
+    int i, j, n, fd, flagdisplay = 0;
+
+        //get the ready records
+    for (n = 0; n < LOGQUEUE_MAXBATCH; n++) {
+        records[n] = &m_records[(m_writepos + n) & m_mask];
+        if (records[n]->seq != m_writepos + n + 1)
+            break;  //not ready yet
+    }
+    if (n == 0)
+        return(0);
+    LOGQUEUE_BARRIER();
+
+        //display the lines that go to the screen
+    for (i = 0; i < n; i++) {
+        if (records[i]->level == LOG_LEVELDISPLAY || records[i]->level == LOG_LEVELDEBUG) {
+            fwrite(records[i]->line,1,records[i]->len,stdout);
+            flagdisplay = 1;
+        }
+    }
+    if (flagdisplay != 0)
+        fflush(stdout);
+
+        //write the lines that go to the log files
+    for (i = 0; i < n; i = j) {
+        if (records[i]->level == LOG_LEVELDISPLAY) {
+            j = i + 1;
+            continue;
+        }
+        fd = OpenFile(&m_files[records[i]->fileid],records[i]->time);
+            //group the following lines for the same file (and name)
+        for (j = i + 1; j < n; j++) {
+            if (records[j]->level == LOG_LEVELDISPLAY || records[j]->fileid != records[i]->fileid || records[j]->time != records[i]->time)
+                break;
+        }
+        if (fd >= 0)
+            WriteLines(fd,records+i,j-i);
+    }
+
+        //free the records
+    LOGQUEUE_BARRIER();
+    for (i = 0; i < n; i++)
+        records[i]->seq = m_writepos + i + m_mask + 1;
+    m_writepos += n;
+
+        //wake up the producers waiting for a free record
+    LOGQUEUE_BARRIER();
+    if (m_nblocked > 0) {
+        m_thr.P(&m_mutexwake);
+        #ifdef WIN32
+          SetEvent(m_eventspace);
+        #else
+          pthread_cond_broadcast(&m_condspace);
+        #endif
+        m_thr.V(&m_mutexwake);
+    }
+
+    return(n);
+}
+
+//////////////////////////////////////////////////////////////////////
+// Opens the log file for the time "ltime".  If the file name changed
+// (rotation or SetFileName()) the old file is closed.
+//
+// [in] pfile : Log file to open.
+// [in] ltime : Time the line being written was logged.
+//
+// Return : The descriptor for the log file or -1 on error.
+//
+int CLogQueue::OpenFile(logqueueFile_t *pfile, time_t ltime)
+{
+    struct tm *ltimeptr, tmtime;
+    char name[LOGQUEUE_MAXPATH];
+
+    if (pfile->nametime == ltime && pfile->fd >= 0)
+        return(pfile->fd);
+
+    m_thr.P(&m_mutexfiles);
+
+    *name = '\0';
+    #ifdef WIN32
+      ltimeptr = localtime(&ltime); //thread safe under Windows
+      if (ltimeptr != NULL) tmtime = *ltimeptr;
+    #else
+      ltimeptr = localtime_r(&ltime,&tmtime);
+    #endif
+    if (ltimeptr != NULL && *pfile->pattern != '\0') {
+        strftime(name,sizeof(name)-1,pfile->pattern,&tmtime);
+        name[sizeof(name)-1] = '\0';
+    }
+    pfile->nametime = ltime;
+
+    m_thr.V(&m_mutexfiles);
+
+    if (*name == '\0')
+        return(-1);
+
+        //check if the log file name changed
+    if (pfile->fd >= 0 && strcmp(name,pfile->name) == 0)
+        return(pfile->fd);
+
+    if (pfile->fd >= 0)
+        close(pfile->fd);
+    strcpy(pfile->name,name);
+    #ifdef WIN32
+      pfile->fd = open(name,O_WRONLY|O_APPEND|O_CREAT|O_BINARY,0666);
+    #else
+      pfile->fd = open(name,O_WRONLY|O_APPEND|O_CREAT,0666);
+    #endif
+    if (pfile->fd < 0)
+        pfile->nametime = -1;   //try again on the next write
+
+    return(pfile->fd);
+}
+
+//////////////////////////////////////////////////////////////////////
+// Writes the lines in "records" to the file "fd".
+//
+// [in] fd       : Descriptor for the log file.
+// [in] records  : Records to write.
+// [in] nrecords : Number of records in "records".
+//
+// Return : VOID
+//
+void CLogQueue::WriteLines(int fd, logqueueRecord_t **records, int nrecords)
+{
+    int i;
+
+    #ifdef WIN32
+      for (i = 0; i < nrecords; i++)
+          write(fd,records[i]->line,records[i]->len);
+    #else
+      struct iovec iov[LOGQUEUE_MAXBATCH];
+      int niov = nrecords;
+      ssize_t nwritten;
+
+      for (i = 0; i < niov; i++) {
+          iov[i].iov_base = records[i]->line;
+          iov[i].iov_len = records[i]->len;
+      }
+
+      i = 0;
+      while (i < niov) {
+          if ((nwritten = writev(fd,iov+i,niov-i)) < 0) {
+              if (errno == EINTR)
+                  continue;
+              break;    //the lines are lost
+          }
+              //skip the lines that were written (handle short writes)
+          while (i < niov && nwritten >= (ssize_t)iov[i].iov_len) {
+              nwritten -= iov[i].iov_len;
+              i++;
+          }
+          if (i < niov) {
+              iov[i].iov_base = (char *)iov[i].iov_base + nwritten;
+              iov[i].iov_len -= nwritten;
+          }
+      }
+    #endif
+}
+
+//////////////////////////////////////////////////////////////////////
+// Wakes up the writer thread if it is waiting for log lines.
+//
+void CLogQueue::WakeWriter()
+{
+
+    m_thr.P(&m_mutexwake);
+    #ifdef WIN32
+      SetEvent(m_eventwake);
+    #else
+      pthread_cond_signal(&m_condwake);
+    #endif
+    m_thr.V(&m_mutexwake);
+}
+
+//////////////////////////////////////////////////////////////////////
+// Waits for log lines to be added to the queue.  If the queue is
+// empty, waits (at most 1 sec) for the first line.  Otherwise waits
+// (at most LOGQUEUE_FLUSHMS) for a full batch.
+//
+// Return : VOID
+//
+void CLogQueue::WaitForRecords()
+{
+    unsigned long nqueued;
+    int timeoutms;
+
+    m_thr.P(&m_mutexwake);
+
+    m_flagwaiting = 2;
+    LOGQUEUE_BARRIER();
+    if ((nqueued = GetNumQueued()) == 0) {
+        m_flagwaiting = 1;
+        LOGQUEUE_BARRIER();
+        nqueued = GetNumQueued();
+    }
+
+    if (nqueued < LOGQUEUE_MAXBATCH && m_flagstop == 0) {
+        timeoutms = (nqueued == 0) ? 1000 : LOGQUEUE_FLUSHMS;
+        #ifdef WIN32
+          m_thr.V(&m_mutexwake);
+          WaitForSingleObject(m_eventwake,timeoutms);
+          m_thr.P(&m_mutexwake);
+        #else
+          struct timeval now;
+          struct timespec timeout;
+          gettimeofday(&now,NULL);
+          timeout.tv_sec = now.tv_sec + timeoutms / 1000;
+          timeout.tv_nsec = (now.tv_usec + (timeoutms % 1000) * 1000) * 1000;
+          if (timeout.tv_nsec >= 1000000000) {
+              timeout.tv_sec++;
+              timeout.tv_nsec -= 1000000000;
+          }
+          pthread_cond_timedwait(&m_condwake,&m_mutexwake,&timeout);
+        #endif
+    }
+    m_flagwaiting = 0;
+
+    m_thr.V(&m_mutexwake);
+}
+
+//////////////////////////////////////////////////////////////////////
+// Waits (at most 10 ms) for the writer to free the record at the
+// position "pos" (called by a producer when the queue is full).
+//
+// [in] pos : Position of the record to wait for.
+//
+// Return : VOID
+//
+void CLogQueue::WaitForSpace(unsigned long pos)
+{
+    logqueueRecord_t *precord = &m_records[pos & m_mask];
+
+    WakeWriter();   //make sure the writer empties the queue
+
+    m_thr.P(&m_mutexwake);
+    m_nblocked++;
+    LOGQUEUE_BARRIER();
+    if ((long)(precord->seq - pos) < 0 && m_flagstop == 0) {
+        #ifdef WIN32
+          m_thr.V(&m_mutexwake);
+          WaitForSingleObject(m_eventspace,10);
+          m_thr.P(&m_mutexwake);
+        #else
+          struct timeval now;
+          struct timespec timeout;
+          gettimeofday(&now,NULL);
+          timeout.tv_sec = now.tv_sec;
+          timeout.tv_nsec = (now.tv_usec + 10000) * 1000;
+          if (timeout.tv_nsec >= 1000000000) {
+              timeout.tv_sec++;
+              timeout.tv_nsec -= 1000000000;
+          }
+          pthread_cond_timedwait(&m_condspace,&m_mutexwake,&timeout);
+        #endif
+    }
+    m_nblocked--;
+    m_thr.V(&m_mutexwake);
+}
+
+//////////////////////////////////////////////////////////////////////
+// Get the number of records reserved by the producers that are not
+// written yet (some may still be being filled in).
+//
+unsigned long CLogQueue::GetNumQueued()
+{
+
+    return(m_addpos - m_writepos);
+}
+
+//////////////////////////////////////////////////////////////////////
+// Writer thread.  Writes the log lines until Stop() is called and
+// the queue is empty.
+//
+#ifdef WIN32
+  void CLogQueue::WriterThread(void *vpqueue)
+#else
+  void *CLogQueue::WriterThread(void *vpqueue)
+#endif
+{
+    CLogQueue *pqueue = (CLogQueue *)vpqueue;
+    int n;
+
+    while (1) {
+        if ((n = pqueue->WriteRecords()) == LOGQUEUE_MAXBATCH)
+            continue;   //more lines are probably ready
+        if (pqueue->m_flagstop != 0) {
+            if (n == 0)
+                break;  //the queue is empty
+            continue;
+        }
+        pqueue->WaitForRecords();
+    }
+
+    pqueue->m_flagrunning = 0;
+
+    #ifndef WIN32
+      return(NULL);     //UNIX must return a value
+    #endif
+}
@@ -0,0 +1,120 @@
+// Copyright (C) 2026 The indiftpd contributors
+//
+// This program is free software; you can redistribute it and/or
+// modify it under the terms of the GNU General Public License
+// as published by the Free Software Foundation; either version 2
+// of the License, or (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program; if not, write to the Free Software
+// Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.
+//
+//
+// LogQueue.h: interface for the CLogQueue class.
+//
+//////////////////////////////////////////////////////////////////////
+#ifndef LOGQUEUE_H
+#define LOGQUEUE_H
+
+#include <time.h>
+
+#include "Thr.h"
+#include "Log.h"
+
+#define LOGQUEUE_MAXLINE    1024    //max size of a log line in the queue (longer lines are cut)
+#define LOGQUEUE_DEFRECORDS 2048    //default number of log lines the queue can hold
+#define LOGQUEUE_MAXFILES   4       //max number of log files written through one queue
+#define LOGQUEUE_MAXBATCH   256     //max number of log lines written at once
+#define LOGQUEUE_FLUSHMS    20      //max time (ms) a partial batch waits to be written
+#define LOGQUEUE_MAXPATH    512     //max length of a log file name
+
+    //What to do when a log line is added to a full queue
+#define LOGQUEUE_FULLBLOCK  0   //wait until the writer thread makes room
+#define LOGQUEUE_FULLDROP   1   //drop the log line (see GetNumDropped())
+
+    //log line waiting in the queue
+typedef struct {
+    volatile unsigned long seq; //position in the queue this record is ready for
+    int fileid;         //log file to write to (see SetFileName())
+    int level;          //logging level to use (see Log.h)
+    time_t time;        //time the line was logged (used for the file name)
+    int len;            //length of "line" (including the '\n')
+    char line[LOGQUEUE_MAXLINE];
+} logqueueRecord_t;
+
+    //log file written by the writer thread
+typedef struct {
+    char pattern[LOGQUEUE_MAXPATH]; //file name (may contain strftime() specifiers)
+    char name[LOGQUEUE_MAXPATH];    //name of the open file
+    time_t nametime;    //time "name" was built for
+    int fd;             //descriptor for the open file (-1 = not open)
+} logqueueFile_t;
+
+
+///////////////////////////////////////////////////////////////////////////////
+// Queue of log lines that are written to the log files by one thread
+///////////////////////////////////////////////////////////////////////////////
+
+class CLogQueue
+{
+public:
+    CLogQueue();
+    virtual ~CLogQueue();
+
+    int Start(int nrecords = LOGQUEUE_DEFRECORDS, int fullpolicy = LOGQUEUE_FULLBLOCK);
+    void Stop();
+    int IsRunning();
+
+    int SetFileName(int fileid, const char *filename);
+    int Add(int fileid, int level, const char *line, time_t ltime = 0);
+
+    unsigned long GetNumDropped();
+
+private:
+    #ifdef WIN32
+      static void WriterThread(void *vpqueue);  //WINDOWS must return "void"
+    #else
+      static void *WriterThread(void *vpqueue); //UNIX must return "void *"
+    #endif
+    int WriteRecords();
+    int OpenFile(logqueueFile_t *pfile, time_t ltime);
+    void WriteLines(int fd, logqueueRecord_t **records, int nrecords);
+    void WakeWriter();
+    void WaitForRecords();
+    void WaitForSpace(unsigned long pos);
+    unsigned long GetNumQueued();
+
+private:
+    CThr m_thr;             //thread functions
+
+    logqueueRecord_t *m_records;    //ring of log lines
+    unsigned long m_mask;           //number of records - 1 (the number is a power of 2)
+    volatile unsigned long m_addpos;    //next position to add a line at (producers)
+    volatile unsigned long m_writepos;  //next position to write (only changed by the writer)
+    int m_fullpolicy;       //LOGQUEUE_FULLBLOCK or LOGQUEUE_FULLDROP
+    volatile unsigned long m_ndropped;  //number of lines dropped because the queue was full
+
+    logqueueFile_t m_files[LOGQUEUE_MAXFILES];
+    thrSync_t m_mutexfiles; //protects the file names in "m_files"
+
+    thrSync_t m_mutexwake;  //used to wake up the writer thread and the blocked producers
+    #ifdef WIN32
+      HANDLE m_eventwake;   //set when lines are added while the writer waits
+      HANDLE m_eventspace;  //set when records are freed while producers are blocked
+    #else
+      pthread_cond_t m_condwake;    //signaled when lines are added while the writer waits
+      pthread_cond_t m_condspace;   //signaled when records are freed while producers are blocked
+    #endif
+    volatile int m_flagwaiting;     //while the writer waits: 1 = for the first line, 2 = for a full batch
+    volatile int m_nblocked;        //number of producers waiting for a free record
+    volatile int m_flagstop;        //if m_flagstop != 0, the writer exits once the queue is empty
+    volatile int m_flagrunning;     //1 while the writer thread runs
+    volatile long m_nwriters;       //number of Add() calls in progress (Stop() waits for them)
+};
+
+#endif //LOGQUEUE_H
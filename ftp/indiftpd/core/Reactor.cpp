@@ -0,0 +1,261 @@
+// Copyright (C) 2026 The indiftpd contributors
+//
+// This program is free software; you can redistribute it and/or
+// modify it under the terms of the GNU General Public License
+// as published by the Free Software Foundation; either version 2
+// of the License, or (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program; if not, write to the Free Software
+// Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.
+//
+//
+// Reactor.cpp: implementation of the CReactor class.
+//
+//////////////////////////////////////////////////////////////////////
+#include <stdlib.h>
+#include <string.h>
+
+#ifdef LINUX
+  #include <unistd.h>
+  #include <errno.h>
+  #include <sys/epoll.h>
+#endif
+
+#include "Reactor.h"
+#include "Timer.h"
+
+//////////////////////////////////////////////////////////////////////
+// Construction/Destruction
+//////////////////////////////////////////////////////////////////////
+
+CReactor::CReactor()
+{
+
+    m_epfd = -1;
+    m_fptr = NULL;
+    m_numthreads = 0;
+    m_flagstop = 1;     //not started
+
+    m_thr.InitializeCritSec(&m_mutex);
+}
+
+CReactor::~CReactor()
+{
+
+    Stop();
+
+    m_thr.DestroyCritSec(&m_mutex);
+}
+
+//////////////////////////////////////////////////////////////////////
+// Public Methods
+//////////////////////////////////////////////////////////////////////
+
+//////////////////////////////////////////////////////////////////////
+// Starts the reactor threads.
+//
+// [in] nthreads : Number of threads waiting for socket events.
+// [in] fptr     : Handler called (in one of the reactor threads) with
+//                 the argument given to Add()/Rearm() when the socket
+//                 is readable.
+//
+// Return : On success 1 is returned.  On failure, or if the reactor
+//          is not supported on this platform, 0 is returned.
+//
+int CReactor::Start(int nthreads, reactorHandler_t fptr)
+{
+#ifdef LINUX
+    int i;
+
+    if (nthreads <= 0 || fptr == NULL || m_epfd != -1)
+        return(0);
+
+    if ((m_epfd = epoll_create(1024)) == -1)
+        return(0);
+    m_fptr = fptr;
+    m_flagstop = 0;
+
+    for (i = 0; i < nthreads; i++) {
+        m_thr.P(&m_mutex);
+        m_numthreads++;
+        m_thr.V(&m_mutex);
+        if (m_thr.Create(EventThread,(void *)this) == 0) {
+            m_thr.P(&m_mutex);
+            m_numthreads--;
+            m_thr.V(&m_mutex);
+            break;
+        }
+    }
+
+    if (i == 0) {   //no reactor threads could be created
+        Stop();
+        return(0);
+    }
+
+    return(1);
+#else
+    return(0);      //not supported
+#endif
+}
+
+//////////////////////////////////////////////////////////////////////
+// Stops the reactor threads.  A handler that is running is allowed
+// to finish.  Sockets still registered are not closed.
+//
+// Return : VOID
+//
+void CReactor::Stop()
+{
+#ifdef LINUX
+    CTimer timer;
+
+    if (m_epfd == -1)
+        return;
+
+    m_flagstop = 1;
+        //wait for all the reactor threads to exit
+    while (GetNumThreads() > 0) timer.Sleep(50);
+
+    close(m_epfd);
+    m_epfd = -1;
+#endif
+}
+
+//////////////////////////////////////////////////////////////////////
+// Check if the reactor threads are running.
+//
+// Return : 1 if running, otherwise 0.
+//
+int CReactor::IsRunning()
+{
+
+    return((m_epfd != -1 && m_flagstop == 0) ? 1 : 0);
+}
+
+//////////////////////////////////////////////////////////////////////
+// Registers a socket.  The handler is called once the socket is
+// readable.
+//
+// [in] sd  : Socket desc to watch.
+// [in] arg : Argument passed to the handler.
+//
+// Return : On success 1 is returned.  On failure 0 is returned.
+//
+int CReactor::Add(SOCKET sd, void *arg)
+{
+#ifdef LINUX
+    struct epoll_event ev;
+
+    if (m_epfd == -1 || sd == SOCK_INVALID)
+        return(0);
+
+    memset(&ev,0,sizeof(ev));
+    ev.events = EPOLLIN | EPOLLRDHUP | EPOLLONESHOT;
+    ev.data.ptr = arg;
+
+    return((epoll_ctl(m_epfd,EPOLL_CTL_ADD,sd,&ev) == 0) ? 1 : 0);
+#else
+    return(0);
+#endif
+}
+
+//////////////////////////////////////////////////////////////////////
+// Re-arms a socket after its handler was called.  This must be the
+// last access to "arg" by the handler, since another reactor thread
+// may call the handler again before Rearm() returns.
+//
+// [in] sd  : Socket desc to watch.
+// [in] arg : Argument passed to the handler.
+//
+// Return : On success 1 is returned.  On failure 0 is returned.
+//
+int CReactor::Rearm(SOCKET sd, void *arg)
+{
+#ifdef LINUX
+    struct epoll_event ev;
+
+    if (m_epfd == -1 || sd == SOCK_INVALID)
+        return(0);
+
+    memset(&ev,0,sizeof(ev));
+    ev.events = EPOLLIN | EPOLLRDHUP | EPOLLONESHOT;
+    ev.data.ptr = arg;
+
+    return((epoll_ctl(m_epfd,EPOLL_CTL_MOD,sd,&ev) == 0) ? 1 : 0);
+#else
+    return(0);
+#endif
+}
+
+//////////////////////////////////////////////////////////////////////
+// Unregisters a socket (should be called before closing the socket).
+//
+// [in] sd : Socket desc to remove.
+//
+// Return : On success 1 is returned.  On failure 0 is returned.
+//
+int CReactor::Remove(SOCKET sd)
+{
+#ifdef LINUX
+    struct epoll_event ev;
+
+    if (m_epfd == -1 || sd == SOCK_INVALID)
+        return(0);
+
+    memset(&ev,0,sizeof(ev));   //required by kernels before 2.6.9
+
+    return((epoll_ctl(m_epfd,EPOLL_CTL_DEL,sd,&ev) == 0) ? 1 : 0);
+#else
+    return(0);
+#endif
+}
+
+//////////////////////////////////////////////////////////////////////
+// Get the number of running reactor threads.
+//
+int CReactor::GetNumThreads()
+{
+    int numthreads;
+
+    m_thr.P(&m_mutex);
+    numthreads = m_numthreads;
+    m_thr.V(&m_mutex);
+
+    return(numthreads);
+}
+
+//////////////////////////////////////////////////////////////////////
+// Private Methods
+//////////////////////////////////////////////////////////////////////
+
+#ifdef LINUX
+//////////////////////////////////////////////////////////////////////
+// Reactor thread.  Waits for socket events and calls the handler.
+//
+void *CReactor::EventThread(void *vpreactor)
+{
+    CReactor *preactor = (CReactor *)vpreactor;
+    struct epoll_event events[REACTOR_MAXEVENTS];
+    int i, n;
+
+    while (preactor->m_flagstop == 0) {
+        n = epoll_wait(preactor->m_epfd,events,REACTOR_MAXEVENTS,REACTOR_WAITMSEC);
+        if (n < 0 && errno != EINTR)
+            break;
+        for (i = 0; i < n; i++)
+            (*preactor->m_fptr)(events[i].data.ptr);
+    }
+
+    preactor->m_thr.P(&preactor->m_mutex);
+    preactor->m_numthreads--;
+    preactor->m_thr.V(&preactor->m_mutex);
+
+    return(NULL);
+}
+#endif
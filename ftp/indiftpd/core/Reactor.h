@@ -0,0 +1,77 @@
+// Copyright (C) 2026 The indiftpd contributors
+//
+// This program is free software; you can redistribute it and/or
+// modify it under the terms of the GNU General Public License
+// as published by the Free Software Foundation; either version 2
+// of the License, or (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program; if not, write to the Free Software
+// Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.
+//
+//
+// Reactor.h: interface for the CReactor class.
+//
+//////////////////////////////////////////////////////////////////////
+#ifndef REACTOR_H
+#define REACTOR_H
+
+#include "Sock.h"
+#include "Thr.h"
+
+#define REACTOR_MAXEVENTS 8     //max number of events handled per wakeup of a reactor thread
+#define REACTOR_WAITMSEC  1000  //max time a reactor thread waits before checking for Stop()
+
+    //function called when a registered socket is readable (or closed)
+typedef void (*reactorHandler_t)(void *arg);
+
+
+///////////////////////////////////////////////////////////////////////////////
+// Readiness notification for many sockets shared by a few threads.
+//
+// A registered socket is reported to only one thread at a time, and is
+// not reported again until it is re-armed with Rearm().  The handler
+// therefore owns the socket (and its argument) until it calls Rearm().
+//
+// Currently only implemented with epoll (LINUX).  On other platforms
+// Start() fails and callers should use a thread per socket.
+///////////////////////////////////////////////////////////////////////////////
+
+class CReactor
+{
+public:
+    CReactor();
+    virtual ~CReactor();
+
+    int Start(int nthreads, reactorHandler_t fptr);
+    void Stop();
+    int IsRunning();
+
+    int Add(SOCKET sd, void *arg);
+    int Rearm(SOCKET sd, void *arg);
+    int Remove(SOCKET sd);
+
+    int GetNumThreads();
+
+private:
+    #ifdef LINUX
+      static void *EventThread(void *vpreactor);
+    #endif
+
+private:
+    CThr m_thr;             //thread functions
+    thrSync_t m_mutex;      //protects m_numthreads
+
+    int m_epfd;             //epoll descriptor (-1 if not running)
+    reactorHandler_t m_fptr;    //handler for the readable sockets
+
+    int m_numthreads;       //number of running reactor threads
+    int m_flagstop;         //if m_flagstop != 0, the reactor threads exit
+};
+
+#endif //REACTOR_H
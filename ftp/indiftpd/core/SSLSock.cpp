@@ -580,11 +580,18 @@ void CSSLSock::FreeX509Mem(char *certbuf)
 // [in] certbuf     : Buffer containing the PEM x509 certificate.
 // [in] certsize    : Size in bytes of the PEM x509 certificate.
 // [out] errcode    : Code that identifies any errors (=0 on success).
+// [in] cachesize   : Max number of sessions cached by the new context
+//                    (0 = sessions are not cached or resumed).
+// [in] cachettl    : Time (sec) a cached session can be resumed.
 //
 // Return : On success the information for the SSL connection is
 //          returned.  On failure NULL is returned.
 //
-sslsock_t *CSSLSock::SSLServerNeg(SOCKET sd, const char *privkeybuf, int privkeysize, const char *privpass, const char *certbuf, int certsize, int *errcode)
+// NOTE: The new context is used for the data connections of the control
+//       connection (see the next SSLServerNeg()), so they can resume
+//       the control connection's session instead of a full handshake.
+//
+sslsock_t *CSSLSock::SSLServerNeg(SOCKET sd, const char *privkeybuf, int privkeysize, const char *privpass, const char *certbuf, int certsize, int *errcode, long cachesize /*=SSLSOCK_SESSCACHESIZE*/, long cachettl /*=SSLSOCK_SESSCACHETTL*/)
 {
 	BIO *bio = NULL;            //I/O pointer
     EVP_PKEY *privkey = NULL;   //private key
@@ -663,6 +670,9 @@ sslsock_t *CSSLSock::SSLServerNeg(SOCKET sd, const char *privkeybuf, int privkey
         //the calling application
     SSL_CTX_set_mode(sslinfo->ctx,SSL_MODE_AUTO_RETRY);
 
+        //set the session cache (and tickets) used to resume sessions
+    SetSessionCache(sslinfo->ctx,cachesize,cachettl);
+
         //do server side SSL.
     if ((sslinfo->ssl = SSL_new(sslinfo->ctx)) == NULL) {
         SSL_CTX_free(sslinfo->ctx); free(sslinfo);
@@ -738,11 +748,13 @@ sslsock_t *CSSLSock::SSLServerNeg(SOCKET sd, sslsock_t *sslinfo, int *errcode)
 // [in] sd       : Socket descriptor to use for the SSL connection.
 // [out] errcode : Code that identifies any errors (=0 on success).
 // [in] sslver   : SSL version (currently only 2 and 3 are supported).
+// [in] resumeinfo : An SSL client connection whose session is resumed
+//                   if the server allows it (NULL = full handshake).
 //
 // Return : On success the information for the SSL connection is
 //          returned.  On failure NULL is returned.
 //
-sslsock_t *CSSLSock::SSLClientNeg(SOCKET sd, int *errcode, int sslver /*=2*/)
+sslsock_t *CSSLSock::SSLClientNeg(SOCKET sd, int *errcode, int sslver /*=2*/, sslsock_t *resumeinfo /*=NULL*/)
 {
     sslsock_t *sslinfo;
 
@@ -786,6 +798,8 @@ sslsock_t *CSSLSock::SSLClientNeg(SOCKET sd, int *errcode, int sslver /*=2*/)
         return(NULL);
     }
     SSL_set_fd(sslinfo->ssl,sd); //set the socket descriptor to use for the SSL connection
+    if (resumeinfo != NULL && resumeinfo->ssl != NULL && SSL_get_session(resumeinfo->ssl) != NULL)
+        SSL_set_session(sslinfo->ssl,SSL_get_session(resumeinfo->ssl));
     if (SSL_connect(sslinfo->ssl) == -1) {
         SSL_free(sslinfo->ssl); SSL_CTX_free(sslinfo->ctx); free(sslinfo);
         *errcode = 5;   //unable to create the SSL connection
@@ -1074,11 +1088,53 @@ long CSSLSock::VerifyCert(sslsock_t *sslinfo)
     return(retcode);
 }
 
+//////////////////////////////////////////////////////////////////////
+// IsSessionReused() Checks if the SSL connection resumed a previous
+// session (abbreviated handshake) instead of negotiating a new one.
+//
+// [in] sslinfo : The information for the SSL connection.
+//
+// Return : 1 if the session was resumed.  Otherwise 0 is returned.
+//
+int CSSLSock::IsSessionReused(sslsock_t *sslinfo)
+{
+
+    if (sslinfo == NULL)
+        return(0);
+
+    if (sslinfo->ssl == NULL)
+        return(0);
+
+    return((SSL_session_reused(sslinfo->ssl) != 0) ? 1 : 0);
+}
+
 
 //////////////////////////////////////////////////////////////////////
 // Private Methods
 //////////////////////////////////////////////////////////////////////
 
+    //sets the server session cache of "ctx" (must be done before the
+    //first handshake).  A "cachesize" of 0 turns off resuming sessions.
+void CSSLSock::SetSessionCache(SSL_CTX *ctx, long cachesize, long cachettl)
+{
+
+        //resumed sessions must come from this application
+    SSL_CTX_set_session_id_context(ctx,(const unsigned char *)SSLSOCK_SESSIDCTX,strlen(SSLSOCK_SESSIDCTX));
+
+    if (cachesize <= 0) {
+        SSL_CTX_set_session_cache_mode(ctx,SSL_SESS_CACHE_OFF);
+        #ifdef SSL_OP_NO_TICKET
+          SSL_CTX_set_options(ctx,SSL_OP_NO_TICKET);  //tickets are resumed w/o the cache
+        #endif
+        return;
+    }
+
+    SSL_CTX_set_session_cache_mode(ctx,SSL_SESS_CACHE_SERVER);
+    SSL_CTX_sess_set_cache_size(ctx,cachesize);
+    if (cachettl > 0)
+        SSL_CTX_set_timeout(ctx,cachettl);  //also the lifetime of the tickets
+}
+
     //make sure the certificate information is valid
 int CSSLSock::CheckCertInfo(sslsockCertInfo_t *certinfo)
 {
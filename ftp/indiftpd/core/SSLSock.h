@@ -34,6 +34,10 @@
   #define SSLSOCK_INVALID -1
 #endif
 
+#define SSLSOCK_SESSCACHESIZE 128   //default max number of sessions cached by a server context
+#define SSLSOCK_SESSCACHETTL  300   //default time (sec) a cached session can be resumed
+#define SSLSOCK_SESSIDCTX "CSSLSock"    //session ID context of the server sessions
+
 typedef struct {
     char country[3];        //Country Name (2 letter code)
     char state[80];         //State or Province Name (full name)
@@ -85,9 +89,9 @@ public:
     void FreeX509Mem(char *certbuf);
 
         //Functions for opening and closing SSL connections
-    sslsock_t *SSLServerNeg(SOCKET sd, const char *privkeybuf, int privkeysize, const char *privpass, const char *certbuf, int certsize, int *errcode);
+    sslsock_t *SSLServerNeg(SOCKET sd, const char *privkeybuf, int privkeysize, const char *privpass, const char *certbuf, int certsize, int *errcode, long cachesize = SSLSOCK_SESSCACHESIZE, long cachettl = SSLSOCK_SESSCACHETTL);
     sslsock_t *SSLServerNeg(SOCKET sd, sslsock_t *sslinfo, int *errcode);   //uses pre-existing context (from above call)
-    sslsock_t *SSLClientNeg(SOCKET sd, int *errcode, int sslver = 2);
+    sslsock_t *SSLClientNeg(SOCKET sd, int *errcode, int sslver = 2, sslsock_t *resumeinfo = NULL);
     void SSLClose(sslsock_t *sslinfo);
     void FreeSSLInfo(sslsock_t *sslinfo);
 
@@ -101,8 +105,10 @@ public:
     char *GetCipherName(sslsock_t *sslinfo);
     void FreeCipherName(char *ciphername);
     long VerifyCert(sslsock_t *sslinfo);
+    int IsSessionReused(sslsock_t *sslinfo);
 
 private:
+    void SetSessionCache(SSL_CTX *ctx, long cachesize, long cachettl);
     int CheckCertInfo(sslsockCertInfo_t *certinfo);
     char *LoadFileToMem(const char *filepath, int *filesize);
     long GetFileSize(const char *filepath);
@@ -149,9 +155,9 @@ public:
     void FreeX509Mem(char *certbuf) { }
 
         //Functions for opening and closing SSL connections
-    sslsock_t *SSLServerNeg(SOCKET sd, const char *privkeybuf, int privkeysize, const char *privpass, const char *certbuf, int certsize, int *errcode) { return(NULL); }
+    sslsock_t *SSLServerNeg(SOCKET sd, const char *privkeybuf, int privkeysize, const char *privpass, const char *certbuf, int certsize, int *errcode, long cachesize = SSLSOCK_SESSCACHESIZE, long cachettl = SSLSOCK_SESSCACHETTL) { return(NULL); }
     sslsock_t *SSLServerNeg(SOCKET sd, sslsock_t *sslinfo, int *errcode) { return(NULL); }
-    sslsock_t *SSLClientNeg(SOCKET sd, int *errcode, int sslver = 2) { return(NULL); }
+    sslsock_t *SSLClientNeg(SOCKET sd, int *errcode, int sslver = 2, sslsock_t *resumeinfo = NULL) { return(NULL); }
     void SSLClose(sslsock_t *sslinfo) { }
     void FreeSSLInfo(sslsock_t *sslinfo) { }
 
@@ -165,6 +171,7 @@ public:
     char *GetCipherName(sslsock_t *sslinfo) { return(NULL); }
     void FreeCipherName(char *ciphername) { }
     long VerifyCert(sslsock_t *sslinfo) { return(0); }
+    int IsSessionReused(sslsock_t *sslinfo) { return(0); }
 };
 
 
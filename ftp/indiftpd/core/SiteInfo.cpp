@@ -39,6 +39,7 @@
 #include "SiteInfo.h"
 #include "FSUtils.h"
 #include "StrUtils.h"
+#include "SSLSock.h"
 
     //Global variable used to signal the program to exit
 int siteinfoFlagQuit = 0;
@@ -90,12 +91,15 @@ CSiteInfo::CSiteInfo(char *progname, char *progversion, char *coreversion, char
         //Initialize the variables used to limit the site transfer speed
     m_maxdlspeed = 0;  //max download speed (bytes/sec)
     m_maxulspeed = 0;  //max upload speed (bytes/sec)
-    m_bytessent = 0;   //num bytes sent in the current transfer cycle
-    m_bytesrecv = 0;   //num bytes recv in the current transfer cycle
-    m_sendtimer = 0;   //used for sending rate timing (downloading)
-    m_recvtimer = 0;   //used for receiving rate timing (uploading)
-    m_thr.InitializeCritSec(&m_mutexsend);
-    m_thr.InitializeCritSec(&m_mutexrecv);
+    m_maxxferdlspeed = 0;  //max download speed of a single transfer (bytes/sec)
+    m_maxxferulspeed = 0;  //max upload speed of a single transfer (bytes/sec)
+    m_userbuckets = NULL;
+    m_thr.InitializeCritSec(&m_mutexbuckets);
+
+        //Initialize the SSL session cache settings
+    m_sslcachesize = SSLSOCK_SESSCACHESIZE;
+    m_sslcachettl = SSLSOCK_SESSCACHETTL;
+    m_flagsslreuse = 0;
 
         //Initialize the formatting strings
     strcpy(m_dateformat,SITEINFO_DEFDATEFORMAT);
@@ -123,6 +127,10 @@ CSiteInfo::CSiteInfo(char *progname, char *progversion, char *coreversion, char
 
 CSiteInfo::~CSiteInfo()
 {
+    siteinfoUserBucket_t *puserbucket;
+
+    m_xferpool.Stop();  //finish the queued transfers
+    m_logqueue.Stop();  //write the queued log lines
 
     if (m_sitedefroot != NULL)
         free(m_sitedefroot);
@@ -132,9 +140,13 @@ CSiteInfo::~CSiteInfo()
     if (m_accesslogname != NULL)
         free(m_accesslogname);
 
-        //destroy site transfer speed mutex
-    m_thr.DestroyCritSec(&m_mutexsend);
-    m_thr.DestroyCritSec(&m_mutexrecv);
+        //free the user transfer speed buckets
+    while (m_userbuckets != NULL) {
+        puserbucket = m_userbuckets;
+        m_userbuckets = m_userbuckets->next;
+        delete puserbucket;
+    }
+    m_thr.DestroyCritSec(&m_mutexbuckets);
 
         //destroy mutexes
     m_thr.DestroyCritSec(&m_mutexproglog);
@@ -354,6 +366,7 @@ int CSiteInfo::SetProgLogName(char *logfile, char *basepath /*=NULL*/)
     if (m_proglogname != NULL)
         free(m_proglogname);
     m_proglogname = tmppath;
+    m_logqueue.SetFileName(SITEINFO_PROGLOGID,m_proglogname);
 
     m_thr.V(&m_mutexproglog);   //exit the critical section
 
@@ -374,6 +387,32 @@ int CSiteInfo::WriteToProgLog(char *subsystem, char *msgformat, ...)
     if (msgformat == NULL)
         return(0);
 
+        //If the log queue is running, build the line in local buffers
+        //and let the writer thread write it (no locking or allocation).
+        //NOTE: the format strings are only changed at startup.
+    if (m_logqueue.IsRunning() != 0) {
+        char message[LOGQUEUE_MAXLINE], line[LOGQUEUE_MAXLINE], *values[3], empty[] = "";
+        CStrUtils strutils;
+
+        va_start(parg,msgformat);
+        #ifdef WIN32
+          _vsnprintf(message,sizeof(message)-1,msgformat,parg);  //for Windows
+        #else
+          vsnprintf(message,sizeof(message),msgformat,parg);     //for UNIX
+        #endif
+        va_end(parg);
+        message[sizeof(message)-1] = '\0';
+
+        GetTimeString(datebuffer,sizeof(datebuffer),m_dateformat);
+        values[0] = datebuffer;
+        values[1] = (subsystem == NULL) ? empty : subsystem;
+        values[2] = message;
+        if (strutils.BuildFormattedString(line,sizeof(line),m_progformat,"DSM",values,3) < 0)
+            return(0);
+
+        return(QueueLogLine(SITEINFO_PROGLOGID,m_progloglevel,line));
+    }
+
         //get the argument list
     va_start(parg,msgformat);
 
@@ -505,6 +544,7 @@ int CSiteInfo::SetAccessLogName(char *logfile, char *basepath /*=NULL*/)
     if (m_accesslogname != NULL)
         free(m_accesslogname);
     m_accesslogname = tmppath;
+    m_logqueue.SetFileName(SITEINFO_ACCESSLOGID,m_accesslogname);
 
     m_thr.V(&m_mutexaccesslog); //exit the critical section
 
@@ -517,6 +557,33 @@ int CSiteInfo::WriteToAccessLog(char *sip, char *sp, char *cip, char *cp, char *
 {
     char *buffer, *buffer1, datebuffer[64];
 
+        //If the log queue is running, build the line in a local buffer
+        //and let the writer thread write it (no locking or allocation).
+        //NOTE: the format strings are only changed at startup.
+    if (m_logqueue.IsRunning() != 0) {
+        char line[LOGQUEUE_MAXLINE], *values[10], empty[] = "";
+        CStrUtils strutils;
+
+        if (m_accessloglevel == SITEINFO_LOGLEVELNONE)
+            return(1);
+
+        GetTimeString(datebuffer,sizeof(datebuffer),m_dateformat);
+        values[0] = datebuffer;
+        values[1] = (sip == NULL) ? empty : sip;
+        values[2] = (sp == NULL) ? empty : sp;
+        values[3] = (cip == NULL) ? empty : cip;
+        values[4] = (cp == NULL) ? empty : cp;
+        values[5] = (user == NULL) ? empty : user;
+        values[6] = (cmd == NULL) ? empty : cmd;
+        values[7] = (arg == NULL) ? empty : arg;
+        values[8] = (status == NULL) ? empty : status;
+        values[9] = (text == NULL) ? empty : text;
+        if (strutils.BuildFormattedString(line,sizeof(line),m_accessformat,"dslcpumart",values,10) < 0)
+            return(0);
+
+        return(QueueLogLine(SITEINFO_ACCESSLOGID,m_accessloglevel,line));
+    }
+
     m_thr.P(&m_mutexaccesslog); //enter the critical section for the access log file
 
     if (m_accesslogname == NULL) {
@@ -556,6 +623,42 @@ int CSiteInfo::WriteToAccessLog(char *sip, char *sp, char *cip, char *cp, char *
     return(1);
 }
 
+    //Start writing the program and access logs through the log queue.
+    //"nrecords" is the max number of lines that can wait to be written and
+    //"fullpolicy" is LOGQUEUE_FULLBLOCK or LOGQUEUE_FULLDROP (see LogQueue.h).
+    //Returns 1 on success and 0 on failure (the logs are then written directly).
+int CSiteInfo::StartLogQueue(int nrecords, int fullpolicy /*=LOGQUEUE_FULLBLOCK*/)
+{
+
+    m_thr.P(&m_mutexaccesslog); //enter the critical section for the access log file
+    m_thr.P(&m_mutexproglog);   //enter the critical section for the program log file
+
+    if (m_proglogname != NULL)
+        m_logqueue.SetFileName(SITEINFO_PROGLOGID,m_proglogname);
+    if (m_accesslogname != NULL)
+        m_logqueue.SetFileName(SITEINFO_ACCESSLOGID,m_accesslogname);
+
+    m_thr.V(&m_mutexproglog);   //exit the critical section
+    m_thr.V(&m_mutexaccesslog); //exit the critical section
+
+    return(m_logqueue.Start(nrecords,fullpolicy));
+}
+
+    //Write all the queued log lines and go back to writing the logs directly
+void CSiteInfo::StopLogQueue()
+{
+    unsigned long ndropped;
+
+    if (m_logqueue.IsRunning() == 0)
+        return;
+
+    ndropped = m_logqueue.GetNumDropped();
+    m_logqueue.Stop();
+
+    if (ndropped > 0)
+        WriteToProgLog("SITEINFO","%lu log lines were dropped (the log queue was full).",ndropped);
+}
+
 ////////////////////////////////////////
 // Functions used to specify/limit the
 // range of ports used in data
@@ -583,6 +686,38 @@ int CSiteInfo::FreetDataPort(int sd)
     return(-1);  //by default this feature is not implemented
 }
 
+    //Start the threads that run the data transfers.  At most "nthreads"
+    //transfers run at the same time on the site and up to "maxqueued" more
+    //wait for a free thread.  "fworkerexit" frees the buffers a thread kept
+    //for its transfers (see CThrPool).
+    //Returns 1 on success and 0 on failure (each transfer then gets its own thread).
+int CSiteInfo::StartXferPool(int nthreads, int maxqueued, thrpoolWorkerExit_t fworkerexit /*=NULL*/)
+{
+
+    return(m_xferpool.Start(nthreads,maxqueued,fworkerexit));
+}
+
+    //Wait for the running and queued transfers and stop the transfer threads
+void CSiteInfo::StopXferPool()
+{
+
+    m_xferpool.Stop();
+}
+
+    //Queue a transfer for the transfer threads.  "fptr" is run with
+    //"xferinfo" by the first free thread.
+    //Returns 1 if the transfer was queued, 0 if the transfer threads are
+    //not running (the caller should start its own thread) and -1 if too
+    //many transfers are already waiting.
+int CSiteInfo::AddXfer(thrpoolWorkerJob_t fptr, void *xferinfo)
+{
+
+    if (m_xferpool.GetNumThreads() == 0)
+        return(0);
+
+    return((m_xferpool.Submit(fptr,xferinfo) != 0) ? 1 : -1);
+}
+
 ////////////////////////////////////////
 // Functions used to build LIST lines
 // returned to the client.
@@ -595,10 +730,8 @@ int CSiteInfo::FreetDataPort(int sd)
 char *CSiteInfo::BuildFullListLine(char *listline, int maxlinesize, char *filepath, char *thisyear /*=NULL*/)
 {
     CFSUtils fsutils;
-    CStrUtils strutils;
     fsutilsFileInfo_t finfo;
-    char *filename, *ptr, timestr[32], permissions[10], user[9], group[9], filetype;
-    int len = 0;
+    char *filename;
 
     if (listline == NULL || maxlinesize <= 0 || filepath == NULL)
         return(listline);
@@ -613,9 +746,30 @@ char *CSiteInfo::BuildFullListLine(char *listline, int maxlinesize, char *filepa
 
     fsutils.GetFileName(filename,strlen(filepath)+1,filepath);
 
-    filetype = (finfo.mode & S_IFDIR) ? 'd' : '-';
+    BuildFullListLine(listline,maxlinesize,filename,&finfo,thisyear);
+
+    free(filename);
+
+    return(listline);
+}
+
+    //Same as above for a file whose stats were already read (Ex. w/ CDirCache).
+    //"filename" is the name displayed in the LIST line.
+char *CSiteInfo::BuildFullListLine(char *listline, int maxlinesize, char *filename, fsutilsFileInfo_t *finfo, char *thisyear /*=NULL*/)
+{
+    CFSUtils fsutils;
+    CStrUtils strutils;
+    char *ptr, timestr[32], permissions[10], user[9], group[9], filetype;
+    int len = 0;
+
+    if (listline == NULL || maxlinesize <= 0 || filename == NULL || finfo == NULL)
+        return(listline);
+
+    *listline = '\0';
+
+    filetype = S_ISDIR(finfo->mode) ? 'd' : '-';
 
-    GetTimeString(timestr,sizeof(timestr),"%Y %b %d %H:%M",finfo.timecreate);
+    GetTimeString(timestr,sizeof(timestr),"%Y %b %d %H:%M",finfo->timecreate);
     if ((ptr = strrchr(timestr,' ')) != NULL) {
         ptr++;
         if (thisyear != NULL) {
@@ -625,19 +779,90 @@ char *CSiteInfo::BuildFullListLine(char *listline, int maxlinesize, char *filepa
             }
         }
         ptr = timestr + 5;  //move to the start of the month name
-        fsutils.GetPrmString(finfo.mode,permissions,sizeof(permissions));
-        fsutils.GetUsrName(finfo.userid,user,sizeof(user));
-        fsutils.GetGrpName(finfo.groupid,group,sizeof(group));
-        strutils.SNPrintf(listline,maxlinesize,"%c%9s %3ld %-8s %-8s %10lu %s ",filetype,permissions,finfo.nlinks,user,group,finfo.size,ptr);
+        fsutils.GetPrmString(finfo->mode,permissions,sizeof(permissions));
+        m_dircache.GetUsrName(finfo->userid,user,sizeof(user));
+        m_dircache.GetGrpName(finfo->groupid,group,sizeof(group));
+        strutils.SNPrintf(listline,maxlinesize,"%c%9s %3ld %-8s %-8s %10lu %s ",filetype,permissions,finfo->nlinks,user,group,finfo->size,ptr);
         len = strlen(listline);
         strncat(listline,filename,maxlinesize-len-1);
     }
 
-    free(filename);
+    return(listline);
+}
+
+    //Gets the "perm" facts (RFC 3659) of the files ("fileperm") and the
+    //sub-directories ("dirperm") in "dirpath" from the user's permissions.
+    //"fileperm" and "dirperm" must be at least SITEINFO_MAXMLSXPERM chars.
+void CSiteInfo::GetMLSxPerm(char *username, char *dirpath, char *fileperm, char *dirperm)
+{
+    char *fptr = fileperm, *dptr = dirperm;
+
+    if (CheckPermissions(username,dirpath,"uw") != 0) {
+        *(fptr++) = 'a';    //append to the file (APPE)
+        *(fptr++) = 'w';    //upload to the file (STOR)
+        *(dptr++) = 'c';    //create files in the dir (STOR)
+    }
+    if (CheckPermissions(username,dirpath,"ow") != 0) {
+        *(fptr++) = 'd';    //delete the file (DELE)
+        *(dptr++) = 'p';    //delete the files in the dir
+    }
+    if (CheckPermissions(username,dirpath,"nw") != 0)
+        *(dptr++) = 'd';    //delete the dir (RMD)
+    if (CheckPermissions(username,dirpath,"cx") != 0)
+        *(dptr++) = 'e';    //enter the dir (CWD)
+    if (CheckPermissions(username,dirpath,"aw") != 0) {
+        *(fptr++) = 'f';    //rename (RNFR)
+        *(dptr++) = 'f';
+    }
+    if (CheckPermissions(username,dirpath,"lx") != 0)
+        *(dptr++) = 'l';    //list the dir (LIST, MLSD)
+    if (CheckPermissions(username,dirpath,"mw") != 0)
+        *(dptr++) = 'm';    //make dirs in the dir (MKD)
+    if (CheckPermissions(username,dirpath,"dr") != 0)
+        *(fptr++) = 'r';    //download the file (RETR)
+    *fptr = '\0';
+    *dptr = '\0';
+}
+
+    //This function is called in CFtpsXfer and CFtps to build a line for the
+    //MLSD and MLST commands (RFC 3659).
+    //Loads "listline" with the facts of the file followed by "filename".
+    //"perm" is the "perm" fact from GetMLSxPerm().
+char *CSiteInfo::BuildMLSxLine(char *listline, int maxlinesize, char *filename, fsutilsFileInfo_t *finfo, char *perm)
+{
+    CStrUtils strutils;
+    char timestr[32];
+    int len;
+
+    if (listline == NULL || maxlinesize <= 0 || filename == NULL || finfo == NULL)
+        return(listline);
+
+    *listline = '\0';
+
+    GetTimeString(timestr,sizeof(timestr),"%Y%m%d%H%M%S",finfo->timemod,1);
+    if (S_ISDIR(finfo->mode)) {
+        strutils.SNPrintf(listline,maxlinesize,"type=dir;modify=%s;perm=%s;unix.mode=0%lo; ",
+                          timestr,(perm != NULL) ? perm : "",finfo->mode & 07777);
+    } else if (S_ISREG(finfo->mode)) {
+        strutils.SNPrintf(listline,maxlinesize,"type=file;size=%lu;modify=%s;perm=%s;unix.mode=0%lo; ",
+                          finfo->size,timestr,(perm != NULL) ? perm : "",finfo->mode & 07777);
+    } else {    //device, socket, FIFO, ... (RFC 3659 OS-specific type)
+        strutils.SNPrintf(listline,maxlinesize,"type=OS.unix=special;modify=%s;perm=;unix.mode=0%lo; ",
+                          timestr,finfo->mode & 07777);
+    }
+    len = strlen(listline);
+    strncat(listline,filename,maxlinesize-len-1);
 
     return(listline);
 }
 
+    //Returns the cache used for the directory listings
+CDirCache *CSiteInfo::GetDirCache()
+{
+
+    return(&m_dircache);
+}
+
 ////////////////////////////////////////
 // Functions used to handle adding new
 // files to the server.
@@ -684,6 +909,83 @@ int CSiteInfo::GetMaxULSpeed(char *username)
     return(0);  //0 -> no speed limit
 }
 
+    //Returns the bucket that limits the speed of all the user's
+    //downloads (flagupload = 0) or uploads (flagupload = 1) together.
+    //Its rate is set from GetMaxDLSpeed()/GetMaxULSpeed() and its parent
+    //limits the whole site to m_maxdlspeed/m_maxulspeed.
+    //Call ReleaseUserBucket() when the transfer is done.
+CTokenBucket *CSiteInfo::GetUserBucket(char *username, int flagupload)
+{
+    siteinfoUserBucket_t *puserbucket;
+    long maxspeed;
+
+    if (username == NULL)
+        return(NULL);
+
+        //the site limits may have been changed since the last transfer
+    if (flagupload != 0) {
+        m_ulbucket.SetRate(m_maxulspeed);
+        maxspeed = GetMaxULSpeed(username);
+    } else {
+        m_dlbucket.SetRate(m_maxdlspeed);
+        maxspeed = GetMaxDLSpeed(username);
+    }
+
+    m_thr.P(&m_mutexbuckets);
+    for (puserbucket = m_userbuckets; puserbucket != NULL; puserbucket = puserbucket->next) {
+        #ifdef WIN32
+          if (puserbucket->flagupload == flagupload && strcmpi(puserbucket->username,username) == 0)
+        #else
+          if (puserbucket->flagupload == flagupload && strcasecmp(puserbucket->username,username) == 0)
+        #endif
+            break;  //the user already has transfers in this direction
+    }
+    if (puserbucket == NULL) {
+        if ((puserbucket = new siteinfoUserBucket_t) == NULL) {
+            m_thr.V(&m_mutexbuckets);
+            return(NULL);
+        }
+        strncpy(puserbucket->username,username,sizeof(puserbucket->username)-1);
+        puserbucket->username[sizeof(puserbucket->username)-1] = '\0';
+        puserbucket->flagupload = flagupload;
+        puserbucket->nrefs = 0;
+        puserbucket->bucket.SetParent((flagupload != 0) ? &m_ulbucket : &m_dlbucket);
+        puserbucket->next = m_userbuckets;
+        m_userbuckets = puserbucket;
+    }
+    puserbucket->bucket.SetRate(maxspeed);
+    puserbucket->nrefs++;
+    m_thr.V(&m_mutexbuckets);
+
+    return(&(puserbucket->bucket));
+}
+
+    //Releases a bucket returned by GetUserBucket().
+void CSiteInfo::ReleaseUserBucket(CTokenBucket *pbucket)
+{
+    siteinfoUserBucket_t *puserbucket, *prev = NULL;
+
+    if (pbucket == NULL)
+        return;
+
+    m_thr.P(&m_mutexbuckets);
+    for (puserbucket = m_userbuckets; puserbucket != NULL; puserbucket = puserbucket->next) {
+        if (&(puserbucket->bucket) == pbucket) {
+            if (--(puserbucket->nrefs) <= 0) {
+                    //the user's last transfer in this direction is done
+                if (prev == NULL)
+                    m_userbuckets = puserbucket->next;
+                else
+                    prev->next = puserbucket->next;
+                delete puserbucket;
+            }
+            break;
+        }
+        prev = puserbucket;
+    }
+    m_thr.V(&m_mutexbuckets);
+}
+
 
 ////////////////////////////////////////
 // Functions used to update the file
@@ -1043,3 +1345,18 @@ char *CSiteInfo::BuildAccessLogLine(char *date, char *sip, char *sp, char *cip,
 
     return(buffer);
 }
+
+    //Adds a log line to the log queue using the logging level "level"
+    //(SITEINFO_LOGLEVEL*).  Returns 1 on success and 0 if the line was dropped.
+int CSiteInfo::QueueLogLine(int fileid, int level, char *line)
+{
+
+    if (level == SITEINFO_LOGLEVELDISPLAY)
+        return(m_logqueue.Add(fileid,LOG_LEVELDISPLAY,line));
+    else if (level == SITEINFO_LOGLEVELNORMAL)
+        return(m_logqueue.Add(fileid,LOG_LEVELNORMAL,line));
+    else if (level == SITEINFO_LOGLEVELDEBUG)
+        return(m_logqueue.Add(fileid,LOG_LEVELDEBUG,line));
+
+    return(1);
+}
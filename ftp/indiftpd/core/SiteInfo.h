@@ -32,6 +32,10 @@
 
 #include "Thr.h"
 #include "Log.h"
+#include "LogQueue.h"
+#include "TokenBucket.h"
+#include "DirCache.h"
+#include "ThrPool.h"
 
 #ifndef NULL
 #define NULL 0
@@ -39,6 +43,7 @@
 
 #define SITEINFO_MAXPWLINE 64      //max size of a string parameter in the password (passwd) file
 #define SITEINFO_MAXPATH   265     //max size of a path
+#define SITEINFO_MAXMLSXPERM 8    //max size of the "perm" fact of a MLSD/MLST line
 
 #define SITEINFO_ANONYMOUSGROUPNUM 99   //the group number used to specify anonymous (no Password)
 
@@ -96,6 +101,10 @@
 #define SITEINFO_LOGLEVELNORMAL  2  //only write to the log file
 #define SITEINFO_LOGLEVELDEBUG   3  //write to the log and the screen
 
+    //IDs of the log files written through the log queue
+#define SITEINFO_PROGLOGID   0  //program log file
+#define SITEINFO_ACCESSLOGID 1  //access log file
+
 typedef struct {
     char username[SITEINFO_MAXPWLINE];      //client's username
     char passwordraw[SITEINFO_MAXPWLINE];   //raw password (maybe encrypted)
@@ -105,6 +114,15 @@ typedef struct {
     char homedir[SITEINFO_MAXPATH];         //user's home directory
 } siteinfoPWInfo_t;
 
+    //speed limit shared by all the transfers of a user in one direction
+typedef struct _siteinfoUserBucket_t {
+    struct _siteinfoUserBucket_t *next;
+    char username[SITEINFO_MAXPWLINE];  //user the bucket belongs to
+    int flagupload;         //0 = downloads, 1 = uploads
+    int nrefs;              //number of transfers using the bucket
+    CTokenBucket bucket;    //its parent is the site's bucket
+} siteinfoUserBucket_t;
+
     //Global variable used to signal the program to exit
 extern int siteinfoFlagQuit;
 
@@ -140,14 +158,26 @@ public:
     virtual void SetAccessLogFormatStr(char *formatstr);
     virtual int SetAccessLogName(char *logfile, char *basepath = NULL);
     virtual int WriteToAccessLog(char *sip, char *sp, char *cip, char *cp, char *user, char *cmd, char *arg, char *status, char *text);
+    virtual int StartLogQueue(int nrecords, int fullpolicy = LOGQUEUE_FULLBLOCK);
+    virtual void StopLogQueue();
 
         //FTP data connection functions
     virtual int SetDataPortRange(unsigned short startport, unsigned short endport);
     virtual int GetDataPort(char *bindport, int maxportlen, int *sdptr, char *bindip);
     virtual int FreetDataPort(int sd);
+        //threads that run the data transfers (LIST, RETR, STOR, ...)
+    virtual int StartXferPool(int nthreads, int maxqueued, thrpoolWorkerExit_t fworkerexit = NULL);
+    virtual void StopXferPool();
+    virtual int AddXfer(thrpoolWorkerJob_t fptr, void *xferinfo);
 
         //builds a full line for the LIST command
     virtual char *BuildFullListLine(char *listline, int maxlinesize, char *filepath, char *thisyear = NULL);
+    virtual char *BuildFullListLine(char *listline, int maxlinesize, char *filename, fsutilsFileInfo_t *finfo, char *thisyear = NULL);
+        //builds a line for the MLSD/MLST commands
+    virtual void GetMLSxPerm(char *username, char *dirpath, char *fileperm, char *dirperm);
+    virtual char *BuildMLSxLine(char *listline, int maxlinesize, char *filename, fsutilsFileInfo_t *finfo, char *perm);
+        //caches the directory listings and user/group names
+    CDirCache *GetDirCache();
 
         //used to handle added (uploaded) files
     virtual int AddFile(char *filepath, char *username, int size = -1);
@@ -156,6 +186,8 @@ public:
     virtual void SetCurrentXferRate(int userid, long bytespersec);
     virtual int GetMaxDLSpeed(char *username);
     virtual int GetMaxULSpeed(char *username);
+    CTokenBucket *GetUserBucket(char *username, int flagupload);
+    void ReleaseUserBucket(CTokenBucket *pbucket);
 
         //file transfer information functions
     virtual int UpdateDLStats(int userid, char *username, int bytes, int bytespersec);
@@ -192,22 +224,37 @@ public:
         //Used in CFtpsXfer to limit the transfer speed for the site
     long m_maxdlspeed;  //max download speed (bytes/sec)
     long m_maxulspeed;  //max upload speed (bytes/sec)
-    long m_bytessent;   //num bytes sent in the current transfer cycle (downloading)
-    long m_bytesrecv;   //num bytes recv in the current transfer cycle (uploading)
-    unsigned long m_sendtimer;  //used for sending rate timing (downloading)
-    unsigned long m_recvtimer;  //used for receiving rate timing (uploading)
-    thrSync_t m_mutexsend;  //used for synchronization when limiting download speed
-    thrSync_t m_mutexrecv;  //used for synchronization when limiting upload speed
+    long m_maxxferdlspeed;  //max download speed of a single transfer (bytes/sec)
+    long m_maxxferulspeed;  //max upload speed of a single transfer (bytes/sec)
+
+        //Used in CFtps and CFtpsXfer to resume the SSL sessions
+    long m_sslcachesize;    //max number of SSL sessions cached per control connection (0 = none)
+    long m_sslcachettl;     //time (sec) a cached SSL session can be resumed
+    int m_flagsslreuse;     //1 = encrypted PASV data connections must resume the control session
 
 private:
     char *BuildProgLogLine(char *date, char *subsystem, char *message);
     char *BuildAccessLogLine(char *date, char *sip, char *sp, char *cip, char *cp, char *user, char *cmd, char *arg, char *status, char *text);
+    int QueueLogLine(int fileid, int level, char *line);
 
 protected:
     CThr m_thr;         //contains thread and mutex functions
 
     CLog m_proglog;     //program log file
     CLog m_accesslog;   //access log file
+    CLogQueue m_logqueue;   //writes both log files when it is running
+
+        //Transfer speed limits (site -> user -> transfer)
+    CTokenBucket m_dlbucket;    //site download speed (set from m_maxdlspeed)
+    CTokenBucket m_ulbucket;    //site upload speed (set from m_maxulspeed)
+    siteinfoUserBucket_t *m_userbuckets;    //buckets of the users w/ transfers
+    thrSync_t m_mutexbuckets;   //protects m_userbuckets
+
+        //Cached directory names and user/group names for the listings
+    CDirCache m_dircache;
+
+        //Runs the data transfers (each transfer gets its own thread if it is not running)
+    CThrPool m_xferpool;
 
         //The default root directory for the site
     char *m_sitedefroot;
@@ -31,12 +31,17 @@
   #include <sys/time.h>
   #include <sys/socket.h>
   #include <netinet/in.h>
+  #include <netinet/tcp.h>  //for TCP_NODELAY
   #include <arpa/inet.h>
   #include <netdb.h>
   #include <fcntl.h>
   #include <errno.h>
 #endif
 
+#ifdef LINUX
+  #include <sys/sendfile.h>  //for sendfile()
+#endif
+
 #include "Sock.h"
 
 //////////////////////////////////////////////////////////////////////
@@ -214,7 +219,8 @@ SOCKET CSock::OpenServer(const char *portnum, char *bindip /*=NULL*/)
         return(SOCK_INVALID);
     }
 
-    if (listen(sd,5) < 0)  {
+        //a short queue drops connections when many clients connect at once
+    if (listen(sd,SOMAXCONN) < 0)  {
         Close(sd);
         return(SOCK_INVALID);
     }
@@ -684,6 +690,48 @@ int CSock::RecvLn(SOCKET sd, char *ptr, int nmax)
     return(i);
 }
 
+//////////////////////////////////////////////////////////////////////
+// Reads the data that has already arrived on a socket, without
+// waiting for more.
+//
+// [in] sd     : Socket desc to read from.
+// [out] ptr   : Buffer to put the received data into.
+// [in] nbytes : Max size of the "ptr" buffer.
+//
+// Return : On success the number of bytes read is returned.  If no
+//          data is available -1 is returned.  If the connection was
+//          closed or failed 0 is returned.
+//
+int CSock::RecvAvail(SOCKET sd, char *ptr, int nbytes)
+{
+    int nread, err;
+
+    if (sd == SOCK_INVALID || ptr == NULL || nbytes <= 0)
+        return(0);
+
+    #ifdef MSG_DONTWAIT
+      nread = recv(sd,ptr,nbytes,MSG_DONTWAIT);
+    #else
+      if (CheckStatus(sd,0,1) <= 0)
+          return(-1);   //no data is available
+      nread = recv(sd,ptr,nbytes,0);
+    #endif
+
+    if (nread < 0) {
+        err = GetLastError();
+        #ifdef WIN32
+          if (err == WSAEWOULDBLOCK || err == WSAEINTR)
+              return(-1);
+        #else
+          if (err == EAGAIN || err == EWOULDBLOCK || err == EINTR)
+              return(-1);
+        #endif
+        return(0);  //error
+    }
+
+    return(nread);  //0 = EOF
+}
+
 //////////////////////////////////////////////////////////////////////
 // Write "nbytes" bytes to a descriptor.  Use in place of write()
 // when "sd" is a stream socket.
@@ -721,6 +769,97 @@ int CSock::SendN(SOCKET sd, const char *ptr, int nbytes, int flagurgent /*=0*/)
     return(nbytes - nleft);
 }
 
+//////////////////////////////////////////////////////////////////////
+// Sends "nbytes" bytes of a file directly from the kernel's file cache
+// to a socket (no copy through a user space buffer).
+//
+// [in] sd     : Socket desc to write to.
+// [in] fd     : File desc to read from.
+// [in] offset : Offset in the file to start reading at (the file
+//               pointer of "fd" is not moved).
+// [in] nbytes : Max number of bytes to send.
+//
+// Return : On success the number of bytes sent is returned (0 at the
+//          end of the file).  On failure or if zero-copy sends are not
+//          supported -1 is returned.
+//
+long CSock::SendFile(SOCKET sd, int fd, long offset, long nbytes)
+{
+#ifdef LINUX
+    off_t off;
+    ssize_t nwritten;
+    long nleft;
+
+    if (sd == SOCK_INVALID || fd < 0 || nbytes <= 0)
+        return(-1);
+
+    off = (off_t)offset;
+    nleft = nbytes;
+    while (nleft > 0) {
+        if ((nwritten = sendfile(sd,fd,&off,nleft)) < 0) {
+            if (errno == EINTR)
+                continue;
+            return(-1);     // error
+        } else if (nwritten == 0) {
+            break;          // end of file
+        }
+        nleft -= nwritten;
+    }
+
+    return(nbytes - nleft);
+#else
+    return(-1);
+#endif
+}
+
+//////////////////////////////////////////////////////////////////////
+// Moves the data that is available on a socket into a file without
+// copying it through a user space buffer.  The data is spliced from
+// the socket into "pipefd" and from the pipe into the file.
+//
+// [in] sd     : Socket desc to read from.
+// [in] fd     : File desc to write to (must not be in append mode).
+// [in] pipefd : Pipe used to hold the data (pipefd[0] = read end,
+//               pipefd[1] = write end).  The pipe is empty on return.
+// [in] nbytes : Max number of bytes to receive.
+//
+// Return : On success the number of bytes written to the file is
+//          returned (0 if the connection was closed).  On failure or
+//          if zero-copy receives are not supported -1 is returned.
+//
+long CSock::RecvFile(SOCKET sd, int fd, int *pipefd, long nbytes)
+{
+#ifdef LINUX
+    ssize_t nread, nwritten;
+    long nleft;
+
+    if (sd == SOCK_INVALID || fd < 0 || pipefd == NULL || nbytes <= 0)
+        return(-1);
+
+    while ((nread = splice(sd,NULL,pipefd[1],NULL,nbytes,SPLICE_F_MOVE | SPLICE_F_MORE)) < 0) {
+        if (errno != EINTR)
+            return(-1);     // error
+    }
+
+        //write everything that was put in the pipe to the file
+    nleft = nread;
+    while (nleft > 0) {
+        if ((nwritten = splice(pipefd[0],NULL,fd,NULL,nleft,SPLICE_F_MOVE | SPLICE_F_MORE)) < 0) {
+            if (errno == EINTR)
+                continue;
+            return(-1);     // error
+        } else if (nwritten == 0) {
+            return(-1);     // the file can not grow
+        }
+        nleft -= nwritten;
+    }
+
+    return(nread);  //0 = EOF
+#else
+    return(-1);
+#endif
+}
+
 //////////////////////////////////////////////////////////////////////
 // Write until '\n' is found (inserts a '\n' if necessary).
 //
@@ -785,6 +924,27 @@ int CSock::SetKeepAlive(SOCKET sd)
         return(0);
 }
 
+//////////////////////////////////////////////////////////////////////
+// Sets TCP_NODELAY on the socket -- so short replies (Ex. a "226" right
+// after a "150") are not held back waiting for the peer's delayed ACK.
+//
+// [in] sd : Socket desc to set the option on.
+//
+// Return : On success 1 is returned.  On failure 0 is returned.
+//
+int CSock::SetNoDelay(SOCKET sd)
+{
+    int ret;
+    int val = 1;
+
+    ret = setsockopt(sd,IPPROTO_TCP,TCP_NODELAY,(char *)&val,sizeof(int));
+
+    if (ret == 0)
+        return(1);
+    else
+        return(0);
+}
+
 //////////////////////////////////////////////////////////////////////
 // Sets the max time a socket will block when receiving.
 //
@@ -81,11 +81,15 @@ public:
         //Functions for transfering data
     int RecvN(SOCKET sd, char *ptr, int nbytes);
     int RecvLn(SOCKET sd, char *ptr, int nmax);
+    int RecvAvail(SOCKET sd, char *ptr, int nbytes);
     int SendN(SOCKET sd, const char *ptr, int nbytes, int flagurgent = 0);
     int SendLn(SOCKET sd, const char *ptr, int flagurgent = 0);
+    long SendFile(SOCKET sd, int fd, long offset, long nbytes);
+    long RecvFile(SOCKET sd, int fd, int *pipefd, long nbytes);
 
         //Functions for setting socket options
     int SetKeepAlive(SOCKET sd);
+    int SetNoDelay(SOCKET sd);
     int SetTimeout(SOCKET sd, int timeoutms);
     int CheckStatus(SOCKET sd, int nsec, int nmsec = 0);
     int SetRecvOOB(SOCKET sd);
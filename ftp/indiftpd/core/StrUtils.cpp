@@ -427,6 +427,58 @@ char *CStrUtils::BuildFormattedString(const char *format, const char *specifiers
     return(buffer);
 }
 
+//////////////////////////////////////////////////////////////////////
+// Same as the function above except the expanded string is written
+// into "buffer" instead of a dynamically allocated buffer.  If the
+// expanded string is too long it is cut to fit in "buffer."
+//
+// [out] buffer     : Stores the format string with all the expanded
+//                    specifiers.
+// [in]  maxsize    : Maximum length string "buffer" can hold.
+// [in]  format     : Format string.
+// [in]  specifiers : String containing the specifier characters.
+// [in]  values     : Array of strings used to substitute for the
+//                    corresponding specifiers.
+// [in]  nparams    : Number of elements in "specifiers" or "values"
+// [in]  escchar    : Escape character used to indicate a specifier.
+//
+// Return : The length of the string written to "buffer".  On failure
+//          -1 is returned.
+//
+int CStrUtils::BuildFormattedString(char *buffer, int maxsize, const char *format, const char *specifiers, char *values[], int nparams, char escchar /*='%'*/)
+{
+    const char *ptr, *vptr;
+    int i, len;
+
+    if (buffer == NULL || maxsize <= 0 || format == NULL || specifiers == NULL || values == NULL || nparams == 0)
+        return(-1);
+
+    len = 0;
+    for (ptr = format; *ptr != '\0' && len < maxsize-1; ptr++) {
+        if (*ptr == escchar) {
+            ptr++;  //move to the next character
+            if (*ptr == '\0')
+                break;  //reached the end of the string
+            if (*ptr == escchar) {
+                buffer[len++] = escchar;    //Ex. found "%%" -> print just "%"
+            } else {
+                    //lookup the value for the specifier
+                for (i = 0; i < nparams; i++) {
+                    if (*ptr == specifiers[i]) {
+                        for (vptr = values[i]; *vptr != '\0' && len < maxsize-1; vptr++)
+                            buffer[len++] = *vptr;  //fill in the value
+                    }
+                }
+            }
+        } else {
+            buffer[len++] = *ptr;
+        }
+    }
+    buffer[len] = '\0';
+
+    return(len);
+}
+
 //////////////////////////////////////////////////////////////////////
 // Checks if "filename" is contained in the "wildcard" string.  The
 // wildcard character is '*'.
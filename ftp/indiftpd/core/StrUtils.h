@@ -40,6 +40,7 @@ public:
     char *RemoveComments(char *line, const char *commentstr);
     char *GetStrHidden(char *buffer, int maxbuffersize);
     char *BuildFormattedString(const char *format, const char *specifiers, char *values[], int nparams, char escchar = '%');
+    int BuildFormattedString(char *buffer, int maxsize, const char *format, const char *specifiers, char *values[], int nparams, char escchar = '%');
     int MatchWildcard(const char *wildcard, const char *filename);
     int SNPrintf(char *buffer, unsigned int size, const char *format, ...);
     char *CheckQuotedString(char *buffer);
@@ -127,6 +127,8 @@ int CTermsrv::GetUseSSL()
 //                        prefix code)
 //                 i = 2: the line is an intermediate line (without
 //                        prefix code)
+//                 i = 3: the line is an intermediate line (sent as
+//                        it is)
 //
 // Return : On success 1 is returned.  On failure 0 is returned.
 //
@@ -139,7 +141,7 @@ int CTermsrv::ResponseSend(const char *response, const char *code, int i /*=0*/)
     if ((m_flagssl == 0 && m_sd == SOCK_INVALID) || (m_flagssl != 0 && m_sslinfo.ssl == NULL))
         return(0);
 
-    if (i != 2) {
+    if (i != 2 && i != 3) {
         if (strlen(code) != 3)  //the code must be 3 characters
             return(0);
     }
@@ -157,6 +159,8 @@ int CTermsrv::ResponseSend(const char *response, const char *code, int i /*=0*/)
         sprintf(line,"%s-%s",code,response);
     else if (i == 2)
         sprintf(line,"    %s",response);
+    else if (i == 3)
+        sprintf(line,"%s",response);
     else
         sprintf(line,"%s %s",code,response);
 
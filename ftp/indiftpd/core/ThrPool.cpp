@@ -0,0 +1,313 @@
+// Copyright (C) 2026 The indiftpd contributors
+//
+// This program is free software; you can redistribute it and/or
+// modify it under the terms of the GNU General Public License
+// as published by the Free Software Foundation; either version 2
+// of the License, or (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program; if not, write to the Free Software
+// Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.
+//
+//
+// ThrPool.cpp: implementation of the CThrPool class.
+//
+//////////////////////////////////////////////////////////////////////
+#include <stdlib.h>
+
+#include "ThrPool.h"
+#include "Timer.h"
+
+//////////////////////////////////////////////////////////////////////
+// Construction/Destruction
+//////////////////////////////////////////////////////////////////////
+
+CThrPool::CThrPool()
+{
+
+    m_jobs = NULL;
+    m_maxjobs = m_firstjob = m_numjobs = 0;
+    m_numthreads = 0;
+    m_flagstop = 1;     //not started
+    m_fworkerexit = NULL;
+
+    m_thr.InitializeCritSec(&m_mutex);
+    #ifdef WIN32
+      m_semjobs = NULL;
+    #else
+      pthread_cond_init(&m_condjobs,NULL);
+    #endif
+}
+
+CThrPool::~CThrPool()
+{
+
+    Stop();
+
+    m_thr.DestroyCritSec(&m_mutex);
+    #ifndef WIN32
+      pthread_cond_destroy(&m_condjobs);
+    #endif
+}
+
+//////////////////////////////////////////////////////////////////////
+// Public Methods
+//////////////////////////////////////////////////////////////////////
+
+//////////////////////////////////////////////////////////////////////
+// Starts the worker threads.
+//
+// [in] nthreads    : Number of worker threads.
+// [in] maxjobs     : Max number of jobs that can wait in the queue.
+// [in] fworkerexit : Frees the data a worker kept for its jobs
+//                    (see thrpoolWorkerJob_t) when the worker exits.
+//
+// Return : On success 1 is returned.  On failure 0 is returned.
+//
+int CThrPool::Start(int nthreads, int maxjobs, thrpoolWorkerExit_t fworkerexit /*=NULL*/)
+{
+    int i;
+
+    if (nthreads <= 0 || maxjobs <= 0 || m_jobs != NULL)
+        return(0);
+
+    if ((m_jobs = (thrpoolJobInfo_t *)calloc(maxjobs,sizeof(thrpoolJobInfo_t))) == NULL)
+        return(0);
+    #ifdef WIN32
+      if ((m_semjobs = CreateSemaphore(NULL,0,maxjobs,NULL)) == NULL) {
+          free(m_jobs); m_jobs = NULL;
+          return(0);
+      }
+    #endif
+    m_maxjobs = maxjobs;
+    m_firstjob = m_numjobs = 0;
+    m_flagstop = 0;
+    m_fworkerexit = fworkerexit;
+
+    for (i = 0; i < nthreads; i++) {
+        m_thr.P(&m_mutex);
+        m_numthreads++;
+        m_thr.V(&m_mutex);
+        if (m_thr.Create(WorkerThread,(void *)this) == 0) {
+            m_thr.P(&m_mutex);
+            m_numthreads--;
+            m_thr.V(&m_mutex);
+            break;
+        }
+    }
+
+    if (i == 0) {   //no worker threads could be created
+        Stop();
+        return(0);
+    }
+
+    return(1);
+}
+
+//////////////////////////////////////////////////////////////////////
+// Stops the worker threads.  Jobs already in the queue are run
+// before the threads exit.
+//
+// Return : VOID
+//
+void CThrPool::Stop()
+{
+    CTimer timer;
+
+    if (m_jobs == NULL)
+        return;
+
+    m_thr.P(&m_mutex);
+    m_flagstop = 1;
+    #ifndef WIN32
+      pthread_cond_broadcast(&m_condjobs);  //wake up the idle workers
+    #endif
+    m_thr.V(&m_mutex);
+
+        //wait for all the worker threads to exit
+    while (GetNumThreads() > 0) timer.Sleep(50);
+
+    #ifdef WIN32
+      CloseHandle(m_semjobs);
+      m_semjobs = NULL;
+    #endif
+    free(m_jobs);
+    m_jobs = NULL;
+    m_maxjobs = m_firstjob = m_numjobs = 0;
+}
+
+//////////////////////////////////////////////////////////////////////
+// Queues a job to be run by one of the worker threads.
+//
+// [in] fptr : Function to run.
+// [in] arg  : Argument passed to the function.
+//
+// Return : On success 1 is returned.  If the pool is not running or
+//          the queue is full 0 is returned (the caller should then
+//          run the job itself).
+//
+int CThrPool::Submit(thrpoolJob_t fptr, void *arg)
+{
+
+    if (fptr == NULL)
+        return(0);
+
+    return(AddJob(fptr,NULL,arg));
+}
+
+//////////////////////////////////////////////////////////////////////
+// Queues a job that uses data kept by the worker thread that runs it
+// (Ex. buffers that are reused by all the jobs a worker runs).
+//
+// [in] wfptr : Function to run.
+// [in] arg   : Argument passed to the function.
+//
+// Return : On success 1 is returned.  If the pool is not running or
+//          the queue is full 0 is returned.
+//
+int CThrPool::Submit(thrpoolWorkerJob_t wfptr, void *arg)
+{
+
+    if (wfptr == NULL)
+        return(0);
+
+    return(AddJob(NULL,wfptr,arg));
+}
+
+//////////////////////////////////////////////////////////////////////
+// Get the number of running worker threads.
+//
+int CThrPool::GetNumThreads()
+{
+    int numthreads;
+
+    m_thr.P(&m_mutex);
+    numthreads = m_numthreads;
+    m_thr.V(&m_mutex);
+
+    return(numthreads);
+}
+
+//////////////////////////////////////////////////////////////////////
+// Get the number of jobs waiting in the queue.
+//
+int CThrPool::GetNumJobs()
+{
+    int numjobs;
+
+    m_thr.P(&m_mutex);
+    numjobs = m_numjobs;
+    m_thr.V(&m_mutex);
+
+    return(numjobs);
+}
+
+//////////////////////////////////////////////////////////////////////
+// Private Methods
+//////////////////////////////////////////////////////////////////////
+
+//////////////////////////////////////////////////////////////////////
+// Adds a job to the queue and wakes up a worker.
+//
+// Return : 1 if the job was queued.  0 if the pool is not running or
+//          the queue is full.
+//
+int CThrPool::AddJob(thrpoolJob_t fptr, thrpoolWorkerJob_t wfptr, void *arg)
+{
+    thrpoolJobInfo_t *job;
+    int retval = 0;
+
+    m_thr.P(&m_mutex);
+    if (m_flagstop == 0 && m_numjobs < m_maxjobs) {
+        job = &m_jobs[(m_firstjob + m_numjobs) % m_maxjobs];
+        job->fptr = fptr;
+        job->wfptr = wfptr;
+        job->arg = arg;
+        m_numjobs++;
+        #ifdef WIN32
+          ReleaseSemaphore(m_semjobs,1,NULL);
+        #else
+          pthread_cond_signal(&m_condjobs);
+        #endif
+        retval = 1;
+    }
+    m_thr.V(&m_mutex);
+
+    return(retval);
+}
+
+//////////////////////////////////////////////////////////////////////
+// Waits for a job and removes it from the queue.
+//
+// [out] job : The job to run.
+//
+// Return : 1 if a job was returned.  0 if the worker should exit.
+//
+int CThrPool::GetJob(thrpoolJobInfo_t *job)
+{
+    int retval = 0;
+
+    #ifdef WIN32
+      while (WaitForSingleObject(m_semjobs,1000) == WAIT_TIMEOUT) {
+          m_thr.P(&m_mutex);
+          if (m_flagstop != 0 && m_numjobs == 0) {
+              m_thr.V(&m_mutex);
+              return(0);
+          }
+          m_thr.V(&m_mutex);
+      }
+      m_thr.P(&m_mutex);
+    #else
+      m_thr.P(&m_mutex);
+      while (m_numjobs == 0 && m_flagstop == 0)
+          pthread_cond_wait(&m_condjobs,&m_mutex);
+    #endif
+
+    if (m_numjobs > 0) {
+        *job = m_jobs[m_firstjob];
+        m_firstjob = (m_firstjob + 1) % m_maxjobs;
+        m_numjobs--;
+        retval = 1;
+    }
+    m_thr.V(&m_mutex);
+
+    return(retval);
+}
+
+//////////////////////////////////////////////////////////////////////
+// Worker thread.  Runs jobs until Stop() is called and the queue
+// is empty.
+//
+#ifdef WIN32
+  void CThrPool::WorkerThread(void *vppool)
+#else
+  void *CThrPool::WorkerThread(void *vppool)
+#endif
+{
+    CThrPool *ppool = (CThrPool *)vppool;
+    thrpoolJobInfo_t job;
+    void *workerdata = NULL;    //data kept for the thrpoolWorkerJob_t jobs
+
+    while (ppool->GetJob(&job) != 0) {
+        if (job.fptr != NULL)
+            (*job.fptr)(job.arg);
+        else
+            (*job.wfptr)(job.arg,&workerdata);
+    }
+
+    if (workerdata != NULL && ppool->m_fworkerexit != NULL)
+        (*ppool->m_fworkerexit)(workerdata);
+
+    ppool->m_thr.P(&ppool->m_mutex);
+    ppool->m_numthreads--;
+    ppool->m_thr.V(&ppool->m_mutex);
+
+    #ifndef WIN32
+      return(NULL);     //UNIX must return a value
+    #endif
+}
@@ -0,0 +1,90 @@
+// Copyright (C) 2026 The indiftpd contributors
+//
+// This program is free software; you can redistribute it and/or
+// modify it under the terms of the GNU General Public License
+// as published by the Free Software Foundation; either version 2
+// of the License, or (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program; if not, write to the Free Software
+// Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.
+//
+//
+// ThrPool.h: interface for the CThrPool class.
+//
+//////////////////////////////////////////////////////////////////////
+#ifndef THRPOOL_H
+#define THRPOOL_H
+
+#include "Thr.h"
+
+    //function run by a worker thread for each job
+typedef void (*thrpoolJob_t)(void *arg);
+    //function run for a job that uses data kept by the worker thread
+    //(*workerdata is NULL for the first job a worker runs)
+typedef void (*thrpoolWorkerJob_t)(void *arg, void **workerdata);
+    //frees the data kept by a worker thread when it exits
+typedef void (*thrpoolWorkerExit_t)(void *workerdata);
+
+    //job waiting in the queue
+typedef struct {
+    thrpoolJob_t fptr;  //function to run (or NULL to run wfptr)
+    thrpoolWorkerJob_t wfptr;   //function to run w/ the worker's data
+    void *arg;          //argument passed to fptr or wfptr
+} thrpoolJobInfo_t;
+
+
+///////////////////////////////////////////////////////////////////////////////
+// Fixed set of worker threads that run jobs from a bounded queue
+///////////////////////////////////////////////////////////////////////////////
+
+class CThrPool
+{
+public:
+    CThrPool();
+    virtual ~CThrPool();
+
+    int Start(int nthreads, int maxjobs, thrpoolWorkerExit_t fworkerexit = NULL);
+    void Stop();
+
+    int Submit(thrpoolJob_t fptr, void *arg);
+    int Submit(thrpoolWorkerJob_t wfptr, void *arg);
+
+    int GetNumThreads();
+    int GetNumJobs();
+
+private:
+    #ifdef WIN32
+      static void WorkerThread(void *vppool);   //WINDOWS must return "void"
+    #else
+      static void *WorkerThread(void *vppool);  //UNIX must return "void *"
+    #endif
+    int GetJob(thrpoolJobInfo_t *job);
+    int AddJob(thrpoolJob_t fptr, thrpoolWorkerJob_t wfptr, void *arg);
+
+private:
+    CThr m_thr;             //thread functions
+
+    thrSync_t m_mutex;      //protects the job queue and the counters
+    #ifdef WIN32
+      HANDLE m_semjobs;     //counts the jobs in the queue
+    #else
+      pthread_cond_t m_condjobs;    //signaled when a job is queued or on Stop()
+    #endif
+
+    thrpoolJobInfo_t *m_jobs;   //circular job queue
+    int m_maxjobs;          //size of m_jobs
+    int m_firstjob;         //index of the oldest job in m_jobs
+    int m_numjobs;          //number of jobs in m_jobs
+
+    int m_numthreads;       //number of running worker threads
+    int m_flagstop;         //if m_flagstop != 0, the workers exit once the queue is empty
+    thrpoolWorkerExit_t m_fworkerexit;  //frees the data kept by a worker (NULL = none)
+};
+
+#endif //THRPOOL_H
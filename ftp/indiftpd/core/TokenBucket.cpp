@@ -0,0 +1,251 @@
+// Copyright (C) 2026 The indiftpd contributors
+//
+// This program is free software; you can redistribute it and/or
+// modify it under the terms of the GNU General Public License
+// as published by the Free Software Foundation; either version 2
+// of the License, or (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program; if not, write to the Free Software
+// Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.
+//
+//
+// TokenBucket.cpp: implementation of the CTokenBucket class.
+//
+// Instead of a count of tokens that is refilled by a timer, a bucket
+// stores the time at which the bytes taken so far are paid for.
+// Taking bytes moves this time forward by (bytes / rate) with a single
+// compare-and-swap, so the refill is part of the same atomic update.
+// The caller is told how long to wait before using the bytes, which
+// spaces the bytes of every transfer evenly instead of sending a whole
+// interval's worth at once and then stopping.
+//
+//////////////////////////////////////////////////////////////////////
+#include <stdlib.h>
+
+#ifndef WIN32
+  #include <time.h>
+  #include <sys/time.h>
+#endif
+
+#include "TokenBucket.h"
+
+    //atomic operations on the paid time
+#ifdef WIN32
+  #define TOKENBUCKET_CAS(ptr,oldval,newval) (InterlockedCompareExchange64((volatile LONGLONG *)(ptr),(LONGLONG)(newval),(LONGLONG)(oldval)) == (LONGLONG)(oldval))
+#else
+  #define TOKENBUCKET_CAS(ptr,oldval,newval) __sync_bool_compare_and_swap((ptr),(oldval),(newval))
+#endif
+
+//////////////////////////////////////////////////////////////////////
+// Construction/Destruction
+//////////////////////////////////////////////////////////////////////
+
+//////////////////////////////////////////////////////////////////////
+// Constructor for the CTokenBucket class.
+//
+// [in] parent : Bucket the bytes are also taken from (NULL = none).
+//
+CTokenBucket::CTokenBucket(CTokenBucket *parent /*=NULL*/)
+{
+
+    m_parent = parent;
+    m_rate = 0;
+    m_burst = TOKENBUCKET_MINBURST;
+    m_paidtime = 0;
+}
+
+CTokenBucket::~CTokenBucket()
+{
+
+}
+
+//////////////////////////////////////////////////////////////////////
+// Public Methods
+//////////////////////////////////////////////////////////////////////
+
+//////////////////////////////////////////////////////////////////////
+// Sets the bucket the bytes are also taken from.
+//
+// [in] parent : Parent bucket (NULL = none).
+//
+// Return : VOID
+//
+// NOTE: Must not be called while bytes are being taken from the bucket.
+//
+void CTokenBucket::SetParent(CTokenBucket *parent)
+{
+
+    m_parent = parent;
+}
+
+//////////////////////////////////////////////////////////////////////
+// Sets the rate of the bucket.  If the rate is changed, the bucket
+// starts over full.
+//
+// [in] bytespersec : Max rate (bytes/sec).  0 = no limit.
+// [in] burst       : Max number of bytes taken at once w/o waiting.
+//                    0 = TOKENBUCKET_BURSTMSEC worth of data (at least
+//                    TOKENBUCKET_MINBURST bytes).
+//
+// Return : VOID
+//
+void CTokenBucket::SetRate(long bytespersec, long burst /*=0*/)
+{
+
+    if (bytespersec < 0)
+        bytespersec = 0;
+
+    if (burst <= 0) {
+        burst = (long)((double)bytespersec * TOKENBUCKET_BURSTMSEC / 1000);
+        if (burst < TOKENBUCKET_MINBURST)
+            burst = TOKENBUCKET_MINBURST;
+    }
+    m_burst = burst;
+
+    if (bytespersec != m_rate) {
+        m_paidtime = 0;
+        m_rate = bytespersec;
+    }
+}
+
+//////////////////////////////////////////////////////////////////////
+// Returns the rate of the bucket (bytes/sec).  0 = no limit.
+//
+long CTokenBucket::GetRate()
+{
+
+    return(m_rate);
+}
+
+//////////////////////////////////////////////////////////////////////
+// Checks if the bucket or any of its parents limits the rate.
+//
+// Return : 1 if there is a limit, 0 otherwise.
+//
+int CTokenBucket::IsLimited()
+{
+    CTokenBucket *pbucket;
+
+    for (pbucket = this; pbucket != NULL; pbucket = pbucket->m_parent) {
+        if (pbucket->m_rate > 0)
+            return(1);
+    }
+
+    return(0);
+}
+
+//////////////////////////////////////////////////////////////////////
+// Takes up to "nbytes" bytes from the bucket and all of its parents.
+// No more than the smallest burst of the buckets is taken at once.
+//
+// [in]  nbytes    : Number of bytes wanted.
+// [out] pwaitmsec : Time to wait before using the bytes (msec).
+//
+// Return : The number of bytes taken.
+//
+// NOTE: Give back the bytes that are not used with Return().
+//
+long CTokenBucket::Take(long nbytes, unsigned long *pwaitmsec)
+{
+    CTokenBucket *pbucket;
+    tokenbucketTime_t now, wait, maxwait = 0;
+
+    for (pbucket = this; pbucket != NULL; pbucket = pbucket->m_parent) {
+        if (pbucket->m_rate > 0 && nbytes > pbucket->m_burst)
+            nbytes = pbucket->m_burst;
+    }
+
+    now = GetTimeUSec();
+    for (pbucket = this; pbucket != NULL; pbucket = pbucket->m_parent) {
+        if ((wait = pbucket->Reserve(nbytes,now)) > maxwait)
+            maxwait = wait;
+    }
+
+    if (pwaitmsec != NULL)
+        *pwaitmsec = (unsigned long)((maxwait + 999) / 1000);
+
+    return(nbytes);
+}
+
+//////////////////////////////////////////////////////////////////////
+// Gives back bytes that were taken with Take() but were not used.
+//
+// [in] nbytes : Number of bytes that were not used.
+//
+// Return : VOID
+//
+void CTokenBucket::Return(long nbytes)
+{
+    CTokenBucket *pbucket;
+
+    if (nbytes <= 0)
+        return;
+
+    for (pbucket = this; pbucket != NULL; pbucket = pbucket->m_parent)
+        pbucket->Reserve(-nbytes,0);
+}
+
+//////////////////////////////////////////////////////////////////////
+// Returns the current time (usec) from a clock that is not changed
+// with the time of day.
+//
+tokenbucketTime_t CTokenBucket::GetTimeUSec()
+{
+
+    #ifdef WIN32
+      LARGE_INTEGER count, freq;
+
+      QueryPerformanceCounter(&count);
+      QueryPerformanceFrequency(&freq);
+      return((tokenbucketTime_t)((double)count.QuadPart * 1000000.0 / (double)freq.QuadPart));
+    #else
+      #ifdef CLOCK_MONOTONIC
+        struct timespec ts;
+
+        if (clock_gettime(CLOCK_MONOTONIC,&ts) == 0)
+            return((tokenbucketTime_t)ts.tv_sec * 1000000 + ts.tv_nsec / 1000);
+      #endif
+      struct timeval tv;
+
+      gettimeofday(&tv,NULL);
+      return((tokenbucketTime_t)tv.tv_sec * 1000000 + tv.tv_usec);
+    #endif
+}
+
+//////////////////////////////////////////////////////////////////////
+// Private Methods
+//////////////////////////////////////////////////////////////////////
+
+//////////////////////////////////////////////////////////////////////
+// Pays for "nbytes" bytes (a negative value gives bytes back).
+//
+// [in] nbytes : Number of bytes.
+// [in] now    : Current time (usec).
+//
+// Return : Time to wait before the bytes may be used (usec).
+//
+tokenbucketTime_t CTokenBucket::Reserve(long nbytes, tokenbucketTime_t now)
+{
+    tokenbucketTime_t paidtime, newpaidtime, cost, bursttime;
+    long rate = m_rate;
+
+    if (rate <= 0)
+        return(0);  //no limit
+
+    cost = (tokenbucketTime_t)nbytes * 1000000 / rate;
+    bursttime = (tokenbucketTime_t)m_burst * 1000000 / rate;
+
+        //bytes not taken since "paidtime" refill the bucket (up to the burst)
+    do {
+        paidtime = m_paidtime;
+        newpaidtime = ((paidtime > now) ? paidtime : now) + cost;
+    } while (TOKENBUCKET_CAS(&m_paidtime,paidtime,newpaidtime) == 0);
+
+    return((newpaidtime - bursttime > now) ? (newpaidtime - bursttime - now) : 0);
+}
@@ -0,0 +1,75 @@
+// Copyright (C) 2026 The indiftpd contributors
+//
+// This program is free software; you can redistribute it and/or
+// modify it under the terms of the GNU General Public License
+// as published by the Free Software Foundation; either version 2
+// of the License, or (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program; if not, write to the Free Software
+// Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.
+//
+//
+// TokenBucket.h: interface for the CTokenBucket class.
+//
+//////////////////////////////////////////////////////////////////////
+#ifndef TOKENBUCKET_H
+#define TOKENBUCKET_H
+
+#include "Thr.h"
+
+#define TOKENBUCKET_BURSTMSEC 100   //default burst (as msec of data at the bucket's rate)
+#define TOKENBUCKET_MINBURST  4096  //min burst (bytes)
+
+    //time in microseconds
+#ifdef WIN32
+  typedef __int64 tokenbucketTime_t;
+#else
+  typedef long long tokenbucketTime_t;
+#endif
+
+
+///////////////////////////////////////////////////////////////////////////////
+// Limits the rate at which bytes are taken from a bucket and from all of
+// its parents (Ex. site -> user -> transfer).  A bucket with a rate of 0
+// does not limit anything.  Any number of threads may take from the same
+// bucket at once (the bucket is updated with atomic operations).
+///////////////////////////////////////////////////////////////////////////////
+
+class CTokenBucket
+{
+public:
+    CTokenBucket(CTokenBucket *parent = NULL);
+    virtual ~CTokenBucket();
+
+    void SetParent(CTokenBucket *parent);
+    void SetRate(long bytespersec, long burst = 0);
+    long GetRate();
+    int IsLimited();
+
+    long Take(long nbytes, unsigned long *pwaitmsec);
+    void Return(long nbytes);
+
+    static tokenbucketTime_t GetTimeUSec();
+
+private:
+    tokenbucketTime_t Reserve(long nbytes, tokenbucketTime_t now);
+
+private:
+    CTokenBucket *m_parent; //bucket the bytes are also taken from (NULL = none)
+
+    volatile long m_rate;   //bytes per second (0 = no limit)
+    volatile long m_burst;  //max bytes that can be taken at once w/o waiting
+
+        //Time at which all the bytes taken so far have been paid for at
+        //"m_rate".  Bytes may be used once this is no more than the burst
+        //time ahead of the current time.
+    volatile tokenbucketTime_t m_paidtime;
+};
+
+#endif //TOKENBUCKET_H
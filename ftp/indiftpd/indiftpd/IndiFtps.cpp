@@ -24,9 +24,30 @@
 #include <stdlib.h>
 
 #include "../core/StrUtils.h"
+#include "../core/ThrPool.h"
+#include "../core/Timer.h"
 #include "IndiFtps.h"
 #include "IndiSiteInfo.h"
 
+    //shared by the files copied by a SITE COPY/MOVE
+typedef struct {
+    CThr thr;
+    thrSync_t mutex;    //protects ndone and ncopied
+    int ndone;          //number of files done (copied or failed)
+    int ncopied;        //number of files copied
+} _CopyRun_t;
+
+    //file copied (or moved) by a copy thread
+typedef struct {
+    fsutilsCopyFile_t *pfile;   //file to copy
+    int flagmove;       //1 = move the file
+    long nbytes;        //bytes copied so far (read for the progress lines)
+    _CopyRun_t *prun;
+} _CopyJob_t;
+
+static void _copyjob(void *vpjob);
+static int _issubpath(const char *path, const char *dirpath);
+
 
 //////////////////////////////////////////////////////////////////////
 // Construction/Destruction
@@ -69,6 +90,22 @@ int CIndiFtps::DoSITE(int argc, char **argv)
 
     switch (*(argv[1])) {
 
+        case 'C': case 'c': {
+            if (strutils.CaseCmp(argv[1],"COPY") == 0) {
+                retval = DoSiteCOPY(argc,argv);
+            } else {
+                DefaultResp(argc,argv);
+            }
+        } break;
+
+        case 'M': case 'm': {
+            if (strutils.CaseCmp(argv[1],"MOVE") == 0) {
+                retval = DoSiteMOVE(argc,argv);
+            } else {
+                DefaultResp(argc,argv);
+            }
+        } break;
+
         case 'V': case 'v': {
             if (strutils.CaseCmp(argv[1],"VERS") == 0) {
                 retval = DoSiteVERS(argc,argv);
@@ -113,7 +150,224 @@ int CIndiFtps::DoSiteVERS(int argc, char **argv)
     return(1);
 }
 
+    //SITE COPY <from> <to> -- copies files or directory trees on the server
+    //(see CFSUtils::CopyFiles())
+int CIndiFtps::DoSiteCOPY(int argc, char **argv)
+{
+    CFSUtils fsutils;
+    fsutilsCopyList_t copylist;
+    char *inpath, *outpath;
+    int retval = 0;
+
+    if (argc != 4) {
+        EventHandler(argc,argv,"'SITE COPY': Invalid number of parameters (SITE COPY <from> <to>).","501",1,1,0);
+        return(0);
+    }
+
+        //check the user's permissions for the paths
+    if (CheckPermissions("SITE",argv[2],"dr",1) == 0 || CheckPermissions("SITE",argv[3],"uw",1) == 0)
+        return(0);
+
+    inpath = fsutils.BuildPath(m_userroot,m_cwd,argv[2]);
+    outpath = fsutils.BuildPath(m_userroot,m_cwd,argv[3]);
+    if (inpath == NULL || outpath == NULL) {
+        EventHandler(argc,argv,"ERROR: unable to set file path.","550",1,1,0);
+        if (inpath != NULL) fsutils.FreePath(inpath);
+        if (outpath != NULL) fsutils.FreePath(outpath);
+        return(0);
+    }
+
+    fsutils.RemoveSlashEnd(inpath);
+    fsutils.RemoveSlashEnd(outpath);
+
+        //list the files to copy (creates the output directories)
+    memset(&copylist,0,sizeof(copylist));
+    if (fsutils.ValidatePath(inpath) == 1 && _issubpath(outpath,inpath) != 0) {
+        WriteToLineBuffer("%s: Cannot copy a directory into itself.",argv[2]);
+        EventHandler(argc,argv,m_linebuffer,"550",1,1,0);
+    } else if (fsutils.CopyFiles(inpath,outpath,&copylist) > 0) {
+        retval = RunCopyList(argc,argv,&copylist,0);
+    } else {
+        WriteToLineBuffer("%s: No files to copy.",argv[2]);
+        EventHandler(argc,argv,m_linebuffer,"550",1,1,0);
+    }
+    fsutils.FreeCopyList(&copylist);
+
+    fsutils.FreePath(outpath);
+    fsutils.FreePath(inpath);
+    return(retval);
+}
+
+    //SITE MOVE <from> <to> -- renames a file or directory, or moves the
+    //files to another file system (copies and deletes them)
+int CIndiFtps::DoSiteMOVE(int argc, char **argv)
+{
+    CFSUtils fsutils;
+    fsutilsCopyList_t copylist;
+    char *inpath, *outpath;
+    int type, retval = 0;
+
+    if (argc != 4) {
+        EventHandler(argc,argv,"'SITE MOVE': Invalid number of parameters (SITE MOVE <from> <to>).","501",1,1,0);
+        return(0);
+    }
+
+        //check the user's permissions for the paths
+    if (CheckPermissions("SITE",argv[2],"wa",1) == 0 || CheckPermissions("SITE",argv[3],"wa",1) == 0)
+        return(0);
+
+    inpath = fsutils.BuildPath(m_userroot,m_cwd,argv[2]);
+    outpath = fsutils.BuildPath(m_userroot,m_cwd,argv[3]);
+    if (inpath == NULL || outpath == NULL) {
+        EventHandler(argc,argv,"ERROR: unable to set file path.","550",1,1,0);
+        if (inpath != NULL) fsutils.FreePath(inpath);
+        if (outpath != NULL) fsutils.FreePath(outpath);
+        return(0);
+    }
+    fsutils.RemoveSlashEnd(inpath);
+    fsutils.RemoveSlashEnd(outpath);
+
+    type = (strchr(inpath,'*') == NULL) ? fsutils.ValidatePath(inpath) : 2;
+    if (type == 0) {
+        WriteToLineBuffer("%s: No such file or directory.",argv[2]);
+        EventHandler(argc,argv,m_linebuffer,"550",1,1,0);
+    } else if (type == 1 && _issubpath(outpath,inpath) != 0) {
+        WriteToLineBuffer("%s: Cannot move a directory into itself.",argv[2]);
+        EventHandler(argc,argv,m_linebuffer,"550",1,1,0);
+    } else if (strchr(inpath,'*') == NULL && fsutils.ValidatePath(outpath) == 0 && fsutils.Rename(inpath,outpath) != 0) {
+            //renamed on the same file system
+        EventHandler(argc,argv,"SITE MOVE command successful.","250",1,1,0);
+        retval = 1;
+    } else {
+            //move the files one at a time
+        memset(&copylist,0,sizeof(copylist));
+        if (fsutils.CopyFiles(inpath,outpath,&copylist) > 0) {
+            retval = RunCopyList(argc,argv,&copylist,1);
+                //remove the (now empty) directories that were moved
+            if (retval != 0 && type == 1)
+                fsutils.DeleteFiles(inpath);
+        } else {
+            WriteToLineBuffer("%s: No files to move.",argv[2]);
+            EventHandler(argc,argv,m_linebuffer,"550",1,1,0);
+        }
+        fsutils.FreeCopyList(&copylist);
+    }
+
+    fsutils.FreePath(outpath);
+    fsutils.FreePath(inpath);
+    return(retval);
+}
+
+
 
 //////////////////////////////////////////////////////////////////////
 // Protected Methods
 //////////////////////////////////////////////////////////////////////
+
+    //Copies (or moves) the files in "plist" with up to INDIFTPS_COPYTHREADS
+    //threads and sends a progress line every INDIFTPS_COPYPROGRESS sec.
+    //Returns 1 if all the files were copied.
+int CIndiFtps::RunCopyList(int argc, char **argv, fsutilsCopyList_t *plist, int flagmove)
+{
+    CThrPool pool;
+    CTimer timer;
+    _CopyRun_t copyrun;
+    _CopyJob_t *jobs;
+    unsigned long timestart, timeprogress;
+    const char *cmd = (flagmove != 0) ? "MOVE" : "COPY";
+    const char *verb = (flagmove != 0) ? "moved" : "copied";
+    double nbytes;
+    int i, ndone, nthreads, flagprogress = 0, retval = 0;
+
+    if ((jobs = (_CopyJob_t *)calloc(plist->nfiles,sizeof(_CopyJob_t))) == NULL) {
+        EventHandler(argc,argv,"ERROR: out of memory.","451",1,1,1);
+        return(0);
+    }
+    copyrun.thr.InitializeCritSec(&copyrun.mutex);
+    copyrun.ndone = copyrun.ncopied = 0;
+
+    nthreads = (plist->nfiles < INDIFTPS_COPYTHREADS) ? plist->nfiles : INDIFTPS_COPYTHREADS;
+    pool.Start(nthreads,plist->nfiles);
+    timestart = timeprogress = timer.Get();
+
+    for (i = 0; i < plist->nfiles; i++) {
+        jobs[i].pfile = &plist->files[i];
+        jobs[i].flagmove = flagmove;
+        jobs[i].prun = &copyrun;
+        if (pool.Submit(_copyjob,(void *)&jobs[i]) == 0)
+            _copyjob((void *)&jobs[i]);     //the pool is not running
+    }
+
+        //wait for the copies and send the progress lines
+    while (1) {
+        copyrun.thr.P(&copyrun.mutex);
+        ndone = copyrun.ndone;
+        copyrun.thr.V(&copyrun.mutex);
+        if (ndone >= plist->nfiles)
+            break;
+        timer.Sleep(100);
+        if (timer.Diff(timeprogress,timer.Get()) >= INDIFTPS_COPYPROGRESS*1000) {
+            for (i = 0, nbytes = 0; i < plist->nfiles; i++)
+                nbytes += jobs[i].nbytes;
+            WriteToLineBuffer("%d of %d files %s (%.1f of %.1f MB copied).",ndone,plist->nfiles,verb,
+                              nbytes/1048576,(double)plist->nbytes/1048576);
+            EventHandler(argc,argv,m_linebuffer,"250",1,0,0,1);
+            timeprogress = timer.Get();
+            flagprogress = 1;
+        }
+    }
+    pool.Stop();
+
+    if (copyrun.ncopied == plist->nfiles) {
+        WriteToLineBuffer("SITE %s: %d files (%.1f MB) %s in %.1f sec.",cmd,copyrun.ncopied,
+                          (double)plist->nbytes/1048576,verb,timer.DiffSec(timestart,timer.Get()));
+        EventHandler(argc,argv,m_linebuffer,"250",1,1,0);
+        retval = 1;
+    } else {
+        WriteToLineBuffer("SITE %s: %d of %d files %s (%d failed).",cmd,copyrun.ncopied,plist->nfiles,
+                          verb,plist->nfiles-copyrun.ncopied);
+            //the reply code can not change after the progress lines
+        if (flagprogress != 0)
+            EventHandler(argc,argv,m_linebuffer,"250",1,1,0);
+        else
+            EventHandler(argc,argv,m_linebuffer,"550",1,1,0);
+    }
+
+    copyrun.thr.DestroyCritSec(&copyrun.mutex);
+    free(jobs);
+    return(retval);
+}
+
+//////////////////////////////////////////////////////////////////////
+// Private Functions
+//////////////////////////////////////////////////////////////////////
+
+    //Copies (or moves) a file of a SITE COPY/MOVE (run by a copy thread).
+static void _copyjob(void *vpjob)
+{
+    _CopyJob_t *job = (_CopyJob_t *)vpjob;
+    CFSUtils fsutils;
+    int result;
+
+    if (job->flagmove != 0)
+        result = fsutils.MoveSingleFile(job->pfile->inputfilename,job->pfile->outputfilename,&job->nbytes);
+    else
+        result = fsutils.CopySingleFile(job->pfile->inputfilename,job->pfile->outputfilename,&job->nbytes);
+
+    job->prun->thr.P(&job->prun->mutex);
+    job->prun->ndone++;
+    job->prun->ncopied += result;
+    job->prun->thr.V(&job->prun->mutex);
+}
+
+    //Returns 1 if "path" is "dirpath" or is inside of "dirpath"
+    //(neither path ends in a slash).
+static int _issubpath(const char *path, const char *dirpath)
+{
+    int len = strlen(dirpath);
+
+    if (strncmp(path,dirpath,len) != 0)
+        return(0);
+
+    return((path[len] == '\0' || path[len] == FSUTILS_SLASH) ? 1 : 0);
+}
@@ -23,6 +23,10 @@
 #define INDIFTPS_H
 
 #include "../core/Ftps.h"
+#include "../core/FSUtils.h"
+
+#define INDIFTPS_COPYTHREADS  4     //max number of threads copying the files of a SITE COPY/MOVE
+#define INDIFTPS_COPYPROGRESS 5     //time (sec) between the progress lines of a SITE COPY/MOVE
 
 class CIndiSiteInfo;
 
@@ -42,6 +46,11 @@ public:
 
         //SITE commands
     virtual int DoSiteVERS(int argc, char **argv);
+    virtual int DoSiteCOPY(int argc, char **argv);
+    virtual int DoSiteMOVE(int argc, char **argv);
+
+protected:
+    int RunCopyList(int argc, char **argv, fsutilsCopyList_t *plist, int flagmove);
 
 protected:
         //pointer to the class containing the IndiFTPD site information
@@ -38,16 +38,19 @@
 //////////////////////////////////////////////////////////////////////
 
 CIndiSiteInfo::CIndiSiteInfo(char *progname, char *progversion, char *coreversion, char *sitedefroot /*=NULL*/)
-:CSiteInfo(progname, progversion, coreversion, sitedefroot)
+:CSiteInfo(progname, progversion, coreversion, sitedefroot),
+ m_users(sizeof(indisiteinfoUserProp_t))    //the username is the first field
 {
 
-    m_userlist = NULL;  //init the user properties list
-
         //Initialize the logging levels
     m_indiaccessloglevel = INDISITEINFO_LOGLEVELNONE;
     CSiteInfo::SetAccessLoggingLevel(SITEINFO_LOGLEVELNONE);
     CSiteInfo::SetProgLoggingLevel(SITEINFO_LOGLEVELNONE);
 
+        //Initialize the user transfer speed limits
+    m_maxuserdlspeed = 0;   //0 -> no speed limit
+    m_maxuserulspeed = 0;
+
         //Initialize the list of PASV ports available
     m_pasvlist = NULL;  //indicates any port can be used
         //Set the PASV port range
@@ -63,7 +66,6 @@ CIndiSiteInfo::CIndiSiteInfo(char *progname, char *progversion, char *coreversio
     m_certsize = 0;      //size of the certificate
 
         //Initialize mutexes
-    m_thr.InitializeCritSec(&m_mutexusers);
     m_thr.InitializeCritSec(&m_mutexpasvbind);
 }
 
@@ -71,10 +73,6 @@ CIndiSiteInfo::~CIndiSiteInfo()
 {
     CSSLSock sslsock;
 
-        //free the user information list if necessary
-    if (m_userlist != NULL)
-        m_dll.Destroy(m_userlist,1);
-
         //free the list of PASV ports if necessary
     if (m_pasvlist != NULL)
         free(m_pasvlist);
@@ -88,7 +86,6 @@ CIndiSiteInfo::~CIndiSiteInfo()
         sslsock.FreeX509Mem(m_cert);
 
         //destroy mutexes
-    m_thr.DestroyCritSec(&m_mutexusers);
     m_thr.DestroyCritSec(&m_mutexpasvbind);
 }
 
@@ -145,8 +142,8 @@ int CIndiSiteInfo::LoadUsers(const char *filepath)
     CCmdLine cmdline;
     CStrUtils strutils;
     CIndiFileUtils fileutils;
-    indisiteinfoUserProp_t puserprop;
-    int argc, nusers = 0;
+    indisiteinfoUserProp_t *users = NULL, *ptr;
+    int argc, nusers, maxusers = 0, nread = 0;
     char **argv;
     FILE *fdr;
 
@@ -162,15 +159,26 @@ int CIndiSiteInfo::LoadUsers(const char *filepath)
         strutils.RemoveComments(cmdline.m_cmdline,INDIFILEUTILS_COMMENTSTRING);
             //parse the command line
         argv = cmdline.ParseCmdLine(&argc,INDIFILEUTILS_USERFILEDELIMITER);
-            //Parse the line of the user information file
-        if (fileutils.ParseUserInfo(argc,argv,&puserprop) != 0) {
-            if (AddUser(&puserprop) != 0)
-                nusers++;   //increment the number of users added to memory
+            //make room for one more user
+        if (nread == maxusers) {
+            maxusers = (maxusers == 0) ? 64 : maxusers * 2;
+            if ((ptr = (indisiteinfoUserProp_t *)realloc(users,maxusers * sizeof(indisiteinfoUserProp_t))) == NULL)
+                break;
+            users = ptr;
         }
+            //Parse the line of the user information file
+        if (fileutils.ParseUserInfo(argc,argv,&users[nread]) != 0)
+            nread++;
     }
     
     fclose(fdr);
 
+        //add all the users to memory at once
+    nusers = m_users.Add(users,nread);
+
+    if (users != NULL)
+        free(users);
+
     return(nusers);
 }
 
@@ -178,76 +186,32 @@ int CIndiSiteInfo::LoadUsers(const char *filepath)
 void CIndiSiteInfo::ClearUsers()
 {
 
-    m_thr.P(&m_mutexusers); //enter the critical section for the user list
-
-    if (m_userlist != NULL) {
-        m_dll.Destroy(m_userlist,1);
-        m_userlist = NULL;
-    }
-
-    m_thr.V(&m_mutexusers); //exit the critical section
+    m_users.Clear();
 }
 
     //Adds a user to the user list in memory
 int CIndiSiteInfo::AddUser(indisiteinfoUserProp_t *puser)
 {
-    int retval = 0;
-    indisiteinfoUserProp_t *puserprop;
-    unsigned key;
-
-    m_thr.P(&m_mutexusers); //enter the critical section for the user list
-
-        //create a new user list if necessary
-    if (m_userlist == NULL) {
-        if ((m_userlist = m_dll.Create(NULL,0,"User List Header")) == NULL) {
-            m_thr.V(&m_mutexusers); //exit the critical section
-            return(0);
-        }
-    }
 
-        //initialize the linked list index (key)
-    key = m_dll.GetGreatestKey(m_userlist) + 1;
-
-        //check if the user has already been added
-    if (m_dll.Search(m_userlist,(unsigned)-1,puser->pwinfo.username,1) == NULL) {
-        if ((puserprop = (indisiteinfoUserProp_t *)malloc(sizeof(indisiteinfoUserProp_t))) != NULL) {
-            memcpy(puserprop,puser,sizeof(indisiteinfoUserProp_t));
-                //add the user to the userlist
-            if (m_dll.Create(m_userlist,key,puser->pwinfo.username,(void *)puserprop) != NULL) {
-                retval = 1;     //return success
-            } else {
-                free(puserprop);
-            }
-        }
-    }
-    
-    m_thr.V(&m_mutexusers); //exit the critical section
+    if (puser == NULL)
+        return(0);
 
-    return(retval);
+    return(m_users.Add(puser,1));
 }
 
 int CIndiSiteInfo::CheckUserProp(char *username)
 {
-    int len, retval = 0;
-    dll_t *node;
+    indisiteinfoUserProp_t userprop;
+    int len;
 
-    m_thr.P(&m_mutexusers); //enter the critical section for the user list
-    
-    if (m_userlist == NULL) {
-        m_thr.V(&m_mutexusers); //exit the critical section
+    if (username == NULL || m_users.Lookup(username,&userprop) == 0)
         return(0);
-    }
-
-    if ((node = m_dll.Search(m_userlist,(unsigned)-1,username,1)) != NULL) {
-            //make sure the "username" matches the name in memory
-        len = strlen(username);
-        strncpy(username,node->name,len);
-        retval = 1;     //the user was found on the userlist
-    }
 
-    m_thr.V(&m_mutexusers); //exit the critical section
+        //make sure the "username" matches the name in memory
+    len = strlen(username);
+    strncpy(username,userprop.pwinfo.username,len);
 
-    return(retval);
+    return(1);  //the user was found on the userlist
 }
 
 ////////////////////////////////////////
@@ -259,24 +223,15 @@ int CIndiSiteInfo::CheckUserProp(char *username)
     //Rteurn NULL on error
 siteinfoPWInfo_t *CIndiSiteInfo::GetPWInfo(char *username)
 {
+    indisiteinfoUserProp_t userprop;
     siteinfoPWInfo_t *pwinfo = NULL;
-    dll_t *node;
 
-    m_thr.P(&m_mutexusers); //enter the critical section for the user list
+    if (username == NULL || m_users.Lookup(username,&userprop) == 0)
+        return(NULL);
 
-    if (m_userlist == NULL) {
-        m_thr.V(&m_mutexusers); //exit the critical section
-        return(0);
-    }
-    
-    if ((node = m_dll.Search(m_userlist,(unsigned)-1,username,1)) != NULL) {
-            //the user was found on the userlist
-        if ((pwinfo = (siteinfoPWInfo_t *)malloc(sizeof(siteinfoPWInfo_t))) != NULL) {
-            memcpy(pwinfo,node->genptr,sizeof(siteinfoPWInfo_t));
-        }
-    }
-    
-    m_thr.V(&m_mutexusers); //exit the critical section
+        //the user was found on the userlist
+    if ((pwinfo = (siteinfoPWInfo_t *)malloc(sizeof(siteinfoPWInfo_t))) != NULL)
+        memcpy(pwinfo,&userprop.pwinfo,sizeof(siteinfoPWInfo_t));
 
     return(pwinfo);
 }
@@ -289,31 +244,18 @@ siteinfoPWInfo_t *CIndiSiteInfo::GetPWInfo(char *username)
     //Returns 1 if any of the "flags" are present in the user's permissions
 int CIndiSiteInfo::CheckPermissions(char *username, char *path, char *flags)
 {
-    indisiteinfoUserProp_t *puserprop;
+    indisiteinfoUserProp_t userprop;
     char *ptr;
-    dll_t *node;
-    int retval = 0;
-
-    m_thr.P(&m_mutexusers); //enter the critical section for the user list
 
-    if (username == NULL || flags == NULL || m_userlist == NULL) {
-        m_thr.V(&m_mutexusers); //exit the critical section
+    if (username == NULL || flags == NULL || m_users.Lookup(username,&userprop) == 0)
         return(0);
-    }
-    
-    if ((node = m_dll.Search(m_userlist,(unsigned)-1,username,1)) != NULL) {
-        puserprop = (indisiteinfoUserProp_t *)(node->genptr);
-        for (ptr = flags; *ptr != '\0'; ptr++) {
-            if (strchr(puserprop->permissions,*ptr) != NULL) {
-                retval = 1;
-                break;
-            }
-        }
-    }
 
-    m_thr.V(&m_mutexusers); //exit the critical section
+    for (ptr = flags; *ptr != '\0'; ptr++) {
+        if (strchr(userprop.permissions,*ptr) != NULL)
+            return(1);
+    }
 
-    return(retval);
+    return(0);
 }
 
 ////////////////////////////////////////
@@ -382,6 +324,32 @@ int CIndiSiteInfo::WriteToAccessLog(char *sip, char *sp, char *cip, char *cp, ch
     return(retval);
 }
 
+////////////////////////////////////////
+// Functions used to limit the transfer
+// speed of the users
+////////////////////////////////////////
+
+    //Sets the max download/upload speed of each user (bytes/sec).
+    //All the transfers of a user share the limit.  0 = no limit.
+void CIndiSiteInfo::SetMaxUserSpeed(long maxdlspeed, long maxulspeed)
+{
+
+    m_maxuserdlspeed = (maxdlspeed > 0) ? maxdlspeed : 0;
+    m_maxuserulspeed = (maxulspeed > 0) ? maxulspeed : 0;
+}
+
+int CIndiSiteInfo::GetMaxDLSpeed(char *username)
+{
+
+    return((int)m_maxuserdlspeed);
+}
+
+int CIndiSiteInfo::GetMaxULSpeed(char *username)
+{
+
+    return((int)m_maxuserulspeed);
+}
+
 ////////////////////////////////////////
 // Functions used to specify/limit the
 // range of ports used in PASV mode
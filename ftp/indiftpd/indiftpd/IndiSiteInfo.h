@@ -24,7 +24,7 @@
 
 #include "../core/SiteInfo.h"
 
-#include "../core/Dll.h"
+#include "../core/HashTable.h"
 
 #define INDISITEINFO_MAXBINDATTEMPTS    3  //max number of ports to attempt to bind to
 
@@ -71,6 +71,10 @@ public:
     void SetAccessLoggingLevel(int level);
     int WriteToAccessLog(char *sip, char *sp, char *cip, char *cp, char *user, char *cmd, char *arg, char *status, char *text);
 
+    void SetMaxUserSpeed(long maxdlspeed, long maxulspeed);
+    int GetMaxDLSpeed(char *username);
+    int GetMaxULSpeed(char *username);
+
     int SetDataPortRange(unsigned short startport, unsigned short endport);
     int GetDataPort(char *bindport, int maxportlen, int *sdptr, char *bindip);
     int FreetDataPort(int sd);
@@ -82,17 +86,16 @@ public:
     int GetPrivKeyPW(char *pwbuff, int maxpwbuff);
 
 private:
-        //mutex for the user properties list (m_userlist)
-    thrSync_t m_mutexusers;
         //Mutex for PASV port binding list (m_pasvlist)
     thrSync_t m_mutexpasvbind;
 
-    CDll m_dll;         //contains doubly-linked list functions
-
-    dll_t *m_userlist;  //header of the linked list of user properties
+    CHashTable m_users; //user properties (indisiteinfoUserProp_t) by username
 
     int m_indiaccessloglevel;   //access log level
 
+    long m_maxuserdlspeed;  //max download speed of each user (bytes/sec)
+    long m_maxuserulspeed;  //max upload speed of each user (bytes/sec)
+
         //list of PASV ports available
     indisiteinfoPasvPort_t *m_pasvlist;
         //used to specify the range of ports that can be used in passive mode
@@ -88,6 +88,10 @@ LINK32=link.exe
 # PROP Default_Filter "cpp;c;cxx;rc;def;r;odl;idl;hpj;bat"
 # Begin Source File
 
+SOURCE=..\core\AsciiXlate.cpp
+# End Source File
+# Begin Source File
+
 SOURCE=..\core\BlowfishCrypt.cpp
 # End Source File
 # Begin Source File
@@ -100,6 +104,10 @@ SOURCE=..\core\Crypto.cpp
 # End Source File
 # Begin Source File
 
+SOURCE=..\core\DirCache.cpp
+# End Source File
+# Begin Source File
+
 SOURCE=..\core\Dll.cpp
 # End Source File
 # Begin Source File
@@ -116,6 +124,10 @@ SOURCE=..\core\FtpsXfer.cpp
 # End Source File
 # Begin Source File
 
+SOURCE=..\core\HashTable.cpp
+# End Source File
+# Begin Source File
+
 SOURCE=.\IndiFileUtils.cpp
 # End Source File
 # Begin Source File
@@ -136,6 +148,14 @@ SOURCE=..\core\Log.cpp
 # End Source File
 # Begin Source File
 
+SOURCE=..\core\LogQueue.cpp
+# End Source File
+# Begin Source File
+
+SOURCE=..\core\Reactor.cpp
+# End Source File
+# Begin Source File
+
 SOURCE=..\core\Service.cpp
 # End Source File
 # Begin Source File
@@ -168,14 +188,26 @@ SOURCE=..\core\Thr.cpp
 # End Source File
 # Begin Source File
 
+SOURCE=..\core\ThrPool.cpp
+# End Source File
+# Begin Source File
+
 SOURCE=..\core\Timer.cpp
 # End Source File
+# Begin Source File
+
+SOURCE=..\core\TokenBucket.cpp
+# End Source File
 # End Group
 # Begin Group "Header Files"
 
 # PROP Default_Filter "h;hpp;hxx;hm;inl"
 # Begin Source File
 
+SOURCE=..\core\AsciiXlate.h
+# End Source File
+# Begin Source File
+
 SOURCE=..\core\BlowfishCrypt.h
 # End Source File
 # Begin Source File
@@ -188,6 +220,10 @@ SOURCE=..\core\Crypto.h
 # End Source File
 # Begin Source File
 
+SOURCE=..\core\DirCache.h
+# End Source File
+# Begin Source File
+
 SOURCE=..\core\Dll.h
 # End Source File
 # Begin Source File
@@ -204,6 +240,10 @@ SOURCE=..\core\FtpsXfer.h
 # End Source File
 # Begin Source File
 
+SOURCE=..\core\HashTable.h
+# End Source File
+# Begin Source File
+
 SOURCE=.\IndiFileUtils.h
 # End Source File
 # Begin Source File
@@ -220,6 +260,14 @@ SOURCE=..\core\Log.h
 # End Source File
 # Begin Source File
 
+SOURCE=..\core\LogQueue.h
+# End Source File
+# Begin Source File
+
+SOURCE=..\core\Reactor.h
+# End Source File
+# Begin Source File
+
 SOURCE=..\core\Service.h
 # End Source File
 # Begin Source File
@@ -252,8 +300,16 @@ SOURCE=..\core\Thr.h
 # End Source File
 # Begin Source File
 
+SOURCE=..\core\ThrPool.h
+# End Source File
+# Begin Source File
+
 SOURCE=..\core\Timer.h
 # End Source File
+# Begin Source File
+
+SOURCE=..\core\TokenBucket.h
+# End Source File
 # End Group
 # Begin Group "Resource Files"
 
@@ -29,6 +29,9 @@
 #include "../core/StrUtils.h"
 #include "../core/FSUtils.h"
 #include "../core/Crypto.h"
+#include "../core/Reactor.h"
+#include "../core/ThrPool.h"
+#include "../core/FtpsXfer.h"
 #include "IndiFtps.h"
 #include "IndiFileUtils.h"
 #include "IndiSiteInfo.h"
@@ -36,6 +39,15 @@
 #define _MAINLOOPFREQ 2     //number of seconds the main loop runs at
 #define _USERLOOPFREQ 1     //the freq of the loop in the user thread
 
+#define _CTRLTHREADS 2      //default num of threads serving the control connections (0 = 1 thread per client)
+#define _FILETHREADS 8      //default num of threads for commands that block on the file system
+#define _FILEQUEUESIZE 256  //max num of commands waiting for a file system thread
+#define _XFERTHREADS 32     //default max num of data transfers running at the same time (0 = 1 thread per transfer)
+#define _XFERQUEUESIZE 256  //max num of data transfers waiting for a transfer thread
+#define _XFERDONEMSEC 500   //max time to wait for a transfer that sent its reply to finish
+#define _RECVBUFSIZE 1024   //max length of the received command lines waiting to be run
+#define _LOGQUEUESIZE 2048  //default num of log lines waiting to be written (0 = write directly)
+
 #define _PROGNAME "IndiFTPD"
 #define _PROGVERSION "1.0.9_beta"
 
@@ -59,26 +71,69 @@ typedef struct {
 static int _flaglisten = 0;     //0 = _listenthread is not active
 static int _flaglistenssl = 0;  //0 = _listensslthread is not active
 
+    //state of a client control connection
+typedef struct _Session {
+    CIndiFtps *pftps;       //FTP server class
+    CTermsrv ftpscmd;       //Terminal command class (used to send and recv FTP commands)
+    CCmdLine cmdline;       //Stores the FTP received command line
+    int flaguser;           //is the user allowed access (1 = user is allowed)
+    int flagauth;           //is the user authenticated  (1 = user if authenticated)
+        //used when the session is run by the reactor
+    char recvbuf[_RECVBUFSIZE]; //received data that has not been run yet
+    int recvlen;            //number of bytes in recvbuf
+    int flageof;            //the client closed the connection
+    struct _Session *prev, *next;   //list of the sessions registered with the reactor
+} _Session_t;
+    //functions used to run the client sessions
+static _Session_t *_sessionnew(CIndiFtps *pftps);
+static int _sessionstart(_Session_t *session);
+static void _sessionexec(_Session_t *session, int sockstatus);
+static void _sessionclose(_Session_t *session);
+    //functions used to run the client sessions in the reactor
+static void _sessionevent(void *vpsession);
+static void _sessionjob(void *vpsession);
+static void _sessionrun(_Session_t *session, int flagpool);
+static int _sessionpeek(_Session_t *session);
+static void _sessionlink(_Session_t *session, int flaglink);
+static int _iscommandblocking(const char *command);
+
+    //waits for commands on the idle control connections
+static CReactor _reactor;
+    //runs the commands that can block (file system access, login delay, ...)
+static CThrPool _filepool;
+    //sessions registered with the reactor (protected by _mutexsession)
+static _Session_t *_sessionlist = NULL;
+static thrSync_t _mutexsession;
+    //number of threads for the reactor, the file system commands and the transfers (set with -w)
+static int _nctrlthreads = _CTRLTHREADS;
+static int _nfilethreads = _FILETHREADS;
+static int _nxferthreads = _XFERTHREADS;
+    //size and full policy for the log queue (set with -q)
+static int _logqueuesize = _LOGQUEUESIZE;
+static int _logqueuepolicy = LOGQUEUE_FULLBLOCK;
+
     //displays the usage screen
 static void _usage(char type);
     //initialize the FTP server (based on the command line inputs)
 static int _initserver(CIndiSiteInfo *psiteinfo, int argc, char **argv, char *bindip, char *port, char *sslport, int *loglevel);
+    //reads the download:upload speeds given to -s, -u and -t
+static int _parsespeed(char *arg, long *pdlspeed, long *pulspeed);
     //standard signal handler used to catch signals such as SIGINT (Ctrl-C)
 static void _sighandler(int sig);
     //Used to check if the user entered a transfer command.
 static int _iscommandxfer(char *command);
 
-    //the main function that handles the client connections
+    //the main function that handles a client connection in its own thread
 #ifdef WIN32
-  static void _connect(void *vpftps);   //WINDOWS must return "void" to run as a new thread
+  static void _connect(void *vpsession);    //WINDOWS must return "void" to run as a new thread
 #else
-  static void *_connect(void *vpftps);  //UNIX must return "void *" to run as a new thread
+  static void *_connect(void *vpsession);   //UNIX must return "void *" to run as a new thread
 #endif
 
     //Used to signal the program to refresh (this is set in _sighandler())
 static int _flaghup = 0;
 
-    //stores the number of current client connections
+    //stores the number of current client connections (protected by _mutexsession)
 static int _nconnections = 0;
 
 
@@ -147,6 +202,34 @@ int main(int argc, char **argv)
     psiteinfo->SetProgLoggingLevel(loglevel);
         //Set the logging level for the FTP access log file
     psiteinfo->SetAccessLoggingLevel(loglevel);
+
+        //start writing the logs from a separate thread
+    if (_logqueuesize > 0 && psiteinfo->StartLogQueue(_logqueuesize,_logqueuepolicy) == 0)
+        psiteinfo->WriteToProgLog("MAIN","WARNING: unable to start the log queue (writing the logs directly).");
+
+        //start the threads that run the data transfers
+        //(if they can't be started, each transfer gets its own thread)
+    if (_nxferthreads > 0) {
+        if (psiteinfo->StartXferPool(_nxferthreads,_XFERQUEUESIZE,ftpsXferJobExit) == 0)
+            psiteinfo->WriteToProgLog("MAIN","WARNING: unable to start the transfer threads (using 1 thread per transfer).");
+        else
+            psiteinfo->WriteToProgLog("MAIN","Running up to %d data transfers at a time.",_nxferthreads);
+    }
+
+        //start the threads that serve the control connections
+        //(if they can't be started, each client gets its own thread)
+    thr.InitializeCritSec(&_mutexsession);
+    if (_nctrlthreads > 0) {
+        if (_nfilethreads > 0 && _filepool.Start(_nfilethreads,_FILEQUEUESIZE) == 0)
+            psiteinfo->WriteToProgLog("MAIN","WARNING: unable to start the file system threads.");
+        if (_reactor.Start(_nctrlthreads,_sessionevent) == 0) {
+            _filepool.Stop();
+            psiteinfo->WriteToProgLog("MAIN","Using 1 thread per client connection.");
+        } else {
+            psiteinfo->WriteToProgLog("MAIN","Serving client connections with %d thread(s) (%d for file system commands).",
+                                      _reactor.GetNumThreads(),_filepool.GetNumThreads());
+        }
+    }
     
         //create the primary listening socket for the server
         //this is the socket that listens on the FTP control port
@@ -217,10 +300,22 @@ int main(int argc, char **argv)
     sock.Close(sd);
     if (sslsd != SOCK_INVALID) sock.Close(sslsd);
 
+        //stop the reactor and close the sessions it was waiting on
+    _filepool.Stop();
+    _reactor.Stop();
+    while (_sessionlist != NULL) {
+        _Session_t *session = _sessionlist;
+        _sessionlink(session,0);
+        _sessionclose(session);
+    }
+
         //wait for all the client connection threads to exit
     while (_nconnections > 0) timer.Sleep(100);
+    psiteinfo->StopXferPool();
     psiteinfo->WriteToProgLog("MAIN","Server shutting down.");
+    psiteinfo->StopLogQueue();
     delete psiteinfo;
+    thr.DestroyCritSec(&_mutexsession);
 
         //uninitialize the network sockets
     sock.Uninitialize();
@@ -239,9 +334,9 @@ int main(int argc, char **argv)
 {
     _ListenInfo_t *listeninfo = (_ListenInfo_t *)(vplisteninfo);
     CSock sock;
-    CThr thr;
     SOCKET clientsd;
     CIndiFtps *pftps;
+    _Session_t *session;
 
     _flaglisten = 1;    //indicate the listen thread is active
 
@@ -255,10 +350,13 @@ int main(int argc, char **argv)
                                     pftps->GetClientIP(),pftps->GetClientPort(),pftps->GetClientName(),clientsd);
                     listeninfo->psiteinfo->WriteToAccessLog(pftps->GetServerIP(),pftps->GetServerPort(),pftps->GetClientIP(),
                                                             pftps->GetClientPort(),pftps->GetLogin(),"CONNECT","","","");
-                        //start a new thread to handle the client connection
-                    if (thr.Create(_connect,(void *)pftps) == 0) {
+                        //hand the client connection to the reactor (or a new thread)
+                    if ((session = _sessionnew(pftps)) == NULL) {
+                        listeninfo->psiteinfo->WriteToProgLog("MAIN","WARNING: unable to allocate the client session.");
+                        sock.Close(clientsd); delete pftps;
+                    } else if (_sessionstart(session) == 0) {
                         listeninfo->psiteinfo->WriteToProgLog("MAIN","WARNING: unable to create a new client thread.");
-                        delete pftps;
+                        _sessionclose(session);
                     }
                 }
             }
@@ -285,9 +383,9 @@ int main(int argc, char **argv)
     CSock sock;
     CSSLSock sslsock;
     sslsock_t *sslinfo;
-    CThr thr;
     SOCKET clientsd;
     CIndiFtps *pftps;
+    _Session_t *session;
     char *privkeybuf = NULL, *certbuf = NULL, privpw[32];
     int errcode, privkeysize = 0, certsize = 0;
     
@@ -312,7 +410,8 @@ int main(int argc, char **argv)
         if (sock.CheckStatus(listeninfo->sd,_MAINLOOPFREQ) > 0) {
             if ((clientsd = sock.Accept(listeninfo->sd)) != SOCK_INVALID) {
                     //setup the SSL connection
-                sslinfo = sslsock.SSLServerNeg(clientsd,privkeybuf,privkeysize,privpw,certbuf,certsize,&errcode);
+                sslinfo = sslsock.SSLServerNeg(clientsd,privkeybuf,privkeysize,privpw,certbuf,certsize,&errcode,
+                                              listeninfo->psiteinfo->m_sslcachesize,listeninfo->psiteinfo->m_sslcachettl);
                     //Create the FTP server class to handle the client connection
                 if ((pftps = new CIndiFtps(clientsd,listeninfo->psiteinfo)) != NULL) {
                     if (sslinfo == NULL) {  //SSL negotiation failed
@@ -328,9 +427,13 @@ int main(int argc, char **argv)
                     listeninfo->psiteinfo->WriteToAccessLog(pftps->GetServerIP(),pftps->GetServerPort(),pftps->GetClientIP(),
                                                             pftps->GetClientPort(),pftps->GetLogin(),"CONNECTSSL","","","");
                         //start a new thread to handle the client connection
-                    if (thr.Create(_connect,(void *)pftps) == 0) {
-                        listeninfo->psiteinfo->WriteToProgLog("MAIN","WARNING: unable to create a new client thread.");
+                        //(SSL control connections are not served by the reactor)
+                    if ((session = _sessionnew(pftps)) == NULL) {
+                        listeninfo->psiteinfo->WriteToProgLog("MAIN","WARNING: unable to allocate the client session.");
                         sslsock.SSLClose(sslinfo); sock.Close(clientsd); delete pftps;
+                    } else if (_sessionstart(session) == 0) {
+                        listeninfo->psiteinfo->WriteToProgLog("MAIN","WARNING: unable to create a new client thread.");
+                        _sessionclose(session);
                     }
                     sslsock.FreeSSLInfo(sslinfo);
                 } else {
@@ -435,6 +538,67 @@ static void _usage(char type)
         printf("transactions between the server and the connected FTP clients.  When reduced\n");
         printf("logging is selected, only the access log file is affected --the program log\n");
         printf("file will continue to log everything.\n");
+    } else if (type == 'w') {
+        printf("By default the control connections of all the clients are served by a few\n");
+        printf("threads that wait for commands on all the connections at once.  Commands\n");
+        printf("that may block on the file system (Ex. CWD, DELE, RETR, LIST) are run by a\n");
+        printf("separate set of threads so that they do not delay the other clients.  Data\n");
+        printf("transfers and directory listings are run by a third set of threads that\n");
+        printf("is kept for the whole site (default = %d).  This is the max number of\n",_XFERTHREADS);
+        printf("transfers running at the same time --up to %d more wait for a free thread\n",_XFERQUEUESIZE);
+        printf("and the rest are refused (\"425 Too many transfers in progress\").\n");
+        printf("\n");
+        printf("Example: \"indiftpd -w4:16:64\" serves the control connections with 4\n");
+        printf("         threads, runs the file system commands with 16 threads and runs\n");
+        printf("         up to 64 transfers at a time.\n");
+        printf("\n");
+        printf("NOTE: \"-w0\" starts a new thread for each client connection.  This is also\n");
+        printf("      done for implicit SSL and \"AUTH SSL\" connections, and on systems\n");
+        printf("      other than Linux.  \"-w<ctrl>:<file>:0\" starts a new thread for each\n");
+        printf("      transfer.  The transfer threads are only set when the server starts.\n");
+    } else if (type == 'q') {
+        printf("By default the log lines are added to a queue and written to the log files\n");
+        printf("(and the screen) by a separate thread, so the threads serving the clients\n");
+        printf("do not wait on the disk.  The -q<lines>:<policy> option sets the number of\n");
+        printf("log lines that can wait in the queue (default = %d) and what to do when the\n",_LOGQUEUESIZE);
+        printf("queue is full:\n");
+        printf("b = block (default - wait until there is room in the queue)\n");
+        printf("d = drop the log line (the number of dropped lines is logged on exit)\n");
+        printf("\n");
+        printf("Example: \"indiftpd -q8192:d\" queues up to 8192 log lines and drops the\n");
+        printf("         log lines that do not fit.\n");
+        printf("\n");
+        printf("NOTE: \"-q0\" writes the log lines directly (no queue).  The queue is only\n");
+        printf("      set when the server starts (it is not changed by a SIGHUP).\n");
+    } else if (type == 's') {
+        printf("The transfer speed can be limited for the whole site, for each user and\n");
+        printf("for each transfer.  The speeds are given as <download>:<upload> in KB/s\n");
+        printf("(0 = no limit).  If only one speed is given, it is used for both.\n");
+        printf("-s<dl>:<ul> = max speed of all the transfers on the site together\n");
+        printf("-u<dl>:<ul> = max speed of all the transfers of a user together\n");
+        printf("-t<dl>:<ul> = max speed of a single transfer\n");
+        printf("A transfer is held to the lowest of the three limits.  The bytes are\n");
+        printf("spread evenly over time and the transfers sharing a limit get equal turns.\n");
+        printf("\n");
+        printf("Example: \"indiftpd -s1024:512 -u256\" limits the site to 1024 KB/s of\n");
+        printf("         downloads and 512 KB/s of uploads, and each user to 256 KB/s\n");
+        printf("         in each direction.\n");
+    } else if (type == 'T') {
+        printf("The SSL sessions of each control connection (explicit or implicit SSL)\n");
+        printf("are cached so that its encrypted data connections (PROT P) can resume\n");
+        printf("the session instead of doing a full handshake for each file.  Session\n");
+        printf("tickets are also sent when the SSL library supports them.  The\n");
+        printf("-T<sessions>:<sec>:r option sets the max number of sessions cached for\n");
+        printf("each control connection (default = %d, 0 = no cache or tickets) and the\n",SSLSOCK_SESSCACHESIZE);
+        printf("time a session can be resumed (default = %d sec).  Adding \":r\" refuses\n",SSLSOCK_SESSCACHETTL);
+        printf("encrypted PASV data connections that do not resume the session of their\n");
+        printf("control connection (\"427 Unable to establish an encrypted data channel\").\n");
+        printf("\n");
+        printf("Example: \"indiftpd -e -T64:600:r\" caches up to 64 sessions for 10 min\n");
+        printf("         and requires the data connections to resume the session.\n");
+        printf("\n");
+        printf("NOTE: Data connections opened by the server (PORT) can not be checked\n");
+        printf("      since the server is the SSL client for these connections.\n");
     } else if (type == 'F') {
         printf("The following types are available:\n");
         printf("p = specify the format for the program log\n");
@@ -506,18 +670,28 @@ static void _usage(char type)
         printf("    -hR           displays help on permissions\n");
         printf("    -hL           displays help on logging\n");
         printf("    -hF           displays help on log formatting\n");
+        printf("    -hw           displays help on the client threads\n");
+        printf("    -hq           displays help on the log queue\n");
+        printf("    -hs           displays help on the transfer speed limits\n");
+        printf("    -hT           displays help on the SSL session cache\n");
         printf("-p<port>          port number the server will run on (default = 21)\n");
         printf("-r<low>-<high>    range of ports to use for data connections (default = any)\n");
         printf("-f<userfile>      file containing user info (def userfile = %s)\n",INDIFILEUTILS_DEFUSERFILENAME);
         printf("-a<userfile>      add a user to the user info file (doesn't start server)\n");
         printf("-b<IP>            IP address to bind to (must be in x.x.x.x form)\n");
+        printf("-w<c>:<f>:<x>     threads serving the clients (default = %d:%d:%d, 0 = 1 per client)\n",_CTRLTHREADS,_FILETHREADS,_XFERTHREADS);
         printf("-e                enable explicit SSL (AUTH SSL)\n");
         printf("-i<port>          enable implicit SSL on the specified port (default = 990)\n");
+        printf("-T<n>:<sec>:r     SSL sessions cached per connection (default = %d:%d)\n",SSLSOCK_SESSCACHESIZE,SSLSOCK_SESSCACHETTL);
         printf("-U<user>          specify a user for the site (default = anonymous)\n");
         printf("-P<password>      password for the user (default = [no password])\n");
         printf("-H<homedir>       home directory for the user (default = CWD)\n");
         printf("-R<flags>         permissions for the user (default = %s)\n",SITEINFO_DEFAULTPERMISSIONS);
         printf("-L<level>:<path>  logging level (default level = 2, path = CWD)\n");
+        printf("-q<lines>:<b|d>   log queue size and full policy (default = %d:b, 0 = no queue)\n",_LOGQUEUESIZE);
+        printf("-s<dl>:<ul>       max site transfer speed in KB/s (default = 0 = no limit)\n");
+        printf("-u<dl>:<ul>       max transfer speed of each user in KB/s (default = 0)\n");
+        printf("-t<dl>:<ul>       max speed of each transfer in KB/s (default = 0)\n");
         printf("-F<type>:<format> set the format for the program/access (type = p/a) logs");
     }
     
@@ -538,6 +712,7 @@ static int _initserver(CIndiSiteInfo *psiteinfo, int argc, char **argv, char *bi
     indisiteinfoUserProp_t userprop;
     int i, retval, startport, endport;
     int flagadd = 0, flagfile = 0;
+    long dlspeed, ulspeed;
 
     if (psiteinfo == NULL || port == NULL || sslport == NULL)
         return(0);
@@ -653,11 +828,76 @@ static int _initserver(CIndiSiteInfo *psiteinfo, int argc, char **argv, char *bi
                     }
                 } break;
 
+                case 'w': { //set the number of threads serving the client connections
+                    if (isdigit(*(argv[i]+2))) {
+                        _nctrlthreads = atoi(argv[i]+2);
+                        if ((ptr = strchr(argv[i],':')) != NULL && isdigit(*(ptr+1))) {
+                            _nfilethreads = atoi(ptr+1);
+                            if ((ptr = strchr(ptr+1,':')) != NULL && isdigit(*(ptr+1)))
+                                _nxferthreads = atoi(ptr+1);
+                        }
+                    } else {
+                        psiteinfo->WriteToProgLog("MAIN","WARNING: invalid number of threads \"%s\" (using default = %d:%d:%d).",
+                                                  argv[i]+2,_CTRLTHREADS,_FILETHREADS,_XFERTHREADS);
+                    }
+                } break;
+
+                case 'q': { //set the size and full policy of the log queue
+                    if (isdigit(*(argv[i]+2))) {
+                        _logqueuesize = atoi(argv[i]+2);
+                        if ((ptr = strchr(argv[i],':')) != NULL)
+                            _logqueuepolicy = (*(ptr+1) == 'd') ? LOGQUEUE_FULLDROP : LOGQUEUE_FULLBLOCK;
+                    } else {
+                        psiteinfo->WriteToProgLog("MAIN","WARNING: invalid log queue size \"%s\" (using default = %d).",
+                                                  argv[i]+2,_LOGQUEUESIZE);
+                    }
+                } break;
+
+                case 's': { //set the max transfer speed for the whole site
+                    if (_parsespeed(argv[i]+2,&dlspeed,&ulspeed) != 0) {
+                        psiteinfo->m_maxdlspeed = dlspeed;
+                        psiteinfo->m_maxulspeed = ulspeed;
+                    } else {
+                        psiteinfo->WriteToProgLog("MAIN","WARNING: invalid site speed \"%s\" (using default = no limit).",argv[i]+2);
+                    }
+                } break;
+
+                case 'u': { //set the max transfer speed for each user
+                    if (_parsespeed(argv[i]+2,&dlspeed,&ulspeed) != 0)
+                        psiteinfo->SetMaxUserSpeed(dlspeed,ulspeed);
+                    else
+                        psiteinfo->WriteToProgLog("MAIN","WARNING: invalid user speed \"%s\" (using default = no limit).",argv[i]+2);
+                } break;
+
+                case 't': { //set the max speed of each transfer
+                    if (_parsespeed(argv[i]+2,&dlspeed,&ulspeed) != 0) {
+                        psiteinfo->m_maxxferdlspeed = dlspeed;
+                        psiteinfo->m_maxxferulspeed = ulspeed;
+                    } else {
+                        psiteinfo->WriteToProgLog("MAIN","WARNING: invalid transfer speed \"%s\" (using default = no limit).",argv[i]+2);
+                    }
+                } break;
+
                 case 'b': { //set the IP address to bind to
                     strncpy(bindip,argv[i]+2,SOCK_IPADDRLEN-1);
                     bindip[SOCK_IPADDRLEN-1] = '\0';
                 } break;
 
+                case 'T': { //set the SSL session cache
+                    if (isdigit(*(argv[i]+2))) {
+                        psiteinfo->m_sslcachesize = atol(argv[i]+2);
+                        if ((ptr = strchr(argv[i],':')) != NULL) {
+                            if (isdigit(*(ptr+1)))
+                                psiteinfo->m_sslcachettl = atol(ptr+1);
+                            if ((ptr = strchr(ptr+1,':')) != NULL && *(ptr+1) == 'r')
+                                psiteinfo->m_flagsslreuse = 1;  //data connections must resume the session
+                        }
+                    } else {
+                        psiteinfo->WriteToProgLog("MAIN","WARNING: invalid SSL session cache \"%s\" (using default = %d:%d).",
+                                                  argv[i]+2,SSLSOCK_SESSCACHESIZE,SSLSOCK_SESSCACHETTL);
+                    }
+                } break;
+
                 case 'e': { //enable explicit SSL
                     if (psiteinfo->InitSSLInfo() == 0)  //initialize the certificate and keys
                         psiteinfo->WriteToProgLog("MAIN","WARNING: unable to initialize the SSL information.");
@@ -784,6 +1024,25 @@ static int _initserver(CIndiSiteInfo *psiteinfo, int argc, char **argv, char *bi
     }
 }
 
+    //Reads the speeds given as "<download>:<upload>" in KB/s (if only one
+    //speed is given, it is used for both).  Returns 0 if "arg" is invalid.
+static int _parsespeed(char *arg, long *pdlspeed, long *pulspeed)
+{
+    char *ptr;
+
+    if (!isdigit(*arg))
+        return(0);
+
+    *pdlspeed = *pulspeed = atol(arg) * 1024;
+    if ((ptr = strchr(arg,':')) != NULL) {
+        if (!isdigit(*(ptr+1)))
+            return(0);
+        *pulspeed = atol(ptr+1) * 1024;
+    }
+
+    return(1);
+}
+
     //standard signal handler used to catch signals such as SIGINT
 static void _sighandler(int sig)
 {
@@ -825,47 +1084,70 @@ static int _iscommandxfer(char *command)
     return(0);
 }
 
-    //This is the main function that handles each client.
-    //This function is run in a new thread for each client connection.
-#ifdef WIN32
-  static void _connect(void *vpftps)    //WINDOWS must return "void" to run as a new thread
-#else
-  static void *_connect(void *vpftps)   //UNIX must return "void *" to run as a new thread
-#endif
+    //Check if a command can block the thread running it for a noticeable
+    //time (file system access, login delay, waiting for transfers, ...).
+    //Returns 1 if the command should be run by a file system thread.
+static int _iscommandblocking(const char *command)
 {
-    CIndiFtps *pftps = (CIndiFtps *)vpftps; //FTP server class
-    CTermsrv ftpscmd;       //Terminal command class (used to send and recv FTP commands)
-    CSock sock;             //Sockets class (contains all the network func)
-    CSSLSock sslsock;       //SSL connection class (contains all the SSL func)
-    CCmdLine cmdline;       //Stores the FTP received command line
-    CStrUtils strutils;     //String utilities class
-    CIndiSiteInfo *psiteinfo;   //pointer to the site information class (used for logging)
-    CTimer timer;           //used for Sleep() and other time related functions
-
-        //set the site information pointer
-    psiteinfo = (CIndiSiteInfo *)pftps->GetSiteInfoPtr();
+    CStrUtils strutils;
+    char commandbuffer[5];
+    int i;
+        //commands that only change or report the session state
+    static const char *fastcmds[] = {"ABOR","ACCT","ALLO","FEAT","HELP","MODE","NOOP","OPTS","PASV",
+                                     "PBSZ","PORT","PROT","PWD","REIN","REST","STRU","SYST","TYPE",
+                                     "USER","XPWD",NULL};
 
-    char **argv;        //array of pointers to the individual command line arguments
-    int argc = 0;       //the number of command line arguments
+        //Extract the FTP command
+    for (i = 0; i < (int)sizeof(commandbuffer)-1 && command[i] != '\0' && command[i] != ' ' &&
+                    command[i] != '\r' && command[i] != '\n'; i++)
+        commandbuffer[i] = command[i];
+    commandbuffer[i] = '\0';
 
-    int sockstatus;     //the status of the socket (has data been received)
+    for (i = 0; fastcmds[i] != NULL; i++) {
+        if (strutils.CaseCmp(commandbuffer,fastcmds[i]) == 0)
+            return(0);
+    }
 
-    int flaguser = 0;   //is the user allowed access (1 = user is allowed)
-    int flagauth = 0;   //is the user authenticated  (1 = user if authenticated)
+    return(1);
+}
 
+    //Creates the state for a new client connection and sends the login
+    //string to the client.
+    //Returns NULL if the session could not be allocated.
+static _Session_t *_sessionnew(CIndiFtps *pftps)
+{
+    CSock sock;
+    CThr thr;
+    CIndiSiteInfo *psiteinfo = (CIndiSiteInfo *)pftps->GetSiteInfoPtr();
+    _Session_t *session;
+
+    if ((session = new _Session_t) == NULL)
+        return(NULL);
+    session->pftps = pftps;
+    session->flaguser = session->flagauth = 0;
+    session->recvlen = 0;
+    session->flageof = 0;
+    session->prev = session->next = NULL;
+
+    thr.P(&_mutexsession);
     _nconnections++;    //increment the number of current client connections
+    thr.V(&_mutexsession);
 
         //Set the socket descriptor for the FTP command class
-    ftpscmd.SetSocketDesc(pftps->GetSocketDesc());
+    session->ftpscmd.SetSocketDesc(pftps->GetSocketDesc());
     if (pftps->GetUseSSL() != 0) {  //set the SSL info (using implicit SSL)
-        ftpscmd.SetSSLInfo(pftps->GetSSLInfo());    //set the SSL info
-        ftpscmd.SetUseSSL(1);                       //set to use SSL
+        session->ftpscmd.SetSSLInfo(pftps->GetSSLInfo());   //set the SSL info
+        session->ftpscmd.SetUseSSL(1);                      //set to use SSL
     }
 
         //Set the socket to keepalive to detect a dead socket
     if (sock.SetKeepAlive(pftps->GetSocketDesc()) == 0)
         psiteinfo->WriteToProgLog("MAIN","Failed to set socket to KeepAlive.");
 
+        //Send the replies right away (a client waits for each reply)
+    if (sock.SetNoDelay(pftps->GetSocketDesc()) == 0)
+        psiteinfo->WriteToProgLog("MAIN","Failed to set socket to NoDelay.");
+
         //Set the socket to receive OOB data (for ABOR)
     if (sock.SetRecvOOB(pftps->GetSocketDesc()) == 0)
         psiteinfo->WriteToProgLog("MAIN","Failed to set socket to receive OOB data.");
@@ -873,152 +1155,180 @@ static int _iscommandxfer(char *command)
         //Send the Login string to the client
     pftps->EventHandler(0,NULL,_LOGINSTR,"220",1,1,0);
 
-    while (pftps->GetFlagQuit() == 0 && siteinfoFlagQuit == 0) {
-        if ((sockstatus = sock.CheckStatus(pftps->GetSocketDesc(),_USERLOOPFREQ)) > 0) {
-                //receive the FTP command and check if the connection was broken
-            if (ftpscmd.CommandRecv(cmdline.m_cmdline,cmdline.GetCmdLineSize()) == 0) {
-                psiteinfo->WriteToProgLog("MAIN","Error connecting to client (%s disconnected).",pftps->GetLogin());
-                pftps->DoQUIT(0,NULL);
-                break;
-            }
-                //update the user's current information
-            pftps->SetLastActive();             //update the last active time
-            //TODO: update last command
-        } else {
-            strcpy(cmdline.m_cmdline,"~");    //used to indicate no activity
-        }
+    return(session);
+}
 
-            //parse the input from the user
-        argv = cmdline.ParseCmdLine(&argc);
-        //if (*(cmdline.m_cmdline) != '~') {
-        //    for (int i= 0; i < argc; i++) printf("argv%d=%s, ",i,argv[i]); printf("\n"); //DEBUG!!!!
-        //}
+    //Starts serving a session: clear text control connections are
+    //registered with the reactor (if it is running), the others get
+    //their own thread.
+    //Returns 1 on success and 0 on failure.
+static int _sessionstart(_Session_t *session)
+{
+    CThr thr;
 
-            //make sure the user is logged in
-            //if the user is not logged in only allow the commands
-            //USER, PASS, or QUIT
-        if (argc > 0 && flagauth == 0) {        //user is not authenticated
+    if (_reactor.IsRunning() != 0 && session->ftpscmd.GetUseSSL() == 0) {
+        _sessionlink(session,1);
+        if (_reactor.Add(session->pftps->GetSocketDesc(),(void *)session) != 0)
+            return(1);
+        _sessionlink(session,0);
+    }
 
-            switch (*(argv[0])) {
+    return(thr.Create(_connect,(void *)session));
+}
 
-                case '~': {
-                    if (sockstatus > 0) //if a command was received
-                        pftps->EventHandler(argc,argv,"Please login with USER and PASS.","530",1,1,0);
-                    //else Do Nothing (idle indicator)
-                } break;
+    //Runs the FTP command stored in session->cmdline.
+    //"sockstatus" is > 0 if the command was received from the client.
+static void _sessionexec(_Session_t *session, int sockstatus)
+{
+    CIndiFtps *pftps = session->pftps;
+    CStrUtils strutils;     //String utilities class
+    CTimer timer;
+    char **argv;        //array of pointers to the individual command line arguments
+    int argc = 0;       //the number of command line arguments
+    int i;
 
-                case 'A': case 'a': {
-                    if (strutils.CaseCmp(argv[0],"AUTH") == 0) {
-                        if (pftps->DoAUTH(argc,argv) != 0) {
-                            ftpscmd.SetSSLInfo(pftps->GetSSLInfo());    //set the SSL info
-                            ftpscmd.SetUseSSL(1);                       //set to use SSL
-                        }
-                    } else {
-                        pftps->EventHandler(argc,argv,"Please login with USER and PASS.","530",1,1,0);
-                    }
-                } break;
+        //parse the input from the user
+    argv = session->cmdline.ParseCmdLine(&argc);
 
-                case 'U': case 'u': {
-                    if (strutils.CaseCmp(argv[0],"USER") == 0) {
-                        flaguser = pftps->DoUSER(argc,argv);
-                    } else {
-                        pftps->EventHandler(argc,argv,"Please login with USER and PASS.","530",1,1,0);
-                    }
-                } break;
+        //make sure the user is logged in
+        //if the user is not logged in only allow the commands
+        //USER, PASS, or QUIT
+    if (argc > 0 && session->flagauth == 0) {   //user is not authenticated
 
-                case 'P': case 'p': {
-                    if (flaguser != 0 && strutils.CaseCmp(argv[0],"PASS") == 0) {
-                        if (pftps->DoPASS(argc,argv) == 0) {
-                            flaguser = 0;
-                            flagauth = 0;  //the user was not authenticated
-                        } else {
-                            flagauth = 1;  //the user was authenticated
-                        }
-                    } else if (strutils.CaseCmp(argv[0],"PBSZ") == 0) {
-                        pftps->DoPBSZ(argc,argv);
-                    } else if (strutils.CaseCmp(argv[0],"PROT") == 0) {
-                        pftps->DoPROT(argc,argv);
-                    } else {
-                        pftps->EventHandler(argc,argv,"Please login with USER and PASS.","530",1,1,0);
+        switch (*(argv[0])) {
+
+            case '~': {
+                if (sockstatus > 0) //if a command was received
+                    pftps->EventHandler(argc,argv,"Please login with USER and PASS.","530",1,1,0);
+                //else Do Nothing (idle indicator)
+            } break;
+
+            case 'A': case 'a': {
+                if (strutils.CaseCmp(argv[0],"AUTH") == 0) {
+                    if (pftps->DoAUTH(argc,argv) != 0) {
+                        session->ftpscmd.SetSSLInfo(pftps->GetSSLInfo());   //set the SSL info
+                        session->ftpscmd.SetUseSSL(1);                      //set to use SSL
                     }
-                } break;
+                } else {
+                    pftps->EventHandler(argc,argv,"Please login with USER and PASS.","530",1,1,0);
+                }
+            } break;
+
+            case 'U': case 'u': {
+                if (strutils.CaseCmp(argv[0],"USER") == 0) {
+                    session->flaguser = pftps->DoUSER(argc,argv);
+                } else {
+                    pftps->EventHandler(argc,argv,"Please login with USER and PASS.","530",1,1,0);
+                }
+            } break;
 
-                case 'Q': case 'q': {
-                    if (strutils.CaseCmp(argv[0],"QUIT") == 0) {
-                        pftps->DoQUIT(argc,argv);
+            case 'P': case 'p': {
+                if (session->flaguser != 0 && strutils.CaseCmp(argv[0],"PASS") == 0) {
+                    if (pftps->DoPASS(argc,argv) == 0) {
+                        session->flaguser = 0;
+                        session->flagauth = 0;  //the user was not authenticated
                     } else {
-                        pftps->EventHandler(argc,argv,"Please login with USER and PASS.","530",1,1,0);
+                        session->flagauth = 1;  //the user was authenticated
                     }
-                } break;
-
-                default: {
+                } else if (strutils.CaseCmp(argv[0],"PBSZ") == 0) {
+                    pftps->DoPBSZ(argc,argv);
+                } else if (strutils.CaseCmp(argv[0],"PROT") == 0) {
+                    pftps->DoPROT(argc,argv);
+                } else {
                     pftps->EventHandler(argc,argv,"Please login with USER and PASS.","530",1,1,0);
-                } break;
+                }
+            } break;
 
-            } // end switch
+            case 'Q': case 'q': {
+                if (strutils.CaseCmp(argv[0],"QUIT") == 0) {
+                    pftps->DoQUIT(argc,argv);
+                } else {
+                    pftps->EventHandler(argc,argv,"Please login with USER and PASS.","530",1,1,0);
+                }
+            } break;
 
-        } else if (argc > 0 && flagauth != 0) { //user is authenticated
+            default: {
+                pftps->EventHandler(argc,argv,"Please login with USER and PASS.","530",1,1,0);
+            } break;
 
-            switch (*(argv[0])) {
+        } // end switch
 
-                case '~': {
-                    if (sockstatus > 0)     //if a command was received
-                        pftps->ExecFTP(argc,argv);
-                    //else Check timer values
-                } break;
+    } else if (argc > 0 && session->flagauth != 0) {    //user is authenticated
 
-                case 'A': case 'a': {
-                    if (strutils.CaseCmp(argv[0],"AUTH") == 0) {
-                        if (pftps->DoAUTH(argc,argv) != 0) {
-                            ftpscmd.SetSSLInfo(pftps->GetSSLInfo());    //set the SSL info
-                            ftpscmd.SetUseSSL(1);                       //set to use SSL
-                        }
-                    } else {
-                        pftps->ExecFTP(argc,argv);
-                    }
-                } break;
+        switch (*(argv[0])) {
 
-                case 'P': case 'p': {
-                    if (strutils.CaseCmp(argv[0],"PASS") == 0) {
-                        if (pftps->DoPASS(argc,argv) == 0) {
-                            flaguser = 0;
-                            flagauth = 0;  //the user was not authenticated
-                        }
-                    } else {
-                        pftps->ExecFTP(argc,argv);
+            case '~': {
+                if (sockstatus > 0)     //if a command was received
+                    pftps->ExecFTP(argc,argv);
+                //else Check timer values
+            } break;
+
+            case 'A': case 'a': {
+                if (strutils.CaseCmp(argv[0],"AUTH") == 0) {
+                    if (pftps->DoAUTH(argc,argv) != 0) {
+                        session->ftpscmd.SetSSLInfo(pftps->GetSSLInfo());   //set the SSL info
+                        session->ftpscmd.SetUseSSL(1);                      //set to use SSL
                     }
-                } break;
+                } else {
+                    pftps->ExecFTP(argc,argv);
+                }
+            } break;
 
-                case 'U': case 'u': {
-                    if (strutils.CaseCmp(argv[0],"USER") == 0) {
-                        flagauth = 0;  //reset the authorization
-                        flaguser = pftps->DoUSER(argc,argv);
-                    } else {
-                        pftps->ExecFTP(argc,argv);
+            case 'P': case 'p': {
+                if (strutils.CaseCmp(argv[0],"PASS") == 0) {
+                    if (pftps->DoPASS(argc,argv) == 0) {
+                        session->flaguser = 0;
+                        session->flagauth = 0;  //the user was not authenticated
                     }
-                } break;
+                } else {
+                    pftps->ExecFTP(argc,argv);
+                }
+            } break;
 
-                default: {
-                        //check if the user entered a data transfer command (Ex. RETR, STOR)
-                    if (_iscommandxfer(cmdline.m_cmdline) != 0) {
-                            //only allow 1 data transfer at a time
-                        if (pftps->GetNumDataThreads() > 0) {
-                            pftps->EventHandler(argc,argv,"Only 1 transfer per control connection is allowed.","550",1,1,0);
-                            break;
-                        }
-                    }
-                        //execute the FTP command
+            case 'U': case 'u': {
+                if (strutils.CaseCmp(argv[0],"USER") == 0) {
+                    session->flagauth = 0;  //reset the authorization
+                    session->flaguser = pftps->DoUSER(argc,argv);
+                } else {
                     pftps->ExecFTP(argc,argv);
-                } break;
+                }
+            } break;
+
+            default: {
+                    //check if the user entered a data transfer command (Ex. RETR, STOR)
+                if (_iscommandxfer(session->cmdline.m_cmdline) != 0) {
+                        //only allow 1 data transfer at a time (the previous
+                        //transfer may still be finishing after its "226" reply)
+                    for (i = 0; i < _XFERDONEMSEC/10 && pftps->GetNumDataThreads() > 0; i++)
+                        timer.Sleep(10);
+                    if (pftps->GetNumDataThreads() > 0) {
+                        pftps->EventHandler(argc,argv,"Only 1 transfer per control connection is allowed.","550",1,1,0);
+                        break;
+                    }
+                }
+                    //execute the FTP command
+                pftps->ExecFTP(argc,argv);
+            } break;
 
-            } // end switch
+        } // end switch
 
-        } else {                                //nothing was entered
-            pftps->EventHandler(argc,argv,"command not understood","500",1,1,0);
-        }
+    } else {                                    //nothing was entered
+        pftps->EventHandler(argc,argv,"command not understood","500",1,1,0);
     }
+}
+
+    //Closes the control connection and frees the session (waits for the
+    //transfer threads of the session to exit).
+static void _sessionclose(_Session_t *session)
+{
+    CIndiFtps *pftps = session->pftps;
+    CIndiSiteInfo *psiteinfo = (CIndiSiteInfo *)pftps->GetSiteInfoPtr();
+    CSock sock;             //Sockets class (contains all the network func)
+    CSSLSock sslsock;       //SSL connection class (contains all the SSL func)
+    CThr thr;
+    CTimer timer;           //used for Sleep() and other time related functions
 
-    if (ftpscmd.GetUseSSL() != 0) sslsock.SSLClose(pftps->GetSSLInfo());    //shutdown SSL
+    if (session->ftpscmd.GetUseSSL() != 0) sslsock.SSLClose(pftps->GetSSLInfo());    //shutdown SSL
     sock.Close(pftps->GetSocketDesc()); //close the control connection
     psiteinfo->WriteToProgLog("MAIN","Connection closed (%u), %s disconnected.",pftps->GetSocketDesc(),pftps->GetLogin());
     psiteinfo->WriteToAccessLog(pftps->GetServerIP(),pftps->GetServerPort(),pftps->GetClientIP(),pftps->GetClientPort(),pftps->GetLogin(),"DISCONNECT","","","");
@@ -1027,10 +1337,193 @@ static int _iscommandxfer(char *command)
     pftps->SetFlagAbor(1); pftps->SetFlagQuit(1); //stop all threads
     while ((pftps->GetNumListThreads()+pftps->GetNumDataThreads()) > 0) timer.Sleep(100); //wait until all threads have stopped
     delete pftps;  //delete the FTP server class
+    delete session;
 
+    thr.P(&_mutexsession);
     _nconnections--;    //decrement the number of current client connections
+    thr.V(&_mutexsession);
+}
+
+    //This is the main function that handles a client in its own thread.
+    //It is used when the reactor is not running and for SSL control
+    //connections.
+#ifdef WIN32
+  static void _connect(void *vpsession)     //WINDOWS must return "void" to run as a new thread
+#else
+  static void *_connect(void *vpsession)    //UNIX must return "void *" to run as a new thread
+#endif
+{
+    _Session_t *session = (_Session_t *)vpsession;
+    CIndiFtps *pftps = session->pftps;  //FTP server class
+    CSock sock;             //Sockets class (contains all the network func)
+    CIndiSiteInfo *psiteinfo;   //pointer to the site information class (used for logging)
+
+    int sockstatus;     //the status of the socket (has data been received)
+
+        //set the site information pointer
+    psiteinfo = (CIndiSiteInfo *)pftps->GetSiteInfoPtr();
+
+    while (pftps->GetFlagQuit() == 0 && siteinfoFlagQuit == 0) {
+        if ((sockstatus = sock.CheckStatus(pftps->GetSocketDesc(),_USERLOOPFREQ)) > 0) {
+                //receive the FTP command and check if the connection was broken
+            if (session->ftpscmd.CommandRecv(session->cmdline.m_cmdline,session->cmdline.GetCmdLineSize()) == 0) {
+                psiteinfo->WriteToProgLog("MAIN","Error connecting to client (%s disconnected).",pftps->GetLogin());
+                pftps->DoQUIT(0,NULL);
+                break;
+            }
+                //update the user's current information
+            pftps->SetLastActive();             //update the last active time
+        } else {
+            strcpy(session->cmdline.m_cmdline,"~");    //used to indicate no activity
+        }
+
+        _sessionexec(session,sockstatus);
+    }
+
+    _sessionclose(session);
 
     #ifndef WIN32
       return(NULL);   //UNIX must return a value
     #endif
 }
+
+    //Called by a reactor thread when data arrives on an idle control
+    //connection (or the connection is closed).
+static void _sessionevent(void *vpsession)
+{
+    _Session_t *session = (_Session_t *)vpsession;
+    CSock sock;
+    int n;
+
+        //read everything that has arrived, without waiting for more
+    while (session->recvlen < (int)sizeof(session->recvbuf)) {
+        n = sock.RecvAvail(session->pftps->GetSocketDesc(),session->recvbuf+session->recvlen,
+                           sizeof(session->recvbuf)-session->recvlen);
+        if (n <= 0) {
+            if (n == 0) session->flageof = 1;   //the connection was closed
+            break;
+        }
+        session->recvlen += n;
+    }
+
+    _sessionrun(session,0);
+}
+
+    //Runs the commands of a session in a file system thread.
+static void _sessionjob(void *vpsession)
+{
+
+    _sessionrun((_Session_t *)vpsession,1);
+}
+
+    //Runs the complete command lines received on a session, then
+    //re-arms the session in the reactor.  Blocking commands are passed
+    //to a file system thread (if "flagpool" is 0 and the queue is not
+    //full), which then continues with the rest of the commands.
+static void _sessionrun(_Session_t *session, int flagpool)
+{
+    CIndiFtps *pftps = session->pftps;
+    CIndiSiteInfo *psiteinfo = (CIndiSiteInfo *)pftps->GetSiteInfoPtr();
+    CStrUtils strutils;
+    CThr thr;
+    int len;
+
+    while (pftps->GetFlagQuit() == 0 && siteinfoFlagQuit == 0) {
+        if ((len = _sessionpeek(session)) == 0)
+            break;  //wait for the rest of the command line
+        if (flagpool == 0 && _iscommandblocking(session->recvbuf) != 0 &&
+            _filepool.Submit(_sessionjob,(void *)session) != 0)
+            return; //the file system thread now owns the session
+
+            //move the command line into the command buffer
+        if (len > session->cmdline.GetCmdLineSize()-1)
+            len = session->cmdline.GetCmdLineSize()-1;
+        memcpy(session->cmdline.m_cmdline,session->recvbuf,len);
+        session->cmdline.m_cmdline[len] = '\0';
+        session->recvlen -= len;
+        memmove(session->recvbuf,session->recvbuf+len,session->recvlen);
+        strutils.RemoveEOL(session->cmdline.m_cmdline);    //remove '\r' and '\n'
+
+            //update the user's current information
+        pftps->SetLastActive();             //update the last active time
+
+        _sessionexec(session,1);
+
+            //"AUTH SSL" succeeded, continue the session in its own thread
+        if (session->ftpscmd.GetUseSSL() != 0) {
+            _reactor.Remove(pftps->GetSocketDesc());
+            _sessionlink(session,0);
+            session->recvlen = 0;   //clear text received after AUTH is discarded
+            if (thr.Create(_connect,(void *)session) == 0) {
+                psiteinfo->WriteToProgLog("MAIN","WARNING: unable to create a new client thread.");
+                _sessionclose(session);
+            }
+            return;
+        }
+    }
+
+    if (session->flageof != 0 && _sessionpeek(session) == 0 && pftps->GetFlagQuit() == 0 && siteinfoFlagQuit == 0) {
+            //the client disconnected
+        if (flagpool == 0 && _filepool.Submit(_sessionjob,(void *)session) != 0)
+            return;
+        psiteinfo->WriteToProgLog("MAIN","Error connecting to client (%s disconnected).",pftps->GetLogin());
+        pftps->DoQUIT(0,NULL);
+    }
+
+    if (pftps->GetFlagQuit() != 0 || siteinfoFlagQuit != 0) {
+            //closing waits for the transfer threads
+        if (flagpool == 0 && _filepool.Submit(_sessionjob,(void *)session) != 0)
+            return;
+        _reactor.Remove(pftps->GetSocketDesc());
+        _sessionlink(session,0);
+        _sessionclose(session);
+        return;
+    }
+
+        //wait for the next command (must be the last access to "session")
+    _reactor.Rearm(pftps->GetSocketDesc(),(void *)session);
+}
+
+    //Get the length of the first complete command line in the receive
+    //buffer of a session (including the '\n').
+    //Returns 0 if no complete command line was received.
+static int _sessionpeek(_Session_t *session)
+{
+    char *ptr;
+
+    if (session->recvlen == 0)
+        return(0);
+
+    if ((ptr = (char *)memchr(session->recvbuf,'\n',session->recvlen)) != NULL)
+        return(ptr - session->recvbuf + 1);
+
+        //a line longer than the buffer is split (like CSock::RecvLn())
+        //and a partial line is run when the connection is closed
+    if (session->recvlen == (int)sizeof(session->recvbuf) || session->flageof != 0)
+        return(session->recvlen);
+
+    return(0);
+}
+
+    //Adds (flaglink != 0) or removes (flaglink == 0) a session from the
+    //list of the sessions registered with the reactor.
+static void _sessionlink(_Session_t *session, int flaglink)
+{
+    CThr thr;
+
+    thr.P(&_mutexsession);
+    if (flaglink != 0) {
+        session->prev = NULL;
+        session->next = _sessionlist;
+        if (_sessionlist != NULL) _sessionlist->prev = session;
+        _sessionlist = session;
+    } else {
+        if (session->prev != NULL)
+            session->prev->next = session->next;
+        else if (_sessionlist == session)
+            _sessionlist = session->next;
+        if (session->next != NULL) session->next->prev = session->prev;
+        session->prev = session->next = NULL;
+    }
+    thr.V(&_mutexsession);
+}
@@ -0,0 +1,1401 @@
+/* async.c
+ *
+ * Copyright (c) 2026 The LibNcFTP contributors.
+ * Distributed under the same terms as the rest of LibNcFTP.
+ *
+ * Non-blocking versions of opening a host, sending a command, and
+ * transferring a file or a directory listing.  Each operation is a
+ * small state machine kept in a FTPAsyncOp, which says which descriptor
+ * it is waiting on and for what.  The application's own event loop
+ * (poll, select, kqueue, ...) calls FTPAsyncStep() when it is ready,
+ * so one thread can drive many sessions.  FTPAsyncRun() is a blocking
+ * loop for a single operation.
+ *
+ * These use the same reply, command, and PASV parsing as the rest of
+ * the library, but only do what most sessions need: no firewall
+ * logins, PASV data connections only, no restarts, and binary uploads.
+ * Looking up the host name is still done with a blocking call.
+ */
+
+#include "syshdrs.h"
+#ifdef PRAGMA_HDRSTOP
+#	pragma hdrstop
+#endif
+
+#ifndef NO_SIGNALS
+#	define NO_SIGNALS 1
+#endif
+
+#ifndef MSG_NOSIGNAL
+#	define MSG_NOSIGNAL 0
+#endif
+
+/* What the operation is. */
+#define kAsyncOpen			1
+#define kAsyncCmd			2
+#define kAsyncGet			3
+#define kAsyncPut			4
+#define kAsyncList			5
+#define kAsyncClose			6
+
+/* What it is waiting for. */
+#define kAsyncStateConnect		1	/* connect() of the control connection */
+#define kAsyncStateSend			2	/* To write aop->cmd */
+#define kAsyncStateReply		3	/* To read a reply */
+#define kAsyncStateDataConnect		4	/* connect() of the data connection */
+#define kAsyncStateData			5	/* To transfer the data */
+
+/* Which reply it is reading. */
+#define kAsyncPhaseBanner		1
+#define kAsyncPhaseLogin		2
+#define kAsyncPhasePWD			3
+#define kAsyncPhaseFEAT			4
+#define kAsyncPhaseCmd			5
+#define kAsyncPhaseTYPE			6
+#define kAsyncPhasePASV			7
+#define kAsyncPhaseDataCmd		8
+#define kAsyncPhaseDataEnd		9
+#define kAsyncPhaseQUIT			10
+#define kAsyncPhaseMODE			11
+
+static int AsyncStartReply(const FTPAsyncOpPtr aop, const int phase);
+
+
+
+
+static void
+AsyncInit(const FTPCIPtr cip, const FTPAsyncOpPtr aop, const int what)
+{
+	FTPAsyncDoneProc doneProc;
+	void *userData;
+
+	doneProc = aop->doneProc;
+	userData = aop->userData;
+	(void) memset(aop, 0, sizeof(FTPAsyncOp));
+	aop->doneProc = doneProc;
+	aop->userData = userData;
+	aop->cip = cip;
+	aop->fd = kClosedFileDescriptor;
+	aop->sockfd = kClosedFileDescriptor;
+	aop->localfd = kClosedFileDescriptor;
+	aop->result = kAsyncPending;
+	aop->what = what;
+}	/* AsyncInit */
+
+
+
+
+static void
+AsyncWait(const FTPAsyncOpPtr aop, const int fd, const int events, const unsigned int tlen)
+{
+	aop->fd = fd;
+	aop->events = events;
+	aop->deadline = 0;
+	if (tlen > 0) {
+		aop->deadline = SMonoTimeMs() + ((unsigned long) tlen * 1000UL);
+		if (aop->deadline == 0)
+			aop->deadline = 1;
+	}
+}	/* AsyncWait */
+
+
+
+
+static int
+AsyncDone(const FTPAsyncOpPtr aop, const int result)
+{
+	if (aop->rp != NULL) {
+		DoneWithResponse(aop->cip, aop->rp);
+		aop->rp = NULL;
+	}
+	if (result < 0)
+		aop->cip->errNo = result;
+	(void) memset(aop->cmd, 0, sizeof(aop->cmd));
+	aop->fd = kClosedFileDescriptor;
+	aop->events = 0;
+	aop->deadline = 0;
+	aop->result = result;
+	if (aop->doneProc != (FTPAsyncDoneProc) 0)
+		(*aop->doneProc)(aop);
+	return (result);
+}	/* AsyncDone */
+
+
+
+
+static void
+AsyncDisconnected(const FTPCIPtr cip)
+{
+	FTPCloseControlConnection(cip);
+	FTPDeallocateHost(cip);
+	if (cip->disconnectTime.tv_sec == 0)
+		(void) gettimeofday(&cip->disconnectTime, NULL);
+}	/* AsyncDisconnected */
+
+
+
+
+/* Cleans up after an error, then finishes the operation. */
+static int
+AsyncFail(const FTPAsyncOpPtr aop, int result)
+{
+	const FTPCIPtr cip = aop->cip;
+
+	if (aop->sockfd != kClosedFileDescriptor) {
+		(void) SClose(aop->sockfd, 3);
+		aop->sockfd = kClosedFileDescriptor;
+	}
+	if (aop->rp != NULL) {
+		DoneWithResponse(cip, aop->rp);
+		aop->rp = NULL;
+	}
+
+	switch (aop->what) {
+		case kAsyncOpen:
+			/* Like FTPOpenHost, hang up if the login didn't work. */
+			FTPShutdownHost(cip);
+			if ((aop->anonLogin == 0) && (cip->leavePass == 0)) {
+				switch (result) {
+					case kErrConnectRetryableErr:
+					case kErrConnectRefused:
+					case kErrRemoteHostClosedConnection:
+					case kErrHostDisconnectedDuringLogin:
+						break;
+					default:
+						/* Don't leave cleartext password in memory,
+						 * since we won't be redialing.
+						 */
+						(void) memset(cip->pass, '*', sizeof(cip->pass) - 1);
+				}
+			}
+			break;
+		case kAsyncClose:
+			/* We were hanging up anyway. */
+			AsyncDisconnected(cip);
+			result = kNoErr;
+			break;
+		default:
+			if (cip->dataSocket != kClosedFileDescriptor) {
+				(void) SetSocketLinger(cip->dataSocket, 0, 0);
+				CloseDataConnection(cip);
+			}
+			break;
+	}
+	return (AsyncDone(aop, result));
+}	/* AsyncFail */
+
+
+
+
+static int
+AsyncSendCmdV(const FTPAsyncOpPtr aop, const int phase, const char *const cmdspec, va_list ap)
+{
+	const FTPCIPtr cip = aop->cip;
+	int result;
+
+#ifdef HAVE_VSNPRINTF
+	(void) vsnprintf(aop->cmd, sizeof(aop->cmd) - 1, cmdspec, ap);
+	aop->cmd[sizeof(aop->cmd) - 1] = '\0';
+#else
+	(void) vsprintf(aop->cmd, cmdspec, ap);
+#endif
+	result = FTPPrepareCommandStr(cip, aop->cmd, sizeof(aop->cmd));
+	if (result < 0)
+		return (AsyncFail(aop, result));
+
+	aop->cmdLen = strlen(aop->cmd);
+	aop->cmdSent = 0;
+	aop->phase = phase;
+	aop->state = kAsyncStateSend;
+	AsyncWait(aop, cip->ctrlSocketW, kAsyncWantWrite, cip->ctrlTimeout);
+	return (kAsyncPending);
+}	/* AsyncSendCmdV */
+
+
+
+
+/*VARARGS*/
+static int
+AsyncSendCmd(const FTPAsyncOpPtr aop, const int phase, const char *const cmdspec, ...)
+#if (defined(__GNUC__)) && (__GNUC__ >= 2)
+__attribute__ ((format (printf, 3, 4)))
+#endif
+;
+
+static int
+AsyncSendCmd(const FTPAsyncOpPtr aop, const int phase, const char *const cmdspec, ...)
+{
+	va_list ap;
+	int result;
+
+	va_start(ap, cmdspec);
+	result = AsyncSendCmdV(aop, phase, cmdspec, ap);
+	va_end(ap);
+	return (result);
+}	/* AsyncSendCmd */
+
+
+
+
+static int
+AsyncWriteCmd(const FTPAsyncOpPtr aop)
+{
+	const FTPCIPtr cip = aop->cip;
+	send_return_t nwrote;
+
+	nwrote = send(cip->ctrlSocketW, aop->cmd + aop->cmdSent, (send_size_t) (aop->cmdLen - aop->cmdSent), MSG_NOSIGNAL);
+	if (nwrote < 0) {
+		if ((errno == EINTR) || (errno == EAGAIN))
+			return (kAsyncPending);
+		FTPLogError(cip, kDoPerror, "Could not write to control stream.\n");
+		FTPShutdownHost(cip);
+		return (AsyncFail(aop, kErrSocketWriteFailed));
+	}
+	aop->cmdSent += (size_t) nwrote;
+	if (aop->cmdSent < aop->cmdLen)
+		return (kAsyncPending);
+
+	/* Don't leave a password lying around. */
+	(void) memset(aop->cmd, 0, sizeof(aop->cmd));
+	return (AsyncStartReply(aop, aop->phase));
+}	/* AsyncWriteCmd */
+
+
+
+
+/* Takes what it can of a reply from the control connection's buffer,
+ * and fills the buffer with one read if it is empty and canRead is
+ * set.  It stops at the end of the reply, so anything the server
+ * sent after it is left for the next one.
+ *
+ * Returns 1 if the reply is complete, 0 if more is needed, or an
+ * error code.
+ */
+static int
+AsyncReadReply(const FTPAsyncOpPtr aop, int canRead)
+{
+	const FTPCIPtr cip = aop->cip;
+	SReadlineInfo *const srl = &cip->ctrlSrl;
+	ResponsePtr rp = aop->rp;
+	recv_return_t nread;
+	int c, result;
+
+	for (;;) {
+		if (srl->bufPtr >= srl->bufLim) {
+			if (canRead == 0)
+				return (0);
+			canRead = 0;
+			nread = recv(cip->ctrlSocketR, srl->buf, (recv_size_t) srl->bufSizeMax, 0);
+			if (nread < 0) {
+				if ((errno == EINTR) || (errno == EAGAIN))
+					return (0);
+				FTPLogError(cip, kDoPerror, "Could not read reply from control connection");
+				FTPShutdownHost(cip);
+				return (kErrInvalidReplyFromServer);
+			} else if (nread == 0) {
+				rp->hadEof = 1;
+				if (rp->eofOkay != 0)
+					return (1);
+				FTPLogError(cip, kDontPerror, "Remote host has closed the connection.\n");
+				FTPShutdownHost(cip);
+				return (kErrRemoteHostClosedConnection);
+			}
+			srl->bufPtr = srl->buf;
+			srl->bufLim = srl->buf + nread;
+			srl->bufSize = (size_t) nread;
+
+			/* Got something, so start the timeout over. */
+			AsyncWait(aop, cip->ctrlSocketR, kAsyncWantRead, cip->ctrlTimeout);
+		}
+
+		c = (int) *srl->bufPtr++;
+		if ((c == '\r') || (c == '\0'))
+			continue;
+		if (c != '\n') {
+			if (aop->lineLen < (sizeof(aop->line) - 1))
+				aop->line[aop->lineLen++] = (char) c;
+			continue;
+		}
+
+		aop->line[aop->lineLen] = '\0';
+		if ((aop->firstLine != 0) && (aop->lineLen == 0)) {
+			/* Blank lines are violation of protocol, but try to be
+			 * lenient with broken servers.
+			 */
+			FTPLogError(cip, kDontPerror, "Protocol violation by server: blank line on control.\n");
+			continue;
+		}
+		aop->lineLen = 0;
+		result = AddResponseLine(cip, rp, aop->line, aop->replyCode, aop->firstLine);
+		aop->firstLine = 0;
+		if (result < 0)
+			return (result);
+		if (result == 0) {
+			result = EndResponse(cip, rp);
+			if (result < 0)
+				return (result);
+			return (1);
+		}
+	}
+}	/* AsyncReadReply */
+
+
+
+
+static int
+AsyncStartXferData(const FTPAsyncOpPtr aop)
+{
+	const FTPCIPtr cip = aop->cip;
+
+	cip->netMode = (aop->what == kAsyncPut) ? kNetWriting : kNetReading;
+	cip->dataSocketConnected = 1;
+
+	/* Close the half of the bidirectional pipe that we won't be using. */
+	if (cip->shutdownUnusedSideOfSockets != 0)
+		(void) shutdown(cip->dataSocket, ((cip->netMode == kNetReading) ? 1 : 0));
+
+	aop->bufLen = aop->bufSent = 0;
+	aop->sawCR = 0;
+	aop->state = kAsyncStateData;
+	FTPStartIOTimer(cip);
+	AsyncWait(aop, cip->dataSocket, (aop->what == kAsyncPut) ? kAsyncWantWrite : kAsyncWantRead, cip->xferTimeout);
+	return (kAsyncPending);
+}	/* AsyncStartXferData */
+
+
+
+
+static int
+AsyncEndXferData(const FTPAsyncOpPtr aop)
+{
+	const FTPCIPtr cip = aop->cip;
+
+	if ((aop->sawCR != 0) && (aop->xferErr == 0))
+		(void) write(aop->localfd, "\r", (write_size_t) 1);
+
+	/* For uploads, this is what tells the server we're done. */
+	CloseDataConnection(cip);
+	FTPStopIOTimer(cip);
+	if (aop->xferErr == 0) {
+		if (aop->what == kAsyncGet)
+			cip->numDownloads++;
+		else if (aop->what == kAsyncPut)
+			cip->numUploads++;
+		else
+			cip->numListings++;
+	}
+
+	if (aop->sawFinalReply != 0)
+		return (AsyncDone(aop, aop->xferErr));
+	return (AsyncStartReply(aop, kAsyncPhaseDataEnd));
+}	/* AsyncEndXferData */
+
+
+
+
+static int
+AsyncWriteLocal(const FTPAsyncOpPtr aop, const char *buf, size_t n)
+{
+	write_return_t nwrote;
+
+	while (n > 0) {
+		nwrote = write(aop->localfd, buf, (write_size_t) n);
+		if (nwrote < 0) {
+			if (errno == EINTR)
+				continue;
+			return (-1);
+		}
+		buf += nwrote;
+		n -= (size_t) nwrote;
+	}
+	return (0);
+}	/* AsyncWriteLocal */
+
+
+
+
+static int
+AsyncRecvData(const FTPAsyncOpPtr aop)
+{
+	const FTPCIPtr cip = aop->cip;
+	recv_return_t nread;
+	char *src, *dst, *lim;
+
+	nread = recv(cip->dataSocket, cip->buf, (recv_size_t) cip->bufSize, 0);
+	if (nread < 0) {
+		if ((errno == EINTR) || (errno == EAGAIN))
+			return (kAsyncPending);
+#if defined(EWOULDBLOCK) && (EWOULDBLOCK != EAGAIN)
+		if (errno == EWOULDBLOCK)
+			return (kAsyncPending);
+#endif
+		FTPLogError(cip, kDoPerror, "Remote read failed after " PRINTF_LONG_LONG " bytes had been received.\n", cip->bytesTransferred);
+		aop->xferErr = kErrSocketReadFailed;
+		return (AsyncEndXferData(aop));
+	} else if (nread == 0) {
+		return (AsyncEndXferData(aop));
+	}
+	cip->bytesTransferred += (longest_int) nread;
+
+	src = dst = cip->buf;
+	lim = cip->buf + nread;
+#if !((defined(WIN32) || defined(_WINDOWS)) && !defined(__CYGWIN__))
+	if (aop->xtype == kTypeAscii) {
+		/* Change the network's CR+LF into our LF. */
+		if (aop->sawCR != 0) {
+			aop->sawCR = 0;
+			if ((*src != '\n') && (AsyncWriteLocal(aop, "\r", 1) < 0))
+				goto writeErr;
+		}
+		while (src < lim) {
+			if (*src == '\r') {
+				if (src + 1 == lim) {
+					aop->sawCR = 1;
+					break;
+				}
+				if (src[1] == '\n') {
+					src++;
+					continue;
+				}
+			}
+			*dst++ = *src++;
+		}
+		lim = dst;
+	}
+#endif
+	if (AsyncWriteLocal(aop, cip->buf, (size_t) (lim - cip->buf)) < 0)
+		goto writeErr;
+
+	FTPUpdateIOTimer(cip);
+	AsyncWait(aop, cip->dataSocket, kAsyncWantRead, cip->xferTimeout);
+	return (kAsyncPending);
+
+writeErr:
+	FTPLogError(cip, kDoPerror, "Local write failed.\n");
+	aop->xferErr = kErrWriteFailed;
+	return (AsyncEndXferData(aop));
+}	/* AsyncRecvData */
+
+
+
+
+static int
+AsyncSendData(const FTPAsyncOpPtr aop)
+{
+	const FTPCIPtr cip = aop->cip;
+	read_return_t nread;
+	send_return_t nwrote;
+
+	if (aop->bufSent >= aop->bufLen) {
+		do {
+			nread = read(aop->localfd, cip->buf, (read_size_t) cip->bufSize);
+		} while ((nread < 0) && (errno == EINTR));
+		if (nread < 0) {
+			FTPLogError(cip, kDoPerror, "Local read failed.\n");
+			aop->xferErr = kErrReadFailed;
+			return (AsyncEndXferData(aop));
+		} else if (nread == 0) {
+			return (AsyncEndXferData(aop));
+		}
+		aop->bufLen = (size_t) nread;
+		aop->bufSent = 0;
+	}
+
+	nwrote = send(cip->dataSocket, cip->buf + aop->bufSent, (send_size_t) (aop->bufLen - aop->bufSent), MSG_NOSIGNAL);
+	if (nwrote < 0) {
+		if ((errno == EINTR) || (errno == EAGAIN))
+			return (kAsyncPending);
+#if defined(EWOULDBLOCK) && (EWOULDBLOCK != EAGAIN)
+		if (errno == EWOULDBLOCK)
+			return (kAsyncPending);
+#endif
+		FTPLogError(cip, kDoPerror, "Remote write failed after " PRINTF_LONG_LONG " bytes had been sent.\n", cip->bytesTransferred);
+		aop->xferErr = kErrSocketWriteFailed;
+		return (AsyncEndXferData(aop));
+	}
+	aop->bufSent += (size_t) nwrote;
+	cip->bytesTransferred += (longest_int) nwrote;
+	FTPUpdateIOTimer(cip);
+	AsyncWait(aop, cip->dataSocket, kAsyncWantWrite, cip->xferTimeout);
+	return (kAsyncPending);
+}	/* AsyncSendData */
+
+
+
+
+static int
+AsyncXferFailed(const FTPAsyncOpPtr aop)
+{
+	if (aop->what == kAsyncGet)
+		return (kErrRETRFailed);
+	if (aop->what == kAsyncPut)
+		return (kErrSTORFailed);
+	return (kErrLISTFailed);
+}	/* AsyncXferFailed */
+
+
+
+
+static int
+AsyncDataConnected(const FTPAsyncOpPtr aop)
+{
+	const FTPCIPtr cip = aop->cip;
+	char servDataAddrStr[64];
+
+	AddrToAddrStr(servDataAddrStr, sizeof(servDataAddrStr), &cip->servDataAddr, 0, NULL);
+	if (SConnectFinish(cip->dataSocket) < 0) {
+		FTPLogError(cip, kDoPerror, "connect to %s failed.\n", servDataAddrStr);
+		return (AsyncFail(aop, kErrConnectDataSocket));
+	}
+	if (GetSocketAddress(cip, cip->dataSocket, &cip->ourDataAddr) < 0)
+		return (AsyncFail(aop, kErrGetSockName));
+	PrintF(cip, "Connected to %s for PASV.\n", servDataAddrStr);
+	cip->hasPASV = kCommandAvailable;
+
+	(void) SetSocketKeepAlive(cip->dataSocket, 1);
+
+	/* Data connection is a non-interactive data stream, so
+	 * high throughput is desired, at the expense of low
+	 * response time.
+	 */
+	(void) SetSocketTypeOfService(cip->dataSocket, IPTOS_THROUGHPUT);
+
+	return (AsyncSendCmd(aop, kAsyncPhaseDataCmd, "%s", aop->dataCmd));
+}	/* AsyncDataConnected */
+
+
+
+
+static int
+AsyncOpenDataConnection(const FTPAsyncOpPtr aop)
+{
+	const FTPCIPtr cip = aop->cip;
+	int dataSocket;
+	int weirdPort = 0;
+	int result;
+
+	cip->servDataAddr = cip->servCtlAddr;
+	cip->servDataAddr.sin_family = AF_INET;
+	cip->ourDataAddr = cip->ourCtlAddr;
+	cip->ourDataAddr.sin_family = AF_INET;
+
+	result = FTPParsePassiveReply(cip, aop->rp, &cip->servDataAddr, &weirdPort);
+	DoneWithResponse(cip, aop->rp);
+	aop->rp = NULL;
+	if (result != kNoErr) {
+		FTPLogError(cip, kDontPerror, "Passive mode refused.\n");
+		if (result < 0)
+			cip->hasPASV = kCommandNotAvailable;
+		return (AsyncFail(aop, kErrPassiveModeFailed));
+	}
+	FTPFixServerDataAddr(cip);
+
+	dataSocket = socket(AF_INET, SOCK_STREAM, 0);
+	if (dataSocket < 0) {
+		FTPLogError(cip, kDoPerror, "Could not get a data socket.\n");
+		return (AsyncFail(aop, kErrNewStreamSocket));
+	}
+	cip->dataSocket = dataSocket;
+
+	FTPSetDataSocketBufSize(cip, dataSocket);
+	if (BindToEphemeralPortNumber(dataSocket, &cip->ourDataAddr, (int) cip->ephemLo, (int) cip->ephemHi) < 0) {
+		FTPLogError(cip, kDoPerror, "Could not bind the data socket");
+		return (AsyncFail(aop, kErrBindDataSocket));
+	}
+
+	result = SConnectStart(dataSocket, &cip->servDataAddr);
+	if (result == 0)
+		return (AsyncDataConnected(aop));
+	if (result < 0) {
+		FTPLogError(cip, kDoPerror, "Could not connect the data socket.\n");
+		return (AsyncFail(aop, (weirdPort > 0) ? kErrServerSentBogusPortNumber : kErrConnectDataSocket));
+	}
+	aop->state = kAsyncStateDataConnect;
+	AsyncWait(aop, dataSocket, kAsyncWantWrite, cip->connTimeout);
+	return (kAsyncPending);
+}	/* AsyncOpenDataConnection */
+
+
+
+
+static int
+AsyncStartPassive(const FTPAsyncOpPtr aop)
+{
+	const FTPCIPtr cip = aop->cip;
+
+	if (cip->hasPASV == kCommandNotAvailable) {
+		FTPLogError(cip, kDontPerror, "The FTPAsync routines need passive mode, which this server does not have.\n");
+		return (AsyncFail(aop, kErrPassiveModeFailed));
+	}
+	return (AsyncSendCmd(aop, kAsyncPhasePASV, "PASV"));
+}	/* AsyncStartPassive */
+
+
+
+
+static int
+AsyncStartType(const FTPAsyncOpPtr aop)
+{
+	const FTPCIPtr cip = aop->cip;
+
+	if (cip->curTransferType != aop->xtype)
+		return (AsyncSendCmd(aop, kAsyncPhaseTYPE, "TYPE %c", aop->xtype));
+	return (AsyncStartPassive(aop));
+}	/* AsyncStartType */
+
+
+
+
+static int
+AsyncStartXfer(const FTPCIPtr cip, const FTPAsyncOpPtr aop, const int what, const int xtype, const int localfd, const char *const cmd, const char *const arg)
+{
+	AsyncInit(cip, aop, what);
+	aop->xtype = xtype;
+	aop->localfd = localfd;
+	(void) STRNCPY(aop->dataCmd, cmd);
+	if ((arg != NULL) && (arg[0] != '\0')) {
+		(void) STRNCAT(aop->dataCmd, " ");
+		(void) STRNCAT(aop->dataCmd, arg);
+	}
+
+	cip->cancelXfer = 0;
+	cip->canceled = 0;
+	cip->dataSocketConnected = 0;
+	FTPInitIOTimer(cip);
+	if (what != kAsyncList) {
+		/* Skip the "RETR " or "STOR ". */
+		cip->rname = aop->dataCmd + 5;
+	}
+
+	/* These routines only do stream mode, so undo a
+	 * MODE Z left over from a blocking transfer.
+	 */
+	if ((cip->curTransferMode != 0) && (cip->curTransferMode != kTransferModeStream))
+		return (AsyncSendCmd(aop, kAsyncPhaseMODE, "MODE S"));
+	return (AsyncStartType(aop));
+}	/* AsyncStartXfer */
+
+
+
+
+static int
+AsyncQueryFeatures(const FTPAsyncOpPtr aop)
+{
+	const FTPCIPtr cip = aop->cip;
+
+	if ((FTPPresetServerFeatures(cip) != 0) || (cip->hasFEAT == kCommandNotAvailable)) {
+		FTPManualOverrideFeatures(cip);
+		return (AsyncDone(aop, kNoErr));
+	}
+	return (AsyncSendCmd(aop, kAsyncPhaseFEAT, "FEAT"));
+}	/* AsyncQueryFeatures */
+
+
+
+
+static int
+AsyncLoggedIn(const FTPAsyncOpPtr aop)
+{
+	const FTPCIPtr cip = aop->cip;
+
+	/* Do the application's login message callback, if present. */
+	if (cip->onLoginMsgProc != 0)
+		(*cip->onLoginMsgProc)(cip, aop->rp);
+	DoneWithResponse(cip, aop->rp);
+	aop->rp = NULL;
+	cip->loggedIn = 1;
+
+	if (cip->startingWorkingDirectory != NULL) {
+		free(cip->startingWorkingDirectory);
+		cip->startingWorkingDirectory = NULL;
+	}
+	if ((cip->currentWorkingDirectory == NULL) && (cip->currentWorkingDirectorySize > 0)) {
+		cip->currentWorkingDirectory = malloc(cip->currentWorkingDirectorySize);
+		if (cip->currentWorkingDirectory == NULL)
+			cip->currentWorkingDirectorySize = 0;
+		else
+			memset(cip->currentWorkingDirectory, 0, cip->currentWorkingDirectorySize);
+	}
+
+	/* When a new site is opened, ASCII mode is assumed (by protocol). */
+	cip->curTransferType = 'A';
+	cip->curTransferMode = kTransferModeStream;
+	PrintF(cip, "Logged in to %s as %s.\n", cip->host, cip->user);
+
+	/* Don't leave cleartext password in memory, since we
+	 * are logged in and do not need it any more.
+	 */
+	if ((aop->anonLogin == 0) && (cip->leavePass == 0))
+		(void) memset(cip->pass, '*', sizeof(cip->pass) - 1);
+
+	(void) gettimeofday(&cip->loginTime, NULL);
+
+	if (cip->doNotGetStartingWorkingDirectory == 0)
+		return (AsyncSendCmd(aop, kAsyncPhasePWD, "PWD"));
+	return (AsyncQueryFeatures(aop));
+}	/* AsyncLoggedIn */
+
+
+
+
+/* The login part of FTPLoginHost(), without the firewall types. */
+static int
+AsyncLoginReply(const FTPAsyncOpPtr aop)
+{
+	const FTPCIPtr cip = aop->cip;
+	const ResponsePtr rp = aop->rp;
+
+	switch (rp->code) {
+		case 230:	/* 230 User logged in, proceed. */
+		case 231:	/* User name accepted. */
+		case 202:	/* Command not implemented, superfluous at this site. */
+			return (AsyncLoggedIn(aop));
+
+		case 331:	/* 331 User name okay, need password. */
+			if ((cip->pass[0] == '\0') && (cip->passIsEmpty == 0) && (cip->passphraseProc != kNoFTPGetPassphraseProc))
+				(*cip->passphraseProc)(cip, &rp->msg, cip->pass, sizeof(cip->pass));
+			aop->sentPass++;
+			return (AsyncSendCmd(aop, kAsyncPhaseLogin, "PASS %s", cip->pass));
+
+		case 332:	/* 332 Need account for login. */
+		case 532: 	/* 532 Need account for storing files. */
+			return (AsyncSendCmd(aop, kAsyncPhaseLogin, "ACCT %s", cip->acct));
+
+		case 530:	/* Not logged in. */
+			return (AsyncFail(aop, (aop->sentPass != 0) ? kErrBadRemoteUserOrPassword : kErrBadRemoteUser));
+
+		case 501:	/* Syntax error in parameters or arguments. */
+		case 503:	/* Bad sequence of commands. */
+		case 550:	/* Can't set guest privileges. */
+			break;
+
+		default:
+			FTPLogError(cip, kDontPerror, "Unexpected response: %s\n", (rp->msg.first != NULL) ? rp->msg.first->line : "");
+			break;
+	}
+	return (AsyncFail(aop, kErrLoginHostMiscErr));
+}	/* AsyncLoginReply */
+
+
+
+
+static int
+AsyncStartLogin(const FTPAsyncOpPtr aop)
+{
+	const FTPCIPtr cip = aop->cip;
+
+	aop->anonLogin = 0;
+	if (cip->user[0] == '\0')
+		(void) STRNCPY(cip->user, "anonymous");
+	if ((strcmp(cip->user, "anonymous") == 0) || (strcmp(cip->user, "ftp") == 0)) {
+		aop->anonLogin = 1;
+		/* Try to get the email address if you didn't specify
+		 * a password when the user is anonymous.
+		 */
+		if ((cip->pass[0] == '\0') && (cip->passIsEmpty == 0)) {
+			FTPInitializeAnonPassword(cip->lip);
+			(void) STRNCPY(cip->pass, cip->lip->defaultAnonPassword);
+		}
+	}
+	return (AsyncSendCmd(aop, kAsyncPhaseLogin, "USER %s", cip->user));
+}	/* AsyncStartLogin */
+
+
+
+
+/* Called with each complete reply, to decide what to do next. */
+static int
+AsyncGotReply(const FTPAsyncOpPtr aop)
+{
+	const FTPCIPtr cip = aop->cip;
+	const ResponsePtr rp = aop->rp;
+	char cwd[512];
+
+	aop->code = rp->code;
+	switch (aop->phase) {
+		case kAsyncPhaseBanner:
+			FTPExamineConnectMessage(cip, rp);
+			if (rp->codeType >= 4) {
+				/* They probably hung up on us right away.  That's
+				 * too bad, but we can tell the caller that they can
+				 * call back later and try again.
+				 */
+				FTPLogError(cip, kDontPerror, "Server hungup immediately after connect.\n");
+				return (AsyncFail(aop, kErrConnectRetryableErr));
+			}
+			DoneWithResponse(cip, rp);
+			aop->rp = NULL;
+			cip->connected = 1;
+			(void) gettimeofday(&cip->connectTime, NULL);
+			PrintF(cip, "Connected to %s.\n", cip->host);
+			return (AsyncStartLogin(aop));
+
+		case kAsyncPhaseLogin:
+			return (AsyncLoginReply(aop));
+
+		case kAsyncPhasePWD:
+			if (rp->codeType == 2) {
+				cwd[0] = '\0';
+				cwd[sizeof(cwd) - 2] = '\0';
+				FTPExaminePWDReply(cip, rp, cwd, sizeof(cwd));
+				if ((cwd[0] != '\0') && (cwd[sizeof(cwd) - 2] == '\0'))
+					cip->startingWorkingDirectory = StrDup(cwd);
+			}
+			DoneWithResponse(cip, rp);
+			aop->rp = NULL;
+			return (AsyncQueryFeatures(aop));
+
+		case kAsyncPhaseFEAT:
+			FTPExamineFeatReply(cip, rp, rp->codeType);
+			DoneWithResponse(cip, rp);
+			aop->rp = NULL;
+			/* Do this again in case the features changed
+			 * anything that the user wants to use.
+			 */
+			FTPManualOverrideFeatures(cip);
+			return (AsyncDone(aop, kNoErr));
+
+		case kAsyncPhaseCmd:
+			return (AsyncDone(aop, rp->codeType));
+
+		case kAsyncPhaseMODE:
+			if (rp->codeType != 2)
+				return (AsyncFail(aop, kErrMODEFailed));
+			cip->curTransferMode = kTransferModeStream;
+			DoneWithResponse(cip, rp);
+			aop->rp = NULL;
+			return (AsyncStartType(aop));
+
+		case kAsyncPhaseTYPE:
+			if (rp->codeType != 2)
+				return (AsyncFail(aop, kErrTYPEFailed));
+			cip->curTransferType = aop->xtype;
+			DoneWithResponse(cip, rp);
+			aop->rp = NULL;
+			return (AsyncStartPassive(aop));
+
+		case kAsyncPhasePASV:
+			return (AsyncOpenDataConnection(aop));
+
+		case kAsyncPhaseDataCmd:
+			if (rp->codeType > 2) {
+				/* They can't do it; the reply says why. */
+				return (AsyncFail(aop, AsyncXferFailed(aop)));
+			}
+			if (rp->codeType == 2) {
+				/* Nothing more coming on the control connection. */
+				aop->sawFinalReply = 1;
+			}
+			DoneWithResponse(cip, rp);
+			aop->rp = NULL;
+			return (AsyncStartXferData(aop));
+
+		case kAsyncPhaseDataEnd:
+			if (aop->xferErr != 0)
+				return (AsyncDone(aop, aop->xferErr));
+			if (rp->codeType != 2)
+				return (AsyncFail(aop, AsyncXferFailed(aop)));
+			return (AsyncDone(aop, kNoErr));
+
+		case kAsyncPhaseQUIT:
+			DoneWithResponse(cip, rp);
+			aop->rp = NULL;
+			AsyncDisconnected(cip);
+			return (AsyncDone(aop, kNoErr));
+	}
+	return (AsyncFail(aop, kErrBadParameter));
+}	/* AsyncGotReply */
+
+
+
+
+static int
+AsyncContinueReply(const FTPAsyncOpPtr aop, const int canRead)
+{
+	int result;
+
+	result = AsyncReadReply(aop, canRead);
+	if (result == 0)
+		return (kAsyncPending);
+	if (result < 0) {
+		if ((aop->phase == kAsyncPhaseLogin) && (aop->rp->code == 421))
+			result = kErrHostDisconnectedDuringLogin;
+		return (AsyncFail(aop, result));
+	}
+	return (AsyncGotReply(aop));
+}	/* AsyncContinueReply */
+
+
+
+
+static int
+AsyncStartReply(const FTPAsyncOpPtr aop, const int phase)
+{
+	const FTPCIPtr cip = aop->cip;
+
+	if (aop->rp != NULL)
+		DoneWithResponse(cip, aop->rp);
+	aop->rp = InitResponse();
+	if (aop->rp == NULL) {
+		FTPLogError(cip, kDontPerror, "Malloc failed.\n");
+		return (AsyncFail(aop, kErrMallocFailed));
+	}
+	if (phase == kAsyncPhaseFEAT)
+		aop->rp->printMode = (kResponseNoPrint|kResponseNoSave);
+	if (phase == kAsyncPhaseQUIT)
+		aop->rp->eofOkay = 1;	/* We are expecting EOF after this cmd. */
+
+	aop->phase = phase;
+	aop->state = kAsyncStateReply;
+	aop->firstLine = 1;
+	aop->lineLen = 0;
+	AsyncWait(aop, cip->ctrlSocketR, kAsyncWantRead, cip->ctrlTimeout);
+
+	/* The reply may already be in the buffer. */
+	return (AsyncContinueReply(aop, 0));
+}	/* AsyncStartReply */
+
+
+
+
+static int
+AsyncControlConnected(const FTPAsyncOpPtr aop)
+{
+	const FTPCIPtr cip = aop->cip;
+	int sockfd;
+
+	sockfd = aop->sockfd;
+	aop->sockfd = kClosedFileDescriptor;
+
+	/* Just the connecting is done without blocking; from here on,
+	 * we only read or write the control connection once it is ready,
+	 * so the blocking routines can use it too.
+	 */
+	(void) SSetNonBlocking(sockfd, 0);
+	cip->ctrlSocketR = sockfd;
+	cip->ctrlSocketW = sockfd;
+	cip->cout = NULL;
+	cip->cin = NULL;
+
+	/* Get our end of the socket address for later use. */
+	if (GetSocketAddress(cip, sockfd, &cip->ourCtlAddr) < 0)
+		return (AsyncFail(aop, kErrGetSockName));
+
+	/* We want Out-of-band data to appear in the regular stream,
+	 * since we can handle TELNET.
+	 */
+	(void) SetSocketInlineOutOfBandData(sockfd, 1);
+	(void) SetSocketKeepAlive(sockfd, 1);
+	(void) SetSocketLinger(sockfd, 0, 0);	/* Don't need it for ctrl. */
+
+	/* Control connection is somewhat interactive, so quick response
+	 * is desired.
+	 */
+	(void) SetSocketTypeOfService(sockfd, IPTOS_LOWDELAY);
+
+	if (InitSReadlineInfo(&cip->ctrlSrl, sockfd, cip->srlBuf, sizeof(cip->srlBuf), (int) cip->ctrlTimeout, 1) < 0) {
+		FTPLogError(cip, kDoPerror, "Could not fdopen.\n");
+		return (AsyncFail(aop, kErrFdopenW));
+	}
+	InetNtoA(cip->ip, &cip->servCtlAddr.sin_addr, sizeof(cip->ip));
+
+	/* Read the startup message from the server. */
+	return (AsyncStartReply(aop, kAsyncPhaseBanner));
+}	/* AsyncControlConnected */
+
+
+
+
+/* Tries to connect to the host's next address. */
+static int
+AsyncConnectNext(const FTPAsyncOpPtr aop)
+{
+	const FTPCIPtr cip = aop->cip;
+	struct sockaddr_in localAddr;
+	int sockfd;
+	int result;
+	int oerrno;
+
+	for (;;) {
+		if (aop->sockfd != kClosedFileDescriptor) {
+			oerrno = errno;
+			(void) SClose(aop->sockfd, 3);
+			aop->sockfd = kClosedFileDescriptor;
+			errno = oerrno;
+		}
+		if (++aop->curAddr >= aop->nAddrs)
+			return (AsyncFail(aop, FTPConnectError(cip, cip->host)));
+
+		(void) memcpy(&cip->servCtlAddr.sin_addr, &aop->addrs[aop->curAddr], sizeof(cip->servCtlAddr.sin_addr));
+		if ((sockfd = socket(cip->servCtlAddr.sin_family, SOCK_STREAM, 0)) < 0) {
+			FTPLogError(cip, kDoPerror, "Could not get a socket.\n");
+			return (AsyncFail(aop, kErrNewStreamSocket));
+		}
+		aop->sockfd = sockfd;
+
+		/* On rare occasions, the user may specify a local IP address to use. */
+		if (cip->preferredLocalAddr.sin_family != 0) {
+			localAddr = cip->preferredLocalAddr;
+			localAddr.sin_port = 0;
+			if (BindToEphemeralPortNumber(sockfd, &localAddr, (int) cip->ephemLo, (int) cip->ephemHi) < 0) {
+				FTPLogError(cip, kDoPerror, "Could not bind the control socket");
+				return (AsyncFail(aop, kErrBindCtrlSocket));
+			}
+		}
+		(void) SetSocketBufSize(sockfd, cip->ctrlSocketRBufSize, cip->ctrlSocketSBufSize);
+
+		result = SConnectStart(sockfd, &cip->servCtlAddr);
+		if (result == 0)
+			return (AsyncControlConnected(aop));
+		if (result > 0) {
+			aop->state = kAsyncStateConnect;
+			AsyncWait(aop, sockfd, kAsyncWantWrite, cip->connTimeout);
+			return (kAsyncPending);
+		}
+	}
+}	/* AsyncConnectNext */
+
+
+
+
+static int
+AsyncTimedOut(const FTPAsyncOpPtr aop)
+{
+	const FTPCIPtr cip = aop->cip;
+
+	switch (aop->state) {
+		case kAsyncStateConnect:
+			PrintF(cip, "Connection attempt timed-out.\n");
+#ifdef ETIMEDOUT
+			errno = ETIMEDOUT;
+#elif defined(WSAETIMEDOUT)
+			errno = WSAETIMEDOUT;
+#endif
+			return (AsyncConnectNext(aop));
+
+		case kAsyncStateDataConnect:
+			FTPLogError(cip, kDontPerror, "Data connection timed out.\n");
+			return (AsyncFail(aop, kErrConnectDataSocket));
+
+		case kAsyncStateData:
+			FTPLogError(cip, kDontPerror, "Data transfer timed out after " PRINTF_LONG_LONG " bytes.\n", cip->bytesTransferred);
+			cip->dataTimedOut = 1;
+			aop->xferErr = kErrDataTimedOut;
+			(void) SetSocketLinger(cip->dataSocket, 0, 0);
+			return (AsyncEndXferData(aop));
+	}
+
+	if (aop->phase == kAsyncPhaseQUIT) {
+		AsyncDisconnected(cip);
+		return (AsyncDone(aop, kNoErr));
+	}
+	FTPLogError(cip, kDontPerror, "Could not read reply from control connection -- timed out.\n");
+	FTPShutdownHost(cip);
+	return (AsyncFail(aop, kErrControlTimedOut));
+}	/* AsyncTimedOut */
+
+
+
+
+/* Moves the operation along, after its descriptor became ready for
+ * "revents" (kAsyncWantRead, kAsyncWantWrite), or with 0 if it wasn't
+ * ready in time.  Returns kAsyncPending, or the operation's result.
+ */
+int
+FTPAsyncStep(const FTPAsyncOpPtr aop, const int revents)
+{
+	if (aop == NULL)
+		return (kErrBadParameter);
+	if (aop->result != kAsyncPending)
+		return (aop->result);
+
+	if ((revents & aop->events) == 0) {
+		if ((aop->deadline != 0) && ((long) (SMonoTimeMs() - aop->deadline) >= 0))
+			return (AsyncTimedOut(aop));
+		return (kAsyncPending);
+	}
+
+	switch (aop->state) {
+		case kAsyncStateConnect:
+			if (SConnectFinish(aop->sockfd) < 0)
+				return (AsyncConnectNext(aop));
+			return (AsyncControlConnected(aop));
+		case kAsyncStateSend:
+			return (AsyncWriteCmd(aop));
+		case kAsyncStateReply:
+			return (AsyncContinueReply(aop, 1));
+		case kAsyncStateDataConnect:
+			return (AsyncDataConnected(aop));
+		case kAsyncStateData:
+			if (aop->what == kAsyncPut)
+				return (AsyncSendData(aop));
+			return (AsyncRecvData(aop));
+	}
+	return (AsyncFail(aop, kErrBadParameter));
+}	/* FTPAsyncStep */
+
+
+
+
+/* Returns how many milliseconds the operation can wait before it times
+ * out, or (-1) if it can wait forever.
+ */
+int
+FTPAsyncTimeLeft(const FTPAsyncOpPtr aop)
+{
+	long msec;
+
+	if ((aop == NULL) || (aop->result != kAsyncPending))
+		return (0);
+	if (aop->deadline == 0)
+		return (-1);
+	msec = (long) (aop->deadline - SMonoTimeMs());
+	if (msec < 0)
+		return (0);
+	return ((int) msec);
+}	/* FTPAsyncTimeLeft */
+
+
+
+
+/* Waits for and steps one operation until it is done. */
+int
+FTPAsyncRun(const FTPAsyncOpPtr aop)
+{
+	int result;
+
+	if (aop == NULL)
+		return (kErrBadParameter);
+
+	while (aop->result == kAsyncPending) {
+		result = SPollOne(aop->fd, ((aop->events & kAsyncWantWrite) != 0), FTPAsyncTimeLeft(aop));
+		if ((result < 0) && (errno == EINTR))
+			continue;
+		/* On an error, step anyway so the I/O call reports it. */
+		(void) FTPAsyncStep(aop, (result != 0) ? aop->events : 0);
+	}
+	return (aop->result);
+}	/* FTPAsyncRun */
+
+
+
+
+/* Gives up on the operation.  Since there is no telling where that
+ * left the control connection, this hangs up on the server, unless
+ * the operation was already done.
+ */
+int
+FTPAsyncCancel(const FTPAsyncOpPtr aop)
+{
+	if (aop == NULL)
+		return (kErrBadParameter);
+	if (aop->result != kAsyncPending)
+		return (aop->result);
+
+	aop->cip->cancelXfer = 1;
+	aop->cip->canceled = 1;
+	FTPShutdownHost(aop->cip);
+	if (aop->what == kAsyncClose)
+		return (AsyncFail(aop, kNoErr));
+	return (AsyncFail(aop, kErrUserCanceled));
+}	/* FTPAsyncCancel */
+
+
+
+
+/* Starts connecting and logging in to cip->host.  Like the other
+ * FTPAsync routines, this returns kAsyncPending, or the result if it
+ * finished right away; aop->doneProc is called either way.  A bad
+ * parameter is returned without starting anything.
+ *
+ * Unlike FTPOpenHost(), this doesn't redial, and a host name is looked
+ * up with the usual blocking call.  A numeric address in cip->host is
+ * used as is, without even the reverse lookup GetHostEntry() does, so
+ * nothing blocks.
+ */
+int
+FTPAsyncOpenHost(const FTPCIPtr cip, const FTPAsyncOpPtr aop)
+{
+	struct in_addr ip_address;
+	struct hostent hp;
+	char **curaddr;
+	unsigned int fport;
+	int hprc;
+	int result;
+
+	if ((cip == NULL) || (aop == NULL))
+		return (kErrBadParameter);
+	if ((memcmp(cip->magic, kLibraryMagic, kLibraryMagicLen) != 0) || (memcmp(cip->tailMagic, kLibraryMagic, kLibraryMagicLen) != 0))
+		return (kErrBadMagic);
+
+	if (cip->host[0] == '\0') {
+		cip->errNo = kErrNoHostSpecified;
+		return (kErrNoHostSpecified);
+	}
+	if (cip->firewallType != kFirewallNotInUse) {
+		FTPLogError(cip, kDontPerror, "FTPAsyncOpenHost cannot log in through a firewall.\n");
+		cip->errNo = kErrBadParameter;
+		return (kErrBadParameter);
+	}
+
+	FTPResetStatusVariables(cip);
+	FTPManualOverrideFeatures(cip);
+	FTPInitialLogEntry(cip);
+
+	result = FTPAllocateHost(cip);
+	if (result < 0)
+		return (result);
+
+	AsyncInit(cip, aop, kAsyncOpen);
+	cip->totalDials++;
+	cip->numDials = 1;
+
+	fport = cip->port;
+	if (fport == 0)
+		fport = cip->lip->defaultPort;
+	(void) ZERO(cip->servCtlAddr);
+	cip->servCtlAddr.sin_port = (unsigned short) htons((unsigned short) fport);
+	cip->cin = NULL;
+	cip->cout = NULL;
+
+	ip_address.s_addr = inet_addr(cip->host);
+	if (ip_address.s_addr != INADDR_NONE) {
+		cip->servCtlAddr.sin_family = AF_INET;
+		aop->addrs[0] = ip_address;
+		aop->nAddrs = 1;
+		(void) STRNCPY(cip->actualHost, cip->host);
+	} else if ((hprc = GetHostEntry(&hp, cip->host, &ip_address, cip->buf, cip->bufSize)) != 0) {
+#ifdef DNSSEC_LOCAL_VALIDATION
+		if (hprc == -2) {
+			FTPLogError(cip, kDontPerror, "%s: untrusted DNS response.\n", cip->host);
+			return (AsyncFail(aop, kErrHostUnknown));
+		}
+#endif
+		FTPLogError(cip, kDontPerror, "%s: unknown host.\n", cip->host);
+		return (AsyncFail(aop, kErrHostUnknown));
+	} else {
+		cip->servCtlAddr.sin_family = (sa_family_t) hp.h_addrtype;
+		for (curaddr = hp.h_addr_list; *curaddr != NULL; curaddr++) {
+			if (aop->nAddrs >= (int) (sizeof(aop->addrs) / sizeof(aop->addrs[0])))
+				break;
+			(void) memcpy(&aop->addrs[aop->nAddrs++], *curaddr, sizeof(aop->addrs[0]));
+		}
+		if (hp.h_name == NULL)
+			(void) STRNCPY(cip->actualHost, cip->host);
+		else
+			(void) STRNCPY(cip->actualHost, (const char *) hp.h_name);
+	}
+
+	aop->curAddr = -1;
+	return (AsyncConnectNext(aop));
+}	/* FTPAsyncOpenHost */
+
+
+
+
+/* Sends a command and reads its reply.  The result is the reply's
+ * code class (2 for a 2xx reply), like FTPCmd(), and aop->code has
+ * the whole number.
+ */
+/*VARARGS*/
+int
+FTPAsyncCmd(const FTPCIPtr cip, const FTPAsyncOpPtr aop, const char *const cmdspec, ...)
+{
+	va_list ap;
+	int result;
+
+	if ((cip == NULL) || (aop == NULL) || (cmdspec == NULL))
+		return (kErrBadParameter);
+	if (strcmp(cip->magic, kLibraryMagic))
+		return (kErrBadMagic);
+
+	AsyncInit(cip, aop, kAsyncCmd);
+	va_start(ap, cmdspec);
+	result = AsyncSendCmdV(aop, kAsyncPhaseCmd, cmdspec, ap);
+	va_end(ap);
+	return (result);
+}	/* FTPAsyncCmd */
+
+
+
+
+/* Downloads "file" in the current remote directory, writing it to the
+ * open descriptor "fd", which is not closed.  For kTypeAscii, the
+ * network's CR+LF line endings are changed to the local ones.
+ */
+int
+FTPAsyncGetOneFile(const FTPCIPtr cip, const FTPAsyncOpPtr aop, const char *const file, const int fd, const int xtype)
+{
+	if ((cip == NULL) || (aop == NULL) || (file == NULL) || (file[0] == '\0') || (fd < 0))
+		return (kErrBadParameter);
+	if (strcmp(cip->magic, kLibraryMagic))
+		return (kErrBadMagic);
+	if ((xtype != kTypeAscii) && (xtype != kTypeBinary))
+		return (kErrBadTransferType);
+
+	return (AsyncStartXfer(cip, aop, kAsyncGet, xtype, fd, "RETR", file));
+}	/* FTPAsyncGetOneFile */
+
+
+
+
+/* Uploads what can be read from the open descriptor "fd" (which is not
+ * closed) as "dstfile" on the server, in binary mode.
+ */
+int
+FTPAsyncPutOneFile(const FTPCIPtr cip, const FTPAsyncOpPtr aop, const char *const dstfile, const int fd)
+{
+	if ((cip == NULL) || (aop == NULL) || (dstfile == NULL) || (dstfile[0] == '\0') || (fd < 0))
+		return (kErrBadParameter);
+	if (strcmp(cip->magic, kLibraryMagic))
+		return (kErrBadMagic);
+
+	return (AsyncStartXfer(cip, aop, kAsyncPut, kTypeBinary, fd, "STOR", dstfile));
+}	/* FTPAsyncPutOneFile */
+
+
+
+
+/* Writes a listing of the current remote directory to "outfd", like
+ * FTPList().
+ */
+int
+FTPAsyncList(const FTPCIPtr cip, const FTPAsyncOpPtr aop, const int outfd, const int longMode, const char *const lsflag)
+{
+	if ((cip == NULL) || (aop == NULL) || (outfd < 0))
+		return (kErrBadParameter);
+	if (strcmp(cip->magic, kLibraryMagic))
+		return (kErrBadMagic);
+
+	return (AsyncStartXfer(cip, aop, kAsyncList, kTypeAscii, outfd, (longMode != 0) ? "LIST" : "NLST", lsflag));
+}	/* FTPAsyncList */
+
+
+
+
+/* Says goodbye to the server and closes the connection, like
+ * FTPCloseHost().
+ */
+int
+FTPAsyncCloseHost(const FTPCIPtr cip, const FTPAsyncOpPtr aop)
+{
+	if ((cip == NULL) || (aop == NULL))
+		return (kErrBadParameter);
+	if ((memcmp(cip->magic, kLibraryMagic, kLibraryMagicLen) != 0) || (memcmp(cip->tailMagic, kLibraryMagic, kLibraryMagicLen) != 0))
+		return (kErrBadMagic);
+
+	AsyncInit(cip, aop, kAsyncClose);
+
+	/* Data connection shouldn't be open normally. */
+	if (cip->dataSocket != kClosedFileDescriptor) {
+		(void) SetSocketLinger(cip->dataSocket, 0, 0);
+		CloseDataConnection(cip);
+	}
+
+	if (cip->connected == 0) {
+		AsyncDisconnected(cip);
+		return (AsyncDone(aop, kNoErr));
+	}
+	cip->eofOkay = 1;
+	return (AsyncSendCmd(aop, kAsyncPhaseQUIT, "QUIT"));
+}	/* FTPAsyncCloseHost */
@@ -0,0 +1,369 @@
+/* c_batch.c
+ *
+ * Copyright (c) 2026 The LibNcFTP contributors.
+ * Distributed under the same terms as the rest of LibNcFTP.
+ *
+ */
+
+#include "syshdrs.h"
+#ifdef PRAGMA_HDRSTOP
+#	pragma hdrstop
+#endif
+
+#if (defined(WIN32) || defined(_WINDOWS)) && !defined(__CYGWIN__)
+#define _CRT_SECURE_NO_WARNINGS 1
+#endif
+
+/* How long to wait for the reply to the second of two commands sent
+ * together, before deciding the server shouldn't get them that way.
+ */
+#define kBatchProbeTimeout		10
+
+typedef struct BatchSent {
+	FTPBatchCmdPtr bp;
+	int part;			/* 1 for the RNTO of a rename */
+} BatchSent;
+
+
+
+
+void
+InitBatchCmdList(const FTPBatchCmdListPtr list)
+{
+	(void) memset(list, 0, sizeof(FTPBatchCmdList));
+}	/* InitBatchCmdList */
+
+
+
+
+FTPBatchCmdPtr
+AddBatchCmd(const FTPBatchCmdListPtr list, const int cmd, const char *const arg, const char *const arg2)
+{
+	FTPBatchCmdPtr bp;
+
+	if ((arg == NULL) || ((cmd == kBatchRename) && (arg2 == NULL)))
+		return (NULL);
+
+	bp = (FTPBatchCmdPtr) calloc(SZ(1), sizeof(FTPBatchCmd));
+	if (bp == NULL)
+		return (NULL);
+	bp->arg = StrDup(arg);
+	if (bp->arg == NULL) {
+		free(bp);
+		return (NULL);
+	}
+	if (arg2 != NULL) {
+		bp->arg2 = StrDup(arg2);
+		if (bp->arg2 == NULL) {
+			free(bp->arg);
+			free(bp);
+			return (NULL);
+		}
+	}
+	bp->cmd = cmd;
+	bp->result = kErrGeneric;
+	bp->size = kSizeUnknown;
+	bp->mdtm = kModTimeUnknown;
+
+	bp->next = NULL;
+	if (list->first == NULL) {
+		list->first = list->last = bp;
+		bp->prev = NULL;
+		list->nCmds = 1;
+	} else {
+		bp->prev = list->last;
+		list->last->next = bp;
+		list->last = bp;
+		list->nCmds++;
+	}
+	return (bp);
+}	/* AddBatchCmd */
+
+
+
+
+void
+DisposeBatchCmdListContents(const FTPBatchCmdListPtr list)
+{
+	FTPBatchCmdPtr bp, nextbp;
+
+	for (bp = list->first; bp != NULL; bp = nextbp) {
+		nextbp = bp->next;
+		free(bp->arg);
+		if (bp->arg2 != NULL)
+			free(bp->arg2);
+		free(bp);
+	}
+	InitBatchCmdList(list);
+}	/* DisposeBatchCmdListContents */
+
+
+
+
+/* Don't bother sending commands we already know the server lacks. */
+static int
+BatchCmdAvailable(const FTPCIPtr cip, const FTPBatchCmdPtr bp)
+{
+	if ((bp->cmd == kBatchSIZE) && (cip->hasSIZE == kCommandNotAvailable)) {
+		bp->result = kErrSIZENotAvailable;
+		return (0);
+	}
+	if ((bp->cmd == kBatchMDTM) && (cip->hasMDTM == kCommandNotAvailable)) {
+		bp->result = kErrMDTMNotAvailable;
+		return (0);
+	}
+	return (1);
+}	/* BatchCmdAvailable */
+
+
+
+
+static const char *
+BatchCmdVerb(const FTPBatchCmdPtr bp, const int part)
+{
+	switch (bp->cmd) {
+		case kBatchSIZE:
+			return ("SIZE");
+		case kBatchMDTM:
+			return ("MDTM");
+		case kBatchDELE:
+			return ("DELE");
+		case kBatchMKD:
+			return ("MKD");
+		case kBatchRename:
+			return ((part == 0) ? "RNFR" : "RNTO");
+	}
+	return (NULL);
+}	/* BatchCmdVerb */
+
+
+
+
+/* Sets the result of a command from its reply, the same way the
+ * corresponding single command function does.  Returns 0 if this
+ * was the RNFR of a rename which failed, so its RNTO is moot.
+ */
+static int
+BatchCmdReply(const FTPCIPtr cip, const FTPBatchCmdPtr bp, const int part, const ResponsePtr rp)
+{
+	bp->code = rp->code;
+	switch (bp->cmd) {
+		case kBatchSIZE:
+			if (rp->codeType == 2) {
+#if defined(HAVE_LONG_LONG) && defined(SCANF_LONG_LONG)
+				(void) sscanf(rp->msg.first->line, SCANF_LONG_LONG, &bp->size);
+#elif defined(HAVE_LONG_LONG) && defined(HAVE_STRTOQ)
+				bp->size = (longest_int) strtoq(rp->msg.first->line, NULL, 0);
+#else
+				(void) sscanf(rp->msg.first->line, "%ld", &bp->size);
+#endif
+				cip->hasSIZE = kCommandAvailable;
+				bp->result = kNoErr;
+			} else if (FTP_UNIMPLEMENTED_CMD(rp->code)) {
+				cip->hasSIZE = kCommandNotAvailable;
+				bp->result = kErrSIZENotAvailable;
+			} else {
+				bp->result = kErrSIZEFailed;
+			}
+			break;
+		case kBatchMDTM:
+			if (rp->codeType == 2) {
+				bp->mdtm = UnMDTMDate(rp->msg.first->line);
+				cip->hasMDTM = kCommandAvailable;
+				bp->result = kNoErr;
+			} else if (FTP_UNIMPLEMENTED_CMD(rp->code)) {
+				cip->hasMDTM = kCommandNotAvailable;
+				cip->hasMDTM_set = kCommandNotAvailable;
+				bp->result = kErrMDTMNotAvailable;
+			} else {
+				bp->result = kErrMDTMFailed;
+			}
+			break;
+		case kBatchDELE:
+			bp->result = (rp->codeType == 2) ? kNoErr : kErrDELEFailed;
+			break;
+		case kBatchMKD:
+			bp->result = (rp->codeType == 2) ? kNoErr : kErrMKDFailed;
+			break;
+		case kBatchRename:
+			if (part == 0) {
+				if (rp->codeType != 3) {
+					bp->result = kErrRenameFailed;
+					return (0);
+				}
+			} else if (bp->result != kErrRenameFailed) {
+				bp->result = (rp->codeType == 2) ? kNoErr : kErrRenameFailed;
+			}
+			break;
+	}
+	return (1);
+}	/* BatchCmdReply */
+
+
+
+
+/* Sends the commands in the list, several at a time, and matches the
+ * replies to them in order.  The commands don't depend on each other's
+ * replies, so they can be written back-to-back, which saves a round
+ * trip for every command but the first.
+ *
+ * The first time, only two commands are sent together; if the second
+ * reply is slow to come, the rest are sent one at a time, and so is
+ * everything after that (set hasPipelining to kCommandNotAvailable to
+ * always do that).  A command that was sent is never sent again, so
+ * the second reply is still waited for as usual; a server which threw
+ * the second command away times out the control connection instead.
+ *
+ * Each command's result and reply code is set in the list.  The
+ * return value is kNoErr unless the connection failed.
+ */
+int
+FTPBatchCmds(const FTPCIPtr cip, const FTPBatchCmdListPtr list, const int xtype)
+{
+	BatchSent sent[kBatchWindow];
+	int head, nOut, window, result, probe;
+	FTPBatchCmdPtr bp, sendbp;
+	int sendPart;
+	char *buf, *cp;
+	size_t len;
+	const char *verb, *arg;
+	ResponsePtr rp;
+
+	if ((cip == NULL) || (list == NULL))
+		return (kErrBadParameter);
+	if (strcmp(cip->magic, kLibraryMagic))
+		return (kErrBadMagic);
+
+	for (bp = list->first; bp != NULL; bp = bp->next) {
+		bp->result = kErrGeneric;
+		bp->code = 0;
+		bp->size = kSizeUnknown;
+		bp->mdtm = kModTimeUnknown;
+	}
+	for (bp = list->first; bp != NULL; bp = bp->next) {
+		if ((bp->cmd == kBatchSIZE) && (cip->hasSIZE != kCommandNotAvailable)) {
+			/* SIZE depends on the transfer type. */
+			result = FTPSetTransferType(cip, xtype);
+			if (result < 0)
+				return (result);
+			break;
+		}
+	}
+
+	if (cip->ctrlSocketW == kClosedFileDescriptor) {
+		cip->errNo = kErrNotConnected;
+		return (kErrNotConnected);
+	}
+
+	buf = (char *) malloc(SZ(kBatchWindow) * sizeof(longstring));
+	if (buf == NULL) {
+		FTPLogError(cip, kDontPerror, "Malloc failed.\n");
+		cip->errNo = kErrMallocFailed;
+		return (kErrMallocFailed);
+	}
+
+	result = kNoErr;
+	sendbp = list->first;
+	sendPart = 0;
+	head = 0;
+	nOut = 0;
+	probe = 0;
+	forever {
+		if (cip->hasPipelining == kCommandAvailable)
+			window = kBatchWindow;
+		else if (cip->hasPipelining == kCommandNotAvailable)
+			window = 1;
+		else
+			window = 2;
+
+		/* Write as many commands as the window allows at once. */
+		len = 0;
+		while ((nOut < window) && (sendbp != NULL) && (probe == 0)) {
+			if ((sendPart == 0) && (BatchCmdAvailable(cip, sendbp) == 0)) {
+				sendbp = sendbp->next;
+				continue;
+			}
+			verb = BatchCmdVerb(sendbp, sendPart);
+			arg = (sendPart == 0) ? sendbp->arg : sendbp->arg2;
+			if ((verb == NULL) || ((strlen(verb) + strlen(arg) + 4) > sizeof(longstring))) {
+				sendbp->result = kErrBadParameter;
+				sendbp = sendbp->next;
+				sendPart = 0;
+				continue;
+			}
+			cp = buf + len;
+			(void) sprintf(cp, "%s %s", verb, arg);
+			PrintF(cip, "Cmd: %s\n", cp);
+			FTPDirCacheNoteCmd(cip, cp);
+			len += strlen(cp);
+			buf[len++] = '\r';
+			buf[len++] = '\n';
+
+			sent[(head + nOut) % kBatchWindow].bp = sendbp;
+			sent[(head + nOut) % kBatchWindow].part = sendPart;
+			nOut++;
+			if ((sendbp->cmd == kBatchRename) && (sendPart == 0)) {
+				sendPart = 1;
+			} else {
+				sendbp = sendbp->next;
+				sendPart = 0;
+			}
+		}
+		if (len > 0) {
+			cip->lastFTPCmdResultStr[0] = '\0';
+			cip->lastFTPCmdResultNum = -1;
+			if (SWrite(cip->ctrlSocketW, buf, len, (int) cip->ctrlTimeout, 0) < 0) {
+				FTPLogError(cip, kDoPerror, "Could not write to control stream.\n");
+				cip->errNo = result = kErrSocketWriteFailed;
+				break;
+			}
+			if ((cip->hasPipelining == kCommandAvailabilityUnknown) && (nOut > 1))
+				probe = 1;
+		}
+		if (nOut == 0)
+			break;
+
+		if ((probe != 0) && (nOut == 1)) {
+			/* Got the first reply of the probe; is the second coming? */
+			probe = 0;
+			if ((cip->ctrlSrl.bufPtr >= cip->ctrlSrl.bufLim) && (WaitResponse(cip, ((cip->ctrlTimeout > 0) && (cip->ctrlTimeout < kBatchProbeTimeout)) ? cip->ctrlTimeout : kBatchProbeTimeout) <= 0)) {
+				PrintF(cip, "Server is slow to reply to pipelined commands; sending the rest one at a time.\n");
+				cip->hasPipelining = kCommandNotAvailable;
+				/* Its reply is still read below; never resend it. */
+			} else {
+				cip->hasPipelining = kCommandAvailable;
+			}
+		}
+
+		rp = InitResponse();
+		if (rp == NULL) {
+			FTPLogError(cip, kDontPerror, "Malloc failed.\n");
+			cip->errNo = result = kErrMallocFailed;
+			break;
+		}
+		result = GetResponse(cip, rp);
+		if (result < 0) {
+			DoneWithResponse(cip, rp);
+			break;
+		}
+		bp = sent[head].bp;
+		if ((BatchCmdReply(cip, bp, sent[head].part, rp) == 0) && (sendbp == bp) && (sendPart == 1)) {
+			/* RNFR failed, and RNTO not sent yet. */
+			sendbp = bp->next;
+			sendPart = 0;
+		}
+		DoneWithResponse(cip, rp);
+		head = (head + 1) % kBatchWindow;
+		nOut--;
+	}
+
+	if (result < 0) {
+		/* The connection is gone; nothing else got done. */
+		for (bp = list->first; bp != NULL; bp = bp->next) {
+			if (bp->result == kErrGeneric)
+				bp->result = result;
+		}
+	}
+	free(buf);
+	return (result);
+}	/* FTPBatchCmds */
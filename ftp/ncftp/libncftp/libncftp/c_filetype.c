@@ -32,6 +32,9 @@ FTPFileType(const FTPCIPtr cip, const char *const file, int *const ftype)
 	}
 
 	*ftype = 0;
+	if (FTPDirCacheFileType(cip, file, ftype) == kNoErr)
+		return (kNoErr);
+
 	result = FTPMListOneFile(cip, file, &mlsInfo);
 	if (result == kNoErr) {
 		*ftype = mlsInfo.ftype;
@@ -10,11 +10,53 @@
 #	pragma hdrstop
 #endif
 
+/* Copies the directory out of a reply to PWD, such as
+ * 257 "/pub/linux" is current directory.
+ */
+void
+FTPExaminePWDReply(const FTPCIPtr cip, ResponsePtr rp, char *const newCwd, const size_t newCwdSize)
+{
+	char *l, *r;
+
+	if (rp->msg.first == NULL)
+		return;
+
+	if ((r = strrchr(rp->msg.first->line, '"')) != NULL) {
+		/* "xxxx" is current directory.
+		 * Strip out just the xxxx to copy into the remote cwd.
+		 */
+		l = strchr(rp->msg.first->line, '"');
+		if ((l != NULL) && (l != r)) {
+			*r = '\0';
+			++l;
+			if (cip->currentWorkingDirectory != NULL)
+				(void) Strncpy(cip->currentWorkingDirectory, l, cip->currentWorkingDirectorySize);
+			if (newCwd != cip->currentWorkingDirectory)
+				(void) Strncpy(newCwd, l, newCwdSize);
+			*r = '"';	/* Restore, so response prints correctly. */
+		}
+	} else {
+		/* xxxx is current directory.
+		 * Mostly for VMS.
+		 */
+		if ((r = strchr(rp->msg.first->line, ' ')) != NULL) {
+			*r = '\0';
+			if (cip->currentWorkingDirectory != NULL)
+				(void) Strncpy(cip->currentWorkingDirectory, (rp->msg.first->line), cip->currentWorkingDirectorySize);
+			if (newCwd != cip->currentWorkingDirectory)
+				(void) Strncpy(newCwd, (rp->msg.first->line), newCwdSize);
+			*r = ' ';	/* Restore, so response prints correctly. */
+		}
+	}
+}	/* FTPExaminePWDReply */
+
+
+
+
 int
 FTPGetCWD(const FTPCIPtr cip, char *const newCwd, const size_t newCwdSize)
 {
 	ResponsePtr rp;
-	char *l, *r;
 	int result;
 
 	if (cip == NULL)
@@ -43,33 +85,7 @@ FTPGetCWD(const FTPCIPtr cip, char *const newCwd, const size_t newCwdSize)
 				cip->currentWorkingDirectory[cip->currentWorkingDirectorySize - 2] = '\0';
 			}
 			if (result == 2) {
-				if ((r = strrchr(rp->msg.first->line, '"')) != NULL) {
-					/* "xxxx" is current directory.
-					 * Strip out just the xxxx to copy into the remote cwd.
-					 */
-					l = strchr(rp->msg.first->line, '"');
-					if ((l != NULL) && (l != r)) {
-						*r = '\0';
-						++l;
-						if (cip->currentWorkingDirectory != NULL)
-							(void) Strncpy(cip->currentWorkingDirectory, l, cip->currentWorkingDirectorySize);
-						if (newCwd != cip->currentWorkingDirectory)
-							(void) Strncpy(newCwd, l, newCwdSize);
-						*r = '"';	/* Restore, so response prints correctly. */
-					}
-				} else {
-					/* xxxx is current directory.
-					 * Mostly for VMS.
-					 */
-					if ((r = strchr(rp->msg.first->line, ' ')) != NULL) {
-						*r = '\0';
-						if (cip->currentWorkingDirectory != NULL)
-							(void) Strncpy(cip->currentWorkingDirectory, (rp->msg.first->line), cip->currentWorkingDirectorySize);
-						if (newCwd != cip->currentWorkingDirectory)
-							(void) Strncpy(newCwd, (rp->msg.first->line), newCwdSize);
-						*r = ' ';	/* Restore, so response prints correctly. */
-					}
-				}
+				FTPExaminePWDReply(cip, rp, newCwd, newCwdSize);
 				result = kNoErr;
 			} else if (result > 0) {
 				result = kErrPWDFailed;
@@ -119,6 +119,7 @@ static const char *gErrList[kErrLast - kErrFirst + 2] = {
 	"you have encountered a bug that we have not fixed yet, sorry!",/* -205 */
 	"could not bind the control connection socket",			/* -206 */
 	"pathname too long (internal buffer too small to hold it)",	/* -207 */
+	"remote transfer mode change failed",				/* -208 */
 	NULL,								
 };
 
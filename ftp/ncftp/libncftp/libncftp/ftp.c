@@ -116,7 +116,7 @@ FTPCloseControlConnection(const FTPCIPtr cip)
 
 
 
-static int
+int
 GetSocketAddress(const FTPCIPtr cip, int sockfd, struct sockaddr_in *saddr)
 {
 	sockaddr_size_t len = (sockaddr_size_t) sizeof (struct sockaddr_in);
@@ -150,6 +150,143 @@ CancelConnect(int signum)
 
 
 
+/* Guess which server software this is from its connect message, since
+ * a few need special handling, and pass the message to the application.
+ */
+void
+FTPExamineConnectMessage(const FTPCIPtr cip, ResponsePtr rp)
+{
+	const char *firstLine, *secondLine, *srvr;
+
+	if (rp->msg.first == NULL)
+		return;
+
+	cip->serverType = kServerTypeUnknown;
+	srvr = NULL;
+	firstLine = rp->msg.first->line;
+	secondLine = NULL;
+	if (rp->msg.first->next != NULL)
+		secondLine = rp->msg.first->next->line;
+	
+	if (strstr(firstLine, "Version wu-") != NULL) {
+		cip->serverType = kServerTypeWuFTPd;
+		srvr = "wu-ftpd";
+	} else if (strstr(firstLine, "NcFTPd") != NULL) {
+		cip->serverType = kServerTypeNcFTPd;
+		srvr = "NcFTPd Server";
+	} else if (STRNEQ("ProFTPD", firstLine, 7)) {
+		cip->serverType = kServerTypeProFTPD;
+		srvr = "ProFTPD";
+	} else if (strstr(firstLine, "Microsoft FTP Service") != NULL) {
+		cip->serverType = kServerTypeMicrosoftFTP;
+		srvr = "Microsoft FTP Service";
+	} else if (strstr(firstLine, "(NetWare ") != NULL) {
+		cip->serverType = kServerTypeNetWareFTP;
+		srvr = "NetWare FTP Service";
+	} else if (strstr(firstLine, "(DG/UX ") != NULL) {
+		cip->serverType = kServerTypeDguxFTP;
+		srvr = "DG/UX FTP Service";
+	} else if (strstr(firstLine, "IBM FTP CS ") != NULL) {
+		cip->serverType = kServerTypeIBMFTPCS;
+		srvr = "IBM FTP CS Server";
+	} else if (strstr(firstLine, "DC/OSx") != NULL) {
+		cip->serverType = kServerTypePyramid;
+		srvr = "Pyramid DC/OSx FTP Service";
+	} else if (STRNEQ("WFTPD", firstLine, 5)) {
+		cip->serverType = kServerTypeWFTPD;
+		srvr = "WFTPD";
+	} else if (STRNEQ("Serv-U FTP", firstLine, 10)) {
+		cip->serverType = kServerTypeServ_U;
+		srvr = "Serv-U FTP-Server";
+	} else if (strstr(firstLine, "VFTPD") != NULL) {
+		cip->serverType = kServerTypeVFTPD;
+		srvr = "VFTPD";
+	} else if (STRNEQ("FTP-Max", firstLine, 7)) {
+		cip->serverType = kServerTypeFTP_Max;
+		srvr = "FTP-Max";
+	} else if (strstr(firstLine, "Roxen") != NULL) {
+		cip->serverType = kServerTypeRoxen;
+		srvr = "Roxen";
+	} else if (strstr(firstLine, "WS_FTP") != NULL) {
+		cip->serverType = kServerTypeWS_FTP;
+		srvr = "WS_FTP Server";
+	} else if ((secondLine != NULL) && (strstr(secondLine, "WarFTP") != NULL)) {
+		cip->serverType = kServerTypeWarFTPd;
+		srvr = "WarFTPd";
+	}
+
+	if (srvr != NULL)
+		PrintF(cip, "Remote server is running %s.\n", srvr);
+
+	/* Do the application's connect message callback, if present. */
+	if ((cip->onConnectMsgProc != 0) && (rp->codeType < 4))
+		(*cip->onConnectMsgProc)(cip, rp);
+}	/* FTPExamineConnectMessage */
+
+
+
+
+/* After connect() fails, logs why and returns the error code for it.
+ * If possible, this tells the caller if they should bother calling
+ * back later.
+ */
+int
+FTPConnectError(const FTPCIPtr cip, const char *const host)
+{
+	int result;
+
+	switch (errno) {
+#ifdef ENETDOWN
+		case ENETDOWN:
+#elif defined(WSAENETDOWN)
+		case WSAENETDOWN:
+#endif
+#ifdef ENETUNREACH
+		case ENETUNREACH:
+#elif defined(WSAENETUNREACH)
+		case WSAENETUNREACH:
+#endif
+#ifdef ECONNABORTED
+		case ECONNABORTED:
+#elif defined(WSAECONNABORTED)
+		case WSAECONNABORTED:
+#endif
+#ifdef ETIMEDOUT
+		case ETIMEDOUT:
+#elif defined(WSAETIMEDOUT)
+		case WSAETIMEDOUT:
+#endif
+#ifdef EHOSTDOWN
+		case EHOSTDOWN:
+#elif defined(WSAEHOSTDOWN)
+		case WSAEHOSTDOWN:
+#endif
+#ifdef ECONNRESET
+		case ECONNRESET:
+#elif defined(WSAECONNRESET)
+		case WSAECONNRESET:
+#endif
+			FTPLogError(cip, kDoPerror, "Could not connect to %s -- try again later.\n", host);
+			result = cip->errNo = kErrConnectRetryableErr;
+			break;
+#ifdef ECONNREFUSED
+		case ECONNREFUSED:
+#elif defined(WSAECONNREFUSED)
+		case WSAECONNREFUSED:
+#endif
+			FTPLogError(cip, kDoPerror, "Could not connect to %s.\n", host);
+			result = cip->errNo = kErrConnectRefused;
+			break;
+		default:
+			FTPLogError(cip, kDoPerror, "Could not connect to %s.\n", host);
+			result = cip->errNo = kErrConnectMiscErr;
+	}
+	return (result);
+}	/* FTPConnectError */
+
+
+
+
 int
 OpenControlConnection(const FTPCIPtr cip, char *host, unsigned int port)
 {
@@ -172,7 +309,6 @@ OpenControlConnection(const FTPCIPtr cip, char *host, unsigned int port)
 	volatile FTPCIPtr vcip;
 	int sj;
 #endif	/* NO_SIGNALS */
-	const char *firstLine, *secondLine, *srvr;
 
 	LIBNCFTP_USE_VAR(gLibNcFTPVersion);
 	LIBNCFTP_USE_VAR(gCopyright);
@@ -432,55 +568,7 @@ OpenControlConnection(const FTPCIPtr cip, char *host, unsigned int port)
 	if (err < 0) {
 		/* Could not connect.  Close up shop and go home. */
 
-		/* If possible, tell the caller if they should bother
-		 * calling back later.
-		 */
-		switch (errno) {
-#ifdef ENETDOWN
-			case ENETDOWN:
-#elif defined(WSAENETDOWN)
-			case WSAENETDOWN:
-#endif
-#ifdef ENETUNREACH
-			case ENETUNREACH:
-#elif defined(WSAENETUNREACH)
-			case WSAENETUNREACH:
-#endif
-#ifdef ECONNABORTED
-			case ECONNABORTED:
-#elif defined(WSAECONNABORTED)
-			case WSAECONNABORTED:
-#endif
-#ifdef ETIMEDOUT
-			case ETIMEDOUT:
-#elif defined(WSAETIMEDOUT)
-			case WSAETIMEDOUT:
-#endif
-#ifdef EHOSTDOWN
-			case EHOSTDOWN:
-#elif defined(WSAEHOSTDOWN)
-			case WSAEHOSTDOWN:
-#endif
-#ifdef ECONNRESET
-			case ECONNRESET:
-#elif defined(WSAECONNRESET)
-			case WSAECONNRESET:
-#endif
-				FTPLogError(cip, kDoPerror, "Could not connect to %s -- try again later.\n", fhost);
-				result = cip->errNo = kErrConnectRetryableErr;
-				break;
-#ifdef ECONNREFUSED
-			case ECONNREFUSED:
-#elif defined(WSAECONNREFUSED)
-			case WSAECONNREFUSED:
-#endif
-				FTPLogError(cip, kDoPerror, "Could not connect to %s.\n", fhost);
-				result = cip->errNo = kErrConnectRefused;
-				break;
-			default:
-				FTPLogError(cip, kDoPerror, "Could not connect to %s.\n", fhost);
-				result = cip->errNo = kErrConnectMiscErr;
-		}
+		result = FTPConnectError(cip, fhost);
 		goto fatal;
 	}
 
@@ -575,68 +663,7 @@ OpenControlConnection(const FTPCIPtr cip, char *host, unsigned int port)
 	if ((result < 0) && (rp->msg.first == NULL)) {
 		goto fatal;
 	}
-	if (rp->msg.first != NULL) {
-		cip->serverType = kServerTypeUnknown;
-		srvr = NULL;
-		firstLine = rp->msg.first->line;
-		secondLine = NULL;
-		if (rp->msg.first->next != NULL)
-			secondLine = rp->msg.first->next->line;
-		
-		if (strstr(firstLine, "Version wu-") != NULL) {
-			cip->serverType = kServerTypeWuFTPd;
-			srvr = "wu-ftpd";
-		} else if (strstr(firstLine, "NcFTPd") != NULL) {
-			cip->serverType = kServerTypeNcFTPd;
-			srvr = "NcFTPd Server";
-		} else if (STRNEQ("ProFTPD", firstLine, 7)) {
-			cip->serverType = kServerTypeProFTPD;
-			srvr = "ProFTPD";
-		} else if (strstr(firstLine, "Microsoft FTP Service") != NULL) {
-			cip->serverType = kServerTypeMicrosoftFTP;
-			srvr = "Microsoft FTP Service";
-		} else if (strstr(firstLine, "(NetWare ") != NULL) {
-			cip->serverType = kServerTypeNetWareFTP;
-			srvr = "NetWare FTP Service";
-		} else if (strstr(firstLine, "(DG/UX ") != NULL) {
-			cip->serverType = kServerTypeDguxFTP;
-			srvr = "DG/UX FTP Service";
-		} else if (strstr(firstLine, "IBM FTP CS ") != NULL) {
-			cip->serverType = kServerTypeIBMFTPCS;
-			srvr = "IBM FTP CS Server";
-		} else if (strstr(firstLine, "DC/OSx") != NULL) {
-			cip->serverType = kServerTypePyramid;
-			srvr = "Pyramid DC/OSx FTP Service";
-		} else if (STRNEQ("WFTPD", firstLine, 5)) {
-			cip->serverType = kServerTypeWFTPD;
-			srvr = "WFTPD";
-		} else if (STRNEQ("Serv-U FTP", firstLine, 10)) {
-			cip->serverType = kServerTypeServ_U;
-			srvr = "Serv-U FTP-Server";
-		} else if (strstr(firstLine, "VFTPD") != NULL) {
-			cip->serverType = kServerTypeVFTPD;
-			srvr = "VFTPD";
-		} else if (STRNEQ("FTP-Max", firstLine, 7)) {
-			cip->serverType = kServerTypeFTP_Max;
-			srvr = "FTP-Max";
-		} else if (strstr(firstLine, "Roxen") != NULL) {
-			cip->serverType = kServerTypeRoxen;
-			srvr = "Roxen";
-		} else if (strstr(firstLine, "WS_FTP") != NULL) {
-			cip->serverType = kServerTypeWS_FTP;
-			srvr = "WS_FTP Server";
-		} else if ((secondLine != NULL) && (strstr(secondLine, "WarFTP") != NULL)) {
-			cip->serverType = kServerTypeWarFTPd;
-			srvr = "WarFTPd";
-		}
-
-		if (srvr != NULL)
-			PrintF(cip, "Remote server is running %s.\n", srvr);
-
-		/* Do the application's connect message callback, if present. */
-		if ((cip->onConnectMsgProc != 0) && (rp->codeType < 4))
-			(*cip->onConnectMsgProc)(cip, rp);
-	}
+	FTPExamineConnectMessage(cip, rp);
 
 	if (rp->codeType >= 4) {
 		/* They probably hung up on us right away.  That's too bad,
@@ -795,30 +822,20 @@ FTPSendPort(const FTPCIPtr cip, struct sockaddr_in *saddr)
 
 
 
+/* Gets the address and port out of a reply to PASV, such as
+ * "227 Entering Passive Mode (129,93,33,1,10,187)".
+ */
 int
-FTPSendPassive(const FTPCIPtr cip, struct sockaddr_in *saddr, int *weird)
+FTPParsePassiveReply(const FTPCIPtr cip, ResponsePtr rp, struct sockaddr_in *saddr, int *weird)
 {
-	ResponsePtr rp;
 	int i[6], j;
 	unsigned char n[6];
 	char *cp;
-	int result;
-
-	rp = InitResponse();
-	if (rp == NULL) {
-		FTPLogError(cip, kDontPerror, "Malloc failed.\n");
-		cip->errNo = kErrMallocFailed;
-		return (cip->errNo);
-	}
-
-	result = RCmd(cip, rp, "PASV");
-	if (result < 0)
-		goto done;
 
 	if (rp->codeType != 2) {
 		/* Didn't understand or didn't want passive port selection. */
-		cip->errNo = result = kErrPASVFailed;
-		goto done;
+		cip->errNo = kErrPASVFailed;
+		return (kErrPASVFailed);
 	}
 
 	/* The other side returns a specification in the form of
@@ -833,7 +850,7 @@ FTPSendPassive(const FTPCIPtr cip, struct sockaddr_in *saddr, int *weird)
 	for (cp = rp->msg.first->line; ; cp++) {
 		if (*cp == '\0') {
 			FTPLogError(cip, kDontPerror, "Cannot parse PASV response: %s\n", rp->msg.first->line);
-			goto done;
+			return (2);
 		}
 		if (isdigit((int) *cp))
 			break;
@@ -842,7 +859,7 @@ FTPSendPassive(const FTPCIPtr cip, struct sockaddr_in *saddr, int *weird)
 	if (sscanf(cp, "%d,%d,%d,%d,%d,%d",
 			&i[0], &i[1], &i[2], &i[3], &i[4], &i[5]) != 6) {
 		FTPLogError(cip, kDontPerror, "Cannot parse PASV response: %s\n", rp->msg.first->line);
-		goto done;
+		return (2);
 	}
 
 	if (weird != (int *) 0)
@@ -860,9 +877,28 @@ FTPSendPassive(const FTPCIPtr cip, struct sockaddr_in *saddr, int *weird)
 	
 	(void) memcpy(&saddr->sin_addr, &n[0], (size_t) 4);
 	(void) memcpy(&saddr->sin_port, &n[4], (size_t) 2);
+	return (kNoErr);
+}	/* FTPParsePassiveReply */
+
+
+
 
-	result = kNoErr;
-done:
+int
+FTPSendPassive(const FTPCIPtr cip, struct sockaddr_in *saddr, int *weird)
+{
+	ResponsePtr rp;
+	int result;
+
+	rp = InitResponse();
+	if (rp == NULL) {
+		FTPLogError(cip, kDontPerror, "Malloc failed.\n");
+		cip->errNo = kErrMallocFailed;
+		return (cip->errNo);
+	}
+
+	result = RCmd(cip, rp, "PASV");
+	if (result >= 0)
+		result = FTPParsePassiveReply(cip, rp, saddr, weird);
 	DoneWithResponse(cip, rp);
 	return (result);
 }	/* FTPSendPassive */
@@ -985,14 +1021,55 @@ BindToEphemeralPortNumber(const int sockfd, struct sockaddr_in *const addrp, con
 
 
 
+/* Sizes the buffers of a new data socket, before it is connected. */
+void
+FTPSetDataSocketBufSize(const FTPCIPtr cip, const int dataSocket)
+{
+	int setsbufs;
+	size_t rbs, sbs;
+
+	if ((cip->dataSocketRBufSize != 0) || (cip->dataSocketSBufSize != 0)) {
+		(void) SetSocketBufSize(dataSocket, cip->dataSocketRBufSize, cip->dataSocketSBufSize);
+#ifdef LINUX
+	} else if (cip->autoTuneBufs != 0) {
+		/* Linux grows the buffers to fit the connection by itself,
+		 * well past 64 kB, but only as long as SO_RCVBUF and
+		 * SO_SNDBUF are never set on the socket.
+		 */
+#endif
+	} else if ((cip->autoTuneBufs != 0) && (cip->dataSocketTunedBufSize != 0)) {
+		/* Sized from the bandwidth-delay product of the
+		 * previous transfer (see FTPStopIOTimer).
+		 */
+		(void) SetSocketBufSize(dataSocket, cip->dataSocketTunedBufSize, cip->dataSocketTunedBufSize);
+	} else if (GetSocketBufSize(dataSocket, &rbs, &sbs) == 0) {
+		/* Use maximum size buffers that qualify for TCP Small Windows
+		 * for file transfers.
+		 */
+		setsbufs = 0;
+		if (rbs < 65536) {
+			rbs = 65536;
+			setsbufs++;
+		}
+		if (sbs < 65536) {
+			sbs = 65536;
+			setsbufs++;
+		}
+		if (setsbufs > 0) {
+		        (void) SetSocketBufSize(dataSocket, rbs, sbs);
+		}
+	}
+}	/* FTPSetDataSocketBufSize */
+
+
+
+
 int
 OpenDataConnection(const FTPCIPtr cip, int mode)
 {
 	int dataSocket;
 	int weirdPort;
 	int result;
-	int setsbufs;
-	size_t rbs, sbs;
 	int passiveAttemptsRemaining = cip->maxNumberOfSuccessivePASVAttempts;
 	char servDataAddrStr[64];
 
@@ -1014,25 +1091,7 @@ tryPort2:
 		return result;
 	}
 
-	if ((cip->dataSocketRBufSize != 0) || (cip->dataSocketSBufSize != 0)) {
-		(void) SetSocketBufSize(dataSocket, cip->dataSocketRBufSize, cip->dataSocketSBufSize);
-	} else if (GetSocketBufSize(dataSocket, &rbs, &sbs) == 0) {
-		/* Use maximum size buffers that qualify for TCP Small Windows
-		 * for file transfers.
-		 */
-		setsbufs = 0;
-		if (rbs < 65536) {
-			rbs = 65536;
-			setsbufs++;
-		}
-		if (sbs < 65536) {
-			sbs = 65536;
-			setsbufs++;
-		}
-		if (setsbufs > 0) {
-		        (void) SetSocketBufSize(dataSocket, rbs, sbs);
-		}
-	}
+	FTPSetDataSocketBufSize(cip, dataSocket);
 
 	if ((cip->hasPASV == kCommandNotAvailable) || (mode == kSendPortMode)) {
 tryPort:
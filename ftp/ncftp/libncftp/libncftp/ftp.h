@@ -8,9 +8,14 @@
 /* FTP.c */
 void FTPFixServerDataAddr(const FTPCIPtr cip);
 void FTPFixClientDataAddr(const FTPCIPtr cip);
+int GetSocketAddress(const FTPCIPtr cip, int sockfd, struct sockaddr_in *saddr);
+void FTPExamineConnectMessage(const FTPCIPtr cip, ResponsePtr rp);
+int FTPConnectError(const FTPCIPtr cip, const char *const host);
 int OpenControlConnection(const FTPCIPtr cip, char *host, unsigned int port);
 void CloseDataConnection(const FTPCIPtr cip);
 int SetStartOffset(const FTPCIPtr cip, longest_int restartPt);
+int FTPParsePassiveReply(const FTPCIPtr cip, ResponsePtr rp, struct sockaddr_in *saddr, int *weird);
+void FTPSetDataSocketBufSize(const FTPCIPtr cip, const int dataSocket);
 int OpenDataConnection(const FTPCIPtr cip, int mode);
 int AcceptDataConnection(const FTPCIPtr cip);
 void HangupOnServer(const FTPCIPtr cip);
@@ -5,6 +5,10 @@
  *
  */
 
+#if defined(LINUX) && !defined(_GNU_SOURCE)
+#	define _GNU_SOURCE 1	/* for splice() */
+#endif
+
 #include "syshdrs.h"
 #ifdef PRAGMA_HDRSTOP
 #	pragma hdrstop
@@ -37,6 +41,110 @@
 #	endif
 #endif
 
+#if defined(HAVE_SPLICE) && defined(SPLICE_F_MOVE) && defined(F_GETFL)
+#	define USE_SPLICE 1
+
+/* How much the pipe between the socket and the file can hold, if the
+ * system lets us make it that large.  Pipes are only 64 kB by default.
+ */
+#	define kSplicePipeSize		(1024 * 1024)
+
+/* Does a binary download by moving the data from the data socket into
+ * the file with splice(), through a pipe, so it is never copied into
+ * our buffer and back out again.  Timeouts, cancelling, and progress
+ * reports work as in the regular loop below.
+ *
+ * This only works for regular files which aren't opened for appending.
+ * If splice() can't be used, usingSplice is left zero and nothing has
+ * been read from the data connection, so the regular loop can do it.
+ */
+static int
+FTPGetSplice(const FTPCIPtr cip, const int fd, const char *const dstfile, const time_t mdtm, struct utimbuf *const utp)
+{
+	int pfd[2];
+	int result;
+	int flags;
+	ssize_t nin, nout, inPipe;
+	size_t pipeSize;
+	struct Stat st;
+
+	cip->usingSplice = 0;
+	if ((Fstat(fd, &st) != 0) || (!S_ISREG(st.st_mode)))
+		return (kNoErr);
+	flags = fcntl(fd, F_GETFL, 0);
+	if ((flags < 0) || ((flags & O_APPEND) != 0))
+		return (kNoErr);
+	if (pipe(pfd) != 0)
+		return (kNoErr);
+	pipeSize = 65536;
+#ifdef F_SETPIPE_SZ
+	flags = fcntl(pfd[1], F_SETPIPE_SZ, kSplicePipeSize);
+	if (flags > 0)
+		pipeSize = (size_t) flags;
+#endif
+
+	PrintF(cip, "Using splice for the download.\n");
+	cip->usingSplice = 1;
+	result = kNoErr;
+	for (;;) {
+		if (! WaitForRemoteInput(cip)) {	/* could set cancelXfer */
+			cip->errNo = result = kErrDataTimedOut;
+			FTPLogError(cip, kDontPerror, "Remote read timed out after " PRINTF_LONG_LONG " bytes had been received.\n", cip->bytesTransferred);
+			break;
+		}
+		if (cip->cancelXfer > 0) {
+			FTPAbortDataTransfer(cip);
+			result = cip->errNo = kErrDataTransferAborted;
+			break;
+		}
+
+		nin = splice(cip->dataSocket, NULL, pfd[1], NULL, pipeSize, SPLICE_F_MOVE|SPLICE_F_NONBLOCK);
+		if (nin < 0) {
+			if ((errno == EINTR) || (errno == EAGAIN))
+				continue;
+			if ((cip->bytesTransferred == 0) && ((errno == EINVAL) || (errno == ENOSYS))) {
+				/* Not for this kind of socket; nothing was read. */
+				PrintF(cip, "Could not splice (%s); using read and write.\n", strerror(errno));
+				cip->usingSplice = 0;
+				break;
+			}
+			FTPLogError(cip, kDoPerror, "Remote read failed after " PRINTF_LONG_LONG " bytes had been received.\n", cip->bytesTransferred);
+			result = cip->errNo = kErrSocketReadFailed;
+			break;
+		} else if (nin == 0) {
+			break;
+		}
+
+		for (inPipe = nin; inPipe > 0; inPipe -= nout) {
+			nout = splice(pfd[0], NULL, fd, NULL, (size_t) inPipe, SPLICE_F_MOVE);
+			if (nout <= 0) {
+				if ((nout < 0) && (errno == EINTR)) {
+					nout = 0;
+					continue;
+				}
+				FTPLogError(cip, kDoPerror, "Local write failed after " PRINTF_LONG_LONG " bytes had been received.\n", cip->bytesTransferred);
+				result = cip->errNo = kErrWriteFailed;
+				(void) shutdown(cip->dataSocket, 2);
+				goto done;
+			}
+		}
+
+		if ((cip->utimeBlocks != 0) && (mdtm != kModTimeUnknown) && (dstfile != NULL))
+			(void) utime(dstfile, utp);
+		cip->bytesTransferred += (longest_int) nin;
+		FTPUpdateIOTimer(cip);
+	}
+
+done:
+	(void) close(pfd[0]);
+	(void) close(pfd[1]);
+	return (result);
+}	/* FTPGetSplice */
+#endif	/* HAVE_SPLICE */
+
+
+
+
 int
 FTPGetOneF(
 	const FTPCIPtr cip,
@@ -53,6 +161,7 @@ FTPGetOneF(
 {
 	char *buf;
 	size_t bufSize;
+	int nFullReads;
 	int tmpResult;
 	volatile int result;
 	read_return_t nread;
@@ -94,6 +203,7 @@ FTPGetOneF(
 
 	result = kNoErr;
 	cip->usingTAR = 0;
+	cip->usingSplice = 0;
 
 	if (fdtouse < 0) {
 		/* Only ask for extended information
@@ -416,6 +526,8 @@ FTPGetOneF(
 	gCanBrokenDataJmp = 1;
 #endif	/* NO_SIGNALS */
 
+	if (startPoint == 0)
+		(void) FTPRequestModeZ(cip, file);
 	tmpResult = FTPStartDataCmd(cip, kNetReading, xtype, startPoint, "RETR %s", file);
 
 	if (tmpResult < 0) {
@@ -491,7 +603,7 @@ FTPGetOneF(
 			}
 #endif /* TESTING_ABOR */
 #ifdef NO_SIGNALS
-			nread = (read_return_t) SRead(cip->dataSocket, buf, bufSize, (int) cip->xferTimeout, kFullBufferNotRequired|kNoFirstSelect);
+			nread = (read_return_t) FTPReadData(cip, buf, bufSize);
 			if (nread == kTimeoutErr) {
 				cip->errNo = result = kErrDataTimedOut;
 				FTPLogError(cip, kDontPerror, "Remote read timed out after " PRINTF_LONG_LONG " bytes had been received.\n", cip->bytesTransferred);
@@ -727,7 +839,12 @@ add_eoln:
 #endif	/* ASCII_TRANSLATION */
 	{
 		/* Binary */
-		for (;;) {
+		nFullReads = 0;
+#ifdef USE_SPLICE
+		if ((cip->useSplice != 0) && (cip->usingModeZ == 0))
+			result = FTPGetSplice(cip, fd, dstfile, mdtm, &ut);
+#endif
+		while (cip->usingSplice == 0) {
 			if (! WaitForRemoteInput(cip)) {	/* could set cancelXfer */
 				cip->errNo = result = kErrDataTimedOut;
 				FTPLogError(cip, kDontPerror, "Remote read timed out after " PRINTF_LONG_LONG " bytes had been received.\n", cip->bytesTransferred);
@@ -747,7 +864,7 @@ add_eoln:
 			}
 #endif /* TESTING_ABOR */
 #ifdef NO_SIGNALS
-			nread = (read_return_t) SRead(cip->dataSocket, buf, bufSize, (int) cip->xferTimeout, kFullBufferNotRequired|kNoFirstSelect);
+			nread = (read_return_t) FTPReadData(cip, buf, bufSize);
 			if (nread == kTimeoutErr) {
 				cip->errNo = result = kErrDataTimedOut;
 				FTPLogError(cip, kDontPerror, "Remote read timed out after " PRINTF_LONG_LONG " bytes had been received.\n", cip->bytesTransferred);
@@ -816,6 +933,9 @@ add_eoln:
 			}
 			cip->bytesTransferred += (longest_int) nread;
 			FTPUpdateIOTimer(cip);
+			FTPGrowIOBuffer(cip, (size_t) nread, &nFullReads);
+			buf = cip->buf;
+			bufSize = cip->bufSize;
 		}
 	}
 
@@ -14,6 +14,46 @@
 #	define NO_SIGNALS 1
 #endif
 
+/* Asks for the sizes of all the files in the list at once, rather
+ * than with one SIZE and a round trip per file.
+ */
+static int
+FTPFileSizes(const FTPCIPtr cip, const FTPFileInfoListPtr files, const int xtype)
+{
+	FTPBatchCmdList batch;
+	FTPBatchCmdPtr bp;
+	FTPFileInfoPtr filePtr;
+	int result;
+
+	InitBatchCmdList(&batch);
+	for (filePtr = files->first; filePtr != NULL; filePtr = filePtr->next) {
+		if ((filePtr->type == 'd') || (filePtr->type == 'l'))
+			continue;
+		if (AddBatchCmd(&batch, kBatchSIZE, filePtr->rname, NULL) == NULL) {
+			DisposeBatchCmdListContents(&batch);
+			return (kErrMallocFailed);
+		}
+	}
+	if (batch.nCmds == 0)
+		return (kNoErr);
+
+	result = FTPBatchCmds(cip, &batch, xtype);
+	if (result == kNoErr) {
+		bp = batch.first;
+		for (filePtr = files->first; filePtr != NULL; filePtr = filePtr->next) {
+			if ((filePtr->type == 'd') || (filePtr->type == 'l'))
+				continue;
+			filePtr->size = bp->size;
+			bp = bp->next;
+		}
+	}
+	DisposeBatchCmdListContents(&batch);
+	return (result);
+}	/* FTPFileSizes */
+
+
+
+
 int
 FTPGetFiles3(
 	const FTPCIPtr cip,
@@ -42,7 +82,9 @@ FTPGetFiles3(
 	char *pattern2, *dstdir2;
 	char c;
 	int recurse1;
+	int sizesKnown;
 	int errRc;
+	FTPParallelXferPtr pxp;
 
 	LIBNCFTP_USE_VAR(reserved);
 	if (cip == NULL)
@@ -109,6 +151,9 @@ FTPGetFiles3(
 
 	cip->cancelXfer = 0;	/* should already be zero */
 
+	/* NULL unless cip->parallelConnections is set. */
+	pxp = InitParallelGet(cip, xtype, resumeflag, appendflag, deleteflag, resumeProc);
+
 	for (itemPtr = globList.first; itemPtr != NULL; itemPtr = itemPtr->next) {
 		if ((recurse == kRecursiveYes) && (FTPIsDir(cip, itemPtr->line) > 0)) {
 #ifdef TAR
@@ -120,8 +165,14 @@ FTPGetFiles3(
 			(void) FTPRemoteRecursiveFileList2(cip, itemPtr->line, &files);
 			(void) ComputeLNames(&files, itemPtr->line, dstdir, 1);
 			recurse1 = recurse;
+			/* Text file sizes from the listing don't account for
+			 * the end-of-line format used for the transfer, so
+			 * those are asked for, all together, up front.
+			 */
+			sizesKnown = ((xtype == kTypeAscii) && (FTPFileSizes(cip, &files, xtype) == kNoErr)) ? 1 : 0;
 		} else {
 			recurse1 = kRecursiveNo;
+			sizesKnown = 0;
 			(void) LineToFileInfoList(itemPtr, &files);
 			(void) ComputeRNames(&files, ".", 0, 1);
 			(void) ComputeLNames(&files, NULL, dstdir, 0);
@@ -157,6 +208,8 @@ FTPGetFiles3(
 			} else if (filePtr->type == 'l') {
 				/* skip it -- we do that next pass. */
 			} else if (recurse1 != kRecursiveYes) {
+				if ((pxp != NULL) && (AddParallelXfer(pxp, filePtr, files.nFileInfos, 0) == kNoErr))
+					continue;
 				result = FTPGetOneF(cip, filePtr->rname, filePtr->lname, xtype, -1, filePtr->size, filePtr->mdtm, resumeflag, appendflag, deleteflag, resumeProc);
 				if (files.nFileInfos == 1) {
 					if (result != kNoErr)
@@ -192,6 +245,8 @@ FTPGetFiles3(
 						*cp = c;
 					}
 				}
+				if ((pxp != NULL) && (AddParallelXfer(pxp, filePtr, files.nFileInfos, ((xtype == kTypeAscii) && (sizesKnown == 0))) == kNoErr))
+					continue;
 				if (xtype == kTypeAscii) {
 					/* Make sure we got the SIZE from
 					 * a SIZE command, and not a
@@ -204,9 +259,13 @@ FTPGetFiles3(
 						FTPCheckForRestartModeAvailability(cip); 
 					}
 					result = FTPSetTransferType(cip, xtype);
-					if (result < 0)
+					if (result < 0) {
+						if (pxp != NULL)
+							DisposeParallelXfer(pxp);
 						return (result);
-					(void) FTPFileSize(cip, filePtr->rname, &filePtr->size, xtype);
+					}
+					if (sizesKnown == 0)
+						(void) FTPFileSize(cip, filePtr->rname, &filePtr->size, xtype);
 				}
 				result = FTPGetOneF(cip, filePtr->rname, filePtr->lname, xtype, -1, filePtr->size, filePtr->mdtm, resumeflag, appendflag, deleteflag, resumeProc);
 
@@ -223,6 +282,10 @@ FTPGetFiles3(
 					break;
 			}
 		}
+		if ((pxp != NULL) && (recurse1 == kRecursiveYes)) {
+			/* Finish this tree before its symlinks and rmdirs. */
+			result = RunParallelXfers(pxp, &batchResult);
+		}
 		if (cip->cancelXfer > 0) {
 			DisposeFileInfoListContents(&files);
 			break;
@@ -254,6 +317,10 @@ FTPGetFiles3(
 		DisposeFileInfoListContents(&files);
 	}
 
+	if (pxp != NULL) {
+		(void) RunParallelXfers(pxp, &batchResult);
+		DisposeParallelXfer(pxp);
+	}
 	DisposeLineListContents(&globList);
 	if (batchResult < 0)
 		cip->errNo = batchResult;
@@ -14,6 +14,55 @@
 #	define NO_SIGNALS 1
 #endif
 
+/* Copies a MODE Z listing to outfd, dropping the CRs and NULs
+ * just like SReadline() would.
+ */
+static int
+FTPListModeZ(const FTPCIPtr cip, const int outfd, char *const buf, const size_t bufSize)
+{
+	char *src, *dst, *lim;
+	int nread;
+
+	cip->bytesTransferred = 0;
+	for (;;) {
+		if (! WaitForRemoteInput(cip)) {
+			FTPLogError(cip, kDontPerror, "Could not directory listing data -- timed out.\n");
+			cip->errNo = kErrDataTimedOut;
+			return (cip->errNo);
+		}
+		nread = FTPReadData(cip, buf, bufSize);
+		if (nread == kTimeoutErr) {
+			FTPLogError(cip, kDontPerror, "Could not directory listing data -- timed out.\n");
+			cip->errNo = kErrDataTimedOut;
+			return (cip->errNo);
+		} else if (nread == 0) {
+			/* end of listing -- done */
+			cip->numListings++;
+			return (kNoErr);
+		} else if (nread < 0) {
+			if (errno == EINTR)
+				continue;
+			FTPLogError(cip, kDoPerror, "Could not read directory listing data");
+			cip->errNo = kErrLISTFailed;
+			return (kErrLISTFailed);
+		}
+		cip->bytesTransferred += (longest_int) nread;
+
+		lim = buf + nread;
+		for (src = dst = buf; src < lim; src++) {
+			if ((*src != '\r') && (*src != '\0'))
+				*dst++ = *src;
+		}
+		if ((dst > buf) && (write(outfd, buf, (write_size_t) (dst - buf)) < 0)) {
+			cip->errNo = kErrLISTFailed;
+			return (kErrLISTFailed);
+		}
+	}
+}	/* FTPListModeZ */
+
+
+
+
 /* This isn't too useful -- it mostly serves as an example so you can write
  * your own function to do what you need to do with the listing.
  */
@@ -38,6 +87,7 @@ FTPList(const FTPCIPtr cip, const int outfd, const int longMode, const char *con
 		return (kErrBadMagic);
 
 	cmd = (longMode != 0) ? "LIST" : "NLST";
+	(void) FTPRequestModeZ(cip, NULL);
 	if ((lsflag == NULL) || (lsflag[0] == '\0')) {
 		result = FTPStartDataCmd(cip, kNetReading, kTypeAscii, (longest_int) 0, "%s", cmd);
 	} else {
@@ -47,7 +97,13 @@ FTPList(const FTPCIPtr cip, const int outfd, const int longMode, const char *con
 
 #ifdef NO_SIGNALS
 
-	if (result == 0) {
+	if ((result == 0) && (cip->usingModeZ != 0)) {
+		result = FTPListModeZ(cip, outfd, secondaryBuf, sizeof(secondaryBuf));
+		if (FTPEndDataCmd(cip, 1) < 0) {
+			result = kErrLISTFailed;
+			cip->errNo = kErrLISTFailed;
+		}
+	} else if (result == 0) {
 		if (InitSReadlineInfo(&lsSrl, cip->dataSocket, secondaryBuf, sizeof(secondaryBuf), (int) cip->xferTimeout, 1) < 0) {
 			/* Not really fdopen, but close in what we're trying to do. */
 			result = kErrFdopenR;
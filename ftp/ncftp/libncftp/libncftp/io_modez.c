@@ -0,0 +1,370 @@
+/* io_modez.c
+ *
+ * Copyright (c) 2026 The LibNcFTP contributors.
+ * Distributed under the same terms as the rest of LibNcFTP.
+ *
+ * MODE Z transfers, where the data connection carries a zlib (deflate)
+ * stream of what would have been sent in stream mode.  FTPGetOneF,
+ * FTPPutOneF, and FTPList ask for it with FTPRequestModeZ() before they
+ * start their data command; every other data command is sent in MODE S.
+ */
+
+#include "syshdrs.h"
+#ifdef PRAGMA_HDRSTOP
+#	pragma hdrstop
+#endif
+
+#if defined(HAVE_LIBZ) && defined(HAVE_ZLIB_H)
+#	define USE_MODE_Z 1
+#	include <zlib.h>
+#endif
+
+#ifdef USE_MODE_Z
+
+/* How much compressed data is read or written at a time. */
+#define kModeZBufSize		((size_t) 32768)
+
+typedef struct FTPModeZState {
+	z_stream zs;
+	int requested;			/* Use MODE Z for the next data command. */
+	int active;			/* zs is set up for the current transfer. */
+	int deflating;			/* Compressing an upload, not inflating. */
+	int moreOutput;			/* Inflate filled the caller's buffer last time. */
+	int inputEOF;			/* Read EOF from the data connection. */
+	int streamEnd;			/* Saw the end of the zlib stream. */
+	int levelSent;			/* Last level sent with OPTS MODE Z LEVEL. */
+	longest_int wireBytes;		/* Compressed bytes read or written. */
+	char buf[kModeZBufSize];
+} FTPModeZState, *FTPModeZStatePtr;
+
+
+
+
+/* Notes that the next data command should use MODE Z, if modeZLevel is
+ * set, the server listed MODE Z in its FEAT reply, and the extension of
+ * file (NULL for a listing) isn't one of modeZSkipExtensions.  Resumed
+ * transfers shouldn't ask, since not every server counts REST offsets
+ * in uncompressed bytes.  Returns 1 if MODE Z will be tried.
+ */
+int
+FTPRequestModeZ(const FTPCIPtr cip, const char *const file)
+{
+	FTPModeZStatePtr zp;
+
+	if ((cip->modeZLevel <= 0) || (cip->hasMODE_Z != kCommandAvailable))
+		return (0);
+	if ((file != NULL) && (cip->modeZSkipExtensions != NULL) && (FilenameExtensionIndicatesASCII(file, cip->modeZSkipExtensions) != 0))
+		return (0);
+
+	zp = (FTPModeZStatePtr) cip->modeZ;
+	if (zp == NULL) {
+		zp = (FTPModeZStatePtr) calloc((size_t) 1, sizeof(FTPModeZState));
+		if (zp == NULL)
+			return (0);
+		cip->modeZ = zp;
+	}
+	zp->requested = 1;
+	return (1);
+}	/* FTPRequestModeZ */
+
+
+
+
+/* Puts the server in the mode the data command about to be sent
+ * needs: MODE Z if FTPRequestModeZ() asked for it, otherwise MODE S.
+ * If the server won't do MODE Z, the transfer just uses MODE S.
+ */
+int
+FTPSetTransferMode(const FTPCIPtr cip, const int netMode)
+{
+	FTPModeZStatePtr zp;
+	int level;
+	int result;
+
+	cip->usingModeZ = 0;
+	zp = (FTPModeZStatePtr) cip->modeZ;
+	if ((zp == NULL) || (zp->requested == 0)) {
+		if (cip->curTransferMode != kTransferModeZ)
+			return (kNoErr);
+		result = FTPCmd(cip, "MODE S");
+		if (result != 2) {
+			if (result >= 0)
+				result = cip->errNo = kErrMODEFailed;
+			return (result);
+		}
+		cip->curTransferMode = kTransferModeStream;
+		return (kNoErr);
+	}
+	zp->requested = 0;
+	if (zp->active != 0)
+		FTPEndModeZ(cip);
+
+	if (cip->curTransferMode != kTransferModeZ) {
+		result = FTPCmd(cip, "MODE Z");
+		if (result < 0)
+			return (result);
+		if (result != 2) {
+			/* Some servers list it, but only allow it for some users. */
+			cip->hasMODE_Z = kCommandNotAvailable;
+			return (FTPSetTransferMode(cip, netMode));
+		}
+		cip->curTransferMode = kTransferModeZ;
+	}
+
+	level = (cip->modeZLevel > 9) ? 9 : cip->modeZLevel;
+	if (zp->levelSent != level) {
+		/* The server may limit the levels it allows;
+		 * if so, it uses its own.  Don't ask again.
+		 */
+		(void) FTPCmd(cip, "OPTS MODE Z LEVEL %d", level);
+		zp->levelSent = level;
+	}
+
+	memset(&zp->zs, 0, sizeof(zp->zs));
+	zp->deflating = (netMode == kNetWriting) ? 1 : 0;
+	if (zp->deflating != 0)
+		result = deflateInit(&zp->zs, level);
+	else
+		result = inflateInit(&zp->zs);
+	if (result != Z_OK) {
+		FTPLogError(cip, kDontPerror, "Could not set up MODE Z: %s.\n", (zp->zs.msg != NULL) ? zp->zs.msg : "zlib error");
+		cip->errNo = kErrMallocFailed;
+		return (kErrMallocFailed);
+	}
+	zp->active = 1;
+	zp->moreOutput = 0;
+	zp->inputEOF = 0;
+	zp->streamEnd = 0;
+	zp->wireBytes = 0;
+	cip->usingModeZ = 1;
+	PrintF(cip, "Using MODE Z, level %d.\n", level);
+	return (kNoErr);
+}	/* FTPSetTransferMode */
+
+
+
+
+/* Reads from the data connection like SRead(), but if the transfer
+ * is in MODE Z, returns the inflated data instead.
+ */
+int
+FTPReadData(const FTPCIPtr cip, char *const buf, const size_t bufSize)
+{
+	FTPModeZStatePtr zp;
+	int nread;
+	int zresult;
+
+	zp = (FTPModeZStatePtr) cip->modeZ;
+	if ((cip->usingModeZ == 0) || (zp == NULL) || (zp->active == 0) || (zp->deflating != 0))
+		return (SRead(cip->dataSocket, buf, bufSize, (int) cip->xferTimeout, kFullBufferNotRequired|kNoFirstSelect));
+
+	zp->zs.next_out = (Bytef *) buf;
+	zp->zs.avail_out = (uInt) bufSize;
+	while (zp->streamEnd == 0) {
+		if ((zp->zs.avail_in == 0) && (zp->moreOutput == 0)) {
+			if (zp->inputEOF != 0) {
+				if (zp->zs.avail_out < (uInt) bufSize)
+					break;
+				FTPLogError(cip, kDontPerror, "The compressed data ended early.\n");
+				errno = EIO;
+				return (-1);
+			}
+			nread = SRead(cip->dataSocket, zp->buf, sizeof(zp->buf), (int) cip->xferTimeout, kFullBufferNotRequired|kNoFirstSelect);
+			if (nread < 0)
+				return (nread);
+			if (nread == 0) {
+				zp->inputEOF = 1;
+				continue;
+			}
+			zp->zs.next_in = (Bytef *) zp->buf;
+			zp->zs.avail_in = (uInt) nread;
+			zp->wireBytes += (longest_int) nread;
+		}
+
+		zresult = inflate(&zp->zs, Z_NO_FLUSH);
+		zp->moreOutput = (zp->zs.avail_out == 0) ? 1 : 0;
+		if (zresult == Z_STREAM_END) {
+			zp->streamEnd = 1;
+		} else if (zresult == Z_BUF_ERROR) {
+			zp->moreOutput = 0;
+		} else if (zresult != Z_OK) {
+			FTPLogError(cip, kDontPerror, "The compressed data was corrupt: %s.\n", (zp->zs.msg != NULL) ? zp->zs.msg : "zlib error");
+			errno = EIO;
+			return (-1);
+		}
+		if (zp->zs.avail_out < (uInt) bufSize)
+			break;
+	}
+	return ((int) (bufSize - (size_t) zp->zs.avail_out));
+}	/* FTPReadData */
+
+
+
+
+/* Returns 1 if FTPReadData() has data for the caller without having
+ * to read from the data connection first.
+ */
+int
+FTPModeZPending(const FTPCIPtr cip)
+{
+	FTPModeZStatePtr zp;
+
+	zp = (FTPModeZStatePtr) cip->modeZ;
+	if ((cip->usingModeZ == 0) || (zp == NULL) || (zp->active == 0) || (zp->deflating != 0))
+		return (0);
+	if ((zp->zs.avail_in != 0) || (zp->moreOutput != 0) || (zp->inputEOF != 0) || (zp->streamEnd != 0))
+		return (1);
+	return (0);
+}	/* FTPModeZPending */
+
+
+
+
+/* Compresses data to send in MODE Z.  Call this with the data until it
+ * returns 0, sending the bytes it puts at *out each time; after the
+ * last of the data, do the same with finish set.  Returns the number
+ * of bytes at *out, or -1 if compression failed.
+ */
+int
+FTPModeZDeflate(const FTPCIPtr cip, const char **const src, size_t *const srcLen, const int finish, const char **const out)
+{
+	FTPModeZStatePtr zp;
+	int zresult;
+	size_t nout;
+
+	zp = (FTPModeZStatePtr) cip->modeZ;
+	if ((zp == NULL) || (zp->active == 0) || (zp->deflating == 0))
+		return (-1);
+	if (zp->streamEnd != 0)
+		return (0);
+
+	zp->zs.next_in = (Bytef *) *src;
+	zp->zs.avail_in = (uInt) *srcLen;
+	zp->zs.next_out = (Bytef *) zp->buf;
+	zp->zs.avail_out = (uInt) sizeof(zp->buf);
+	zresult = deflate(&zp->zs, (finish != 0) ? Z_FINISH : Z_NO_FLUSH);
+	if (zresult == Z_STREAM_END) {
+		zp->streamEnd = 1;
+	} else if ((zresult != Z_OK) && (zresult != Z_BUF_ERROR)) {
+		return (-1);
+	}
+	*src = (const char *) zp->zs.next_in;
+	*srcLen = (size_t) zp->zs.avail_in;
+
+	nout = sizeof(zp->buf) - (size_t) zp->zs.avail_out;
+	zp->wireBytes += (longest_int) nout;
+	*out = zp->buf;
+	return ((int) nout);
+}	/* FTPModeZDeflate */
+
+
+
+
+/* Done with the MODE Z stream of the current transfer, if any. */
+void
+FTPEndModeZ(const FTPCIPtr cip)
+{
+	FTPModeZStatePtr zp;
+
+	zp = (FTPModeZStatePtr) cip->modeZ;
+	if ((zp == NULL) || (zp->active == 0))
+		return;
+	if (zp->deflating != 0)
+		(void) deflateEnd(&zp->zs);
+	else
+		(void) inflateEnd(&zp->zs);
+	zp->active = 0;
+	cip->usingModeZ = 0;
+	if (zp->wireBytes > 0)
+		PrintF(cip, "MODE Z: " PRINTF_LONG_LONG " bytes, " PRINTF_LONG_LONG " compressed.\n", cip->bytesTransferred, zp->wireBytes);
+}	/* FTPEndModeZ */
+
+
+
+
+void
+FTPDisposeModeZ(const FTPCIPtr cip)
+{
+	if (cip->modeZ != NULL) {
+		FTPEndModeZ(cip);
+		free(cip->modeZ);
+		cip->modeZ = NULL;
+	}
+	cip->usingModeZ = 0;
+}	/* FTPDisposeModeZ */
+
+#else	/* USE_MODE_Z */
+
+/* Built without zlib, so everything is sent in MODE S. */
+
+int
+FTPRequestModeZ(const FTPCIPtr UNUSED(cip), const char *const UNUSED(file))
+{
+	LIBNCFTP_USE_VAR(cip);
+	LIBNCFTP_USE_VAR(file);
+	return (0);
+}	/* FTPRequestModeZ */
+
+
+
+
+int
+FTPSetTransferMode(const FTPCIPtr cip, const int UNUSED(netMode))
+{
+	LIBNCFTP_USE_VAR(netMode);
+	cip->usingModeZ = 0;
+	return (kNoErr);
+}	/* FTPSetTransferMode */
+
+
+
+
+int
+FTPReadData(const FTPCIPtr cip, char *const buf, const size_t bufSize)
+{
+	return (SRead(cip->dataSocket, buf, bufSize, (int) cip->xferTimeout, kFullBufferNotRequired|kNoFirstSelect));
+}	/* FTPReadData */
+
+
+
+
+int
+FTPModeZPending(const FTPCIPtr UNUSED(cip))
+{
+	LIBNCFTP_USE_VAR(cip);
+	return (0);
+}	/* FTPModeZPending */
+
+
+
+
+int
+FTPModeZDeflate(const FTPCIPtr UNUSED(cip), const char **const UNUSED(src), size_t *const UNUSED(srcLen), const int UNUSED(finish), const char **const UNUSED(out))
+{
+	LIBNCFTP_USE_VAR(cip);
+	LIBNCFTP_USE_VAR(src);
+	LIBNCFTP_USE_VAR(srcLen);
+	LIBNCFTP_USE_VAR(finish);
+	LIBNCFTP_USE_VAR(out);
+	return (-1);
+}	/* FTPModeZDeflate */
+
+
+
+
+void
+FTPEndModeZ(const FTPCIPtr UNUSED(cip))
+{
+	LIBNCFTP_USE_VAR(cip);
+}	/* FTPEndModeZ */
+
+
+
+
+void
+FTPDisposeModeZ(const FTPCIPtr cip)
+{
+	cip->usingModeZ = 0;
+}	/* FTPDisposeModeZ */
+
+#endif	/* USE_MODE_Z */
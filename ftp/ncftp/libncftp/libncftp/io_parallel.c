@@ -0,0 +1,987 @@
+/* io_parallel.c
+ *
+ * Copyright (c) 2026 The LibNcFTP contributors.
+ * Distributed under the same terms as the rest of LibNcFTP.
+ *
+ * Transfers the files of a batch (FTPGetFiles3, FTPPutFiles3) over
+ * several control connections at once.  The extra connections are
+ * clones of the caller's connection (same host, login, and working
+ * directory), each used by its own thread, which is the one thread
+ * per FTPConnectionInfo model the rest of the library supports.
+ */
+
+#include "syshdrs.h"
+#ifdef PRAGMA_HDRSTOP
+#	pragma hdrstop
+#endif
+
+#ifndef NO_SIGNALS
+#	define NO_SIGNALS 1
+#endif
+
+#ifndef O_BINARY
+	/* Needed for platforms using different EOLN sequence (i.e. DOS) */
+#	ifdef _O_BINARY
+#		define O_BINARY _O_BINARY
+#	else
+#		define O_BINARY 0
+#	endif
+#endif
+
+#if (defined(WIN32) || defined(_WINDOWS)) && !defined(__CYGWIN__)
+#	include <process.h>
+#	define HAVE_PARALLEL_XFERS 1
+	typedef CRITICAL_SECTION ParallelMutex;
+	typedef HANDLE ParallelThread;
+#	define ParallelLockInit(a) InitializeCriticalSection(a)
+#	define ParallelLockDispose(a) DeleteCriticalSection(a)
+#	define ParallelLock(a) EnterCriticalSection(a)
+#	define ParallelUnlock(a) LeaveCriticalSection(a)
+#elif defined(HAVE_PTHREAD_H) && defined(HAVE_LIBPTHREAD)
+#	include <pthread.h>
+#	define HAVE_PARALLEL_XFERS 1
+	typedef pthread_mutex_t ParallelMutex;
+	typedef pthread_t ParallelThread;
+#	define ParallelLockInit(a) (void) pthread_mutex_init(a, NULL)
+#	define ParallelLockDispose(a) (void) pthread_mutex_destroy(a)
+#	define ParallelLock(a) (void) pthread_mutex_lock(a)
+#	define ParallelUnlock(a) (void) pthread_mutex_unlock(a)
+#endif
+
+/* How often the calling thread checks on the workers, in milliseconds. */
+#define kParallelPollInterval		100
+
+/* Send a NOOP on the caller's (idle) connection this often, in seconds,
+ * so the server does not time it out during a long batch.
+ */
+#define kParallelNoopInterval		60
+
+typedef struct ParallelXferJob {
+	char *rname;
+	char *lname;
+	longest_int size;		/* Of the whole file. */
+	time_t mdtm;
+	longest_int startPoint;		/* Of this segment. */
+	longest_int length;		/* Of this segment, or kSizeUnknown. */
+	int file;			/* Index of the file's first job. */
+	int nSegments;			/* 0 if the file is not segmented. */
+	int segmentsLeft;		/* First job of a file only. */
+	int askSize;			/* Get the ASCII size with SIZE first. */
+	int strict;			/* Any error fails the batch. */
+	int result;			/* For the whole file, in its first job. */
+} ParallelXferJob, *ParallelXferJobPtr;
+
+typedef struct ParallelXferWorker {
+	FTPConnectionInfo ci;		/* Clone of the caller's connection. */
+	FTPParallelXferPtr pxp;
+#ifdef HAVE_PARALLEL_XFERS
+	ParallelThread thr;
+#endif
+	longest_int bytes;		/* Transferred for the current job. */
+	int cloned;
+	int started;
+	int failed;			/* Could not open; don't try again. */
+} ParallelXferWorker, *ParallelXferWorkerPtr;
+
+struct FTPParallelXfer {
+	FTPCIPtr cip;
+	int netMode;			/* kNetReading (get) or kNetWriting (put) */
+	int xtype;
+	int resumeflag;
+	int appendflag;
+	int deleteflag;
+	const char *tmppfx;
+	const char *tmpsfx;
+	time_t batchStartTime;
+	time_t origLmtime;
+	FTPConfirmResumeDownloadProc resumeDownloadProc;
+	FTPConfirmResumeUploadProc resumeUploadProc;
+	char cwd[512];
+
+	ParallelXferJobPtr jobs;
+	ParallelXferJobPtr *queue;	/* Largest first. */
+	int nJobs;
+	int nJobsAllocated;
+	int nextJob;
+
+	ParallelXferWorkerPtr workers;
+	int nWorkers;
+	int nRunning;
+	int cancel;
+	longest_int bytesDone;
+	longest_int totalSize;
+	int lastStarted;
+#ifdef HAVE_PARALLEL_XFERS
+	ParallelMutex lock;
+	ParallelMutex procLock;		/* Serializes calls to resume procs. */
+#endif
+};
+
+
+
+
+int
+FTPCloneConnectionInfo(const FTPCIPtr cip, const FTPCIPtr newcip)
+{
+	if ((cip == NULL) || (newcip == NULL))
+		return (kErrBadParameter);
+	if ((memcmp(cip->magic, kLibraryMagic, kLibraryMagicLen) != 0) || (memcmp(cip->tailMagic, kLibraryMagic, kLibraryMagicLen) != 0))
+		return (kErrBadMagic);
+
+	/* Take the host, login, and settings, then forget
+	 * everything that belongs to cip's connection.
+	 */
+	(void) memcpy(newcip, cip, sizeof(FTPConnectionInfo));
+	newcip->buf = NULL;
+	newcip->doAllocBuf = 1;
+	newcip->cin = NULL;
+	newcip->cout = NULL;
+	newcip->ctrlSocketR = kClosedFileDescriptor;
+	newcip->ctrlSocketW = kClosedFileDescriptor;
+	newcip->dataSocket = kClosedFileDescriptor;
+	newcip->startingWorkingDirectory = NULL;
+	newcip->currentWorkingDirectory = NULL;
+	newcip->dirCache = NULL;
+	newcip->modeZ = NULL;
+	newcip->usingModeZ = 0;
+	if (newcip->currentWorkingDirectorySize == 0)
+		newcip->currentWorkingDirectorySize = kDefaultPathBufSize;
+	InitLineList(&newcip->lastFTPCmdResultLL);
+#if USE_SIO
+	(void) memset(&newcip->ctrlSrl, 0, sizeof(newcip->ctrlSrl));
+#endif
+	FTPResetStatusVariables(newcip);
+	newcip->rname = NULL;
+	newcip->lname = NULL;
+
+	/* Messages were already shown for cip's connection. */
+	newcip->onConnectMsgProc = NULL;
+	newcip->onLoginMsgProc = NULL;
+	newcip->redialStatusProc = NULL;
+	newcip->printResponseProc = NULL;
+	newcip->passphraseProc = NULL;
+	newcip->progress = NULL;
+	return (kNoErr);
+}	/* FTPCloneConnectionInfo */
+
+
+
+
+#ifdef HAVE_PARALLEL_XFERS
+
+static void
+ParallelNap(void)
+{
+#if (defined(WIN32) || defined(_WINDOWS)) && !defined(__CYGWIN__)
+	Sleep(kParallelPollInterval);
+#else
+	struct timeval tv;
+
+	tv.tv_sec = 0;
+	tv.tv_usec = kParallelPollInterval * 1000;
+	(void) select(0, NULL, NULL, NULL, &tv);
+#endif
+}	/* ParallelNap */
+
+
+
+
+/* Progress meter of the workers' connections; just keeps track of the
+ * bytes, for the aggregate meter shown on the caller's connection.
+ */
+static void
+ParallelProgress(const FTPCIPtr wcip, int UNUSED(mode))
+{
+	ParallelXferWorkerPtr wp = (ParallelXferWorkerPtr) wcip->pUser;
+
+	LIBNCFTP_USE_VAR(mode);
+	ParallelLock(&wp->pxp->lock);
+	wp->bytes = wcip->bytesTransferred;
+	ParallelUnlock(&wp->pxp->lock);
+}	/* ParallelProgress */
+
+
+
+
+static int
+ParallelConfirmResumeDownload(const FTPCIPtr wcip, const char **localpath, longest_int localsize, time_t localmtime, const char *remotepath, longest_int remotesize, time_t remotetime, longest_int *startPoint)
+{
+	FTPParallelXferPtr pxp = ((ParallelXferWorkerPtr) wcip->pUser)->pxp;
+	int rc;
+
+	ParallelLock(&pxp->procLock);
+	rc = (*pxp->resumeDownloadProc)(wcip, localpath, localsize, localmtime, remotepath, remotesize, remotetime, startPoint);
+	ParallelUnlock(&pxp->procLock);
+	return (rc);
+}	/* ParallelConfirmResumeDownload */
+
+
+
+
+static int
+ParallelConfirmResumeUpload(const FTPCIPtr wcip, const char *localpath, longest_int localsize, time_t localmtime, const char **remotepath, longest_int remotesize, time_t remotetime, longest_int *startPoint)
+{
+	FTPParallelXferPtr pxp = ((ParallelXferWorkerPtr) wcip->pUser)->pxp;
+	int rc;
+
+	ParallelLock(&pxp->procLock);
+	rc = (*pxp->resumeUploadProc)(wcip, localpath, localsize, localmtime, remotepath, remotesize, remotetime, startPoint);
+	ParallelUnlock(&pxp->procLock);
+	return (rc);
+}	/* ParallelConfirmResumeUpload */
+
+
+
+
+/* Downloads one segment of a file into its place in the local file,
+ * starting the RETR at the segment's offset with REST.
+ */
+static int
+GetSegment(const FTPCIPtr cip, const ParallelXferJobPtr jp)
+{
+	int fd;
+	int result, tmpResult;
+	int lastSegment;
+	longest_int left;
+	size_t ntoread;
+	read_return_t nread;
+	write_return_t nwrote;
+
+	fd = Open(jp->lname, O_WRONLY|O_BINARY, 00666);
+	if (fd < 0) {
+		FTPLogError(cip, kDoPerror, "Cannot open local file %s for writing.\n", jp->lname);
+		cip->errNo = kErrOpenFailed;
+		return (kErrOpenFailed);
+	}
+	if (Lseek(fd, jp->startPoint, SEEK_SET) != jp->startPoint) {
+		(void) close(fd);
+		cip->errNo = kErrLseekFailed;
+		return (kErrLseekFailed);
+	}
+
+	result = FTPStartDataCmd(cip, kNetReading, kTypeBinary, jp->startPoint, "RETR %s", jp->rname);
+	if (result < 0) {
+		(void) close(fd);
+		if (result == kErrGeneric)
+			result = kErrRETRFailed;
+		cip->errNo = result;
+		return (result);
+	}
+	if (cip->startPoint != jp->startPoint) {
+		/* Remote could not or would not set the start offset. */
+		FTPAbortDataTransfer(cip);
+		(void) FTPEndDataCmd(cip, 1);
+		(void) close(fd);
+		cip->errNo = kErrSetStartPoint;
+		return (kErrSetStartPoint);
+	}
+
+	FTPInitIOTimer(cip);
+	cip->expectedSize = jp->size;
+	cip->mdtm = jp->mdtm;
+	cip->rname = jp->rname;
+	cip->lname = jp->lname;
+	FTPStartIOTimer(cip);
+
+	lastSegment = ((jp->startPoint + jp->length) >= jp->size);
+	left = jp->length;
+	result = kNoErr;
+	while (left > 0) {
+		if (! WaitForRemoteInput(cip)) {	/* could set cancelXfer */
+			cip->errNo = result = kErrDataTimedOut;
+			FTPLogError(cip, kDontPerror, "Remote read timed out after " PRINTF_LONG_LONG " bytes had been received.\n", cip->bytesTransferred);
+			break;
+		}
+		if (cip->cancelXfer > 0) {
+			FTPAbortDataTransfer(cip);
+			result = cip->errNo = kErrDataTransferAborted;
+			break;
+		}
+		ntoread = cip->bufSize;
+		if ((longest_int) ntoread > left)
+			ntoread = (size_t) left;
+		nread = (read_return_t) SRead(cip->dataSocket, cip->buf, ntoread, (int) cip->xferTimeout, kFullBufferNotRequired|kNoFirstSelect);
+		if (nread == kTimeoutErr) {
+			cip->errNo = result = kErrDataTimedOut;
+			FTPLogError(cip, kDontPerror, "Remote read timed out after " PRINTF_LONG_LONG " bytes had been received.\n", cip->bytesTransferred);
+			break;
+		} else if (nread < 0) {
+			if (errno == EINTR)
+				continue;
+			FTPLogError(cip, kDoPerror, "Remote read failed after " PRINTF_LONG_LONG " bytes had been received.\n", cip->bytesTransferred);
+			result = cip->errNo = kErrSocketReadFailed;
+			break;
+		} else if (nread == 0) {
+			/* The remote file got shorter. */
+			FTPLogError(cip, kDontPerror, "Remote file %s ended after " PRINTF_LONG_LONG " bytes.\n", jp->rname, jp->startPoint + cip->bytesTransferred);
+			result = cip->errNo = kErrDataTransferFailed;
+			lastSegment = 1;
+			break;
+		}
+
+		nwrote = PWrite(fd, cip->buf, (write_size_t) nread);
+		if (nwrote != nread) {
+			FTPLogError(cip, kDoPerror, "Local write failed after " PRINTF_LONG_LONG " bytes had been received.\n", cip->bytesTransferred);
+			result = cip->errNo = kErrWriteFailed;
+			(void) shutdown(cip->dataSocket, 2);
+			break;
+		}
+		left -= (longest_int) nread;
+		cip->bytesTransferred += (longest_int) nread;
+		FTPUpdateIOTimer(cip);
+	}
+	(void) close(fd);
+
+	if ((result == kNoErr) && (lastSegment == 0)) {
+		/* The rest of the file belongs to other segments. */
+		FTPAbortDataTransfer(cip);
+		tmpResult = FTPEndDataCmd(cip, 1);
+		if ((tmpResult < 0) && (tmpResult != kErrDataTransferFailed))
+			result = cip->errNo = kErrRETRFailed;
+	} else {
+		tmpResult = FTPEndDataCmd(cip, 1);
+		if ((tmpResult < 0) && (result == kNoErr))
+			result = cip->errNo = kErrRETRFailed;
+	}
+	FTPStopIOTimer(cip);
+
+	if (result == kNoErr)
+		cip->numDownloads++;
+	return (result);
+}	/* GetSegment */
+
+
+
+
+static int
+RunJob(const FTPParallelXferPtr pxp, const FTPCIPtr cip, const ParallelXferJobPtr jp)
+{
+	int result;
+	int onCaller = (cip == pxp->cip);
+	FTPConfirmResumeDownloadProc resumeDownloadProc = pxp->resumeDownloadProc;
+	FTPConfirmResumeUploadProc resumeUploadProc = pxp->resumeUploadProc;
+
+	if ((onCaller == 0) && (resumeDownloadProc != kNoFTPConfirmResumeDownloadProc))
+		resumeDownloadProc = ParallelConfirmResumeDownload;
+	if ((onCaller == 0) && (resumeUploadProc != kNoFTPConfirmResumeUploadProc))
+		resumeUploadProc = ParallelConfirmResumeUpload;
+
+	if (pxp->netMode == kNetWriting)
+		return (FTPPutOneF(cip, jp->lname, jp->rname, pxp->xtype, -1, pxp->appendflag, pxp->tmppfx, pxp->tmpsfx, pxp->resumeflag, pxp->deleteflag, resumeUploadProc, pxp->batchStartTime, pxp->origLmtime));
+
+	if (jp->nSegments > 0)
+		return (GetSegment(cip, jp));
+
+	if (jp->askSize != 0) {
+		/* Make sure we got the SIZE from a SIZE command,
+		 * and not a directory listing, which may not have
+		 * taken into the account the required end-of-line
+		 * format for text files sent over FTP.
+		 */
+		if ((pxp->resumeflag == kResumeYes) || (resumeDownloadProc != kNoFTPConfirmResumeDownloadProc))
+			FTPCheckForRestartModeAvailability(cip);
+		result = FTPSetTransferType(cip, pxp->xtype);
+		if (result < 0)
+			return (result);
+		(void) FTPFileSize(cip, jp->rname, &jp->size, pxp->xtype);
+	}
+	return (FTPGetOneF(cip, jp->rname, jp->lname, pxp->xtype, -1, jp->size, jp->mdtm, pxp->resumeflag, pxp->appendflag, pxp->deleteflag, resumeDownloadProc));
+}	/* RunJob */
+
+
+
+
+/* Call with the lock held. */
+static void
+FinishJob(const FTPParallelXferPtr pxp, const ParallelXferJobPtr jp, const int result, const longest_int bytes)
+{
+	ParallelXferJobPtr fjp = &pxp->jobs[jp->file];
+	struct utimbuf ut;
+
+	pxp->bytesDone += bytes;
+	if ((pxp->totalSize != kSizeUnknown) && (jp->length != kSizeUnknown) && (bytes < jp->length)) {
+		/* Skipped, resumed, or failed; don't wait for those bytes. */
+		pxp->totalSize -= jp->length - bytes;
+	}
+
+	if (jp->nSegments == 0) {
+		fjp->result = result;
+	} else {
+		if ((result != kNoErr) && (fjp->result == kNoErr))
+			fjp->result = result;
+		if ((--fjp->segmentsLeft == 0) && (fjp->result == kNoErr) && (fjp->mdtm != kModTimeUnknown)) {
+			(void) time(&ut.actime);
+			ut.modtime = fjp->mdtm;
+			(void) utime(fjp->lname, &ut);
+		}
+	}
+	if (result == kErrUserCanceled)
+		pxp->cancel = 1;
+}	/* FinishJob */
+
+
+
+
+static void
+ParallelWorker(const ParallelXferWorkerPtr wp)
+{
+	FTPParallelXferPtr pxp = wp->pxp;
+	FTPCIPtr wcip = &wp->ci;
+	ParallelXferJobPtr jp;
+	int result;
+
+	if (wcip->connected == 0) {
+		result = FTPOpenHost(wcip);
+		if ((result == kNoErr) && (pxp->cwd[0] != '\0'))
+			result = FTPChdir(wcip, pxp->cwd);
+		if (result != kNoErr) {
+			if (wcip->connected != 0)
+				(void) FTPCloseHost(wcip);
+			ParallelLock(&pxp->lock);
+			wp->failed = 1;
+			pxp->nRunning--;
+			ParallelUnlock(&pxp->lock);
+			return;
+		}
+	}
+
+	forever {
+		ParallelLock(&pxp->lock);
+		if ((pxp->cancel != 0) || (pxp->nextJob >= pxp->nJobs) || (wcip->connected == 0)) {
+			pxp->nRunning--;
+			ParallelUnlock(&pxp->lock);
+			break;
+		}
+		jp = pxp->queue[pxp->nextJob++];
+		pxp->lastStarted = (int) (jp - pxp->jobs);
+		wp->bytes = 0;
+		ParallelUnlock(&pxp->lock);
+
+		result = RunJob(pxp, wcip, jp);
+
+		ParallelLock(&pxp->lock);
+		FinishJob(pxp, jp, result, wp->bytes);
+		wp->bytes = 0;
+		ParallelUnlock(&pxp->lock);
+	}
+}	/* ParallelWorker */
+
+
+
+
+#if (defined(WIN32) || defined(_WINDOWS)) && !defined(__CYGWIN__)
+static unsigned int __stdcall
+ParallelThreadProc(void *arg)
+{
+	ParallelWorker((ParallelXferWorkerPtr) arg);
+	return (0);
+}	/* ParallelThreadProc */
+
+
+
+static int
+StartParallelThread(const ParallelXferWorkerPtr wp)
+{
+	wp->thr = (HANDLE) _beginthreadex(NULL, 0, ParallelThreadProc, wp, 0, NULL);
+	return ((wp->thr == 0) ? -1 : 0);
+}	/* StartParallelThread */
+
+
+
+static void
+JoinParallelThread(const ParallelXferWorkerPtr wp)
+{
+	(void) WaitForSingleObject(wp->thr, INFINITE);
+	(void) CloseHandle(wp->thr);
+}	/* JoinParallelThread */
+
+#else
+
+static void *
+ParallelThreadProc(void *arg)
+{
+	ParallelWorker((ParallelXferWorkerPtr) arg);
+	return (NULL);
+}	/* ParallelThreadProc */
+
+
+
+static int
+StartParallelThread(const ParallelXferWorkerPtr wp)
+{
+	return ((pthread_create(&wp->thr, NULL, ParallelThreadProc, wp) != 0) ? -1 : 0);
+}	/* StartParallelThread */
+
+
+
+static void
+JoinParallelThread(const ParallelXferWorkerPtr wp)
+{
+	(void) pthread_join(wp->thr, NULL);
+}	/* JoinParallelThread */
+#endif
+
+
+
+
+static int
+CompareJobs(const void *a, const void *b)
+{
+	const ParallelXferJob *ja = *(const ParallelXferJob *const *) a;
+	const ParallelXferJob *jb = *(const ParallelXferJob *const *) b;
+
+	if (ja->length > jb->length)
+		return (-1);
+	if (ja->length < jb->length)
+		return (1);
+	if (ja < jb)
+		return (-1);
+	return ((ja > jb) ? 1 : 0);
+}	/* CompareJobs */
+
+
+
+
+/* Splits a big download into segments, one for each connection (but
+ * none smaller than kParallelSegmentMinSize), which are fetched at
+ * the same time using REST.
+ */
+static int
+SplitJob(const FTPParallelXferPtr pxp, const int i)
+{
+	ParallelXferJobPtr jp;
+	FTPCIPtr cip = pxp->cip;
+	longest_int segSize, size;
+	int n, nSegments, xtype;
+	struct Stat st;
+	int fd;
+
+	jp = &pxp->jobs[i];
+	size = jp->size;
+	if ((pxp->netMode != kNetReading) || (jp->askSize != 0) || (pxp->deleteflag == kDeleteYes))
+		return (kNoErr);
+	if ((size == kSizeUnknown) || (size < (2 * kParallelSegmentMinSize)))
+		return (kNoErr);
+	xtype = pxp->xtype;
+	AutomaticallyUseASCIIModeDependingOnExtension(cip, jp->rname, &xtype);
+	if (xtype != kTypeBinary)
+		return (kNoErr);
+	if (Stat(jp->lname, &st) == 0) {
+		/* Only if we would overwrite it anyway. */
+		if ((pxp->resumeflag == kResumeYes) || (pxp->appendflag == kAppendYes) || (pxp->resumeDownloadProc != kNoFTPConfirmResumeDownloadProc))
+			return (kNoErr);
+		if (! S_ISREG(st.st_mode))
+			return (kNoErr);
+	}
+	FTPCheckForRestartModeAvailability(cip);
+	if (cip->hasREST != kCommandAvailable)
+		return (kNoErr);
+
+	nSegments = cip->parallelConnections;
+	if ((size / kParallelSegmentMinSize) < (longest_int) nSegments)
+		nSegments = (int) (size / kParallelSegmentMinSize);
+	segSize = (size + nSegments - 1) / nSegments;
+
+	if ((pxp->nJobs + nSegments - 1) > pxp->nJobsAllocated) {
+		jp = (ParallelXferJobPtr) realloc(pxp->jobs, sizeof(ParallelXferJob) * (size_t) (pxp->nJobs + nSegments - 1));
+		if (jp == NULL)
+			return (kErrMallocFailed);
+		pxp->jobs = jp;
+		pxp->nJobsAllocated = pxp->nJobs + nSegments - 1;
+		jp = &pxp->jobs[i];
+	}
+
+	fd = Open(jp->lname, O_WRONLY|O_CREAT|O_TRUNC|O_BINARY, 00666);
+	if (fd < 0) {
+		/* Let FTPGetOneF() report it. */
+		return (kNoErr);
+	}
+	(void) close(fd);
+
+	jp->nSegments = nSegments;
+	jp->segmentsLeft = nSegments;
+	jp->length = segSize;
+	for (n = 1; n < nSegments; n++) {
+		(void) memcpy(&pxp->jobs[pxp->nJobs], jp, sizeof(ParallelXferJob));
+		pxp->jobs[pxp->nJobs].startPoint = segSize * n;
+		pxp->jobs[pxp->nJobs].length = (n == (nSegments - 1)) ? (size - (segSize * n)) : segSize;
+		pxp->nJobs++;
+	}
+	return (kNoErr);
+}	/* SplitJob */
+
+#endif	/* HAVE_PARALLEL_XFERS */
+
+
+
+
+static FTPParallelXferPtr
+InitParallelXfer(const FTPCIPtr cip, const int netMode)
+{
+#ifdef HAVE_PARALLEL_XFERS
+	FTPParallelXferPtr pxp;
+
+	if ((cip->parallelConnections < 2) || (cip->connected == 0))
+		return (NULL);
+	pxp = (FTPParallelXferPtr) calloc((size_t) 1, sizeof(struct FTPParallelXfer));
+	if (pxp == NULL)
+		return (NULL);
+	pxp->workers = (ParallelXferWorkerPtr) calloc((size_t) cip->parallelConnections, sizeof(ParallelXferWorker));
+	if (pxp->workers == NULL) {
+		free(pxp);
+		return (NULL);
+	}
+	pxp->nWorkers = cip->parallelConnections;
+	pxp->cip = cip;
+	pxp->netMode = netMode;
+	ParallelLockInit(&pxp->lock);
+	ParallelLockInit(&pxp->procLock);
+	return (pxp);
+#else
+	LIBNCFTP_USE_VAR(cip);
+	LIBNCFTP_USE_VAR(netMode);
+	return (NULL);
+#endif
+}	/* InitParallelXfer */
+
+
+
+
+FTPParallelXferPtr
+InitParallelGet(const FTPCIPtr cip, const int xtype, const int resumeflag, const int appendflag, const int deleteflag, const FTPConfirmResumeDownloadProc resumeProc)
+{
+	FTPParallelXferPtr pxp;
+
+	pxp = InitParallelXfer(cip, kNetReading);
+	if (pxp != NULL) {
+		if (deleteflag == kDeleteYes)
+			FTPFlushDirCache(cip);
+		pxp->xtype = xtype;
+		pxp->resumeflag = resumeflag;
+		pxp->appendflag = appendflag;
+		pxp->deleteflag = deleteflag;
+		pxp->resumeDownloadProc = resumeProc;
+	}
+	return (pxp);
+}	/* InitParallelGet */
+
+
+
+
+FTPParallelXferPtr
+InitParallelPut(const FTPCIPtr cip, const int xtype, const int appendflag, const char *const tmppfx, const char *const tmpsfx, const int resumeflag, const int deleteflag, const FTPConfirmResumeUploadProc resumeProc, const time_t batchStartTime, const time_t origLmtime)
+{
+	FTPParallelXferPtr pxp;
+
+	pxp = InitParallelXfer(cip, kNetWriting);
+	if (pxp != NULL) {
+		/* The other connections' uploads don't go through cip. */
+		FTPFlushDirCache(cip);
+		pxp->xtype = xtype;
+		pxp->appendflag = appendflag;
+		pxp->tmppfx = tmppfx;
+		pxp->tmpsfx = tmpsfx;
+		pxp->resumeflag = resumeflag;
+		pxp->deleteflag = deleteflag;
+		pxp->resumeUploadProc = resumeProc;
+		pxp->batchStartTime = batchStartTime;
+		pxp->origLmtime = origLmtime;
+	}
+	return (pxp);
+}	/* InitParallelPut */
+
+
+
+
+/* Queues a file for RunParallelXfers().  If this fails, transfer
+ * the file the usual way.
+ */
+int
+AddParallelXfer(const FTPParallelXferPtr pxp, const FTPFileInfoPtr fip, const int nFileInfos, const int askSize)
+{
+	ParallelXferJobPtr jp;
+	int n;
+
+	if (pxp->nJobs >= pxp->nJobsAllocated) {
+		n = (pxp->nJobsAllocated < 16) ? 16 : (pxp->nJobsAllocated * 2);
+		jp = (ParallelXferJobPtr) realloc(pxp->jobs, sizeof(ParallelXferJob) * (size_t) n);
+		if (jp == NULL)
+			return (kErrMallocFailed);
+		pxp->jobs = jp;
+		pxp->nJobsAllocated = n;
+	}
+
+	jp = &pxp->jobs[pxp->nJobs];
+	(void) memset(jp, 0, sizeof(ParallelXferJob));
+	jp->rname = StrDup(fip->rname);
+	jp->lname = StrDup(fip->lname);
+	if ((jp->rname == NULL) || (jp->lname == NULL)) {
+		if (jp->rname != NULL)
+			free(jp->rname);
+		if (jp->lname != NULL)
+			free(jp->lname);
+		return (kErrMallocFailed);
+	}
+	jp->size = fip->size;
+	jp->mdtm = fip->mdtm;
+	jp->startPoint = (longest_int) 0;
+	jp->length = fip->size;
+	jp->file = pxp->nJobs;
+	jp->askSize = askSize;
+	jp->strict = (nFileInfos == 1);
+	jp->result = kNoErr;
+	pxp->nJobs++;
+	return (kNoErr);
+}	/* AddParallelXfer */
+
+
+
+
+#ifdef HAVE_PARALLEL_XFERS
+static void
+ClearParallelXfers(const FTPParallelXferPtr pxp)
+{
+	int i;
+
+	for (i = 0; i < pxp->nJobs; i++) {
+		if (pxp->jobs[i].file != i)
+			continue;	/* Segment; shares the strings. */
+		free(pxp->jobs[i].rname);
+		free(pxp->jobs[i].lname);
+	}
+	pxp->nJobs = 0;
+	pxp->nextJob = 0;
+	if (pxp->queue != NULL) {
+		free(pxp->queue);
+		pxp->queue = NULL;
+	}
+}	/* ClearParallelXfers */
+#endif	/* HAVE_PARALLEL_XFERS */
+
+
+
+
+/* Transfers the queued files, and updates the batch result the way
+ * FTPGetFiles3() and FTPPutFiles3() do for each file.  Returns the
+ * first error that counts for the batch, or kNoErr.
+ */
+int
+RunParallelXfers(const FTPParallelXferPtr pxp, int *const batchResult)
+{
+#ifdef HAVE_PARALLEL_XFERS
+	FTPCIPtr cip = pxp->cip;
+	ParallelXferWorkerPtr wp;
+	ParallelXferJobPtr jp;
+	int i, n, nFiles, result, rc;
+	int meter;
+	time_t now, nextNoop;
+
+	if (pxp->nJobs == 0)
+		return (kNoErr);
+	if (cip->cancelXfer > 0) {
+		ClearParallelXfers(pxp);
+		return (kNoErr);
+	}
+
+	nFiles = pxp->nJobs;
+	if ((nFiles == 1) && (pxp->netMode == kNetReading) && (pxp->jobs[0].size == kSizeUnknown) && (pxp->jobs[0].askSize == 0)) {
+		/* A single file; see if it is big enough to split. */
+		jp = &pxp->jobs[0];
+		if (FTPFileSizeAndModificationTime(cip, jp->rname, &jp->size, kTypeBinary, &jp->mdtm) == kNoErr)
+			jp->length = jp->size;
+	}
+	for (i = 0; i < nFiles; i++) {
+		if ((result = SplitJob(pxp, i)) < 0) {
+			ClearParallelXfers(pxp);
+			return (result);
+		}
+	}
+
+	pxp->queue = (ParallelXferJobPtr *) calloc((size_t) ((unsigned int) pxp->nJobs), sizeof(ParallelXferJobPtr));
+	if (pxp->queue == NULL) {
+		ClearParallelXfers(pxp);
+		return (kErrMallocFailed);
+	}
+	pxp->totalSize = (longest_int) 0;
+	for (i = 0; i < pxp->nJobs; i++) {
+		pxp->queue[i] = &pxp->jobs[i];
+		if ((pxp->totalSize != kSizeUnknown) && (pxp->jobs[i].length != kSizeUnknown))
+			pxp->totalSize += pxp->jobs[i].length;
+		else
+			pxp->totalSize = kSizeUnknown;
+	}
+	qsort(pxp->queue, (size_t) pxp->nJobs, sizeof(ParallelXferJobPtr), CompareJobs);
+	pxp->nextJob = 0;
+	pxp->bytesDone = (longest_int) 0;
+	pxp->cancel = 0;
+	pxp->lastStarted = pxp->queue[0]->file;
+
+	n = pxp->nWorkers;
+	if (n > pxp->nJobs)
+		n = pxp->nJobs;
+	if (n < 2)
+		n = 0;		/* Not worth another connection. */
+
+	meter = 0;
+	if ((n > 0) && (cip->progress != (FTPProgressMeterProc) 0)) {
+		meter = 1;
+		FTPInitIOTimer(cip);
+		cip->expectedSize = pxp->totalSize;
+		cip->startPoint = (longest_int) 0;
+		cip->rname = pxp->queue[0]->rname;
+		cip->lname = pxp->queue[0]->lname;
+		FTPStartIOTimer(cip);
+	}
+
+	pxp->nRunning = 0;
+	for (i = 0; i < n; i++) {
+		wp = &pxp->workers[i];
+		if (wp->failed != 0)
+			continue;
+		if (wp->cloned == 0) {
+			if (pxp->cwd[0] == '\0')
+				(void) FTPGetCWD(cip, pxp->cwd, sizeof(pxp->cwd));
+			if (FTPCloneConnectionInfo(cip, &wp->ci) != kNoErr) {
+				wp->failed = 1;
+				continue;
+			}
+			wp->ci.pUser = wp;
+			wp->ci.maxDials = 1;
+			wp->ci.useSendfile = 0;	/* It uses signals. */
+			wp->ci.doNotGetStartingWorkingDirectory = 1;
+			wp->pxp = pxp;
+			wp->cloned = 1;
+		}
+		wp->ci.progress = (meter != 0) ? ParallelProgress : (FTPProgressMeterProc) 0;
+		wp->ci.cancelXfer = 0;
+		wp->bytes = 0;
+		ParallelLock(&pxp->lock);
+		pxp->nRunning++;
+		ParallelUnlock(&pxp->lock);
+		if (StartParallelThread(wp) < 0) {
+			ParallelLock(&pxp->lock);
+			pxp->nRunning--;
+			ParallelUnlock(&pxp->lock);
+			wp->started = 0;
+			continue;
+		}
+		wp->started = 1;
+	}
+
+	(void) time(&nextNoop);
+	nextNoop += kParallelNoopInterval;
+	forever {
+		ParallelLock(&pxp->lock);
+		if (pxp->nRunning <= 0) {
+			ParallelUnlock(&pxp->lock);
+			break;
+		}
+		if ((cip->cancelXfer > 0) && (pxp->cancel == 0)) {
+			pxp->cancel = 1;
+			for (i = 0; i < n; i++)
+				pxp->workers[i].ci.cancelXfer = 1;
+		}
+		if (meter != 0) {
+			cip->bytesTransferred = pxp->bytesDone;
+			for (i = 0; i < n; i++)
+				cip->bytesTransferred += pxp->workers[i].bytes;
+			cip->expectedSize = pxp->totalSize;
+			cip->rname = pxp->jobs[pxp->lastStarted].rname;
+			cip->lname = pxp->jobs[pxp->lastStarted].lname;
+		}
+		ParallelUnlock(&pxp->lock);
+
+		if (meter != 0)
+			FTPUpdateIOTimer(cip);
+		(void) time(&now);
+		if (now >= nextNoop) {
+			(void) FTPCmd(cip, "NOOP");
+			nextNoop = now + kParallelNoopInterval;
+		}
+		ParallelNap();
+	}
+	for (i = 0; i < n; i++) {
+		if (pxp->workers[i].started != 0) {
+			JoinParallelThread(&pxp->workers[i]);
+			pxp->workers[i].started = 0;
+		}
+	}
+
+	if (meter != 0) {
+		cip->bytesTransferred = pxp->bytesDone;
+		cip->expectedSize = pxp->totalSize;
+		FTPStopIOTimer(cip);
+	}
+
+	/* Whatever the other connections didn't get to
+	 * (all of it, if none could be opened).
+	 */
+	while ((pxp->cancel == 0) && (pxp->nextJob < pxp->nJobs) && (cip->connected != 0) && (cip->cancelXfer <= 0)) {
+		jp = pxp->queue[pxp->nextJob++];
+		result = RunJob(pxp, cip, jp);
+		FinishJob(pxp, jp, result, (longest_int) 0);
+	}
+	if (pxp->cancel != 0)
+		cip->cancelXfer = 1;
+
+	rc = kNoErr;
+	for (i = 0; i < pxp->nJobs; i++) {
+		jp = &pxp->jobs[i];
+		if (jp->file != i)
+			continue;
+		result = jp->result;
+		if ((jp->nSegments == 0) && (i >= nFiles))
+			continue;
+		if (jp->strict != 0) {
+			if (result == kNoErr)
+				continue;
+		} else if ((result == kNoErr) || (result == kErrLocalFileNewer) || (result == kErrRemoteFileNewer) || (result == kErrLocalSameAsRemote) || (result == kErrRemoteSameAsLocal)) {
+			continue;
+		}
+		*batchResult = result;
+		if (rc == kNoErr)
+			rc = result;
+	}
+	for (i = pxp->nextJob; i < pxp->nJobs; i++) {
+		/* Never started. */
+		if (pxp->queue[i]->result == kNoErr) {
+			if (rc == kNoErr)
+				rc = (cip->connected == 0) ? kErrRemoteHostClosedConnection : kErrUserCanceled;
+			*batchResult = rc;
+			break;
+		}
+	}
+
+	ClearParallelXfers(pxp);
+	return (rc);
+#else
+	LIBNCFTP_USE_VAR(pxp);
+	LIBNCFTP_USE_VAR(batchResult);
+	return (kNoErr);
+#endif
+}	/* RunParallelXfers */
+
+
+
+
+void
+DisposeParallelXfer(const FTPParallelXferPtr pxp)
+{
+#ifdef HAVE_PARALLEL_XFERS
+	int i;
+
+	ClearParallelXfers(pxp);
+	for (i = 0; i < pxp->nWorkers; i++) {
+		if (pxp->workers[i].cloned != 0)
+			(void) FTPCloseHost(&pxp->workers[i].ci);
+	}
+	free(pxp->workers);
+	if (pxp->jobs != NULL)
+		free(pxp->jobs);
+	ParallelLockDispose(&pxp->lock);
+	ParallelLockDispose(&pxp->procLock);
+	free(pxp);
+#else
+	LIBNCFTP_USE_VAR(pxp);
+#endif
+}	/* DisposeParallelXfer */
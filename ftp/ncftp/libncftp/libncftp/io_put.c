@@ -141,7 +141,7 @@ FTPASCIILocalFileSeek(const int fd, const longest_int howMuchToSkip, char *const
 
 
 static int
-FTPPutBlock(
+FTPPutRawBlock(
 	const FTPCIPtr cip,
 	const char *cp,
 	write_size_t ntowrite
@@ -186,6 +186,49 @@ FTPPutBlock(
 	FTPUpdateIOTimer(cip);
 
 	return (result);
+}	/* FTPPutRawBlock */
+
+
+
+
+/* Sends a block of the file, compressing it first if the transfer is
+ * in MODE Z.  The compressor holds on to some of the data, so after
+ * the last block call this with finish set (and no data) to send the
+ * rest.
+ */
+static int
+FTPPutBlock(
+	const FTPCIPtr cip,
+	const char *cp,
+	write_size_t ntowrite,
+	const int finish
+)
+{
+	const char *zout;
+	size_t zleft;
+	int nz;
+	int result;
+
+	if (cip->usingModeZ == 0)
+		return ((ntowrite == 0) ? kNoErr : FTPPutRawBlock(cip, cp, ntowrite));
+
+	zleft = (size_t) ntowrite;
+	forever {
+		nz = FTPModeZDeflate(cip, &cp, &zleft, finish, &zout);
+		if (nz < 0) {
+			FTPLogError(cip, kDontPerror, "MODE Z compression failed after " PRINTF_LONG_LONG " bytes had been sent.\n", cip->bytesTransferred);
+			cip->errNo = result = kErrSTORFailed;
+			(void) shutdown(cip->dataSocket, 2);
+			return (result);
+		}
+		if (nz == 0)
+			break;
+		if ((result = FTPPutRawBlock(cip, zout, (write_size_t) nz)) < 0)
+			return (result);
+		if ((zleft == 0) && (finish == 0))
+			break;
+	}
+	return (kNoErr);
 }	/* FTPPutBlock */
 
 
@@ -212,6 +255,7 @@ FTPPutOneF(
 	const char *odstfile;
 	const char *tdstfile;
 	size_t bufSize;
+	int nFullReads;
 	size_t l;
 	int tmpResult, result, pbrc;
 	read_return_t nread;
@@ -512,6 +556,8 @@ FTPPutOneF(
 	memcpy(cmdStr, cmd, 4 + 1 /* space */ + 1 /* nul byte */);
 	STRNCAT(cmdStr, dstfile);
 
+	if (startPoint == 0)
+		(void) FTPRequestModeZ(cip, odstfile);
 	tmpResult = FTPStartDataCmd2(
 		cip,
 		kNetWriting,
@@ -530,6 +576,11 @@ FTPPutOneF(
 		return (cip->errNo);
 	}
 
+	if (cip->usingModeZ != 0) {
+		/* The data has to go through the compressor. */
+		cip->usingSendfile = 0;
+	}
+
 	if ((startPoint != 0) && (cip->startPoint == 0)) {
 		/* Remote could not or would not set the start offset
 		 * to what we wanted.
@@ -595,7 +646,7 @@ FTPPutOneF(
 				ntowrite = (write_size_t) nread;
 				cp = inbuf;
 	
-				if ((pbrc = FTPPutBlock(cip, cp, ntowrite)) < 0) {
+				if ((pbrc = FTPPutBlock(cip, cp, ntowrite, 0)) < 0) {
 					result = pbrc;
 					goto brk;
 				}
@@ -672,7 +723,7 @@ FTPPutOneF(
 				ntowrite = (write_size_t) (dst - cip->buf);
 				cp = cip->buf;
 	
-				if ((pbrc = FTPPutBlock(cip, cp, ntowrite)) < 0) {
+				if ((pbrc = FTPPutBlock(cip, cp, ntowrite, 0)) < 0) {
 					result = pbrc;
 					goto brk;
 				}
@@ -689,7 +740,7 @@ FTPPutOneF(
 				cp = crlf;
 				ntowrite = 2;
 	
-				if ((pbrc = FTPPutBlock(cip, cp, ntowrite)) < 0) {
+				if ((pbrc = FTPPutBlock(cip, cp, ntowrite, 0)) < 0) {
 					result = pbrc;
 					goto brk;
 				}
@@ -739,6 +790,7 @@ FTPPutOneF(
 	} else {
 		/* binary */
 		cip->usingSendfile = 0;
+		nFullReads = 0;
 		for (;;) {
 			cp = buf;
 			nread = read(fd, cp, (read_size_t) bufSize);
@@ -757,13 +809,20 @@ FTPPutOneF(
 			cip->bytesTransferred += (longest_int) nread;
 	
 			ntowrite = (write_size_t) nread;
-			if ((pbrc = FTPPutBlock(cip, cp, ntowrite)) < 0) {
+			if ((pbrc = FTPPutBlock(cip, cp, ntowrite, 0)) < 0) {
 				result = pbrc;
 				goto brk;
 			}
+			FTPGrowIOBuffer(cip, (size_t) nread, &nFullReads);
+			buf = cip->buf;
+			bufSize = cip->bufSize;
 		}
 	}
 brk:
+	if ((result == kNoErr) && (cip->usingModeZ != 0)) {
+		/* Send what the compressor still has. */
+		result = FTPPutBlock(cip, NULL, 0, 1);
+	}
 
 	/* This looks very bizarre, since
 	 * we will be checking the socket
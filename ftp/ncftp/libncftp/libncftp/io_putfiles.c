@@ -14,13 +14,10 @@
 #	define NO_SIGNALS 1
 #endif
 
-int
-FTPPutFiles4(
+static int
+PutFileInfoList(
 	const FTPCIPtr cip,
-	const char *const pattern,
-	const char *const dstdir1,
-	const int recurse,
-	const int doGlob,
+	const FTPFileInfoListPtr filp,
 	const int xtype,
 	const int appendflag,
 	const char *const tmppfx,
@@ -31,45 +28,13 @@ FTPPutFiles4(
 	const time_t batchStartTime,
 	const time_t origLmtime)
 {
-	FTPLineList globList;
-	FTPFileInfoList files;
 	FTPFileInfoPtr filePtr;
 	int batchResult;
 	int result;
-	const char *dstdir;
-	char dstdir2[512];
-	int appendflag2 = appendflag;
-
-	if (cip == NULL)
-		return (kErrBadParameter);
-	if (strcmp(cip->magic, kLibraryMagic))
-		return (kErrBadMagic);
-
-	if (dstdir1 == NULL) {
-		dstdir = NULL;
-	} else {
-		dstdir = STRNCPY(dstdir2, dstdir1);
-		StrRemoveTrailingLocalPathDelim(dstdir2);
-	}
-
-	(void) FTPLocalGlob(cip, &globList, pattern, doGlob);
-	if (recurse == kRecursiveYes) {
-		appendflag2 = kAppendNo;
-		(void) FTPLocalRecursiveFileList(cip, &globList, &files);
-		if (files.first == NULL) {
-			cip->errNo = kErrNoValidFilesSpecified;
-			return (kErrNoValidFilesSpecified);
-		}
-		(void) ComputeRNames(&files, dstdir, 0, 1);
-	} else {
-		(void) LineListToFileInfoList(&globList, &files);
-		(void) ComputeLNames(&files, NULL, NULL, 1);
-		(void) ComputeRNames(&files, dstdir, 0, 0);
-	}
-	DisposeLineListContents(&globList);
+	FTPParallelXferPtr pxp;
 
 #if 0
-	for (filePtr = files.first; filePtr != NULL; filePtr = filePtr->next) {
+	for (filePtr = filp->first; filePtr != NULL; filePtr = filePtr->next) {
 		PrintF(cip, "  R=%s, L=%s, 2=%s, size=%lld, mdtm=%u, type=%c\n",
 			filePtr->rname,
 			filePtr->lname,
@@ -81,8 +46,14 @@ FTPPutFiles4(
 	}
 #endif
 
+	/* NULL unless cip->parallelConnections is set.
+	 * Directories are still created here, in order,
+	 * before the queued files are sent.
+	 */
+	pxp = InitParallelPut(cip, xtype, appendflag, tmppfx, tmpsfx, resumeflag, deleteflag, resumeProc, batchStartTime, origLmtime);
+
 	batchResult = kNoErr;
-	for (filePtr = files.first; filePtr != NULL; filePtr = filePtr->next) {
+	for (filePtr = filp->first; filePtr != NULL; filePtr = filePtr->next) {
 		if (cip->connected == 0) {
 			if (batchResult == kNoErr)
 				batchResult = kErrRemoteHostClosedConnection;
@@ -101,22 +72,11 @@ FTPPutFiles4(
 			if ((filePtr->rlinkto != NULL) && (filePtr->rlinkto[0] != '\0'))
 				(void) FTPSymlink(cip, filePtr->rname, filePtr->rlinkto);
 #endif
-		} else if (recurse != kRecursiveYes) {
-			result = FTPPutOneF(cip, filePtr->lname, filePtr->rname, xtype, -1, appendflag2, tmppfx, tmpsfx, resumeflag, deleteflag, resumeProc, batchStartTime, origLmtime);
-			if (files.nFileInfos == 1) {
-				if (result != kNoErr)
-					batchResult = result;
-			} else {
-				if ((result != kNoErr) && (result != kErrLocalFileNewer) && (result != kErrRemoteFileNewer) && (result != kErrRemoteSameAsLocal))
-					batchResult = result;
-			}
-			if (result == kErrUserCanceled)
-				cip->cancelXfer = 1;
-			if (cip->cancelXfer > 0)
-				break;
 		} else {
-			result = FTPPutOneF(cip, filePtr->lname, filePtr->rname, xtype, -1, appendflag2, tmppfx, tmpsfx, resumeflag, deleteflag, resumeProc, batchStartTime, origLmtime);
-			if (files.nFileInfos == 1) {
+			if ((pxp != NULL) && (AddParallelXfer(pxp, filePtr, filp->nFileInfos, 0) == kNoErr))
+				continue;
+			result = FTPPutOneF(cip, filePtr->lname, filePtr->rname, xtype, -1, appendflag, tmppfx, tmpsfx, resumeflag, deleteflag, resumeProc, batchStartTime, origLmtime);
+			if (filp->nFileInfos == 1) {
 				if (result != kNoErr)
 					batchResult = result;
 			} else {
@@ -129,6 +89,69 @@ FTPPutFiles4(
 				break;
 		}
 	}
+	if (pxp != NULL) {
+		(void) RunParallelXfers(pxp, &batchResult);
+		DisposeParallelXfer(pxp);
+	}
+	return (batchResult);
+}	/* PutFileInfoList */
+
+
+
+
+int
+FTPPutFiles4(
+	const FTPCIPtr cip,
+	const char *const pattern,
+	const char *const dstdir1,
+	const int recurse,
+	const int doGlob,
+	const int xtype,
+	const int appendflag,
+	const char *const tmppfx,
+	const char *const tmpsfx,
+	const int resumeflag,
+	const int deleteflag,
+	const FTPConfirmResumeUploadProc resumeProc,
+	const time_t batchStartTime,
+	const time_t origLmtime)
+{
+	FTPLineList globList;
+	FTPFileInfoList files;
+	int batchResult;
+	const char *dstdir;
+	char dstdir2[512];
+	int appendflag2 = appendflag;
+
+	if (cip == NULL)
+		return (kErrBadParameter);
+	if (strcmp(cip->magic, kLibraryMagic))
+		return (kErrBadMagic);
+
+	if (dstdir1 == NULL) {
+		dstdir = NULL;
+	} else {
+		dstdir = STRNCPY(dstdir2, dstdir1);
+		StrRemoveTrailingLocalPathDelim(dstdir2);
+	}
+
+	(void) FTPLocalGlob(cip, &globList, pattern, doGlob);
+	if (recurse == kRecursiveYes) {
+		appendflag2 = kAppendNo;
+		(void) FTPLocalRecursiveFileList(cip, &globList, &files);
+		if (files.first == NULL) {
+			cip->errNo = kErrNoValidFilesSpecified;
+			return (kErrNoValidFilesSpecified);
+		}
+		(void) ComputeRNames(&files, dstdir, 0, 1);
+	} else {
+		(void) LineListToFileInfoList(&globList, &files);
+		(void) ComputeLNames(&files, NULL, NULL, 1);
+		(void) ComputeRNames(&files, dstdir, 0, 0);
+	}
+	DisposeLineListContents(&globList);
+
+	batchResult = PutFileInfoList(cip, &files, xtype, appendflag2, tmppfx, tmpsfx, resumeflag, deleteflag, resumeProc, batchStartTime, origLmtime);
 	DisposeFileInfoListContents(&files);
 	if (batchResult < 0)
 		cip->errNo = batchResult;
@@ -138,6 +161,36 @@ FTPPutFiles4(
 
 
 
+/* Uploads each file in the list from its lname to its rname, like
+ * FTPPutFiles3() does with the files it finds, so a program can send
+ * a set of files it has already decided on without a glob or a
+ * directory walk.  The rnames may have directories in them, which
+ * need to exist already.  Entries of type 'd' are created with MKD, in
+ * order.  When parallelConnections is set the files are sent over that
+ * many connections at once.
+ */
+int
+FTPPutFileList(const FTPCIPtr cip, const FTPFileInfoListPtr filp, const int xtype, const char *const tmppfx, const char *const tmpsfx)
+{
+	int batchResult;
+
+	if ((cip == NULL) || (filp == NULL))
+		return (kErrBadParameter);
+	if (strcmp(cip->magic, kLibraryMagic))
+		return (kErrBadMagic);
+	if (filp->first == NULL) {
+		cip->errNo = kErrNoValidFilesSpecified;
+		return (kErrNoValidFilesSpecified);
+	}
+	batchResult = PutFileInfoList(cip, filp, xtype, kAppendNo, tmppfx, tmpsfx, kResumeNo, kDeleteNo, kNoFTPConfirmResumeUploadProc, 0, 0);
+	if (batchResult < 0)
+		cip->errNo = batchResult;
+	return (batchResult);
+}	/* FTPPutFileList */
+
+
+
+
 int
 FTPPutFiles(const FTPCIPtr cip, const char *const pattern, const char *const dstdir, const int recurse, const int doGlob)
 {
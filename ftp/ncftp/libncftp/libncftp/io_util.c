@@ -14,6 +14,14 @@
 #	define NO_SIGNALS 1
 #endif
 
+/* Transfers smaller than this finish before TCP gets up to speed,
+ * so their rate says little about the link.
+ */
+#define kAutoTuneMinBytes		((longest_int) 256 * 1024)
+
+/* Grow the transfer buffer after this many reads in a row filled it. */
+#define kGrowBufAfterFullReads		8
+
 double
 FTPDuration(struct timeval *const t0)
 {
@@ -140,11 +148,50 @@ FTPUpdateIOTimer(const FTPCIPtr cip)
 
 
 
+/* After a transfer, pick the socket buffer size for the next data
+ * connection from the rate just seen and the control connection's
+ * round-trip time.  The buffers need to hold about one
+ * bandwidth-delay product; if the last rate already filled half of
+ * what we had, the window was probably what limited it, so double it.
+ */
+static void
+FTPTuneDataSocketBufs(const FTPCIPtr cip)
+{
+	double bdp, target;
+	size_t cur, want;
+
+	if ((cip->autoTuneBufs == 0) || (cip->ctrlRTT <= 0.0) || (cip->sec <= 0.0))
+		return;
+	if (cip->bytesTransferred < kAutoTuneMinBytes)
+		return;
+
+	bdp = ((double) cip->bytesTransferred / cip->sec) * cip->ctrlRTT;
+	cur = (cip->dataSocketTunedBufSize != 0) ? cip->dataSocketTunedBufSize : kMinDataSocketBufSize;
+	target = bdp * 2.0;
+	if ((target >= (double) cur) && (target < (double) cur * 2.0))
+		target = (double) cur * 2.0;
+	if (target < (double) kMinDataSocketBufSize)
+		want = kMinDataSocketBufSize;
+	else if (target > (double) kMaxDataSocketBufSize)
+		want = kMaxDataSocketBufSize;
+	else
+		want = (size_t) target;
+
+	if (want != cip->dataSocketTunedBufSize) {
+		PrintF(cip, "Data socket buffers: %lu bytes (%.0f bytes/sec, RTT %.1f ms).\n", (unsigned long) want, (double) cip->bytesTransferred / cip->sec, cip->ctrlRTT * 1000.0);
+		cip->dataSocketTunedBufSize = want;
+	}
+}	/* FTPTuneDataSocketBufs */
+
+
+
+
 void
 FTPStopIOTimer(const FTPCIPtr cip)
 {
 	cip->nextProgressUpdate = 0;	/* force last update */
 	FTPUpdateIOTimer(cip);
+	FTPTuneDataSocketBufs(cip);
 	if (cip->progress != (FTPProgressMeterProc) 0)
 		(*cip->progress)(cip, kPrEndMsg);
 }	/* FTPStopIOTimer */
@@ -152,14 +199,51 @@ FTPStopIOTimer(const FTPCIPtr cip)
 
 
 
+/* Called after each read in a transfer loop with the number of bytes
+ * that read returned.  When the reads keep filling the whole buffer,
+ * there is more data waiting than we take each time, so double the
+ * buffer (if we allocated it), up to kMaxFTPBufSize.  That way a fast
+ * transfer needs fewer system calls, while a slow one, or the
+ * typical small file, never uses more memory than before.
+ *
+ * Since cip->buf may move, callers must reload their copies of
+ * cip->buf and cip->bufSize afterwards.
+ */
+void
+FTPGrowIOBuffer(const FTPCIPtr cip, const size_t nread, int *const nFullReads)
+{
+	char *newBuf;
+	size_t newSize;
+
+	if (nread < cip->bufSize) {
+		*nFullReads = 0;
+		return;
+	}
+	if (++(*nFullReads) < kGrowBufAfterFullReads)
+		return;
+	*nFullReads = 0;
+
+	if ((cip->autoTuneBufs == 0) || (cip->doAllocBuf == 0) || (cip->bufSize >= kMaxFTPBufSize))
+		return;
+	newSize = cip->bufSize * 2;
+	if (newSize > kMaxFTPBufSize)
+		newSize = kMaxFTPBufSize;
+	newBuf = (char *) realloc(cip->buf, newSize);
+	if (newBuf == NULL)
+		return;		/* Keep using the old one. */
+	cip->buf = newBuf;
+	cip->bufSize = newSize;
+}	/* FTPGrowIOBuffer */
+
+
+
+
 /* The purpose of this is to provide updates for the progress meters
  * during lags.  Return zero if the operation timed-out.
  */
 int
 WaitForRemoteInput(const FTPCIPtr cip)
 {
-	fd_set ss, ss2;
-	struct timeval tv;
 	int result;
 	int fd;
 	int wsecs;
@@ -179,6 +263,9 @@ WaitForRemoteInput(const FTPCIPtr cip)
 		return (0);	/* already timed-out */
 	}
 
+	if (FTPModeZPending(cip) != 0)
+		return (1);	/* Have inflated data without reading more. */
+
 	ocancelXfer = cip->cancelXfer;
 	wsecs = 0;
 	cip->stalled = 0;
@@ -188,19 +275,7 @@ WaitForRemoteInput(const FTPCIPtr cip)
 			/* leave cip->stalled -- could have been stalled and then canceled. */
 			return (1);
 		}
-		MY_FD_ZERO(&ss);
-#if defined(__DECC) || defined(__DECCXX)
-#pragma message save
-#pragma message disable trunclongint
-#endif
-		MY_FD_SET(fd, &ss);
-#if defined(__DECC) || defined(__DECCXX)
-#pragma message restore
-#endif
-		ss2 = ss;
-		tv.tv_sec = 1;
-		tv.tv_usec = 0;
-		result = select(fd + 1, SELECT_TYPE_ARG234 &ss, NULL, SELECT_TYPE_ARG234 &ss2, &tv);
+		result = SPollOne(fd, 0, 1000);
 		if (result >= 1) {
 			/* ready */
 			cip->stalled = 0;
@@ -237,8 +312,6 @@ WaitForRemoteInput(const FTPCIPtr cip)
 int
 WaitForRemoteOutput(const FTPCIPtr cip)
 {
-	fd_set ss, ss2;
-	struct timeval tv;
 	int result;
 	int fd;
 	int wsecs;
@@ -267,19 +340,7 @@ WaitForRemoteOutput(const FTPCIPtr cip)
 			/* leave cip->stalled -- could have been stalled and then canceled. */
 			return (1);
 		}
-		MY_FD_ZERO(&ss);
-#if defined(__DECC) || defined(__DECCXX)
-#pragma message save
-#pragma message disable trunclongint
-#endif
-		MY_FD_SET(fd, &ss);
-#if defined(__DECC) || defined(__DECCXX)
-#pragma message restore
-#endif
-		ss2 = ss;
-		tv.tv_sec = 1;
-		tv.tv_usec = 0;
-		result = select(fd + 1, NULL, SELECT_TYPE_ARG234 &ss, SELECT_TYPE_ARG234 &ss2, &tv);
+		result = SPollOne(fd, 1, 1000);
 		if (result >= 1) {
 			/* ready */
 			cip->stalled = 0;
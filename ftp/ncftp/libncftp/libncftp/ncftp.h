@@ -462,7 +462,22 @@ typedef struct FTPConnectionInfo {
     int iUser2;				/* Scratch integer field you can use. */
 	void *pUser;				/* Scratch pointer field you can use. */
 	longest_int llUser;			/* Scratch long long field you can use. */
-	int reserved[32];			/* Do not use or modify. */
+	int parallelConnections;		/* You may modify this. */
+	int hasPipelining;			/* You may modify this. */
+	int dirCacheSeconds;			/* You may modify this. */
+	void *dirCache;				/* Do not use or modify. */
+	int autoTuneBufs;			/* You may modify this. */
+	double ctrlRTT;				/* Do not modify. */
+	size_t dataSocketTunedBufSize;		/* Do not use or modify. */
+	int useSplice;				/* You may modify this. */
+	int usingSplice;			/* Do not modify. */
+	int modeZLevel;				/* You may modify this. */
+	const char *modeZSkipExtensions;	/* You may modify this. */
+	int hasMODE_Z;				/* Do not modify this field. */
+	int curTransferMode;			/* Do not modify this field. */
+	int usingModeZ;				/* Do not modify. */
+	void *modeZ;				/* Do not use or modify. */
+	int reserved[14];			/* Do not use or modify. */
 	char tailMagic[16];			/* Do not use or modify. */
 } FTPConnectionInfo;
 
@@ -492,6 +507,94 @@ typedef struct FTPFileInfoList {
     int reserved;
 } FTPFileInfoList, *FTPFileInfoListPtr;
 
+/* Used with FTPBatchCmds() */
+typedef struct FTPBatchCmd *FTPBatchCmdPtr;
+typedef struct FTPBatchCmd {
+	FTPBatchCmdPtr prev, next;
+	int cmd;		/* kBatchSIZE, kBatchMDTM, ... */
+	char *arg;
+	char *arg2;		/* New name, for kBatchRename */
+	int result;		/* kNoErr, or what FTPFileSize() etc. would return */
+	int code;		/* Numeric reply of the (last) command */
+	longest_int size;	/* kBatchSIZE */
+	time_t mdtm;		/* kBatchMDTM */
+} FTPBatchCmd;
+
+typedef struct FTPBatchCmdList {
+	FTPBatchCmdPtr first, last;
+	int nCmds;
+} FTPBatchCmdList, *FTPBatchCmdListPtr;
+
+/* Used with FTPGetDirIndex() */
+typedef struct FTPDirEntry {
+	char *name;
+	char *rlinkto;		/* NULL unless a symlink */
+	longest_int size;
+	time_t mdtm;
+	int mode;		/* -1 if unknown */
+	int type;		/* '-', 'd', 'l' */
+} FTPDirEntry, *FTPDirEntryPtr;
+
+typedef struct FTPDirIndex *FTPDirIndexPtr;
+typedef struct FTPDirIndex {
+	FTPDirIndexPtr next;
+	char *path;		/* Absolute, if the cwd was known */
+	unsigned int hash;
+	time_t when;		/* When the directory was listed */
+	size_t allocSize;
+	int cached;
+	int inUse;
+	int nEntries;
+	FTPDirEntryPtr entries;	/* Sorted by name, without "." and ".." */
+} FTPDirIndex;
+
+/* Used with the FTPAsync routines.  Each operation waits on one
+ * descriptor at a time: wait until "fd" is ready for "events" (or
+ * until "deadline" passes), then call FTPAsyncStep().  When "result"
+ * is no longer kAsyncPending the operation is done.
+ *
+ * The one exception is FTPAsyncOpenHost(), which looks up a host name
+ * with the usual blocking call before it returns.  Put a numeric
+ * address in cip->host (resolved on your own) to keep it from blocking.
+ */
+typedef struct FTPAsyncOp *FTPAsyncOpPtr;
+typedef void (*FTPAsyncDoneProc)(const FTPAsyncOpPtr aop);
+typedef struct FTPAsyncOp {
+	FTPCIPtr cip;
+	int fd;			/* Descriptor to wait on, or -1 */
+	int events;		/* kAsyncWantRead or kAsyncWantWrite */
+	unsigned long deadline;	/* SMonoTimeMs() it times out at, or 0 */
+	int result;		/* kAsyncPending until done */
+	int code;		/* Numeric reply of the last command */
+	FTPAsyncDoneProc doneProc;	/* You may set this, and userData. */
+	void *userData;
+
+	/* The rest are private. */
+	int what;
+	int state;
+	int phase;
+	int sockfd;
+	int localfd;
+	int xtype;
+	int xferErr;
+	int sawFinalReply;
+	int sawCR;
+	int anonLogin;
+	int sentPass;
+	int firstLine;
+	int nAddrs;
+	int curAddr;
+	struct in_addr addrs[8];	/* Of the host, to try in turn */
+	ResponsePtr rp;
+	char replyCode[16];
+	size_t cmdLen, cmdSent;
+	size_t lineLen;
+	size_t bufLen, bufSent;
+	char cmd[512];
+	char dataCmd[512];
+	char line[512];
+} FTPAsyncOp;
+
 /* Used with UnMlsT() */
 typedef struct MLstItem{
 	char fname[512];
@@ -540,6 +643,27 @@ typedef struct MLstItem{
 
 #define kDefaultPathBufSize		4096
 
+/* When autoTuneBufs is set, the transfer buffer may grow up to this
+ * size during a large transfer, and the data socket buffers are sized
+ * within these limits to fit the bandwidth-delay product.
+ */
+#define kMaxFTPBufSize			((size_t) 256 * 1024)
+#define kMinDataSocketBufSize		((size_t) 64 * 1024)
+#define kMaxDataSocketBufSize		((size_t) 16 * 1024 * 1024)
+
+/* Files at least twice this size are downloaded in segments over
+ * several connections at once, when parallelConnections is set.
+ */
+#define kParallelSegmentMinSize	((longest_int) 4 * 1024 * 1024)
+
+/* Most memory the directory index cache uses, when dirCacheSeconds is set. */
+#define kDirCacheMaxBytes		((size_t) 4 * 1024 * 1024)
+
+/* Files with these extensions are already compressed, so they are not
+ * sent with MODE Z even when modeZLevel is set.
+ */
+#define kDefaultModeZSkipExtensions	"|.7z|.apk|.bz2|.cab|.deb|.gif|.gz|.jar|.jpeg|.jpg|.lz|.lzma|.mkv|.mov|.mp3|.mp4|.ogg|.png|.rar|.rpm|.tbz|.tbz2|.tgz|.txz|.webp|.xz|.z|.zip|.zst|"
+
 #ifdef USE_SIO
 /* This version of the library can handle timeouts without
  * a user-installed signal handler.
@@ -586,6 +710,9 @@ typedef struct MLstItem{
 #define kTypeBinary			'I'
 #define kTypeEbcdic			'E'
 
+#define kTransferModeStream		'S'
+#define kTransferModeZ			'Z'
+
 #define kGlobChars 			"[*?"
 #define GLOBCHARSINSTR(a)		(strpbrk(a, kGlobChars) != NULL)
 
@@ -613,6 +740,21 @@ typedef struct MLstItem{
 #define kCommandAvailable		1
 #define kCommandNotAvailable		0
 
+/* Commands for AddBatchCmd(). */
+#define kBatchSIZE			1
+#define kBatchMDTM			2
+#define kBatchDELE			3
+#define kBatchMKD			4
+#define kBatchRename			5	/* RNFR, then RNTO */
+
+/* Most commands FTPBatchCmds() will send before reading replies. */
+#define kBatchWindow			32
+
+/* For the FTPAsync routines. */
+#define kAsyncPending			1
+#define kAsyncWantRead			1
+#define kAsyncWantWrite			2
+
 /* Values returned by FTPDecodeURL. */
 #define kNotURL				(-1)
 #define kMalformedURL			(-2)
@@ -899,12 +1041,28 @@ extern const char *gLibNcFTP_Uses_Me_To_Quiet_Variable_Unused_Warnings;
 
 /* Public routines */
 void FTPAbortDataTransfer(const FTPCIPtr cip);
+int FTPAsyncCancel(const FTPAsyncOpPtr aop);
+int FTPAsyncCloseHost(const FTPCIPtr cip, const FTPAsyncOpPtr aop);
+int FTPAsyncCmd(const FTPCIPtr cip, const FTPAsyncOpPtr aop, const char *const cmdspec, ...)
+#if (defined(__GNUC__)) && (__GNUC__ >= 2)
+__attribute__ ((format (printf, 3, 4)))
+#endif
+;
+int FTPAsyncGetOneFile(const FTPCIPtr cip, const FTPAsyncOpPtr aop, const char *const file, const int fd, const int xtype);
+int FTPAsyncList(const FTPCIPtr cip, const FTPAsyncOpPtr aop, const int outfd, const int longMode, const char *const lsflag);
+int FTPAsyncOpenHost(const FTPCIPtr cip, const FTPAsyncOpPtr aop);
+int FTPAsyncPutOneFile(const FTPCIPtr cip, const FTPAsyncOpPtr aop, const char *const dstfile, const int fd);
+int FTPAsyncRun(const FTPAsyncOpPtr aop);
+int FTPAsyncStep(const FTPAsyncOpPtr aop, const int revents);
+int FTPAsyncTimeLeft(const FTPAsyncOpPtr aop);
+int FTPBatchCmds(const FTPCIPtr cip, const FTPBatchCmdListPtr list, const int xtype);
 int FTPChdir(const FTPCIPtr cip, const char *const cdCwd);
 int FTPChdirAndGetCWD(const FTPCIPtr cip, const char *const cdCwd, char *const newCwd, const size_t newCwdSize);
 int FTPChdir3(FTPCIPtr cip, const char *const cdCwd, char *const newCwd, const size_t newCwdSize, int flags);
 int FTPChdirList(FTPCIPtr cip, FTPLineListPtr const cdlist, char *const newCwd, const size_t newCwdSize, int flags);
 int FTPChmod(const FTPCIPtr cip, const char *const pattern, const char *const mode, const int doGlob);
 int FTPCloseHost(const FTPCIPtr cip);
+int FTPCloneConnectionInfo(const FTPCIPtr cip, const FTPCIPtr newcip);
 int FTPCmd(const FTPCIPtr cip, const char *const cmdspec, ...)
 #if (defined(__GNUC__)) && (__GNUC__ >= 2)
 __attribute__ ((format (printf, 2, 3)))
@@ -913,14 +1071,17 @@ __attribute__ ((format (printf, 2, 3)))
 int FTPDecodeHostName(const FTPCIPtr cip, const char *const hstr0);
 int FTPDecodeURL(const FTPCIPtr cip, char *const url, FTPLineListPtr cdlist, char *const fn, const size_t fnsize, int *const xtype, int *const wantnlst);
 int FTPDelete(const FTPCIPtr cip, const char *const pattern, const int recurse, const int doGlob);
+FTPDirEntryPtr FTPDirIndexLookup(const FTPDirIndexPtr dip, const char *const name);
 int FTPFileExists(const FTPCIPtr cip, const char *const file);
 int FTPFileModificationTime(const FTPCIPtr cip, const char *const file, time_t *const mdtm);
 int FTPFileSize(const FTPCIPtr cip, const char *const file, longest_int *const size, const int type);
 longest_int FTPLocalASCIIFileSize(const char *const fn, char *buf, const size_t bufsize);
 int FTPFileSizeAndModificationTime(const FTPCIPtr cip, const char *const file, longest_int *const size, const int type, time_t *const mdtm);
 int FTPFileType(const FTPCIPtr cip, const char *const file, int *const ftype);
+void FTPFlushDirCache(const FTPCIPtr cip);
 int FTPFtw(const FTPCIPtr cip, const FtwInfoPtr ftwip, const char *const path, FtwProc proc);
 int FTPGetCWD(const FTPCIPtr cip, char *const newCwd, const size_t newCwdSize);
+int FTPGetDirIndex(const FTPCIPtr cip, const char *const dir, FTPDirIndexPtr *const dipp);
 int FTPGetFileToMemory(const FTPCIPtr cip, const char *const file, char *memBuf, const size_t maxNumberOfBytesToWriteToMemBuf, size_t *const numberOfBytesWrittenToMemBuf, const longest_int startPoint, const int deleteflag);
 int FTPGetFiles3(const FTPCIPtr cip, const char *pattern1, const char *const dstdir1, const int recurse, int doGlob, const int xtype, const int resumeflag, int appendflag, const int deleteflag, const int tarflag, const FTPConfirmResumeDownloadProc resumeProc, int UNUSED(reserved));
 int FTPGetOneFile3(const FTPCIPtr cip, const char *const file, const char *const dstfile, const int xtype, const int fdtouse, const int resumeflag, const int appendflag, const int deleteflag, const FTPConfirmResumeDownloadProc resumeProc, int UNUSED(reserved));
@@ -940,9 +1101,11 @@ int FTPOpenHost(const FTPCIPtr cip);
 int FTPOpenHostNoLogin(const FTPCIPtr cip);
 void FTPPerror(const FTPCIPtr cip, const int err, const int eerr, const char *const s1, const char *const s2);
 int FTPPutFileFromMemory(const FTPCIPtr cip, const char *volatile dstfile, const char *volatile src, const size_t srcLen, const int appendflag);
+int FTPPutFileList(const FTPCIPtr cip, const FTPFileInfoListPtr filp, const int xtype, const char *const tmppfx, const char *const tmpsfx);
 int FTPPutOneFile4(const FTPCIPtr cip, const char *const file, const char *const dstfile, const int xtype, const int fdtouse, const int appendflag, const char *const tmppfx, const char *const tmpsfx, const int resumeflag, const int deleteflag, const FTPConfirmResumeUploadProc resumeProc, const time_t batchStartTime, const time_t origLmtime); 
 int FTPPutFiles4(const FTPCIPtr cip, const char *const pattern, const char *const dstdir1, const int recurse, const int doGlob, const int xtype, const int appendflag, const char *const tmppfx, const char *const tmpsfx, const int resumeflag, const int deleteflag, const FTPConfirmResumeUploadProc resumeProc, const time_t batchStartTime, const time_t origLmtime);
 int FTPReadLoginConfigFile(FTPCIPtr cip, const char *const fn);
+void FTPReleaseDirIndex(const FTPCIPtr cip, const FTPDirIndexPtr dip);
 int FTPRemoteGlob(FTPCIPtr cip, FTPLineListPtr fileList, const char *pattern, int doGlob);
 int FTPRename(const FTPCIPtr cip, const char *const oldname, const char *const newname);
 int FTPRmdir(const FTPCIPtr cip, const char *const pattern, const int recurse, const int doGlob);
@@ -960,6 +1123,11 @@ void InitLineList(FTPLineListPtr);
 FTPLinePtr RemoveLine(FTPLineListPtr, FTPLinePtr);
 FTPLinePtr AddLine(FTPLineListPtr, const char *);
 
+/* FTPBatchCmdList routines */
+void InitBatchCmdList(const FTPBatchCmdListPtr list);
+FTPBatchCmdPtr AddBatchCmd(const FTPBatchCmdListPtr list, const int cmd, const char *const arg, const char *const arg2);
+void DisposeBatchCmdListContents(const FTPBatchCmdListPtr list);
+
 /* Ftw routines */
 void FtwInit(FtwInfo *const ftwip);
 void FtwDispose(FtwInfo *const ftwip);
@@ -1042,6 +1210,7 @@ int FTPSendPassive(const FTPCIPtr cip, struct sockaddr_in *saddr, int *weird);
 int FTPSetStartOffset(const FTPCIPtr cip, longest_int restartPt);
 void FTPCloseControlConnection(const FTPCIPtr cip);
 int FTPSendCommandStr(const FTPCIPtr cip, char *const command, const size_t siz);
+int FTPPrepareCommandStr(const FTPCIPtr cip, char *const command, const size_t siz);
 int FTPSendCommand(const FTPCIPtr cip, const char *const cmdspec, va_list ap)
 #if (defined(__GNUC__)) && (__GNUC__ >= 2)
 __attribute__ ((format (printf, 2, 0)))
@@ -1049,6 +1218,9 @@ __attribute__ ((format (printf, 2, 0)))
 ;
 char *FTPGetLocalCWD(char *buf, size_t size);
 int FTPQueryFeatures(const FTPCIPtr);
+int FTPPresetServerFeatures(const FTPCIPtr cip);
+void FTPExamineFeatReply(const FTPCIPtr cip, ResponsePtr rp, const int result);
+void FTPExaminePWDReply(const FTPCIPtr cip, ResponsePtr rp, char *const newCwd, const size_t newCwdSize);
 void FTPManualOverrideFeatures(const FTPCIPtr cip);
 int FTPMListOneFile(const FTPCIPtr cip, const char *const file, const MLstItemPtr mlip);
 void FTPInitializeAnonPassword(const FTPLIPtr);
@@ -1133,6 +1305,8 @@ ResponsePtr InitResponse(void);
 void ReInitResponse(const FTPCIPtr, ResponsePtr);
 int GetTelnetString(const FTPCIPtr, char *, size_t, FILE *, FILE *);
 int GetResponse(const FTPCIPtr, ResponsePtr);
+int AddResponseLine(const FTPCIPtr cip, ResponsePtr rp, char *const str, char *const code, const int firstLine);
+int EndResponse(const FTPCIPtr cip, ResponsePtr rp);
 int RCmd(const FTPCIPtr, ResponsePtr, const char *, ...)
 #if (defined(__GNUC__)) && (__GNUC__ >= 2)
 __attribute__ ((format (printf, 3, 4)))
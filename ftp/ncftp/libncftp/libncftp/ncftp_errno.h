@@ -122,4 +122,5 @@
 #define kErrKnownBug				(-205)
 #define kErrBindCtrlSocket			(-206)
 #define kErrPathTooLong				(-207)
-#define kErrLast				(207)
+#define kErrMODEFailed				(-208)
+#define kErrLast				(208)
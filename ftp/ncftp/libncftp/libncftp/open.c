@@ -32,6 +32,8 @@ FTPResetStatusVariables(const FTPCIPtr cip)
 	cip->loggedIn = 0;
 	cip->bytesTransferred = 0;
 	cip->curTransferType = 0;
+	cip->curTransferMode = 0;
+	cip->usingModeZ = 0;
 	cip->startPoint = 0;
 	cip->dataSocketConnected = 0;
 	cip->totalDials = 0;
@@ -40,6 +42,8 @@ FTPResetStatusVariables(const FTPCIPtr cip)
 	memset(&cip->disconnectTime, 0, sizeof(cip->disconnectTime));
 	memset(&cip->lastCmdStart, 0, sizeof(cip->lastCmdStart));
 	memset(&cip->lastCmdFinish, 0, sizeof(cip->lastCmdFinish));
+	cip->ctrlRTT = 0.0;
+	cip->dataSocketTunedBufSize = 0;
 	cip->numDownloads = 0;
 	cip->numUploads = 0;
 	cip->numListings = 0;
@@ -74,6 +78,9 @@ FTPDeallocateHost(const FTPCIPtr cip)
 		cip->startingWorkingDirectory = NULL;
 	}
 
+	FTPDisposeDirCache(cip);
+	FTPDisposeModeZ(cip);
+
 #if USE_SIO
 	DisposeSReadlineInfo(&cip->ctrlSrl);
 #endif
@@ -347,6 +354,7 @@ okay:
 
 	/* When a new site is opened, ASCII mode is assumed (by protocol). */
 	cip->curTransferType = 'A';
+	cip->curTransferMode = kTransferModeStream;
 	PrintF(cip, "Logged in to %s as %s.\n", cip->host, cip->user);
 
 	/* Don't leave cleartext password in memory, since we
@@ -434,19 +442,13 @@ FTPExamineMlstFeatures(const FTPCIPtr cip, const char *features)
 
 
 
+/* Sets what we already know about the server software from its
+ * connect message.  Returns 1 if we shouldn't try to find out any
+ * more by sending it commands.
+ */
 int
-FTPQueryFeatures(const FTPCIPtr cip)
+FTPPresetServerFeatures(const FTPCIPtr cip)
 {
-	ResponsePtr rp;
-	int result;
-	FTPLinePtr lp;
-	char *cp, *p;
-
-	if (cip == NULL)
-		return (kErrBadParameter);
-	if (strcmp(cip->magic, kLibraryMagic))
-		return (kErrBadMagic);
-
 	if (cip->serverType == kServerTypeMicrosoftFTP) {
 		cip->hasNLST_a = kCommandNotAvailable;
 		cip->hasNLST_d = kCommandNotAvailable;
@@ -471,7 +473,8 @@ FTPQueryFeatures(const FTPCIPtr cip)
 		cip->hasSITE_UTIME = kCommandNotAvailable;
 		cip->hasHELP_SITE = kCommandNotAvailable;
 		cip->hasRETR_tar = kCommandNotAvailable;
-		return (kNoErr);
+		cip->hasPipelining = kCommandNotAvailable;
+		return (1);
 	}
 
 	if (cip->serverType == kServerTypeProFTPD) {
@@ -492,6 +495,7 @@ FTPQueryFeatures(const FTPCIPtr cip)
 		cip->hasMFMT = kCommandNotAvailable;
 		cip->hasMFF = kCommandNotAvailable;
 		cip->hasRETR_tar = kCommandNotAvailable;
+		cip->hasPipelining = kCommandNotAvailable;
 	}
 
 	/* We cheat here and pre-populate some
@@ -513,24 +517,22 @@ FTPQueryFeatures(const FTPCIPtr cip)
 		cip->hasREST = kCommandAvailable;
 		cip->NLSTfileParamWorks = kCommandAvailable;
 	}
+	return (0);
+}	/* FTPPresetServerFeatures */
 
-	if (cip->hasFEAT == kCommandNotAvailable) {
-		return (kNoErr);
-	}
-	
-	rp = InitResponse();
-	if (rp == NULL) {
-		cip->errNo = kErrMallocFailed;
-		result = cip->errNo;
-		return (result);
-	}
 
-	rp->printMode = (kResponseNoPrint|kResponseNoSave);
-	result = RCmd(cip, rp, "FEAT");
-	if (result < kNoErr) {
-		DoneWithResponse(cip, rp);
-		return (result);
-	} else if (result != 2) {
+
+
+/* Notes which commands the server says it has in its reply to FEAT,
+ * where "result" is what RCmd() returned for it.
+ */
+void
+FTPExamineFeatReply(const FTPCIPtr cip, ResponsePtr rp, const int result)
+{
+	FTPLinePtr lp;
+	char *cp;
+
+	if (result != 2) {
 		/* Newer commands are only shown in FEAT,
 		 * so we don't have to do the "try it,
 		 * then save that it didn't work" thing.
@@ -539,6 +541,7 @@ FTPQueryFeatures(const FTPCIPtr cip)
 		cip->hasMLSD = kCommandNotAvailable;
 		cip->hasMFMT = kCommandNotAvailable;
 		cip->hasMFF = kCommandNotAvailable;
+		cip->hasMODE_Z = kCommandNotAvailable;
 	} else {
 		cip->hasFEAT = kCommandAvailable;
 
@@ -573,6 +576,8 @@ FTPQueryFeatures(const FTPCIPtr cip)
 				cip->hasMLST = kCommandAvailable;
 				cip->hasMLSD = kCommandAvailable;
 				FTPExamineMlstFeatures(cip, cp + 5);
+			} else if (ISTRNCMP(cp, "MODE Z", 6) == 0) {
+				cip->hasMODE_Z = kCommandAvailable;
 			} else if (ISTRNCMP(cp, "CLNT", 4) == 0) {
 				cip->hasCLNT = kCommandAvailable;
 			} else if (ISTRNCMP(cp, "Compliance Level: ", 18) == 0) {
@@ -585,6 +590,45 @@ FTPQueryFeatures(const FTPCIPtr cip)
 			}
 		}
 	}
+}	/* FTPExamineFeatReply */
+
+
+
+
+int
+FTPQueryFeatures(const FTPCIPtr cip)
+{
+	ResponsePtr rp;
+	int result;
+	FTPLinePtr lp;
+	char *cp, *p;
+
+	if (cip == NULL)
+		return (kErrBadParameter);
+	if (strcmp(cip->magic, kLibraryMagic))
+		return (kErrBadMagic);
+
+	if (FTPPresetServerFeatures(cip) != 0)
+		return (kNoErr);
+
+	if (cip->hasFEAT == kCommandNotAvailable) {
+		return (kNoErr);
+	}
+	
+	rp = InitResponse();
+	if (rp == NULL) {
+		cip->errNo = kErrMallocFailed;
+		result = cip->errNo;
+		return (result);
+	}
+
+	rp->printMode = (kResponseNoPrint|kResponseNoSave);
+	result = RCmd(cip, rp, "FEAT");
+	if (result < kNoErr) {
+		DoneWithResponse(cip, rp);
+		return (result);
+	}
+	FTPExamineFeatReply(cip, rp, result);
 
 	/* You can set cip->hasHELP_SITE to kCommandNotAvailable
 	 * if your host chokes (i.e. IBM Mainframes) when you
@@ -1058,6 +1102,12 @@ FTPInitConnectionInfo2(const FTPLIPtr lip, const FTPCIPtr cip, char *const buf,
 	cip->STATfileParamWorks = kCommandAvailabilityUnknown;
 	cip->NLSTfileParamWorks = kCommandAvailabilityUnknown;
 	cip->hasRETR_tar = kCommandAvailabilityUnknown;
+	cip->hasPipelining = kCommandAvailabilityUnknown;
+	cip->hasMODE_Z = kCommandAvailabilityUnknown;
+	cip->modeZLevel = 0;
+	cip->modeZSkipExtensions = kDefaultModeZSkipExtensions;
+	cip->autoTuneBufs = 1;
+	cip->useSplice = 1;
 	cip->firewallType = kFirewallNotInUse;
 	cip->startingWorkingDirectory = NULL;
 	cip->currentWorkingDirectory = NULL;
@@ -144,20 +144,18 @@ ReInitResponse(const FTPCIPtr cip, ResponsePtr rp)
 
 
 
-/* Returns 0 if a response was read, or (-1) if an error occurs.
- * This reads the entire response text into a FTPLineList, which is kept
- * in the 'Response' structure.
+/* Adds one line of a reply, without its end-of-line, to the Response.
+ * The "code" buffer holds the reply code from the first line, which
+ * is also how the last line of a multi-line reply begins.
+ *
+ * Returns 1 if more lines of the reply are to follow, 0 if it is
+ * complete, or kErrInvalidReplyFromServer.
  */
 int
-GetResponse(const FTPCIPtr cip, ResponsePtr rp)
+AddResponseLine(const FTPCIPtr cip, ResponsePtr rp, char *const str, char *const code, const int firstLine)
 {
-	longstring str;
-	int eofError;
-	str16 code;
 	char *cp;
 	int continuation;
-	volatile FTPCIPtr vcip;
-	int result;
 
 	/* RFC 959 states that a reply may span multiple lines.  A single
 	 * line message would have the 3-digit code <space> then the msg.
@@ -171,13 +169,99 @@ GetResponse(const FTPCIPtr cip, ResponsePtr rp)
 	 *	234 A line beginning with numbers
 	 *	123 The last line
 	 */
+	cp = str;
+	if (firstLine != 0) {
+		if ((!isdigit((int) *cp)) || (strlen(cp) < 3)) {
+			FTPLogError(cip, kDontPerror, "Invalid reply: \"%s\"\n", cp);
+			cip->errNo = kErrInvalidReplyFromServer;
+			return (cip->errNo);
+		}
+		rp->codeType = *cp - '0';
+		cp += 3;
+		continuation = (*cp == '-');
+		if (*cp != '\0')
+			*cp++ = '\0';
+		(void) Strncpy(code, str, 4);
+		rp->code = atoi(code);
+		(void) AddLine(&rp->msg, cp);
+		return (continuation);
+	}
+
+	continuation = 1;
+	if (strncmp(code, cp, SZ(3)) == 0) {
+		cp += 3;
+		if (*cp != '-')
+			continuation = 0;
+		if (*cp != '\0')
+			++cp;
+	}
+	(void) AddLine(&rp->msg, cp);
+	return (continuation);
+}	/* AddResponseLine */
+
+
+
+
+/* Call this once AddResponseLine() says the reply is complete.  This
+ * handles a 421 reply, and keeps the control connection round-trip
+ * time up to date.
+ */
+int
+EndResponse(const FTPCIPtr cip, ResponsePtr rp)
+{
+	struct timeval t0, t1, t2;
+	double rtt;
+
+	if (rp->code == 421) {
+		/*
+		 *   421 Service not available, closing control connection.
+		 *       This may be a reply to any command if the service knows it
+		 *       must shut down.
+		 */
+		if (rp->eofOkay == 0)
+			FTPLogError(cip, kDontPerror, "Remote host has closed the connection.\n");
+		FTPShutdownHost(cip);
+		cip->errNo = kErrRemoteHostClosedConnection;
+		return(cip->errNo);
+	}
+
+	(void) gettimeofday(&t1, NULL);
+	if ((cip->lastCmdStart.tv_sec > cip->lastCmdFinish.tv_sec) || ((cip->lastCmdStart.tv_sec == cip->lastCmdFinish.tv_sec) && (cip->lastCmdStart.tv_usec > cip->lastCmdFinish.tv_usec))) {
+		/* This is the first reply since the last command was sent,
+		 * so it measures a round trip.  Keep the quickest one,
+		 * which is the one that waited least on the server.
+		 */
+		t0 = cip->lastCmdStart;
+		t2 = t1;
+		rtt = FTPDuration2(&t0, &t2);
+		if ((rtt > 0.0) && ((cip->ctrlRTT <= 0.0) || (rtt < cip->ctrlRTT)))
+			cip->ctrlRTT = rtt;
+	}
+	cip->lastCmdFinish = t1;
+	return (kNoErr);
+}	/* EndResponse */
+
+
+
+
+/* Returns 0 if a response was read, or (-1) if an error occurs.
+ * This reads the entire response text into a FTPLineList, which is kept
+ * in the 'Response' structure.
+ */
+int
+GetResponse(const FTPCIPtr cip, ResponsePtr rp)
+{
+	longstring str;
+	str16 code;
+	int continuation;
+	int firstLine;
+	volatile FTPCIPtr vcip;
+	int result;
 
 	vcip = cip;
 
-	cp = str;
-	eofError = 0;
-	for (;;) {
-		if (cip->dataTimedOut > 0) {
+	for (firstLine = 1; ; ) {
+		if ((firstLine != 0) && (cip->dataTimedOut > 0)) {
 			/* Give up immediately unless the server had already
 			 * sent a message. Odds are since the data is timed
 			 * out, so is the control.
@@ -199,7 +283,6 @@ GetResponse(const FTPCIPtr cip, ResponsePtr rp)
 			return (cip->errNo);
 		} else if (result == 0) {
 			/* eof */
-			eofError = 1;
 			rp->hadEof = 1;
 			if (rp->eofOkay == 0)
 				FTPLogError(cip, kDontPerror, "Remote host has closed the connection.\n");
@@ -214,7 +297,7 @@ GetResponse(const FTPCIPtr cip, ResponsePtr rp)
 			return (cip->errNo);
 		}
 
-		if ((str[0] == '\n') || (str[0] == '\0')) {
+		if ((firstLine != 0) && ((str[0] == '\n') || (str[0] == '\0'))) {
 			/* Blank lines are violation of protocol, but try to be
 			 * lenient with broken servers.
 			 */
@@ -223,94 +306,31 @@ GetResponse(const FTPCIPtr cip, ResponsePtr rp)
 		}
 		if (str[result - 1] == '\n')
 			str[result - 1] = '\0';
-		else
+		else if (firstLine != 0)
 			PrintF(cip, "Warning: Remote line was too long: [%s]\n", str);
-		break;
-	}
-
-	if (!isdigit((int) *cp)) {
-		FTPLogError(cip, kDontPerror, "Invalid reply: \"%s\"\n", cp);
-		cip->errNo = kErrInvalidReplyFromServer;
-		return (cip->errNo);
-	}
 
-	rp->codeType = *cp - '0';
-	cp += 3;
-	continuation = (*cp == '-');
-	*cp++ = '\0';
-	(void) STRNCPY(code, str);
-	rp->code = atoi(code);
-	(void) AddLine(&rp->msg, cp);
-	if (eofError < 0) {
-		/* Read reply, but EOF was there also. */
-		rp->hadEof = 1;
-	}
-	
-	while (continuation) {
-		result = SReadline(&cip->ctrlSrl, str, sizeof(str) - 1);
-		if (result == kTimeoutErr) {
-			/* timeout */
-			FTPLogError(cip, kDontPerror, "Could not read reply from control connection -- timed out.\n");
-			FTPShutdownHost(vcip);
-			cip->errNo = kErrControlTimedOut;
-			return (cip->errNo);
-		} else if (result == 0) {
-			/* eof */
-			eofError = 1;
-			rp->hadEof = 1;
-			if (rp->eofOkay == 0)
-				FTPLogError(cip, kDontPerror, "Remote host has closed the connection.\n");
-			FTPShutdownHost(vcip);
-			cip->errNo = kErrRemoteHostClosedConnection;
-			return (cip->errNo);
-		} else if (result < 0) {
-			/* error */
-			FTPLogError(cip, kDoPerror, "Could not read reply from control connection");
-			FTPShutdownHost(vcip);
-			cip->errNo = kErrInvalidReplyFromServer;
-			return (cip->errNo);
-		}
-
-		if (str[result - 1] == '\n')
-			str[result - 1] = '\0';
-		cp = str;
-		if (strncmp(code, cp, SZ(3)) == 0) {
-			cp += 3;
-			if (*cp != '-')
-				continuation = 0;
-			++cp;
-		}
-		(void) AddLine(&rp->msg, cp);
-	}
-
-	if (rp->code == 421) {
-		/*
-		 *   421 Service not available, closing control connection.
-		 *       This may be a reply to any command if the service knows it
-		 *       must shut down.
-		 */
-		if (rp->eofOkay == 0)
-			FTPLogError(cip, kDontPerror, "Remote host has closed the connection.\n");
-		FTPShutdownHost(vcip);
-		cip->errNo = kErrRemoteHostClosedConnection;
-		return(cip->errNo);
+		continuation = AddResponseLine(cip, rp, str, code, firstLine);
+		if (continuation < 0)
+			return (continuation);
+		if (continuation == 0)
+			break;
+		firstLine = 0;
 	}
 
-	(void) gettimeofday(&cip->lastCmdFinish, NULL);
-	return (kNoErr);
+	return (EndResponse(cip, rp));
 }	/* GetResponse */
 
 
 
 
-/* This creates the complete command text to send, and writes it
- * on the stream.
+/* This creates the complete command text to send, with the TELNET
+ * end-of-line, and logs it.  FTPSendCommandStr() then writes it on
+ * the stream; the FTPAsync routines write it when they can.
  */
 
 int
-FTPSendCommandStr(const FTPCIPtr cip, char *const command, const size_t siz)
+FTPPrepareCommandStr(const FTPCIPtr cip, char *const command, const size_t siz)
 {
-	int result;
 	size_t clen;
 	char *cp;
 
@@ -344,6 +364,7 @@ FTPSendCommandStr(const FTPCIPtr cip, char *const command, const size_t siz)
 		PrintF(cip, "Cmd: %s\n", command);
 	else
 		PrintF(cip, "Cmd: %s\n", "PASS xxxxxxxx");
+	FTPDirCacheNoteCmd(cip, command);
 
 	if ((cp + 2) >= (command + siz - 1)) {
 		/* Not enough room to add \r\n */
@@ -357,6 +378,21 @@ FTPSendCommandStr(const FTPCIPtr cip, char *const command, const size_t siz)
 	cip->lastFTPCmdResultStr[0] = '\0';
 	cip->lastFTPCmdResultNum = -1;
 
+	(void) gettimeofday(&cip->lastCmdStart, NULL);
+	return (kNoErr);
+}	/* FTPPrepareCommandStr */
+
+
+
+
+int
+FTPSendCommandStr(const FTPCIPtr cip, char *const command, const size_t siz)
+{
+	int result;
+
+	result = FTPPrepareCommandStr(cip, command, siz);
+	if (result < 0)
+		return (result);
 	result = SWrite(cip->ctrlSocketW, command, strlen(command), (int) cip->ctrlTimeout, 0);
 
 	if (result < 0) {
@@ -541,10 +577,17 @@ FTPStartDataCmd3(const FTPCIPtr cip, const int netMode, const int type, const lo
 	if (strcmp(cip->magic, kLibraryMagic))
 		return (kErrBadMagic);
 
-	result = FTPSetTransferType(cip, type);
+	/* This also uses up a FTPRequestModeZ(), so do it first. */
+	result = FTPSetTransferMode(cip, netMode);
 	if (result < 0)
 		return (result);
 
+	result = FTPSetTransferType(cip, type);
+	if (result < 0) {
+		FTPEndModeZ(cip);
+		return (result);
+	}
+
 	/* Re-set the cancellation flag. */
 	cip->cancelXfer = 0;
 	cip->canceled = 0;
@@ -848,6 +891,7 @@ FTPEndDataCmd(const FTPCIPtr cip, int didXfer)
 	if (strcmp(cip->magic, kLibraryMagic))
 		return (kErrBadMagic);
 
+	FTPEndModeZ(cip);
 	if (cip->canceled == 1) {
 		/* Already read the post-transfer response. */
 		return (kNoErr);
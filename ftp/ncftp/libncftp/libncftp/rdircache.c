@@ -0,0 +1,571 @@
+/* rdircache.c
+ *
+ * Copyright (c) 2026 The LibNcFTP contributors.
+ * Distributed under the same terms as the rest of LibNcFTP.
+ *
+ */
+
+#include "syshdrs.h"
+#ifdef PRAGMA_HDRSTOP
+#	pragma hdrstop
+#endif
+
+#if (defined(WIN32) || defined(_WINDOWS)) && !defined(__CYGWIN__)
+#define _CRT_SECURE_NO_WARNINGS 1
+#endif
+
+/* The directory listings kept for a connection, most recently used
+ * first.  Each FTPDirIndex is a single block of memory holding the
+ * structure, its entries, and all of their strings.
+ */
+typedef struct FTPDirCache {
+	FTPDirIndexPtr first;
+	int nDirs;
+	size_t nBytes;
+} FTPDirCache, *FTPDirCachePtr;
+
+/* Commands after which a cached listing may be out of date. */
+static const char *const gDirCacheFlushCmds[] = {
+	"STOR", "STOU", "APPE", "DELE", "RMD", "XRMD", "MKD", "XMKD",
+	"RNTO", "SITE", "MFMT", "MFCT", "MFF",
+	NULL
+};
+
+
+
+
+static unsigned int
+DirIndexHash(const char *s)
+{
+	unsigned int h;
+
+	for (h = 0; *s != '\0'; s++)
+		h = (h * 31) + (unsigned int) ((unsigned char) *s);
+	return (h);
+}	/* DirIndexHash */
+
+
+
+
+/* Cached listings are looked up by absolute pathname, so that
+ * relative paths still find them after a change of directory.
+ */
+static int
+DirIndexKey(const FTPCIPtr cip, const char *const dir, char *const key, const size_t keysize)
+{
+	char cwd[512];
+	size_t len;
+
+	if (dir[0] == '/') {
+		CompressPath(key, dir, keysize, 0);
+	} else {
+		if (FTPGetCWD(cip, cwd, sizeof(cwd)) < 0)
+			return (-1);
+		if (cwd[0] != '/')
+			return (-1);	/* Not a UNIX-style path. */
+		PathCat(key, keysize, cwd, dir, 0);
+	}
+	len = strlen(key);
+	if ((len == 0) || (key[0] != '/'))
+		return (-1);
+	while ((len > 1) && (key[len - 1] == '/'))
+		key[--len] = '\0';
+	return (0);
+}	/* DirIndexKey */
+
+
+
+
+static int
+DirEntryCmp(const void *a, const void *b)
+{
+	return (strcmp(((const FTPDirEntry *) a)->name, ((const FTPDirEntry *) b)->name));
+}	/* DirEntryCmp */
+
+
+
+
+static FTPDirIndexPtr
+NewDirIndex(const char *const path, const unsigned int hash, const FTPFileInfoListPtr filp)
+{
+	FTPDirIndexPtr dip;
+	FTPDirEntryPtr dep;
+	FTPFileInfoPtr fip;
+	size_t hdrSize, strSize, len;
+	int n;
+	char *sp;
+
+	n = 0;
+	strSize = strlen(path) + 1;
+	for (fip = filp->first; fip != NULL; fip = fip->next) {
+		if ((strcmp(fip->relname, ".") == 0) || (strcmp(fip->relname, "..") == 0))
+			continue;
+		n++;
+		strSize += strlen(fip->relname) + 1;
+		if (fip->rlinkto != NULL)
+			strSize += strlen(fip->rlinkto) + 1;
+	}
+
+	/* Keep the entries aligned for their longest_int field. */
+	hdrSize = ((sizeof(FTPDirIndex) + sizeof(longest_int) - 1) / sizeof(longest_int)) * sizeof(longest_int);
+	len = hdrSize + ((size_t) n * sizeof(FTPDirEntry)) + strSize;
+	dip = (FTPDirIndexPtr) malloc(len);
+	if (dip == NULL)
+		return (NULL);
+	(void) memset(dip, 0, hdrSize);
+	dip->allocSize = len;
+	dip->hash = hash;
+	dip->when = time(NULL);
+	dip->nEntries = n;
+	dip->entries = (FTPDirEntryPtr) ((char *) dip + hdrSize);
+
+	sp = (char *) (dip->entries + n);
+	len = strlen(path) + 1;
+	memcpy(sp, path, len);
+	dip->path = sp;
+	sp += len;
+
+	dep = dip->entries;
+	for (fip = filp->first; fip != NULL; fip = fip->next) {
+		if ((strcmp(fip->relname, ".") == 0) || (strcmp(fip->relname, "..") == 0))
+			continue;
+		len = strlen(fip->relname) + 1;
+		memcpy(sp, fip->relname, len);
+		dep->name = sp;
+		sp += len;
+		dep->rlinkto = NULL;
+		if (fip->rlinkto != NULL) {
+			len = strlen(fip->rlinkto) + 1;
+			memcpy(sp, fip->rlinkto, len);
+			dep->rlinkto = sp;
+			sp += len;
+		}
+		dep->size = fip->size;
+		dep->mdtm = fip->mdtm;
+		dep->mode = fip->mode;
+		dep->type = fip->type;
+		dep++;
+	}
+	if (n > 1)
+		qsort(dip->entries, (size_t) n, sizeof(FTPDirEntry), DirEntryCmp);
+	return (dip);
+}	/* NewDirIndex */
+
+
+
+
+static void
+UncacheDirIndex(const FTPDirCachePtr dcp, const FTPDirIndexPtr dip, const FTPDirIndexPtr prevdip)
+{
+	if (prevdip == NULL)
+		dcp->first = dip->next;
+	else
+		prevdip->next = dip->next;
+	dip->next = NULL;
+	dcp->nDirs--;
+	dcp->nBytes -= dip->allocSize;
+	dip->cached = 0;
+	if (dip->inUse == 0)
+		free(dip);
+}	/* UncacheDirIndex */
+
+
+
+
+static FTPDirIndexPtr
+FindDirIndex(const FTPCIPtr cip, const char *const key, const unsigned int hash)
+{
+	FTPDirCachePtr dcp;
+	FTPDirIndexPtr dip, prevdip;
+
+	dcp = (FTPDirCachePtr) cip->dirCache;
+	if (dcp == NULL)
+		return (NULL);
+
+	for (prevdip = NULL, dip = dcp->first; dip != NULL; prevdip = dip, dip = dip->next) {
+		if ((dip->hash == hash) && (strcmp(dip->path, key) == 0))
+			break;
+	}
+	if (dip == NULL)
+		return (NULL);
+
+	if ((time(NULL) - dip->when) >= (time_t) cip->dirCacheSeconds) {
+		UncacheDirIndex(dcp, dip, prevdip);
+		return (NULL);
+	}
+	if (prevdip != NULL) {
+		/* Move to the front. */
+		prevdip->next = dip->next;
+		dip->next = dcp->first;
+		dcp->first = dip;
+	}
+	return (dip);
+}	/* FindDirIndex */
+
+
+
+
+static void
+CacheDirIndex(const FTPCIPtr cip, const FTPDirIndexPtr dip)
+{
+	FTPDirCachePtr dcp;
+	FTPDirIndexPtr lastdip, prevdip;
+
+	dcp = (FTPDirCachePtr) cip->dirCache;
+	if (dcp == NULL) {
+		dcp = (FTPDirCachePtr) calloc(SZ(1), sizeof(FTPDirCache));
+		if (dcp == NULL)
+			return;
+		cip->dirCache = dcp;
+	}
+
+	dip->next = dcp->first;
+	dcp->first = dip;
+	dip->cached = 1;
+	dcp->nDirs++;
+	dcp->nBytes += dip->allocSize;
+
+	/* Forget the least recently used ones if it's too big. */
+	while ((dcp->nBytes > kDirCacheMaxBytes) && (dcp->nDirs > 1)) {
+		for (prevdip = NULL, lastdip = dcp->first; lastdip->next != NULL; prevdip = lastdip, lastdip = lastdip->next)
+			;
+		UncacheDirIndex(dcp, lastdip, prevdip);
+	}
+}	/* CacheDirIndex */
+
+
+
+
+/* Gets the contents of a remote directory with a single MLSD, as an
+ * index of its entries sorted by name.  If dirCacheSeconds is set,
+ * the index is kept and returned again for the same directory until
+ * it is that old, or until a command which could change the remote
+ * files is sent.
+ *
+ * Call FTPReleaseDirIndex() when done with it.
+ */
+int
+FTPGetDirIndex(const FTPCIPtr cip, const char *const dir, FTPDirIndexPtr *const dipp)
+{
+	FTPDirIndexPtr dip;
+	FTPLineList ll;
+	FTPFileInfoList fil;
+	char key[512];
+	int haveKey, mls, result;
+	unsigned int hash;
+
+	if ((cip == NULL) || (dipp == NULL))
+		return (kErrBadParameter);
+	if (strcmp(cip->magic, kLibraryMagic))
+		return (kErrBadMagic);
+
+	*dipp = NULL;
+	if ((dir == NULL) || (dir[0] == '\0')) {
+		cip->errNo = kErrInvalidDirParam;
+		return (kErrInvalidDirParam);
+	}
+	if (cip->hasMLSD != kCommandAvailable) {
+		cip->errNo = kErrMLSDNotAvailable;
+		return (kErrMLSDNotAvailable);
+	}
+
+	haveKey = 0;
+	hash = 0;
+	if ((cip->dirCacheSeconds > 0) && (DirIndexKey(cip, dir, key, sizeof(key)) == 0)) {
+		haveKey = 1;
+		hash = DirIndexHash(key);
+		dip = FindDirIndex(cip, key, hash);
+		if (dip != NULL) {
+			PrintF(cip, "Using cached listing of %s.\n", key);
+			dip->inUse++;
+			*dipp = dip;
+			return (kNoErr);
+		}
+	}
+
+	mls = 1;
+	result = FTPListToMemory2(cip, dir, &ll, "-a", 0, &mls);
+	if (result < 0) {
+		DisposeLineListContents(&ll);
+		return (result);
+	}
+	if (UnMlsD(cip, &fil, &ll) < 0) {
+		DisposeLineListContents(&ll);
+		cip->errNo = kErrInvalidMLSTResponse;
+		return (kErrInvalidMLSTResponse);
+	}
+	DisposeLineListContents(&ll);
+
+	dip = NewDirIndex((haveKey != 0) ? key : dir, hash, &fil);
+	DisposeFileInfoListContents(&fil);
+	if (dip == NULL) {
+		FTPLogError(cip, kDontPerror, "Malloc failed.\n");
+		cip->errNo = kErrMallocFailed;
+		return (kErrMallocFailed);
+	}
+	dip->inUse = 1;
+	if (haveKey != 0)
+		CacheDirIndex(cip, dip);
+	*dipp = dip;
+	return (kNoErr);
+}	/* FTPGetDirIndex */
+
+
+
+
+void
+FTPReleaseDirIndex(const FTPCIPtr UNUSED(cip), const FTPDirIndexPtr dip)
+{
+	LIBNCFTP_USE_VAR(cip);
+	if (dip == NULL)
+		return;
+	if (dip->inUse > 0)
+		dip->inUse--;
+	if ((dip->inUse == 0) && (dip->cached == 0))
+		free(dip);
+}	/* FTPReleaseDirIndex */
+
+
+
+
+FTPDirEntryPtr
+FTPDirIndexLookup(const FTPDirIndexPtr dip, const char *const name)
+{
+	int lo, hi, mid, c;
+
+	if ((dip == NULL) || (name == NULL))
+		return (NULL);
+	lo = 0;
+	hi = dip->nEntries - 1;
+	while (lo <= hi) {
+		mid = (lo + hi) / 2;
+		c = strcmp(name, dip->entries[mid].name);
+		if (c == 0)
+			return (&dip->entries[mid]);
+		if (c < 0)
+			hi = mid - 1;
+		else
+			lo = mid + 1;
+	}
+	return (NULL);
+}	/* FTPDirIndexLookup */
+
+
+
+
+void
+FTPFlushDirCache(const FTPCIPtr cip)
+{
+	FTPDirCachePtr dcp;
+
+	if (cip == NULL)
+		return;
+	dcp = (FTPDirCachePtr) cip->dirCache;
+	if (dcp == NULL)
+		return;
+	while (dcp->first != NULL)
+		UncacheDirIndex(dcp, dcp->first, NULL);
+}	/* FTPFlushDirCache */
+
+
+
+
+void
+FTPDisposeDirCache(const FTPCIPtr cip)
+{
+	if (cip->dirCache != NULL) {
+		FTPFlushDirCache(cip);
+		free(cip->dirCache);
+		cip->dirCache = NULL;
+	}
+}	/* FTPDisposeDirCache */
+
+
+
+
+/* Called with each command sent, so the cache is thrown
+ * out whenever remote files may be changing.
+ */
+void
+FTPDirCacheNoteCmd(const FTPCIPtr cip, const char *const command)
+{
+	const char *const *cmdp;
+	size_t len;
+
+	if (cip->dirCache == NULL)
+		return;
+	for (cmdp = gDirCacheFlushCmds; *cmdp != NULL; cmdp++) {
+		len = strlen(*cmdp);
+		if ((ISTRNEQ(command, *cmdp, len)) && ((command[len] == ' ') || (command[len] == '\0'))) {
+			FTPFlushDirCache(cip);
+			return;
+		}
+	}
+}	/* FTPDirCacheNoteCmd */
+
+
+
+
+/* Answers FTPFileType() from the cached listing of the item's
+ * directory, if there is one.
+ */
+int
+FTPDirCacheFileType(const FTPCIPtr cip, const char *const file, int *const ftype)
+{
+	FTPDirIndexPtr dip;
+	FTPDirEntryPtr dep;
+	char key[512], name[512];
+	char *cp;
+
+	if ((cip->dirCacheSeconds <= 0) || (cip->dirCache == NULL))
+		return (kErrGeneric);
+	if (DirIndexKey(cip, file, key, sizeof(key)) < 0)
+		return (kErrGeneric);
+	cp = strrchr(key, '/');
+	if ((cp == NULL) || (cp[1] == '\0'))
+		return (kErrGeneric);
+	(void) Strncpy(name, cp + 1, sizeof(name));
+	if (cp == key)
+		cp++;	/* Parent is the root directory. */
+	*cp = '\0';
+
+	dip = FindDirIndex(cip, key, DirIndexHash(key));
+	if (dip == NULL)
+		return (kErrGeneric);
+	dep = FTPDirIndexLookup(dip, name);
+	if ((dep == NULL) || (dep->type == 'l'))
+		return (kErrGeneric);
+	*ftype = dep->type;
+	return (kNoErr);
+}	/* FTPDirCacheFileType */
+
+
+
+
+static int
+WildMatch(const char *pat, const char *str)
+{
+	int c, lo, hi, negate, matched;
+
+	for (;;) {
+		c = (int) ((unsigned char) *pat++);
+		switch (c) {
+			case '\0':
+				return (*str == '\0');
+			case '?':
+				if (*str++ == '\0')
+					return (0);
+				break;
+			case '*':
+				while (*pat == '*')
+					pat++;
+				if (*pat == '\0')
+					return (1);
+				for ( ; *str != '\0'; str++) {
+					if (WildMatch(pat, str) != 0)
+						return (1);
+				}
+				return (0);
+			case '[':
+				if (*str == '\0')
+					return (0);
+				negate = ((*pat == '!') || (*pat == '^')) ? 1 : 0;
+				if (negate != 0)
+					pat++;
+				matched = 0;
+				do {
+					lo = (int) ((unsigned char) *pat++);
+					if (lo == '\0')
+						return (0);
+					if ((pat[0] == '-') && (pat[1] != ']') && (pat[1] != '\0')) {
+						hi = (int) ((unsigned char) pat[1]);
+						pat += 2;
+						if ((lo <= (int) ((unsigned char) *str)) && ((int) ((unsigned char) *str) <= hi))
+							matched = 1;
+					} else if (lo == (int) ((unsigned char) *str)) {
+						matched = 1;
+					}
+				} while (*pat != ']');
+				pat++;
+				if (matched == negate)
+					return (0);
+				str++;
+				break;
+			case '\\':
+				if (*pat != '\0')
+					c = (int) ((unsigned char) *pat++);
+				if (c != (int) ((unsigned char) *str++))
+					return (0);
+				break;
+			default:
+				if (c != (int) ((unsigned char) *str++))
+					return (0);
+				break;
+		}
+	}
+}	/* WildMatch */
+
+
+
+
+/* Does what the server would for "NLST pattern", from the listing of
+ * the pattern's directory, when the wildcards are only in the last
+ * part of the pattern.  This is only tried when dirCacheSeconds is
+ * set, so later globs in the same directory don't need the server.
+ */
+int
+FTPDirCacheGlob(const FTPCIPtr cip, const FTPLineListPtr fileList, const char *const pattern)
+{
+	FTPDirIndexPtr dip;
+	FTPDirEntryPtr dep;
+	char dir[512], path[512];
+	const char *pat, *cp;
+	size_t dirLen;
+	int i, all;
+
+	if ((cip->dirCacheSeconds <= 0) || (cip->hasMLSD != kCommandAvailable))
+		return (kErrGeneric);
+
+	cp = strrchr(pattern, '/');
+	if (cp == NULL) {
+		pat = pattern;
+		(void) Strncpy(dir, ".", sizeof(dir));
+		dirLen = 0;
+	} else {
+		pat = cp + 1;
+		dirLen = (size_t) (cp - pattern) + 1;
+		if (dirLen >= sizeof(dir))
+			return (kErrGeneric);
+		memcpy(dir, pattern, dirLen);
+		dir[(dirLen == 1) ? 1 : (dirLen - 1)] = '\0';
+	}
+	if ((pat[0] == '\0') || (GLOBCHARSINSTR(dir)))
+		return (kErrGeneric);
+
+	if (FTPGetDirIndex(cip, dir, &dip) < 0)
+		return (kErrGeneric);
+
+	/* "*" is done with "NLST -a", which includes the dot files. */
+	all = ((strcmp(pat, "*") == 0) || (strcmp(pat, "**") == 0)) ? 1 : 0;
+	for (i = 0; i < dip->nEntries; i++) {
+		dep = &dip->entries[i];
+		if (all == 0) {
+			if ((dep->name[0] == '.') && (pat[0] != '.'))
+				continue;
+			if (WildMatch(pat, dep->name) == 0)
+				continue;
+		}
+		if ((dirLen + strlen(dep->name)) >= sizeof(path))
+			continue;
+		memcpy(path, pattern, dirLen);
+		(void) strcpy(path + dirLen, dep->name);
+		(void) AddLine(fileList, path);
+	}
+	FTPReleaseDirIndex(cip, dip);
+
+	if (fileList->first == NULL) {
+		cip->errNo = kErrGlobNoMatch;
+		return (kErrGlobNoMatch);
+	}
+	return (kNoErr);
+}	/* FTPDirCacheGlob */
@@ -35,7 +35,7 @@ typedef struct FtwSubDirList {
 static int
 FTPFtwTraverse(const FtwInfoPtr ftwip, size_t dirPathLen, int depth)
 {
-	char *cp;
+	const char *cp;
 	size_t fnLen;
 	mode_t m;
 	char *filename;
@@ -50,6 +50,9 @@ FTPFtwTraverse(const FtwInfoPtr ftwip, size_t dirPathLen, int depth)
 	FTPFileInfoList fil;
 	FTPLinePtr filePtr;
 	FTPFileInfoPtr fip;
+	FTPDirIndexPtr dip;
+	FTPDirEntryPtr dep;
+	int di;
 	int result;
 	int isRootDir;
 	longest_int sz;
@@ -57,29 +60,31 @@ FTPFtwTraverse(const FtwInfoPtr ftwip, size_t dirPathLen, int depth)
 	isRootDir = ((dirPathLen == 1) && ((path[0] == '/') || (path[0] == '\\'))) ? 1 : 0;
 	filePtr = NULL;
 	fip = NULL;
+	dip = NULL;
+	dep = NULL;
+	di = 0;
 	mls = 0;
 	lsl = 0;
+	InitLineList(&ll);
+	InitFileInfoList(&fil);
 
 	if (cip->hasMLSD == kCommandAvailable) {
+		/* One "MLSD" has everything we need for each item,
+		 * and the index may already be cached from a
+		 * previous pass.
+		 */
 		mls = 1;
-		if (((result = FTPListToMemory2(cip, dirPathLen ? path : ".", &ll, "-a", 0, &mls)) < 0) || (ll.first == NULL)) {
+		result = FTPGetDirIndex(cip, dirPathLen ? path : ".", &dip);
+		if (result == kErrInvalidMLSTResponse) {
+			return (result);
+		} else if (result < 0) {
 			/* Not an error unless the first directory could not be opened. */
-			DisposeLineListContents(&ll);
 			return (0);
-		}
-
-		/* "MLSD" succeeded */
-		unlsrc = UnMlsD(cip, &fil, &ll);
-		if (unlsrc < 0) {
-			DisposeLineListContents(&ll);
-			return (cip->errNo = kErrInvalidMLSTResponse);
-		} else if (unlsrc == 0) {
+		} else if (dip->nEntries == 0) {
 			/* empty */
-			DisposeLineListContents(&ll);
+			FTPReleaseDirIndex(cip, dip);
 			return (0);
 		}
-		fip = fil.first;
-		DisposeLineListContents(&ll);
 	} else {
 		if (((result = FTPListToMemory2(cip, dirPathLen ? path : ".", &ll, "-la", 0, &mls)) < 0) || (ll.first == NULL)) {
 			DisposeLineListContents(&ll);
@@ -123,7 +128,12 @@ FTPFtwTraverse(const FtwInfoPtr ftwip, size_t dirPathLen, int depth)
 	/* Path now contains dir/  */
 
 	for (;;) {
-		if ((mls != 0) || (lsl != 0)) {
+		if (mls != 0) {
+			if (di >= dip->nEntries)
+				break;
+			dep = &dip->entries[di];
+			cp = dep->name;
+		} else if (lsl != 0) {
 			if (fip == NULL)
 				break;
 			cp = fip->relname;
@@ -162,25 +172,25 @@ FTPFtwTraverse(const FtwInfoPtr ftwip, size_t dirPathLen, int depth)
 
 		memset(&ftwip->curStat, 0, sizeof(ftwip->curStat));
 		if (mls != 0) {
-			ftwip->curType = fip->type;
-			if (fip->type == 'd') {
+			ftwip->curType = dep->type;
+			if (dep->type == 'd') {
 				ftwip->curStat.st_mode = S_IFDIR;
 				ftwip->curStat.st_size = (longest_int) -1;
 #ifdef S_IFLNK
-			} else if (fip->type == 'l') {
+			} else if (dep->type == 'l') {
 				ftwip->curStat.st_mode = S_IFLNK;
-				ftwip->rlinkto = fip->rlinkto;
+				ftwip->rlinkto = dep->rlinkto;
 #endif
-			} else if (fip->type == '-') {
+			} else if (dep->type == '-') {
 				ftwip->curStat.st_mode = S_IFREG;
-				ftwip->curStat.st_size = fip->size;
+				ftwip->curStat.st_size = dep->size;
 			} else {
 				/* unknown type, skip */
 				goto nxt;
 			}
-			if (fip->mode != (-1))
-				ftwip->curStat.st_mode |= (fip->mode & 00777);
-			ftwip->curStat.st_mtime = fip->mdtm;
+			if (dep->mode != (-1))
+				ftwip->curStat.st_mode |= (dep->mode & 00777);
+			ftwip->curStat.st_mtime = dep->mdtm;
 		} else if (lsl != 0) {
 			ftwip->curType = fip->type;
 			if (fip->type == 'd') {
@@ -269,18 +279,19 @@ FTPFtwTraverse(const FtwInfoPtr ftwip, size_t dirPathLen, int depth)
 			}
 		}
 nxt:
-		if ((mls != 0) || (lsl != 0)) {
+		if (mls != 0) {
+			di++;
+		} else if (lsl != 0) {
 			fip = fip->next;
 		} else {
 			filePtr = filePtr->next;
 		}
 	}
 
-	if ((mls != 0) || (lsl != 0)) {
-		DisposeFileInfoListContents(&fil);
-	} else {
-		DisposeLineListContents(&ll);
-	}
+	FTPReleaseDirIndex(cip, dip);
+	dip = NULL;
+	DisposeFileInfoListContents(&fil);
+	DisposeLineListContents(&ll);
 
 	/* Now enter each subdirectory. */
 	for (sdp = head; sdp != NULL; sdp = nextsdp) {
@@ -312,11 +323,9 @@ nxt:
 	rc = 0;
 
 panic:
-	if (mls != 0) {
-		DisposeFileInfoListContents(&fil);
-	} else {
-		DisposeLineListContents(&ll);
-	}
+	FTPReleaseDirIndex(cip, dip);
+	DisposeFileInfoListContents(&fil);
+	DisposeLineListContents(&ll);
 
 	for (sdp = head; sdp != NULL; sdp = nextsdp) {
 		nextsdp = sdp->next;
@@ -214,6 +214,16 @@ FTPRemoteGlob(FTPCIPtr cip, FTPLineListPtr fileList, const char *pattern, int do
 	 * style wildcards.
 	 */
 	if ((doGlob == 1) && (GLOBCHARSINSTR(pattern))) {
+		/* Match against a cached directory listing, if we can. */
+		result = FTPDirCacheGlob(cip, fileList, pattern);
+		if (result == kErrGlobNoMatch)
+			return (result);
+		if (result == kNoErr) {
+			for (lp=fileList->first; lp != NULL; lp = lp->next)
+				PrintF(cip, "  Rglob [%s]\n", lp->line);
+			return (kNoErr);
+		}
+
 		/* Use NLST, which lists files one per line. */
 		lsflags = "";
 		
@@ -0,0 +1,220 @@
+/* asyncget: downloads files over several sessions at once, all driven
+ * by one poll() loop in this thread, using the FTPAsync routines.
+ *
+ * Each session opens the host, then gets its share of the files
+ * (session i gets files i, i+N, i+2N, ...), then closes.  The next
+ * operation of a session is started from the doneProc of the last.
+ */
+
+#ifdef HAVE_CONFIG_H
+#	include <config.h>
+#endif
+
+#include <ncftp.h>				/* Library header. */
+#include <Strn.h>				/* Library header. */
+#include <poll.h>
+
+#define kMaxSessions 16
+
+typedef struct Session {
+	FTPConnectionInfo fi;
+	FTPAsyncOp aop;
+	int fileNum;
+	int localfd;
+	int done;
+} Session;
+
+static Session gSessions[kMaxSessions];
+static int gNumSessions = 4;
+static char **gFiles;
+static int gNumFiles;
+static int gNumErrors = 0;
+
+static void NextOp(const FTPAsyncOpPtr aop);
+
+static void
+Usage(void)
+{
+	fprintf(stderr, "Usage:  asyncget [-n sessions] [-u user] [-p pass] [-P port] <host> <file> [<file>...]\n");
+	fprintf(stderr, "\nLibrary version: %s.\n", gLibNcFTPVersion + 5);
+#ifdef UNAME
+	fprintf(stderr, "System: %s.\n", UNAME);
+#endif
+	exit(2);
+}	/* Usage */
+
+
+
+
+static int
+StartNextFile(Session *const sp)
+{
+	const char *cp;
+
+	if (sp->fileNum >= gNumFiles)
+		return (FTPAsyncCloseHost(&sp->fi, &sp->aop));
+
+	cp = strrchr(gFiles[sp->fileNum], '/');
+	cp = (cp == NULL) ? gFiles[sp->fileNum] : cp + 1;
+	sp->localfd = open(cp, O_WRONLY|O_CREAT|O_TRUNC, 00644);
+	if (sp->localfd < 0) {
+		perror(cp);
+		return (FTPAsyncCloseHost(&sp->fi, &sp->aop));
+	}
+	return (FTPAsyncGetOneFile(&sp->fi, &sp->aop, gFiles[sp->fileNum], sp->localfd, kTypeBinary));
+}	/* StartNextFile */
+
+
+
+
+/* Called when an operation of a session completes; starts its next. */
+static void
+NextOp(const FTPAsyncOpPtr aop)
+{
+	Session *sp = (Session *) aop->userData;
+
+	if (sp->localfd >= 0) {
+		(void) close(sp->localfd);
+		sp->localfd = -1;
+		if (aop->result < 0) {
+			fprintf(stderr, "asyncget: %s: %s.\n", gFiles[sp->fileNum], FTPStrError(aop->result));
+			gNumErrors++;
+		} else {
+			printf("%s\n", gFiles[sp->fileNum]);
+		}
+		sp->fileNum += gNumSessions;
+	} else if (sp->fi.connected == 0) {
+		if (aop->result < 0) {
+			fprintf(stderr, "asyncget: cannot open %s: %s.\n", sp->fi.host, FTPStrError(aop->result));
+			gNumErrors++;
+		}
+		sp->done = 1;
+		return;
+	}
+
+	/* The doneProc may start another operation with the same aop. */
+	(void) StartNextFile(sp);
+}	/* NextOp */
+
+
+
+
+main_void_return_t
+main(int argc, char **argv)
+{
+	int result, c, i, n, pending, timeout, t;
+	FTPLibraryInfo li;
+	GetoptInfo opt;
+	struct pollfd pfds[kMaxSessions];
+	Session *sp;
+	const char *user = "anonymous";
+	const char *pass = "";
+	unsigned int port = 0;
+
+	GetoptReset(&opt);
+	while ((c = Getopt(&opt, argc, argv, "n:u:p:P:")) > 0) switch(c) {
+		case 'n':
+			gNumSessions = atoi(opt.arg);
+			if ((gNumSessions < 1) || (gNumSessions > kMaxSessions))
+				Usage();
+			break;
+		case 'u':
+			user = opt.arg;
+			break;
+		case 'p':
+			pass = opt.arg;
+			break;
+		case 'P':
+			port = (unsigned int) atoi(opt.arg);
+			break;
+		default:
+			Usage();
+	}
+	if (opt.ind > argc - 2)
+		Usage();
+	gFiles = argv + opt.ind + 1;
+	gNumFiles = argc - opt.ind - 1;
+	if (gNumSessions > gNumFiles)
+		gNumSessions = gNumFiles;
+
+	InitWinsock();
+
+	result = FTPInitLibrary(&li);
+	if (result < 0) {
+		fprintf(stderr, "asyncget: init library error %d (%s).\n", result, FTPStrError(result));
+		DisposeWinsock();
+		exit(3);
+	}
+
+	for (i=0; i<gNumSessions; i++) {
+		sp = &gSessions[i];
+		result = FTPInitConnectionInfo(&li, &sp->fi, kDefaultFTPBufSize);
+		if (result < 0) {
+			fprintf(stderr, "asyncget: init connection info error %d (%s).\n", result, FTPStrError(result));
+			DisposeWinsock();
+			exit(4);
+		}
+		sp->fi.errLog = stderr;
+		sp->fi.connTimeout = 20;
+		sp->fi.xferTimeout = 60;
+		STRNCPY(sp->fi.host, argv[opt.ind]);
+		STRNCPY(sp->fi.user, user);
+		STRNCPY(sp->fi.pass, pass);
+		if (port != 0)
+			sp->fi.port = port;
+		sp->fileNum = i;
+		sp->localfd = -1;
+		sp->done = 0;
+		sp->aop.doneProc = NextOp;
+		sp->aop.userData = sp;
+
+		/* A result other than kAsyncPending has already run NextOp. */
+		if (FTPAsyncOpenHost(&sp->fi, &sp->aop) == kErrBadParameter) {
+			fprintf(stderr, "asyncget: bad parameter.\n");
+			exit(5);
+		}
+	}
+
+	for (;;) {
+		n = 0;
+		timeout = -1;
+		for (i=0; i<gNumSessions; i++) {
+			sp = &gSessions[i];
+			pfds[i].fd = -1;
+			pfds[i].events = 0;
+			pfds[i].revents = 0;
+			if ((sp->done != 0) || (sp->aop.result != kAsyncPending))
+				continue;
+			pfds[i].fd = sp->aop.fd;
+			pfds[i].events = ((sp->aop.events & kAsyncWantWrite) != 0) ? POLLOUT : POLLIN;
+			t = FTPAsyncTimeLeft(&sp->aop);
+			if ((t >= 0) && ((timeout < 0) || (t < timeout)))
+				timeout = t;
+			n++;
+		}
+		if (n == 0)
+			break;
+
+		if (poll(pfds, (nfds_t) gNumSessions, timeout) < 0) {
+			if (errno == EINTR)
+				continue;
+			perror("poll");
+			exit(6);
+		}
+
+		for (i=0; i<gNumSessions; i++) {
+			sp = &gSessions[i];
+			if (pfds[i].fd < 0)
+				continue;
+			pending = 0;
+			if ((pfds[i].revents & (POLLIN|POLLHUP|POLLERR)) != 0)
+				pending |= kAsyncWantRead;
+			if ((pfds[i].revents & (POLLOUT|POLLHUP|POLLERR)) != 0)
+				pending |= kAsyncWantWrite;
+			(void) FTPAsyncStep(&sp->aop, pending);
+		}
+	}
+
+	DisposeWinsock();
+	exit((gNumErrors == 0) ? 0 : 1);
+}	/* main */
@@ -0,0 +1,54 @@
+#!/bin/sh
+#
+# Runs xferbench against an FTP server on this machine, with the
+# loopback interface slowed down by "tc netem" to look like a few
+# kinds of real links, with buffer autotuning off and then on.
+#
+# Needs root (for tc) and a Linux kernel with the netem qdisc.
+#
+# Usage:  netembench.sh [xferbench flags] FTP-URL
+# Example:
+#   sh netembench.sh -u test -p secret -P 2121 -n 3 ftp://127.0.0.1/big.bin
+#
+
+DEV="${NETEM_DEV-lo}"
+XFERBENCH="${XFERBENCH-./xferbench}"
+
+# Each profile is "name:netem parameters".  The delay is added in
+# each direction, so the round trip is twice as long.
+PROFILES="${NETEM_PROFILES-lan:delay 0.5ms
+metro:delay 5ms
+continental:delay 25ms
+intercontinental:delay 75ms
+lossy:delay 25ms loss 0.1%}"
+
+if [ "$#" -lt 1 ] ; then
+	echo "Usage: $0 [xferbench flags] FTP-URL" 1>&2
+	exit 2
+fi
+if [ ! -x "$XFERBENCH" ] ; then
+	echo "$0: build xferbench first (or set XFERBENCH)." 1>&2
+	exit 2
+fi
+if ! tc qdisc show dev "$DEV" > /dev/null 2>&1 ; then
+	echo "$0: cannot run tc on $DEV (need root?)." 1>&2
+	exit 2
+fi
+
+cleanup() {
+	tc qdisc del dev "$DEV" root > /dev/null 2>&1
+}
+trap cleanup 0
+trap 'exit 1' 1 2 15
+
+echo "$PROFILES" | while IFS=: read name params ; do
+	[ -z "$name" ] && continue
+	cleanup
+	if ! tc qdisc add dev "$DEV" root netem $params ; then
+		echo "$0: could not add netem $params on $DEV." 1>&2
+		exit 1
+	fi
+	echo "=== $name ($params)"
+	"$XFERBENCH" -A "$@" | sed -n 's/^Average/  off: average/p'
+	"$XFERBENCH" "$@" | sed -n 's/^Average/  on:  average/p'
+done
@@ -0,0 +1,221 @@
+/* xferbench: time repeated downloads (or uploads) of one file, to
+ * compare transfer rates and CPU use with buffer autotuning and
+ * splice() on and off.
+ */
+
+#ifdef HAVE_CONFIG_H
+#	include <config.h>
+#endif
+
+#include <ncftp.h>				/* Library header. */
+#include <Strn.h>				/* Library header. */
+
+#if (defined(WIN32) || defined(_WINDOWS)) && !defined(__CYGWIN__)
+#	define kNullDevice "NUL"
+#else
+#	define kNullDevice "/dev/null"
+#	include <sys/resource.h>
+#	define HAVE_GETRUSAGE 1
+#endif
+
+static void
+Usage(void)
+{
+	FILE *fp;
+
+	fp = stderr;
+	(void) fprintf(fp, "Usage:\n");
+	(void) fprintf(fp, "  xferbench [flags] FTP-URL\n");
+	(void) fprintf(fp, "\nFlags:\n\
+  -u XX  Use username XX instead of anonymous.\n\
+  -p XX  Use password XX with the username.\n\
+  -P XX  Use port number XX instead of the default FTP service port (21).\n\
+  -d XX  Use the file XX for debug logging.\n\
+  -F     Use passive (PASV) data connections.\n\
+  -n XX  Transfer the file XX times (default 3).\n\
+  -b XX  Start with a transfer buffer of XX bytes.\n\
+  -A     Turn off buffer autotuning.\n\
+  -S     Turn off splice() for downloads.\n\
+  -o XX  Download to the local file XX instead of " kNullDevice ".\n\
+  -U XX  Upload the local file XX to the URL, instead of downloading.\n");
+	(void) fprintf(fp, "\nExamples:\n\
+  xferbench -u user -p pass -n 5 ftp://localhost/pub/big.bin\n\
+  xferbench -A -u user -p pass -n 5 ftp://localhost/pub/big.bin\n\
+  xferbench -S -o /tmp/big.bin -u user -p pass ftp://localhost/pub/big.bin\n");
+	(void) fprintf(fp, "\nLibrary version: %s.\n", gLibNcFTPVersion + 5);
+	DisposeWinsock();
+	exit(2);
+}	/* Usage */
+
+
+
+main_void_return_t
+main(int argc, char **argv)
+{
+	int result;
+	int c, i;
+	int es = 0;
+	int rc;
+	int nRuns = 3;
+	int autoTune = 1;
+	int useSplice = 1;
+	const char *outfile = kNullDevice;
+	size_t bufSize = kDefaultFTPBufSize;
+	const char *upfile = NULL;
+	FTPLibraryInfo li;
+	FTPConnectionInfo ci;
+	char url[256];
+	char urlfile[128];
+	int urlxtype;
+	FTPLineList cdlist;
+	FTPLinePtr lp;
+	GetoptInfo opt;
+	FILE *debugLog = NULL;
+	int dataPortMode = kDefaultDataPortMode;
+	unsigned int port = 0;
+	char user[64], pass[64];
+	double totalBytes, totalSec, totalCPU, mbps, cpu;
+#ifdef HAVE_GETRUSAGE
+	struct rusage ru0, ru1;
+#endif
+
+	InitWinsock();
+	result = FTPInitLibrary(&li);
+	if (result < 0) {
+		fprintf(stderr, "xferbench: init library error %d (%s).\n", result, FTPStrError(result));
+		DisposeWinsock();
+		exit(3);
+	}
+
+	user[0] = pass[0] = '\0';
+	GetoptReset(&opt);
+	while ((c = Getopt(&opt, argc, argv, "P:u:p:d:Fn:b:ASo:U:")) > 0) switch(c) {
+		case 'P':
+			port = (unsigned int) atoi(opt.arg);
+			break;
+		case 'u':
+			(void) STRNCPY(user, opt.arg);
+			break;
+		case 'p':
+			(void) STRNCPY(pass, opt.arg);	/* Don't recommend doing this! */
+			break;
+		case 'd':
+			if ((opt.arg[0] == '-') || (strcmp(opt.arg, "stderr") == 0))
+				debugLog = stderr;
+			else
+				debugLog = fopen(opt.arg, "a");
+			break;
+		case 'F':
+			dataPortMode = (dataPortMode == kPassiveMode) ? kSendPortMode : kPassiveMode;
+			break;
+		case 'n':
+			nRuns = atoi(opt.arg);
+			if (nRuns < 1)
+				Usage();
+			break;
+		case 'b':
+			bufSize = (size_t) atol(opt.arg);
+			if (bufSize < 512)
+				Usage();
+			break;
+		case 'A':
+			autoTune = 0;
+			break;
+		case 'S':
+			useSplice = 0;
+			break;
+		case 'o':
+			outfile = opt.arg;
+			break;
+		case 'U':
+			upfile = opt.arg;
+			break;
+		default:
+			Usage();
+	}
+	if (opt.ind > argc - 1)
+		Usage();
+
+	result = FTPInitConnectionInfo(&li, &ci, bufSize);
+	if (result < 0) {
+		fprintf(stderr, "xferbench: init connection info error %d (%s).\n", result, FTPStrError(result));
+		DisposeWinsock();
+		exit(3);
+	}
+	ci.debugLog = debugLog;
+	ci.dataPortMode = dataPortMode;
+	ci.autoTuneBufs = autoTune;
+	ci.useSplice = useSplice;
+	if (user[0] != '\0')
+		(void) STRNCPY(ci.user, user);
+	if (pass[0] != '\0')
+		(void) STRNCPY(ci.pass, pass);
+
+	(void) STRNCPY(url, argv[opt.ind]);
+	rc = FTPDecodeURL(&ci, url, &cdlist, urlfile, sizeof(urlfile), (int *) &urlxtype, NULL);
+	if ((rc == kMalformedURL) || (rc == kNotURL) || (urlfile[0] == '\0')) {
+		(void) fprintf(stderr, "xferbench: need a file URL, not %s\n", url);
+		DisposeWinsock();
+		exit(4);
+	}
+	if (port != 0)
+		ci.port = port;
+
+	if ((result = FTPOpenHost(&ci)) < 0) {
+		FTPPerror(&ci, result, 0, "Could not open", ci.host);
+		DisposeWinsock();
+		exit(5);
+	}
+
+	for (lp = cdlist.first; lp != NULL; lp = lp->next) {
+		if (FTPChdir(&ci, lp->line) != 0) {
+			(void) fprintf(stderr, "xferbench: cannot chdir to %s: %s.\n", lp->line, FTPStrError(ci.errNo));
+			es = 6;
+			goto close;
+		}
+	}
+
+	(void) printf("%s %s, autotuning %s, splice %s, buffer %lu bytes.\n", (upfile != NULL) ? "Uploading" : "Downloading", urlfile, (autoTune != 0) ? "on" : "off", (useSplice != 0) ? "on" : "off", (unsigned long) bufSize);
+	totalBytes = totalSec = totalCPU = 0.0;
+	for (i = 1; i <= nRuns; i++) {
+#ifdef HAVE_GETRUSAGE
+		(void) getrusage(RUSAGE_SELF, &ru0);
+#endif
+		if (upfile != NULL)
+			result = FTPPutOneFile3(&ci, upfile, urlfile, kTypeBinary, (-1), kAppendNo, NULL, NULL, kResumeNo, kDeleteNo, kNoFTPConfirmResumeUploadProc, 0);
+		else
+			result = FTPGetOneFile3(&ci, urlfile, outfile, kTypeBinary, (-1), kResumeNo, kAppendNo, kDeleteNo, kNoFTPConfirmResumeDownloadProc, 0);
+		cpu = 0.0;
+#ifdef HAVE_GETRUSAGE
+		(void) getrusage(RUSAGE_SELF, &ru1);
+		cpu = FTPDuration2(&ru0.ru_utime, &ru1.ru_utime) + FTPDuration2(&ru0.ru_stime, &ru1.ru_stime);
+#endif
+		if (result < 0) {
+			FTPPerror(&ci, result, kErrCouldNotStartDataTransfer, "Could not transfer", urlfile);
+			es = 1;
+			break;
+		}
+		mbps = (ci.sec > 0.0) ? ((double) ci.bytesTransferred / ci.sec / 1000000.0) : 0.0;
+		(void) printf("  run %d: " PRINTF_LONG_LONG " bytes in %.3f sec, %.1f MB/s, CPU %.0f%%%s; buffer %lu, data socket buffers %lu, RTT %.2f ms\n",
+			i,
+			ci.bytesTransferred,
+			ci.sec,
+			mbps,
+			(ci.sec > 0.0) ? (100.0 * cpu / ci.sec) : 0.0,
+			(ci.usingSplice != 0) ? " (splice)" : "",
+			(unsigned long) ci.bufSize,
+			(unsigned long) ci.dataSocketTunedBufSize,
+			ci.ctrlRTT * 1000.0
+		);
+		totalBytes += (double) ci.bytesTransferred;
+		totalSec += ci.sec;
+		totalCPU += cpu;
+	}
+	if ((es == 0) && (totalSec > 0.0))
+		(void) printf("Average: %.1f MB/s, CPU %.0f%%\n", totalBytes / totalSec / 1000000.0, 100.0 * totalCPU / totalSec);
+
+close:
+	FTPCloseHost(&ci);
+	DisposeWinsock();
+	exit(es);
+}	/* main */
@@ -60,6 +60,8 @@ Usage(void)
   -F     Use passive (PASV) data connections.\n\
   -DD    Delete remote file after successfully downloading it.\n\
   -r XX  Redial XX times until connected.\n\
+  -j XX  Transfer up to XX files (or parts of a big file) at once.\n\
+  -k XX  Compress with MODE Z at level XX (1-9), if the server has it.\n\
   -R     Recursive mode; copy whole directory trees.\n");
 	(void) fprintf(fp, "\nExamples:\n\
   ncftpget ftp.wustl.edu . /pub/README /pub/README.too\n\
@@ -179,7 +181,7 @@ main(int argc, char **argv)
 	dstdir = NULL;
 
 	GetoptReset(&opt);
-	while ((c = Getopt(&opt, argc, argv, "P:u:p:e:d:t:aRr:vVf:ADzZFT")) > 0) switch(c) {
+	while ((c = Getopt(&opt, argc, argv, "P:u:p:e:d:t:aRr:vVf:ADzZFTj:k:")) > 0) switch(c) {
 		case 'P':
 			fi.port = atoi(opt.arg);	
 			break;
@@ -225,6 +227,13 @@ main(int argc, char **argv)
 		case 'R':
 			rflag = 1;
 			break;
+		case 'j':
+			fi.parallelConnections = atoi(opt.arg);
+			fi.leavePass = 1;	/* The extra connections log in too. */
+			break;
+		case 'k':
+			fi.modeZLevel = atoi(opt.arg);
+			break;
 		case 'T':
 			tarflag = 0;
 			break;
@@ -72,6 +72,8 @@ Usage(void)
   -F     Use passive (PASV) data connections.\n\
   -y     Try using \"SITE UTIME\" to preserve timestamps on remote host.\n\
   -r XX  Redial XX times until connected.\n\
+  -j XX  Send up to XX files of a tree (-R) at once.\n\
+  -k XX  Compress with MODE Z at level XX (1-9), if the server has it.\n\
   -R     Recursive mode; copy whole directory trees.\n");
 	(void) fprintf(fp, "\nExamples:\n\
   ncftpput -u gleason -p my.password Elwood.probe.net /home/gleason stuff.txt\n\
@@ -190,7 +192,7 @@ main(int argc, char **argv)
 	files = NULL;
 
 	GetoptReset(&opt);
-	while ((c = Getopt(&opt, argc, argv, "P:u:p:e:d:U:t:mar:RvVf:AT:S:FcyZzD")) > 0) switch(c) {
+	while ((c = Getopt(&opt, argc, argv, "P:u:p:e:d:U:t:mar:RvVf:AT:S:FcyZzDj:k:")) > 0) switch(c) {
 		case 'P':
 			fi.port = atoi(opt.arg);	
 			break;
@@ -242,6 +244,13 @@ main(int argc, char **argv)
 		case 'R':
 			rflag = 1;
 			break;
+		case 'j':
+			fi.parallelConnections = atoi(opt.arg);
+			fi.leavePass = 1;	/* The extra connections log in too. */
+			break;
+		case 'k':
+			fi.modeZLevel = atoi(opt.arg);
+			break;
 		case 'v':
 			progmeters = 1;
 			break;
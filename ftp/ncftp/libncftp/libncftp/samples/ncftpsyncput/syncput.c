@@ -1,13 +1,18 @@
 /* NcFTPSyncPut.c
  *
- * Utility to synchronize a remote site.  This version only does incremental
- * updates by comparing recursive local directory listing to a previous listing.
- * This utility does not consider the actual contents of the remote directory,
- * so if you change files directly on the server this utility will not know
- * that those files have been changed.
+ * Utility to synchronize a remote site.  This version does incremental
+ * updates by comparing recursive local directory listing to a previous listing,
+ * which is kept in the catalog file.  By default this utility does not consider
+ * the actual contents of the remote directory, so if you change files directly
+ * on the server this utility will not know that those files have been changed;
+ * use "remote-check" (-R) to have it list the remote directory too.
+ *
+ * Files which were only moved or renamed locally can be renamed on the server
+ * instead of being sent again ("detect-renames", -M), and the files are sent
+ * over several connections at once with "parallel-connections" (-j).
  */
 
-#define VERSION "1.0.0"
+#define VERSION "1.1.0"
 
 #if (defined(WIN32) || defined(_WINDOWS)) && !defined(__CYGWIN__)
 #	define _CRT_SECURE_NO_WARNINGS 1
@@ -32,6 +37,69 @@
 	struct utimbuf { time_t actime, modtime; };
 #endif
 
+#ifdef HAVE_SYS_MMAN_H
+#	include <sys/mman.h>
+#endif
+
+#ifndef O_BINARY
+	/* Needed for platforms using different EOLN sequence (i.e. DOS) */
+#	ifdef _O_BINARY
+#		define O_BINARY _O_BINARY
+#	else
+#		define O_BINARY 0
+#	endif
+#endif
+
+/* The catalog file is a manifest of the files as of the last update:
+ * a header, then one fixed-size entry per file in RelnameCmp() order,
+ * then the NUL-terminated names.  It is mapped into memory instead of
+ * being parsed, so comparing a big tree against it is cheap.  Numbers
+ * are in the byte order of the machine that wrote it, and a manifest
+ * from another kind of machine is treated like a missing one.
+ *
+ * The text catalog files of older versions are still read.
+ */
+#define kManifestMagic		"NcSyncM1"
+#define kManifestByteOrder	0x01020304U
+
+typedef struct ManifestHeader {
+	char magic[8];
+	unsigned int byteOrder;
+	unsigned int nEntries;
+	unsigned int namesSize;
+	unsigned int reserved;
+} ManifestHeader;
+
+typedef struct ManifestEntry {
+	longest_int size;
+	longest_int mdtm;
+	longest_uint hash;		/* Of the contents, or 0 if not known */
+	unsigned int nameOffset;	/* Into the names */
+	unsigned int nameLen;
+} ManifestEntry;
+
+typedef struct Manifest {
+	char *base;			/* The whole file */
+	size_t baseSize;
+	int mapped;
+	int nEntries;
+	ManifestEntry *entries;
+	char *names;
+} Manifest;
+
+#define ManifestName(mp,i) ((mp)->names + (mp)->entries[i].nameOffset)
+
+/* What to do with each file of the current catalog, */
+#define kSyncUnchanged		0
+#define kSyncChanged		1	/* Send it again */
+#define kSyncNew		2	/* Send it; not in the last catalog */
+#define kSyncRenamed		3	/* Rename a deleted file to it */
+
+/* and with each file of the previous one. */
+#define kSyncKept		0
+#define kSyncDeleted		1
+#define kSyncRenameSource	2
+
 FTPLibraryInfo gLib;
 FTPConnectionInfo gConn;
 
@@ -44,10 +112,18 @@ char gDebugCurCatalogFile[256];
 char gConfigFileNameOnly[80];	/* filename only */
 char gUmaskStr[16];
 int gDeleteRemoteFiles = 1;
+int gCheckRemote = 0;
+int gDetectRenames = 0;
+int gParallelConnections = 0;
 #if (defined(WIN32) || defined(_WINDOWS)) && !defined(__CYGWIN__)
 int gRPathsToLowercase = 0;
 #endif
-FTPFileInfoList gFiles, gFilesToDelete, gPrevCatalog, gCurCatalog;
+FTPFileInfoList gFiles, gFilesToDelete, gCurCatalog, gRemoteFiles;
+FTPBatchCmdList gRenames;
+Manifest gPrevCatalog;
+char *gCurState, *gPrevState;
+longest_uint *gCurHash;
+int *gCurRenameFrom;
 char gTextExts[256] = ".txt;.html;.htm;.xml;.ini;.sh;.pl;.hqx;.cfg;.c;.h;.cpp;.hpp;.ps;.bat;.m3u;.pls";
 
 extern int gFirewallType;
@@ -116,20 +192,15 @@ PrintFileList(FTPFileInfoListPtr filp)
 
 
 
+/* Orders paths by depth, and then by name.  This is also the order
+ * of the catalog file, so it must not depend on the locale.
+ */
 static int
-BreadthFirstCaseCmp(const void *a, const void *b)
+RelnameCmp(const char *const cpa, const char *const cpb)
 {
-	char *cp, *cpa, *cpb;
+	const char *cp;
 	int depth, deptha, depthb;
 	int c;
-	const FTPFileInfo *const *fipa;
-	const FTPFileInfo *const *fipb;
-
-	fipa = (const FTPFileInfo *const *) a;
-	fipb = (const FTPFileInfo *const *) b;
-
-	cpa = (**fipa).relname;
-	cpb = (**fipb).relname;
 
 	for (cp = cpa, depth = 0;;) {
 		c = *cp++;
@@ -159,16 +230,79 @@ BreadthFirstCaseCmp(const void *a, const void *b)
 #if (defined(WIN32) || defined(_WINDOWS)) && !defined(__CYGWIN__)
 	/* Paths are generally not case-sensitive. */
 	return (_stricmp(cpa, cpb));
-#elif defined(HAVE_SETLOCALE)
-	return (strcoll(cpa, cpb));
 #else
 	return (strcmp(cpa, cpb));
 #endif
+}	/* RelnameCmp */
+
+
+
+
+static int
+BreadthFirstCaseCmp(const void *a, const void *b)
+{
+	const FTPFileInfo *const *fipa;
+	const FTPFileInfo *const *fipb;
+
+	fipa = (const FTPFileInfo *const *) a;
+	fipb = (const FTPFileInfo *const *) b;
+
+	return (RelnameCmp((**fipa).relname, (**fipb).relname));
 }	/* BreadthFirstCaseCmp */
 
 
 
 
+static FTPFileInfoPtr
+FindFileInfo(const FTPFileInfoListPtr filp, const char *const relname)
+{
+	FTPFileInfo key;
+	FTPFileInfoPtr keyp, *fipp;
+
+	if ((filp->vec == NULL) || (filp->nFileInfos < 1))
+		return (NULL);
+	key.relname = (char *) relname;
+	keyp = &key;
+	fipp = (FTPFileInfoPtr *) bsearch(&keyp, filp->vec, (size_t) filp->nFileInfos,
+		sizeof(FTPFileInfoPtr), BreadthFirstCaseCmp);
+	return ((fipp == NULL) ? NULL : *fipp);
+}	/* FindFileInfo */
+
+
+
+
+/* Copies a local relative path, with FTP's "/" between directories. */
+static void
+RemotePath(char *const dst, const size_t dsize, const char *const relname)
+{
+	char *cp;
+
+	(void) Strncpy(dst, relname, dsize);
+	for (cp = dst; *cp != '\0'; cp++) {
+		if (IsLocalPathDelim(*cp))
+			*cp = '/';
+	}
+}	/* RemotePath */
+
+
+
+
+/* The reverse of RemotePath(). */
+static void
+LocalRelname(char *const dst, const size_t dsize, const char *const rpath)
+{
+	char *cp;
+
+	(void) Strncpy(dst, rpath, dsize);
+	for (cp = dst; *cp != '\0'; cp++) {
+		if (*cp == '/')
+			*cp = LOCAL_PATH_DELIM;
+	}
+}	/* LocalRelname */
+
+
+
+
 static void
 LoadCatalogFromFile(const char *const catalogFileName, FTPFileInfoListPtr const filp)
 {
@@ -263,15 +397,227 @@ LoadCatalogFromFile(const char *const catalogFileName, FTPFileInfoListPtr const
 
 
 
+/* Lays out a manifest of the list, which must be in RelnameCmp() order,
+ * in a new block of memory.
+ */
+static char *
+BuildManifest(const FTPFileInfoListPtr filp, const longest_uint *const hashes, size_t *const sizep)
+{
+	ManifestHeader h;
+	ManifestEntry *ep;
+	FTPFileInfoPtr fip;
+	char *base, *names;
+	size_t namesSize, len;
+	int i, n;
+
+	n = filp->nFileInfos;
+	namesSize = 0;
+	for (i=0; i<n; i++)
+		namesSize += strlen(filp->vec[i]->relname) + 1;
+
+	*sizep = sizeof(ManifestHeader) + ((size_t) n * sizeof(ManifestEntry)) + namesSize;
+	base = (char *) calloc((size_t) 1, *sizep);
+	if (base == NULL)
+		return (NULL);
+
+	(void) memset(&h, 0, sizeof(h));
+	(void) memcpy(h.magic, kManifestMagic, sizeof(h.magic));
+	h.byteOrder = kManifestByteOrder;
+	h.nEntries = (unsigned int) n;
+	h.namesSize = (unsigned int) namesSize;
+	(void) memcpy(base, &h, sizeof(h));
+
+	ep = (ManifestEntry *) (base + sizeof(ManifestHeader));
+	names = base + sizeof(ManifestHeader) + ((size_t) n * sizeof(ManifestEntry));
+	namesSize = 0;
+	for (i=0; i<n; i++) {
+		fip = filp->vec[i];
+		len = strlen(fip->relname);
+		ep[i].size = fip->size;
+		ep[i].mdtm = (longest_int) fip->mdtm;
+		ep[i].hash = (hashes == NULL) ? (longest_uint) 0 : hashes[i];
+		ep[i].nameOffset = (unsigned int) namesSize;
+		ep[i].nameLen = (unsigned int) len;
+		(void) memcpy(names + namesSize, fip->relname, len + 1);
+		namesSize += len + 1;
+	}
+	return (base);
+}	/* BuildManifest */
+
+
+
+
+/* Checks a manifest laid out in memory, and sets up mp to use it. */
+static int
+AttachManifest(Manifest *const mp, char *const base, const size_t baseSize, const int mapped)
+{
+	ManifestHeader h;
+	ManifestEntry *ep;
+	char *names;
+	int i;
+
+	if (baseSize < sizeof(ManifestHeader))
+		return (-1);
+	(void) memcpy(&h, base, sizeof(h));
+	if ((memcmp(h.magic, kManifestMagic, sizeof(h.magic)) != 0) || (h.byteOrder != kManifestByteOrder))
+		return (-1);
+	if ((h.nEntries > (0x7FFFFFFFU / (unsigned int) sizeof(ManifestEntry))) || (baseSize != (sizeof(ManifestHeader) + ((size_t) h.nEntries * sizeof(ManifestEntry)) + (size_t) h.namesSize)))
+		return (-1);
+
+	ep = (ManifestEntry *) (base + sizeof(ManifestHeader));
+	names = base + sizeof(ManifestHeader) + ((size_t) h.nEntries * sizeof(ManifestEntry));
+	for (i=0; i<(int) h.nEntries; i++) {
+		if ((ep[i].nameLen == 0) || (ep[i].nameOffset >= h.namesSize) || (ep[i].nameLen >= (h.namesSize - ep[i].nameOffset)) || (names[ep[i].nameOffset + ep[i].nameLen] != '\0'))
+			return (-1);
+		if ((i > 0) && (RelnameCmp(names + ep[i - 1].nameOffset, names + ep[i].nameOffset) >= 0))
+			return (-1);
+	}
+
+	mp->base = base;
+	mp->baseSize = baseSize;
+	mp->mapped = mapped;
+	mp->nEntries = (int) h.nEntries;
+	mp->entries = ep;
+	mp->names = names;
+	return (0);
+}	/* AttachManifest */
+
+
+
+
+/* Returns 1 if the file is a manifest and it was loaded, 0 if it
+ * isn't one or is missing, or -1 if it is damaged.
+ */
+static int
+LoadManifestFile(const char *const fn, Manifest *const mp)
+{
+	int fd;
+	struct stat st;
+	char *base;
+	size_t size, nleft;
+	int nread;
+
+	fd = open(fn, O_RDONLY|O_BINARY);
+	if (fd < 0)
+		return (0);
+	if ((fstat(fd, &st) < 0) || (st.st_size < (off_t) sizeof(ManifestHeader))) {
+		(void) close(fd);
+		return (0);
+	}
+	size = (size_t) st.st_size;
+
+#ifdef HAVE_SYS_MMAN_H
+	base = (char *) mmap(NULL, size, PROT_READ, MAP_PRIVATE, fd, (off_t) 0);
+	if (base != (char *) MAP_FAILED) {
+		(void) close(fd);
+		if (memcmp(base, kManifestMagic, sizeof(kManifestMagic) - 1) != 0) {
+			(void) munmap(base, size);
+			return (0);
+		}
+		if (AttachManifest(mp, base, size, 1) < 0) {
+			(void) munmap(base, size);
+			return (-1);
+		}
+		return (1);
+	}
+#endif
+
+	base = (char *) malloc(size);
+	if (base == NULL) {
+		(void) close(fd);
+		return (-1);
+	}
+	for (nleft = size; nleft > 0; nleft -= (size_t) nread) {
+		nread = (int) read(fd, base + (size - nleft), nleft);
+		if (nread <= 0) {
+			(void) close(fd);
+			free(base);
+			return (-1);
+		}
+	}
+	(void) close(fd);
+
+	if (memcmp(base, kManifestMagic, sizeof(kManifestMagic) - 1) != 0) {
+		free(base);
+		return (0);
+	}
+	if (AttachManifest(mp, base, size, 0) < 0) {
+		free(base);
+		return (-1);
+	}
+	return (1);
+}	/* LoadManifestFile */
+
+
+
+
 static void
 LoadPreviousCatalogFile(void)
 {
-	LoadCatalogFromFile(gCatalogFile, &gPrevCatalog);
+	FTPFileInfoList oldCatalog;
+	char *base;
+	size_t size;
+	int result;
+
+	(void) memset(&gPrevCatalog, 0, sizeof(gPrevCatalog));
+	result = LoadManifestFile(gCatalogFile, &gPrevCatalog);
+	if (result > 0)
+		return;
+	if (result < 0) {
+		/* Same as no catalog: everything is sent again. */
+		(void) fprintf(stderr, "NcFTPSyncPut: ignoring damaged catalog file %s.\n", gCatalogFile);
+		return;
+	}
+
+	/* Missing, or a text catalog from an older version. */
+	LoadCatalogFromFile(gCatalogFile, &oldCatalog);
+	base = BuildManifest(&oldCatalog, NULL, &size);
+	DisposeFileInfoListContents(&oldCatalog);
+	if ((base != NULL) && (AttachManifest(&gPrevCatalog, base, size, 0) < 0))
+		free(base);
 }	/* LoadPreviousCatalogFile */
 
 
 
 
+/* A 64-bit FNV-1a hash of the file's contents, or 0 if it can't be read. */
+static longest_uint
+HashLocalFile(const char *const path)
+{
+	static unsigned char buf[65536];
+	longest_uint h, prime;
+	int fd, nread, i;
+
+	fd = open(path, O_RDONLY|O_BINARY);
+	if (fd < 0)
+		return ((longest_uint) 0);
+
+	h = (((longest_uint) 0xcbf29ce4U) << 32) | (longest_uint) 0x84222325U;
+	prime = (((longest_uint) 0x00000100U) << 32) | (longest_uint) 0x000001b3U;
+	for (;;) {
+		nread = (int) read(fd, buf, sizeof(buf));
+		if (nread == 0)
+			break;
+		if (nread < 0) {
+			(void) close(fd);
+			return ((longest_uint) 0);
+		}
+		for (i=0; i<nread; i++) {
+			h ^= (longest_uint) buf[i];
+			h *= prime;
+		}
+	}
+	(void) close(fd);
+
+	/* Zero means "not known." */
+	if (h == (longest_uint) 0)
+		h = (longest_uint) 1;
+	return (h);
+}	/* HashLocalFile */
+
+
+
+
 static void
 ComputeCurrentCatalog(void)
 {
@@ -320,108 +666,396 @@ CopyFileInfoAndAddToFileList(FTPFileInfoPtr lp, FTPFileInfoListPtr filp)
 
 
 
+static int
+AddNameToFileList(const char *const relname, const longest_int size, const time_t mdtm, FTPFileInfoListPtr filp)
+{
+	FTPFileInfo fi;
+
+	InitFileInfo(&fi);
+	fi.relname = StrDup(relname);
+	fi.lname = StrDup(relname);
+	fi.relnameLen = strlen(relname);
+	fi.type = '-';
+	fi.size = size;
+	fi.mdtm = mdtm;
+	if (AddFileInfo(filp, &fi) == NULL)
+		return (-1);
+	return 0;
+}	/* AddNameToFileList */
+
+
+
+
+static int
+RenameCandidateCmp(const void *a, const void *b)
+{
+	const ManifestEntry *epa, *epb;
+
+	epa = &gPrevCatalog.entries[*(const int *) a];
+	epb = &gPrevCatalog.entries[*(const int *) b];
+	if (epa->size != epb->size)
+		return ((epa->size < epb->size) ? -1 : 1);
+	if (epa->hash != epb->hash)
+		return ((epa->hash < epb->hash) ? -1 : 1);
+	return (*(const int *) a - *(const int *) b);
+}	/* RenameCandidateCmp */
+
+
+
+
+/* Matches new files to deleted ones with the same size and contents,
+ * which were most likely moved or renamed, so they can be renamed on
+ * the server instead of being sent again.  Only files whose contents
+ * were hashed can be matched, that is, files sent while this was on.
+ */
+static void
+DetectRenames(void)
+{
+	int *cand;
+	int nCand, nCur, nPrev;
+	int i, j, lo, hi, mid;
+	const ManifestEntry *ep;
+	FTPFileInfoPtr curfip;
+
+	nCur = gCurCatalog.nFileInfos;
+	nPrev = gPrevCatalog.nEntries;
+	cand = (int *) malloc(sizeof(int) * (size_t) (nPrev + 1));
+	if (cand == NULL)
+		return;
+	for (j=0, nCand=0; j<nPrev; j++) {
+		if ((gPrevState[j] == kSyncDeleted) && (gPrevCatalog.entries[j].hash != (longest_uint) 0))
+			cand[nCand++] = j;
+	}
+	if (nCand > 1)
+		qsort(cand, (size_t) nCand, sizeof(int), RenameCandidateCmp);
+
+	for (i=0; (i<nCur) && (nCand > 0); i++) {
+		curfip = gCurCatalog.vec[i];
+		if ((gCurState[i] != kSyncNew) || (gCurHash[i] == (longest_uint) 0))
+			continue;
+		lo = 0;
+		hi = nCand;
+		while (lo < hi) {
+			mid = (lo + hi) / 2;
+			ep = &gPrevCatalog.entries[cand[mid]];
+			if ((ep->size < curfip->size) || ((ep->size == curfip->size) && (ep->hash < gCurHash[i])))
+				lo = mid + 1;
+			else
+				hi = mid;
+		}
+		for ( ; lo < nCand; lo++) {
+			ep = &gPrevCatalog.entries[cand[lo]];
+			if ((ep->size != curfip->size) || (ep->hash != gCurHash[i]))
+				break;
+			if (gPrevState[cand[lo]] == kSyncDeleted) {
+				gPrevState[cand[lo]] = kSyncRenameSource;
+				gCurState[i] = kSyncRenamed;
+				gCurRenameFrom[i] = cand[lo];
+				break;
+			}
+		}
+	}
+	free(cand);
+}	/* DetectRenames */
+
+
+
+
 static void
 CollectListOfChangedFiles(void)
 {
-	FTPFileInfoPtr prevfip, curfip;
-	int iPrev, iCur;
+	FTPFileInfoPtr curfip;
+	const ManifestEntry *prevep;
+	int iPrev, iCur, nPrev, nCur;
 	int cmprc;
 
-	InitFileInfoList(&gFiles);
-	InitFileInfoList(&gFilesToDelete);
-
 	LoadPreviousCatalogFile();
 	if (gDebugCurCatalogFile[0] != '\0')
 		LoadCatalogFromFile(gDebugCurCatalogFile, &gCurCatalog);	/* for testing */
 	else
 		ComputeCurrentCatalog();
 
+	nCur = gCurCatalog.nFileInfos;
+	nPrev = gPrevCatalog.nEntries;
+	gCurState = (char *) calloc((size_t) (nCur + 1), sizeof(char));
+	gCurHash = (longest_uint *) calloc((size_t) (nCur + 1), sizeof(longest_uint));
+	gCurRenameFrom = (int *) calloc((size_t) (nCur + 1), sizeof(int));
+	gPrevState = (char *) calloc((size_t) (nPrev + 1), sizeof(char));
+	if ((gCurState == NULL) || (gCurHash == NULL) || (gCurRenameFrom == NULL) || (gPrevState == NULL)) {
+		(void) fprintf(stderr, "NcFTPSyncPut: out of memory.\n");
+		DisposeWinsock();
+		exit(1);
+	}
+
 	/* We now have both the old catalog and current catalog
-	 * ready to compare.  We next need to create a new list
-	 * containing just the list of files that we need to
-	 * update.
+	 * ready to compare, both sorted by RelnameCmp.  Note what
+	 * needs to be done with each file.
 	 */
-
 	iPrev = 0;
-	iCur = 0;
-
-	for (;;) {
-		if (gCurCatalog.vec == NULL)
-			break;	/* done */
-
+	for (iCur = 0; iCur < nCur; iCur++) {
 		curfip = gCurCatalog.vec[iCur];
-		if (curfip == NULL)
-			break;	/* done */
-		
-		for (;;) {
-			if (
-				(gPrevCatalog.vec == NULL) ||
-				((prevfip = gPrevCatalog.vec[iPrev]) == NULL)
-			) {
-				/* Prev list did not have this file. */
-				(void) CopyFileInfoAndAddToFileList(curfip, &gFiles);
+		cmprc = 1;
+		while (iPrev < nPrev) {
+			cmprc = RelnameCmp(ManifestName(&gPrevCatalog, iPrev), curfip->relname);
+			if (cmprc >= 0)
 				break;
+			/* Current list did not have file.
+			 * That means the file was deleted
+			 * since last run.
+			 */
+			gPrevState[iPrev++] = kSyncDeleted;
+		}
+
+		if (cmprc == 0) {
+			/* Prev list _did_ have the file.
+			 * Now compare it by time/size.
+			 */
+			prevep = &gPrevCatalog.entries[iPrev++];
+			if ((prevep->mdtm != (longest_int) curfip->mdtm) || (prevep->size != curfip->size)) {
+				gCurState[iCur] = kSyncChanged;
+			} else {
+				gCurState[iCur] = kSyncUnchanged;
+				gCurHash[iCur] = prevep->hash;
 			}
-		
-			cmprc = BreadthFirstCaseCmp(&prevfip, &curfip);
-			if (cmprc == 0) {
-				/* Prev list _did_ have the file.
-				 * Now compare it by time/size.
-				 */
-				if ((prevfip->mdtm != curfip->mdtm) || (prevfip->size != curfip->size))
-					(void) CopyFileInfoAndAddToFileList(curfip, &gFiles);
-				iPrev++;
-				break;
-			} else if (cmprc < 0) {
-				/* Current list did not have file.
-				 * That means the file was deleted
-				 * since last run.
-				 */
-				(void) CopyFileInfoAndAddToFileList(prevfip, &gFilesToDelete);
-				iPrev++;
-				/* continue... */
-			} else /* if (cmprc > 0) */ {
-				/* Previous list did not have this file.
-				 * That means we need to upload this file
-				 * which had been added since the last run.
-				 */
-				(void) CopyFileInfoAndAddToFileList(curfip, &gFiles);
-				break;
+		} else {
+			/* Previous list did not have this file.
+			 * That means we need to upload this file
+			 * which had been added since the last run.
+			 */
+			gCurState[iCur] = kSyncNew;
+		}
+
+		if ((gCurState[iCur] != kSyncUnchanged) && (gDetectRenames != 0) && (curfip->type == '-'))
+			gCurHash[iCur] = HashLocalFile(curfip->lname);
+	}
+	while (iPrev < nPrev)
+		gPrevState[iPrev++] = kSyncDeleted;
+
+	/* A rename takes the old file away too. */
+	if ((gDetectRenames != 0) && (gDeleteRemoteFiles != 0))
+		DetectRenames();
+}	/* CollectListOfChangedFiles */
+
+
+
+
+static int
+GetFileTypeBasedOffOfExtension(const char *const fname)
+{
+	char buf[256], *tok, extbuf[16];
+	const char *delims;
+	const char *ext;
+	int len;
+	int i;
+
+
+	ext = strrchr(fname, '.');
+	if (ext == NULL)
+		return (kTypeBinary);
+
+	ext++;
+	STRNCPY(extbuf, ext);
+	for (i=0, len=(int) strlen(extbuf); i<len; i++)
+		if (isupper((int) extbuf[i]))
+			extbuf[i] = (char) tolower(extbuf[i]);
+
+	STRNCPY(buf, gTextExts);
+	for (i=0, len=(int) strlen(buf); i<len; i++)
+		if (isupper((int) buf[i]))
+			buf[i] = (char) tolower(buf[i]);
+
+	delims = ".;, \t\r\n";
+	for (tok = strtok(buf, delims); tok != NULL; tok = strtok(NULL, delims)) {
+		if (strcmp(tok, ext) == 0)
+			return (kTypeAscii);
+	}
+
+	return (kTypeBinary);
+}	/* GetFileTypeBasedOffOfExtension */
+
+
+
+
+/* Lists the whole remote tree into gRemoteFiles, with one MLSD for
+ * each directory, and relnames like those of the local catalog.
+ */
+static int
+SnapshotRemoteTree(void)
+{
+	FTPLineList dirs;
+	FTPLinePtr lp;
+	FTPDirIndexPtr dip;
+	FTPDirEntryPtr dep;
+	FTPFileInfo fi;
+	int i, result;
+	char path[512], rpath[512], relname[512];
+
+	InitFileInfoList(&gRemoteFiles);
+	InitLineList(&dirs);
+	(void) AddLine(&dirs, "");
+
+	/* Subdirectories are added to the end as they are found. */
+	for (lp = dirs.first; lp != NULL; lp = lp->next) {
+		STRNCPY(path, gRDirActual);
+		if (lp->line[0] != '\0') {
+			if ((path[0] == '\0') || (path[strlen(path) - 1] != '/'))
+				STRNCAT(path, "/");
+			STRNCAT(path, lp->line);
+		}
+		result = FTPGetDirIndex(&gConn, path, &dip);
+		if (result < 0) {
+			DisposeLineListContents(&dirs);
+			DisposeFileInfoListContents(&gRemoteFiles);
+			return (result);
+		}
+		for (i=0; i<dip->nEntries; i++) {
+			dep = &dip->entries[i];
+			STRNCPY(rpath, lp->line);
+			if (rpath[0] != '\0')
+				STRNCAT(rpath, "/");
+			STRNCAT(rpath, dep->name);
+			if (dep->type == 'd') {
+				(void) AddLine(&dirs, rpath);
+				continue;
 			}
+			LocalRelname(relname, sizeof(relname), rpath);
+#if (defined(WIN32) || defined(_WINDOWS)) && !defined(__CYGWIN__)
+			if (gRPathsToLowercase != 0)
+				_strlwr(relname);
+#endif
+			InitFileInfo(&fi);
+			fi.relname = StrDup(relname);
+			fi.relnameLen = strlen(relname);
+			fi.type = dep->type;
+			fi.size = dep->size;
+			fi.mdtm = dep->mdtm;
+			(void) AddFileInfo(&gRemoteFiles, &fi);
 		}
+		FTPReleaseDirIndex(&gConn, dip);
+	}
+	DisposeLineListContents(&dirs);
 
-		iCur++;
+	VectorizeFileInfoList(&gRemoteFiles);
+	if (gRemoteFiles.nFileInfos > 1) {
+		qsort(gRemoteFiles.vec, (size_t) gRemoteFiles.nFileInfos,
+			sizeof(FTPFileInfoPtr), BreadthFirstCaseCmp);
 	}
+	return (kNoErr);
+}	/* SnapshotRemoteTree */
 
-	for (;;) {
-		if (gPrevCatalog.vec == NULL)
-			break;
 
-		prevfip = gPrevCatalog.vec[iPrev];
-		if (prevfip == NULL) {
-			break;
+
+
+/* Uses the snapshot of the remote tree to send files again which are
+ * missing or the wrong size there, to skip ones which are already
+ * there, and to leave out deletions and renames of files which aren't.
+ */
+static void
+CompareWithRemoteSnapshot(void)
+{
+	FTPFileInfoPtr curfip, rfip;
+	int i, j, nCur, nPrev;
+
+	nCur = gCurCatalog.nFileInfos;
+	nPrev = gPrevCatalog.nEntries;
+	for (i=0; i<nCur; i++) {
+		curfip = gCurCatalog.vec[i];
+		if (curfip->type != '-')
+			continue;
+		if (gCurState[i] == kSyncRenamed) {
+			j = gCurRenameFrom[i];
+			if (FindFileInfo(&gRemoteFiles, ManifestName(&gPrevCatalog, j)) != NULL)
+				continue;
+			gPrevState[j] = kSyncKept;
+			gCurState[i] = kSyncNew;
 		}
 
-		/* Current list did not have file.
-		 * That means the file was deleted
-		 * since last run.
-		 */
-		(void) CopyFileInfoAndAddToFileList(prevfip, &gFilesToDelete);
-		iPrev++;
+		rfip = FindFileInfo(&gRemoteFiles, curfip->relname);
+		if (gCurState[i] == kSyncUnchanged) {
+			/* Text files can change size on the way. */
+			if ((rfip == NULL) || ((rfip->size != curfip->size) && (GetFileTypeBasedOffOfExtension(curfip->lname) == kTypeBinary)))
+				gCurState[i] = kSyncChanged;
+		} else if ((rfip != NULL) && (rfip->type == '-') && (rfip->size == curfip->size) && (rfip->mdtm != kModTimeUnknown) && (rfip->mdtm >= curfip->mdtm)) {
+			gCurState[i] = kSyncUnchanged;
+		}
 	}
 
-	VectorizeFileInfoList(&gFiles);
-	if (gFiles.nFileInfos > 1) {
-		qsort(gFiles.vec, (size_t) gFiles.nFileInfos,
-			sizeof(FTPFileInfoPtr), BreadthFirstCaseCmp);
+	for (j=0; j<nPrev; j++) {
+		if ((gPrevState[j] == kSyncDeleted) && (FindFileInfo(&gRemoteFiles, ManifestName(&gPrevCatalog, j)) == NULL))
+			gPrevState[j] = kSyncKept;
+	}
+}	/* CompareWithRemoteSnapshot */
+
+
+
+
+/* Makes the lists of files to send, rename, and delete. */
+static void
+BuildPlan(void)
+{
+	FTPFileInfoPtr curfip;
+	const ManifestEntry *ep;
+	int i, j;
+	char from[512], to[512];
+
+	DisposeFileInfoListContents(&gFiles);
+	DisposeFileInfoListContents(&gFilesToDelete);
+	DisposeBatchCmdListContents(&gRenames);
+	InitFileInfoList(&gFiles);
+	InitFileInfoList(&gFilesToDelete);
+	InitBatchCmdList(&gRenames);
+
+	/* Both catalogs are in order, so these lists will be too. */
+	for (i=0; i<gCurCatalog.nFileInfos; i++) {
+		curfip = gCurCatalog.vec[i];
+		if ((gCurState[i] == kSyncChanged) || (gCurState[i] == kSyncNew)) {
+			(void) CopyFileInfoAndAddToFileList(curfip, &gFiles);
+		} else if (gCurState[i] == kSyncRenamed) {
+			RemotePath(from, sizeof(from), ManifestName(&gPrevCatalog, gCurRenameFrom[i]));
+			RemotePath(to, sizeof(to), curfip->relname);
+			if (AddBatchCmd(&gRenames, kBatchRename, from, to) == NULL) {
+				(void) CopyFileInfoAndAddToFileList(curfip, &gFiles);
+				gPrevState[gCurRenameFrom[i]] = kSyncDeleted;
+			}
+		}
+	}
+	for (j=0; j<gPrevCatalog.nEntries; j++) {
+		if ((gPrevState[j] != kSyncDeleted) || (gDeleteRemoteFiles == 0))
+			continue;
+		ep = &gPrevCatalog.entries[j];
+		(void) AddNameToFileList(ManifestName(&gPrevCatalog, j), ep->size, (time_t) ep->mdtm, &gFilesToDelete);
 	}
 
+	VectorizeFileInfoList(&gFiles);
 	VectorizeFileInfoList(&gFilesToDelete);
-	if (gFilesToDelete.nFileInfos > 1) {
-		qsort(gFilesToDelete.vec, (size_t) gFilesToDelete.nFileInfos,
-			sizeof(FTPFileInfoPtr), BreadthFirstCaseCmp);
+}	/* BuildPlan */
+
+
+
+
+static void
+ShowPlan(void)
+{
+	FTPBatchCmdPtr bp;
+
+	if ((gFiles.nFileInfos < 1) && (gFilesToDelete.nFileInfos < 1) && (gRenames.nCmds < 1)) {
+		(void) fprintf(stdout, "No files have been added, removed, or changed since the last update.\n");
+		return;
 	}
-}	/* CollectListOfChangedFiles */
+	if (gFiles.nFileInfos > 0) {
+		(void) fprintf(stdout, "New or changed files:\n");
+		PrintFileList(&gFiles);
+	}
+	if (gRenames.nCmds > 0) {
+		(void) fprintf(stdout, "\nMoved or renamed files:\n");
+		for (bp = gRenames.first; bp != NULL; bp = bp->next)
+			(void) fprintf(stdout, "%s -> %s\n", bp->arg, bp->arg2);
+	}
+	if (gFilesToDelete.nFileInfos > 0) {
+		(void) fprintf(stdout, "\nDeleted files:\n");
+		PrintFileList(&gFilesToDelete);
+	}
+}	/* ShowPlan */
 
 
 
@@ -438,7 +1072,12 @@ Usage(void)
 	(void) fprintf(fp, "\nFlags:\n\
   -d XX  Use the file XX for debug logging.\n\
   -UU    Update catalog file only, no uploading.\n\
-  -t XX  Timeout after XX seconds.\n");
+  -l     Only list what would be done.\n\
+  -t XX  Timeout after XX seconds.\n\
+  -j XX  Send files over XX connections at once.\n\
+  -R     Also compare with a listing of the remote directory (needs MLSD).\n\
+  -M     Rename files on the remote host which were moved or renamed here,\n\
+         instead of sending them again.\n");
 	(void) fprintf(fp, "\
   -v/-V  Do (do not) use progress meters.\n\
   -F     Use passive (PASV) data connections.\n\
@@ -456,6 +1095,9 @@ Other config file options:\n\
   debug-log                (same as \"-d\"; default is off)\n\
   passive                  (yes/no, default: no)\n\
   sync-deletes             (yes/no, default: yes)\n\
+  remote-check             (same as \"-R\"; yes/no, default: no)\n\
+  detect-renames           (same as \"-M\"; yes/no, default: no)\n\
+  parallel-connections     (same as \"-j\"; default: 1)\n\
   port                     (default: 21)\n\
   umask                    (default depends on server)\n\
   textexts                 (default: %s)\n", gTextExts);
@@ -466,7 +1108,11 @@ Other config file options:\n\
 	(void) fprintf(fp, "\n\
 Note: If you choose to put the config file and/or the timestamp\n\
       file in the directory to synchronize, NcFTPSyncPut will _not_\n\
-      upload those files _if_ they are detected.\n");
+      upload those files _if_ they are detected.\n\
+\n\
+      Moved files are found by their contents, which are checked when\n\
+      they are sent with detect-renames on, so only files sent that way\n\
+      can be renamed later.\n");
 	(void) fprintf(fp, "\nLibrary version: %s.\n", gLibNcFTPVersion + 5);
 	(void) fprintf(fp, "\nThis is a freeware program by Mike Gleason (http://www.NcFTP.com/contact/).\n");
 	(void) fprintf(fp, "This was built using LibNcFTP (http://www.ncftp.com/libncftp).\n");
@@ -506,165 +1152,245 @@ static int
 UpdateCatalogFile(void)
 {
 	FILE *fp;
-	FTPFileInfoPtr fip;
-	int i, n;
-	char mdtmstr[64];
+	char *base;
+	size_t size;
+	int result;
+	char tmpCatalogFile[sizeof(gCatalogFile) + 8];
 
-	fp = fopen(
-		gCatalogFile,
-#if (defined(WIN32) || defined(_WINDOWS)) && !defined(__CYGWIN__)
-		"wt"
-#else
-		"w"
-#endif
-		);
-	if (fp == NULL) {
-		perror(gCatalogFile);
+	base = BuildManifest(&gCurCatalog, gCurHash, &size);
+	if (base == NULL) {
+		(void) fprintf(stderr, "NcFTPSyncPut: out of memory.\n");
 		return (-1);
 	}
 
-	n = gCurCatalog.nFileInfos;
-	for (i=0; i<n; i++) {
-		fip = gCurCatalog.vec[i];
-		(void) strftime(mdtmstr, sizeof(mdtmstr), "%Y-%m-%d %H:%M:%S", localtime(&fip->mdtm));
-		(void) fprintf(fp, "File: %s\nSize: ", fip->relname);
-		(void) fprintf(fp, PRINTF_LONG_LONG, fip->size);
-		(void) fprintf(fp, "\nDate: %lu (%s)\n\n", (unsigned long) fip->mdtm, mdtmstr);
-		if (fflush(fp) < 0) {
-			(void) fclose(fp);
-			return (-1);
-		}
+	/* Replace the old catalog only once the new one is complete. */
+	STRNCPY(tmpCatalogFile, gCatalogFile);
+	STRNCAT(tmpCatalogFile, ".tmp");
+	fp = fopen(tmpCatalogFile, "wb");
+	if (fp == NULL) {
+		perror(tmpCatalogFile);
+		free(base);
+		return (-1);
+	}
+	result = 0;
+	if (fwrite(base, (size_t) 1, size, fp) != size)
+		result = -1;
+	if (fclose(fp) != 0)
+		result = -1;
+	free(base);
+	if (result < 0) {
+		perror(tmpCatalogFile);
+		(void) remove(tmpCatalogFile);
+		return (-1);
 	}
 
+#if (defined(WIN32) || defined(_WINDOWS)) && !defined(__CYGWIN__)
+	(void) remove(gCatalogFile);
+#endif
+	if (rename(tmpCatalogFile, gCatalogFile) < 0) {
+		perror(gCatalogFile);
+		(void) remove(tmpCatalogFile);
+		return (-1);
+	}
 	return (0);
 }	/* UpdateCatalogFile */
 
 
 
 
+/* Notes the directories of a file's remote path, parents first, unless
+ * they were just noted for the file before.
+ */
+static void
+AddParentDirs(FTPLineListPtr dirs, const char *const rpath, char *const lastDir, const size_t lastDirSize)
+{
+	char *cp, relDir[512];
+
+	(void) Strncpy(relDir, rpath, sizeof(relDir));
+	cp = strrchr(relDir, '/');
+	if (cp == NULL)
+		return;
+	*cp = '\0';
+	if (strcmp(relDir, lastDir) == 0)
+		return;
+	(void) Strncpy(lastDir, relDir, lastDirSize);
+
+	for (cp = strchr(relDir, '/'); cp != NULL; cp = strchr(cp + 1, '/')) {
+		*cp = '\0';
+		(void) AddLine(dirs, relDir);
+		*cp = '/';
+	}
+	(void) AddLine(dirs, relDir);
+}	/* AddParentDirs */
+
+
+
+
 static int
-GetFileTypeBasedOffOfExtension(const char *const fname)
+DirCmp(const void *a, const void *b)
 {
-	char buf[256], *tok, extbuf[16];
-	const char *delims;
-	const char *ext;
-	int len;
-	int i;
+	return (RelnameCmp(*(char *const *) a, *(char *const *) b));
+}	/* DirCmp */
 
 
-	ext = strrchr(fname, '.');
-	if (ext == NULL)
-		return (kTypeBinary);
 
-	ext++;
-	STRNCPY(extbuf, ext);
-	for (i=0, len=(int) strlen(extbuf); i<len; i++)
-		if (isupper((int) extbuf[i]))
-			extbuf[i] = (char) tolower(extbuf[i]);
 
-	STRNCPY(buf, gTextExts);
-	for (i=0, len=(int) strlen(buf); i<len; i++)
-		if (isupper((int) buf[i]))
-			buf[i] = (char) tolower(buf[i]);
+/* Creates the remote directories for all the files about to be sent or
+ * renamed, with the MKDs sent together, instead of finding out each one
+ * is missing with a CWD of its own.  Most will already exist, which is
+ * fine.
+ */
+static void
+MakeRemoteDirs(void)
+{
+	FTPLineList dirs;
+	FTPLinePtr lp;
+	FTPBatchCmdList batch;
+	FTPFileInfoPtr fip;
+	FTPBatchCmdPtr bp;
+	char **vec;
+	int i, n;
+	char rpath[512], lastDir[512];
 
-	delims = ".;, \t\r\n";
-	for (tok = strtok(buf, delims); tok != NULL; tok = strtok(NULL, delims)) {
-		if (strcmp(tok, ext) == 0)
-			return (kTypeAscii);
+	InitLineList(&dirs);
+	lastDir[0] = '\0';
+	for (fip = gFiles.first; fip != NULL; fip = fip->next) {
+		RemotePath(rpath, sizeof(rpath), fip->relname);
+		AddParentDirs(&dirs, rpath, lastDir, sizeof(lastDir));
 	}
+	for (bp = gRenames.first; bp != NULL; bp = bp->next)
+		AddParentDirs(&dirs, bp->arg2, lastDir, sizeof(lastDir));
+	if (dirs.nLines < 1)
+		return;
 
-	return (kTypeBinary);
-}	/* GetFileTypeBasedOffOfExtension */
+	/* Sorted, parents come first, and duplicates are together. */
+	InitBatchCmdList(&batch);
+	n = dirs.nLines;
+	vec = (char **) malloc(sizeof(char *) * (size_t) n);
+	if (vec == NULL) {
+		for (lp = dirs.first; lp != NULL; lp = lp->next)
+			(void) AddBatchCmd(&batch, kBatchMKD, lp->line, NULL);
+	} else {
+		for (lp = dirs.first, i = 0; lp != NULL; lp = lp->next)
+			vec[i++] = lp->line;
+		qsort(vec, (size_t) n, sizeof(char *), DirCmp);
+		for (i=0; i<n; i++) {
+			if ((i > 0) && (strcmp(vec[i], vec[i - 1]) == 0))
+				continue;
+			(void) AddBatchCmd(&batch, kBatchMKD, vec[i], NULL);
+		}
+		free(vec);
+	}
+	if (batch.nCmds > 0)
+		(void) FTPBatchCmds(&gConn, &batch, kTypeBinary);
+	DisposeBatchCmdListContents(&batch);
+	DisposeLineListContents(&dirs);
+}	/* MakeRemoteDirs */
+
+
+
+
+/* Renames the files on the server which were moved or renamed here,
+ * all at once.  For any that can't be, the file is sent and the old
+ * one deleted after all.
+ */
+static void
+RenameFiles(void)
+{
+	FTPBatchCmdPtr bp;
+	FTPFileInfoPtr fip;
+	int nFailed;
+	char relname[512];
 
+	if (gRenames.nCmds < 1)
+		return;
 
+	(void) FTPBatchCmds(&gConn, &gRenames, kTypeBinary);
+	nFailed = 0;
+	for (bp = gRenames.first; bp != NULL; bp = bp->next) {
+		if (bp->result == kNoErr)
+			continue;
+		(void) fprintf(stderr, "NcFTPSyncPut: remote rename of %s to %s failed: %s.\n", bp->arg, bp->arg2, FTPStrError(bp->result));
+		nFailed++;
+		LocalRelname(relname, sizeof(relname), bp->arg2);
+		fip = FindFileInfo(&gCurCatalog, relname);
+		if (fip != NULL)
+			(void) CopyFileInfoAndAddToFileList(fip, &gFiles);
+		LocalRelname(relname, sizeof(relname), bp->arg);
+		(void) AddNameToFileList(relname, (longest_int) 0, (time_t) 0, &gFilesToDelete);
+	}
 
+	if (nFailed > 0) {
+		VectorizeFileInfoList(&gFiles);
+		VectorizeFileInfoList(&gFilesToDelete);
+		if (gFilesToDelete.nFileInfos > 1) {
+			qsort(gFilesToDelete.vec, (size_t) gFilesToDelete.nFileInfos,
+				sizeof(FTPFileInfoPtr), BreadthFirstCaseCmp);
+		}
+	}
+}	/* RenameFiles */
 
 
+
+
+/* Sends the new and changed files, by path from the remote directory,
+ * as two batches (text and binary), which go over several connections
+ * at once when gParallelConnections is set.
+ */
 static int
 CopyFiles(void)
 {
+	FTPFileInfoList textFiles, binFiles;
 	FTPFileInfoPtr fip;
-	int i, n;
+	FTPFileInfo fi;
 	int result;
-	int xtype;
-	char *cp, relDir[256], curRelDir[256];
+	char rname[512];
 
-	STRNCPY(curRelDir, "");
-	n = gFiles.nFileInfos;
-	if (n < 1)
+	if ((gFiles.nFileInfos < 1) && (gRenames.nCmds < 1))
 		return (0);
 
-	for (i=0; i<n; i++) {
-		fip = gFiles.vec[i];
-
-#if 0
-		printf("\n\n%c  %-10lu  size=%-10d  %s\n",
-			fip->type,
-			fip->mdtm,
-			(int) fip->size,
-			fip->lname
-		);
-#endif
-		STRNCPY(relDir, fip->relname);
-		cp = StrRFindLocalPathDelim(relDir);
-		if (cp != NULL)
-			*cp = '\0';
-		else
-			relDir[0] = '\0';
-
-		if (strcmp(relDir, curRelDir) != 0) {
-			/* This file was in a different
-			 * directory than the one before.
-			 * 
-			 * We now need to change back to
-			 * our starting directory, and then
-			 * change to each sub-node in the
-			 * new relative directory.
-			 */
-			result = FTPChdir(&gConn, gRDirActual);
-			if (result != 0) {
-				(void) fprintf(stderr, "NcFTPSyncPut: chdir back to %s failed: %s.\n", gRDirActual, FTPStrError(result));
-				return (-1);
-			}
-			STRNCPY(curRelDir, relDir);
-			if (curRelDir[0] != '\0')
-				result = FTPChdir3(&gConn, curRelDir, NULL, 0, (kChdirOneSubdirAtATime|kChdirAndMkdir));
-			if (result != 0) {
-				(void) fprintf(stderr, "NcFTPSyncPut: chdir to %s failed: %s.\n", curRelDir, FTPStrError(result));
-				return (-1);
-			}
-		}
+	MakeRemoteDirs();
+	RenameFiles();
 
+	InitFileInfoList(&textFiles);
+	InitFileInfoList(&binFiles);
+	for (fip = gFiles.first; fip != NULL; fip = fip->next) {
+		RemotePath(rname, sizeof(rname), fip->relname);
 		if (fip->type == 'l') {
-			if ((fip->rlinkto != NULL) && (fip->relname != NULL)) {
-				cp = StrRFindLocalPathDelim(fip->relname);
-				if (cp == NULL)
-					cp = fip->relname;
-				else
-					cp++;
-				(void) FTPSymlink(&gConn, fip->rlinkto, cp);
-			}
-		} else {
-			xtype = GetFileTypeBasedOffOfExtension(fip->lname);
-			result = FTPPutFiles3(&gConn, fip->lname, ".", kRecursiveNo, kGlobNo,
-				xtype, kAppendNo, NULL, ".tmp", kResumeNo, kDeleteNo,
-				kNoFTPConfirmResumeUploadProc, 0);
-			if (result != 0) {
-				(void) fprintf(stderr, "NcFTPSyncPut: file send error for %s: %s.\n", fip->lname, FTPStrError(result));
-				return (result);
-			}
+			if (fip->rlinkto != NULL)
+				(void) FTPSymlink(&gConn, fip->rlinkto, rname);
+			continue;
 		}
+		InitFileInfo(&fi);
+		fi.relname = StrDup(fip->relname);
+		fi.relnameLen = fip->relnameLen;
+		fi.lname = StrDup(fip->lname);
+		fi.rname = StrDup(rname);
+		fi.type = '-';
+		fi.size = fip->size;
+		fi.mdtm = fip->mdtm;
+		if (GetFileTypeBasedOffOfExtension(fip->lname) == kTypeAscii)
+			(void) AddFileInfo(&textFiles, &fi);
+		else
+			(void) AddFileInfo(&binFiles, &fi);
 	}
 
-	n = gFilesToDelete.nFileInfos;
-	if ((n < 1) || (gDeleteRemoteFiles == 0))
-		return (0);
+	result = 0;
+	if (textFiles.nFileInfos > 0)
+		result = FTPPutFileList(&gConn, &textFiles, kTypeAscii, NULL, ".tmp");
+	if ((result == 0) && (binFiles.nFileInfos > 0))
+		result = FTPPutFileList(&gConn, &binFiles, kTypeBinary, NULL, ".tmp");
+	DisposeFileInfoListContents(&textFiles);
+	DisposeFileInfoListContents(&binFiles);
+	if (result != 0) {
+		(void) fprintf(stderr, "NcFTPSyncPut: file send error: %s.\n", FTPStrError(result));
+		return (result);
+	}
 
-	if (gConn.startingWorkingDirectory == NULL) {
+	if ((gFilesToDelete.nFileInfos > 0) && (gDeleteRemoteFiles != 0) && (gConn.startingWorkingDirectory == NULL)) {
 		(void) fprintf(stderr, "NcFTPSyncPut: could not change back to starting directory.\n");
 		(void) fprintf(stderr, "This is required to synchronize remote deletions.\n");
 		/* Don't reupload everything everytime... */
-		return (0);
 	}
 	return 0;
 }	/* CopyFiles */
@@ -672,10 +1398,30 @@ CopyFiles(void)
 
 
 
+/* Sends the deletions queued up for the current directory. */
+static void
+FlushDeletes(FTPBatchCmdListPtr batch, const char *const relDir)
+{
+	FTPBatchCmdPtr bp;
+
+	if (batch->nCmds > 0) {
+		(void) FTPBatchCmds(&gConn, batch, kTypeBinary);
+		for (bp = batch->first; bp != NULL; bp = bp->next) {
+			if (bp->result != kNoErr)
+				(void) fprintf(stderr, "NcFTPSyncPut: remote delete of %s%s%s failed: %s.\n", relDir, (relDir[0] != '\0') ? LOCAL_PATH_DELIM_STR : "", bp->arg, FTPStrError(bp->result));
+		}
+	}
+	DisposeBatchCmdListContents(batch);
+}	/* FlushDeletes */
+
+
+
+
 static int
 DeleteFiles(void)
 {
 	FTPFileInfoPtr fip;
+	FTPBatchCmdList batch;
 	int i, n;
 	int result;
 	char *cp, *fname, relDir[256], curRelDir[256];
@@ -685,6 +1431,8 @@ DeleteFiles(void)
 	if (n < 1)
 		return (0);
 
+	InitBatchCmdList(&batch);
+
 	for (i=0; i<n; i++) {
 		fip = gFilesToDelete.vec[i];
 
@@ -715,6 +1463,7 @@ DeleteFiles(void)
 			 * change to each sub-node in the
 			 * new relative directory.
 			 */
+			FlushDeletes(&batch, curRelDir);
 			result = FTPChdir(&gConn, gRDirActual);
 			if (result != 0) {
 				(void) fprintf(stderr, "NcFTPSyncPut: chdir back to %s failed: %s.\n", gRDirActual, FTPStrError(result));
@@ -731,12 +1480,13 @@ DeleteFiles(void)
 
 		if (fip->type == 'd')
 			continue;	/* We only handle 'l' and '-' (links, files) */
-		result = FTPDelete(&gConn, fname, kRecursiveNo, kGlobNo);
-		if (result != 0) {
-			(void) fprintf(stderr, "NcFTPSyncPut: remote delete of %s failed: %s.\n", fip->lname, FTPStrError(result));
-			continue;
+		if (AddBatchCmd(&batch, kBatchDELE, fname, NULL) == NULL) {
+			result = FTPDelete(&gConn, fname, kRecursiveNo, kGlobNo);
+			if (result != 0)
+				(void) fprintf(stderr, "NcFTPSyncPut: remote delete of %s failed: %s.\n", fip->lname, FTPStrError(result));
 		}
 	}
+	FlushDeletes(&batch, curRelDir);
 
 	return 0;
 }	/* DeleteFiles */
@@ -879,6 +1629,12 @@ ReadSyncputConfigFile(const char *fn, FTPCIPtr cip)
 			(void) STRNCPY(gUmaskStr, tokstart + 6);
 		} else if (strncmp(tokstart, "sync-deletes", 12) == 0) {
 			gDeleteRemoteFiles = StrToBool(tokstart + 13);
+		} else if (strncmp(tokstart, "remote-check", 12) == 0) {
+			gCheckRemote = StrToBool(tokstart + 13);
+		} else if (strncmp(tokstart, "detect-renames", 14) == 0) {
+			gDetectRenames = StrToBool(tokstart + 15);
+		} else if (strncmp(tokstart, "parallel-connections", 20) == 0) {
+			gParallelConnections = atoi(tokstart + 21);
 #if (defined(WIN32) || defined(_WINDOWS)) && !defined(__CYGWIN__)
 		} else if (strncmp(tokstart, "pathnames-to-lowercase", 22) == 0) {
 			gRPathsToLowercase = StrToBool(tokstart + 23);
@@ -937,7 +1693,7 @@ main(int argc, char **argv)
 	progmeters = GetDefaultProgressMeterSetting();
 
 	GetoptReset(&opt);
-	while ((c = Getopt(&opt, argc, argv, "P:u:p:e:d:t:vUVFyl")) > 0) switch(c) {
+	while ((c = Getopt(&opt, argc, argv, "P:u:p:e:d:t:j:vUVFylMR")) > 0) switch(c) {
 		case 'P':
 			gConn.port = atoi(opt.arg);	
 			break;
@@ -984,6 +1740,15 @@ main(int argc, char **argv)
 		case 'l':
 			showListOnly = 1;
 			break;
+		case 'j':
+			gParallelConnections = atoi(opt.arg);
+			break;
+		case 'M':
+			gDetectRenames = 1;
+			break;
+		case 'R':
+			gCheckRemote = 1;
+			break;
 		default:
 			Usage();
 	}
@@ -1035,25 +1800,22 @@ main(int argc, char **argv)
 
 
 	CollectListOfChangedFiles();
-	if ((gFiles.nFileInfos < 1) && (gFilesToDelete.nFileInfos < 1)) {
-		(void) fprintf(stdout, "No files have been added, removed, or changed since the last update.\n");
-		es = kExitSuccess;
-		DisposeWinsock();
-		exit((int) es);
-	}
-
-	if (showListOnly != 0) {
-		if (gFiles.nFileInfos > 0) {
-			(void) fprintf(stdout, "New or changed files:\n");
-			PrintFileList(&gFiles);
+	if (gCheckRemote == 0) {
+		/* Otherwise, wait until the remote files are known. */
+		BuildPlan();
+		if ((gFiles.nFileInfos < 1) && (gFilesToDelete.nFileInfos < 1) && (gRenames.nCmds < 1)) {
+			(void) fprintf(stdout, "No files have been added, removed, or changed since the last update.\n");
+			es = kExitSuccess;
+			DisposeWinsock();
+			exit((int) es);
 		}
-		if (gFilesToDelete.nFileInfos > 0) {
-			(void) fprintf(stdout, "\nDeleted files:\n");
-			PrintFileList(&gFilesToDelete);
+
+		if (showListOnly != 0) {
+			ShowPlan();
+			es = kExitSuccess;
+			DisposeWinsock();
+			exit((int) es);
 		}
-		es = kExitSuccess;
-		DisposeWinsock();
-		exit((int) es);
 	}
 
 	if (updateListOnly >= 2) {
@@ -1064,6 +1826,11 @@ main(int argc, char **argv)
 		exit((int) es);
 	}
 
+	if (gParallelConnections > 1) {
+		gConn.parallelConnections = gParallelConnections;
+		gConn.leavePass = 1;	/* The extra connections log in too. */
+	}
+
 	es = kExitOpenTimedOut;
 	if ((result = FTPOpenHost(&gConn)) < 0) {
 		(void) fprintf(stderr, "NcFTPSyncPut: cannot open %s: %s.\n", gConn.host, FTPStrError(result));
@@ -1082,11 +1849,34 @@ main(int argc, char **argv)
 			(void) fprintf(stderr, "NcFTPSyncPut: chdir %s failed: %s.\n", gRDir, FTPStrError(result));
 	}
 
+	if ((result >= 0) && (gCheckRemote != 0)) {
+		result = SnapshotRemoteTree();
+		if (result < 0) {
+			/* Go by the catalog alone. */
+			(void) fprintf(stderr, "NcFTPSyncPut: could not list %s: %s.\n", gRDirActual, FTPStrError(result));
+		} else {
+			CompareWithRemoteSnapshot();
+		}
+		BuildPlan();
+		if (showListOnly != 0) {
+			ShowPlan();
+			(void) FTPCloseHost(&gConn);
+			DisposeWinsock();
+			exit(kExitSuccess);
+		}
+		if ((gFiles.nFileInfos < 1) && (gFilesToDelete.nFileInfos < 1) && (gRenames.nCmds < 1)) {
+			/* Still rewrite the catalog below. */
+			ShowPlan();
+		}
+		result = 0;
+	}
+
 	if (result >= 0) {
 		es = kExitXferTimedOut;
 		(void) signal(SIGINT, Abort);
 		if (CopyFiles() == 0) {
-			DeleteFiles();
+			if (gDeleteRemoteFiles != 0)
+				DeleteFiles();
 			es = kExitSuccess;
 		}
 	}
@@ -73,6 +73,8 @@ static const char *gConnInfoOptStrings[] = {
 	"require20",
 	"allowProxyForPORT",
 	"doNotGetStartCWD",
+	"Pipelining",
+	"MODE_Z",
 	NULL
 };
 
@@ -97,6 +99,8 @@ typedef enum ConnInfoOptions {
 	kOptRequire20,
 	kOptAllowProxyForPORT,
 	kOptDoNotGetStartCWD,
+	kOptPipelining,
+	kOptMODE_Z,
 	kOptNumConnInfoOptions
 } ConnInfoOptions;
 
@@ -212,6 +216,12 @@ FTPManualOverrideFeatures(const FTPCIPtr cip)
 					case kOptDoNotGetStartCWD:
 						cip->doNotGetStartingWorkingDirectory = intval;
 						break;
+					case kOptPipelining:
+						cip->hasPipelining = intval;
+						break;
+					case kOptMODE_Z:
+						cip->hasMODE_Z = intval;
+						break;
 					case kOptNumConnInfoOptions:
 						break;
 				}
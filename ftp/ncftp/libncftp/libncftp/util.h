@@ -93,8 +93,18 @@ void AutomaticallyUseASCIIModeDependingOnExtension(const FTPCIPtr cip, const cha
 void FTPCheckForRestartModeAvailability(const FTPCIPtr cip);
 int WaitForRemoteInput(const FTPCIPtr cip);
 int WaitForRemoteOutput(const FTPCIPtr cip);
+void FTPGrowIOBuffer(const FTPCIPtr cip, const size_t nread, int *const nFullReads);
 void FTPSetUploadSocketBufferSize(const FTPCIPtr cip);
 
+/* io_modez.c */
+int FTPRequestModeZ(const FTPCIPtr cip, const char *const file);
+int FTPSetTransferMode(const FTPCIPtr cip, const int netMode);
+int FTPReadData(const FTPCIPtr cip, char *const buf, const size_t bufSize);
+int FTPModeZPending(const FTPCIPtr cip);
+int FTPModeZDeflate(const FTPCIPtr cip, const char **const src, size_t *const srcLen, const int finish, const char **const out);
+void FTPEndModeZ(const FTPCIPtr cip);
+void FTPDisposeModeZ(const FTPCIPtr cip);
+
 /* io_get.c, io_put.c */
 int
 FTPGetOneF(
@@ -128,6 +138,20 @@ FTPPutOneF(
 
 int FTPGetOneTarF(const FTPCIPtr cip, const char *file, const char *const dstdir);
 
+/* io_parallel.c */
+typedef struct FTPParallelXfer *FTPParallelXferPtr;
+FTPParallelXferPtr InitParallelGet(const FTPCIPtr cip, const int xtype, const int resumeflag, const int appendflag, const int deleteflag, const FTPConfirmResumeDownloadProc resumeProc);
+FTPParallelXferPtr InitParallelPut(const FTPCIPtr cip, const int xtype, const int appendflag, const char *const tmppfx, const char *const tmpsfx, const int resumeflag, const int deleteflag, const FTPConfirmResumeUploadProc resumeProc, const time_t batchStartTime, const time_t origLmtime);
+int AddParallelXfer(const FTPParallelXferPtr pxp, const FTPFileInfoPtr fip, const int nFileInfos, const int askSize);
+int RunParallelXfers(const FTPParallelXferPtr pxp, int *const batchResult);
+void DisposeParallelXfer(const FTPParallelXferPtr pxp);
+
+/* rdircache.c */
+int FTPDirCacheFileType(const FTPCIPtr cip, const char *const file, int *const ftype);
+int FTPDirCacheGlob(const FTPCIPtr cip, const FTPLineListPtr fileList, const char *const pattern);
+void FTPDirCacheNoteCmd(const FTPCIPtr cip, const char *const command);
+void FTPDisposeDirCache(const FTPCIPtr cip);
+
 /* open.c */
 void FTPResetStatusVariables(const FTPCIPtr cip);
 void FTPDeallocateHost(const FTPCIPtr cip);
@@ -262,3 +262,111 @@ connected:
 
 	return (0);
 }	/* _SConnect */
+
+
+
+
+/*
+ * Turn non-blocking mode on or off for a socket.
+ */
+int
+SSetNonBlocking(const int sfd, const int onoff)
+{
+#ifndef FIONBIO
+	int fcntl_opt;
+#endif
+
+#ifdef FIONBIO
+	if (SSetFIONBIO(sfd, (onoff != 0) ? 1 : 0) < 0) {
+		SIOSETERRNO
+		return (-1);
+	}
+#else
+	if ((fcntl_opt = fcntl(sfd, F_GETFL, 0)) < 0) {
+		SIOSETERRNO
+		return (-1);
+	}
+	if (onoff != 0)
+		fcntl_opt |= O_NONBLOCK;
+	else
+		fcntl_opt &= ~O_NONBLOCK;
+	if (fcntl(sfd, F_SETFL, fcntl_opt) < 0) {
+		SIOSETERRNO
+		return (-1);
+	}
+#endif
+	return (0);
+}	/* SSetNonBlocking */
+
+
+
+
+/*
+ * Start a connect() without waiting for it to finish, for programs
+ * which do their own waiting.  The socket is left in non-blocking mode.
+ *
+ * Returns 0 if it connected right away, 1 if the connection is in
+ * progress (wait until the socket is writable, then call
+ * SConnectFinish), or -1 on error.
+ */
+int
+SConnectStart(const int sfd, const struct sockaddr_in *const addr)
+{
+	int result;
+#if (defined(WIN32) || defined(_WINDOWS)) && !defined(__CYGWIN__)
+	int wsaErrno;
+#endif
+	DECL_SIGPIPE_VARS
+
+	if (addr == NULL) {
+		errno = EINVAL;
+		return (-1);
+	}
+	if (SSetNonBlocking(sfd, 1) < 0)
+		return (-1);
+
+	errno = 0;
+	IGNORE_SIGPIPE
+	result = connect(sfd, (const struct sockaddr *) addr,
+			(sockaddr_size_t) sizeof(struct sockaddr_in));
+	RESTORE_SIGPIPE
+	if (result == 0)
+		return (0);
+#if (defined(WIN32) || defined(_WINDOWS)) && !defined(__CYGWIN__)
+	wsaErrno = WSAGetLastError();
+	if ((wsaErrno == WSAEWOULDBLOCK) || (wsaErrno == WSAEINPROGRESS))
+		return (1);
+#else
+	if ((errno == EINPROGRESS) || (errno == EWOULDBLOCK) || (errno == EINTR))
+		return (1);
+#endif
+	SIOSETERRNO
+	return (-1);
+}	/* SConnectStart */
+
+
+
+
+/*
+ * Call this once a socket given to SConnectStart is writable.
+ * Returns 0 if the connection was made, or -1 with errno set to
+ * the reason it failed.
+ */
+int
+SConnectFinish(const int sfd)
+{
+	int soerr;
+	sockopt_size_t soerrsize;
+
+	soerr = 0;
+	soerrsize = (sockopt_size_t) sizeof(soerr);
+	if (getsockopt(sfd, SOL_SOCKET, SO_ERROR, (char *) &soerr, &soerrsize) < 0) {
+		SIOSETERRNO
+		return (-1);
+	}
+	if (soerr != 0) {
+		errno = soerr;
+		return (-1);
+	}
+	return (0);
+}	/* SConnectFinish */
@@ -28,10 +28,8 @@ SRead(int sfd, char *const buf0, size_t size, int tlen, int retry)
 	read_return_t nread;
 	read_size_t nleft;
 	char *buf = buf0;
-	int tleft;
-	time_t done, now;
-	fd_set ss;
-	struct timeval tv;
+	int msleft;
+	unsigned long startMs;
 	int result, firstRead;
 	DECL_SIGPIPE_VARS
 	
@@ -44,13 +42,12 @@ SRead(int sfd, char *const buf0, size_t size, int tlen, int retry)
 	errno = 0;
 
 	nleft = (read_size_t) size;
-	time(&now);
-	done = now + tlen;
+	startMs = SMonoTimeMs();
+	msleft = STimeLeftMs(startMs, tlen);
 	firstRead = 1;
 
 	forever {
-		tleft = (done > now) ? ((int) (done - now)) : 0;
-		if (tleft < 1) {
+		if (msleft <= 0) {
 			nread = (read_return_t) size - (read_return_t) nleft;
 			if ((nread == 0) || ((retry & (kFullBufferRequired|kFullBufferRequiredExceptLast)) != 0)) {
 				nread = kTimeoutErr;
@@ -63,18 +60,7 @@ SRead(int sfd, char *const buf0, size_t size, int tlen, int retry)
 		if (!firstRead || ((retry & kNoFirstSelect) == 0)) {
 			forever {
 				errno = 0;
-				MY_FD_ZERO(&ss);
-#if defined(__DECC) || defined(__DECCXX)
-#pragma message save
-#pragma message disable trunclongint
-#endif
-				MY_FD_SET(sfd, &ss);
-#if defined(__DECC) || defined(__DECCXX)
-#pragma message restore
-#endif
-				tv.tv_sec = (tv_sec_t) tleft;
-				tv.tv_usec = 0;
-				result = select(sfd + 1, SELECT_TYPE_ARG234 &ss, NULL, NULL, SELECT_TYPE_ARG5 &tv);
+				result = SPollOne(sfd, 0, msleft);
 				if (result >= 1) {
 					/* ready */
 					break;
@@ -93,6 +79,7 @@ SRead(int sfd, char *const buf0, size_t size, int tlen, int retry)
 					RESTORE_SIGPIPE
 					return (-1);
 				}
+				msleft = STimeLeftMs(startMs, tlen);
 			}
 			firstRead = 0;
 		}
@@ -128,7 +115,7 @@ SRead(int sfd, char *const buf0, size_t size, int tlen, int retry)
 		if ((nleft == 0) || (((retry & (kFullBufferRequired|kFullBufferRequiredExceptLast)) == 0) && (nleft != (read_size_t) size)))
 			break;
 		buf += nread;
-		time(&now);
+		msleft = STimeLeftMs(startMs, tlen);
 	}
 	nread = (read_return_t) size - (read_return_t) nleft;
 
@@ -3,136 +3,135 @@
 #	pragma hdrstop
 #endif
 
-/* 
- * Return zero if the operation timed-out or erred-out, otherwise non-zero.
+/* The largest timeout, in seconds, which still fits in an int
+ * when converted to milliseconds.
  */
-int
-SWaitUntilReadyForReading(const int sfd, const int tlen)
+#define kMaxTimeoutSecs 2147483
+
+/*
+ * Return a millisecond count from some arbitrary fixed point, suitable
+ * only for measuring intervals.  Unlike time() this is not affected
+ * when the system clock is changed.  Subtract two values as unsigned
+ * longs, so the difference is still correct if the counter wraps.
+ */
+unsigned long
+SMonoTimeMs(void)
 {
-	fd_set ss, ss2;
+#if (defined(WIN32) || defined(_WINDOWS)) && !defined(__CYGWIN__)
+	return ((unsigned long) GetTickCount());
+#else
+#	if defined(HAVE_CLOCK_GETTIME) && defined(CLOCK_MONOTONIC)
+	struct timespec ts;
+#	endif
 	struct timeval tv;
-	int result;
-	int tleft;
-	time_t now, done;
 
-	if (sfd < 0) {
-		errno = EBADF;
+#	if defined(HAVE_CLOCK_GETTIME) && defined(CLOCK_MONOTONIC)
+	if (clock_gettime(CLOCK_MONOTONIC, &ts) == 0)
+		return (((unsigned long) ts.tv_sec * 1000UL) + ((unsigned long) ts.tv_nsec / 1000000UL));
+#	endif
+	(void) gettimeofday(&tv, NULL);
+	return (((unsigned long) tv.tv_sec * 1000UL) + ((unsigned long) tv.tv_usec / 1000UL));
+#endif
+}	/* SMonoTimeMs */
+
+
+
+
+/*
+ * Given the SMonoTimeMs() value when an operation started, and its
+ * limit "tlen" in seconds, return the milliseconds left, or zero
+ * if the time is up.
+ */
+int
+STimeLeftMs(const unsigned long startMs, const int tlen)
+{
+	unsigned long limMs, elapsedMs;
+
+	if (tlen <= 0)
 		return (0);
-	}
-	errno = 0;
+	limMs = (unsigned long) ((tlen > kMaxTimeoutSecs) ? kMaxTimeoutSecs : tlen) * 1000UL;
+	elapsedMs = SMonoTimeMs() - startMs;
+	if (elapsedMs >= limMs)
+		return (0);
+	return ((int) (limMs - elapsedMs));
+}	/* STimeLeftMs */
 
-	if (tlen < 0) {
-		forever {
-			MY_FD_ZERO(&ss);
-#if defined(__DECC) || defined(__DECCXX)
-#pragma message save
-#pragma message disable trunclongint
-#endif
-			MY_FD_SET(sfd, &ss);
-#if defined(__DECC) || defined(__DECCXX)
-#pragma message restore
-#endif
-			ss2 = ss;
-			result = select(sfd + 1, SELECT_TYPE_ARG234 &ss, NULL, SELECT_TYPE_ARG234 &ss2, NULL);
-			if (result >= 1) {
-				/* ready */
-				return (1);
-			} else if ((result < 0) && (errno != EINTR)) {
-				/* error */
-				return (0);
-			}
-			/* else try again */
-		}
-		/*NOTREACHED*/
-	} else if (tlen == 0) {
-		forever {
-			MY_FD_ZERO(&ss);
-#if defined(__DECC) || defined(__DECCXX)
-#pragma message save
-#pragma message disable trunclongint
-#endif
-			MY_FD_SET(sfd, &ss);
-#if defined(__DECC) || defined(__DECCXX)
-#pragma message restore
-#endif
-			ss2 = ss;
-			tv.tv_sec = 0;
-			tv.tv_usec = 0;
-			result = select(sfd + 1, SELECT_TYPE_ARG234 &ss, NULL, SELECT_TYPE_ARG234 &ss2, &tv);
-			if (result >= 1) {
-				/* ready */
-				return (1);
-			} else if (result == 0) {
-				/* timed-out */
-				errno = ETIMEDOUT;
-				return (0);
-			} else if ((result < 0) && (errno != EINTR)) {
-				/* error */
-				return (0);
-			}
-			/* else try again */
+
+
+
+/*
+ * Wait up to "msec" milliseconds (forever, if negative) for sfd to
+ * become readable, or writable if "forWriting" is set.  An error or
+ * hangup pending on the socket also counts as ready, since the next
+ * read or write will then return right away.
+ *
+ * Returns 1 if ready, 0 if timed-out, or -1 on error (including
+ * EINTR, which the caller may want to retry).
+ *
+ * This uses poll() where available, which unlike select() has no
+ * limit on the descriptor number and doesn't need to build and scan
+ * an fd_set each time.
+ */
+int
+SPollOne(const int sfd, const int forWriting, const int msec)
+{
+#if defined(HAVE_POLL) && defined(HAVE_POLL_H) && !((defined(WIN32) || defined(_WINDOWS)) && !defined(__CYGWIN__))
+	struct pollfd pfd;
+	int result;
+
+	pfd.fd = sfd;
+	pfd.events = (short) ((forWriting != 0) ? POLLOUT : POLLIN);
+	pfd.revents = 0;
+	result = poll(&pfd, 1, (msec < 0) ? -1 : msec);
+	if (result > 0) {
+		if ((pfd.revents & POLLNVAL) != 0) {
+			errno = EBADF;
+			return (-1);
 		}
-		/*NOTREACHED*/
+		return (1);
 	}
-	
-	time(&now);
-	done = now + tlen;
-	tleft = tlen;
+	return (result);
+#else
+	fd_set ss, ss2;
+	struct timeval tv;
+	int result;
 
-	forever {
-		MY_FD_ZERO(&ss);
+	MY_FD_ZERO(&ss);
 #if defined(__DECC) || defined(__DECCXX)
 #pragma message save
 #pragma message disable trunclongint
 #endif
-		MY_FD_SET(sfd, &ss);
+	MY_FD_SET(sfd, &ss);
 #if defined(__DECC) || defined(__DECCXX)
 #pragma message restore
 #endif
-		ss2 = ss;
-		tv.tv_sec = (tv_sec_t) tleft;
-		tv.tv_usec = 0;
-		result = select(sfd + 1, SELECT_TYPE_ARG234 &ss, NULL, SELECT_TYPE_ARG234 &ss2, &tv);
-		if (result >= 1) {
-			/* ready */
-			return (1);
-		} else if (result < 0) {
-			if (errno != EINTR) {
-				/* error */
-				break;
-			}
-			/* try again */
-			time(&now);
-			if (now > done) {
-				/* timed-out */
-				errno = ETIMEDOUT;
-				break;
-			}
-			tleft = (int) (done - now);
-		} else {
-			/* timed-out */
-			errno = ETIMEDOUT;
-			break;
-		}
+	ss2 = ss;
+	if (msec < 0) {
+		if (forWriting != 0)
+			result = select(sfd + 1, NULL, SELECT_TYPE_ARG234 &ss, SELECT_TYPE_ARG234 &ss2, NULL);
+		else
+			result = select(sfd + 1, SELECT_TYPE_ARG234 &ss, NULL, SELECT_TYPE_ARG234 &ss2, NULL);
+	} else {
+		tv.tv_sec = (tv_sec_t) (msec / 1000);
+		tv.tv_usec = (tv_usec_t) ((msec % 1000) * 1000);
+		if (forWriting != 0)
+			result = select(sfd + 1, NULL, SELECT_TYPE_ARG234 &ss, SELECT_TYPE_ARG234 &ss2, SELECT_TYPE_ARG5 &tv);
+		else
+			result = select(sfd + 1, SELECT_TYPE_ARG234 &ss, NULL, SELECT_TYPE_ARG234 &ss2, SELECT_TYPE_ARG5 &tv);
 	}
-
-	return (0);
-}	/* SWaitUntilReadyForReading */
+	return ((result > 0) ? 1 : result);
+#endif
+}	/* SPollOne */
 
 
 
 
-/* 
- * Return zero if the operation timed-out or erred-out, otherwise non-zero.
- */
-int
-SWaitUntilReadyForWriting(const int sfd, const int tlen)
+static int
+SWaitUntilReady(const int sfd, const int forWriting, const int tlen)
 {
-	fd_set ss, ss2;
-	struct timeval tv;
 	int result;
-	int tleft;
-	time_t now, done;
+	int msleft;
+	unsigned long startMs;
 
 	if (sfd < 0) {
 		errno = EBADF;
@@ -142,17 +141,7 @@ SWaitUntilReadyForWriting(const int sfd, const int tlen)
 
 	if (tlen < 0) {
 		forever {
-			MY_FD_ZERO(&ss);
-#if defined(__DECC) || defined(__DECCXX)
-#pragma message save
-#pragma message disable trunclongint
-#endif
-			MY_FD_SET(sfd, &ss);
-#if defined(__DECC) || defined(__DECCXX)
-#pragma message restore
-#endif
-			ss2 = ss;
-			result = select(sfd + 1, NULL, SELECT_TYPE_ARG234 &ss, SELECT_TYPE_ARG234 &ss2, NULL);
+			result = SPollOne(sfd, forWriting, -1);
 			if (result >= 1) {
 				/* ready */
 				return (1);
@@ -163,55 +152,13 @@ SWaitUntilReadyForWriting(const int sfd, const int tlen)
 			/* else try again */
 		}
 		/*NOTREACHED*/
-	} else if (tlen == 0) {
-		forever {
-			MY_FD_ZERO(&ss);
-#if defined(__DECC) || defined(__DECCXX)
-#pragma message save
-#pragma message disable trunclongint
-#endif
-			MY_FD_SET(sfd, &ss);
-#if defined(__DECC) || defined(__DECCXX)
-#pragma message restore
-#endif
-			ss2 = ss;
-			tv.tv_sec = 0;
-			tv.tv_usec = 0;
-			result = select(sfd + 1, NULL, SELECT_TYPE_ARG234 &ss, SELECT_TYPE_ARG234 &ss2, &tv);
-			if (result >= 1) {
-				/* ready */
-				return (1);
-			} else if (result == 0) {
-				/* timed-out */
-				errno = ETIMEDOUT;
-				return (0);
-			} else if ((result < 0) && (errno != EINTR)) {
-				/* error */
-				return (0);
-			}
-			/* else try again */
-		}
-		/*NOTREACHED*/
 	}
 
-	time(&now);
-	done = now + tlen;
-	tleft = tlen;
+	startMs = SMonoTimeMs();
+	msleft = (tlen == 0) ? 0 : STimeLeftMs(startMs, tlen);
 
 	forever {
-		MY_FD_ZERO(&ss);
-#if defined(__DECC) || defined(__DECCXX)
-#pragma message save
-#pragma message disable trunclongint
-#endif
-		MY_FD_SET(sfd, &ss);
-#if defined(__DECC) || defined(__DECCXX)
-#pragma message restore
-#endif
-		ss2 = ss;
-		tv.tv_sec = (tv_sec_t) tleft;
-		tv.tv_usec = 0;
-		result = select(sfd + 1, NULL, SELECT_TYPE_ARG234 &ss, SELECT_TYPE_ARG234 &ss2, &tv);
+		result = SPollOne(sfd, forWriting, msleft);
 		if (result >= 1) {
 			/* ready */
 			return (1);
@@ -221,13 +168,14 @@ SWaitUntilReadyForWriting(const int sfd, const int tlen)
 				break;
 			}
 			/* try again */
-			time(&now);
-			if (now > done) {
+			if (tlen == 0)
+				continue;
+			msleft = STimeLeftMs(startMs, tlen);
+			if (msleft <= 0) {
 				/* timed-out */
 				errno = ETIMEDOUT;
 				break;
 			}
-			tleft = (int) (done - now);
 		} else {
 			/* timed-out */
 			errno = ETIMEDOUT;
@@ -236,4 +184,28 @@ SWaitUntilReadyForWriting(const int sfd, const int tlen)
 	}
 
 	return (0);
+}	/* SWaitUntilReady */
+
+
+
+
+/*
+ * Return zero if the operation timed-out or erred-out, otherwise non-zero.
+ */
+int
+SWaitUntilReadyForReading(const int sfd, const int tlen)
+{
+	return (SWaitUntilReady(sfd, 0, tlen));
+}	/* SWaitUntilReadyForReading */
+
+
+
+
+/*
+ * Return zero if the operation timed-out or erred-out, otherwise non-zero.
+ */
+int
+SWaitUntilReadyForWriting(const int sfd, const int tlen)
+{
+	return (SWaitUntilReady(sfd, 1, tlen));
 }	/* SWaitUntilReadyForWriting */
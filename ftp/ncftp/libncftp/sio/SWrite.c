@@ -9,10 +9,8 @@ SWrite(int sfd, const char *const buf0, size_t size, int tlen, int swopts)
 	const char *buf = buf0;
 	write_return_t nwrote;
 	write_size_t nleft;
-	int tleft;
-	time_t done, now;
-	fd_set ss;
-	struct timeval tv;
+	int msleft;
+	unsigned long startMs;
 	int result, firstSelect;
 	DECL_SIGPIPE_VARS
 	
@@ -24,13 +22,12 @@ SWrite(int sfd, const char *const buf0, size_t size, int tlen, int swopts)
 	IGNORE_SIGPIPE
 
 	nleft = (write_size_t) size;
-	time(&now);
-	done = now + tlen;
+	startMs = SMonoTimeMs();
+	msleft = STimeLeftMs(startMs, tlen);
 	firstSelect = 1;
 
 	forever {
-		tleft = (done > now) ? ((int) (done - now)) : 0;
-		if (tleft < 1) {
+		if (msleft <= 0) {
 			nwrote = (write_return_t) size - (write_return_t) nleft;
 			if (nwrote == 0) {
 				nwrote = kTimeoutErr;
@@ -50,18 +47,7 @@ SWrite(int sfd, const char *const buf0, size_t size, int tlen, int swopts)
 		if (!firstSelect || ((swopts & kNoFirstSelect) == 0)) {
 			forever {
 				errno = 0;
-				MY_FD_ZERO(&ss);
-#if defined(__DECC) || defined(__DECCXX)
-#pragma message save
-#pragma message disable trunclongint
-#endif
-				MY_FD_SET(sfd, &ss);
-#if defined(__DECC) || defined(__DECCXX)
-#pragma message restore
-#endif
-				tv.tv_sec = (tv_sec_t) tlen;
-				tv.tv_usec = 0;
-				result = select(sfd + 1, NULL, SELECT_TYPE_ARG234 &ss, NULL, SELECT_TYPE_ARG5 &tv);
+				result = SPollOne(sfd, 1, msleft);
 				if (result >= 1) {
 					/* ready */
 					break;
@@ -80,6 +66,7 @@ SWrite(int sfd, const char *const buf0, size_t size, int tlen, int swopts)
 					RESTORE_SIGPIPE
 					return (-1);
 				}
+				msleft = STimeLeftMs(startMs, tlen);
 			}
 			firstSelect = 0;
 		}
@@ -106,7 +93,7 @@ SWrite(int sfd, const char *const buf0, size_t size, int tlen, int swopts)
 		if (nleft == 0)
 			break;
 		buf += nwrote;
-		time(&now);
+		msleft = STimeLeftMs(startMs, tlen);
 	}
 	nwrote = (write_return_t) size - (write_return_t) nleft;
 
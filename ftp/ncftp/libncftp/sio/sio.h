@@ -213,6 +213,9 @@ int SClose(int, int);
 
 /* SConnect.c */
 int SConnect(int, const struct sockaddr_in *const, int);
+int SConnectStart(const int sfd, const struct sockaddr_in *const addr);
+int SConnectFinish(const int sfd);
+int SSetNonBlocking(const int sfd, const int onoff);
 
 /* SConnectByName.c */
 int SConnectByName(int, const char *const, const int);
@@ -264,6 +267,9 @@ int SSendtoByName(int, const char *const, size_t, int, const char *const, int);
 int SendtoByName(int, const char *const, size_t, const char *const);
 
 /* SWait.c */
+unsigned long SMonoTimeMs(void);
+int STimeLeftMs(const unsigned long startMs, const int tlen);
+int SPollOne(const int sfd, const int forWriting, const int msec);
 int SWaitUntilReadyForReading(const int sfd, const int tlen);
 int SWaitUntilReadyForWriting(const int sfd, const int tlen);
 
@@ -137,6 +137,9 @@
 #	ifdef CAN_USE_SYS_SELECT_H
 #		include <sys/select.h>
 #	endif
+#	ifdef HAVE_POLL_H
+#		include <poll.h>
+#	endif
 #	define MY_FD_ZERO FD_ZERO
 #	define MY_FD_SET FD_SET
 #	define MY_FD_CLR FD_CLR
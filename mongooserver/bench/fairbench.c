@@ -0,0 +1,269 @@
+/**
+ * @file fairbench.c
+ *
+ * @brief
+ *  Measures how long small requests take while bulk downloads run through
+ *  the bandwidth limits (-l of mongooserver), and how evenly the bulk
+ *  downloads share the limit.
+ *
+ *  An in-process server is started on 127.0.0.1 with a document root in a
+ *  temporary directory holding a big file and a small one. The small file
+ *  is fetched over and over on fresh connections, first with nothing else
+ *  running (idle), then while the bulk clients download the big file in a
+ *  loop. Latency percentiles are printed for both phases, with each bulk
+ *  client's rate and Jain's fairness index (1.0 = perfectly even).
+ *
+ * @note
+ *  Build on Linux with "make" in this directory.
+ *  fairbench [-l limits] [-c bulk clients] [-t seconds] [-p port]
+ *  e.g. fairbench -l '*=8m' -c 4 -t 5
+ *       fairbench -l - -c 4 -t 5        (no limits)
+ */
+
+#include "../mongoose.h"
+
+#include <pthread.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <arpa/inet.h>
+
+#define BIG_FILE_SIZE ( 64 * 1024 * 1024 )
+#define SMALL_FILE_SIZE 512
+#define MAX_BULK 64
+#define MAX_SAMPLES 100000
+#define SMALL_INTERVAL_US 10000 /* pause between small requests */
+
+static struct mg_serve_http_opts s_opts;
+static volatile int s_server_stop = 0;
+static volatile int s_bulk_stop = 0;
+static volatile int s_counting = 0;
+static int s_port = 8890;
+
+typedef struct {
+    pthread_t tid;
+    volatile long long bytes; /* received while s_counting is set */
+} bulk_client;
+
+static double now_us ( void )
+{
+    struct timespec ts;
+    clock_gettime ( CLOCK_MONOTONIC, &ts );
+    return ts.tv_sec * 1e6 + ts.tv_nsec / 1e3;
+}
+
+static void ev_handler ( struct mg_connection *nc, int ev, void *ev_data )
+{
+    if ( ev == MG_EV_HTTP_REQUEST ) {
+        mg_serve_http ( nc, ( struct http_message * ) ev_data, s_opts );
+    }
+}
+
+static void *server_thread ( void *arg )
+{
+    struct mg_mgr *mgr = ( struct mg_mgr * ) arg;
+
+    while ( !s_server_stop ) {
+        mg_mgr_poll ( mgr, 50 );
+    }
+    return NULL;
+}
+
+static int connect_server ( void )
+{
+    struct sockaddr_in sin;
+    int one = 1;
+    int fd = socket ( AF_INET, SOCK_STREAM, 0 );
+
+    if ( fd < 0 ) {
+        return -1;
+    }
+    memset ( &sin, 0, sizeof ( sin ) );
+    sin.sin_family = AF_INET;
+    sin.sin_port = htons ( ( unsigned short ) s_port );
+    sin.sin_addr.s_addr = htonl ( INADDR_LOOPBACK );
+    if ( connect ( fd, ( struct sockaddr * ) &sin, sizeof ( sin ) ) != 0 ) {
+        close ( fd );
+        return -1;
+    }
+    setsockopt ( fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof ( one ) );
+    return fd;
+}
+
+/* GETs uri on a new connection and reads the response until the server
+ * closes it. Returns the number of bytes read, -1 on error. */
+static long long fetch ( const char *uri, bulk_client *bc )
+{
+    char buf[65536];
+    long long total = 0;
+    int fd, n;
+
+    if ( ( fd = connect_server() ) < 0 ) {
+        return -1;
+    }
+    n = snprintf ( buf, sizeof ( buf ), "GET %s HTTP/1.1\r\nHost: 127.0.0.1\r\n"
+                   "Connection: close\r\n\r\n", uri );
+    if ( send ( fd, buf, n, 0 ) != n ) {
+        close ( fd );
+        return -1;
+    }
+    while ( ( n = recv ( fd, buf, sizeof ( buf ), 0 ) ) > 0 ) {
+        total += n;
+        if ( bc != NULL && s_counting ) {
+            bc->bytes += n;
+        }
+        if ( bc != NULL && s_bulk_stop ) {
+            break;
+        }
+    }
+    close ( fd );
+    return n < 0 ? -1 : total;
+}
+
+static void *bulk_thread ( void *arg )
+{
+    bulk_client *bc = ( bulk_client * ) arg;
+
+    while ( !s_bulk_stop ) {
+        if ( fetch ( "/big.bin", bc ) < 0 ) {
+            usleep ( 10000 );
+        }
+    }
+    return NULL;
+}
+
+static int cmp_double ( const void *a, const void *b )
+{
+    double x = * ( const double * ) a, y = * ( const double * ) b;
+    return x < y ? -1 : x > y;
+}
+
+/* Fetches the small file for the given time and prints the latencies. */
+static void measure_small ( const char *label, int seconds, double *samples )
+{
+    double end = now_us() + seconds * 1e6, t0;
+    int n = 0, errors = 0;
+
+    while ( now_us() < end && n < MAX_SAMPLES ) {
+        t0 = now_us();
+        if ( fetch ( "/small.txt", NULL ) < SMALL_FILE_SIZE ) {
+            errors++;
+        } else {
+            samples[n++] = ( now_us() - t0 ) / 1000.0;
+        }
+        usleep ( SMALL_INTERVAL_US );
+    }
+    if ( n == 0 ) {
+        printf ( "%-6s no small request completed (%d errors)\n", label, errors );
+        return;
+    }
+    qsort ( samples, n, sizeof ( samples[0] ), cmp_double );
+    printf ( "%-6s %5d small requests, ms: p50 %7.2f  p90 %7.2f  p99 %7.2f  max %7.2f  (%d errors)\n",
+             label, n, samples[n / 2], samples[n * 9 / 10], samples[n * 99 / 100],
+             samples[n - 1], errors );
+}
+
+static int write_file ( const char *path, size_t size )
+{
+    char buf[65536];
+    size_t i, n;
+    FILE *fp = fopen ( path, "wb" );
+
+    if ( fp == NULL ) {
+        return -1;
+    }
+    for ( i = 0; i < sizeof ( buf ); i++ ) {
+        buf[i] = 'a' + i % 26;
+    }
+    for ( i = 0; i < size; i += n ) {
+        n = size - i < sizeof ( buf ) ? size - i : sizeof ( buf );
+        fwrite ( buf, 1, n, fp );
+    }
+    return fclose ( fp );
+}
+
+int main ( int argc, char *argv[] )
+{
+    static bulk_client bulk[MAX_BULK];
+    static double samples[MAX_SAMPLES];
+    char root[] = "/tmp/fairbenchXXXXXX", path[256], addr[32];
+    const char *limits = "*=8m";
+    int nbulk = 4, seconds = 5, i;
+    double sum = 0, sumsq = 0, rate;
+    struct mg_mgr mgr;
+    struct mg_connection *nc;
+    pthread_t server;
+
+    for ( i = 1; i < argc - 1; i++ ) {
+        if ( strcmp ( argv[i], "-l" ) == 0 ) {
+            limits = argv[++i];
+        } else if ( strcmp ( argv[i], "-c" ) == 0 ) {
+            nbulk = atoi ( argv[++i] );
+        } else if ( strcmp ( argv[i], "-t" ) == 0 ) {
+            seconds = atoi ( argv[++i] );
+        } else if ( strcmp ( argv[i], "-p" ) == 0 ) {
+            s_port = atoi ( argv[++i] );
+        }
+    }
+    if ( nbulk < 1 || nbulk > MAX_BULK || seconds < 1 ) {
+        fprintf ( stderr, "usage: %s [-l limits|-] [-c 1-%d] [-t seconds] [-p port]\n",
+                  argv[0], MAX_BULK );
+        return EXIT_FAILURE;
+    }
+
+    if ( mkdtemp ( root ) == NULL ) {
+        perror ( "mkdtemp" );
+        return EXIT_FAILURE;
+    }
+    snprintf ( path, sizeof ( path ), "%s/big.bin", root );
+    write_file ( path, BIG_FILE_SIZE );
+    snprintf ( path, sizeof ( path ), "%s/small.txt", root );
+    write_file ( path, SMALL_FILE_SIZE );
+
+    s_opts.document_root = root;
+    s_opts.rate_limit = strcmp ( limits, "-" ) == 0 ? NULL : limits;
+
+    mg_mgr_init ( &mgr, NULL );
+    snprintf ( addr, sizeof ( addr ), "127.0.0.1:%d", s_port );
+    if ( ( nc = mg_bind ( &mgr, addr, ev_handler ) ) == NULL ) {
+        fprintf ( stderr, "mg_bind(%s) failed\n", addr );
+        return EXIT_FAILURE;
+    }
+    mg_set_protocol_http_websocket ( nc );
+    pthread_create ( &server, NULL, server_thread, &mgr );
+
+    printf ( "limits: %s, %d bulk clients, %d s per phase\n",
+             s_opts.rate_limit != NULL ? s_opts.rate_limit : "none", nbulk, seconds );
+    measure_small ( "idle", seconds, samples );
+
+    for ( i = 0; i < nbulk; i++ ) {
+        pthread_create ( &bulk[i].tid, NULL, bulk_thread, &bulk[i] );
+    }
+    sleep ( 1 ); /* let the buckets settle */
+    s_counting = 1;
+    measure_small ( "bulk", seconds, samples );
+    s_counting = 0;
+    s_bulk_stop = 1;
+    for ( i = 0; i < nbulk; i++ ) {
+        pthread_join ( bulk[i].tid, NULL );
+    }
+
+    printf ( "bulk rates, MB/s:" );
+    for ( i = 0; i < nbulk; i++ ) {
+        rate = bulk[i].bytes / ( 1024.0 * 1024.0 ) / seconds;
+        sum += rate;
+        sumsq += rate * rate;
+        printf ( " %.2f", rate );
+    }
+    printf ( "\ntotal %.2f MB/s, Jain's fairness index %.3f\n", sum,
+             sumsq > 0 ? sum * sum / ( nbulk * sumsq ) : 0.0 );
+
+    s_server_stop = 1;
+    pthread_join ( server, NULL );
+    mg_mgr_free ( &mgr );
+    snprintf ( path, sizeof ( path ), "%s/big.bin", root );
+    unlink ( path );
+    snprintf ( path, sizeof ( path ), "%s/small.txt", root );
+    unlink ( path );
+    rmdir ( root );
+    return EXIT_SUCCESS;
+}
@@ -0,0 +1,301 @@
+/**
+ * @file proxybench.c
+ *
+ * @brief
+ *  Measures requests per second and latency of small GETs sent straight
+ *  to a server and through the reverse proxy (-x of mongooserver).
+ *
+ *  Two in-process servers are started on 127.0.0.1, each polled by its own
+ *  thread: the upstream serves a small file from a temporary directory, the
+ *  proxy forwards "/" to the upstream. Client threads send GETs over
+ *  keep-alive connections (or a new connection per request with -n) for the
+ *  given time, first to the upstream, then to the proxy. The request rate
+ *  and latency percentiles are printed for both.
+ *
+ * @note
+ *  Build on Linux with "make" in this directory.
+ *  proxybench [-c clients] [-t seconds] [-p port] [-n]
+ *  e.g. proxybench -c 4 -t 5
+ *       proxybench -c 4 -t 5 -n     (Connection: close)
+ */
+
+#include "../mongoose.h"
+
+#include <pthread.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <arpa/inet.h>
+
+#define SMALL_FILE_SIZE 512
+#define MAX_CLIENTS 64
+#define MAX_SAMPLES 200000 /* per client */
+
+static struct mg_serve_http_opts s_opts;
+static volatile int s_server_stop = 0;
+static volatile int s_client_stop = 0;
+static int s_port = 8892;
+static int s_close = 0;
+
+typedef struct {
+    pthread_t tid;
+    int port;
+    int n;           /* latency samples kept */
+    long total;      /* requests completed */
+    int errors;
+    double *samples; /* ms */
+} client;
+
+static double now_us ( void )
+{
+    struct timespec ts;
+    clock_gettime ( CLOCK_MONOTONIC, &ts );
+    return ts.tv_sec * 1e6 + ts.tv_nsec / 1e3;
+}
+
+static void ev_handler ( struct mg_connection *nc, int ev, void *ev_data )
+{
+    if ( ev == MG_EV_HTTP_REQUEST ) {
+        mg_serve_http ( nc, ( struct http_message * ) ev_data, s_opts );
+    }
+}
+
+static void *server_thread ( void *arg )
+{
+    struct mg_mgr *mgr = ( struct mg_mgr * ) arg;
+
+    while ( !s_server_stop ) {
+        mg_mgr_poll ( mgr, 50 );
+    }
+    return NULL;
+}
+
+static int connect_server ( int port )
+{
+    struct sockaddr_in sin;
+    int one = 1;
+    int fd = socket ( AF_INET, SOCK_STREAM, 0 );
+
+    if ( fd < 0 ) {
+        return -1;
+    }
+    memset ( &sin, 0, sizeof ( sin ) );
+    sin.sin_family = AF_INET;
+    sin.sin_port = htons ( ( unsigned short ) port );
+    sin.sin_addr.s_addr = htonl ( INADDR_LOOPBACK );
+    if ( connect ( fd, ( struct sockaddr * ) &sin, sizeof ( sin ) ) != 0 ) {
+        close ( fd );
+        return -1;
+    }
+    setsockopt ( fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof ( one ) );
+    return fd;
+}
+
+/* Sends one GET on fd and reads the response, headers and Content-Length
+ * bytes of body. Returns 0 if the response was complete. */
+static int request ( int fd )
+{
+    static const char keep[] = "GET /small.txt HTTP/1.1\r\nHost: 127.0.0.1\r\n\r\n";
+    static const char cls[] = "GET /small.txt HTTP/1.1\r\nHost: 127.0.0.1\r\n"
+                              "Connection: close\r\n\r\n";
+    const char *req = s_close ? cls : keep;
+    int reqlen = s_close ? sizeof ( cls ) - 1 : sizeof ( keep ) - 1;
+    char buf[4096], *p;
+    int len = 0, n, hlen = -1, clen = -1;
+
+    if ( send ( fd, req, reqlen, 0 ) != reqlen ) {
+        return -1;
+    }
+    while ( hlen < 0 || len < hlen + clen ) {
+        if ( len == sizeof ( buf ) - 1 ) {
+            return -1;
+        }
+        if ( ( n = recv ( fd, buf + len, sizeof ( buf ) - 1 - len, 0 ) ) <= 0 ) {
+            return -1;
+        }
+        len += n;
+        buf[len] = '\0';
+        if ( hlen < 0 && ( p = strstr ( buf, "\r\n\r\n" ) ) != NULL ) {
+            hlen = ( int ) ( p - buf ) + 4;
+            if ( ( p = strcasestr ( buf, "\r\nContent-Length:" ) ) == NULL ||
+                 p > buf + hlen ) {
+                return -1;
+            }
+            clen = atoi ( p + 17 );
+        }
+    }
+    return strncmp ( buf, "HTTP/1.1 200", 12 ) == 0 ? 0 : -1;
+}
+
+static void *client_thread ( void *arg )
+{
+    client *c = ( client * ) arg;
+    double t0;
+    int fd = -1;
+
+    while ( !s_client_stop ) {
+        t0 = now_us();
+        if ( fd < 0 && ( fd = connect_server ( c->port ) ) < 0 ) {
+            c->errors++;
+            usleep ( 10000 );
+            continue;
+        }
+        if ( request ( fd ) != 0 ) {
+            c->errors++;
+            close ( fd );
+            fd = -1;
+            continue;
+        }
+        if ( c->n < MAX_SAMPLES ) {
+            c->samples[c->n++] = ( now_us() - t0 ) / 1000.0;
+        }
+        c->total++;
+        if ( s_close ) {
+            close ( fd );
+            fd = -1;
+        }
+    }
+    if ( fd >= 0 ) {
+        close ( fd );
+    }
+    return NULL;
+}
+
+static int cmp_double ( const void *a, const void *b )
+{
+    double x = * ( const double * ) a, y = * ( const double * ) b;
+    return x < y ? -1 : x > y;
+}
+
+/* Runs the clients against port for the given time and prints the results. */
+static void measure ( const char *label, int port, int nclients, int seconds,
+                      client *clients, double *all )
+{
+    double t0, elapsed;
+    int i, n = 0, errors = 0;
+    long total = 0;
+
+    s_client_stop = 0;
+    for ( i = 0; i < nclients; i++ ) {
+        clients[i].port = port;
+        clients[i].n = clients[i].errors = 0;
+        clients[i].total = 0;
+        pthread_create ( &clients[i].tid, NULL, client_thread, &clients[i] );
+    }
+    t0 = now_us();
+    sleep ( seconds );
+    s_client_stop = 1;
+    for ( i = 0; i < nclients; i++ ) {
+        pthread_join ( clients[i].tid, NULL );
+    }
+    elapsed = ( now_us() - t0 ) / 1e6;
+
+    for ( i = 0; i < nclients; i++ ) {
+        memcpy ( all + n, clients[i].samples, clients[i].n * sizeof ( all[0] ) );
+        n += clients[i].n;
+        total += clients[i].total;
+        errors += clients[i].errors;
+    }
+    if ( n == 0 ) {
+        printf ( "%-6s no request completed (%d errors)\n", label, errors );
+        return;
+    }
+    qsort ( all, n, sizeof ( all[0] ), cmp_double );
+    printf ( "%-6s %8.0f req/s, ms: p50 %6.3f  p90 %6.3f  p99 %6.3f  max %7.3f  (%d errors)\n",
+             label, total / elapsed, all[n / 2], all[n * 9 / 10], all[n * 99 / 100],
+             all[n - 1], errors );
+}
+
+static int write_file ( const char *path, size_t size )
+{
+    FILE *fp = fopen ( path, "wb" );
+    size_t i;
+
+    if ( fp == NULL ) {
+        return -1;
+    }
+    for ( i = 0; i < size; i++ ) {
+        fputc ( 'a' + i % 26, fp );
+    }
+    return fclose ( fp );
+}
+
+int main ( int argc, char *argv[] )
+{
+    static client clients[MAX_CLIENTS];
+    char root[] = "/tmp/proxybenchXXXXXX", path[256], addr[32], upstream[64];
+    int nclients = 4, seconds = 5, i;
+    struct mg_mgr up_mgr, px_mgr;
+    struct mg_connection *nc;
+    pthread_t up_thread, px_thread;
+    double *all;
+
+    for ( i = 1; i < argc; i++ ) {
+        if ( strcmp ( argv[i], "-n" ) == 0 ) {
+            s_close = 1;
+        } else if ( i + 1 >= argc ) {
+            break;
+        } else if ( strcmp ( argv[i], "-c" ) == 0 ) {
+            nclients = atoi ( argv[++i] );
+        } else if ( strcmp ( argv[i], "-t" ) == 0 ) {
+            seconds = atoi ( argv[++i] );
+        } else if ( strcmp ( argv[i], "-p" ) == 0 ) {
+            s_port = atoi ( argv[++i] );
+        }
+    }
+    if ( nclients < 1 || nclients > MAX_CLIENTS || seconds < 1 ) {
+        fprintf ( stderr, "usage: %s [-c 1-%d] [-t seconds] [-p port] [-n]\n",
+                  argv[0], MAX_CLIENTS );
+        return EXIT_FAILURE;
+    }
+    for ( i = 0; i < nclients; i++ ) {
+        clients[i].samples = ( double * ) malloc ( MAX_SAMPLES * sizeof ( double ) );
+    }
+    all = ( double * ) malloc ( ( size_t ) nclients * MAX_SAMPLES * sizeof ( double ) );
+
+    if ( mkdtemp ( root ) == NULL ) {
+        perror ( "mkdtemp" );
+        return EXIT_FAILURE;
+    }
+    snprintf ( path, sizeof ( path ), "%s/small.txt", root );
+    write_file ( path, SMALL_FILE_SIZE );
+    s_opts.document_root = root;
+
+    mg_mgr_init ( &up_mgr, NULL );
+    snprintf ( addr, sizeof ( addr ), "127.0.0.1:%d", s_port );
+    if ( ( nc = mg_bind ( &up_mgr, addr, ev_handler ) ) == NULL ) {
+        fprintf ( stderr, "mg_bind(%s) failed\n", addr );
+        return EXIT_FAILURE;
+    }
+    mg_set_protocol_http_websocket ( nc );
+
+    mg_mgr_init ( &px_mgr, NULL );
+    snprintf ( addr, sizeof ( addr ), "127.0.0.1:%d", s_port + 1 );
+    if ( ( nc = mg_bind ( &px_mgr, addr, ev_handler ) ) == NULL ) {
+        fprintf ( stderr, "mg_bind(%s) failed\n", addr );
+        return EXIT_FAILURE;
+    }
+    mg_set_protocol_http_websocket ( nc );
+    snprintf ( upstream, sizeof ( upstream ), "http://127.0.0.1:%d", s_port );
+    mg_register_http_proxy ( nc, "/", upstream );
+
+    pthread_create ( &up_thread, NULL, server_thread, &up_mgr );
+    pthread_create ( &px_thread, NULL, server_thread, &px_mgr );
+
+    printf ( "%d clients, %s, %d s per target\n", nclients,
+             s_close ? "connection per request" : "keep-alive", seconds );
+    measure ( "direct", s_port, nclients, seconds, clients, all );
+    measure ( "proxy", s_port + 1, nclients, seconds, clients, all );
+
+    s_server_stop = 1;
+    pthread_join ( up_thread, NULL );
+    pthread_join ( px_thread, NULL );
+    mg_mgr_free ( &px_mgr );
+    mg_mgr_free ( &up_mgr );
+    unlink ( path );
+    rmdir ( root );
+    for ( i = 0; i < nclients; i++ ) {
+        free ( clients[i].samples );
+    }
+    free ( all );
+    return EXIT_SUCCESS;
+}
@@ -64,8 +64,9 @@ MG_INTERNAL struct mg_connection *mg_do_connect(struct mg_connection *nc,
                                                 int proto,
                                                 union socket_address *sa);
 
-MG_INTERNAL int mg_parse_address(const char *str, union socket_address *sa,
-                                 int *proto, char *host, size_t host_len);
+MG_INTERNAL int mg_parse_address(struct mg_mgr *mgr, const char *str,
+                                 union socket_address *sa, int *proto,
+                                 char *host, size_t host_len);
 MG_INTERNAL void mg_call(struct mg_connection *nc,
                          mg_event_handler_t ev_handler, int ev, void *ev_data);
 void mg_forward(struct mg_connection *from, struct mg_connection *to);
@@ -105,6 +106,64 @@ MG_INTERNAL time_t mg_parse_date_string(const char *datetime);
 MG_INTERNAL int mg_is_not_modified(struct http_message *hm, cs_stat_t *st);
 #endif
 
+#if !defined(MG_DISABLE_HTTP) && !defined(MG_DISABLE_FILESYSTEM) && \
+    !defined(MG_DISABLE_DIRECTORY_LISTING)
+/* Free directory listing indexes cached on the manager. */
+MG_INTERNAL void mg_http_free_dir_cache(struct mg_mgr *mgr);
+#endif
+
+#ifndef MG_DISABLE_HTTP
+/*
+ * Keeps a closing HTTP client connection open in the manager's pool if it is
+ * reusable. Returns 1 if it was pooled, 0 if it should be closed.
+ */
+MG_INTERNAL int mg_http_pool_park(struct mg_connection *nc);
+#endif
+
+#if !defined(MG_DISABLE_HTTP) && !defined(MG_DISABLE_HTTP_METRICS)
+/* Free HTTP metrics gathered on the manager. */
+MG_INTERNAL void mg_http_free_metrics(struct mg_mgr *mgr);
+#endif
+
+/*
+ * Returns how many of `len` bytes the connection's buckets allow sending at
+ * time `now`. If that's 0, the connection is flagged MG_F_THROTTLED until
+ * `throttle_time`.
+ */
+MG_INTERNAL size_t mg_bucket_allowance(struct mg_connection *nc, size_t len,
+                                       double now);
+/* Takes `n` sent bytes out of the connection's buckets. */
+MG_INTERNAL void mg_bucket_consume(struct mg_connection *nc, size_t n);
+
+#ifndef MG_DISABLE_RESOLVER
+/*
+ * Looks `name` up in the manager's DNS cache. Returns 1 and fills the address
+ * of `sa` if an answer is cached, -1 if the name is cached as nonexistent and
+ * 0 if a query has to be sent.
+ */
+MG_INTERNAL int mg_resolve_from_cache(struct mg_mgr *mgr, const char *name,
+                                      union socket_address *sa);
+/*
+ * Resolves `name` for mg_connect(): A record first, then AAAA with IPv6.
+ * `cb` is always called from mg_mgr_poll(), never from this function.
+ * `*waiter` identifies the lookup for mg_resolve_set_timer().
+ */
+MG_INTERNAL int mg_resolve_for_connect(struct mg_mgr *mgr, const char *name,
+                                       mg_resolve_callback_t cb, void *data,
+                                       void **waiter);
+/* Fails the lookup with MG_RESOLVE_TIMEOUT at `timestamp`, 0 disarms. */
+MG_INTERNAL void mg_resolve_set_timer(void *waiter, double timestamp);
+/*
+ * Delivers cached answers queued since the last poll and expires lookup
+ * timers. Returns when the next lookup timer is due, 0 if none is armed.
+ */
+MG_INTERNAL double mg_resolve_poll(struct mg_mgr *mgr);
+MG_INTERNAL void mg_resolve_free_cache(struct mg_mgr *mgr);
+/* Looks `name` up in the manager's copy of the hosts file. */
+MG_INTERNAL int mg_resolve_from_hosts(struct mg_mgr *mgr, const char *name,
+                                      union socket_address *usa);
+#endif
+
 struct ctl_msg {
   mg_event_handler_t callback;
   char message[MG_CTL_MSG_MESSAGE_SIZE];
@@ -1683,7 +1742,8 @@ const char *c_strnstr(const char *s, const char *find, size_t slen) {
 /* Which flags can be pre-set by the user at connection creation time. */
 #define _MG_ALLOWED_CONNECT_FLAGS_MASK                                   \
   (MG_F_USER_1 | MG_F_USER_2 | MG_F_USER_3 | MG_F_USER_4 | MG_F_USER_5 | \
-   MG_F_USER_6 | MG_F_WEBSOCKET_NO_DEFRAG | MG_F_ENABLE_BROADCAST)
+   MG_F_USER_6 | MG_F_WEBSOCKET_NO_DEFRAG | MG_F_ENABLE_BROADCAST |      \
+   MG_F_HTTP_POOL)
 /* Which flags should be modifiable by user's callbacks. */
 #define _MG_CALLBACK_MODIFIABLE_FLAGS_MASK                               \
   (MG_F_USER_1 | MG_F_USER_2 | MG_F_USER_3 | MG_F_USER_4 | MG_F_USER_5 | \
@@ -1762,6 +1822,10 @@ MG_INTERNAL void mg_call(struct mg_connection *nc,
 }
 
 void mg_if_timer(struct mg_connection *c, double now) {
+  /* Buckets have refilled, let the connection be polled for writing */
+  if ((c->flags & MG_F_THROTTLED) && now >= c->throttle_time) {
+    c->flags &= ~MG_F_THROTTLED;
+  }
   if (c->ev_timer_time > 0 && now >= c->ev_timer_time) {
     double old_value = c->ev_timer_time;
     mg_call(c, NULL, MG_EV_TIMER, &now);
@@ -1782,7 +1846,11 @@ void mg_if_poll(struct mg_connection *nc, time_t now) {
 }
 
 static void mg_destroy_conn(struct mg_connection *conn, int destroy_if) {
+  int i;
   if (destroy_if) mg_if_destroy_conn(conn);
+  for (i = 0; i < MG_MAX_CONN_BUCKETS; i++) {
+    mg_set_bucket(conn, i, NULL);
+  }
   if (conn->proto_data != NULL && conn->proto_data_destructor != NULL) {
     conn->proto_data_destructor(conn->proto_data);
   }
@@ -1799,6 +1867,9 @@ static void mg_destroy_conn(struct mg_connection *conn, int destroy_if) {
 
 void mg_close_conn(struct mg_connection *conn) {
   DBG(("%p %lu %d", conn, conn->flags, conn->sock));
+#ifndef MG_DISABLE_HTTP
+  if (mg_http_pool_park(conn)) return;
+#endif
   mg_remove_conn(conn);
   mg_if_destroy_conn(conn);
   mg_call(conn, NULL, MG_EV_CLOSE, NULL);
@@ -1865,10 +1936,11 @@ enum v7_err mg_enable_javascript(struct mg_mgr *m, struct v7 *v7,
 #endif
 
 void mg_mgr_free(struct mg_mgr *m) {
-  struct mg_connection *conn, *tmp_conn;
+  struct mg_connection *conn;
 
   DBG(("%p", m));
   if (m == NULL) return;
+  m->closing = 1;
   /* Do one last poll, see https://github.com/cesanta/mongoose/issues/286 */
   mg_mgr_poll(m, 0);
 
@@ -1878,11 +1950,29 @@ void mg_mgr_free(struct mg_mgr *m) {
   m->ctl[0] = m->ctl[1] = INVALID_SOCKET;
 #endif
 
-  for (conn = m->active_connections; conn != NULL; conn = tmp_conn) {
-    tmp_conn = conn->next;
+  /* A pooled HTTP client stays at the head and is closed on the next pass */
+  while ((conn = m->active_connections) != NULL) {
     mg_close_conn(conn);
   }
 
+#if !defined(MG_DISABLE_HTTP) && !defined(MG_DISABLE_FILESYSTEM) && \
+    !defined(MG_DISABLE_DIRECTORY_LISTING)
+  mg_http_free_dir_cache(m);
+#endif
+#ifndef MG_DISABLE_RESOLVER
+  mg_resolve_free_cache(m);
+#endif
+#if !defined(MG_DISABLE_HTTP) && !defined(MG_DISABLE_HTTP_METRICS)
+  mg_http_free_metrics(m);
+#endif
+
+  while (m->buckets != NULL) {
+    struct mg_bucket *b = m->buckets;
+    m->buckets = b->next;
+    MG_FREE(b->name);
+    MG_FREE(b);
+  }
+
   mg_ev_mgr_free(m);
 }
 
@@ -1999,8 +2089,9 @@ MG_INTERNAL struct mg_connection *mg_create_connection(
  *    0   if HOST needs DNS lookup
  *   >0   length of the address string
  */
-MG_INTERNAL int mg_parse_address(const char *str, union socket_address *sa,
-                                 int *proto, char *host, size_t host_len) {
+MG_INTERNAL int mg_parse_address(struct mg_mgr *mgr, const char *str,
+                                 union socket_address *sa, int *proto,
+                                 char *host, size_t host_len) {
   unsigned int a, b, c, d, port = 0;
   int ch, len = 0;
 #ifdef MG_ENABLE_IPV6
@@ -2040,7 +2131,7 @@ MG_INTERNAL int mg_parse_address(const char *str, union socket_address *sa,
   } else if (strlen(str) < host_len &&
              sscanf(str, "%[^ :]:%u%n", host, &port, &len) == 2) {
     sa->sin.sin_port = htons((uint16_t) port);
-    if (mg_resolve_from_hosts_file(host, sa) != 0) {
+    if (mg_resolve_from_hosts(mgr, host, sa) != 0) {
       /*
        * if resolving from hosts file failed and the host
        * we are trying to resolve is `localhost` - we should
@@ -2433,13 +2524,23 @@ static void resolve_cb(struct mg_dns_message *msg, void *data,
       if (msg->answers[i].rtype == MG_DNS_A_RECORD) {
         /*
          * Async resolver guarantees that there is at least one answer.
-         * TODO(lsm): handle IPv6 answers too
          */
+        nc->sa.sin.sin_family = AF_INET;
         mg_dns_parse_record_data(msg, &msg->answers[i], &nc->sa.sin.sin_addr,
                                  4);
         mg_do_connect(nc, nc->flags & MG_F_UDP ? SOCK_DGRAM : SOCK_STREAM,
                       &nc->sa);
         return;
+#ifdef MG_ENABLE_IPV6
+      } else if (msg->answers[i].rtype == MG_DNS_AAAA_RECORD) {
+        /* sin6_port shares the offset with sin_port set by mg_parse_address */
+        nc->sa.sin6.sin6_family = AF_INET6;
+        mg_dns_parse_record_data(msg, &msg->answers[i], &nc->sa.sin6.sin6_addr,
+                                 sizeof(nc->sa.sin6.sin6_addr));
+        mg_do_connect(nc, nc->flags & MG_F_UDP ? SOCK_DGRAM : SOCK_STREAM,
+                      &nc->sa);
+        return;
+#endif
       }
     }
   }
@@ -2495,8 +2596,8 @@ struct mg_connection *mg_connect_opt(struct mg_mgr *mgr, const char *address,
     return NULL;
   }
 
-  if ((rc = mg_parse_address(address, &nc->sa, &proto, host, sizeof(host))) <
-      0) {
+  if ((rc = mg_parse_address(mgr, address, &nc->sa, &proto, host,
+                             sizeof(host))) < 0) {
     /* Address is malformed */
     MG_SET_PTRPTR(opts.error_string, "cannot parse address");
     mg_destroy_conn(nc, 1 /* destroy_if */);
@@ -2534,17 +2635,29 @@ struct mg_connection *mg_connect_opt(struct mg_mgr *mgr, const char *address,
      * DNS resolution is required for host.
      * mg_parse_address() fills port in nc->sa, which we pass to resolve_cb()
      */
-    struct mg_connection *dns_conn = NULL;
-    struct mg_resolve_async_opts o;
-    memset(&o, 0, sizeof(o));
-    o.dns_conn = &dns_conn;
-    if (mg_resolve_async_opt(nc->mgr, host, MG_DNS_A_RECORD, resolve_cb, nc,
-                             o) != 0) {
+    void *waiter = NULL;
+
+    /* Answers still within their TTL need no round trip */
+    switch (mg_resolve_from_cache(nc->mgr, host, &nc->sa)) {
+      case 1:
+#ifdef MG_ENABLE_SSL
+        if (opts.ssl_ca_cert != NULL && opts.ssl_server_name == NULL) {
+          mg_set_ssl_server_name(nc, host);
+        }
+#endif
+        return mg_do_connect(nc, proto, &nc->sa);
+      case -1:
+        MG_SET_PTRPTR(opts.error_string, "DNS lookup failed");
+        mg_destroy_conn(nc, 1 /* destroy_if */);
+        return NULL;
+    }
+
+    if (mg_resolve_for_connect(nc->mgr, host, resolve_cb, nc, &waiter) != 0) {
       MG_SET_PTRPTR(opts.error_string, "cannot schedule DNS lookup");
       mg_destroy_conn(nc, 1 /* destroy_if */);
       return NULL;
     }
-    nc->priv_2 = dns_conn;
+    nc->priv_2 = waiter;
     nc->flags |= MG_F_RESOLVING;
 #ifdef MG_ENABLE_SSL
     if (opts.ssl_ca_cert != NULL && opts.ssl_server_name == NULL) {
@@ -2581,7 +2694,7 @@ struct mg_connection *mg_bind_opt(struct mg_mgr *mgr, const char *address,
 
   MG_COPY_COMMON_CONNECTION_OPTIONS(&add_sock_opts, &opts);
 
-  if (mg_parse_address(address, &sa, &proto, host, sizeof(host)) <= 0) {
+  if (mg_parse_address(mgr, address, &sa, &proto, host, sizeof(host)) <= 0) {
     MG_SET_PTRPTR(opts.error_string, "cannot parse address");
     return NULL;
   }
@@ -2712,14 +2825,16 @@ double mg_set_timer(struct mg_connection *c, double timestamp) {
   c->ev_timer_time = timestamp;
   /*
    * If this connection is resolving, it's not in the list of active
-   * connections, so not processed yet. It has a DNS resolver connection
-   * linked to it. Set up a timer for the DNS connection.
+   * connections, so not processed yet. Its lookup is linked to it and may be
+   * shared with other connections, so the timer goes on the lookup.
    */
   DBG(("%p %p %d -> %lu", c, c->priv_2, c->flags & MG_F_RESOLVING,
        (unsigned long) timestamp));
+#ifndef MG_DISABLE_RESOLVER
   if ((c->flags & MG_F_RESOLVING) && c->priv_2 != NULL) {
-    ((struct mg_connection *) c->priv_2)->ev_timer_time = timestamp;
+    mg_resolve_set_timer(c->priv_2, timestamp);
   }
+#endif
   return result;
 }
 
@@ -2744,6 +2859,130 @@ struct mg_connection *mg_add_sock(struct mg_mgr *s, sock_t sock,
 double mg_time(void) {
   return cs_time();
 }
+
+static void mg_bucket_refill(struct mg_bucket *b, double now) {
+  if (now > b->last_refill) {
+    b->tokens += (now - b->last_refill) * b->rate;
+    if (b->tokens > b->burst) b->tokens = b->burst;
+  }
+  b->last_refill = now;
+}
+
+/* Sets the rate and the one second burst, dropping tokens above the burst */
+static void mg_bucket_set_rate(struct mg_bucket *b, double rate) {
+  b->rate = rate > 1 ? rate : 1;
+  b->burst = b->rate > MG_BUCKET_QUANTUM ? b->rate : MG_BUCKET_QUANTUM;
+  if (b->tokens > b->burst) b->tokens = b->burst;
+}
+
+struct mg_bucket *mg_bucket_get(struct mg_mgr *mgr, const char *name,
+                                double rate) {
+  struct mg_bucket *b, **p;
+  double now = mg_time();
+
+  for (p = &mgr->buckets; name != NULL && (b = *p) != NULL;) {
+    if (strcmp(b->name, name) == 0) {
+      /* Tokens earned so far count at the old rate */
+      mg_bucket_refill(b, now);
+      mg_bucket_set_rate(b, rate);
+      b->refcnt++;
+      return b;
+    }
+    /* An unused bucket that's full again is as good as a new one */
+    mg_bucket_refill(b, now);
+    if (b->refcnt <= 0 && b->tokens >= b->burst) {
+      *p = b->next;
+      MG_FREE(b->name);
+      MG_FREE(b);
+    } else {
+      p = &b->next;
+    }
+  }
+
+  if ((b = (struct mg_bucket *) MG_CALLOC(1, sizeof(*b))) == NULL) {
+    return NULL;
+  }
+  mg_bucket_set_rate(b, rate);
+  b->tokens = b->burst;
+  b->last_refill = now;
+  b->refcnt = 1;
+  if (name != NULL) {
+    if ((b->name = strdup(name)) == NULL) {
+      MG_FREE(b);
+      return NULL;
+    }
+    b->next = mgr->buckets;
+    mgr->buckets = b;
+  }
+  return b;
+}
+
+void mg_bucket_release(struct mg_mgr *mgr, struct mg_bucket *b) {
+  (void) mgr;
+  /* Named buckets stay on the manager list until they are full again */
+  if (b != NULL && --b->refcnt <= 0 && b->name == NULL) {
+    MG_FREE(b);
+  }
+}
+
+void mg_set_bucket(struct mg_connection *nc, int slot, struct mg_bucket *b) {
+  if (slot < 0 || slot >= MG_MAX_CONN_BUCKETS) {
+    mg_bucket_release(nc->mgr, b);
+    return;
+  }
+  mg_bucket_release(nc->mgr, nc->buckets[slot]);
+  nc->buckets[slot] = b;
+}
+
+MG_INTERNAL size_t mg_bucket_allowance(struct mg_connection *nc, size_t len,
+                                       double now) {
+  size_t allowed = len > MG_BUCKET_QUANTUM ? MG_BUCKET_QUANTUM : len;
+  double wait = 0;
+  struct mg_bucket *b;
+  int i, short_of_tokens = 0;
+
+  /* Send what has been paid for while the connection was throttled */
+  if (nc->send_credit > 0) {
+    return len < nc->send_credit ? len : nc->send_credit;
+  }
+
+  for (i = 0; i < MG_MAX_CONN_BUCKETS; i++) {
+    if ((b = nc->buckets[i]) == NULL) continue;
+    mg_bucket_refill(b, now);
+    if (b->tokens < (double) allowed) short_of_tokens = 1;
+  }
+  if (!short_of_tokens) return allowed;
+
+  /*
+   * Not enough tokens: pay for the write up front, driving the buckets into
+   * debt, and sleep until the debt is repaid. Connections throttled later
+   * queue up behind the debt, which gives first-come first-served fairness
+   * instead of favouring whichever connection is polled first.
+   */
+  for (i = 0; i < MG_MAX_CONN_BUCKETS; i++) {
+    if ((b = nc->buckets[i]) == NULL) continue;
+    b->tokens -= (double) allowed;
+    if (b->tokens < 0 && -b->tokens / b->rate > wait) {
+      wait = -b->tokens / b->rate;
+    }
+  }
+  nc->send_credit = allowed;
+  nc->flags |= MG_F_THROTTLED;
+  nc->throttle_time = now + wait;
+  return 0;
+}
+
+MG_INTERNAL void mg_bucket_consume(struct mg_connection *nc, size_t n) {
+  int i;
+  if (nc->send_credit > 0) {
+    size_t paid = n < nc->send_credit ? n : nc->send_credit;
+    nc->send_credit -= paid;
+    n -= paid;
+  }
+  for (i = 0; i < MG_MAX_CONN_BUCKETS && n > 0; i++) {
+    if (nc->buckets[i] != NULL) nc->buckets[i]->tokens -= (double) n;
+  }
+}
 #ifdef MG_MODULE_LINES
 #line 1 "mongoose/src/net_if_socket.c"
 #endif
@@ -2787,10 +3026,19 @@ static int mg_is_error(int n) {
                     );
 }
 
+/* Resolved names may be either IPv4 or IPv6 addresses */
+static int mg_sock_family(const union socket_address *sa) {
+  return sa->sa.sa_family == AF_INET6 ? AF_INET6 : AF_INET;
+}
+
+static socklen_t mg_sock_addr_len(const union socket_address *sa) {
+  return sa->sa.sa_family == AF_INET6 ? sizeof(sa->sin6) : sizeof(sa->sin);
+}
+
 void mg_if_connect_tcp(struct mg_connection *nc,
                        const union socket_address *sa) {
   int rc, proto = 0;
-  nc->sock = socket(AF_INET, SOCK_STREAM, proto);
+  nc->sock = socket(mg_sock_family(sa), SOCK_STREAM, proto);
   if (nc->sock == INVALID_SOCKET) {
     nc->err = errno ? errno : 1;
     return;
@@ -2798,13 +3046,13 @@ void mg_if_connect_tcp(struct mg_connection *nc,
 #if !defined(MG_ESP8266)
   mg_set_non_blocking_mode(nc->sock);
 #endif
-  rc = connect(nc->sock, &sa->sa, sizeof(sa->sin));
+  rc = connect(nc->sock, &sa->sa, mg_sock_addr_len(sa));
   nc->err = mg_is_error(rc) ? errno : 0;
   LOG(LL_INFO, ("%p sock %d err %d", nc, nc->sock, nc->err));
 }
 
 void mg_if_connect_udp(struct mg_connection *nc) {
-  nc->sock = socket(AF_INET, SOCK_DGRAM, 0);
+  nc->sock = socket(mg_sock_family(&nc->sa), SOCK_DGRAM, 0);
   if (nc->sock == INVALID_SOCKET) {
     nc->err = errno ? errno : 1;
     return;
@@ -2945,6 +3193,7 @@ static sock_t mg_open_listening_socket(union socket_address *sa, int type,
 
 static void mg_write_to_socket(struct mg_connection *nc) {
   struct mbuf *io = &nc->send_mbuf;
+  size_t len = io->len;
   int n = 0;
 
 #ifdef MG_LWIP
@@ -2954,9 +3203,13 @@ static void mg_write_to_socket(struct mg_connection *nc) {
 
   assert(io->len > 0);
 
+  if ((len = mg_bucket_allowance(nc, io->len, mg_time())) == 0) {
+    return;
+  }
+
   if (nc->flags & MG_F_UDP) {
-    int n =
-        sendto(nc->sock, io->buf, io->len, 0, &nc->sa.sa, sizeof(nc->sa.sin));
+    int n = sendto(nc->sock, io->buf, io->len, 0, &nc->sa.sa,
+                   mg_sock_addr_len(&nc->sa));
     DBG(("%p %d %d %d %s:%hu", nc, nc->sock, n, errno,
          inet_ntoa(nc->sa.sin.sin_addr), ntohs(nc->sa.sin.sin_port)));
     if (n > 0) {
@@ -2969,6 +3222,10 @@ static void mg_write_to_socket(struct mg_connection *nc) {
 #if defined(MG_ENABLE_SSL)
   if (nc->ssl != NULL) {
     if (nc->flags & MG_F_SSL_HANDSHAKE_DONE) {
+      /*
+       * SSL_write() must be retried with the same buffer, so send it all.
+       * Buckets go into debt and the next write waits longer.
+       */
       n = SSL_write(nc->ssl, io->buf, io->len);
       DBG(("%p %d bytes -> %d (SSL)", nc, n, nc->sock));
       if (n <= 0) {
@@ -2988,7 +3245,7 @@ static void mg_write_to_socket(struct mg_connection *nc) {
   } else
 #endif
   {
-    n = (int) MG_SEND_FUNC(nc->sock, io->buf, io->len, 0);
+    n = (int) MG_SEND_FUNC(nc->sock, io->buf, len, 0);
     DBG(("%p %d bytes -> %d", nc, n, nc->sock));
     if (n < 0 && mg_is_error(n)) {
       /* Something went wrong, drop the connection. */
@@ -2998,6 +3255,7 @@ static void mg_write_to_socket(struct mg_connection *nc) {
   }
 
   if (n > 0) {
+    mg_bucket_consume(nc, n);
     mbuf_remove(io, n);
     mg_if_sent_cb(nc, n);
   }
@@ -3054,9 +3312,9 @@ static void mg_handle_tcp_read(struct mg_connection *conn) {
     }
     if (n == 0) {
       /* Orderly shutdown of the socket, try flushing output. */
-      conn->flags |= MG_F_SEND_AND_CLOSE;
+      conn->flags |= MG_F_SEND_AND_CLOSE | MG_F_PEER_CLOSED;
     } else if (mg_is_error(n)) {
-      conn->flags |= MG_F_CLOSE_IMMEDIATELY;
+      conn->flags |= MG_F_CLOSE_IMMEDIATELY | MG_F_PEER_CLOSED;
     }
   }
 }
@@ -3098,7 +3356,7 @@ static int mg_ssl_err(struct mg_connection *conn, int res) {
   } else {
     /* There could be an alert to deliver. Try our best. */
     SSL_write(conn->ssl, "", 0);
-    conn->flags |= MG_F_CLOSE_IMMEDIATELY;
+    conn->flags |= MG_F_CLOSE_IMMEDIATELY | MG_F_PEER_CLOSED;
   }
   return ssl_err;
 }
@@ -3287,6 +3545,10 @@ time_t mg_mgr_poll(struct mg_mgr *mgr, int timeout_ms) {
    * e.g. timer-only "connections".
    */
   min_timer = 0;
+#ifndef MG_DISABLE_RESOLVER
+  /* Lookup timers are kept by the resolver, not by connections */
+  if ((min_timer = mg_resolve_poll(mgr)) > 0) num_timers++;
+#endif
   for (nc = mgr->active_connections, num_fds = 0; nc != NULL; nc = tmp) {
     tmp = nc->next;
 
@@ -3314,7 +3576,8 @@ time_t mg_mgr_poll(struct mg_mgr *mgr, int timeout_ms) {
       }
 
       if (((nc->flags & MG_F_CONNECTING) && !(nc->flags & MG_F_WANT_READ)) ||
-          (nc->send_mbuf.len > 0 && !(nc->flags & MG_F_CONNECTING))) {
+          (nc->send_mbuf.len > 0 &&
+           !(nc->flags & (MG_F_CONNECTING | MG_F_THROTTLED)))) {
         mg_add_to_set(nc->sock, &write_set, &max_fd);
         mg_add_to_set(nc->sock, &err_set, &max_fd);
       }
@@ -3326,6 +3589,14 @@ time_t mg_mgr_poll(struct mg_mgr *mgr, int timeout_ms) {
       }
       num_timers++;
     }
+
+    /* Wake up when a throttled connection's buckets have refilled */
+    if (nc->flags & MG_F_THROTTLED) {
+      if (num_timers == 0 || nc->throttle_time < min_timer) {
+        min_timer = nc->throttle_time;
+      }
+      num_timers++;
+    }
   }
 
   /*
@@ -3790,18 +4061,44 @@ static const char *mg_version_header = "Mongoose/" MG_VERSION;
 
 enum mg_http_proto_data_type { DATA_NONE, DATA_FILE, DATA_PUT };
 
+/* Disk space for uploads is reserved with fallocate(FALLOC_FL_KEEP_SIZE) */
+#if CS_PLATFORM == CS_P_UNIX && defined(__linux__)
+#include <sys/syscall.h>
+#include <linux/falloc.h>
+#if defined(SYS_fallocate) && defined(FALLOC_FL_KEEP_SIZE) && \
+    defined(__LP64__)
+#define MG_HTTP_PUT_FALLOCATE
+#endif
+#endif
+
 struct mg_http_proto_data_file {
   FILE *fp;      /* Opened file. */
   int64_t cl;    /* Content-Length. How many bytes to send. */
   int64_t sent;  /* How many bytes have been already sent. */
   int keepalive; /* Keep connection open after sending. */
   enum mg_http_proto_data_type type;
+  int64_t start;          /* PUT: file offset of the first body byte */
+  int status;             /* PUT: status code sent once the body is written */
+  size_t recv_mbuf_limit; /* PUT: restored when the upload is over */
 };
 
 struct mg_http_proto_data_cgi {
   struct mg_connection *cgi_nc;
 };
 
+#if !defined(MG_DISABLE_FILESYSTEM) && !defined(MG_DISABLE_DIRECTORY_LISTING)
+struct mg_http_proto_data_dir {
+  struct mg_dir_index *idx; /* Shared listing index, NULL if idle */
+  char *uri;                /* Request URI, used for page links */
+  size_t offset;            /* First entry of the requested page */
+  size_t limit;             /* Page size, 0 means no limit */
+  size_t pos;               /* Next entry to send */
+  size_t end;               /* One past the last entry to send */
+  int json;                 /* Send JSON instead of HTML */
+  int started;              /* Entries are being sent */
+};
+#endif
+
 struct mg_http_proto_data_chuncked {
   int64_t body_len; /* How many bytes of chunked body was reassembled. */
 };
@@ -3813,6 +4110,67 @@ struct mg_http_endpoint {
   mg_event_handler_t handler;
 };
 
+struct mg_http_proxy_mount {
+  struct mg_http_proxy_mount *next;
+  char *prefix;
+  char *upstream;
+};
+
+struct mg_http_proto_data_pool {
+  char *key;    /* "scheme://host:port" if the connection may be pooled */
+  int reusable; /* Last response was complete and kept alive */
+  int reused;   /* MG_EV_CONNECT is yet to be delivered */
+};
+
+enum mg_http_proxy_state {
+  MG_HTTP_PROXY_HEADERS, /* Waiting for response headers */
+  MG_HTTP_PROXY_BODY,
+  MG_HTTP_PROXY_DONE
+};
+
+enum mg_http_proxy_framing {
+  MG_HTTP_PROXY_LENGTH, /* Content-Length bytes */
+  MG_HTTP_PROXY_CHUNKED,
+  MG_HTTP_PROXY_EOF /* Until the sender closes the connection */
+};
+
+enum mg_http_proxy_chunk_state {
+  MG_HTTP_PROXY_CHUNK_SIZE,
+  MG_HTTP_PROXY_CHUNK_DATA,
+  MG_HTTP_PROXY_CHUNK_DATA_END,
+  MG_HTTP_PROXY_CHUNK_TRAILER
+};
+
+/* One direction of a proxied exchange: the body this connection sends */
+struct mg_http_proto_data_proxy {
+  struct mg_connection *peer; /* Other side of the relay, NULL if idle */
+  enum mg_http_proxy_state state;
+  enum mg_http_proxy_framing framing;
+  int64_t body_left; /* Bytes left with MG_HTTP_PROXY_LENGTH */
+  enum mg_http_proxy_chunk_state chunk_state;
+  size_t chunk_left;
+  int chunk_ext;  /* Skipping chunk extensions */
+  int line_len;   /* Length of the current trailer line */
+  int keep_alive; /* Connection may carry another exchange */
+  int head;       /* Response to HEAD, carries no body */
+  size_t recv_mbuf_limit; /* Restored when the exchange is over */
+};
+
+#ifndef MG_DISABLE_HTTP_METRICS
+/* Request in flight on a server connection, and the connection's totals */
+struct mg_http_proto_data_metrics {
+  struct mg_http_route_metrics *route; /* NULL if no request is in flight */
+  double start;      /* When the request was dispatched */
+  int64_t ttfb;      /* Microseconds to the first response byte, or -1 */
+  size_t resp_off;   /* Where the response starts in send_mbuf */
+  int status;        /* Response status code, 0 until seen */
+  int64_t requests;  /* Requests completed on the connection */
+  int64_t rx, tx;    /* Bytes received and sent on the connection */
+  int64_t rx_mark;   /* Part of rx already accounted to a route */
+  int64_t tx_mark;   /* Part of tx already accounted to a route */
+};
+#endif
+
 enum mg_http_multipart_stream_state {
   MPS_BEGIN,
   MPS_WAITING_FOR_BOUNDARY,
@@ -3837,6 +4195,9 @@ struct mg_http_multipart_stream {
 struct mg_http_proto_data {
 #ifndef MG_DISABLE_FILESYSTEM
   struct mg_http_proto_data_file file;
+#ifndef MG_DISABLE_DIRECTORY_LISTING
+  struct mg_http_proto_data_dir dir;
+#endif
 #endif
 #ifndef MG_DISABLE_CGI
   struct mg_http_proto_data_cgi cgi;
@@ -3847,6 +4208,12 @@ struct mg_http_proto_data {
   struct mg_http_proto_data_chuncked chunk;
   struct mg_http_endpoint *endpoints;
   mg_event_handler_t endpoint_handler;
+  struct mg_http_proxy_mount *proxies;
+  struct mg_http_proto_data_pool pool;
+  struct mg_http_proto_data_proxy proxy;
+#ifndef MG_DISABLE_HTTP_METRICS
+  struct mg_http_proto_data_metrics metrics;
+#endif
 };
 
 static void mg_http_conn_destructor(void *proto_data);
@@ -3875,6 +4242,15 @@ static void mg_http_free_proto_data_mp_stream(
 static void mg_http_free_proto_data_file(struct mg_http_proto_data_file *d) {
   if (d != NULL) {
     if (d->fp != NULL) {
+#ifdef MG_HTTP_PUT_FALLOCATE
+      struct stat st;
+      /* Give back the space reserved past what an aborted upload wrote */
+      if (d->type == DATA_PUT && d->sent < d->cl &&
+          fstat(fileno(d->fp), &st) == 0 &&
+          ftruncate(fileno(d->fp), st.st_size) != 0) {
+        DBG(("ftruncate failed: %d", errno));
+      }
+#endif
       fclose(d->fp);
     }
     memset(d, 0, sizeof(struct mg_http_proto_data_file));
@@ -3882,6 +4258,11 @@ static void mg_http_free_proto_data_file(struct mg_http_proto_data_file *d) {
 }
 #endif
 
+#if !defined(MG_DISABLE_FILESYSTEM) && !defined(MG_DISABLE_DIRECTORY_LISTING)
+static void mg_http_free_proto_data_dir(struct mg_http_proto_data_dir *d);
+static void mg_http_transfer_dir_data(struct mg_connection *nc);
+#endif
+
 #ifndef MG_DISABLE_CGI
 static void mg_http_free_proto_data_cgi(struct mg_http_proto_data_cgi *d) {
   if (d != NULL) {
@@ -3904,10 +4285,55 @@ static void mg_http_free_proto_data_endpoints(struct mg_http_endpoint **ep) {
   ep = NULL;
 }
 
+static void mg_http_free_proto_data_proxies(struct mg_http_proxy_mount **pm) {
+  struct mg_http_proxy_mount *current = *pm;
+
+  while (current != NULL) {
+    struct mg_http_proxy_mount *tmp = current->next;
+    MG_FREE(current->prefix);
+    MG_FREE(current->upstream);
+    MG_FREE(current);
+    current = tmp;
+  }
+
+  *pm = NULL;
+}
+
+static int mg_http_proxy_begin(struct mg_connection *nc,
+                               struct http_message *hm, int req_len);
+static int mg_http_put_begin(struct mg_connection *nc, struct http_message *hm,
+                             int req_len);
+
+#ifndef MG_DISABLE_FILESYSTEM
+/* Whether a request is being served before its body has arrived */
+static int mg_http_is_body_pending(struct mg_connection *nc,
+                                   struct http_message *hm) {
+  return hm->message.p == nc->recv_mbuf.buf &&
+         hm->message.len > nc->recv_mbuf.len;
+}
+#endif
+
+/* Whether the message allows another one on the same connection */
+static int mg_http_is_keep_alive(struct http_message *hm) {
+#ifndef MG_DISABLE_HTTP_KEEP_ALIVE
+  struct mg_str *conn_hdr = mg_get_http_header(hm, "Connection");
+  if (conn_hdr != NULL) {
+    return mg_vcasecmp(conn_hdr, "keep-alive") == 0;
+  }
+  return mg_vcmp(&hm->proto, "HTTP/1.1") == 0;
+#else
+  (void) hm;
+  return 0;
+#endif
+}
+
 static void mg_http_conn_destructor(void *proto_data) {
   struct mg_http_proto_data *pd = (struct mg_http_proto_data *) proto_data;
 #ifndef MG_DISABLE_FILESYSTEM
   mg_http_free_proto_data_file(&pd->file);
+#ifndef MG_DISABLE_DIRECTORY_LISTING
+  mg_http_free_proto_data_dir(&pd->dir);
+#endif
 #endif
 #ifndef MG_DISABLE_CGI
   mg_http_free_proto_data_cgi(&pd->cgi);
@@ -3916,111 +4342,582 @@ static void mg_http_conn_destructor(void *proto_data) {
   mg_http_free_proto_data_mp_stream(&pd->mp_stream);
 #endif
   mg_http_free_proto_data_endpoints(&pd->endpoints);
+  mg_http_free_proto_data_proxies(&pd->proxies);
+  MG_FREE(pd->pool.key);
   free(proto_data);
 }
 
+#ifndef MG_DISABLE_HTTP_METRICS
 /*
- * This structure helps to create an environment for the spawned CGI program.
- * Environment is an array of "VARIABLE=VALUE\0" ASCIIZ strings,
- * last element must be NULL.
- * However, on Windows there is a requirement that all these VARIABLE=VALUE\0
- * strings must reside in a contiguous buffer. The end of the buffer is
- * marked by two '\0' characters.
- * We satisfy both worlds: we create an envp array (which is vars), all
- * entries are actually pointers inside buf.
+ * HTTP metrics. Everything happens in the event loop, so counters are plain
+ * integers. Latencies are recorded in microseconds into log-linear (HDR)
+ * histograms: values below MG_HDR_SUB are exact, above that each power of
+ * two is split into MG_HDR_SUB buckets.
  */
-struct mg_cgi_env_block {
-  struct mg_connection *nc;
-  char buf[MG_CGI_ENVIRONMENT_SIZE];       /* Environment buffer */
-  const char *vars[MG_MAX_CGI_ENVIR_VARS]; /* char *envp[] */
-  int len;                                 /* Space taken */
-  int nvars;                               /* Number of variables in envp[] */
+#define MG_HDR_SUB_BITS 4
+#define MG_HDR_SUB (1 << MG_HDR_SUB_BITS)
+#define MG_HDR_MAX_BITS 40 /* Values are capped at 2^40 us, ~12 days */
+#define MG_HDR_BUCKETS ((MG_HDR_MAX_BITS - MG_HDR_SUB_BITS + 1) * MG_HDR_SUB)
+
+struct mg_hdr_histogram {
+  int64_t counts[MG_HDR_BUCKETS];
+  int64_t count;
+  double sum;
 };
 
-#ifndef MG_DISABLE_FILESYSTEM
+struct mg_http_status_count {
+  int code;
+  int64_t count;
+};
 
-#define MIME_ENTRY(_ext, _type) \
-  { _ext, sizeof(_ext) - 1, _type }
-static const struct {
-  const char *extension;
-  size_t ext_len;
-  const char *mime_type;
-} mg_static_builtin_mime_types[] = {
-    MIME_ENTRY("html", "text/html"),
-    MIME_ENTRY("html", "text/html"),
-    MIME_ENTRY("htm", "text/html"),
-    MIME_ENTRY("shtm", "text/html"),
-    MIME_ENTRY("shtml", "text/html"),
-    MIME_ENTRY("css", "text/css"),
-    MIME_ENTRY("js", "application/x-javascript"),
-    MIME_ENTRY("ico", "image/x-icon"),
-    MIME_ENTRY("gif", "image/gif"),
-    MIME_ENTRY("jpg", "image/jpeg"),
-    MIME_ENTRY("jpeg", "image/jpeg"),
-    MIME_ENTRY("png", "image/png"),
-    MIME_ENTRY("svg", "image/svg+xml"),
-    MIME_ENTRY("txt", "text/plain"),
-    MIME_ENTRY("torrent", "application/x-bittorrent"),
-    MIME_ENTRY("wav", "audio/x-wav"),
-    MIME_ENTRY("mp3", "audio/x-mp3"),
-    MIME_ENTRY("mid", "audio/mid"),
-    MIME_ENTRY("m3u", "audio/x-mpegurl"),
-    MIME_ENTRY("ogg", "application/ogg"),
-    MIME_ENTRY("ram", "audio/x-pn-realaudio"),
-    MIME_ENTRY("xml", "text/xml"),
-    MIME_ENTRY("ttf", "application/x-font-ttf"),
-    MIME_ENTRY("json", "application/json"),
-    MIME_ENTRY("xslt", "application/xml"),
-    MIME_ENTRY("xsl", "application/xml"),
-    MIME_ENTRY("ra", "audio/x-pn-realaudio"),
-    MIME_ENTRY("doc", "application/msword"),
-    MIME_ENTRY("exe", "application/octet-stream"),
-    MIME_ENTRY("zip", "application/x-zip-compressed"),
-    MIME_ENTRY("xls", "application/excel"),
-    MIME_ENTRY("tgz", "application/x-tar-gz"),
-    MIME_ENTRY("tar", "application/x-tar"),
-    MIME_ENTRY("gz", "application/x-gunzip"),
-    MIME_ENTRY("arj", "application/x-arj-compressed"),
-    MIME_ENTRY("rar", "application/x-rar-compressed"),
-    MIME_ENTRY("rtf", "application/rtf"),
-    MIME_ENTRY("pdf", "application/pdf"),
-    MIME_ENTRY("swf", "application/x-shockwave-flash"),
-    MIME_ENTRY("mpg", "video/mpeg"),
-    MIME_ENTRY("webm", "video/webm"),
-    MIME_ENTRY("mpeg", "video/mpeg"),
-    MIME_ENTRY("mov", "video/quicktime"),
-    MIME_ENTRY("mp4", "video/mp4"),
-    MIME_ENTRY("m4v", "video/x-m4v"),
-    MIME_ENTRY("asf", "video/x-ms-asf"),
-    MIME_ENTRY("avi", "video/x-msvideo"),
-    MIME_ENTRY("bmp", "image/bmp"),
-    {NULL, 0, NULL}};
+struct mg_http_route_metrics {
+  struct mg_http_route_metrics *next;
+  char *name;
+  struct mg_http_status_count *codes;
+  int num_codes;
+  int64_t bytes_in;
+  int64_t bytes_out;
+  struct mg_hdr_histogram ttfb;
+  struct mg_hdr_histogram total;
+};
 
-#ifndef MG_DISABLE_DAV
-static int mg_mkdir(const char *path, uint32_t mode) {
-#ifndef _WIN32
-  return mkdir(path, mode);
-#else
-  (void) mode;
-  return _mkdir(path);
-#endif
+struct mg_http_metrics {
+  struct mg_http_route_metrics *routes;
+  int64_t connections;                   /* HTTP connections closed */
+  struct mg_hdr_histogram conn_requests; /* Requests per connection */
+};
+
+static int mg_hdr_index(int64_t v) {
+  int e = MG_HDR_SUB_BITS;
+  if (v < MG_HDR_SUB) return v < 0 ? 0 : (int) v;
+  while (e < MG_HDR_MAX_BITS - 1 && (v >> (e + 1)) != 0) e++;
+  if ((v >> (e + 1)) != 0) return MG_HDR_BUCKETS - 1;
+  return (e - MG_HDR_SUB_BITS + 1) * MG_HDR_SUB +
+         (int) ((v >> (e - MG_HDR_SUB_BITS)) - MG_HDR_SUB);
 }
-#endif
 
-static struct mg_str mg_get_mime_type(const char *path, const char *dflt,
-                                      const struct mg_serve_http_opts *opts) {
-  const char *ext, *overrides;
-  size_t i, path_len;
-  struct mg_str r, k, v;
+/* Highest value that falls into bucket i */
+static int64_t mg_hdr_bucket_top(int i) {
+  int shift;
+  if (i < MG_HDR_SUB) return i;
+  shift = i / MG_HDR_SUB - 1;
+  return ((int64_t)(MG_HDR_SUB + i % MG_HDR_SUB + 1) << shift) - 1;
+}
 
-  path_len = strlen(path);
+static void mg_hdr_record(struct mg_hdr_histogram *h, int64_t v) {
+  h->counts[mg_hdr_index(v)]++;
+  h->count++;
+  h->sum += (double) v;
+}
 
-  overrides = opts->custom_mime_types;
-  while ((overrides = mg_next_comma_list_entry(overrides, &k, &v)) != NULL) {
-    ext = path + (path_len - k.len);
-    if (path_len > k.len && mg_vcasecmp(&k, ext) == 0) {
-      return v;
-    }
+static int64_t mg_hdr_quantile(const struct mg_hdr_histogram *h, double q) {
+  int64_t rank = (int64_t)(q * h->count + 0.5), seen = 0;
+  int i;
+  if (rank < 1) rank = 1;
+  for (i = 0; i < MG_HDR_BUCKETS; i++) {
+    if ((seen += h->counts[i]) >= rank) return mg_hdr_bucket_top(i);
+  }
+  return 0;
+}
+
+static struct mg_http_metrics *mg_http_get_metrics(struct mg_mgr *mgr) {
+  if (mgr->http_metrics == NULL) {
+    mgr->http_metrics =
+        (struct mg_http_metrics *) MG_CALLOC(1, sizeof(*mgr->http_metrics));
+  }
+  return mgr->http_metrics;
+}
+
+static struct mg_http_route_metrics *mg_http_get_route_metrics(
+    struct mg_mgr *mgr, const char *name, size_t len) {
+  struct mg_http_metrics *m = mg_http_get_metrics(mgr);
+  struct mg_http_route_metrics *r;
+
+  if (m == NULL) return NULL;
+  for (r = m->routes; r != NULL; r = r->next) {
+    if (strlen(r->name) == len && memcmp(r->name, name, len) == 0) return r;
+  }
+  if ((r = (struct mg_http_route_metrics *) MG_CALLOC(1, sizeof(*r))) ==
+          NULL ||
+      (r->name = (char *) MG_MALLOC(len + 1)) == NULL) {
+    MG_FREE(r);
+    return NULL;
+  }
+  memcpy(r->name, name, len);
+  r->name[len] = '\0';
+  r->next = m->routes;
+  m->routes = r;
+  return r;
+}
+
+static void mg_http_metrics_count_status(struct mg_http_route_metrics *r,
+                                         int code) {
+  struct mg_http_status_count *codes;
+  int i;
+
+  for (i = 0; i < r->num_codes; i++) {
+    if (r->codes[i].code == code) {
+      r->codes[i].count++;
+      return;
+    }
+  }
+  codes = (struct mg_http_status_count *) MG_REALLOC(
+      r->codes, (r->num_codes + 1) * sizeof(*codes));
+  if (codes == NULL) return;
+  r->codes = codes;
+  r->codes[r->num_codes].code = code;
+  r->codes[r->num_codes].count = 1;
+  r->num_codes++;
+}
+
+/* Accounts the request in flight on `nc` to its route. */
+static void mg_http_metrics_finish(struct mg_connection *nc) {
+  struct mg_http_proto_data_metrics *pm = &mg_http_get_proto_data(nc)->metrics;
+  struct mg_http_route_metrics *r = pm->route;
+
+  if (r == NULL) return;
+  mg_http_metrics_count_status(r, pm->status);
+  r->bytes_in += pm->rx - pm->rx_mark;
+  r->bytes_out += pm->tx - pm->tx_mark;
+  if (pm->ttfb >= 0) mg_hdr_record(&r->ttfb, pm->ttfb);
+  mg_hdr_record(&r->total, (int64_t)((mg_time() - pm->start) * 1e6));
+  pm->rx_mark = pm->rx;
+  pm->tx_mark = pm->tx;
+  pm->requests++;
+  pm->route = NULL;
+}
+
+/*
+ * Starts timing a request dispatched on a server connection. `route` is the
+ * endpoint or proxy prefix that takes it, NULL for the default handler.
+ */
+static void mg_http_metrics_begin(struct mg_connection *nc, const char *route,
+                                  size_t route_len) {
+  struct mg_http_proto_data_metrics *pm;
+
+  if (nc->listener == NULL) return;
+  pm = &mg_http_get_proto_data(nc)->metrics;
+  if (pm->route != NULL && pm->status != 0) {
+    /* Pipelined request, the previous response is still being sent */
+    mg_http_metrics_finish(nc);
+  }
+  if (route == NULL) {
+    route = "default";
+    route_len = 7;
+  }
+  pm->route = mg_http_get_route_metrics(nc->mgr, route, route_len);
+  pm->start = mg_time();
+  pm->ttfb = -1;
+  pm->resp_off = nc->send_mbuf.len;
+  pm->status = 0;
+}
+
+/*
+ * Picks up the response status once the response is queued, and finishes
+ * the request once the response is sent and nothing more is coming.
+ * Called wherever a response may have been produced.
+ */
+static void mg_http_metrics_update(struct mg_connection *nc) {
+  struct mg_http_proto_data *pd;
+  struct mg_http_proto_data_metrics *pm;
+  struct mbuf *io = &nc->send_mbuf;
+  size_t off;
+
+  if (nc->listener == NULL) return;
+  pd = mg_http_get_proto_data(nc);
+  pm = &pd->metrics;
+  if (pm->route == NULL) return;
+
+  /* Status line, skipping interim responses like 100 Continue */
+  for (off = pm->resp_off; pm->status == 0 && io->len >= off + 12 &&
+                           memcmp(io->buf + off, "HTTP/1.", 7) == 0;) {
+    int code = atoi(io->buf + off + 9);
+    const char *end;
+    if (code >= 200 || code == 101) {
+      pm->status = code;
+    } else if ((end = c_strnstr(io->buf + off, "\r\n\r\n", io->len - off)) !=
+               NULL) {
+      off = end + 4 - io->buf;
+    } else {
+      break;
+    }
+  }
+
+  if (pm->status == 0 || io->len > 0) return;
+#ifndef MG_DISABLE_FILESYSTEM
+  if (pd->file.fp != NULL) return;
+#ifndef MG_DISABLE_DIRECTORY_LISTING
+  if (pd->dir.idx != NULL) return;
+#endif
+#endif
+#ifndef MG_DISABLE_CGI
+  if (pd->cgi.cgi_nc != NULL) return;
+#endif
+  if (pd->proxy.peer != NULL) return;
+  mg_http_metrics_finish(nc);
+}
+
+/* Byte counters and response timing, for every event of a server connection */
+static void mg_http_metrics_event(struct mg_connection *nc, int ev,
+                                  void *ev_data) {
+  struct mg_http_proto_data_metrics *pm;
+  struct mg_http_metrics *m;
+  size_t n;
+
+  if (nc->listener == NULL) return;
+  pm = &mg_http_get_proto_data(nc)->metrics;
+  switch (ev) {
+    case MG_EV_RECV:
+      pm->rx += *(int *) ev_data;
+      break;
+    case MG_EV_SEND:
+      n = (size_t) *(int *) ev_data;
+      pm->tx += n;
+      if (pm->route != NULL) {
+        if (pm->ttfb < 0 && n > pm->resp_off) {
+          pm->ttfb = (int64_t)((mg_time() - pm->start) * 1e6);
+        }
+        pm->resp_off = pm->resp_off > n ? pm->resp_off - n : 0;
+        mg_http_metrics_update(nc);
+      }
+      break;
+    case MG_EV_CLOSE:
+      mg_http_metrics_finish(nc);
+      if ((m = mg_http_get_metrics(nc->mgr)) != NULL) {
+        m->connections++;
+        mg_hdr_record(&m->conn_requests, pm->requests);
+      }
+      break;
+  }
+}
+
+int mg_http_get_conn_metrics(struct mg_connection *nc,
+                             struct mg_http_conn_metrics *m) {
+  struct mg_http_proto_data_metrics *pm;
+
+  if (nc->listener == NULL || nc->proto_data == NULL ||
+      nc->proto_data_destructor != mg_http_conn_destructor) {
+    return -1;
+  }
+  pm = &((struct mg_http_proto_data *) nc->proto_data)->metrics;
+  m->requests = pm->requests;
+  m->bytes_received = pm->rx;
+  m->bytes_sent = pm->tx;
+  m->request_start = pm->route != NULL ? pm->start : 0;
+  m->status = pm->route != NULL ? pm->status : 0;
+  return 0;
+}
+
+MG_INTERNAL void mg_http_free_metrics(struct mg_mgr *mgr) {
+  struct mg_http_metrics *m = mgr->http_metrics;
+
+  if (m == NULL) return;
+  while (m->routes != NULL) {
+    struct mg_http_route_metrics *r = m->routes;
+    m->routes = r->next;
+    MG_FREE(r->name);
+    MG_FREE(r->codes);
+    MG_FREE(r);
+  }
+  MG_FREE(m);
+  mgr->http_metrics = NULL;
+}
+
+static void mg_http_metrics_printf(struct mbuf *mb, const char *fmt, ...) {
+  char mem[256], *buf = mem;
+  int len;
+  va_list ap;
+
+  va_start(ap, fmt);
+  if ((len = mg_avprintf(&buf, sizeof(mem), fmt, ap)) > 0) {
+    mbuf_append(mb, buf, len);
+  }
+  va_end(ap);
+  if (buf != mem && buf != NULL) {
+    MG_FREE(buf);
+  }
+}
+
+/* Appends `name{route="..."` with the route escaped as a label value */
+static void mg_http_metrics_series(struct mbuf *mb, const char *name,
+                                   const struct mg_http_route_metrics *r) {
+  const char *p;
+
+  mg_http_metrics_printf(mb, "%s{route=\"", name);
+  for (p = r->name; *p != '\0'; p++) {
+    if (*p == '"' || *p == '\\') {
+      mbuf_append(mb, "\\", 1);
+      mbuf_append(mb, p, 1);
+    } else if (*p == '\n') {
+      mbuf_append(mb, "\\n", 2);
+    } else {
+      mbuf_append(mb, p, 1);
+    }
+  }
+  mbuf_append(mb, "\"", 1);
+}
+
+static void mg_http_metrics_summary(struct mbuf *mb, const char *name,
+                                    const struct mg_http_route_metrics *r,
+                                    const struct mg_hdr_histogram *h,
+                                    double scale) {
+  static const double quantiles[] = {0.5, 0.9, 0.99, 0.999};
+  char total[100];
+  size_t i;
+
+  for (i = 0; i < ARRAY_SIZE(quantiles); i++) {
+    if (r != NULL) {
+      mg_http_metrics_series(mb, name, r);
+      mg_http_metrics_printf(mb, ",");
+    } else {
+      mg_http_metrics_printf(mb, "%s{", name);
+    }
+    mg_http_metrics_printf(mb, "quantile=\"%g\"} %g\n", quantiles[i],
+                           mg_hdr_quantile(h, quantiles[i]) * scale);
+  }
+  for (i = 0; i < 2; i++) {
+    snprintf(total, sizeof(total), "%s%s", name, i == 0 ? "_sum" : "_count");
+    if (r != NULL) {
+      mg_http_metrics_series(mb, total, r);
+      mg_http_metrics_printf(mb, "}");
+    } else {
+      mg_http_metrics_printf(mb, "%s", total);
+    }
+    if (i == 0) {
+      mg_http_metrics_printf(mb, " %g\n", h->sum * scale);
+    } else {
+      mg_http_metrics_printf(mb, " %" INT64_FMT "\n", h->count);
+    }
+  }
+}
+
+static void mg_http_metrics_print(struct mg_mgr *mgr, struct mbuf *mb) {
+  struct mg_http_metrics *m = mg_http_get_metrics(mgr);
+  struct mg_http_route_metrics *r;
+  struct mg_connection *c;
+  int64_t listening = 0, server = 0, client = 0;
+  int64_t recv_len = 0, recv_size = 0, send_len = 0, send_size = 0;
+  int i;
+
+  if (m == NULL) return;
+
+  mg_http_metrics_printf(
+      mb,
+      "# HELP mongoose_http_requests_total Completed HTTP requests.\n"
+      "# TYPE mongoose_http_requests_total counter\n");
+  for (r = m->routes; r != NULL; r = r->next) {
+    for (i = 0; i < r->num_codes; i++) {
+      mg_http_metrics_series(mb, "mongoose_http_requests_total", r);
+      mg_http_metrics_printf(mb, ",code=\"%d\"} %" INT64_FMT "\n",
+                             r->codes[i].code, r->codes[i].count);
+    }
+  }
+
+  mg_http_metrics_printf(
+      mb,
+      "# HELP mongoose_http_received_bytes_total Bytes received with HTTP "
+      "requests.\n"
+      "# TYPE mongoose_http_received_bytes_total counter\n");
+  for (r = m->routes; r != NULL; r = r->next) {
+    mg_http_metrics_series(mb, "mongoose_http_received_bytes_total", r);
+    mg_http_metrics_printf(mb, "} %" INT64_FMT "\n", r->bytes_in);
+  }
+
+  mg_http_metrics_printf(
+      mb,
+      "# HELP mongoose_http_sent_bytes_total Bytes sent with HTTP "
+      "responses.\n"
+      "# TYPE mongoose_http_sent_bytes_total counter\n");
+  for (r = m->routes; r != NULL; r = r->next) {
+    mg_http_metrics_series(mb, "mongoose_http_sent_bytes_total", r);
+    mg_http_metrics_printf(mb, "} %" INT64_FMT "\n", r->bytes_out);
+  }
+
+  mg_http_metrics_printf(
+      mb,
+      "# HELP mongoose_http_ttfb_seconds Time to the first response byte.\n"
+      "# TYPE mongoose_http_ttfb_seconds summary\n");
+  for (r = m->routes; r != NULL; r = r->next) {
+    mg_http_metrics_summary(mb, "mongoose_http_ttfb_seconds", r, &r->ttfb,
+                            1e-6);
+  }
+
+  mg_http_metrics_printf(
+      mb,
+      "# HELP mongoose_http_response_seconds Time to send the whole "
+      "response.\n"
+      "# TYPE mongoose_http_response_seconds summary\n");
+  for (r = m->routes; r != NULL; r = r->next) {
+    mg_http_metrics_summary(mb, "mongoose_http_response_seconds", r,
+                            &r->total, 1e-6);
+  }
+
+  mg_http_metrics_printf(
+      mb,
+      "# HELP mongoose_http_connections_total Closed HTTP connections.\n"
+      "# TYPE mongoose_http_connections_total counter\n"
+      "mongoose_http_connections_total %" INT64_FMT "\n"
+      "# HELP mongoose_http_connection_requests Requests per HTTP "
+      "connection.\n"
+      "# TYPE mongoose_http_connection_requests summary\n",
+      m->connections);
+  mg_http_metrics_summary(mb, "mongoose_http_connection_requests", NULL,
+                          &m->conn_requests, 1);
+
+  for (c = mgr->active_connections; c != NULL; c = c->next) {
+    if (c->flags & MG_F_LISTENING) {
+      listening++;
+    } else if (c->listener != NULL) {
+      server++;
+    } else {
+      client++;
+    }
+    recv_len += c->recv_mbuf.len;
+    recv_size += c->recv_mbuf.size;
+    send_len += c->send_mbuf.len;
+    send_size += c->send_mbuf.size;
+  }
+  mg_http_metrics_printf(
+      mb,
+      "# HELP mongoose_connections Open connections.\n"
+      "# TYPE mongoose_connections gauge\n"
+      "mongoose_connections{type=\"listening\"} %" INT64_FMT "\n"
+      "mongoose_connections{type=\"server\"} %" INT64_FMT "\n"
+      "mongoose_connections{type=\"client\"} %" INT64_FMT "\n",
+      listening, server, client);
+  mg_http_metrics_printf(
+      mb,
+      "# HELP mongoose_mbuf_bytes Bytes buffered in connection mbufs.\n"
+      "# TYPE mongoose_mbuf_bytes gauge\n"
+      "mongoose_mbuf_bytes{mbuf=\"recv\"} %" INT64_FMT "\n"
+      "mongoose_mbuf_bytes{mbuf=\"send\"} %" INT64_FMT "\n"
+      "# HELP mongoose_mbuf_allocated_bytes Bytes allocated for connection "
+      "mbufs.\n"
+      "# TYPE mongoose_mbuf_allocated_bytes gauge\n"
+      "mongoose_mbuf_allocated_bytes{mbuf=\"recv\"} %" INT64_FMT "\n"
+      "mongoose_mbuf_allocated_bytes{mbuf=\"send\"} %" INT64_FMT "\n",
+      recv_len, send_len, recv_size, send_size);
+}
+
+void mg_http_metrics_handler(struct mg_connection *nc, int ev, void *ev_data) {
+  struct mbuf mb;
+
+  if (ev != MG_EV_HTTP_REQUEST) return;
+  mbuf_init(&mb, 4096);
+  mg_http_metrics_print(nc->mgr, &mb);
+  mg_send_head(nc, 200, mb.len, "Content-Type: text/plain; version=0.0.4");
+  mg_send(nc, mb.buf, mb.len);
+  mbuf_free(&mb);
+  (void) ev_data;
+}
+#else
+#define mg_http_metrics_begin(nc, route, route_len)
+#define mg_http_metrics_update(nc)
+#define mg_http_metrics_event(nc, ev, ev_data)
+#endif /* MG_DISABLE_HTTP_METRICS */
+
+/*
+ * This structure helps to create an environment for the spawned CGI program.
+ * Environment is an array of "VARIABLE=VALUE\0" ASCIIZ strings,
+ * last element must be NULL.
+ * However, on Windows there is a requirement that all these VARIABLE=VALUE\0
+ * strings must reside in a contiguous buffer. The end of the buffer is
+ * marked by two '\0' characters.
+ * We satisfy both worlds: we create an envp array (which is vars), all
+ * entries are actually pointers inside buf.
+ */
+struct mg_cgi_env_block {
+  struct mg_connection *nc;
+  char buf[MG_CGI_ENVIRONMENT_SIZE];       /* Environment buffer */
+  const char *vars[MG_MAX_CGI_ENVIR_VARS]; /* char *envp[] */
+  int len;                                 /* Space taken */
+  int nvars;                               /* Number of variables in envp[] */
+};
+
+#ifndef MG_DISABLE_FILESYSTEM
+
+#define MIME_ENTRY(_ext, _type) \
+  { _ext, sizeof(_ext) - 1, _type }
+static const struct {
+  const char *extension;
+  size_t ext_len;
+  const char *mime_type;
+} mg_static_builtin_mime_types[] = {
+    MIME_ENTRY("html", "text/html"),
+    MIME_ENTRY("html", "text/html"),
+    MIME_ENTRY("htm", "text/html"),
+    MIME_ENTRY("shtm", "text/html"),
+    MIME_ENTRY("shtml", "text/html"),
+    MIME_ENTRY("css", "text/css"),
+    MIME_ENTRY("js", "application/x-javascript"),
+    MIME_ENTRY("ico", "image/x-icon"),
+    MIME_ENTRY("gif", "image/gif"),
+    MIME_ENTRY("jpg", "image/jpeg"),
+    MIME_ENTRY("jpeg", "image/jpeg"),
+    MIME_ENTRY("png", "image/png"),
+    MIME_ENTRY("svg", "image/svg+xml"),
+    MIME_ENTRY("txt", "text/plain"),
+    MIME_ENTRY("torrent", "application/x-bittorrent"),
+    MIME_ENTRY("wav", "audio/x-wav"),
+    MIME_ENTRY("mp3", "audio/x-mp3"),
+    MIME_ENTRY("mid", "audio/mid"),
+    MIME_ENTRY("m3u", "audio/x-mpegurl"),
+    MIME_ENTRY("ogg", "application/ogg"),
+    MIME_ENTRY("ram", "audio/x-pn-realaudio"),
+    MIME_ENTRY("xml", "text/xml"),
+    MIME_ENTRY("ttf", "application/x-font-ttf"),
+    MIME_ENTRY("json", "application/json"),
+    MIME_ENTRY("xslt", "application/xml"),
+    MIME_ENTRY("xsl", "application/xml"),
+    MIME_ENTRY("ra", "audio/x-pn-realaudio"),
+    MIME_ENTRY("doc", "application/msword"),
+    MIME_ENTRY("exe", "application/octet-stream"),
+    MIME_ENTRY("zip", "application/x-zip-compressed"),
+    MIME_ENTRY("xls", "application/excel"),
+    MIME_ENTRY("tgz", "application/x-tar-gz"),
+    MIME_ENTRY("tar", "application/x-tar"),
+    MIME_ENTRY("gz", "application/x-gunzip"),
+    MIME_ENTRY("arj", "application/x-arj-compressed"),
+    MIME_ENTRY("rar", "application/x-rar-compressed"),
+    MIME_ENTRY("rtf", "application/rtf"),
+    MIME_ENTRY("pdf", "application/pdf"),
+    MIME_ENTRY("swf", "application/x-shockwave-flash"),
+    MIME_ENTRY("mpg", "video/mpeg"),
+    MIME_ENTRY("webm", "video/webm"),
+    MIME_ENTRY("mpeg", "video/mpeg"),
+    MIME_ENTRY("mov", "video/quicktime"),
+    MIME_ENTRY("mp4", "video/mp4"),
+    MIME_ENTRY("m4v", "video/x-m4v"),
+    MIME_ENTRY("asf", "video/x-ms-asf"),
+    MIME_ENTRY("avi", "video/x-msvideo"),
+    MIME_ENTRY("bmp", "image/bmp"),
+    {NULL, 0, NULL}};
+
+#ifndef MG_DISABLE_DAV
+static int mg_mkdir(const char *path, uint32_t mode) {
+#ifndef _WIN32
+  return mkdir(path, mode);
+#else
+  (void) mode;
+  return _mkdir(path);
+#endif
+}
+#endif
+
+static struct mg_str mg_get_mime_type(const char *path, const char *dflt,
+                                      const struct mg_serve_http_opts *opts) {
+  const char *ext, *overrides;
+  size_t i, path_len;
+  struct mg_str r, k, v;
+
+  path_len = strlen(path);
+
+  overrides = opts->custom_mime_types;
+  while ((overrides = mg_next_comma_list_entry(overrides, &k, &v)) != NULL) {
+    ext = path + (path_len - k.len);
+    if (path_len > k.len && mg_vcasecmp(&k, ext) == 0) {
+      return v;
+    }
   }
 
   for (i = 0; mg_static_builtin_mime_types[i].extension != NULL; i++) {
@@ -4476,6 +5373,48 @@ static void mg_ws_handshake(struct mg_connection *nc,
 #endif /* MG_DISABLE_HTTP_WEBSOCKET */
 
 #ifndef MG_DISABLE_FILESYSTEM
+static void mg_http_send_error(struct mg_connection *nc, int code,
+                               const char *reason);
+
+/* Writes PUT body data at the current upload offset, bypassing stdio */
+static size_t mg_http_put_write(struct mg_http_proto_data_file *d,
+                                const char *buf, size_t len) {
+  size_t n = 0;
+#if CS_PLATFORM == CS_P_UNIX
+  while (n < len) {
+    ssize_t k = pwrite(fileno(d->fp), buf + n, len - n,
+                       (off_t)(d->start + d->sent + n));
+    if (k < 0 && errno == EINTR) continue;
+    if (k <= 0) break;
+    n += (size_t) k;
+  }
+#else
+  /* The stream is unbuffered and positioned by mg_handle_put() */
+  n = fwrite(buf, 1, len, d->fp);
+#endif
+  d->sent += n;
+  return n;
+}
+
+/* Finishes a PUT: err is 0 or the errno of the failed write */
+static void mg_http_put_done(struct mg_connection *nc, int err) {
+  struct mg_http_proto_data *pd = mg_http_get_proto_data(nc);
+  nc->recv_mbuf_limit = pd->file.recv_mbuf_limit;
+  if (err == 0) {
+    mg_printf(nc, "HTTP/1.1 %d OK\r\nContent-Length: 0\r\n\r\n",
+              pd->file.status);
+    if (!pd->file.keepalive) nc->flags |= MG_F_SEND_AND_CLOSE;
+  } else {
+    DBG(("%p PUT failed after %" INT64_FMT " bytes: %d", nc, pd->file.sent,
+         err));
+    mg_http_send_error(nc, err == ENOSPC ? 413 : 500, NULL);
+    /* Nobody wants the rest of the body, stop reading it */
+    mbuf_remove(&nc->recv_mbuf, nc->recv_mbuf.len);
+    nc->recv_mbuf_limit = 0;
+  }
+  mg_http_free_proto_data_file(&pd->file);
+}
+
 static void mg_http_transfer_file_data(struct mg_connection *nc) {
   struct mg_http_proto_data *pd = mg_http_get_proto_data(nc);
   char buf[MG_MAX_HTTP_SEND_MBUF];
@@ -4503,15 +5442,22 @@ static void mg_http_transfer_file_data(struct mg_connection *nc) {
     }
   } else if (pd->file.type == DATA_PUT) {
     struct mbuf *io = &nc->recv_mbuf;
-    size_t to_write = left <= 0 ? 0 : left < io->len ? (size_t) left : io->len;
-    size_t n = fwrite(io->buf, 1, to_write, pd->file.fp);
-    if (n > 0) {
+    int64_t rest = pd->file.cl - pd->file.sent;
+    size_t to_write = (int64_t) io->len < rest ? io->len : (size_t) rest;
+    /*
+     * Write in large batches: wait until the read-ahead allowed by
+     * recv_mbuf_limit is full, the body is complete or the peer is gone.
+     */
+    if (to_write > 0 &&
+        ((int64_t) to_write == rest || io->len >= nc->recv_mbuf_limit ||
+         (nc->flags & MG_F_PEER_CLOSED))) {
+      n = mg_http_put_write(&pd->file, io->buf, to_write);
       mbuf_remove(io, n);
-      pd->file.sent += n;
-    }
-    if (n == 0 || pd->file.sent >= pd->file.cl) {
-      if (!pd->file.keepalive) nc->flags |= MG_F_SEND_AND_CLOSE;
-      mg_http_free_proto_data_file(&pd->file);
+      if (n < to_write) {
+        mg_http_put_done(nc, errno != 0 ? errno : EIO);
+      } else if (pd->file.sent >= pd->file.cl) {
+        mg_http_put_done(nc, 0);
+      }
     }
   }
 #ifndef MG_DISABLE_CGI
@@ -4620,10 +5566,10 @@ MG_INTERNAL size_t mg_handle_chunked(struct mg_connection *nc,
   return body_len;
 }
 
-static mg_event_handler_t mg_http_get_endpoint_handler(
+static struct mg_http_endpoint *mg_http_get_endpoint(
     struct mg_connection *nc, struct mg_str *uri_path) {
   struct mg_http_proto_data *pd;
-  mg_event_handler_t ret = NULL;
+  struct mg_http_endpoint *ret = NULL;
   int matched, matched_max = 0;
   struct mg_http_endpoint *ep;
 
@@ -4639,7 +5585,7 @@ static mg_event_handler_t mg_http_get_endpoint_handler(
     if ((matched = mg_match_prefix_n(name_s, *uri_path)) != -1) {
       if (matched > matched_max) {
         /* Looking for the longest suitable handler */
-        ret = ep->handler;
+        ret = ep;
         matched_max = matched;
       }
     }
@@ -4653,15 +5599,20 @@ static mg_event_handler_t mg_http_get_endpoint_handler(
 static void mg_http_call_endpoint_handler(struct mg_connection *nc, int ev,
                                           struct http_message *hm) {
   struct mg_http_proto_data *pd = mg_http_get_proto_data(nc);
+  int is_request = ev == MG_EV_HTTP_REQUEST || ev == MG_EV_HTTP_PUT_REQUEST;
 
-  if (pd->endpoint_handler == NULL || ev == MG_EV_HTTP_REQUEST) {
-    pd->endpoint_handler =
-        ev == MG_EV_HTTP_REQUEST
-            ? mg_http_get_endpoint_handler(nc->listener, &hm->uri)
-            : NULL;
+  if (pd->endpoint_handler == NULL || is_request) {
+    struct mg_http_endpoint *ep =
+        is_request ? mg_http_get_endpoint(nc->listener, &hm->uri) : NULL;
+    pd->endpoint_handler = ep != NULL ? ep->handler : NULL;
+    if (is_request) {
+      mg_http_metrics_begin(nc, ep != NULL ? ep->name : NULL,
+                            ep != NULL ? ep->name_len : 0);
+    }
   }
   mg_call(nc, pd->endpoint_handler ? pd->endpoint_handler : nc->handler, ev,
           hm);
+  mg_http_metrics_update(nc);
 }
 
 #ifdef MG_ENABLE_HTTP_STREAMING_MULTIPART
@@ -4700,6 +5651,13 @@ void mg_http_handler(struct mg_connection *nc, int ev, void *ev_data) {
 #ifndef MG_DISABLE_HTTP_WEBSOCKET
   struct mg_str *vec;
 #endif
+  if (pd->pool.reused) {
+    /* Pooled connection handed out by mg_connect_http() */
+    int err = 0;
+    pd->pool.reused = 0;
+    mg_call(nc, nc->handler, MG_EV_CONNECT, &err);
+  }
+
   if (ev == MG_EV_CLOSE) {
 #ifdef MG_ENABLE_HTTP_STREAMING_MULTIPART
     if (pd->mp_stream.boundary != NULL) {
@@ -4729,17 +5687,35 @@ void mg_http_handler(struct mg_connection *nc, int ev, void *ev_data) {
     }
   }
 
+  mg_http_metrics_event(nc, ev, ev_data);
+
 #ifndef MG_DISABLE_FILESYSTEM
   if (pd->file.fp != NULL) {
     mg_http_transfer_file_data(nc);
   }
+#ifndef MG_DISABLE_DIRECTORY_LISTING
+  if (pd->dir.idx != NULL && ev != MG_EV_CLOSE) {
+    mg_http_transfer_dir_data(nc);
+  }
+#endif
 #endif
 
   mg_call(nc, nc->handler, ev, ev_data);
+  mg_http_metrics_update(nc);
 
   if (ev == MG_EV_RECV) {
     struct mg_str *s;
 
+    /* Anything past a complete response makes the connection unusable */
+    pd->pool.reusable = 0;
+
+#ifndef MG_DISABLE_FILESYSTEM
+    if (pd->file.type == DATA_PUT) {
+      /* Body of a streamed PUT, consumed by mg_http_transfer_file_data() */
+      return;
+    }
+#endif
+
 #ifdef MG_ENABLE_HTTP_STREAMING_MULTIPART
     if (pd->mp_stream.boundary != NULL) {
       mg_http_multipart_continue(nc);
@@ -4749,6 +5725,10 @@ void mg_http_handler(struct mg_connection *nc, int ev, void *ev_data) {
 
     req_len = mg_parse_http(io->buf, io->len, hm, is_req);
 
+    if (req_len > 0 && is_req && mg_http_proxy_begin(nc, hm, req_len)) {
+      return;
+    }
+
     if (req_len > 0 &&
         (s = mg_get_http_header(hm, "Transfer-Encoding")) != NULL &&
         mg_vcasecmp(s, "chunked") == 0) {
@@ -4764,6 +5744,14 @@ void mg_http_handler(struct mg_connection *nc, int ev, void *ev_data) {
     }
 #endif /* MG_ENABLE_HTTP_STREAMING_MULTIPART */
 
+    /* Offer PUT requests for streaming once, when their headers complete */
+    if (req_len > 0 && is_req && ev_data != NULL &&
+        io->len - *(int *) ev_data < (size_t) req_len &&
+        hm->message.len > io->len && mg_vcmp(&hm->method, "PUT") == 0 &&
+        mg_http_put_begin(nc, hm, req_len)) {
+      return;
+    }
+
     /* TODO(alashkin): refactor this ifelseifelseifelseifelse */
     if ((req_len < 0 ||
          (req_len == 0 && io->len >= MG_MAX_HTTP_REQUEST_SIZE))) {
@@ -4853,12 +5841,49 @@ void mg_http_handler(struct mg_connection *nc, int ev, void *ev_data) {
 #else
       mg_http_call_endpoint_handler(nc, trigger_ev, hm);
 #endif
+      if (!is_req && pd->pool.key != NULL) {
+        pd->pool.reusable =
+            io->len == hm->message.len && mg_http_is_keep_alive(hm);
+      }
       mbuf_remove(io, hm->message.len);
     }
   }
   (void) pd;
 }
 
+/*
+ * Sends MG_EV_HTTP_PUT_REQUEST. Returns 1 if the handler took the request,
+ * either streaming its body to disk or answering it without the body.
+ */
+static int mg_http_put_begin(struct mg_connection *nc, struct http_message *hm,
+                             int req_len) {
+  struct mg_http_proto_data *pd = mg_http_get_proto_data(nc);
+  size_t sent = nc->send_mbuf.len;
+
+  mg_http_call_endpoint_handler(nc, MG_EV_HTTP_PUT_REQUEST, hm);
+#ifndef MG_DISABLE_FILESYSTEM
+  if (pd->file.type == DATA_PUT) {
+    struct mg_str *expect = mg_get_http_header(hm, "Expect");
+    if (expect != NULL && mg_vcasecmp(expect, "100-continue") == 0) {
+      mg_printf(nc, "%s", "HTTP/1.1 100 Continue\r\n\r\n");
+    }
+    mbuf_remove(&nc->recv_mbuf, req_len);
+    mg_http_transfer_file_data(nc);
+    mg_http_metrics_update(nc);
+    return 1;
+  }
+#endif
+  if (nc->send_mbuf.len != sent || (nc->flags & MG_F_CLOSE_IMMEDIATELY)) {
+    /* Answered early: the body will not be read, so the connection ends */
+    mbuf_remove(&nc->recv_mbuf, nc->recv_mbuf.len);
+    nc->recv_mbuf_limit = 0;
+    nc->flags |= MG_F_SEND_AND_CLOSE;
+    return 1;
+  }
+  (void) pd;
+  return 0;
+}
+
 static size_t mg_get_line_len(const char *buf, size_t buf_len) {
   size_t len = 0;
   while (len < buf_len && buf[len] != '\n') len++;
@@ -4869,6 +5894,7 @@ static size_t mg_get_line_len(const char *buf, size_t buf_len) {
 static void mg_http_multipart_begin(struct mg_connection *nc,
                                     struct http_message *hm, int req_len) {
   struct mg_http_proto_data *pd = mg_http_get_proto_data(nc);
+  struct mg_http_endpoint *ep;
   struct mg_str *ct;
   struct mbuf *io = &nc->recv_mbuf;
 
@@ -4917,10 +5943,10 @@ static void mg_http_multipart_begin(struct mg_connection *nc,
     pd->mp_stream.boundary_len = strlen(boundary);
     pd->mp_stream.var_name = pd->mp_stream.file_name = NULL;
 
-    pd->endpoint_handler = mg_http_get_endpoint_handler(nc->listener, &hm->uri);
-    if (pd->endpoint_handler == NULL) {
-      pd->endpoint_handler = nc->handler;
-    }
+    ep = mg_http_get_endpoint(nc->listener, &hm->uri);
+    pd->endpoint_handler = ep != NULL ? ep->handler : nc->handler;
+    mg_http_metrics_begin(nc, ep != NULL ? ep->name : NULL,
+                          ep != NULL ? ep->name_len : 0);
 
     mg_call(nc, pd->endpoint_handler, MG_EV_HTTP_MULTIPART_REQUEST, hm);
 
@@ -5160,7 +6186,7 @@ void mg_file_upload_handler(struct mg_connection *nc, int ev, void *ev_data,
       if (lfn.p != mp->file_name) free((char *) lfn.p);
       LOG(LL_DEBUG,
           ("%p Receiving file %s -> %s", nc, mp->file_name, fus->lfn));
-      fus->fp = fopen(fus->lfn, "w");
+      fus->fp = fopen(fus->lfn, "wb");
       if (fus->fp == NULL) {
         mg_printf(nc,
                   "HTTP/1.1 500 Internal Server Error\r\n"
@@ -5318,6 +6344,9 @@ void mg_send_response_line_s(struct mg_connection *nc, int status_code,
     case 404:
       status_message = "Not Found";
       break;
+    case 413:
+      status_message = "Payload Too Large";
+      break;
     case 416:
       status_message = "Requested range not satisfiable";
       break;
@@ -5373,12 +6402,7 @@ void mg_send_head(struct mg_connection *c, int status_code,
   mg_send(c, "\r\n", 2);
 }
 
-#ifdef MG_DISABLE_FILESYSTEM
-void mg_serve_http(struct mg_connection *nc, struct http_message *hm,
-                   struct mg_serve_http_opts opts) {
-  mg_send_head(nc, 501, 0, NULL);
-}
-#else
+/* Also used by the reverse proxy, which works without the filesystem */
 static void mg_http_send_error(struct mg_connection *nc, int code,
                                const char *reason) {
   if (!reason) reason = "";
@@ -5388,6 +6412,13 @@ static void mg_http_send_error(struct mg_connection *nc, int code,
   mg_send(nc, reason, strlen(reason));
   nc->flags |= MG_F_SEND_AND_CLOSE;
 }
+
+#ifdef MG_DISABLE_FILESYSTEM
+void mg_serve_http(struct mg_connection *nc, struct http_message *hm,
+                   struct mg_serve_http_opts opts) {
+  mg_send_head(nc, 501, 0, NULL);
+}
+#else
 #ifndef MG_DISABLE_SSI
 static void mg_send_ssi_file(struct mg_connection *nc, struct http_message *hm,
                              const char *path, FILE *fp, int include_level,
@@ -5607,6 +6638,18 @@ static int mg_http_parse_range_header(const struct mg_str *header, int64_t *a,
   return result;
 }
 
+#ifndef MG_DISABLE_DAV
+/* Parses "bytes a-b/len", and "bytes=a-b" sent by older clients */
+static int mg_http_parse_content_range(const struct mg_str *header,
+                                       int64_t *a, int64_t *b) {
+  char buf[100];
+  snprintf(buf, sizeof(buf), "%.*s", (int) header->len, header->p);
+  if (strncmp(buf, "bytes", 5) != 0) return 0;
+  if (buf[5] == '=') buf[5] = ' ';
+  return sscanf(buf, "bytes %" INT64_FMT "-%" INT64_FMT, a, b);
+}
+#endif
+
 void mg_http_serve_file(struct mg_connection *nc, struct http_message *hm,
                         const char *path, const struct mg_str mime_type,
                         const struct mg_str extra_headers) {
@@ -6074,11 +7117,27 @@ static void mg_escape(const char *src, char *dst, size_t dst_len) {
   dst[n] = '\0';
 }
 
+static void mg_json_escape(const char *src, char *dst, size_t dst_len) {
+  static const char *hex = "0123456789abcdef";
+  size_t n = 0;
+  while (*src != '\0' && n + 7 < dst_len) {
+    unsigned char ch = *(unsigned char *) src++;
+    if (ch == '"' || ch == '\\') {
+      dst[n++] = '\\';
+      dst[n++] = ch;
+    } else if (ch < 0x20) {
+      n += snprintf(dst + n, dst_len - n, "\\u00%c%c", hex[ch >> 4],
+                    hex[ch & 0xf]);
+    } else {
+      dst[n++] = ch;
+    }
+  }
+  dst[n] = '\0';
+}
+
 static void mg_print_dir_entry(struct mg_connection *nc, const char *file_name,
-                               cs_stat_t *stp) {
+                               int is_dir, int64_t fsize, time_t mtime) {
   char size[64], mod[64], href[MAX_PATH_SIZE * 3], path[MAX_PATH_SIZE];
-  int64_t fsize = stp->st_size;
-  int is_dir = S_ISDIR(stp->st_mode);
   const char *slash = is_dir ? "/" : "";
 
   if (is_dir) {
@@ -6098,7 +7157,7 @@ static void mg_print_dir_entry(struct mg_connection *nc, const char *file_name,
       snprintf(size, sizeof(size), "%.1fG", (double) fsize / 1073741824);
     }
   }
-  strftime(mod, sizeof(mod), "%d-%b-%Y %H:%M", localtime(&stp->st_mtime));
+  strftime(mod, sizeof(mod), "%d-%b-%Y %H:%M", localtime(&mtime));
   mg_escape(file_name, path, sizeof(path));
   mg_url_encode(file_name, strlen(file_name), href, sizeof(href));
   mg_printf_http_chunk(nc,
@@ -6108,14 +7167,405 @@ static void mg_print_dir_entry(struct mg_connection *nc, const char *file_name,
                        size);
 }
 
+static void mg_print_dir_entry_json(struct mg_connection *nc,
+                                    const char *file_name, int is_dir,
+                                    int64_t fsize, time_t mtime, int first) {
+  char name[MAX_PATH_SIZE * 2];
+  mg_json_escape(file_name, name, sizeof(name));
+  mg_printf_http_chunk(nc,
+                       "%s\n{\"name\":\"%s\",\"type\":\"%s\","
+                       "\"size\":%" INT64_FMT ",\"mtime\":%lu}",
+                       first ? "" : ",", name, is_dir ? "dir" : "file",
+                       is_dir ? (int64_t) 0 : fsize, (unsigned long) mtime);
+}
+
+/*
+ * Directory listing index.
+ *
+ * A listing is built incrementally, at most MG_DIR_SCAN_BATCH entries per
+ * poll iteration, so that huge directories do not stall other connections.
+ * Once complete, the entries are sorted and the index is kept in the
+ * manager's cache, shared between connections, until the directory mtime
+ * changes or the index expires.
+ */
+#if CS_PLATFORM == CS_P_UNIX && defined(__linux__)
+#include <sys/syscall.h>
+#if defined(SYS_getdents64)
+#define MG_DIR_USE_GETDENTS64
+#define MG_DIR_GETDENTS_BUF_SIZE 65536
+
+struct mg_linux_dirent64 {
+  uint64_t d_ino;
+  int64_t d_off;
+  unsigned short d_reclen;
+  unsigned char d_type;
+  char d_name[1];
+};
+#endif
+#endif
+
+struct mg_dir_entry {
+  size_t name_off;  /* Offset of the name in mg_dir_index::names */
+  const char *name; /* Set once the index is complete */
+  int64_t size;
+  time_t mtime;
+  int is_dir;
+};
+
+struct mg_dir_index {
+  struct mg_dir_index *next; /* mg_mgr::dir_cache linkage */
+  char *path;
+  char *auth_file;      /* Hidden file patterns the index was built with */
+  char *hidden_pattern; /* ... */
+  time_t dir_mtime;     /* Directory mtime when the scan started */
+  double created;       /* When the scan started */
+  double last_used;
+  struct mbuf names;   /* NUL-terminated entry names */
+  struct mbuf entries; /* Array of struct mg_dir_entry */
+  size_t num_entries;
+  int refcnt;   /* Number of connections using this index */
+  int cached;   /* Linked into mg_mgr::dir_cache */
+  int complete; /* Scan finished and entries are sorted */
+#if defined(MG_DIR_USE_GETDENTS64)
+  int fd;
+  char *dbuf;
+  size_t dbuf_pos, dbuf_len;
+#else
+  DIR *dirp;
+#endif
+};
+
+static char *mg_dir_strdup(const char *s) {
+  return s == NULL ? NULL : strdup(s);
+}
+
+static int mg_dir_streq(const char *a, const char *b) {
+  return (a == NULL || b == NULL) ? a == b : strcmp(a, b) == 0;
+}
+
+static int mg_dir_entry_cmp(const void *a, const void *b) {
+  const struct mg_dir_entry *e1 = (const struct mg_dir_entry *) a;
+  const struct mg_dir_entry *e2 = (const struct mg_dir_entry *) b;
+  if (e1->is_dir != e2->is_dir) return e2->is_dir - e1->is_dir;
+  return strcmp(e1->name, e2->name);
+}
+
+static void mg_dir_index_close(struct mg_dir_index *idx) {
+#if defined(MG_DIR_USE_GETDENTS64)
+  if (idx->fd >= 0) close(idx->fd);
+  idx->fd = -1;
+  MG_FREE(idx->dbuf);
+  idx->dbuf = NULL;
+#else
+  if (idx->dirp != NULL) closedir(idx->dirp);
+  idx->dirp = NULL;
+#endif
+}
+
+static void mg_dir_index_free(struct mg_dir_index *idx) {
+  mg_dir_index_close(idx);
+  mbuf_free(&idx->names);
+  mbuf_free(&idx->entries);
+  MG_FREE(idx->path);
+  MG_FREE(idx->auth_file);
+  MG_FREE(idx->hidden_pattern);
+  MG_FREE(idx);
+}
+
+/*
+ * Fetch the next directory entry. Return 1 on success, 0 when the directory
+ * is exhausted or cannot be read.
+ */
+static int mg_dir_index_next(struct mg_dir_index *idx, const char **name,
+                             cs_stat_t *st) {
+#if defined(MG_DIR_USE_GETDENTS64)
+  struct mg_linux_dirent64 *dp;
+  for (;;) {
+    if (idx->dbuf_pos >= idx->dbuf_len) {
+      long n = syscall(SYS_getdents64, idx->fd, idx->dbuf,
+                       MG_DIR_GETDENTS_BUF_SIZE);
+      if (n <= 0) return 0;
+      idx->dbuf_len = (size_t) n;
+      idx->dbuf_pos = 0;
+    }
+    dp = (struct mg_linux_dirent64 *) (idx->dbuf + idx->dbuf_pos);
+    idx->dbuf_pos += dp->d_reclen;
+    /* Entry can vanish between getdents64() and fstatat(), skip it then */
+    if (fstatat(idx->fd, dp->d_name, st, 0) == 0) {
+      *name = dp->d_name;
+      return 1;
+    }
+  }
+#else
+  struct dirent *dp;
+#if CS_PLATFORM != CS_P_UNIX
+  char path[MAX_PATH_SIZE];
+#endif
+  while ((dp = readdir(idx->dirp)) != NULL) {
+#if CS_PLATFORM == CS_P_UNIX
+    if (fstatat(dirfd(idx->dirp), dp->d_name, st, 0) == 0) {
+#else
+    snprintf(path, sizeof(path), "%s/%s", idx->path, dp->d_name);
+    if (mg_stat(path, st) == 0) {
+#endif
+      *name = dp->d_name;
+      return 1;
+    }
+  }
+  return 0;
+#endif
+}
+
+/* Scan up to `max` directory entries. Sort the index once it's complete. */
+static void mg_dir_index_scan(struct mg_dir_index *idx, int max) {
+  struct mg_serve_http_opts opts;
+  struct mg_dir_entry e, *entries;
+  const char *name;
+  cs_stat_t st;
+  size_t i;
+
+  if (idx->complete) return;
+  memset(&opts, 0, sizeof(opts));
+  opts.per_directory_auth_file = idx->auth_file;
+  opts.hidden_file_pattern = idx->hidden_pattern;
+
+  while (max-- > 0) {
+    if (!mg_dir_index_next(idx, &name, &st)) {
+      mg_dir_index_close(idx);
+      mbuf_trim(&idx->names);
+      mbuf_trim(&idx->entries);
+      entries = (struct mg_dir_entry *) idx->entries.buf;
+      for (i = 0; i < idx->num_entries; i++) {
+        entries[i].name = idx->names.buf + entries[i].name_off;
+      }
+      if (idx->num_entries > 1) {
+        qsort(entries, idx->num_entries, sizeof(*entries), mg_dir_entry_cmp);
+      }
+      idx->complete = 1;
+      DBG(("%s: %d entries in %.3f s", idx->path, (int) idx->num_entries,
+           mg_time() - idx->created));
+      return;
+    }
+    /* Do not show current dir and hidden files */
+    if (mg_is_file_hidden(name, &opts, 1)) {
+      continue;
+    }
+    memset(&e, 0, sizeof(e));
+    e.name_off = idx->names.len;
+    e.size = st.st_size;
+    e.mtime = st.st_mtime;
+    e.is_dir = S_ISDIR(st.st_mode);
+    mbuf_append(&idx->names, name, strlen(name) + 1);
+    mbuf_append(&idx->entries, &e, sizeof(e));
+    idx->num_entries++;
+  }
+}
+
+static struct mg_dir_index *mg_dir_index_create(
+    const char *dir, const struct mg_serve_http_opts *opts, time_t mtime) {
+  struct mg_dir_index *idx =
+      (struct mg_dir_index *) MG_CALLOC(1, sizeof(*idx));
+  int ok;
+
+  if (idx == NULL) return NULL;
+  idx->path = mg_dir_strdup(dir);
+  idx->auth_file = mg_dir_strdup(opts->per_directory_auth_file);
+  idx->hidden_pattern = mg_dir_strdup(opts->hidden_file_pattern);
+  idx->dir_mtime = mtime;
+  idx->created = idx->last_used = mg_time();
+  mbuf_init(&idx->names, 0);
+  mbuf_init(&idx->entries, 0);
+#if defined(MG_DIR_USE_GETDENTS64)
+  idx->fd = open(dir, O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+  idx->dbuf = (char *) MG_MALLOC(MG_DIR_GETDENTS_BUF_SIZE);
+  ok = idx->fd >= 0 && idx->dbuf != NULL;
+#else
+  ok = (idx->dirp = opendir(dir)) != NULL;
+#endif
+  if (!ok) {
+    DBG(("opendir(%s) -> %d", dir, errno));
+    mg_dir_index_close(idx);
+    /* Serve an empty listing, like a directory we cannot read */
+    idx->complete = 1;
+  }
+  return idx;
+}
+
+static void mg_dir_index_release(struct mg_dir_index *idx) {
+  if (--idx->refcnt <= 0 && !idx->cached) {
+    mg_dir_index_free(idx);
+  }
+}
+
+static void mg_dir_cache_unlink(struct mg_mgr *mgr, struct mg_dir_index *idx) {
+  struct mg_dir_index **p;
+  for (p = &mgr->dir_cache; *p != NULL; p = &(*p)->next) {
+    if (*p == idx) {
+      *p = idx->next;
+      break;
+    }
+  }
+  idx->cached = 0;
+  idx->next = NULL;
+  if (idx->refcnt <= 0) mg_dir_index_free(idx);
+}
+
+/*
+ * Find a valid cached index for the directory or start building a new one.
+ * Returned index is referenced and must be released with
+ * `mg_dir_index_release()`.
+ */
+static struct mg_dir_index *mg_dir_index_get(
+    struct mg_mgr *mgr, const char *dir,
+    const struct mg_serve_http_opts *opts) {
+  struct mg_dir_index *idx, *tmp, *lru = NULL;
+  double now = mg_time();
+  cs_stat_t st;
+  int n = 0;
+
+  memset(&st, 0, sizeof(st));
+  mg_stat(dir, &st);
+
+  for (idx = mgr->dir_cache; idx != NULL; idx = tmp) {
+    tmp = idx->next;
+    if (strcmp(idx->path, dir) == 0 &&
+        mg_dir_streq(idx->auth_file, opts->per_directory_auth_file) &&
+        mg_dir_streq(idx->hidden_pattern, opts->hidden_file_pattern)) {
+      /*
+       * A directory modified in the same second the scan started could have
+       * changed after it, so such an index is not reused.
+       */
+      if (!idx->complete ||
+          (idx->dir_mtime == st.st_mtime &&
+           idx->dir_mtime < (time_t) idx->created &&
+           now - idx->created < MG_DIR_INDEX_TTL)) {
+        idx->refcnt++;
+        idx->last_used = now;
+        return idx;
+      }
+      mg_dir_cache_unlink(mgr, idx);
+      continue;
+    }
+    if (idx->refcnt <= 0 && (lru == NULL || idx->last_used < lru->last_used)) {
+      lru = idx;
+    }
+    n++;
+  }
+
+  if (n >= MG_DIR_INDEX_CACHE_SIZE && lru != NULL) {
+    mg_dir_cache_unlink(mgr, lru);
+  }
+
+  if ((idx = mg_dir_index_create(dir, opts, st.st_mtime)) != NULL) {
+    idx->refcnt = 1;
+    if (!idx->complete) {
+      idx->cached = 1;
+      idx->next = mgr->dir_cache;
+      mgr->dir_cache = idx;
+    }
+  }
+  return idx;
+}
+
+MG_INTERNAL void mg_http_free_dir_cache(struct mg_mgr *mgr) {
+  struct mg_dir_index *idx, *tmp;
+  for (idx = mgr->dir_cache; idx != NULL; idx = tmp) {
+    tmp = idx->next;
+    idx->cached = 0;
+    if (idx->refcnt <= 0) mg_dir_index_free(idx);
+  }
+  mgr->dir_cache = NULL;
+}
+
+static void mg_http_free_proto_data_dir(struct mg_http_proto_data_dir *d) {
+  if (d != NULL) {
+    if (d->idx != NULL) mg_dir_index_release(d->idx);
+    MG_FREE(d->uri);
+    memset(d, 0, sizeof(*d));
+  }
+}
+
+static void mg_http_transfer_dir_data(struct mg_connection *nc) {
+  struct mg_http_proto_data *pd = mg_http_get_proto_data(nc);
+  struct mg_http_proto_data_dir *d = &pd->dir;
+  struct mg_dir_index *idx = d->idx;
+  const struct mg_dir_entry *e;
+
+  if (!idx->complete) {
+    mg_dir_index_scan(idx, MG_DIR_SCAN_BATCH);
+    if (!idx->complete) {
+      /* Come back on the next poll iteration without waiting for IO */
+      mg_set_timer(nc, mg_time());
+      return;
+    }
+  }
+
+  if (!d->started) {
+    d->started = 1;
+    d->pos = d->offset = MIN(d->offset, idx->num_entries);
+    d->end = idx->num_entries;
+    if (d->limit > 0 && d->limit < d->end - d->pos) {
+      d->end = d->pos + d->limit;
+    }
+    if (d->json) {
+      char uri[MAX_PATH_SIZE * 2];
+      mg_json_escape(d->uri, uri, sizeof(uri));
+      mg_printf_http_chunk(nc,
+                           "{\"path\":\"%s\",\"total\":%lu,\"offset\":%lu,"
+                           "\"entries\":[",
+                           uri, (unsigned long) idx->num_entries,
+                           (unsigned long) d->pos);
+    }
+  }
+
+  e = (const struct mg_dir_entry *) idx->entries.buf;
+  while (d->pos < d->end && nc->send_mbuf.len < MG_MAX_HTTP_SEND_MBUF) {
+    if (d->json) {
+      mg_print_dir_entry_json(nc, e[d->pos].name, e[d->pos].is_dir,
+                              e[d->pos].size, e[d->pos].mtime,
+                              d->pos == d->offset);
+    } else {
+      mg_print_dir_entry(nc, e[d->pos].name, e[d->pos].is_dir, e[d->pos].size,
+                         e[d->pos].mtime);
+    }
+    d->pos++;
+  }
+
+  if (d->pos >= d->end) {
+    if (d->json) {
+      mg_printf_http_chunk(nc, "\n]}\n");
+    } else {
+      if (d->end < idx->num_entries) {
+        mg_printf_http_chunk(nc,
+                             "<tr><td colspan=3><a href=\"?offset=%lu&limit="
+                             "%lu\">Next page</a></td></tr>\n",
+                             (unsigned long) d->end, (unsigned long) d->limit);
+      }
+      mg_printf_http_chunk(nc,
+                           "</tbody><tr><td colspan=3><hr></td></tr>\n"
+                           "</table>\n"
+                           "<address>%s</address>\n"
+                           "</body></html>",
+                           mg_version_header);
+    }
+    mg_send_http_chunk(nc, "", 0);
+    /* TODO(rojer): Remove when cesanta/dev/issues/197 is fixed. */
+    nc->flags |= MG_F_SEND_AND_CLOSE;
+    mg_http_free_proto_data_dir(d);
+  }
+}
+
+#ifndef MG_DISABLE_DAV
 static void mg_scan_directory(struct mg_connection *nc, const char *dir,
                               const struct mg_serve_http_opts *opts,
                               void (*func)(struct mg_connection *, const char *,
                                            cs_stat_t *)) {
-  char path[MAX_PATH_SIZE];
   cs_stat_t st;
   struct dirent *dp;
   DIR *dirp;
+#if CS_PLATFORM != CS_P_UNIX
+  char path[MAX_PATH_SIZE];
+#endif
 
   DBG(("%p [%s]", nc, dir));
   if ((dirp = (opendir(dir))) != NULL) {
@@ -6124,8 +7574,12 @@ static void mg_scan_directory(struct mg_connection *nc, const char *dir,
       if (mg_is_file_hidden((const char *) dp->d_name, opts, 1)) {
         continue;
       }
+#if CS_PLATFORM == CS_P_UNIX
+      if (fstatat(dirfd(dirp), dp->d_name, &st, 0) == 0) {
+#else
       snprintf(path, sizeof(path), "%s/%s", dir, dp->d_name);
       if (mg_stat(path, &st) == 0) {
+#endif
         func(nc, (const char *) dp->d_name, &st);
       }
     }
@@ -6134,6 +7588,7 @@ static void mg_scan_directory(struct mg_connection *nc, const char *dir,
     DBG(("%p opendir(%s) -> %d", nc, dir, errno));
   }
 }
+#endif /* MG_DISABLE_DAV */
 
 static void mg_send_directory_listing(struct mg_connection *nc, const char *dir,
                                       struct http_message *hm,
@@ -6161,35 +7616,50 @@ static void mg_send_directory_listing(struct mg_connection *nc, const char *dir,
       "srt(tb, sc, so, true);"
       "}"
       "</script>";
+  struct mg_http_proto_data *pd = mg_http_get_proto_data(nc);
+  struct mg_http_proto_data_dir *d = &pd->dir;
+  char buf[50];
+
+  mg_http_free_proto_data_dir(d);
+  if (mg_get_http_var(&hm->query_string, "offset", buf, sizeof(buf)) > 0) {
+    d->offset = (size_t) strtoul(buf, NULL, 10);
+  }
+  if (mg_get_http_var(&hm->query_string, "limit", buf, sizeof(buf)) > 0) {
+    d->limit = (size_t) strtoul(buf, NULL, 10);
+  }
+  if (mg_get_http_var(&hm->query_string, "format", buf, sizeof(buf)) > 0) {
+    d->json = strcmp(buf, "json") == 0;
+  }
+  if ((d->uri = (char *) MG_MALLOC(hm->uri.len + 1)) == NULL ||
+      (d->idx = mg_dir_index_get(nc->mgr, dir, opts)) == NULL) {
+    mg_http_free_proto_data_dir(d);
+    mg_http_send_error(nc, 500, NULL);
+    return;
+  }
+  memcpy(d->uri, hm->uri.p, hm->uri.len);
+  d->uri[hm->uri.len] = '\0';
 
   mg_send_response_line(nc, 200, opts->extra_headers);
   mg_printf(nc, "%s: %s\r\n%s: %s\r\n\r\n", "Transfer-Encoding", "chunked",
-            "Content-Type", "text/html; charset=utf-8");
-
-  mg_printf_http_chunk(
-      nc,
-      "<html><head><title>Index of %.*s</title>%s%s"
-      "<style>th,td {text-align: left; padding-right: 1em; "
-      "font-family: monospace; }</style></head>\n"
-      "<body><h1>Index of %.*s</h1>\n<table cellpadding=0><thead>"
-      "<tr><th><a href=# rel=0>Name</a></th><th>"
-      "<a href=# rel=1>Modified</a</th>"
-      "<th><a href=# rel=2>Size</a></th></tr>"
-      "<tr><td colspan=3><hr></td></tr>\n"
-      "</thead>\n"
-      "<tbody id=tb>",
-      (int) hm->uri.len, hm->uri.p, sort_js_code, sort_js_code2,
-      (int) hm->uri.len, hm->uri.p);
-  mg_scan_directory(nc, dir, opts, mg_print_dir_entry);
-  mg_printf_http_chunk(nc,
-                       "</tbody><tr><td colspan=3><hr></td></tr>\n"
-                       "</table>\n"
-                       "<address>%s</address>\n"
-                       "</body></html>",
-                       mg_version_header);
-  mg_send_http_chunk(nc, "", 0);
-  /* TODO(rojer): Remove when cesanta/dev/issues/197 is fixed. */
-  nc->flags |= MG_F_SEND_AND_CLOSE;
+            "Content-Type", d->json ? "application/json; charset=utf-8"
+                                    : "text/html; charset=utf-8");
+  if (!d->json) {
+    mg_printf_http_chunk(
+        nc,
+        "<html><head><title>Index of %.*s</title>%s%s"
+        "<style>th,td {text-align: left; padding-right: 1em; "
+        "font-family: monospace; }</style></head>\n"
+        "<body><h1>Index of %.*s</h1>\n<table cellpadding=0><thead>"
+        "<tr><th><a href=# rel=0>Name</a></th><th>"
+        "<a href=# rel=1>Modified</a</th>"
+        "<th><a href=# rel=2>Size</a></th></tr>"
+        "<tr><td colspan=3><hr></td></tr>\n"
+        "</thead>\n"
+        "<tbody id=tb>",
+        (int) hm->uri.len, hm->uri.p, sort_js_code, sort_js_code2,
+        (int) hm->uri.len, hm->uri.p);
+  }
+  mg_http_transfer_dir_data(nc);
 }
 #endif /* MG_DISABLE_DIRECTORY_LISTING */
 
@@ -6386,12 +7856,44 @@ static int mg_create_itermediate_directories(const char *path) {
   return 1;
 }
 
+/*
+ * Reserves disk space for an upload. The file size is left alone, so that
+ * an interrupted upload can be resumed from what was actually written.
+ * Returns -1 with errno set only if the disk is known to be full.
+ */
+static int mg_http_put_reserve(FILE *fp, int64_t off, int64_t len) {
+#ifdef MG_HTTP_PUT_FALLOCATE
+  if (len > 0 && syscall(SYS_fallocate, fileno(fp), FALLOC_FL_KEEP_SIZE,
+                         (off_t) off, (off_t) len) != 0 &&
+      errno == ENOSPC) {
+    return -1;
+  }
+#else
+  (void) fp;
+  (void) off;
+  (void) len;
+#endif
+  return 0;
+}
+
 static void mg_handle_put(struct mg_connection *nc, const char *path,
                           struct http_message *hm) {
   struct mg_http_proto_data *pd = mg_http_get_proto_data(nc);
   cs_stat_t st;
   const struct mg_str *cl_hdr = mg_get_http_header(hm, "Content-Length");
-  int rc, status_code = mg_stat(path, &st) == 0 ? 200 : 201;
+  const struct mg_str *range_hdr = mg_get_http_header(hm, "Content-Range");
+  int64_t r1 = 0, r2 = 0;
+  int rc, exists = mg_stat(path, &st) == 0;
+  int status_code = exists ? 200 : 201;
+
+  /* A range resumes an upload: write into the file instead of replacing it */
+  if (range_hdr != NULL &&
+      mg_http_parse_content_range(range_hdr, &r1, &r2) > 0 && r1 >= 0) {
+    status_code = 206;
+  } else {
+    r1 = 0;
+    range_hdr = NULL;
+  }
 
   mg_http_free_proto_data_file(&pd->file);
   if ((rc = mg_create_itermediate_directories(path)) == 0) {
@@ -6400,24 +7902,40 @@ static void mg_handle_put(struct mg_connection *nc, const char *path,
     mg_http_send_error(nc, 500, NULL);
   } else if (cl_hdr == NULL) {
     mg_http_send_error(nc, 411, NULL);
-  } else if ((pd->file.fp = fopen(path, "w+b")) == NULL) {
+  } else if ((pd->file.fp = fopen(
+                  path, range_hdr != NULL && exists ? "r+b" : "w+b")) == NULL) {
     mg_http_send_error(nc, 500, NULL);
   } else {
-    const struct mg_str *range_hdr = mg_get_http_header(hm, "Content-Range");
-    int64_t r1 = 0, r2 = 0;
     pd->file.type = DATA_PUT;
     mg_set_close_on_exec(fileno(pd->file.fp));
     pd->file.cl = to64(cl_hdr->p);
-    if (range_hdr != NULL &&
-        mg_http_parse_range_header(range_hdr, &r1, &r2) > 0) {
-      status_code = 206;
-      fseeko(pd->file.fp, r1, SEEK_SET);
-      pd->file.cl = r2 > r1 ? r2 - r1 + 1 : pd->file.cl - r1;
+    pd->file.start = r1;
+    pd->file.status = status_code;
+    pd->file.keepalive = mg_http_is_keep_alive(hm);
+    pd->file.recv_mbuf_limit = nc->recv_mbuf_limit;
+#if CS_PLATFORM != CS_P_UNIX
+    /* No pwrite(): position the stream once and write through stdio */
+    setvbuf(pd->file.fp, NULL, _IONBF, 0);
+    fseeko(pd->file.fp, r1, SEEK_SET);
+#endif
+    if (mg_http_put_reserve(pd->file.fp, r1, pd->file.cl) != 0) {
+      mg_http_put_done(nc, errno);
+    } else if (!mg_http_is_body_pending(nc, hm)) {
+      /* The whole body is buffered already */
+      size_t len = (int64_t) hm->body.len < pd->file.cl ? hm->body.len
+                                                         : (size_t) pd->file.cl;
+      if (mg_http_put_write(&pd->file, hm->body.p, len) < len) {
+        mg_http_put_done(nc, errno != 0 ? errno : EIO);
+      } else {
+        mg_http_put_done(nc, 0);
+      }
+    } else if (nc->recv_mbuf_limit > MG_HTTP_PUT_BUFFER_SIZE) {
+      /*
+       * MG_EV_HTTP_PUT_REQUEST: the body is streamed as it arrives. Bound
+       * the read-ahead so that reading pauses while the disk catches up.
+       */
+      nc->recv_mbuf_limit = MG_HTTP_PUT_BUFFER_SIZE;
     }
-    mg_printf(nc, "HTTP/1.1 %d OK\r\nContent-Length: 0\r\n\r\n", status_code);
-    /* Remove HTTP request from the mbuf, leave only payload */
-    mbuf_remove(&nc->recv_mbuf, hm->message.len - hm->body.len);
-    mg_http_transfer_file_data(nc);
   }
 }
 #endif /* MG_DISABLE_DAV */
@@ -7037,6 +8555,7 @@ static void mg_cgi_ev_handler(struct mg_connection *cgi_nc, int ev,
           }
         }
         nc->flags &= ~MG_F_USER_1;
+        mg_http_metrics_update(nc);
       }
       if (!(nc->flags & MG_F_USER_1)) {
         mg_forward(cgi_nc, nc);
@@ -7203,6 +8722,12 @@ MG_INTERNAL void mg_send_http_file(struct mg_connection *nc, char *path,
       (mg_match_prefix(opts->cgi_file_pattern, strlen(opts->cgi_file_pattern),
                        index_file ? index_file : path) > 0);
 
+  if (is_cgi && mg_http_is_body_pending(nc, hm)) {
+    /* CGI takes the whole body, wait for MG_EV_HTTP_REQUEST */
+    MG_FREE(index_file);
+    return;
+  }
+
   DBG(("%p %.*s [%s] exists=%d is_dir=%d is_dav=%d is_cgi=%d index=%s", nc,
        (int) hm->method.len, hm->method.p, path, exists, is_directory, is_dav,
        is_cgi, index_file ? index_file : ""));
@@ -7284,10 +8809,69 @@ MG_INTERNAL void mg_send_http_file(struct mg_connection *nc, char *path,
   MG_FREE(index_file);
 }
 
+/* Parse bandwidth limit like "512k", return bytes per second */
+static double mg_parse_rate(const struct mg_str *s) {
+  char buf[50];
+  double rate;
+  snprintf(buf, sizeof(buf), "%.*s", (int) s->len, s->p);
+  rate = strtod(buf, NULL);
+  switch (s->len > 0 ? tolower(*(unsigned char *) &s->p[s->len - 1]) : 0) {
+    case 'g':
+      rate *= 1024;
+    /* fallthrough */
+    case 'm':
+      rate *= 1024;
+    /* fallthrough */
+    case 'k':
+      rate *= 1024;
+      break;
+  }
+  return rate;
+}
+
+/* Attach bandwidth shaping buckets configured by `opts->rate_limit`. */
+static void mg_http_set_rate_limits(struct mg_connection *nc,
+                                    struct http_message *hm,
+                                    const struct mg_serve_http_opts *opts) {
+  struct mg_str key, val;
+  const char *list = opts->rate_limit;
+  char name[MAX_PATH_SIZE];
+  size_t longest = 0;
+  double rate;
+
+  /* URI prefix bucket is chosen per request */
+  mg_set_bucket(nc, 3, NULL);
+  while ((list = mg_next_comma_list_entry(list, &key, &val)) != NULL) {
+    if ((rate = mg_parse_rate(&val)) <= 0) continue;
+    if (mg_vcmp(&key, "*") == 0) {
+      if (nc->buckets[0] == NULL) {
+        mg_set_bucket(nc, 0, mg_bucket_get(nc->mgr, "*", rate));
+      }
+    } else if (mg_vcmp(&key, "ip") == 0) {
+      if (nc->buckets[1] == NULL) {
+        snprintf(name, sizeof(name), "ip:");
+        mg_sock_addr_to_str(&nc->sa, name + 3, sizeof(name) - 3,
+                            MG_SOCK_STRINGIFY_IP);
+        mg_set_bucket(nc, 1, mg_bucket_get(nc->mgr, name, rate));
+      }
+    } else if (mg_vcmp(&key, "conn") == 0) {
+      if (nc->buckets[2] == NULL) {
+        mg_set_bucket(nc, 2, mg_bucket_get(nc->mgr, NULL, rate));
+      }
+    } else if (key.len > longest && key.len < sizeof(name) &&
+               key.len <= hm->uri.len &&
+               memcmp(key.p, hm->uri.p, key.len) == 0) {
+      longest = key.len;
+      snprintf(name, sizeof(name), "%.*s", (int) key.len, key.p);
+      mg_set_bucket(nc, 3, mg_bucket_get(nc->mgr, name, rate));
+    }
+  }
+}
+
 void mg_serve_http(struct mg_connection *nc, struct http_message *hm,
                    struct mg_serve_http_opts opts) {
-  char *path = NULL;
-  struct mg_str *hdr, path_info;
+  char *path = NULL, uri_buf[MAX_PATH_SIZE];
+  struct mg_str *hdr, path_info, uri = hm->uri;
   uint32_t remote_ip = ntohl(*(uint32_t *) &nc->sa.sin.sin_addr);
 
   if (mg_check_ip_acl(opts.ip_acl, remote_ip) != 1) {
@@ -7319,16 +8903,34 @@ void mg_serve_http(struct mg_connection *nc, struct http_message *hm,
   if (opts.index_files == NULL) {
     opts.index_files = "index.html,index.htm,index.shtml,index.cgi,index.php";
   }
+  if (mg_http_is_body_pending(nc, hm)) {
+    /*
+     * MG_EV_HTTP_PUT_REQUEST. Only uploads are served before the body, and
+     * the request may yet come again as MG_EV_HTTP_REQUEST, so the URI is
+     * normalized in a copy rather than in recv_mbuf.
+     */
+    if (mg_vcmp(&hm->method, "PUT") != 0 || hm->uri.len > sizeof(uri_buf)) {
+      return;
+    }
+    memcpy(uri_buf, hm->uri.p, hm->uri.len);
+    hm->uri.p = uri_buf;
+  }
   /* Normalize path - resolve "." and ".." (in-place). */
   if (!mg_normalize_uri_path(&hm->uri, &hm->uri)) {
     mg_http_send_error(nc, 400, NULL);
-    return;
+  } else {
+    if (opts.rate_limit != NULL) {
+      mg_http_set_rate_limits(nc, hm, &opts);
+    }
+    if (mg_uri_to_local_path(hm, &opts, &path, &path_info) == 0) {
+      mg_http_send_error(nc, 404, NULL);
+    } else {
+      mg_send_http_file(nc, path, &path_info, hm, &opts);
+    }
   }
-  if (mg_uri_to_local_path(hm, &opts, &path, &path_info) == 0) {
-    mg_http_send_error(nc, 404, NULL);
-    return;
+  if (hm->uri.p == uri_buf) {
+    hm->uri = uri;
   }
-  mg_send_http_file(nc, path, &path_info, hm, &opts);
 
   MG_FREE(path);
   path = NULL;
@@ -7397,20 +8999,112 @@ cleanup:
   return -1;
 }
 
-struct mg_connection *mg_connect_http_base(
-    struct mg_mgr *mgr, mg_event_handler_t ev_handler,
-    struct mg_connect_opts opts, const char *schema, const char *schema_ssl,
-    const char *url, const char **path, char **addr) {
-  struct mg_connection *nc = NULL;
-  int port_i = -1;
-  int use_ssl = 0;
+/*
+ * Idle pooled client connection. It stays in the active list so that the
+ * server closing it is noticed, and carries this as its proto data.
+ */
+struct mg_http_pool_entry {
+  struct mg_http_pool_entry *next; /* mg_mgr::http_pool linkage */
+  struct mg_connection *nc;
+  char *key;
+};
 
-  if (mg_http_common_url_parse(url, schema, schema_ssl, &use_ssl, addr, &port_i,
-                               path) < 0) {
-    return NULL;
+static void mg_http_pool_entry_free(void *proto_data) {
+  struct mg_http_pool_entry *e = (struct mg_http_pool_entry *) proto_data;
+  struct mg_http_pool_entry **p;
+  for (p = &e->nc->mgr->http_pool; *p != NULL; p = &(*p)->next) {
+    if (*p == e) {
+      *p = e->next;
+      break;
+    }
   }
+  MG_FREE(e->key);
+  MG_FREE(e);
+}
+
+static void mg_http_pool_handler(struct mg_connection *nc, int ev,
+                                 void *ev_data) {
+  (void) ev_data;
+  switch (ev) {
+    case MG_EV_RECV:
+    /* Servers have nothing to say between requests */
+    case MG_EV_TIMER:
+      nc->flags |= MG_F_CLOSE_IMMEDIATELY;
+      break;
+  }
+}
+
+MG_INTERNAL int mg_http_pool_park(struct mg_connection *nc) {
+  struct mg_http_proto_data *pd;
+  struct mg_http_pool_entry *e;
+  int n = 0;
+
+  if (nc->proto_data_destructor != mg_http_conn_destructor) return 0;
+  pd = (struct mg_http_proto_data *) nc->proto_data;
+  if (pd->pool.key == NULL || !pd->pool.reusable || nc->err != 0 ||
+      nc->send_mbuf.len > 0 || nc->recv_mbuf.len > 0 ||
+      (nc->flags & (MG_F_PEER_CLOSED | MG_F_IS_WEBSOCKET | MG_F_CONNECTING |
+                    MG_F_RESOLVING))) {
+    return 0;
+  }
+  for (e = nc->mgr->http_pool; e != NULL; e = e->next) n++;
+  if (n >= MG_HTTP_POOL_SIZE ||
+      (e = (struct mg_http_pool_entry *) MG_CALLOC(1, sizeof(*e))) == NULL) {
+    return 0;
+  }
+
+  /* To the handler, the connection is gone */
+  mg_call(nc, NULL, MG_EV_CLOSE, NULL);
+
+  DBG(("%p pooled for %s", nc, pd->pool.key));
+  e->nc = nc;
+  e->key = pd->pool.key;
+  pd->pool.key = NULL;
+  nc->proto_data_destructor(nc->proto_data);
+  nc->proto_data = e;
+  nc->proto_data_destructor = mg_http_pool_entry_free;
+  nc->proto_handler = nc->handler = mg_http_pool_handler;
+  nc->user_data = NULL;
+  nc->flags &= ~_MG_CALLBACK_MODIFIABLE_FLAGS_MASK;
+  nc->ev_timer_time = mg_time() + MG_HTTP_POOL_IDLE_TIMEOUT;
+  e->next = nc->mgr->http_pool;
+  nc->mgr->http_pool = e;
+
+  return 1;
+}
+
+/* Takes the most recently parked connection for `key` out of the pool. */
+static struct mg_connection *mg_http_pool_take(struct mg_mgr *mgr,
+                                               const char *key,
+                                               mg_event_handler_t ev_handler,
+                                               struct mg_connect_opts opts) {
+  struct mg_http_pool_entry *e;
+  struct mg_connection *nc;
+
+  for (e = mgr->http_pool; e != NULL; e = e->next) {
+    if (strcmp(e->key, key) == 0) break;
+  }
+  if (e == NULL) return NULL;
+
+  nc = e->nc;
+  mg_http_pool_entry_free(e);
+  nc->proto_data = NULL;
+  nc->proto_data_destructor = NULL;
+  nc->handler = ev_handler;
+  nc->user_data = opts.user_data;
+  nc->flags |= opts.flags & _MG_ALLOWED_CONNECT_FLAGS_MASK;
+  nc->ev_timer_time = 0;
+  mg_set_protocol_http_websocket(nc);
+  DBG(("%p reused for %s", nc, key));
+
+  return nc;
+}
+
+static struct mg_connection *mg_connect_http_addr(
+    struct mg_mgr *mgr, mg_event_handler_t ev_handler,
+    struct mg_connect_opts opts, int use_ssl, char **addr, int port_i) {
+  struct mg_connection *nc = NULL;
 
-  LOG(LL_DEBUG, ("%s use_ssl? %d", url, use_ssl));
   if (use_ssl) {
 #ifdef MG_ENABLE_SSL
     /*
@@ -7423,7 +9117,8 @@ struct mg_connection *mg_connect_http_base(
     }
 #else
     MG_SET_PTRPTR(opts.error_string, "ssl is disabled");
-    MG_FREE(addr);
+    MG_FREE(*addr);
+    *addr = NULL;
     return NULL;
 #endif
   }
@@ -7437,6 +9132,59 @@ struct mg_connection *mg_connect_http_base(
   return nc;
 }
 
+/*
+ * Like mg_connect_http_base() for HTTP URLs. With MG_F_HTTP_POOL, hands out
+ * an idle pooled connection to the same server if there is one.
+ */
+static struct mg_connection *mg_connect_http_pooled(
+    struct mg_mgr *mgr, mg_event_handler_t ev_handler,
+    struct mg_connect_opts opts, const char *url, const char **path,
+    char **addr, int *reused) {
+  struct mg_connection *nc = NULL;
+  int port_i = -1, use_ssl = 0, poolable = opts.flags & MG_F_HTTP_POOL;
+  char key[MG_MAX_HOST_LEN + 10];
+
+#ifdef MG_ENABLE_SSL
+  poolable = poolable && opts.ssl_cert == NULL && opts.ssl_ca_cert == NULL;
+#endif
+
+  *reused = 0;
+  if (mg_http_common_url_parse(url, "http://", "https://", &use_ssl, addr,
+                               &port_i, path) < 0) {
+    return NULL;
+  }
+
+  /* `addr` always has the port at this point */
+  snprintf(key, sizeof(key), "%s%s", use_ssl ? "https://" : "http://", *addr);
+  if (poolable && (nc = mg_http_pool_take(mgr, key, ev_handler, opts)) != NULL) {
+    if (port_i >= 0) (*addr)[port_i] = '\0';
+    *reused = 1;
+  } else {
+    nc = mg_connect_http_addr(mgr, ev_handler, opts, use_ssl, addr, port_i);
+  }
+  if (nc != NULL && poolable) {
+    mg_http_get_proto_data(nc)->pool.key = strdup(key);
+  }
+
+  return nc;
+}
+
+struct mg_connection *mg_connect_http_base(
+    struct mg_mgr *mgr, mg_event_handler_t ev_handler,
+    struct mg_connect_opts opts, const char *schema, const char *schema_ssl,
+    const char *url, const char **path, char **addr) {
+  int port_i = -1;
+  int use_ssl = 0;
+
+  if (mg_http_common_url_parse(url, schema, schema_ssl, &use_ssl, addr, &port_i,
+                               path) < 0) {
+    return NULL;
+  }
+
+  LOG(LL_DEBUG, ("%s use_ssl? %d", url, use_ssl));
+  return mg_connect_http_addr(mgr, ev_handler, opts, use_ssl, addr, port_i);
+}
+
 struct mg_connection *mg_connect_http_opt(struct mg_mgr *mgr,
                                           mg_event_handler_t ev_handler,
                                           struct mg_connect_opts opts,
@@ -7445,12 +9193,14 @@ struct mg_connection *mg_connect_http_opt(struct mg_mgr *mgr,
                                           const char *post_data) {
   char *addr = NULL;
   const char *path = NULL;
-  struct mg_connection *nc = mg_connect_http_base(
-      mgr, ev_handler, opts, "http://", "https://", url, &path, &addr);
+  int reused;
+  struct mg_connection *nc = mg_connect_http_pooled(mgr, ev_handler, opts, url,
+                                                    &path, &addr, &reused);
 
   if (nc == NULL) {
     return NULL;
   }
+  mg_http_get_proto_data(nc)->pool.reused = reused;
 
   mg_printf(nc, "%s %s HTTP/1.1\r\nHost: %s\r\nContent-Length: %" SIZE_T_FMT
                 "\r\n%s\r\n%s",
@@ -7546,16 +9296,472 @@ void mg_register_http_endpoint(struct mg_connection *nc, const char *uri_path,
   struct mg_http_proto_data *pd = NULL;
   struct mg_http_endpoint *new_ep = NULL;
 
-  if (nc == NULL) return;
-  new_ep = (struct mg_http_endpoint *) calloc(1, sizeof(*new_ep));
-  if (new_ep == NULL) return;
+  if (nc == NULL) return;
+  new_ep = (struct mg_http_endpoint *) calloc(1, sizeof(*new_ep));
+  if (new_ep == NULL) return;
+
+  pd = mg_http_get_proto_data(nc);
+  new_ep->name = strdup(uri_path);
+  new_ep->name_len = strlen(new_ep->name);
+  new_ep->handler = handler;
+  new_ep->next = pd->endpoints;
+  pd->endpoints = new_ep;
+}
+
+void mg_register_http_proxy(struct mg_connection *nc, const char *prefix,
+                            const char *upstream) {
+  struct mg_http_proto_data *pd = NULL;
+  struct mg_http_proxy_mount *pm = NULL;
+  size_t len = strlen(upstream);
+
+  if (nc == NULL) return;
+  pm = (struct mg_http_proxy_mount *) MG_CALLOC(1, sizeof(*pm));
+  if (pm == NULL) return;
+
+  /* Rest of the URI is appended to the upstream path, which has no '/' */
+  while (len > 0 && upstream[len - 1] == '/') len--;
+  pd = mg_http_get_proto_data(nc);
+  pm->prefix = strdup(prefix);
+  pm->upstream = (char *) MG_MALLOC(len + 1);
+  if (pm->prefix == NULL || pm->upstream == NULL) {
+    MG_FREE(pm->prefix);
+    MG_FREE(pm->upstream);
+    MG_FREE(pm);
+    return;
+  }
+  memcpy(pm->upstream, upstream, len);
+  pm->upstream[len] = '\0';
+  pm->next = pd->proxies;
+  pd->proxies = pm;
+}
+
+/* Finds the longest proxy prefix of the URI, set on the listener. */
+static struct mg_http_proxy_mount *mg_http_find_proxy(struct mg_connection *nc,
+                                                      struct http_message *hm,
+                                                      size_t *prefix_len) {
+  struct mg_connection *lc = nc->listener;
+  struct mg_http_proxy_mount *pm, *found = NULL;
+  size_t len;
+
+  if (lc == NULL || lc->proto_data_destructor != mg_http_conn_destructor) {
+    return NULL;
+  }
+  pm = ((struct mg_http_proto_data *) lc->proto_data)->proxies;
+  for (; pm != NULL; pm = pm->next) {
+    len = strlen(pm->prefix);
+    if (len > 0 && pm->prefix[len - 1] == '/') len--;
+    /* Must end at a path component boundary */
+    if (len <= hm->uri.len && memcmp(pm->prefix, hm->uri.p, len) == 0 &&
+        (len == hm->uri.len || hm->uri.p[len] == '/') &&
+        (found == NULL || len > *prefix_len)) {
+      found = pm;
+      *prefix_len = len;
+    }
+  }
+
+  return found;
+}
+
+static int mg_http_is_hop_header(const struct mg_str *name) {
+  return mg_vcasecmp(name, "Connection") == 0 ||
+         mg_vcasecmp(name, "Keep-Alive") == 0 ||
+         mg_vcasecmp(name, "Proxy-Connection") == 0;
+}
+
+/*
+ * Returns how many of `len` bytes of chunked body belong to the message
+ * and marks the end of it.
+ */
+static size_t mg_http_proxy_scan_chunked(struct mg_http_proto_data_proxy *px,
+                                         const char *buf, size_t len) {
+  size_t i = 0, n;
+  int ch;
+
+  while (i < len && px->state != MG_HTTP_PROXY_DONE) {
+    ch = ((const unsigned char *) buf)[i];
+    switch (px->chunk_state) {
+      case MG_HTTP_PROXY_CHUNK_SIZE:
+        if (ch == '\n') {
+          px->chunk_state = px->chunk_left > 0 ? MG_HTTP_PROXY_CHUNK_DATA
+                                               : MG_HTTP_PROXY_CHUNK_TRAILER;
+          px->chunk_ext = 0;
+          px->line_len = 0;
+        } else if (!px->chunk_ext && isxdigit(ch)) {
+          px->chunk_left = px->chunk_left * 16 +
+                           (isdigit(ch) ? ch - '0' : tolower(ch) - 'a' + 10);
+        } else {
+          px->chunk_ext = 1;
+        }
+        i++;
+        break;
+      case MG_HTTP_PROXY_CHUNK_DATA:
+        n = len - i < px->chunk_left ? len - i : px->chunk_left;
+        px->chunk_left -= n;
+        i += n;
+        if (px->chunk_left == 0) {
+          px->chunk_state = MG_HTTP_PROXY_CHUNK_DATA_END;
+        }
+        break;
+      case MG_HTTP_PROXY_CHUNK_DATA_END:
+        if (ch == '\n') px->chunk_state = MG_HTTP_PROXY_CHUNK_SIZE;
+        i++;
+        break;
+      case MG_HTTP_PROXY_CHUNK_TRAILER:
+        /* Trailer lines until an empty one */
+        if (ch == '\n') {
+          if (px->line_len == 0) px->state = MG_HTTP_PROXY_DONE;
+          px->line_len = 0;
+        } else if (ch != '\r') {
+          px->line_len++;
+        }
+        i++;
+        break;
+    }
+  }
+
+  return i;
+}
+
+/*
+ * Whether the upstream could frame the request body differently than the
+ * proxy does, the basis of request smuggling: Content-Length together with
+ * Transfer-Encoding, a coding other than chunked, or a repeated header.
+ */
+static int mg_http_proxy_is_ambiguous(struct http_message *hm) {
+  struct mg_str *te = NULL;
+  int i, num_cl = 0, num_te = 0;
+
+  for (i = 0; i < MG_MAX_HTTP_HEADERS && hm->header_names[i].len > 0; i++) {
+    if (mg_vcasecmp(&hm->header_names[i], "Content-Length") == 0) {
+      num_cl++;
+    } else if (mg_vcasecmp(&hm->header_names[i], "Transfer-Encoding") == 0) {
+      te = &hm->header_values[i];
+      num_te++;
+    }
+  }
+
+  return num_cl > 1 || num_te > 1 ||
+         (te != NULL && (num_cl > 0 || mg_vcasecmp(te, "chunked") != 0));
+}
+
+static void mg_http_proxy_set_framing(struct mg_http_proto_data_proxy *px,
+                                      struct http_message *hm, int no_body) {
+  struct mg_str *te = mg_get_http_header(hm, "Transfer-Encoding");
+
+  px->state = MG_HTTP_PROXY_BODY;
+  if (no_body) {
+    px->framing = MG_HTTP_PROXY_LENGTH;
+    px->body_left = 0;
+  } else if (te != NULL && mg_vcasecmp(te, "chunked") == 0) {
+    px->framing = MG_HTTP_PROXY_CHUNKED;
+    px->chunk_state = MG_HTTP_PROXY_CHUNK_SIZE;
+    px->chunk_left = 0;
+  } else if (hm->body.len != (size_t) ~0) {
+    px->framing = MG_HTTP_PROXY_LENGTH;
+    px->body_left = hm->body.len;
+  } else {
+    px->framing = MG_HTTP_PROXY_EOF;
+    px->keep_alive = 0;
+  }
+  if (px->framing == MG_HTTP_PROXY_LENGTH && px->body_left == 0) {
+    px->state = MG_HTTP_PROXY_DONE;
+  }
+}
+
+/*
+ * Moves body bytes buffered on `from` to its peer, as much as the peer's
+ * send buffer takes unless `force` is set. Returns the number of bytes moved.
+ */
+static size_t mg_http_proxy_relay(struct mg_connection *from, int force) {
+  struct mg_http_proto_data_proxy *px = &mg_http_get_proto_data(from)->proxy;
+  struct mg_connection *to = px->peer;
+  struct mbuf *io = &from->recv_mbuf;
+  size_t n = io->len;
+
+  if (to == NULL || px->state != MG_HTTP_PROXY_BODY) return 0;
+  if (!force) {
+    size_t room = to->send_mbuf.len < MG_HTTP_PROXY_BUFFER_SIZE
+                      ? MG_HTTP_PROXY_BUFFER_SIZE - to->send_mbuf.len
+                      : 0;
+    if (n > room) n = room;
+  }
+
+  switch (px->framing) {
+    case MG_HTTP_PROXY_LENGTH:
+      if ((int64_t) n > px->body_left) n = (size_t) px->body_left;
+      px->body_left -= n;
+      if (px->body_left == 0) px->state = MG_HTTP_PROXY_DONE;
+      break;
+    case MG_HTTP_PROXY_CHUNKED:
+      n = mg_http_proxy_scan_chunked(px, io->buf, n);
+      break;
+    case MG_HTTP_PROXY_EOF:
+      break;
+  }
+
+  if (n > 0) {
+    mg_send(to, io->buf, n);
+    mbuf_remove(io, n);
+  }
+  return n;
+}
+
+/* Relays what both sides of the exchange have buffered. */
+static void mg_http_proxy_pump(struct mg_connection *nc) {
+  struct mg_connection *peer = mg_http_get_proto_data(nc)->proxy.peer;
+  size_t n;
+
+  mg_http_proxy_relay(nc, 0);
+  if (peer != NULL && (n = mg_http_proxy_relay(peer, 0)) > 0) {
+    /* Only the connection being handled is acknowledged by mg_call() */
+    mg_if_recved(peer, n);
+  }
+}
+
+static void mg_http_proxy_detach(struct mg_connection *nc) {
+  struct mg_http_proto_data_proxy *px = &mg_http_get_proto_data(nc)->proxy;
+  nc->recv_mbuf_limit = px->recv_mbuf_limit;
+  nc->proto_handler = mg_http_handler;
+  memset(px, 0, sizeof(*px));
+}
+
+/* Parses upstream response headers and sends them on to the client. */
+static void mg_http_proxy_response(struct mg_connection *up) {
+  struct mg_http_proto_data_proxy *ux = &mg_http_get_proto_data(up)->proxy;
+  struct mg_connection *nc = ux->peer;
+  struct mg_http_proto_data_proxy *cx = &mg_http_get_proto_data(nc)->proxy;
+  struct http_message hm;
+  int i, len;
+
+  while (ux->state == MG_HTTP_PROXY_HEADERS) {
+    len = mg_parse_http(up->recv_mbuf.buf, up->recv_mbuf.len, &hm, 0);
+    if (len == 0 && up->recv_mbuf.len >= MG_MAX_HTTP_REQUEST_SIZE) len = -1;
+    if (len == 0) return;
+    if (len < 0) {
+      up->flags |= MG_F_CLOSE_IMMEDIATELY;
+      return;
+    }
+
+    if (hm.resp_code < 200 && hm.resp_code != 101) {
+      /* Interim response, e.g. 100 Continue */
+      mg_send(nc, up->recv_mbuf.buf, len);
+      mbuf_remove(&up->recv_mbuf, len);
+      continue;
+    }
+
+    ux->keep_alive = mg_http_is_keep_alive(&hm);
+    if (hm.resp_code == 101) {
+      /* Protocol switch, e.g. to websocket. Relay both ways until closed. */
+      ux->state = cx->state = MG_HTTP_PROXY_BODY;
+      ux->framing = cx->framing = MG_HTTP_PROXY_EOF;
+      ux->keep_alive = cx->keep_alive = 0;
+    } else {
+      mg_http_proxy_set_framing(
+          ux, &hm,
+          ux->head || hm.resp_code == 204 || hm.resp_code == 304);
+      if (ux->framing == MG_HTTP_PROXY_EOF) cx->keep_alive = 0;
+    }
+
+    mg_printf(nc, "HTTP/1.1 %d %.*s\r\n", hm.resp_code,
+              (int) hm.resp_status_msg.len, hm.resp_status_msg.p);
+    for (i = 0; i < MG_MAX_HTTP_HEADERS && hm.header_names[i].len > 0; i++) {
+      if (mg_http_is_hop_header(&hm.header_names[i])) continue;
+      mg_printf(nc, "%.*s: %.*s\r\n", (int) hm.header_names[i].len,
+                hm.header_names[i].p, (int) hm.header_values[i].len,
+                hm.header_values[i].p);
+    }
+    mg_printf(nc, "Connection: %s\r\n\r\n",
+              hm.resp_code == 101 ? "Upgrade"
+                                  : cx->keep_alive ? "keep-alive" : "close");
+    mbuf_remove(&up->recv_mbuf, len);
+    mg_http_metrics_update(nc);
+  }
+}
+
+/* Finishes the exchange once the whole response has been relayed. */
+static void mg_http_proxy_check_done(struct mg_connection *nc) {
+  struct mg_connection *peer = mg_http_get_proto_data(nc)->proxy.peer;
+  struct mg_connection *c = nc->listener != NULL ? nc : peer;
+  struct mg_connection *up = nc->listener != NULL ? peer : nc;
+  struct mg_http_proto_data_proxy *cx, *ux;
+  int reuse_c, reuse_up;
+
+  if (peer == NULL) return;
+  cx = &mg_http_get_proto_data(c)->proxy;
+  ux = &mg_http_get_proto_data(up)->proxy;
+  if (ux->state != MG_HTTP_PROXY_DONE) return;
+
+  /* Neither side may be reused if the request body was cut short */
+  reuse_c = cx->keep_alive && cx->state == MG_HTTP_PROXY_DONE;
+  reuse_up = ux->keep_alive && cx->state == MG_HTTP_PROXY_DONE;
+  mg_http_proxy_detach(c);
+  mg_http_proxy_detach(up);
+  mg_http_metrics_update(c);
+
+  /* Closing a reusable upstream connection returns it to the pool */
+  mg_http_get_proto_data(up)->pool.reusable = reuse_up;
+  up->flags |= MG_F_SEND_AND_CLOSE;
+
+  if (!reuse_c) {
+    c->flags |= MG_F_SEND_AND_CLOSE;
+  } else if (c->recv_mbuf.len > 0) {
+    /* Pipelined request */
+    int len = (int) c->recv_mbuf.len;
+    mg_call(c, NULL, MG_EV_RECV, &len);
+  }
+}
+
+static void mg_http_proxy_closed(struct mg_connection *nc) {
+  struct mg_http_proto_data_proxy *px = &mg_http_get_proto_data(nc)->proxy;
+  struct mg_connection *peer = px->peer;
+
+  if (nc->listener != NULL) {
+    /* Client is gone, the upstream connection is in the middle of a request */
+    peer->flags |= MG_F_CLOSE_IMMEDIATELY;
+  } else {
+    if (px->state == MG_HTTP_PROXY_HEADERS) {
+      mg_send_head(peer, 502, 0, "Connection: close");
+    } else {
+      /* Body until EOF is complete now, anything else is cut short */
+      mg_http_proxy_relay(nc, 1);
+    }
+    peer->flags |= MG_F_SEND_AND_CLOSE;
+  }
+  mg_http_proxy_detach(nc);
+  mg_http_proxy_detach(peer);
+  mg_http_metrics_update(nc->listener != NULL ? nc : peer);
+}
+
+/* Protocol handler of both sides of a proxied exchange. */
+static void mg_http_proxy_handler(struct mg_connection *nc, int ev,
+                                  void *ev_data) {
+  struct mg_http_proto_data *pd = mg_http_get_proto_data(nc);
+
+  mg_http_metrics_event(nc, ev, ev_data);
+  if (pd->proxy.peer != NULL) {
+    switch (ev) {
+      case MG_EV_RECV:
+        if (nc->listener == NULL) {
+          mg_http_proxy_response(nc);
+        }
+      /* fallthrough */
+      case MG_EV_SEND:
+      case MG_EV_POLL:
+        mg_http_proxy_pump(nc);
+        mg_http_proxy_check_done(nc);
+        break;
+      case MG_EV_CLOSE:
+        mg_http_proxy_closed(nc);
+        break;
+    }
+  }
+
+  /* Upstream connections have no user handler */
+  if (nc->handler != mg_http_proxy_handler) {
+    mg_call(nc, nc->handler, ev, ev_data);
+  }
+}
+
+static int mg_http_proxy_begin(struct mg_connection *nc,
+                               struct http_message *hm, int req_len) {
+  struct mg_http_proto_data_proxy *cx, *ux;
+  struct mg_http_proxy_mount *pm;
+  struct mg_connect_opts opts;
+  struct mg_connection *up;
+  struct mg_str *xff, *host;
+  char *url, *addr = NULL, peer_ip[50];
+  const char *path = NULL;
+  size_t prefix_len = 0, len;
+  int i, reused;
+
+  if ((pm = mg_http_find_proxy(nc, hm, &prefix_len)) == NULL) return 0;
+  mg_http_metrics_begin(nc, pm->prefix, strlen(pm->prefix));
+
+  if (mg_http_proxy_is_ambiguous(hm)) {
+    DBG(("%p ambiguous request body framing", nc));
+    mbuf_remove(&nc->recv_mbuf, nc->recv_mbuf.len);
+    mg_http_send_error(nc, 400, "Ambiguous request body length");
+    mg_http_metrics_update(nc);
+    return 1;
+  }
+
+  /* Upstream URL is the upstream with the rest of the URI */
+  len = strlen(pm->upstream);
+  if ((url = (char *) MG_MALLOC(len + hm->uri.len - prefix_len + 1)) == NULL) {
+    nc->flags |= MG_F_CLOSE_IMMEDIATELY;
+    return 1;
+  }
+  memcpy(url, pm->upstream, len);
+  memcpy(url + len, hm->uri.p + prefix_len, hm->uri.len - prefix_len);
+  url[len + hm->uri.len - prefix_len] = '\0';
 
-  pd = mg_http_get_proto_data(nc);
-  new_ep->name = strdup(uri_path);
-  new_ep->name_len = strlen(new_ep->name);
-  new_ep->handler = handler;
-  new_ep->next = pd->endpoints;
-  pd->endpoints = new_ep;
+  memset(&opts, 0, sizeof(opts));
+  opts.flags = MG_F_HTTP_POOL;
+  up = mg_connect_http_pooled(nc->mgr, mg_http_proxy_handler, opts, url,
+                              &path, &addr, &reused);
+  if (up == NULL) {
+    DBG(("%p cannot connect to %s", nc, url));
+    mbuf_remove(&nc->recv_mbuf, nc->recv_mbuf.len);
+    mg_send_head(nc, 502, 0, "Connection: close");
+    nc->flags |= MG_F_SEND_AND_CLOSE;
+    mg_http_metrics_update(nc);
+    MG_FREE(url);
+    MG_FREE(addr);
+    return 1;
+  }
+  DBG(("%p -> %p %s%s", nc, up, url, reused ? " (reused)" : ""));
+  up->proto_handler = mg_http_proxy_handler;
+
+  mg_printf(up, "%.*s %s%s%.*s HTTP/1.1\r\nHost: %s\r\n", (int) hm->method.len,
+            hm->method.p, path, hm->query_string.len > 0 ? "?" : "",
+            (int) hm->query_string.len, hm->query_string.p, addr);
+  for (i = 0; i < MG_MAX_HTTP_HEADERS && hm->header_names[i].len > 0; i++) {
+    const struct mg_str *name = &hm->header_names[i];
+    if (mg_http_is_hop_header(name) || mg_vcasecmp(name, "Host") == 0 ||
+        mg_vcasecmp(name, "X-Forwarded-For") == 0) {
+      continue;
+    }
+    mg_printf(up, "%.*s: %.*s\r\n", (int) name->len, name->p,
+              (int) hm->header_values[i].len, hm->header_values[i].p);
+  }
+  mg_conn_addr_to_str(nc, peer_ip, sizeof(peer_ip),
+                      MG_SOCK_STRINGIFY_REMOTE | MG_SOCK_STRINGIFY_IP);
+  if ((xff = mg_get_http_header(hm, "X-Forwarded-For")) != NULL) {
+    mg_printf(up, "X-Forwarded-For: %.*s, %s\r\n", (int) xff->len, xff->p,
+              peer_ip);
+  } else {
+    mg_printf(up, "X-Forwarded-For: %s\r\n", peer_ip);
+  }
+  if ((host = mg_get_http_header(hm, "Host")) != NULL) {
+    mg_printf(up, "X-Forwarded-Host: %.*s\r\n", (int) host->len, host->p);
+  }
+  mg_printf(up, "Connection: %s\r\n\r\n",
+            mg_get_http_header(hm, "Upgrade") != NULL ? "Upgrade"
+                                                     : "keep-alive");
+
+  cx = &mg_http_get_proto_data(nc)->proxy;
+  ux = &mg_http_get_proto_data(up)->proxy;
+  cx->peer = up;
+  cx->keep_alive = mg_http_is_keep_alive(hm);
+  mg_http_proxy_set_framing(
+      cx, hm, hm->body.len == (size_t) ~0 &&
+                  mg_get_http_header(hm, "Transfer-Encoding") == NULL);
+  ux->peer = nc;
+  ux->state = MG_HTTP_PROXY_HEADERS;
+  ux->head = mg_vcasecmp(&hm->method, "HEAD") == 0;
+
+  /* Bound what is read ahead of the other side */
+  cx->recv_mbuf_limit = nc->recv_mbuf_limit;
+  ux->recv_mbuf_limit = up->recv_mbuf_limit;
+  nc->recv_mbuf_limit = up->recv_mbuf_limit = MG_HTTP_PROXY_BUFFER_SIZE;
+  nc->proto_handler = mg_http_proxy_handler;
+
+  mbuf_remove(&nc->recv_mbuf, req_len);
+  mg_http_proxy_pump(nc);
+
+  MG_FREE(url);
+  MG_FREE(addr);
+  return 1;
 }
 
 #endif /* MG_DISABLE_HTTP */
@@ -8891,11 +11097,37 @@ static const char *mg_default_dns_server = "udp://" MG_DEFAULT_NAMESERVER ":53";
 
 MG_INTERNAL char mg_dns_server[256];
 
-struct mg_resolve_async_request {
-  char name[1024];
-  int query;
+struct mg_resolve_waiter {
+  struct mg_resolve_waiter *next;
   mg_resolve_callback_t callback;
   void *data;
+  double timer;      /* mg_time() when the lookup times out, 0 if never */
+  int aaaa_fallback; /* Look up AAAA if the A lookup finds nothing */
+};
+
+/*
+ * Cached DNS answer, shared by all lookups of the same name and query type.
+ * While a query is in flight, lookups of the same name queue up as waiters
+ * instead of sending their own query. Waiters of an entry that is not in
+ * flight get the cached answer from the next mg_mgr_poll().
+ */
+struct mg_dns_cache_entry {
+  struct mg_dns_cache_entry *next; /* mg_mgr::dns_cache linkage */
+  char *name;
+  int query;
+  double expire;            /* mg_time() when the entry goes stale */
+  double last_used;
+  enum mg_resolve_err err;  /* MG_RESOLVE_OK if `pkt` holds an answer */
+  char *pkt;                /* Raw DNS response */
+  int pkt_len;
+  struct mg_connection *dns_nc; /* Query in flight, NULL when done */
+  struct mg_resolve_waiter *waiters;
+  int deliver; /* Waiters are due in this mg_resolve_poll() pass */
+};
+
+struct mg_resolve_async_request {
+  struct mg_mgr *mgr;
+  struct mg_dns_cache_entry *entry;
   time_t timeout;
   int max_retries;
   enum mg_resolve_err err;
@@ -8979,46 +11211,485 @@ static int mg_get_ip_address_of_nameserver(char *name, size_t name_len) {
   return ret;
 }
 
-int mg_resolve_from_hosts_file(const char *name, union socket_address *usa) {
 #ifndef MG_DISABLE_FILESYSTEM
-  /* TODO(mkm) cache /etc/hosts */
-  FILE *fp;
-  char line[1024];
-  char *p;
-  char alias[256];
+/*
+ * Parsed hosts file. Each manager keeps its own copy in mg_mgr::hosts, so
+ * managers polled from different threads share nothing. It is re-read only
+ * when the file's mtime or size changes.
+ */
+struct mg_hosts_entry {
+  size_t name_off; /* Offset of the name in mg_hosts_table::names */
+  const char *name;
+  int order; /* Line order, first entry for a name wins */
+  union socket_address sa;
+};
+
+struct mg_hosts_table {
+  struct mbuf names;   /* NUL-terminated host names */
+  struct mbuf entries; /* Array of struct mg_hosts_entry sorted by name */
+  size_t num_entries;
+  time_t mtime;
+  int64_t size;
+  double checked; /* When the file was last stat()-ed */
+  int loaded;
+};
+
+static int mg_hosts_entry_cmp(const void *a, const void *b) {
+  const struct mg_hosts_entry *e1 = (const struct mg_hosts_entry *) a;
+  const struct mg_hosts_entry *e2 = (const struct mg_hosts_entry *) b;
+  int res = mg_casecmp(e1->name, e2->name);
+  if (res != 0) return res;
+  /* Prefer IPv4 addresses, then file order */
+  if (e1->sa.sa.sa_family != e2->sa.sa.sa_family) {
+    return e1->sa.sa.sa_family == AF_INET ? -1 : 1;
+  }
+  return e1->order - e2->order;
+}
+
+static void mg_hosts_load(struct mg_hosts_table *t, FILE *fp) {
+  char line[1024], *p, *tok, *save;
+  struct mg_hosts_entry e;
+  struct mg_hosts_entry *entries;
   unsigned int a, b, c, d;
-  int len = 0;
+  size_t i;
+  int len = 0, order = 0;
+
+  t->names.len = t->entries.len = t->num_entries = 0;
+  while (fgets(line, sizeof(line), fp) != NULL) {
+    if ((p = strchr(line, '#')) != NULL) *p = '\0';
+    if ((tok = strtok_r(line, " \t\r\n", &save)) == NULL) continue;
+
+    memset(&e, 0, sizeof(e));
+    if (sscanf(tok, "%u.%u.%u.%u%n", &a, &b, &c, &d, &len) == 4 &&
+        tok[len] == '\0') {
+      e.sa.sin.sin_family = AF_INET;
+      e.sa.sin.sin_addr.s_addr = htonl(a << 24 | b << 16 | c << 8 | d);
+#ifdef MG_ENABLE_IPV6
+    } else if (inet_pton(AF_INET6, tok, &e.sa.sin6.sin6_addr) == 1) {
+      e.sa.sin6.sin6_family = AF_INET6;
+#endif
+    } else {
+      continue;
+    }
+
+    while ((tok = strtok_r(NULL, " \t\r\n", &save)) != NULL) {
+      e.name_off = t->names.len;
+      e.order = order++;
+      mbuf_append(&t->names, tok, strlen(tok) + 1);
+      mbuf_append(&t->entries, &e, sizeof(e));
+      t->num_entries++;
+    }
+  }
+
+  entries = (struct mg_hosts_entry *) t->entries.buf;
+  for (i = 0; i < t->num_entries; i++) {
+    entries[i].name = t->names.buf + entries[i].name_off;
+  }
+  qsort(entries, t->num_entries, sizeof(*entries), mg_hosts_entry_cmp);
+  DBG(("%s: %d names", MG_HOSTS_FILE, (int) t->num_entries));
+}
+
+/* Re-read the hosts file if it has changed. */
+static void mg_hosts_refresh(struct mg_hosts_table *t) {
+  double now = mg_time();
+  cs_stat_t st;
+  FILE *fp;
+
+  if (t->checked != 0 && now - t->checked < MG_HOSTS_CHECK_INTERVAL) return;
+  t->checked = now;
+
+  if (mg_stat(MG_HOSTS_FILE, &st) != 0 ||
+      (t->loaded && st.st_mtime == t->mtime && st.st_size == t->size)) {
+    return;
+  }
+  if ((fp = fopen(MG_HOSTS_FILE, "r")) == NULL) {
+    t->num_entries = 0;
+    t->loaded = 0;
+    return;
+  }
+  mg_hosts_load(t, fp);
+  fclose(fp);
+  t->mtime = st.st_mtime;
+  t->size = st.st_size;
+  t->loaded = 1;
+}
+
+static void mg_hosts_free(struct mg_hosts_table *t) {
+  mbuf_free(&t->names);
+  mbuf_free(&t->entries);
+}
 
-  if ((fp = fopen("/etc/hosts", "r")) == NULL) {
+static int mg_hosts_lookup(const struct mg_hosts_table *t, const char *name,
+                           union socket_address *usa) {
+  const struct mg_hosts_entry *entries =
+      (const struct mg_hosts_entry *) t->entries.buf;
+  size_t lo = 0, hi;
+
+  /* Find the first entry for the name */
+  for (hi = t->num_entries; lo < hi;) {
+    size_t mid = lo + (hi - lo) / 2;
+    if (mg_casecmp(entries[mid].name, name) < 0) {
+      lo = mid + 1;
+    } else {
+      hi = mid;
+    }
+  }
+  if (lo < t->num_entries && mg_casecmp(entries[lo].name, name) == 0) {
+    const union socket_address *sa = &entries[lo].sa;
+    if (sa->sa.sa_family == AF_INET) {
+      usa->sin.sin_family = AF_INET;
+      usa->sin.sin_addr = sa->sin.sin_addr;
+#ifdef MG_ENABLE_IPV6
+    } else {
+      /* sin_port and sin6_port share the offset, keep the parsed port */
+      usa->sin6.sin6_family = AF_INET6;
+      usa->sin6.sin6_addr = sa->sin6.sin6_addr;
+#endif
+    }
+    return 0;
+  }
+  return -1;
+}
+#endif /* MG_DISABLE_FILESYSTEM */
+
+MG_INTERNAL int mg_resolve_from_hosts(struct mg_mgr *mgr, const char *name,
+                                      union socket_address *usa) {
+#ifndef MG_DISABLE_FILESYSTEM
+  if (mgr->hosts == NULL &&
+      (mgr->hosts = (struct mg_hosts_table *) MG_CALLOC(
+           1, sizeof(*mgr->hosts))) == NULL) {
     return -1;
   }
+  mg_hosts_refresh(mgr->hosts);
+  return mg_hosts_lookup(mgr->hosts, name, usa);
+#else
+  (void) mgr;
+  (void) name;
+  (void) usa;
+  return -1;
+#endif
+}
+
+int mg_resolve_from_hosts_file(const char *name, union socket_address *usa) {
+#ifndef MG_DISABLE_FILESYSTEM
+  struct mg_hosts_table t;
+  int res;
+
+  memset(&t, 0, sizeof(t));
+  mg_hosts_refresh(&t);
+  res = mg_hosts_lookup(&t, name, usa);
+  mg_hosts_free(&t);
+  return res;
+#else
+  (void) name;
+  (void) usa;
+  return -1;
+#endif
+}
+
+/* Lowest TTL of the answers, clamped to the cache limits */
+static double mg_dns_answer_ttl(const struct mg_dns_message *msg) {
+  int i, ttl = MG_DNS_CACHE_MAX_TTL;
+  for (i = 0; i < msg->num_answers; i++) {
+    if (msg->answers[i].ttl < ttl) ttl = msg->answers[i].ttl;
+  }
+  return ttl < MG_DNS_CACHE_MIN_TTL ? MG_DNS_CACHE_MIN_TTL : ttl;
+}
+
+static void mg_dns_cache_entry_free(struct mg_dns_cache_entry *e) {
+  MG_FREE(e->name);
+  MG_FREE(e->pkt);
+  MG_FREE(e);
+}
+
+static void mg_dns_cache_unlink(struct mg_mgr *mgr,
+                                struct mg_dns_cache_entry *e) {
+  struct mg_dns_cache_entry **p;
+  for (p = &mgr->dns_cache; *p != NULL; p = &(*p)->next) {
+    if (*p == e) {
+      *p = e->next;
+      break;
+    }
+  }
+  mg_dns_cache_entry_free(e);
+}
+
+static struct mg_dns_cache_entry *mg_dns_cache_find(struct mg_mgr *mgr,
+                                                    const char *name,
+                                                    int query) {
+  struct mg_dns_cache_entry *e;
+  for (e = mgr->dns_cache; e != NULL; e = e->next) {
+    if (e->query == query && mg_casecmp(e->name, name) == 0) return e;
+  }
+  return NULL;
+}
+
+static struct mg_dns_cache_entry *mg_dns_cache_add(struct mg_mgr *mgr,
+                                                   const char *name,
+                                                   int query) {
+  struct mg_dns_cache_entry *e, *lru = NULL;
+  int n = 0;
+
+  for (e = mgr->dns_cache; e != NULL; e = e->next) {
+    if (e->dns_nc == NULL && e->waiters == NULL &&
+        (lru == NULL || e->last_used < lru->last_used)) {
+      lru = e;
+    }
+    n++;
+  }
+  if (n >= MG_DNS_CACHE_SIZE && lru != NULL) {
+    mg_dns_cache_unlink(mgr, lru);
+  }
+
+  if ((e = (struct mg_dns_cache_entry *) MG_CALLOC(1, sizeof(*e))) == NULL ||
+      (e->name = strdup(name)) == NULL) {
+    MG_FREE(e);
+    return NULL;
+  }
+  e->query = query;
+  e->next = mgr->dns_cache;
+  mgr->dns_cache = e;
+  return e;
+}
+
+MG_INTERNAL void mg_resolve_free_cache(struct mg_mgr *mgr) {
+  struct mg_dns_cache_entry *e;
+  while ((e = mgr->dns_cache) != NULL) {
+    mgr->dns_cache = e->next;
+    /* Fail lookups still queued so that their connections are freed */
+    while (e->waiters != NULL) {
+      struct mg_resolve_waiter *w = e->waiters;
+      e->waiters = w->next;
+      w->callback(NULL, w->data, MG_RESOLVE_NO_ANSWERS);
+      MG_FREE(w);
+    }
+    mg_dns_cache_entry_free(e);
+  }
+#ifndef MG_DISABLE_FILESYSTEM
+  if (mgr->hosts != NULL) {
+    mg_hosts_free(mgr->hosts);
+    MG_FREE(mgr->hosts);
+    mgr->hosts = NULL;
+  }
+#endif
+}
+
+static int mg_resolve_enqueue(struct mg_mgr *mgr, const char *name, int query,
+                              struct mg_resolve_waiter *w,
+                              struct mg_resolve_async_opts opts);
+
+/*
+ * Deliver the outcome of a lookup to a waiter. Returns 1 if the waiter was
+ * queued again for the AAAA fallback, 0 if it is done and can be freed.
+ */
+static int mg_resolve_deliver(struct mg_mgr *mgr, const char *name, int query,
+                              struct mg_dns_message *msg,
+                              enum mg_resolve_err err,
+                              struct mg_resolve_waiter *w) {
+#ifdef MG_ENABLE_IPV6
+  /* mg_resolve_enqueue() refuses while mg_mgr_free() closes everything */
+  if (w->aaaa_fallback && query == MG_DNS_A_RECORD &&
+      (msg != NULL ? mg_dns_next_record(msg, MG_DNS_A_RECORD, NULL) == NULL
+                   : err == MG_RESOLVE_NO_ANSWERS)) {
+    struct mg_resolve_async_opts opts;
+    memset(&opts, 0, sizeof(opts));
+    w->aaaa_fallback = 0;
+    if (mg_resolve_enqueue(mgr, name, MG_DNS_AAAA_RECORD, w, opts) == 0) {
+      return 1;
+    }
+  }
+#else
+  (void) mgr;
+  (void) name;
+  (void) query;
+#endif
+  w->callback(msg, w->data, msg != NULL ? MG_RESOLVE_OK : err);
+  return 0;
+}
+
+static void mg_resolve_deliver_all(struct mg_mgr *mgr, const char *name,
+                                   int query, struct mg_dns_message *msg,
+                                   enum mg_resolve_err err,
+                                   struct mg_resolve_waiter *waiters) {
+  struct mg_resolve_waiter *w;
+  while ((w = waiters) != NULL) {
+    waiters = w->next;
+    if (!mg_resolve_deliver(mgr, name, query, msg, err, w)) {
+      MG_FREE(w);
+    }
+  }
+}
+
+/* Deliver the cached answer of `e` to the waiters queued on it. */
+static void mg_resolve_deliver_cached(struct mg_mgr *mgr,
+                                      struct mg_dns_cache_entry *e) {
+  struct mg_resolve_waiter *waiters = e->waiters;
+  struct mg_dns_message *msg = NULL;
+  enum mg_resolve_err err = e->err;
+  int query = e->query;
+  char name[1024];
+
+  /* Callbacks may start lookups that evict `e`, keep what is needed */
+  snprintf(name, sizeof(name), "%s", e->name);
+  e->waiters = NULL;
+  e->deliver = 0;
+  if (e->pkt != NULL &&
+      (msg = (struct mg_dns_message *) MG_MALLOC(sizeof(*msg))) != NULL &&
+      mg_parse_dns(e->pkt, e->pkt_len, msg) != 0) {
+    MG_FREE(msg);
+    msg = NULL;
+  }
+  if (msg == NULL && err == MG_RESOLVE_OK) err = MG_RESOLVE_NO_ANSWERS;
+  mg_resolve_deliver_all(mgr, name, query, msg, err, waiters);
+  MG_FREE(msg);
+}
+
+/*
+ * Record the outcome of the query in flight and notify all waiters.
+ * `msg` is NULL on failure.
+ */
+static void mg_resolve_complete(struct mg_mgr *mgr,
+                                struct mg_dns_cache_entry *e,
+                                struct mg_dns_message *msg,
+                                enum mg_resolve_err err) {
+  struct mg_resolve_waiter *waiters = e->waiters;
+  double now = mg_time();
+  char name[1024];
+  int query = e->query;
+
+  snprintf(name, sizeof(name), "%s", e->name);
+  e->dns_nc = NULL;
+  e->waiters = NULL;
+  e->last_used = now;
+  MG_FREE(e->pkt);
+  e->pkt = NULL;
+
+  if (msg != NULL && (e->pkt = (char *) MG_MALLOC(msg->pkt.len)) != NULL) {
+    memcpy(e->pkt, msg->pkt.p, msg->pkt.len);
+    e->pkt_len = (int) msg->pkt.len;
+    e->err = MG_RESOLVE_OK;
+    e->expire = now + mg_dns_answer_ttl(msg);
+  } else if (msg == NULL && err == MG_RESOLVE_NO_ANSWERS) {
+    e->err = err;
+    e->expire = now + MG_DNS_NEGATIVE_TTL;
+  } else {
+    /* Do not cache timeouts, the next lookup should try again */
+    mg_dns_cache_unlink(mgr, e);
+  }
+
+  mg_resolve_deliver_all(mgr, name, query, msg, err, waiters);
+}
+
+/* Drop the query in flight for `e`, nobody is waiting for it any more. */
+static void mg_resolve_cancel(struct mg_mgr *mgr,
+                              struct mg_dns_cache_entry *e) {
+  struct mg_connection *dns_nc = e->dns_nc;
+  MG_FREE(dns_nc->user_data);
+  dns_nc->user_data = NULL;
+  dns_nc->flags |= MG_F_CLOSE_IMMEDIATELY;
+  mg_dns_cache_unlink(mgr, e);
+}
 
-  for (; fgets(line, sizeof(line), fp) != NULL;) {
-    if (line[0] == '#') continue;
+MG_INTERNAL void mg_resolve_set_timer(void *waiter, double timestamp) {
+  ((struct mg_resolve_waiter *) waiter)->timer = timestamp;
+}
+
+MG_INTERNAL double mg_resolve_poll(struct mg_mgr *mgr) {
+  struct mg_dns_cache_entry *e;
+  struct mg_resolve_waiter *w, **p;
+  double now = mg_time(), next = 0;
+
+  /*
+   * Cached answers queued since the last poll. Callbacks change the cache,
+   * so look for the next due entry from the start every time. Lookups the
+   * callbacks queue wait for the next poll.
+   */
+  for (e = mgr->dns_cache; e != NULL; e = e->next) {
+    e->deliver = e->dns_nc == NULL && e->waiters != NULL;
+  }
+  for (;;) {
+    for (e = mgr->dns_cache; e != NULL; e = e->next) {
+      if (e->deliver && e->dns_nc == NULL) break;
+    }
+    if (e == NULL) break;
+    mg_resolve_deliver_cached(mgr, e);
+  }
 
-    if (sscanf(line, "%u.%u.%u.%u%n", &a, &b, &c, &d, &len) == 0) {
-      /* TODO(mkm): handle ipv6 */
+  /* Expired lookup timers fail their waiter only */
+  for (e = mgr->dns_cache; e != NULL;) {
+    for (p = &e->waiters; *p != NULL; p = &(*p)->next) {
+      if ((*p)->timer > 0 && (*p)->timer <= now) break;
+    }
+    if (*p == NULL) {
+      e = e->next;
       continue;
     }
-    for (p = line + len; sscanf(p, "%s%n", alias, &len) == 1; p += len) {
-      if (strcmp(alias, name) == 0) {
-        usa->sin.sin_addr.s_addr = htonl(a << 24 | b << 16 | c << 8 | d);
-        fclose(fp);
-        return 0;
-      }
+    w = *p;
+    *p = w->next;
+    if (e->waiters == NULL && e->dns_nc != NULL) {
+      mg_resolve_cancel(mgr, e);
     }
+    w->callback(NULL, w->data, MG_RESOLVE_TIMEOUT);
+    MG_FREE(w);
+    e = mgr->dns_cache;
   }
 
-  fclose(fp);
+  for (e = mgr->dns_cache; e != NULL; e = e->next) {
+    for (w = e->waiters; w != NULL; w = w->next) {
+      if (w->timer > 0 && (next == 0 || w->timer < next)) next = w->timer;
+    }
+  }
+  return next;
+}
+
+MG_INTERNAL int mg_resolve_from_cache(struct mg_mgr *mgr, const char *name,
+                                      union socket_address *sa) {
+  static const int queries[] = {MG_DNS_A_RECORD, MG_DNS_AAAA_RECORD};
+  struct mg_dns_resource_record *rr;
+  struct mg_dns_cache_entry *e;
+  struct mg_dns_message *msg;
+  double now = mg_time();
+  int i, n = 1, res = -1;
+
+#ifdef MG_ENABLE_IPV6
+  n = 2;
+#endif
+  for (i = 0; i < n && res == -1; i++) {
+    if ((e = mg_dns_cache_find(mgr, name, queries[i])) == NULL ||
+        e->dns_nc != NULL || now >= e->expire) {
+      /* A query has to go out */
+      return 0;
+    }
+    e->last_used = now;
+    if (e->pkt == NULL ||
+        (msg = (struct mg_dns_message *) MG_MALLOC(sizeof(*msg))) == NULL) {
+      continue;
+    }
+    if (mg_parse_dns(e->pkt, e->pkt_len, msg) == 0 &&
+        (rr = mg_dns_next_record(msg, queries[i], NULL)) != NULL) {
+      if (queries[i] == MG_DNS_A_RECORD) {
+        sa->sin.sin_family = AF_INET;
+        mg_dns_parse_record_data(msg, rr, &sa->sin.sin_addr, 4);
+#ifdef MG_ENABLE_IPV6
+      } else {
+        sa->sin6.sin6_family = AF_INET6;
+        mg_dns_parse_record_data(msg, rr, &sa->sin6.sin6_addr,
+                                 sizeof(sa->sin6.sin6_addr));
 #endif
+      }
+      res = 1;
+    }
+    MG_FREE(msg);
+  }
 
-  return -1;
+  return res;
 }
 
 static void mg_resolve_async_eh(struct mg_connection *nc, int ev, void *data) {
   time_t now = time(NULL);
   struct mg_resolve_async_request *req;
   struct mg_dns_message *msg;
+  int rcode;
 
   DBG(("ev=%d user_data=%p", ev, nc->user_data));
 
@@ -9037,23 +11708,40 @@ static void mg_resolve_async_eh(struct mg_connection *nc, int ev, void *data) {
         break;
       }
       if (now - req->last_time >= req->timeout) {
-        mg_send_dns_query(nc, req->name, req->query);
+        mg_send_dns_query(nc, req->entry->name, req->entry->query);
         req->last_time = now;
         req->retries++;
       }
       break;
     case MG_EV_RECV:
       msg = (struct mg_dns_message *) MG_MALLOC(sizeof(*msg));
-      if (mg_parse_dns(nc->recv_mbuf.buf, *(int *) data, msg) == 0 &&
-          msg->num_answers > 0) {
-        req->callback(msg, req->data, MG_RESOLVE_OK);
+      if (msg == NULL ||
+          mg_parse_dns(nc->recv_mbuf.buf, *(int *) data, msg) != 0 ||
+          (msg->flags & 0x200) /* Truncated */) {
+        rcode = -1;
+      } else {
+        rcode = msg->flags & 0xf;
+      }
+      if (rcode == 0 &&
+          mg_dns_next_record(msg, req->entry->query, NULL) != NULL) {
         nc->user_data = NULL;
+        mg_resolve_complete(req->mgr, req->entry, msg, MG_RESOLVE_OK);
         MG_FREE(req);
-      } else {
+        nc->flags |= MG_F_CLOSE_IMMEDIATELY;
+      } else if (rcode == 0 || rcode == 3) {
+        /* NODATA or NXDOMAIN, the only answers cached as nonexistent */
         req->err = MG_RESOLVE_NO_ANSWERS;
+        nc->flags |= MG_F_CLOSE_IMMEDIATELY;
+      } else {
+        /*
+         * SERVFAIL, REFUSED, a garbled packet: ask again on the next poll.
+         * If the retries run out the lookup fails without being cached.
+         */
+        mbuf_remove(&nc->recv_mbuf, nc->recv_mbuf.len);
+        req->last_time = 0;
+        req->err = MG_RESOLVE_EXCEEDED_RETRY_COUNT;
       }
       MG_FREE(msg);
-      nc->flags |= MG_F_CLOSE_IMMEDIATELY;
       break;
     case MG_EV_SEND:
       /*
@@ -9070,14 +11758,20 @@ static void mg_resolve_async_eh(struct mg_connection *nc, int ev, void *data) {
     case MG_EV_CLOSE:
       /* If we got here with request still not done, fire an error callback. */
       if (req != NULL) {
-        req->callback(NULL, req->data, req->err);
         nc->user_data = NULL;
+        mg_resolve_complete(req->mgr, req->entry, NULL, req->err);
         MG_FREE(req);
       }
       break;
   }
 }
 
+static int mg_resolve_async_internal(struct mg_mgr *mgr, const char *name,
+                                     int query, mg_resolve_callback_t cb,
+                                     void *data,
+                                     struct mg_resolve_async_opts opts,
+                                     int aaaa_fallback, void **waiter);
+
 int mg_resolve_async(struct mg_mgr *mgr, const char *name, int query,
                      mg_resolve_callback_t cb, void *data) {
   struct mg_resolve_async_opts opts;
@@ -9088,22 +11782,66 @@ int mg_resolve_async(struct mg_mgr *mgr, const char *name, int query,
 int mg_resolve_async_opt(struct mg_mgr *mgr, const char *name, int query,
                          mg_resolve_callback_t cb, void *data,
                          struct mg_resolve_async_opts opts) {
+  return mg_resolve_async_internal(mgr, name, query, cb, data, opts, 0, NULL);
+}
+
+MG_INTERNAL int mg_resolve_for_connect(struct mg_mgr *mgr, const char *name,
+                                       mg_resolve_callback_t cb, void *data,
+                                       void **waiter) {
+  struct mg_resolve_async_opts opts;
+  memset(&opts, 0, sizeof(opts));
+#ifdef MG_ENABLE_IPV6
+  return mg_resolve_async_internal(mgr, name, MG_DNS_A_RECORD, cb, data, opts,
+                                   1, waiter);
+#else
+  return mg_resolve_async_internal(mgr, name, MG_DNS_A_RECORD, cb, data, opts,
+                                   0, waiter);
+#endif
+}
+
+/*
+ * Queue `w` for the answer to `name`: on a query in flight, on a cached
+ * answer to be delivered by the next mg_mgr_poll(), or on a new query.
+ * Never calls back. Returns -1 and leaves `w` to the caller on failure.
+ */
+static int mg_resolve_enqueue(struct mg_mgr *mgr, const char *name, int query,
+                              struct mg_resolve_waiter *w,
+                              struct mg_resolve_async_opts opts) {
   struct mg_resolve_async_request *req;
+  struct mg_dns_cache_entry *e;
   struct mg_connection *dns_nc;
   const char *nameserver = opts.nameserver_url;
+  double now = mg_time();
 
   DBG(("%s %d %p", name, query, opts.dns_conn));
 
+  if (opts.dns_conn != NULL) {
+    *opts.dns_conn = NULL;
+  }
+  /* A query sent while mg_mgr_free() closes connections would leak */
+  if (mgr->closing || strlen(name) >= 1024) {
+    return -1;
+  }
+
+  if ((e = mg_dns_cache_find(mgr, name, query)) != NULL) {
+    e->last_used = now;
+    if (e->dns_nc != NULL || now < e->expire) {
+      w->next = e->waiters;
+      e->waiters = w;
+      return 0;
+    }
+  } else if ((e = mg_dns_cache_add(mgr, name, query)) == NULL) {
+    return -1;
+  }
+
   /* resolve with DNS */
   req = (struct mg_resolve_async_request *) MG_CALLOC(1, sizeof(*req));
   if (req == NULL) {
     return -1;
   }
 
-  strncpy(req->name, name, sizeof(req->name));
-  req->query = query;
-  req->callback = cb;
-  req->data = data;
+  req->mgr = mgr;
+  req->entry = e;
   /* TODO(mkm): parse defaults out of resolve.conf */
   req->max_retries = opts.max_retries ? opts.max_retries : 2;
   req->timeout = opts.timeout ? opts.timeout : 5;
@@ -9121,10 +11859,14 @@ int mg_resolve_async_opt(struct mg_mgr *mgr, const char *name, int query,
 
   dns_nc = mg_connect(mgr, nameserver, mg_resolve_async_eh);
   if (dns_nc == NULL) {
-    free(req);
+    MG_FREE(req);
     return -1;
   }
   dns_nc->user_data = req;
+  e->dns_nc = dns_nc;
+  e->expire = 0;
+  w->next = e->waiters;
+  e->waiters = w;
   if (opts.dns_conn != NULL) {
     *opts.dns_conn = dns_nc;
   }
@@ -9132,6 +11874,30 @@ int mg_resolve_async_opt(struct mg_mgr *mgr, const char *name, int query,
   return 0;
 }
 
+static int mg_resolve_async_internal(struct mg_mgr *mgr, const char *name,
+                                     int query, mg_resolve_callback_t cb,
+                                     void *data,
+                                     struct mg_resolve_async_opts opts,
+                                     int aaaa_fallback, void **waiter) {
+  struct mg_resolve_waiter *w;
+
+  if ((w = (struct mg_resolve_waiter *) MG_CALLOC(1, sizeof(*w))) == NULL) {
+    return -1;
+  }
+  w->callback = cb;
+  w->data = data;
+  w->aaaa_fallback = aaaa_fallback;
+  if (mg_resolve_enqueue(mgr, name, query, w, opts) != 0) {
+    MG_FREE(w);
+    return -1;
+  }
+  if (waiter != NULL) {
+    *waiter = w;
+  }
+
+  return 0;
+}
+
 #endif /* MG_DISABLE_RESOLVE */
 #ifdef MG_MODULE_LINES
 #line 1 "mongoose/src/coap.c"
@@ -10905,9 +13671,9 @@ static void mg_handle_tcp_read(struct mg_connection *conn) {
   }
   if (n == 0) {
     /* Orderly shutdown of the socket, try flushing output. */
-    conn->flags |= MG_F_SEND_AND_CLOSE;
+    conn->flags |= MG_F_SEND_AND_CLOSE | MG_F_PEER_CLOSED;
   } else if (mg_is_error(n)) {
-    conn->flags |= MG_F_CLOSE_IMMEDIATELY;
+    conn->flags |= MG_F_CLOSE_IMMEDIATELY | MG_F_PEER_CLOSED;
   }
 }
 
@@ -11029,6 +13795,10 @@ time_t mg_mgr_poll(struct mg_mgr *mgr, int timeout_ms) {
    * e.g. timer-only "connections".
    */
   min_timer = 0;
+#ifndef MG_DISABLE_RESOLVER
+  /* Lookup timers are kept by the resolver, not by connections */
+  if ((min_timer = mg_resolve_poll(mgr)) > 0) num_timers++;
+#endif
   for (nc = mgr->active_connections, num_fds = 0; nc != NULL; nc = tmp) {
     tmp = nc->next;
 
@@ -11740,6 +14510,9 @@ time_t mg_mgr_poll(struct mg_mgr *mgr, int timeout_ms) {
   int num_timers = 0;
   DBG(("begin poll @%u", (unsigned int) (now * 1000)));
   mg_ev_mgr_lwip_process_signals(mgr);
+#ifndef MG_DISABLE_RESOLVER
+  if ((min_timer = mg_resolve_poll(mgr)) > 0) num_timers++;
+#endif
   for (nc = mgr->active_connections; nc != NULL; nc = tmp) {
     struct mg_lwip_conn_state *cs = (struct mg_lwip_conn_state *) nc->sock;
     (void) cs;
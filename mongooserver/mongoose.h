@@ -287,7 +287,12 @@ typedef struct _stati64 cs_stat_t;
 #if CS_PLATFORM == CS_P_UNIX
 
 #ifndef _XOPEN_SOURCE
-#define _XOPEN_SOURCE 600
+#define _XOPEN_SOURCE 700
+#endif
+
+/* Enable syscall() for the getdents64() based directory scanner */
+#if defined(__linux__) && !defined(_DEFAULT_SOURCE)
+#define _DEFAULT_SOURCE
 #endif
 
 /* <inttypes.h> wants this for C++ */
@@ -1273,6 +1278,30 @@ typedef void (*mg_event_handler_t)(struct mg_connection *, int ev, void *);
 /*
  * Mongoose event manager.
  */
+/*
+ * Token bucket that shapes outgoing bandwidth. A connection can draw from up
+ * to `MG_MAX_CONN_BUCKETS` buckets at once (e.g. global, per-IP and
+ * per-connection), and sends only as much as the emptiest one allows.
+ */
+struct mg_bucket {
+  struct mg_bucket *next; /* mg_mgr::buckets linkage */
+  char *name;             /* Lookup key, NULL for a private bucket */
+  double rate;            /* Refill rate, bytes per second */
+  double burst;           /* Capacity, bytes */
+  double tokens;          /* Bytes that can be sent right now */
+  double last_refill;     /* mg_time() of the last refill */
+  int refcnt;             /* Number of connections using the bucket */
+};
+
+#ifndef MG_MAX_CONN_BUCKETS
+#define MG_MAX_CONN_BUCKETS 4
+#endif
+
+/* Max bytes a shaped connection sends per write, to interleave connections */
+#ifndef MG_BUCKET_QUANTUM
+#define MG_BUCKET_QUANTUM 8192
+#endif
+
 struct mg_mgr {
   struct mg_connection *active_connections;
   const char *hexdump_file; /* Debug hexdump file path */
@@ -1281,6 +1310,13 @@ struct mg_mgr {
 #endif
   void *user_data; /* User data */
   void *mgr_data;  /* Implementation-specific event manager's data. */
+  struct mg_dir_index *dir_cache; /* Cached directory listing indexes */
+  struct mg_bucket *buckets;      /* Named bandwidth shaping buckets */
+  struct mg_dns_cache_entry *dns_cache; /* Resolver answers and queries */
+  struct mg_hosts_table *hosts;         /* Parsed hosts file */
+  int closing;                          /* Set by mg_mgr_free() */
+  struct mg_http_pool_entry *http_pool; /* Idle keep-alive HTTP clients */
+  struct mg_http_metrics *http_metrics; /* HTTP request counters */
 #ifdef MG_ENABLE_JAVASCRIPT
   struct v7 *v7;
 #endif
@@ -1328,6 +1364,9 @@ struct mg_connection {
   } priv_1;       /* Used by mg_enable_multithreading() */
   void *priv_2;   /* Used by mg_enable_multithreading() */
   void *mgr_data; /* Implementation-specific event manager's data. */
+  struct mg_bucket *buckets[MG_MAX_CONN_BUCKETS]; /* Bandwidth shaping */
+  double throttle_time; /* When a throttled connection may send again */
+  size_t send_credit;   /* Bytes already paid for to the buckets */
   unsigned long flags;
 /* Flags set by Mongoose */
 #define MG_F_LISTENING (1 << 0)          /* This connection is listening */
@@ -1339,6 +1378,8 @@ struct mg_connection {
 #define MG_F_WANT_READ (1 << 6)          /* SSL specific */
 #define MG_F_WANT_WRITE (1 << 7)         /* SSL specific */
 #define MG_F_IS_WEBSOCKET (1 << 8)       /* Websocket specific */
+#define MG_F_THROTTLED (1 << 9)          /* Waiting for bucket tokens */
+#define MG_F_PEER_CLOSED (1 << 15)       /* Peer closed or reset the socket */
 
 /* Flags that are settable by user */
 #define MG_F_SEND_AND_CLOSE (1 << 10)      /* Push remaining data and close  */
@@ -1346,6 +1387,7 @@ struct mg_connection {
 #define MG_F_WEBSOCKET_NO_DEFRAG (1 << 12) /* Websocket specific */
 #define MG_F_DELETE_CHUNK (1 << 13)        /* HTTP specific */
 #define MG_F_ENABLE_BROADCAST (1 << 14)    /* Allow broadcast address usage */
+#define MG_F_HTTP_POOL (1 << 16)           /* Keep-alive HTTP client pooling */
 
 #define MG_F_USER_1 (1 << 20) /* Flags left for application */
 #define MG_F_USER_2 (1 << 21)
@@ -1720,6 +1762,30 @@ enum v7_err mg_enable_javascript(struct mg_mgr *m, struct v7 *v7,
  */
 double mg_set_timer(struct mg_connection *c, double timestamp);
 
+/*
+ * Finds a bucket by name or creates a new one, refilled at `rate` bytes per
+ * second with a one second burst. A NULL `name` creates a private bucket.
+ * Returns a new reference, or NULL on OOM.
+ *
+ * Buckets are shared: all connections attached to the same named bucket
+ * split its bandwidth. Getting an existing bucket with a different `rate`
+ * changes both its rate and its burst, for all of its connections.
+ */
+struct mg_bucket *mg_bucket_get(struct mg_mgr *mgr, const char *name,
+                                double rate);
+
+/* Drops a reference obtained with `mg_bucket_get()`. */
+void mg_bucket_release(struct mg_mgr *mgr, struct mg_bucket *b);
+
+/*
+ * Attaches bucket `b` to the connection's bucket `slot`, taking over the
+ * caller's reference, and releases the bucket previously in that slot.
+ * `b` can be NULL to detach. Writes to the socket are then limited by all
+ * attached buckets. A throttled connection is not polled for writing until
+ * its buckets are expected to have enough tokens again.
+ */
+void mg_set_bucket(struct mg_connection *nc, int slot, struct mg_bucket *b);
+
 /*
  * A sub-second precision version of time().
  */
@@ -2152,6 +2218,41 @@ extern "C" {
 #define MG_ENV_EXPORT_TO_CGI "MONGOOSE_CGI"
 #endif
 
+/* Seconds a cached directory listing index stays valid */
+#ifndef MG_DIR_INDEX_TTL
+#define MG_DIR_INDEX_TTL 10
+#endif
+
+/* Max number of directory listing indexes cached per manager */
+#ifndef MG_DIR_INDEX_CACHE_SIZE
+#define MG_DIR_INDEX_CACHE_SIZE 16
+#endif
+
+/* Directory entries scanned per poll iteration while building an index */
+#ifndef MG_DIR_SCAN_BATCH
+#define MG_DIR_SCAN_BATCH 512
+#endif
+
+/* Maximum number of idle keep-alive client connections kept per manager */
+#ifndef MG_HTTP_POOL_SIZE
+#define MG_HTTP_POOL_SIZE 32
+#endif
+
+/* Seconds an idle pooled client connection is kept open */
+#ifndef MG_HTTP_POOL_IDLE_TIMEOUT
+#define MG_HTTP_POOL_IDLE_TIMEOUT 30
+#endif
+
+/* Bytes buffered per direction by the reverse proxy */
+#ifndef MG_HTTP_PROXY_BUFFER_SIZE
+#define MG_HTTP_PROXY_BUFFER_SIZE 65536
+#endif
+
+/* Read-ahead of a PUT body streamed to disk, see MG_EV_HTTP_PUT_REQUEST */
+#ifndef MG_HTTP_PUT_BUFFER_SIZE
+#define MG_HTTP_PUT_BUFFER_SIZE 65536
+#endif
+
 /* HTTP message */
 struct http_message {
   struct mg_str message; /* Whole message: request line + headers + body */
@@ -2207,11 +2308,12 @@ struct mg_ssi_call_ctx {
 };
 
 /* HTTP and websocket events. void *ev_data is described in a comment. */
-#define MG_EV_HTTP_REQUEST 100 /* struct http_message * */
-#define MG_EV_HTTP_REPLY 101   /* struct http_message * */
-#define MG_EV_HTTP_CHUNK 102   /* struct http_message * */
-#define MG_EV_SSI_CALL 105     /* char * */
-#define MG_EV_SSI_CALL_CTX 106 /* struct mg_ssi_call_ctx * */
+#define MG_EV_HTTP_REQUEST 100     /* struct http_message * */
+#define MG_EV_HTTP_REPLY 101       /* struct http_message * */
+#define MG_EV_HTTP_CHUNK 102       /* struct http_message * */
+#define MG_EV_HTTP_PUT_REQUEST 103 /* struct http_message * */
+#define MG_EV_SSI_CALL 105         /* char * */
+#define MG_EV_SSI_CALL_CTX 106     /* struct mg_ssi_call_ctx * */
 
 #ifndef MG_DISABLE_HTTP_WEBSOCKET
 #define MG_EV_WEBSOCKET_HANDSHAKE_REQUEST 111 /* NULL */
@@ -2254,6 +2356,11 @@ struct mg_ssi_call_ctx {
  *   Mongoose sends `MG_EV_HTTP_REPLY` event with
  *   full reassembled body (if handler did not signal to delete chunks) or
  *   with empty body (if handler did signal to delete chunks).
+ * - MG_EV_HTTP_PUT_REQUEST: headers of a PUT request have arrived, but its
+ *   body has not. Calling `mg_serve_http()` here streams the body to disk
+ *   as it arrives instead of buffering it in memory. If the handler neither
+ *   responds nor starts an upload, the body is buffered and
+ *   MG_EV_HTTP_REQUEST follows as usual.
  * - MG_EV_WEBSOCKET_HANDSHAKE_REQUEST: server has received the WebSocket
  *   handshake request. `ev_data` contains parsed HTTP request.
  * - MG_EV_WEBSOCKET_HANDSHAKE_DONE: server has completed the WebSocket
@@ -2557,7 +2664,15 @@ struct mg_serve_http_opts {
    */
   const char *global_auth_file;
 
-  /* Set to "no" to disable directory listing. Enabled by default. */
+  /*
+   * Set to "no" to disable directory listing. Enabled by default.
+   *
+   * Listings are built incrementally across poll iterations and cached as a
+   * sorted index (directories first, then by name) until the directory's
+   * mtime changes or `MG_DIR_INDEX_TTL` seconds pass. Clients can page
+   * through large directories with `?offset=N&limit=M` and request
+   * machine-readable output with `?format=json`.
+   */
   const char *enable_directory_listing;
 
   /*
@@ -2676,8 +2791,67 @@ struct mg_serve_http_opts {
    * Example: to enable CORS, set this to "Access-Control-Allow-Origin: *".
    */
   const char *extra_headers;
+
+  /*
+   * Comma-separated list of `key=rate` outgoing bandwidth limits in bytes
+   * per second, with optional `k`, `m` or `g` suffix. Key is `*` for a limit
+   * shared by all clients, `ip` for a limit per client IP address, `conn`
+   * for a limit per connection, or a URI prefix for a limit shared by all
+   * requests under that prefix (the longest matching prefix wins).
+   * Example: "*=10m,ip=2m,/iso/=4m".
+   */
+  const char *rate_limit;
+};
+
+#ifndef MG_DISABLE_HTTP_METRICS
+/*
+ * Event handler that serves the manager's HTTP metrics in the Prometheus
+ * text format. Register it as an endpoint:
+ *
+ * ```c
+ * mg_register_http_endpoint(nc, "/metrics", mg_http_metrics_handler);
+ * ```
+ *
+ * Metrics are gathered for every request served by the manager:
+ *
+ * - `mongoose_http_requests_total{route,code}`: completed requests by
+ *   status code;
+ * - `mongoose_http_received_bytes_total{route}`,
+ *   `mongoose_http_sent_bytes_total{route}`: bytes on the wire;
+ * - `mongoose_http_ttfb_seconds{route}`: from dispatching the request to its
+ *   first response byte written to the socket;
+ * - `mongoose_http_response_seconds{route}`: until the whole response is
+ *   written;
+ * - `mongoose_http_connection_requests`: requests served per connection;
+ * - `mongoose_connections{type}` and `mongoose_mbuf_bytes{mbuf}` gauges.
+ *
+ * A route is the endpoint or reverse proxy prefix that took the request,
+ * or "default". Latencies are summaries with quantiles since start-up, kept
+ * in log-linear histograms with 1/16 relative precision. Counters are plain
+ * integers updated in the event loop, without locks. Build with
+ * `MG_DISABLE_HTTP_METRICS` to leave them out.
+ */
+void mg_http_metrics_handler(struct mg_connection *nc, int ev, void *ev_data);
+
+/* Counters of one HTTP server connection, see `mg_http_get_conn_metrics()` */
+struct mg_http_conn_metrics {
+  int64_t requests;       /* Requests completed on the connection */
+  int64_t bytes_received; /* Bytes read from the socket */
+  int64_t bytes_sent;     /* Bytes written to the socket */
+  double request_start;   /* mg_time() of the request in flight, 0 if none */
+  int status;             /* Its response status, 0 until the head is queued */
 };
 
+/*
+ * Fills `m` with the counters of a server connection accepted by an HTTP
+ * listener, e.g. to log them on `MG_EV_CLOSE`. The same counters feed the
+ * per-route totals of `mg_http_metrics_handler()`. Returns 0, or -1 if `nc`
+ * is not an HTTP server connection.
+ */
+int mg_http_get_conn_metrics(struct mg_connection *nc,
+                             struct mg_http_conn_metrics *m);
+#endif
+
 /*
  * Serves given HTTP request according to the `options`.
  *
@@ -2689,6 +2863,7 @@ struct mg_serve_http_opts {
  *   struct mg_serve_http_opts opts = { .document_root = "/var/www" };  // C99
  *
  *   switch (ev) {
+ *     case MG_EV_HTTP_PUT_REQUEST:
  *     case MG_EV_HTTP_REQUEST:
  *       mg_serve_http(nc, hm, opts);
  *       break;
@@ -2697,6 +2872,14 @@ struct mg_serve_http_opts {
  *   }
  * }
  * ```
+ *
+ * On MG_EV_HTTP_PUT_REQUEST only DAV uploads are served; the file is
+ * written with `pwrite()` as the body arrives, reading is paused while
+ * `MG_HTTP_PUT_BUFFER_SIZE` bytes wait for the disk, and the response is
+ * sent once the body is on disk. Disk space is reserved up front where the
+ * platform allows. A `Content-Range: bytes a-b/len` header resumes an upload
+ * at offset `a` without truncating the file; an interrupted upload leaves
+ * the file at the size written so far.
  */
 void mg_serve_http(struct mg_connection *nc, struct http_message *hm,
                    struct mg_serve_http_opts opts);
@@ -2754,6 +2937,24 @@ void mg_http_serve_file(struct mg_connection *nc, struct http_message *hm,
 void mg_register_http_endpoint(struct mg_connection *nc, const char *uri_path,
                                mg_event_handler_t handler);
 
+/*
+ * Forwards requests for `prefix` to `upstream`, e.g. "/api" to
+ * "http://127.0.0.1:9000/v1" sends `/api/users?id=1` to
+ * `http://127.0.0.1:9000/v1/users?id=1`.
+ *
+ * The request is forwarded as soon as its headers arrive; request and
+ * response bodies are relayed as they come, with at most
+ * `MG_HTTP_PROXY_BUFFER_SIZE` bytes buffered per direction. Upstream
+ * connections are taken from the manager's keep-alive pool, see
+ * `mg_connect_http_opt()`. Proxied requests are not passed to the event
+ * handler. Requests whose body length is ambiguous (`Content-Length` together
+ * with `Transfer-Encoding`, a coding other than chunked, or repeated framing
+ * headers) are refused with 400.
+ * The longest matching prefix wins.
+ */
+void mg_register_http_proxy(struct mg_connection *nc, const char *prefix,
+                            const char *upstream);
+
 #ifdef MG_ENABLE_HTTP_STREAMING_MULTIPART
 
 /* Callback prototype for `mg_file_upload_handler()`. */
@@ -2923,6 +3124,9 @@ extern "C" {
  *       "Content-Type: application/x-www-form-urlencoded\r\n",
  *       "var_1=value_1&var_2=value_2");
  * ```
+ *
+ * The connection is closed as usual; see `mg_connect_http_opt()` with
+ * `MG_F_HTTP_POOL` for reusing connections.
  */
 struct mg_connection *mg_connect_http(struct mg_mgr *mgr,
                                       mg_event_handler_t event_handler,
@@ -2936,6 +3140,14 @@ struct mg_connection *mg_connect_http(struct mg_mgr *mgr,
  * Mostly identical to mg_connect_http, but allows you to provide extra
  *parameters
  * (for example, SSL parameters)
+ *
+ * With `MG_F_HTTP_POOL` in `opts.flags`, connections to the same scheme, host
+ * and port are pooled: when the handler closes a connection after a complete
+ * keep-alive response, the socket is kept open for
+ * `MG_HTTP_POOL_IDLE_TIMEOUT` seconds and handed to the next pooled request
+ * for that server. The handler still sees `MG_EV_CLOSE`, and a reused
+ * connection delivers `MG_EV_CONNECT` right before its first other event.
+ * Connections with a client certificate or CA verification are not pooled.
  */
 struct mg_connection *mg_connect_http_opt(struct mg_mgr *mgr,
                                           mg_event_handler_t ev_handler,
@@ -3540,6 +3752,34 @@ void mg_dns_send_reply(struct mg_connection *nc, struct mg_dns_reply *r);
 extern "C" {
 #endif /* __cplusplus */
 
+/* Maximum number of names kept in a manager's DNS cache */
+#ifndef MG_DNS_CACHE_SIZE
+#define MG_DNS_CACHE_SIZE 64
+#endif
+
+/* Bounds, in seconds, for the TTL of cached DNS answers */
+#ifndef MG_DNS_CACHE_MIN_TTL
+#define MG_DNS_CACHE_MIN_TTL 1
+#endif
+
+#ifndef MG_DNS_CACHE_MAX_TTL
+#define MG_DNS_CACHE_MAX_TTL 3600
+#endif
+
+/* How long, in seconds, NXDOMAIN and NODATA replies are remembered */
+#ifndef MG_DNS_NEGATIVE_TTL
+#define MG_DNS_NEGATIVE_TTL 30
+#endif
+
+#ifndef MG_HOSTS_FILE
+#define MG_HOSTS_FILE "/etc/hosts"
+#endif
+
+/* How often, in seconds, the hosts file is checked for changes */
+#ifndef MG_HOSTS_CHECK_INTERVAL
+#define MG_HOSTS_CHECK_INTERVAL 1
+#endif
+
 enum mg_resolve_err {
   MG_RESOLVE_OK = 0,
   MG_RESOLVE_NO_ANSWERS = 1,
@@ -3584,6 +3824,16 @@ int mg_resolve_async(struct mg_mgr *mgr, const char *name, int query,
  *   NULL);
  * mg_dns_parse_record_data(msg, rr, &ina, sizeof(ina));
  * ----
+ *
+ * Answers are cached per manager for their TTL (clamped to
+ * `MG_DNS_CACHE_MIN_TTL`..`MG_DNS_CACHE_MAX_TTL`), names that do not exist
+ * or have no record of the asked type (NXDOMAIN, NODATA) for
+ * `MG_DNS_NEGATIVE_TTL` seconds. Other failures, like SERVFAIL or a garbled
+ * reply, are retried and never cached. A cached answer is delivered by the next
+ * `mg_mgr_poll()`, never before this function returns. Lookups of a name that
+ * is already being resolved wait for the query in flight instead of sending
+ * another one; for these `dns_conn` is set to NULL. A query whose last
+ * waiting connection timed out (see `mg_set_timer()`) is dropped.
  */
 int mg_resolve_async_opt(struct mg_mgr *mgr, const char *name, int query,
                          mg_resolve_callback_t cb, void *data,
@@ -3592,6 +3842,11 @@ int mg_resolve_async_opt(struct mg_mgr *mgr, const char *name, int query,
 /*
  * Resolve a name from `/etc/hosts`.
  *
+ * This reads the whole file on every call. Connections made with
+ * `mg_connect()` use a parsed copy kept by their manager instead, which is
+ * re-read when the file's modification time or size changes, checked at most
+ * every `MG_HOSTS_CHECK_INTERVAL` seconds.
+ *
  * Returns 0 on success, -1 on failure.
  */
 int mg_resolve_from_hosts_file(const char *host, union socket_address *usa);
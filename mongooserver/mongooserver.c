@@ -17,6 +17,8 @@
 #include "mongoose.h"
 
 static const char *s_http_port = "8888";
+static const char *s_proxy = NULL;
+static const char *s_metrics_uri = NULL;
 static int s_sig_num = 0;
 static struct mg_serve_http_opts s_http_server_opts;
 
@@ -30,6 +32,7 @@ static void ev_handler ( struct mg_connection *nc, int ev, void *ev_data )
 {
     struct http_message *hm = ( struct http_message * ) ev_data;
     switch ( ev ) {
+    case MG_EV_HTTP_PUT_REQUEST:
     case MG_EV_HTTP_REQUEST:
         mg_serve_http ( nc, hm, s_http_server_opts );
         break;
@@ -53,13 +56,35 @@ int main ( int argc, char const *argv[] )
             s_http_server_opts.document_root = argv[++i];
         } else if ( strcmp ( argv[i], "-p" ) == 0 || strcmp ( argv[i], "--port" ) == 0 ) {
             s_http_port = argv[++i];
+        } else if ( strcmp ( argv[i], "-l" ) == 0 || strcmp ( argv[i], "--rate-limit" ) == 0 ) {
+            s_http_server_opts.rate_limit = argv[++i];
+        } else if ( strcmp ( argv[i], "-x" ) == 0 || strcmp ( argv[i], "--proxy" ) == 0 ) {
+            s_proxy = argv[++i];
+        } else if ( strcmp ( argv[i], "-u" ) == 0 || strcmp ( argv[i], "--upload" ) == 0 ) {
+            s_http_server_opts.dav_auth_file = argv[++i];
+        } else if ( strcmp ( argv[i], "-m" ) == 0 || strcmp ( argv[i], "--metrics" ) == 0 ) {
+            s_metrics_uri = argv[++i];
         } else if ( strcmp ( argv[i], "-h" ) == 0 || strcmp ( argv[i], "--help" ) == 0 ) {
-            printf ( "\n  %s -r [dir] -p [port]\n\n", argv[0] );
+            printf ( "\n  %s -r [dir] -p [port] -l [limits] -x [proxies] -u [auth] -m [uri]\n\n", argv[0] );
+            printf ( "  limits: comma-separated key=rate in bytes/s (k/m/g suffix),\n"
+                     "          key is '*' (all clients), 'ip', 'conn' or a URI prefix\n"
+                     "          e.g. -l '*=10m,ip=2m,/iso/=4m'\n" );
+            printf ( "  proxies: comma-separated prefix=upstream URL\n"
+                     "          e.g. -x '/api=http://127.0.0.1:9000'\n" );
+            printf ( "  auth: htdigest file allowing PUT/DELETE/MKCOL/MOVE uploads,\n"
+                     "        or '-' to allow them without authentication\n" );
+            printf ( "  uri: serve Prometheus request metrics at this URI,\n"
+                     "       e.g. -m /metrics\n\n" );
             return 0;
         }
     }
 
 
+    /* Uploads go to the document root */
+    if ( s_http_server_opts.dav_auth_file != NULL ) {
+        s_http_server_opts.dav_document_root = s_http_server_opts.document_root;
+    }
+
     /* detect the document root directory */
     const char* folderr = s_http_server_opts.document_root;
     struct stat sb = { 0 };
@@ -80,6 +105,32 @@ int main ( int argc, char const *argv[] )
     }
     mg_set_protocol_http_websocket ( nc );
 
+    /* Register reverse proxy prefixes */
+    if ( s_proxy != NULL ) {
+        struct mg_str prefix, upstream;
+        const char *list = s_proxy;
+        char prefix_buf[256], upstream_buf[256];
+
+        while ( ( list = mg_next_comma_list_entry ( list, &prefix, &upstream ) ) != NULL ) {
+            if ( upstream.len == 0 || prefix.len >= sizeof ( prefix_buf ) ||
+                 upstream.len >= sizeof ( upstream_buf ) ) {
+                fprintf ( stderr, "bad proxy '%.*s', expected prefix=upstream\n",
+                          ( int ) prefix.len, prefix.p );
+                mg_mgr_free ( &mgr );
+                return EXIT_FAILURE;
+            }
+            snprintf ( prefix_buf, sizeof ( prefix_buf ), "%.*s", ( int ) prefix.len, prefix.p );
+            snprintf ( upstream_buf, sizeof ( upstream_buf ), "%.*s", ( int ) upstream.len, upstream.p );
+            mg_register_http_proxy ( nc, prefix_buf, upstream_buf );
+            printf ( "Proxying %s to %s\n", prefix_buf, upstream_buf );
+        }
+    }
+
+    /* Expose request counters and latencies */
+    if ( s_metrics_uri != NULL ) {
+        mg_register_http_endpoint ( nc, s_metrics_uri, mg_http_metrics_handler );
+    }
+
     /* Handle with signals */
     signal ( SIGINT, signal_handler );
     signal ( SIGTERM, signal_handler );